@@ -0,0 +1,187 @@
+/*!
+ * @file Example21_TxQueueMirror.ino
+ * 
+ * @mainpage SparkFun Swarm Satellite Arduino Library
+ * 
+ * @section intro_sec Examples
+ * 
+ * This example shows how to:
+ *   Enable the local mirror of the modem's transmit queue
+ *   Resynchronise the mirror with the modem
+ *   Read the queue depth and the pending message IDs without talking to the modem
+ *   Read the enqueue-to-sent latency of the transmitted messages
+ * 
+ * Want to support open source hardware? Buy a board from SparkFun!
+ * SparkX Swarm Serial Breakout : https://www.sparkfun.com/products/19236
+ * 
+ * @section author Author
+ * 
+ * This library was written by:
+ * Paul Clark
+ * SparkFun Electronics
+ * October 2026
+ * 
+ * @section license License
+ * 
+ * MIT: please see LICENSE.md for the full license information
+ * 
+ */
+
+#include <SparkFun_Swarm_Satellite_Arduino_Library.h> //Click here to get the library:  http://librarymanager/All#SparkFun_Swarm_Satellite
+
+SWARM_M138 mySwarm;
+#define swarmSerial Serial1 // Use Serial1 to communicate with the modem. Change this if required.
+
+// If you are using the Swarm Satellite Transceiver MicroMod Function Board:
+//
+// The Function Board has an onboard power switch which controls the power to the modem.
+// The power is disabled by default.
+// To enable the power, you need to pull the correct PWR_EN pin high.
+//
+// Uncomment and adapt a line to match your Main Board and Processor configuration:
+//#define swarmPowerEnablePin A1 // MicroMod Main Board Single (DEV-18575) : with a Processor Board that supports A1 as an output
+//#define swarmPowerEnablePin 39 // MicroMod Main Board Single (DEV-18575) : with e.g. the Teensy Processor Board using pin 39 (SDIO_DATA2) to control the power
+//#define swarmPowerEnablePin 4  // MicroMod Main Board Single (DEV-18575) : with e.g. the Artemis Processor Board using pin 4 (SDIO_DATA2) to control the power
+//#define swarmPowerEnablePin G5 // MicroMod Main Board Double (DEV-18576) : Slot 0 with the ALT_PWR_EN0 set to G5<->PWR_EN0
+//#define swarmPowerEnablePin G6 // MicroMod Main Board Double (DEV-18576) : Slot 1 with the ALT_PWR_EN1 set to G6<->PWR_EN1
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void setup()
+{
+  // Swarm Satellite Transceiver MicroMod Function Board PWR_EN
+  #ifdef swarmPowerEnablePin
+  pinMode(swarmPowerEnablePin, OUTPUT); // Enable modem power 
+  digitalWrite(swarmPowerEnablePin, HIGH);
+  #endif
+
+  delay(1000);
+  
+  Serial.begin(115200);
+  while (!Serial)
+    ; // Wait for the user to open the Serial console
+  Serial.println(F("Swarm Satellite example"));
+  Serial.println();
+
+  //mySwarm.enableDebugging(); // Uncomment this line to enable debug messages on Serial
+
+  bool modemBegun = mySwarm.begin(swarmSerial); // Begin communication with the modem
+  
+  while (!modemBegun) // If the begin failed, keep trying to begin communication with the modem
+  {
+    Serial.println(F("Could not communicate with the modem. It may still be booting..."));
+    delay(2000);
+    modemBegun = mySwarm.begin(swarmSerial);
+  }
+
+  // Enable the TX queue mirror. It can hold up to 16 message IDs
+  if (!mySwarm.enableTxQueueMirror(16))
+  {
+    Serial.println(F("Could not allocate memory for the TX queue mirror! Freezing..."));
+    while (1)
+      ;
+  }
+
+  // Count any unsent messages which were queued before the mirror was enabled
+  Swarm_M138_Error_e err = mySwarm.syncTxQueueMirror();
+  if (err != SWARM_M138_SUCCESS)
+  {
+    Serial.print(F("syncTxQueueMirror failed: "));
+    Serial.println(mySwarm.modemErrorString(err)); // Convert the error into printable text
+  }
+
+  Serial.print(F("There are "));
+  Serial.print(mySwarm.getTxQueueDepth());
+  Serial.println(F(" unsent messages in the TX queue"));
+
+  // Queue a message. The mirror will track it until the modem sends it
+  uint64_t id;
+  err = mySwarm.transmitText("Hello World!", &id);
+  if (err == SWARM_M138_SUCCESS)
+  {
+    Serial.print(F("The message has been added to the transmit queue. The message ID is "));
+    serialPrintUint64_t(id);
+    Serial.println();
+  }
+  else
+  {
+    Serial.print(F("Swarm communication error: "));
+    Serial.println(mySwarm.modemErrorString(err)); // Convert the error into printable text
+  }
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void loop()
+{
+  mySwarm.checkUnsolicitedMsg(); // Process any $TD SENT messages. This updates the mirror
+
+  static unsigned long lastPrint = 0;
+  if (millis() - lastPrint < 10000) // Print the queue every 10 seconds
+    return;
+  lastPrint = millis();
+
+  // The depth and the IDs come from the mirror. There is no need to talk to the modem
+  Serial.print(F("Unsent messages: "));
+  Serial.print(mySwarm.getTxQueueDepth());
+
+  uint64_t ids[16];
+  uint16_t numIDs = mySwarm.getTxQueueMirrorIDs(ids, 16);
+  for (uint16_t i = 0; i < numIDs; i++)
+  {
+    Serial.print(F(" "));
+    serialPrintUint64_t(ids[i]);
+  }
+  Serial.println();
+
+  Swarm_M138_TX_Latency_t latency;
+  mySwarm.getTxQueueLatency(&latency);
+  if (latency.sent > 0)
+  {
+    Serial.print(F("Messages sent: "));
+    Serial.print(latency.sent);
+    Serial.print(F("  Latency (s): last "));
+    Serial.print(latency.last / 1000);
+    Serial.print(F("  min "));
+    Serial.print(latency.minimum / 1000);
+    Serial.print(F("  max "));
+    Serial.print(latency.maximum / 1000);
+    Serial.print(F("  mean "));
+    Serial.println(latency.mean / 1000);
+  }
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void serialPrintUint64_t(uint64_t theNum)
+{
+  // Convert uint64_t to string
+  // Based on printLLNumber by robtillaart
+  // https://forum.arduino.cc/index.php?topic=143584.msg1519824#msg1519824
+  
+  char rev[21]; // Char array to hold to theNum (reversed order)
+  char fwd[21]; // Char array to hold to theNum (correct order)
+  unsigned int i = 0;
+  if (theNum == 0ULL) // if theNum is zero, set fwd to "0"
+  {
+    fwd[0] = '0';
+    fwd[1] = 0; // mark the end with a NULL
+  }
+  else
+  {
+    while (theNum > 0)
+    {
+      rev[i++] = (theNum % 10) + '0'; // divide by 10, convert the remainder to char
+      theNum /= 10; // divide by 10
+    }
+    unsigned int j = 0;
+    while (i > 0)
+    {
+      fwd[j++] = rev[--i]; // reverse the order
+      fwd[j] = 0; // mark the end with a NULL
+    }
+  }
+
+  Serial.print(fwd);
+}
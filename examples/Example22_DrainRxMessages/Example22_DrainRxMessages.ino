@@ -0,0 +1,156 @@
+/*!
+ * @file Example22_DrainRxMessages.ino
+ * 
+ * @mainpage SparkFun Swarm Satellite Arduino Library
+ * 
+ * @section intro_sec Examples
+ * 
+ * This example shows how to:
+ *   Read all of the unread messages in one go, as binary data
+ *   Delete the read messages once they have been processed
+ * 
+ * Want to support open source hardware? Buy a board from SparkFun!
+ * SparkX Swarm Serial Breakout : https://www.sparkfun.com/products/19236
+ * 
+ * @section author Author
+ * 
+ * This library was written by:
+ * Paul Clark
+ * SparkFun Electronics
+ * October 2026
+ * 
+ * @section license License
+ * 
+ * MIT: please see LICENSE.md for the full license information
+ * 
+ */
+
+#include <SparkFun_Swarm_Satellite_Arduino_Library.h> //Click here to get the library:  http://librarymanager/All#SparkFun_Swarm_Satellite
+
+SWARM_M138 mySwarm;
+#define swarmSerial Serial1 // Use Serial1 to communicate with the modem. Change this if required.
+
+// If you are using the Swarm Satellite Transceiver MicroMod Function Board:
+//
+// The Function Board has an onboard power switch which controls the power to the modem.
+// The power is disabled by default.
+// To enable the power, you need to pull the correct PWR_EN pin high.
+//
+// Uncomment and adapt a line to match your Main Board and Processor configuration:
+//#define swarmPowerEnablePin A1 // MicroMod Main Board Single (DEV-18575) : with a Processor Board that supports A1 as an output
+//#define swarmPowerEnablePin 39 // MicroMod Main Board Single (DEV-18575) : with e.g. the Teensy Processor Board using pin 39 (SDIO_DATA2) to control the power
+//#define swarmPowerEnablePin 4  // MicroMod Main Board Single (DEV-18575) : with e.g. the Artemis Processor Board using pin 4 (SDIO_DATA2) to control the power
+//#define swarmPowerEnablePin G5 // MicroMod Main Board Double (DEV-18576) : Slot 0 with the ALT_PWR_EN0 set to G5<->PWR_EN0
+//#define swarmPowerEnablePin G6 // MicroMod Main Board Double (DEV-18576) : Slot 1 with the ALT_PWR_EN1 set to G6<->PWR_EN1
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+// Callback: printMessage will be called once for each unread message
+// data points to the binary message. It is only valid until printMessage returns
+// Keep this function short. The next message is being read while it runs
+void printMessage(const uint8_t *data, size_t len, const uint64_t *msg_id, const uint32_t *epoch, const uint16_t *appID)
+{
+  Serial.print(F("Message ID: "));
+  serialPrintUint64_t(*msg_id);
+  Serial.print(F("  Epoch: "));
+  Serial.print(*epoch);
+  Serial.print(F("  AppID: "));
+  Serial.print(*appID);
+  Serial.print(F("  Length: "));
+  Serial.print(len);
+  Serial.print(F("  Data: "));
+  for (size_t i = 0; i < len; i++)
+  {
+    if (data[i] < 0x10) Serial.print(F("0"));
+    Serial.print(data[i], HEX);
+  }
+  Serial.println();
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void setup()
+{
+  // Swarm Satellite Transceiver MicroMod Function Board PWR_EN
+  #ifdef swarmPowerEnablePin
+  pinMode(swarmPowerEnablePin, OUTPUT); // Enable modem power 
+  digitalWrite(swarmPowerEnablePin, HIGH);
+  #endif
+
+  delay(1000);
+  
+  Serial.begin(115200);
+  while (!Serial)
+    ; // Wait for the user to open the Serial console
+  Serial.println(F("Swarm Satellite example"));
+  Serial.println();
+
+  //mySwarm.enableDebugging(); // Uncomment this line to enable debug messages on Serial
+
+  bool modemBegun = mySwarm.begin(swarmSerial); // Begin communication with the modem
+  
+  while (!modemBegun) // If the begin failed, keep trying to begin communication with the modem
+  {
+    Serial.println(F("Could not communicate with the modem. It may still be booting..."));
+    delay(2000);
+    modemBegun = mySwarm.begin(swarmSerial);
+  }
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void loop()
+{
+  // Read all of the unread messages. Delete them once they have been read
+  uint16_t drained;
+  Swarm_M138_Error_e err = mySwarm.drainRxMessages(&printMessage, 0xFFFF, &drained, true);
+
+  if (err == SWARM_M138_SUCCESS)
+  {
+    Serial.print(F("Read "));
+    Serial.print(drained);
+    Serial.println(F(" messages"));
+  }
+  else
+  {
+    Serial.print(F("Swarm communication error: "));
+    Serial.println(mySwarm.modemErrorString(err)); // Convert the error into printable text
+  }
+
+  delay(60000); // Check again in one minute
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void serialPrintUint64_t(uint64_t theNum)
+{
+  // Convert uint64_t to string
+  // Based on printLLNumber by robtillaart
+  // https://forum.arduino.cc/index.php?topic=143584.msg1519824#msg1519824
+  
+  char rev[21]; // Char array to hold to theNum (reversed order)
+  char fwd[21]; // Char array to hold to theNum (correct order)
+  unsigned int i = 0;
+  if (theNum == 0ULL) // if theNum is zero, set fwd to "0"
+  {
+    fwd[0] = '0';
+    fwd[1] = 0; // mark the end with a NULL
+  }
+  else
+  {
+    while (theNum > 0)
+    {
+      rev[i++] = (theNum % 10) + '0'; // divide by 10, convert the remainder to char
+      theNum /= 10; // divide by 10
+    }
+    unsigned int j = 0;
+    while (i > 0)
+    {
+      fwd[j++] = rev[--i]; // reverse the order
+      fwd[j] = 0; // mark the end with a NULL
+    }
+  }
+
+  Serial.print(fwd);
+}
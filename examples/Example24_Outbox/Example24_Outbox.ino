@@ -0,0 +1,203 @@
+/*!
+ * @file Example24_Outbox.ino
+ * 
+ * @mainpage SparkFun Swarm Satellite Arduino Library
+ * 
+ * @section intro_sec Examples
+ * 
+ * This example shows how to:
+ *   Store messages in an outbox on SD card, so they survive a reset
+ *   Trickle the messages into the modem's transmit queue
+ * 
+ * The outbox uses the SWARM_M138_Storage interface. This example implements it using the SD library.
+ * The same pattern can be used for LittleFS, SPIFFS, EEPROM, etc.
+ * 
+ * Want to support open source hardware? Buy a board from SparkFun!
+ * SparkX Swarm Serial Breakout : https://www.sparkfun.com/products/19236
+ * 
+ * @section author Author
+ * 
+ * This library was written by:
+ * Paul Clark
+ * SparkFun Electronics
+ * October 2026
+ * 
+ * @section license License
+ * 
+ * MIT: please see LICENSE.md for the full license information
+ * 
+ */
+
+#include <SparkFun_Swarm_Satellite_Arduino_Library.h> //Click here to get the library:  http://librarymanager/All#SparkFun_Swarm_Satellite
+
+SWARM_M138 mySwarm;
+#define swarmSerial Serial1 // Use Serial1 to communicate with the modem. Change this if required.
+
+#include <SPI.h>
+#include <SD.h>
+const int sdChipSelect = 10; // Change this to match your SD card chip select pin
+
+// If you are using the Swarm Satellite Transceiver MicroMod Function Board:
+//
+// The Function Board has an onboard power switch which controls the power to the modem.
+// The power is disabled by default.
+// To enable the power, you need to pull the correct PWR_EN pin high.
+//
+// Uncomment and adapt a line to match your Main Board and Processor configuration:
+//#define swarmPowerEnablePin A1 // MicroMod Main Board Single (DEV-18575) : with a Processor Board that supports A1 as an output
+//#define swarmPowerEnablePin 39 // MicroMod Main Board Single (DEV-18575) : with e.g. the Teensy Processor Board using pin 39 (SDIO_DATA2) to control the power
+//#define swarmPowerEnablePin 4  // MicroMod Main Board Single (DEV-18575) : with e.g. the Artemis Processor Board using pin 4 (SDIO_DATA2) to control the power
+//#define swarmPowerEnablePin G5 // MicroMod Main Board Double (DEV-18576) : Slot 0 with the ALT_PWR_EN0 set to G5<->PWR_EN0
+//#define swarmPowerEnablePin G6 // MicroMod Main Board Double (DEV-18576) : Slot 1 with the ALT_PWR_EN1 set to G6<->PWR_EN1
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+// An implementation of SWARM_M138_Storage which stores the outbox log in a file on SD card
+
+class SDStorage : public SWARM_M138_Storage
+{
+public:
+  SDStorage(const char *fileName) { _fileName = fileName; }
+
+  uint32_t size(void)
+  {
+    File logFile = SD.open(_fileName, FILE_READ);
+    if (!logFile)
+      return (0); // The file does not exist yet
+    uint32_t theSize = logFile.size();
+    logFile.close();
+    return (theSize);
+  }
+
+  bool read(uint32_t offset, uint8_t *data, uint16_t len)
+  {
+    File logFile = SD.open(_fileName, FILE_READ);
+    if (!logFile)
+      return (false);
+    bool success = logFile.seek(offset) && (logFile.read(data, len) == len);
+    logFile.close();
+    return (success);
+  }
+
+  bool append(const uint8_t *data, uint16_t len)
+  {
+#ifdef FILE_APPEND
+    File logFile = SD.open(_fileName, FILE_APPEND); // ESP32: FILE_WRITE would truncate the file
+#else
+    File logFile = SD.open(_fileName, FILE_WRITE); // FILE_WRITE appends
+#endif
+    if (!logFile)
+      return (false);
+    bool success = (logFile.write(data, len) == len);
+    logFile.close(); // Close the file so the data is written to the card
+    return (success);
+  }
+
+  bool clear(void)
+  {
+    if (SD.exists(_fileName))
+      return (SD.remove(_fileName));
+    return (true);
+  }
+
+  // discard is optional. Without it, the log is only trimmed once every message has been sent.
+  // A card has plenty of room, so it is not implemented here. See SWARM_M138_File_Storage in extras/host for one way to do it
+
+private:
+  const char *_fileName;
+};
+
+SDStorage outboxStorage("/OUTBOX.LOG");
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void setup()
+{
+  // Swarm Satellite Transceiver MicroMod Function Board PWR_EN
+  #ifdef swarmPowerEnablePin
+  pinMode(swarmPowerEnablePin, OUTPUT); // Enable modem power 
+  digitalWrite(swarmPowerEnablePin, HIGH);
+  #endif
+
+  delay(1000);
+  
+  Serial.begin(115200);
+  while (!Serial)
+    ; // Wait for the user to open the Serial console
+  Serial.println(F("Swarm Satellite example"));
+  Serial.println();
+
+  //mySwarm.enableDebugging(); // Uncomment this line to enable debug messages on Serial
+
+  bool modemBegun = mySwarm.begin(swarmSerial); // Begin communication with the modem
+  
+  while (!modemBegun) // If the begin failed, keep trying to begin communication with the modem
+  {
+    Serial.println(F("Could not communicate with the modem. It may still be booting..."));
+    delay(2000);
+    modemBegun = mySwarm.begin(swarmSerial);
+  }
+
+  if (!SD.begin(sdChipSelect))
+  {
+    Serial.println(F("Could not begin the SD card! Freezing..."));
+    while (1)
+      ;
+  }
+
+  // Begin the outbox. Any messages which were pending before the reset are recovered
+  // Keep at most 8 unsent messages in the modem's queue
+  if (!mySwarm.beginOutbox(&outboxStorage, 8))
+  {
+    Serial.println(F("Could not begin the outbox! Freezing..."));
+    while (1)
+      ;
+  }
+
+  Serial.print(F("The outbox contains "));
+  Serial.print(mySwarm.getOutboxCount());
+  Serial.println(F(" messages"));
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void loop()
+{
+  static unsigned long lastReading = 0;
+  static unsigned long lastService = 0;
+
+  if (millis() - lastReading > 300000) // Add a reading to the outbox every 5 minutes
+  {
+    lastReading = millis();
+
+    uint8_t reading[4];
+    unsigned long now = millis();
+    reading[0] = now >> 24; // Replace this with your sensor data
+    reading[1] = now >> 16;
+    reading[2] = now >> 8;
+    reading[3] = now;
+
+    Swarm_M138_Error_e err = mySwarm.outboxBinary(reading, sizeof(reading));
+    if (err == SWARM_M138_SUCCESS)
+    {
+      Serial.print(F("Reading added to the outbox. The outbox contains "));
+      Serial.print(mySwarm.getOutboxCount());
+      Serial.println(F(" messages"));
+    }
+    else
+      Serial.println(F("Could not add the reading to the outbox!"));
+  }
+
+  if (millis() - lastService > 60000) // Service the outbox every minute
+  {
+    lastService = millis();
+
+    Swarm_M138_Error_e err = mySwarm.serviceOutbox(); // Move messages into the modem if there is room
+    if (err != SWARM_M138_SUCCESS)
+    {
+      Serial.print(F("Swarm communication error: "));
+      Serial.println(mySwarm.modemErrorString(err)); // Convert the error into printable text
+    }
+  }
+}
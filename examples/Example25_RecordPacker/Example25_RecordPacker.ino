@@ -0,0 +1,147 @@
+/*!
+ * @file Example25_RecordPacker.ino
+ * 
+ * @mainpage SparkFun Swarm Satellite Arduino Library
+ * 
+ * @section intro_sec Examples
+ * 
+ * This example shows how to:
+ *   Pack many small sensor readings into one 192-byte packet
+ *   Send the packet when it is full, or when the oldest reading is one hour old
+ *   Split a packet back into its readings
+ * 
+ * Want to support open source hardware? Buy a board from SparkFun!
+ * SparkX Swarm Serial Breakout : https://www.sparkfun.com/products/19236
+ * 
+ * @section author Author
+ * 
+ * This library was written by:
+ * Paul Clark
+ * SparkFun Electronics
+ * October 2026
+ * 
+ * @section license License
+ * 
+ * MIT: please see LICENSE.md for the full license information
+ * 
+ */
+
+#include <SparkFun_Swarm_Satellite_Arduino_Library.h> //Click here to get the library:  http://librarymanager/All#SparkFun_Swarm_Satellite
+
+SWARM_M138 mySwarm;
+#define swarmSerial Serial1 // Use Serial1 to communicate with the modem. Change this if required.
+
+// If you are using the Swarm Satellite Transceiver MicroMod Function Board:
+//
+// The Function Board has an onboard power switch which controls the power to the modem.
+// The power is disabled by default.
+// To enable the power, you need to pull the correct PWR_EN pin high.
+//
+// Uncomment and adapt a line to match your Main Board and Processor configuration:
+//#define swarmPowerEnablePin A1 // MicroMod Main Board Single (DEV-18575) : with a Processor Board that supports A1 as an output
+//#define swarmPowerEnablePin 39 // MicroMod Main Board Single (DEV-18575) : with e.g. the Teensy Processor Board using pin 39 (SDIO_DATA2) to control the power
+//#define swarmPowerEnablePin 4  // MicroMod Main Board Single (DEV-18575) : with e.g. the Artemis Processor Board using pin 4 (SDIO_DATA2) to control the power
+//#define swarmPowerEnablePin G5 // MicroMod Main Board Double (DEV-18576) : Slot 0 with the ALT_PWR_EN0 set to G5<->PWR_EN0
+//#define swarmPowerEnablePin G6 // MicroMod Main Board Double (DEV-18576) : Slot 1 with the ALT_PWR_EN1 set to G6<->PWR_EN1
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+#define READING_TEMPERATURE 1 // Record types. These are passed to the unpacker callback
+#define READING_BATTERY 2
+
+// Callback: printRecord will be called once for each record by unpackRecords
+void printRecord(uint8_t type, const uint8_t *data, uint8_t len)
+{
+  Serial.print(F("Record type: "));
+  Serial.print(type);
+  Serial.print(F("  Length: "));
+  Serial.print(len);
+  Serial.print(F("  Data: "));
+  for (uint8_t i = 0; i < len; i++)
+  {
+    if (data[i] < 0x10) Serial.print(F("0"));
+    Serial.print(data[i], HEX);
+  }
+  Serial.println();
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void setup()
+{
+  // Swarm Satellite Transceiver MicroMod Function Board PWR_EN
+  #ifdef swarmPowerEnablePin
+  pinMode(swarmPowerEnablePin, OUTPUT); // Enable modem power 
+  digitalWrite(swarmPowerEnablePin, HIGH);
+  #endif
+
+  delay(1000);
+  
+  Serial.begin(115200);
+  while (!Serial)
+    ; // Wait for the user to open the Serial console
+  Serial.println(F("Swarm Satellite example"));
+  Serial.println();
+
+  //mySwarm.enableDebugging(); // Uncomment this line to enable debug messages on Serial
+
+  bool modemBegun = mySwarm.begin(swarmSerial); // Begin communication with the modem
+  
+  while (!modemBegun) // If the begin failed, keep trying to begin communication with the modem
+  {
+    Serial.println(F("Could not communicate with the modem. It may still be booting..."));
+    delay(2000);
+    modemBegun = mySwarm.begin(swarmSerial);
+  }
+
+  // Enable the packer. Send the packet when the oldest reading is one hour old
+  if (!mySwarm.enablePacker(3600000UL))
+  {
+    Serial.println(F("Could not allocate memory for the packer! Freezing..."));
+    while (1)
+      ;
+  }
+
+  // Show how a packet is split into its records
+  const uint8_t examplePacket[] = { READING_TEMPERATURE, 2, 0x01, 0x2C, READING_BATTERY, 1, 0x5A };
+  mySwarm.unpackRecords(examplePacket, sizeof(examplePacket), &printRecord);
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void loop()
+{
+  mySwarm.checkUnsolicitedMsg(); // checkUnsolicitedMsg sends the packet when the oldest reading reaches its maximum age
+
+  static unsigned long lastReading = 0;
+  if (millis() - lastReading < 180000) // Take a reading every 3 minutes
+    return;
+  lastReading = millis();
+
+  uint8_t temperature[2];
+  int16_t temp = 300; // Replace this with your sensor data: e.g. 30.0C
+  temperature[0] = temp >> 8;
+  temperature[1] = temp & 0xFF;
+
+  Swarm_M138_Error_e err = mySwarm.packRecord(READING_TEMPERATURE, temperature, sizeof(temperature)); // Pack the reading. The packet is sent when it is full
+
+  if (err == SWARM_M138_SUCCESS)
+  {
+    Serial.print(F("Reading packed. The packet contains "));
+    Serial.print(mySwarm.getPackerLength());
+    Serial.println(F(" bytes"));
+
+    // The reading is packed even if the full packet could not be sent. Don't pack it again: the packet is kept and retried
+    if (mySwarm.getPackerFlushError() != SWARM_M138_SUCCESS)
+    {
+      Serial.print(F("The packet could not be sent: "));
+      Serial.println(mySwarm.modemErrorString(mySwarm.getPackerFlushError()));
+    }
+  }
+  else // The reading was not packed
+  {
+    Serial.print(F("Swarm communication error: "));
+    Serial.println(mySwarm.modemErrorString(err)); // Convert the error into printable text
+  }
+}
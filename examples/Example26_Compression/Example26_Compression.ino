@@ -0,0 +1,155 @@
+/*!
+ * @file Example26_Compression.ino
+ * 
+ * @mainpage SparkFun Swarm Satellite Arduino Library
+ * 
+ * @section intro_sec Examples
+ * 
+ * This example shows how to:
+ *   Compress text and binary payloads using LZSS with the static dictionary
+ *   Compress a series of sensor readings using delta / varint encoding
+ *   Benchmark the compression: the ratio and the time taken on your board
+ *   Send a compressed message
+ * 
+ * Want to support open source hardware? Buy a board from SparkFun!
+ * SparkX Swarm Serial Breakout : https://www.sparkfun.com/products/19236
+ * 
+ * @section author Author
+ * 
+ * This library was written by:
+ * Paul Clark
+ * SparkFun Electronics
+ * October 2026
+ * 
+ * @section license License
+ * 
+ * MIT: please see LICENSE.md for the full license information
+ * 
+ */
+
+#include <SparkFun_Swarm_Satellite_Arduino_Library.h> //Click here to get the library:  http://librarymanager/All#SparkFun_Swarm_Satellite
+
+SWARM_M138 mySwarm;
+#define swarmSerial Serial1 // Use Serial1 to communicate with the modem. Change this if required.
+
+// If you are using the Swarm Satellite Transceiver MicroMod Function Board:
+//
+// The Function Board has an onboard power switch which controls the power to the modem.
+// The power is disabled by default.
+// To enable the power, you need to pull the correct PWR_EN pin high.
+//
+// Uncomment and adapt a line to match your Main Board and Processor configuration:
+//#define swarmPowerEnablePin A1 // MicroMod Main Board Single (DEV-18575) : with a Processor Board that supports A1 as an output
+//#define swarmPowerEnablePin 39 // MicroMod Main Board Single (DEV-18575) : with e.g. the Teensy Processor Board using pin 39 (SDIO_DATA2) to control the power
+//#define swarmPowerEnablePin 4  // MicroMod Main Board Single (DEV-18575) : with e.g. the Artemis Processor Board using pin 4 (SDIO_DATA2) to control the power
+//#define swarmPowerEnablePin G5 // MicroMod Main Board Double (DEV-18576) : Slot 0 with the ALT_PWR_EN0 set to G5<->PWR_EN0
+//#define swarmPowerEnablePin G6 // MicroMod Main Board Double (DEV-18576) : Slot 1 with the ALT_PWR_EN1 set to G6<->PWR_EN1
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+// A small benchmark corpus
+
+const char corpusJSON[] = "{\"id\":17,\"ts\":1760745600,\"lat\":40.0150,\"lon\":-105.2705,\"alt\":1655,\"temp\":21.5,\"hum\":38,\"bat\":3.91}";
+const char corpusCSV[] = "2026-10-18T12:00:00Z,21.0,38,1013.2,3.91\n2026-10-18T12:05:00Z,21.1,38,1013.2,3.91\n"
+                         "2026-10-18T12:10:00Z,21.2,38,1013.2,3.91\n2026-10-18T12:15:00Z,21.3,38,1013.2,3.91\n";
+const char corpusNMEA[] = "$GPGGA,120000.00,4000.9000,N,10516.2300,W,1,08,0.9,1655.0,M,-21.0,M,,*47";
+
+uint8_t compressed[SWARM_M138_MAX_PACKET_LENGTH_BYTES];
+
+// Compress and decompress the data. Print the ratio and the time taken
+void benchmark(const __FlashStringHelper *name, const uint8_t *data, size_t len)
+{
+  size_t compressedLen = sizeof(compressed);
+  unsigned long start = micros();
+  Swarm_M138_Error_e err = mySwarm.compressPayload(data, len, compressed, &compressedLen);
+  unsigned long compressTime = micros() - start;
+
+  Serial.print(name);
+  if (err != SWARM_M138_SUCCESS)
+  {
+    Serial.println(F(": does not fit in one packet"));
+    return;
+  }
+
+  Serial.print(F(": in "));
+  Serial.print(len);
+  Serial.print(F("  out "));
+  Serial.print(compressedLen);
+  Serial.print(F("  ratio "));
+  Serial.print((float)len / (float)compressedLen);
+  Serial.print(F("  mode "));
+  Serial.print(compressed[0]);
+  Serial.print(F("  compress (us) "));
+  Serial.println(compressTime);
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void setup()
+{
+  // Swarm Satellite Transceiver MicroMod Function Board PWR_EN
+  #ifdef swarmPowerEnablePin
+  pinMode(swarmPowerEnablePin, OUTPUT); // Enable modem power 
+  digitalWrite(swarmPowerEnablePin, HIGH);
+  #endif
+
+  delay(1000);
+  
+  Serial.begin(115200);
+  while (!Serial)
+    ; // Wait for the user to open the Serial console
+  Serial.println(F("Swarm Satellite example"));
+  Serial.println();
+
+  // The compression does not need the modem. Run the benchmark first
+  benchmark(F("JSON"), (const uint8_t *)corpusJSON, strlen(corpusJSON));
+  benchmark(F("CSV"), (const uint8_t *)corpusCSV, strlen(corpusCSV));
+  benchmark(F("NMEA"), (const uint8_t *)corpusNMEA, strlen(corpusNMEA));
+
+  int32_t series[48]; // 48 temperature readings (x100) which change slowly
+  for (int i = 0; i < 48; i++)
+    series[i] = 2150 + (i % 7) - 3 + (i / 4);
+  size_t compressedLen = sizeof(compressed);
+  unsigned long start = micros();
+  mySwarm.compressSeries(series, 48, compressed, &compressedLen);
+  unsigned long compressTime = micros() - start;
+  Serial.print(F("Series: in "));
+  Serial.print(sizeof(series));
+  Serial.print(F("  out "));
+  Serial.print(compressedLen);
+  Serial.print(F("  ratio "));
+  Serial.print((float)sizeof(series) / (float)compressedLen);
+  Serial.print(F("  compress (us) "));
+  Serial.println(compressTime);
+  Serial.println();
+
+  //mySwarm.enableDebugging(); // Uncomment this line to enable debug messages on Serial
+
+  bool modemBegun = mySwarm.begin(swarmSerial); // Begin communication with the modem
+  
+  while (!modemBegun) // If the begin failed, keep trying to begin communication with the modem
+  {
+    Serial.println(F("Could not communicate with the modem. It may still be booting..."));
+    delay(2000);
+    modemBegun = mySwarm.begin(swarmSerial);
+  }
+
+  // Compress and queue the JSON message
+  uint64_t id;
+  Swarm_M138_Error_e err = mySwarm.transmitCompressed((const uint8_t *)corpusJSON, strlen(corpusJSON), &id);
+  if (err == SWARM_M138_SUCCESS)
+    Serial.println(F("The compressed message has been added to the transmit queue"));
+  else
+  {
+    Serial.print(F("Swarm communication error: "));
+    Serial.println(mySwarm.modemErrorString(err)); // Convert the error into printable text
+  }
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void loop()
+{
+  // Nothing to do here
+}
@@ -0,0 +1,144 @@
+/*!
+ * @file Example27_Fragmentation.ino
+ * 
+ * @mainpage SparkFun Swarm Satellite Arduino Library
+ * 
+ * @section intro_sec Examples
+ * 
+ * This example shows how to:
+ *   Send a payload which is larger than one packet, split into fragments
+ *   Reassemble fragmented messages sent to the modem
+ *   Report the missing fragments if a message times out
+ * 
+ * Want to support open source hardware? Buy a board from SparkFun!
+ * SparkX Swarm Serial Breakout : https://www.sparkfun.com/products/19236
+ * 
+ * @section author Author
+ * 
+ * This library was written by:
+ * Paul Clark
+ * SparkFun Electronics
+ * October 2026
+ * 
+ * @section license License
+ * 
+ * MIT: please see LICENSE.md for the full license information
+ * 
+ */
+
+#include <SparkFun_Swarm_Satellite_Arduino_Library.h> //Click here to get the library:  http://librarymanager/All#SparkFun_Swarm_Satellite
+
+SWARM_M138 mySwarm;
+#define swarmSerial Serial1 // Use Serial1 to communicate with the modem. Change this if required.
+
+// If you are using the Swarm Satellite Transceiver MicroMod Function Board:
+//
+// The Function Board has an onboard power switch which controls the power to the modem.
+// The power is disabled by default.
+// To enable the power, you need to pull the correct PWR_EN pin high.
+//
+// Uncomment and adapt a line to match your Main Board and Processor configuration:
+//#define swarmPowerEnablePin A1 // MicroMod Main Board Single (DEV-18575) : with a Processor Board that supports A1 as an output
+//#define swarmPowerEnablePin 39 // MicroMod Main Board Single (DEV-18575) : with e.g. the Teensy Processor Board using pin 39 (SDIO_DATA2) to control the power
+//#define swarmPowerEnablePin 4  // MicroMod Main Board Single (DEV-18575) : with e.g. the Artemis Processor Board using pin 4 (SDIO_DATA2) to control the power
+//#define swarmPowerEnablePin G5 // MicroMod Main Board Double (DEV-18576) : Slot 0 with the ALT_PWR_EN0 set to G5<->PWR_EN0
+//#define swarmPowerEnablePin G6 // MicroMod Main Board Double (DEV-18576) : Slot 1 with the ALT_PWR_EN1 set to G6<->PWR_EN1
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+// Callback: printReassembled will be called when all of the fragments of a message have arrived
+void printReassembled(const uint8_t *data, size_t len, uint8_t key, uint16_t channel)
+{
+  Serial.print(F("Reassembled message: key "));
+  Serial.print(key);
+  Serial.print(F("  channel "));
+  Serial.print(channel);
+  Serial.print(F("  length "));
+  Serial.println(len);
+}
+
+// Callback: printTimeout will be called if a partial message times out
+void printTimeout(uint8_t key, uint16_t channel, uint8_t count, const uint8_t *missing)
+{
+  Serial.print(F("Message timed out: key "));
+  Serial.print(key);
+  Serial.print(F("  missing fragments:"));
+  for (uint16_t i = 0; i < count; i++)
+  {
+    if (missing[i >> 3] & (1 << (i & 7)))
+    {
+      Serial.print(F(" "));
+      Serial.print(i);
+    }
+  }
+  Serial.println();
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void setup()
+{
+  // Swarm Satellite Transceiver MicroMod Function Board PWR_EN
+  #ifdef swarmPowerEnablePin
+  pinMode(swarmPowerEnablePin, OUTPUT); // Enable modem power 
+  digitalWrite(swarmPowerEnablePin, HIGH);
+  #endif
+
+  delay(1000);
+  
+  Serial.begin(115200);
+  while (!Serial)
+    ; // Wait for the user to open the Serial console
+  Serial.println(F("Swarm Satellite example"));
+  Serial.println();
+
+  //mySwarm.enableDebugging(); // Uncomment this line to enable debug messages on Serial
+
+  bool modemBegun = mySwarm.begin(swarmSerial); // Begin communication with the modem
+  
+  while (!modemBegun) // If the begin failed, keep trying to begin communication with the modem
+  {
+    Serial.println(F("Could not communicate with the modem. It may still be booting..."));
+    delay(2000);
+    modemBegun = mySwarm.begin(swarmSerial);
+  }
+
+  // Reassemble messages of up to 1000 bytes. Discard partial messages after 6 hours
+  if (!mySwarm.enableReassembly(1000, 21600000UL))
+  {
+    Serial.println(F("Could not allocate memory for reassembly! Freezing..."));
+    while (1)
+      ;
+  }
+  mySwarm.setReassembledCallback(&printReassembled);
+  mySwarm.setFragmentTimeoutCallback(&printTimeout);
+
+  // Enable message notifications so the fragments arrive as $RD messages
+  mySwarm.setMessageNotifications(true);
+
+  // Send a 500 byte payload. It will be split into three fragments
+  uint8_t payload[500];
+  for (int i = 0; i < 500; i++)
+    payload[i] = i & 0xFF;
+
+  uint8_t key;
+  Swarm_M138_Error_e err = mySwarm.transmitFragmented(payload, sizeof(payload), &key);
+  if (err == SWARM_M138_SUCCESS)
+  {
+    Serial.print(F("The fragments have been added to the transmit queue. The message key is "));
+    Serial.println(key);
+  }
+  else
+  {
+    Serial.print(F("Swarm communication error: "));
+    Serial.println(mySwarm.modemErrorString(err)); // Convert the error into printable text
+  }
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void loop()
+{
+  mySwarm.checkUnsolicitedMsg(); // Process any $RD fragments. Check for timeouts
+}
@@ -0,0 +1,153 @@
+/*!
+ * @file Example28_TxScheduler.ino
+ * 
+ * @mainpage SparkFun Swarm Satellite Arduino Library
+ * 
+ * @section intro_sec Examples
+ * 
+ * This example shows how to:
+ *   Use the priority transmit scheduler to send alarm, telemetry and bulk messages
+ *   Set the hold duration and maximum waiting age for each priority class
+ *   Alarms are moved to the front of the modem's queue. Bulk messages are sent last
+ * 
+ * Want to support open source hardware? Buy a board from SparkFun!
+ * SparkX Swarm Serial Breakout : https://www.sparkfun.com/products/19236
+ * 
+ * @section author Author
+ * 
+ * This library was written by:
+ * Paul Clark
+ * SparkFun Electronics
+ * October 2026
+ * 
+ * @section license License
+ * 
+ * MIT: please see LICENSE.md for the full license information
+ * 
+ */
+
+#include <SparkFun_Swarm_Satellite_Arduino_Library.h> //Click here to get the library:  http://librarymanager/All#SparkFun_Swarm_Satellite
+
+SWARM_M138 mySwarm;
+#define swarmSerial Serial1 // Use Serial1 to communicate with the modem. Change this if required.
+
+// If you are using the Swarm Satellite Transceiver MicroMod Function Board:
+//
+// The Function Board has an onboard power switch which controls the power to the modem.
+// The power is disabled by default.
+// To enable the power, you need to pull the correct PWR_EN pin high.
+//
+// Uncomment and adapt a line to match your Main Board and Processor configuration:
+//#define swarmPowerEnablePin A1 // MicroMod Main Board Single (DEV-18575) : with a Processor Board that supports A1 as an output
+//#define swarmPowerEnablePin 39 // MicroMod Main Board Single (DEV-18575) : with e.g. the Teensy Processor Board using pin 39 (SDIO_DATA2) to control the power
+//#define swarmPowerEnablePin 4  // MicroMod Main Board Single (DEV-18575) : with e.g. the Artemis Processor Board using pin 4 (SDIO_DATA2) to control the power
+//#define swarmPowerEnablePin G5 // MicroMod Main Board Double (DEV-18576) : Slot 0 with the ALT_PWR_EN0 set to G5<->PWR_EN0
+//#define swarmPowerEnablePin G6 // MicroMod Main Board Double (DEV-18576) : Slot 1 with the ALT_PWR_EN1 set to G6<->PWR_EN1
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+unsigned long lastTelemetry = 0;
+unsigned long lastBulk = 0;
+
+#define alarmPin 2 // Pull this pin low to send an alarm
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void setup()
+{
+  // Swarm Satellite Transceiver MicroMod Function Board PWR_EN
+  #ifdef swarmPowerEnablePin
+  pinMode(swarmPowerEnablePin, OUTPUT); // Enable modem power 
+  digitalWrite(swarmPowerEnablePin, HIGH);
+  #endif
+
+  pinMode(alarmPin, INPUT_PULLUP);
+
+  delay(1000);
+  
+  Serial.begin(115200);
+  while (!Serial)
+    ; // Wait for the user to open the Serial console
+  Serial.println(F("Swarm Satellite example"));
+  Serial.println();
+
+  //mySwarm.enableDebugging(); // Uncomment this line to enable debug messages on Serial
+
+  bool modemBegun = mySwarm.begin(swarmSerial); // Begin communication with the modem
+  
+  while (!modemBegun) // If the begin failed, keep trying to begin communication with the modem
+  {
+    Serial.println(F("Could not communicate with the modem. It may still be booting..."));
+    delay(2000);
+    modemBegun = mySwarm.begin(swarmSerial);
+  }
+
+  // Hold up to 8 messages. Keep at most 4 unsent messages in the modem's queue
+  if (!mySwarm.enableTxScheduler(8, 4))
+  {
+    Serial.println(F("Could not allocate memory for the scheduler! Freezing..."));
+    while (1)
+      ;
+  }
+
+  // Alarms: the modem holds them for 24 hours. Never discarded while waiting
+  mySwarm.setTxPriorityPolicy(SWARM_M138_TX_PRIORITY_ALARM, 86400, 0);
+  // Telemetry: the modem holds them for 12 hours. Discarded if they wait longer than 2 hours for space in the modem
+  mySwarm.setTxPriorityPolicy(SWARM_M138_TX_PRIORITY_TELEMETRY, 43200, 7200000UL);
+  // Bulk: the modem holds them for 7 days
+  mySwarm.setTxPriorityPolicy(SWARM_M138_TX_PRIORITY_BULK, 604800, 0);
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void loop()
+{
+  mySwarm.checkUnsolicitedMsg(); // Update the TX queue mirror when messages are sent
+  mySwarm.serviceTxScheduler(); // Move waiting messages into the modem
+
+  if (millis() - lastTelemetry > 900000UL) // Every 15 minutes
+  {
+    lastTelemetry = millis();
+    uint8_t telemetry[4] = { 0x01, 0x02, 0x03, 0x04 };
+    Swarm_M138_Error_e err = mySwarm.scheduleBinary(telemetry, sizeof(telemetry), SWARM_M138_TX_PRIORITY_TELEMETRY);
+    if (err != SWARM_M138_SUCCESS)
+    {
+      Serial.print(F("Could not schedule telemetry: "));
+      Serial.println(mySwarm.modemErrorString(err)); // Convert the error into printable text
+    }
+  }
+
+  if (millis() - lastBulk > 3600000UL) // Every hour
+  {
+    lastBulk = millis();
+    uint8_t bulk[150];
+    for (int i = 0; i < 150; i++)
+      bulk[i] = i;
+    mySwarm.scheduleBinary(bulk, sizeof(bulk), SWARM_M138_TX_PRIORITY_BULK);
+  }
+
+  if (digitalRead(alarmPin) == LOW)
+  {
+    const char alarm[] = "ALARM";
+    Swarm_M138_Error_e err = mySwarm.scheduleBinary((const uint8_t *)alarm, strlen(alarm), SWARM_M138_TX_PRIORITY_ALARM);
+    if (err == SWARM_M138_SUCCESS)
+      Serial.println(F("Alarm scheduled"));
+    else
+    {
+      Serial.print(F("Could not schedule the alarm: "));
+      Serial.println(mySwarm.modemErrorString(err)); // Convert the error into printable text
+    }
+    while (digitalRead(alarmPin) == LOW) // Wait for the pin to be released
+      delay(10);
+  }
+
+  Serial.print(F("Waiting or unsent: alarm "));
+  Serial.print(mySwarm.getScheduledCount(SWARM_M138_TX_PRIORITY_ALARM));
+  Serial.print(F("  telemetry "));
+  Serial.print(mySwarm.getScheduledCount(SWARM_M138_TX_PRIORITY_TELEMETRY));
+  Serial.print(F("  bulk "));
+  Serial.println(mySwarm.getScheduledCount(SWARM_M138_TX_PRIORITY_BULK));
+
+  delay(1000);
+}
@@ -0,0 +1,130 @@
+/*!
+ * @file Example29_RxDedup.ino
+ * 
+ * @mainpage SparkFun Swarm Satellite Arduino Library
+ * 
+ * @section intro_sec Examples
+ * 
+ * This example shows how to:
+ *   Enable the duplicate filter for received messages
+ *   Suppress repeated $RD messages, and messages which drainRxMessages has seen before
+ * 
+ * Want to support open source hardware? Buy a board from SparkFun!
+ * SparkX Swarm Serial Breakout : https://www.sparkfun.com/products/19236
+ * 
+ * @section author Author
+ * 
+ * This library was written by:
+ * Paul Clark
+ * SparkFun Electronics
+ * October 2026
+ * 
+ * @section license License
+ * 
+ * MIT: please see LICENSE.md for the full license information
+ * 
+ */
+
+#include <SparkFun_Swarm_Satellite_Arduino_Library.h> //Click here to get the library:  http://librarymanager/All#SparkFun_Swarm_Satellite
+
+SWARM_M138 mySwarm;
+#define swarmSerial Serial1 // Use Serial1 to communicate with the modem. Change this if required.
+
+// If you are using the Swarm Satellite Transceiver MicroMod Function Board:
+//
+// The Function Board has an onboard power switch which controls the power to the modem.
+// The power is disabled by default.
+// To enable the power, you need to pull the correct PWR_EN pin high.
+//
+// Uncomment and adapt a line to match your Main Board and Processor configuration:
+//#define swarmPowerEnablePin A1 // MicroMod Main Board Single (DEV-18575) : with a Processor Board that supports A1 as an output
+//#define swarmPowerEnablePin 39 // MicroMod Main Board Single (DEV-18575) : with e.g. the Teensy Processor Board using pin 39 (SDIO_DATA2) to control the power
+//#define swarmPowerEnablePin 4  // MicroMod Main Board Single (DEV-18575) : with e.g. the Artemis Processor Board using pin 4 (SDIO_DATA2) to control the power
+//#define swarmPowerEnablePin G5 // MicroMod Main Board Double (DEV-18576) : Slot 0 with the ALT_PWR_EN0 set to G5<->PWR_EN0
+//#define swarmPowerEnablePin G6 // MicroMod Main Board Double (DEV-18576) : Slot 1 with the ALT_PWR_EN1 set to G6<->PWR_EN1
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+// Callback: printMessage will be called when a new unsolicited message arrives.
+// Duplicates are suppressed before the callback is called.
+void printMessage(const uint16_t *appID, const int16_t *rssi, const int16_t *snr, const int16_t *fdev, const char *asciiHex)
+{
+  Serial.print(F("New $RD message: "));
+  Serial.println(asciiHex);
+}
+
+// Callback: printDrained will be called by drainRxMessages for each new message in the database.
+// Duplicates are suppressed before the callback is called.
+void printDrained(const uint8_t *data, size_t len, const uint64_t *msg_id, const uint32_t *epoch, const uint16_t *appID)
+{
+  Serial.print(F("New message from the database. Epoch: "));
+  Serial.print(*epoch);
+  Serial.print(F("  Length: "));
+  Serial.println(len);
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void setup()
+{
+  // Swarm Satellite Transceiver MicroMod Function Board PWR_EN
+  #ifdef swarmPowerEnablePin
+  pinMode(swarmPowerEnablePin, OUTPUT); // Enable modem power 
+  digitalWrite(swarmPowerEnablePin, HIGH);
+  #endif
+
+  delay(1000);
+  
+  Serial.begin(115200);
+  while (!Serial)
+    ; // Wait for the user to open the Serial console
+  Serial.println(F("Swarm Satellite example"));
+  Serial.println();
+
+  //mySwarm.enableDebugging(); // Uncomment this line to enable debug messages on Serial
+
+  bool modemBegun = mySwarm.begin(swarmSerial); // Begin communication with the modem
+  
+  while (!modemBegun) // If the begin failed, keep trying to begin communication with the modem
+  {
+    Serial.println(F("Could not communicate with the modem. It may still be booting..."));
+    delay(2000);
+    modemBegun = mySwarm.begin(swarmSerial);
+  }
+
+  // Remember the fingerprints of the last 32 messages.
+  // To suppress messages replayed after a reset too, pass a SWARM_M138_Storage
+  // (e.g. the SDStorage class from Example24_Outbox) as the second parameter.
+  if (!mySwarm.enableRxDedup(32))
+  {
+    Serial.println(F("Could not allocate memory for the duplicate filter! Freezing..."));
+    while (1)
+      ;
+  }
+
+  mySwarm.setReceiveMessageCallback(&printMessage); // Set up the callback for $RD messages
+  mySwarm.setMessageNotifications(true); // Enable the $RD notifications
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void loop()
+{
+  mySwarm.checkUnsolicitedMsg(); // Process any $RD messages
+
+  // Every 10 seconds, drain the unread messages from the modem's database.
+  // The filter only applies to $RD and drainRxMessages. readMessage always returns the message.
+  // $RD does not include the epoch, so a message which has already arrived as $RD is
+  // not recognised when it is drained. Process each message from one source only.
+  static unsigned long lastRead = 0;
+  if (millis() - lastRead > 10000)
+  {
+    lastRead = millis();
+
+    mySwarm.drainRxMessages(&printDrained);
+
+    Serial.print(F("Duplicates suppressed: "));
+    Serial.println(mySwarm.getRxDuplicateCount());
+  }
+}
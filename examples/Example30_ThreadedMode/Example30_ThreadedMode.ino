@@ -0,0 +1,127 @@
+/*!
+ * @file Example30_ThreadedMode.ino
+ * 
+ * @mainpage SparkFun Swarm Satellite Arduino Library
+ * 
+ * @section intro_sec Examples
+ * 
+ * This example shows how to:
+ *   Start threaded mode (ESP32 only): a FreeRTOS reader task owns the serial port
+ *   Keep collecting $RD messages while loop() is busy or waiting for a command
+ *   The callbacks are called from loop(), never from inside the reader task
+ * 
+ * Want to support open source hardware? Buy a board from SparkFun!
+ * SparkX Swarm Serial Breakout : https://www.sparkfun.com/products/19236
+ * 
+ * @section author Author
+ * 
+ * This library was written by:
+ * Paul Clark
+ * SparkFun Electronics
+ * October 2026
+ * 
+ * @section license License
+ * 
+ * MIT: please see LICENSE.md for the full license information
+ * 
+ */
+
+#ifndef ARDUINO_ARCH_ESP32
+#error "Threaded mode needs an ESP32"
+#endif
+
+#include <SparkFun_Swarm_Satellite_Arduino_Library.h> //Click here to get the library:  http://librarymanager/All#SparkFun_Swarm_Satellite
+
+SWARM_M138 mySwarm;
+#define swarmSerial Serial1 // Use Serial1 to communicate with the modem. Change this if required.
+
+// If you are using the Swarm Satellite Transceiver MicroMod Function Board:
+//
+// The Function Board has an onboard power switch which controls the power to the modem.
+// The power is disabled by default.
+// To enable the power, you need to pull the correct PWR_EN pin high.
+//
+// Uncomment and adapt a line to match your Main Board and Processor configuration:
+//#define swarmPowerEnablePin A1 // MicroMod Main Board Single (DEV-18575) : with a Processor Board that supports A1 as an output
+//#define swarmPowerEnablePin 39 // MicroMod Main Board Single (DEV-18575) : with e.g. the Teensy Processor Board using pin 39 (SDIO_DATA2) to control the power
+//#define swarmPowerEnablePin 4  // MicroMod Main Board Single (DEV-18575) : with e.g. the Artemis Processor Board using pin 4 (SDIO_DATA2) to control the power
+//#define swarmPowerEnablePin G5 // MicroMod Main Board Double (DEV-18576) : Slot 0 with the ALT_PWR_EN0 set to G5<->PWR_EN0
+//#define swarmPowerEnablePin G6 // MicroMod Main Board Double (DEV-18576) : Slot 1 with the ALT_PWR_EN1 set to G6<->PWR_EN1
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+// Callback: printMessage will be called by checkUnsolicitedMsg when a $RD message has been queued by the reader task
+void printMessage(const uint16_t *appID, const int16_t *rssi, const int16_t *snr, const int16_t *fdev, const char *asciiHex)
+{
+  Serial.print(F("New message: "));
+  Serial.println(asciiHex);
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void setup()
+{
+  // Swarm Satellite Transceiver MicroMod Function Board PWR_EN
+  #ifdef swarmPowerEnablePin
+  pinMode(swarmPowerEnablePin, OUTPUT); // Enable modem power 
+  digitalWrite(swarmPowerEnablePin, HIGH);
+  #endif
+
+  delay(1000);
+  
+  Serial.begin(115200);
+  while (!Serial)
+    ; // Wait for the user to open the Serial console
+  Serial.println(F("Swarm Satellite example"));
+  Serial.println();
+
+  //mySwarm.enableDebugging(); // Uncomment this line to enable debug messages on Serial
+
+  bool modemBegun = mySwarm.begin(swarmSerial); // Begin communication with the modem
+  
+  while (!modemBegun) // If the begin failed, keep trying to begin communication with the modem
+  {
+    Serial.println(F("Could not communicate with the modem. It may still be booting..."));
+    delay(2000);
+    modemBegun = mySwarm.begin(swarmSerial);
+  }
+
+  mySwarm.setReceiveMessageCallback(&printMessage); // Set up the callback for $RD messages
+  mySwarm.setMessageNotifications(true); // Enable the $RD notifications
+
+  // Start the reader task. From now on, only call the library from this (the loop) task
+  if (!mySwarm.beginThreadedMode())
+  {
+    Serial.println(F("Could not start the reader task! Freezing..."));
+    while (1)
+      ;
+  }
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void loop()
+{
+  mySwarm.checkUnsolicitedMsg(); // Call the callbacks for any events queued by the reader task
+
+  // Commands are passed to the reader task. They still block, but $RD messages keep being collected
+  Swarm_M138_GeospatialData_t info;
+  Swarm_M138_Error_e err = mySwarm.getGeospatialInfo(&info);
+  if (err == SWARM_M138_SUCCESS)
+  {
+    Serial.print(F("Lat: "));
+    Serial.print(info.lat, 4);
+    Serial.print(F("  Lon: "));
+    Serial.println(info.lon, 4);
+  }
+
+  delay(5000); // Pretend to be busy. The reader task keeps the serial buffer empty
+
+  uint32_t drops = mySwarm.getEventDropCount();
+  if (drops > 0)
+  {
+    Serial.print(F("Events discarded because the queue was full: "));
+    Serial.println(drops);
+  }
+}
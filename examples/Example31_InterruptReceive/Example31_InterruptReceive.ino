@@ -0,0 +1,144 @@
+/*!
+ * @file Example31_InterruptReceive.ino
+ * 
+ * @mainpage SparkFun Swarm Satellite Arduino Library
+ * 
+ * @section intro_sec Examples
+ * 
+ * This example shows how to:
+ *   Pass the modem's serial data to the library from the UART receive interrupt (or UART event)
+ *   so long $RD messages are not lost while the sketch is busy
+ *   Reference implementations for ESP32 (UART events) and SAMD21 (SERCOM interrupt)
+ *   Use the dropped byte counter and high water mark to check the ring buffer size
+ * 
+ * Want to support open source hardware? Buy a board from SparkFun!
+ * SparkX Swarm Serial Breakout : https://www.sparkfun.com/products/19236
+ * 
+ * @section author Author
+ * 
+ * This library was written by:
+ * Paul Clark
+ * SparkFun Electronics
+ * October 2026
+ * 
+ * @section license License
+ * 
+ * MIT: please see LICENSE.md for the full license information
+ * 
+ */
+
+#include <SparkFun_Swarm_Satellite_Arduino_Library.h> //Click here to get the library:  http://librarymanager/All#SparkFun_Swarm_Satellite
+
+SWARM_M138 mySwarm;
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+#if defined(ARDUINO_ARCH_ESP32)
+
+// ESP32: the UART driver calls onReceive from its event task as soon as data arrives.
+// Pass the data straight to the library's ring buffer.
+
+#define swarmSerial Serial1
+
+void swarmReceive(void)
+{
+  uint8_t buf[64];
+  int avail = swarmSerial.available();
+  while (avail > 0)
+  {
+    size_t len = swarmSerial.read(buf, (avail < (int)sizeof(buf)) ? avail : sizeof(buf));
+    mySwarm.feedRxBytes(buf, len);
+    avail = swarmSerial.available();
+  }
+}
+
+void beginReceivePath(void)
+{
+  swarmSerial.onReceive(swarmReceive); // Needs v2.0.2 (or later) of the ESP32 Arduino core
+}
+
+#elif defined(ARDUINO_ARCH_SAMD)
+
+// SAMD21: create a UART on SERCOM1 (TX on pin 10, RX on pin 11) and take over its interrupt handler.
+// Each received byte is read from the SERCOM data register and passed straight to the library.
+// Connect the modem TX to pin 11 and the modem RX to pin 10.
+
+#include "wiring_private.h" // pinPeripheral
+
+Uart swarmSerial(&sercom1, 11, 10, SERCOM_RX_PAD_0, UART_TX_PAD_2);
+
+void SERCOM1_Handler()
+{
+  while (sercom1.availableDataUART()) // Pass each received byte to the library
+    mySwarm.feedRxByte(sercom1.readDataUART());
+  swarmSerial.IrqHandler(); // Let the core handle the transmit and error interrupts
+}
+
+void beginReceivePath(void)
+{
+  pinPeripheral(10, PIO_SERCOM);
+  pinPeripheral(11, PIO_SERCOM);
+}
+
+#else
+#error "This example needs an ESP32 or SAMD21 board"
+#endif
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+// Callback: printMessage will be called when a new unsolicited message arrives.
+void printMessage(const uint16_t *appID, const int16_t *rssi, const int16_t *snr, const int16_t *fdev, const char *asciiHex)
+{
+  Serial.print(F("New message: "));
+  Serial.println(asciiHex);
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void setup()
+{
+  delay(1000);
+  
+  Serial.begin(115200);
+  while (!Serial)
+    ; // Wait for the user to open the Serial console
+  Serial.println(F("Swarm Satellite example"));
+  Serial.println();
+
+  //mySwarm.enableDebugging(); // Uncomment this line to enable debug messages on Serial
+
+  bool modemBegun = mySwarm.begin(swarmSerial); // Begin communication with the modem
+  
+  while (!modemBegun) // If the begin failed, keep trying to begin communication with the modem
+  {
+    Serial.println(F("Could not communicate with the modem. It may still be booting..."));
+    delay(2000);
+    modemBegun = mySwarm.begin(swarmSerial);
+  }
+
+  // From now on, the library reads the ring buffer instead of the serial port
+  if (!mySwarm.enableRxHook(2048))
+  {
+    Serial.println(F("Could not allocate memory for the ring buffer! Freezing..."));
+    while (1)
+      ;
+  }
+  beginReceivePath(); // Start passing the received data to the library
+
+  mySwarm.setReceiveMessageCallback(&printMessage); // Set up the callback for $RD messages
+  mySwarm.setMessageNotifications(true); // Enable the $RD notifications
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void loop()
+{
+  mySwarm.checkUnsolicitedMsg(); // Process the data in the ring buffer
+
+  delay(500); // Pretend to be busy. Without the interrupt receive path, long messages would overflow the serial buffer
+
+  Serial.print(F("Ring buffer high water: "));
+  Serial.print(mySwarm.getRxHighWater());
+  Serial.print(F("  Dropped bytes: "));
+  Serial.println(mySwarm.getRxDroppedBytes());
+}
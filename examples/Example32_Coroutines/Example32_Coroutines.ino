@@ -0,0 +1,160 @@
+/*!
+ * @file Example32_Coroutines.ino
+ * 
+ * @mainpage SparkFun Swarm Satellite Arduino Library
+ * 
+ * @section intro_sec Examples
+ * 
+ * This example shows how to:
+ *   Use C++20 coroutines to talk to the modem without blocking
+ *   Run several coroutines from one loop: each one co_awaits its own commands and messages
+ *   This needs a C++20 compiler: e.g. ESP32 with a recent toolchain and -std=gnu++2a
+ * 
+ * Want to support open source hardware? Buy a board from SparkFun!
+ * SparkX Swarm Serial Breakout : https://www.sparkfun.com/products/19236
+ * 
+ * @section author Author
+ * 
+ * This library was written by:
+ * Paul Clark
+ * SparkFun Electronics
+ * October 2026
+ * 
+ * @section license License
+ * 
+ * MIT: please see LICENSE.md for the full license information
+ * 
+ */
+
+#include <SparkFun_Swarm_Satellite_Arduino_Library.h> //Click here to get the library:  http://librarymanager/All#SparkFun_Swarm_Satellite
+
+#ifndef SWARM_M138_COROUTINES_AVAILABLE
+#error "This example needs C++20 coroutines"
+#endif
+
+SWARM_M138 mySwarm;
+#define swarmSerial Serial1 // Use Serial1 to communicate with the modem. Change this if required.
+
+// If you are using the Swarm Satellite Transceiver MicroMod Function Board:
+//
+// The Function Board has an onboard power switch which controls the power to the modem.
+// The power is disabled by default.
+// To enable the power, you need to pull the correct PWR_EN pin high.
+//
+// Uncomment and adapt a line to match your Main Board and Processor configuration:
+//#define swarmPowerEnablePin A1 // MicroMod Main Board Single (DEV-18575) : with a Processor Board that supports A1 as an output
+//#define swarmPowerEnablePin 39 // MicroMod Main Board Single (DEV-18575) : with e.g. the Teensy Processor Board using pin 39 (SDIO_DATA2) to control the power
+//#define swarmPowerEnablePin 4  // MicroMod Main Board Single (DEV-18575) : with e.g. the Artemis Processor Board using pin 4 (SDIO_DATA2) to control the power
+//#define swarmPowerEnablePin G5 // MicroMod Main Board Double (DEV-18576) : Slot 0 with the ALT_PWR_EN0 set to G5<->PWR_EN0
+//#define swarmPowerEnablePin G6 // MicroMod Main Board Double (DEV-18576) : Slot 1 with the ALT_PWR_EN1 set to G6<->PWR_EN1
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+// Coroutine: print the position every 30 seconds
+SWARM_M138_Task positionReporter()
+{
+  Swarm_M138_GeospatialData_t info;
+
+  while (true)
+  {
+    Swarm_M138_Error_e err = co_await mySwarm.getGeospatialInfoAsync(&info); // loop() keeps running while we wait
+
+    if (err == SWARM_M138_SUCCESS)
+    {
+      Serial.print(F("Latitude: "));
+      Serial.print(info.lat, 4);
+      Serial.print(F("  Longitude: "));
+      Serial.println(info.lon, 4);
+    }
+    else
+    {
+      Serial.print(F("Swarm communication error: "));
+      Serial.println(mySwarm.modemErrorString(err)); // Convert the error into printable text
+    }
+
+    co_await mySwarm.delayAsync(30000);
+  }
+}
+
+// Coroutine: print the number of unsent messages every 60 seconds
+SWARM_M138_Task queueWatcher()
+{
+  uint16_t count;
+
+  while (true)
+  {
+    Swarm_M138_Error_e err = co_await mySwarm.getUnsentMessageCountAsync(&count);
+
+    if (err == SWARM_M138_SUCCESS)
+    {
+      Serial.print(F("Unsent messages: "));
+      Serial.println(count);
+    }
+
+    co_await mySwarm.delayAsync(60000);
+  }
+}
+
+// Coroutine: wait for each $PW message
+Swarm_M138_Event_t powerEvent; // Global: a Swarm_M138_Event_t is too large for the coroutine frame
+
+SWARM_M138_Task powerWatcher()
+{
+  while (true)
+  {
+    co_await mySwarm.nextEvent(SWARM_M138_EVENT_POWER_STATUS, &powerEvent);
+    Serial.print(F("Power status: "));
+    Serial.println(powerEvent.sentence);
+  }
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void setup()
+{
+  // Swarm Satellite Transceiver MicroMod Function Board PWR_EN
+  #ifdef swarmPowerEnablePin
+  pinMode(swarmPowerEnablePin, OUTPUT); // Enable modem power 
+  digitalWrite(swarmPowerEnablePin, HIGH);
+  #endif
+
+  delay(1000);
+  
+  Serial.begin(115200);
+  while (!Serial)
+    ; // Wait for the user to open the Serial console
+  Serial.println(F("Swarm Satellite example"));
+  Serial.println();
+
+  //mySwarm.enableDebugging(); // Uncomment this line to enable debug messages on Serial
+
+  bool modemBegun = mySwarm.begin(swarmSerial); // Begin communication with the modem
+  
+  while (!modemBegun) // If the begin failed, keep trying to begin communication with the modem
+  {
+    Serial.println(F("Could not communicate with the modem. It may still be booting..."));
+    delay(2000);
+    modemBegun = mySwarm.begin(swarmSerial);
+  }
+
+  mySwarm.setPowerStatusRate(60); // Send a $PW message every 60 seconds
+
+  // Start the coroutines. Each one runs until its first co_await, then returns here
+  // The frames come from a fixed pool. valid() is false if the pool is full
+  if (!positionReporter().valid() || !queueWatcher().valid() || !powerWatcher().valid())
+  {
+    Serial.println(F("Could not start the coroutines! Freezing..."));
+    while (1)
+      ;
+  }
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void loop()
+{
+  mySwarm.poll(); // Process the modem messages. Resume the coroutines whose results have arrived
+
+  // Do other things here. Don't block for long
+}
@@ -0,0 +1,183 @@
+/*!
+ * @file Example33_TypedEvents.ino
+ * 
+ * @mainpage SparkFun Swarm Satellite Arduino Library
+ * 
+ * @section intro_sec Examples
+ * 
+ * This example shows how to:
+ *   Use the typed event queue instead of callbacks
+ *   Pop the parsed messages at your own pace, outside checkUnsolicitedMsg
+ *   Call library commands while handling an event (you can't do that from a callback)
+ * 
+ * Want to support open source hardware? Buy a board from SparkFun!
+ * SparkX Swarm Serial Breakout : https://www.sparkfun.com/products/19236
+ * 
+ * @section author Author
+ * 
+ * This library was written by:
+ * Paul Clark
+ * SparkFun Electronics
+ * October 2026
+ * 
+ * @section license License
+ * 
+ * MIT: please see LICENSE.md for the full license information
+ * 
+ */
+
+#include <SparkFun_Swarm_Satellite_Arduino_Library.h> //Click here to get the library:  http://librarymanager/All#SparkFun_Swarm_Satellite
+
+SWARM_M138 mySwarm;
+#define swarmSerial Serial1 // Use Serial1 to communicate with the modem. Change this if required.
+
+// If you are using the Swarm Satellite Transceiver MicroMod Function Board:
+//
+// The Function Board has an onboard power switch which controls the power to the modem.
+// The power is disabled by default.
+// To enable the power, you need to pull the correct PWR_EN pin high.
+//
+// Uncomment and adapt a line to match your Main Board and Processor configuration:
+//#define swarmPowerEnablePin A1 // MicroMod Main Board Single (DEV-18575) : with a Processor Board that supports A1 as an output
+//#define swarmPowerEnablePin 39 // MicroMod Main Board Single (DEV-18575) : with e.g. the Teensy Processor Board using pin 39 (SDIO_DATA2) to control the power
+//#define swarmPowerEnablePin 4  // MicroMod Main Board Single (DEV-18575) : with e.g. the Artemis Processor Board using pin 4 (SDIO_DATA2) to control the power
+//#define swarmPowerEnablePin G5 // MicroMod Main Board Double (DEV-18576) : Slot 0 with the ALT_PWR_EN0 set to G5<->PWR_EN0
+//#define swarmPowerEnablePin G6 // MicroMod Main Board Double (DEV-18576) : Slot 1 with the ALT_PWR_EN1 set to G6<->PWR_EN1
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void setup()
+{
+  // Swarm Satellite Transceiver MicroMod Function Board PWR_EN
+  #ifdef swarmPowerEnablePin
+  pinMode(swarmPowerEnablePin, OUTPUT); // Enable modem power 
+  digitalWrite(swarmPowerEnablePin, HIGH);
+  #endif
+
+  delay(1000);
+  
+  Serial.begin(115200);
+  while (!Serial)
+    ; // Wait for the user to open the Serial console
+  Serial.println(F("Swarm Satellite example"));
+  Serial.println();
+
+  //mySwarm.enableDebugging(); // Uncomment this line to enable debug messages on Serial
+
+  bool modemBegun = mySwarm.begin(swarmSerial); // Begin communication with the modem
+  
+  while (!modemBegun) // If the begin failed, keep trying to begin communication with the modem
+  {
+    Serial.println(F("Could not communicate with the modem. It may still be booting..."));
+    delay(2000);
+    modemBegun = mySwarm.begin(swarmSerial);
+  }
+
+  // Queue up to 8 events. If loop falls behind, overwrite the oldest
+  if (!mySwarm.enableTypedEvents(8, SWARM_M138_OVERFLOW_DROP_OLDEST))
+  {
+    Serial.println(F("Could not allocate memory for the event queue! Freezing..."));
+    while (1)
+      ;
+  }
+
+  mySwarm.setMessageNotifications(true); // Enable $RD messages
+  mySwarm.setDateTimeRate(60); // Send a $DT message every 60 seconds
+  mySwarm.setPowerStatusRate(60); // Send a $PW message every 60 seconds
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void loop()
+{
+  mySwarm.checkUnsolicitedMsg(); // Parse any new messages into the queue
+
+  Swarm_M138_Typed_Event_t event;
+
+  while (mySwarm.popTypedEvent(&event)) // Handle the events at our own pace
+  {
+    switch (event.type)
+    {
+      case SWARM_M138_EVENT_DATE_TIME:
+        Serial.print(F("Date/time: "));
+        Serial.print(event.dateTime.YYYY);
+        Serial.print(F("/"));
+        Serial.print(event.dateTime.MM);
+        Serial.print(F("/"));
+        Serial.println(event.dateTime.DD);
+        break;
+
+      case SWARM_M138_EVENT_POWER_STATUS:
+        Serial.print(F("CPU voltage: "));
+        Serial.println(event.powerStatus.cpu_volts, 2);
+        break;
+
+      case SWARM_M138_EVENT_RECEIVE_MESSAGE:
+      {
+        Serial.print(F("Received "));
+        Serial.print(event.receiveData.length);
+        Serial.println(F(" bytes"));
+
+        // We are outside checkUnsolicitedMsg, so we can call a command here
+        uint16_t count;
+        if (mySwarm.getRxMessageCount(&count, true) == SWARM_M138_SUCCESS)
+        {
+          Serial.print(F("Unread messages: "));
+          Serial.println(count);
+        }
+        break;
+      }
+
+      case SWARM_M138_EVENT_TRANSMIT_DATA:
+        Serial.print(F("Message sent. ID: "));
+        serialPrintUint64_t(event.transmitData.msg_id);
+        Serial.println();
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  if (mySwarm.getTypedEventDrops() > 0)
+  {
+    Serial.print(F("Events dropped: "));
+    Serial.println(mySwarm.getTypedEventDrops());
+    mySwarm.clearTypedEvents();
+  }
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void serialPrintUint64_t(uint64_t theNum)
+{
+  // Convert uint64_t to string
+  // Based on printLLNumber by robtillaart
+  // https://forum.arduino.cc/index.php?topic=143584.msg1519824#msg1519824
+  
+  char rev[21]; // Char array to hold to theNum (reversed order)
+  char fwd[21]; // Char array to hold to theNum (correct order)
+  unsigned int i = 0;
+  if (theNum == 0ULL) // if theNum is zero, set fwd to "0"
+  {
+    fwd[0] = '0';
+    fwd[1] = 0; // mark the end with a NULL
+  }
+  else
+  {
+    while (theNum > 0)
+    {
+      rev[i++] = (theNum % 10) + '0'; // divide by 10, convert the remainder to char
+      theNum /= 10; // divide by 10
+    }
+    unsigned int j = 0;
+    while (i > 0)
+    {
+      fwd[j++] = rev[--i]; // reverse the order
+      fwd[j] = 0; // mark the end with a NULL
+    }
+  }
+
+  Serial.print(fwd);
+}
@@ -0,0 +1,121 @@
+/*!
+ * @file Example34_Subscriptions.ino
+ * 
+ * @mainpage SparkFun Swarm Satellite Arduino Library
+ * 
+ * @section intro_sec Examples
+ * 
+ * This example shows how to:
+ *   Subscribe to only the unsolicited messages you need
+ *   Drop the others as soon as their tag is known
+ *   Keep only every Nth $GN message
+ * 
+ * Want to support open source hardware? Buy a board from SparkFun!
+ * SparkX Swarm Serial Breakout : https://www.sparkfun.com/products/19236
+ * 
+ * @section author Author
+ * 
+ * This library was written by:
+ * Paul Clark
+ * SparkFun Electronics
+ * October 2026
+ * 
+ * @section license License
+ * 
+ * MIT: please see LICENSE.md for the full license information
+ * 
+ */
+
+#include <SparkFun_Swarm_Satellite_Arduino_Library.h> //Click here to get the library:  http://librarymanager/All#SparkFun_Swarm_Satellite
+
+SWARM_M138 mySwarm;
+#define swarmSerial Serial1 // Use Serial1 to communicate with the modem. Change this if required.
+
+// If you are using the Swarm Satellite Transceiver MicroMod Function Board:
+//
+// The Function Board has an onboard power switch which controls the power to the modem.
+// The power is disabled by default.
+// To enable the power, you need to pull the correct PWR_EN pin high.
+//
+// Uncomment and adapt a line to match your Main Board and Processor configuration:
+//#define swarmPowerEnablePin A1 // MicroMod Main Board Single (DEV-18575) : with a Processor Board that supports A1 as an output
+//#define swarmPowerEnablePin 39 // MicroMod Main Board Single (DEV-18575) : with e.g. the Teensy Processor Board using pin 39 (SDIO_DATA2) to control the power
+//#define swarmPowerEnablePin 4  // MicroMod Main Board Single (DEV-18575) : with e.g. the Artemis Processor Board using pin 4 (SDIO_DATA2) to control the power
+//#define swarmPowerEnablePin G5 // MicroMod Main Board Double (DEV-18576) : Slot 0 with the ALT_PWR_EN0 set to G5<->PWR_EN0
+//#define swarmPowerEnablePin G6 // MicroMod Main Board Double (DEV-18576) : Slot 1 with the ALT_PWR_EN1 set to G6<->PWR_EN1
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+// Callback: printGeospatial will be called for every 10th $GN message
+void printGeospatial(const Swarm_M138_GeospatialData_t *info)
+{
+  Serial.print(F("Latitude: "));
+  Serial.print(info->lat, 4);
+  Serial.print(F("  Longitude: "));
+  Serial.println(info->lon, 4);
+}
+
+// Callback: printMessage will be called when a $RD message arrives
+void printMessage(const uint16_t *appID, const int16_t *rssi, const int16_t *snr, const int16_t *fdev, const char *asciiHex)
+{
+  Serial.print(F("New message: "));
+  Serial.println(asciiHex);
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void setup()
+{
+  // Swarm Satellite Transceiver MicroMod Function Board PWR_EN
+  #ifdef swarmPowerEnablePin
+  pinMode(swarmPowerEnablePin, OUTPUT); // Enable modem power 
+  digitalWrite(swarmPowerEnablePin, HIGH);
+  #endif
+
+  delay(1000);
+  
+  Serial.begin(115200);
+  while (!Serial)
+    ; // Wait for the user to open the Serial console
+  Serial.println(F("Swarm Satellite example"));
+  Serial.println();
+
+  //mySwarm.enableDebugging(); // Uncomment this line to enable debug messages on Serial
+
+  bool modemBegun = mySwarm.begin(swarmSerial); // Begin communication with the modem
+  
+  while (!modemBegun) // If the begin failed, keep trying to begin communication with the modem
+  {
+    Serial.println(F("Could not communicate with the modem. It may still be booting..."));
+    delay(2000);
+    modemBegun = mySwarm.begin(swarmSerial);
+  }
+
+  mySwarm.setGeospatialInfoCallback(&printGeospatial);
+  mySwarm.setReceiveMessageCallback(&printMessage);
+
+  // Keep only $GN and $RD. The $DT, $GS, $PW etc. messages are dropped as soon as their tag is known
+  mySwarm.setSubscriptions(SWARM_M138_SUBSCRIBE(SWARM_M138_EVENT_GEOSPATIAL) | SWARM_M138_SUBSCRIBE(SWARM_M138_EVENT_RECEIVE_MESSAGE));
+
+  // The modem sends $GN every second. Keep only every 10th one
+  mySwarm.setSubscriptionSampling(SWARM_M138_EVENT_GEOSPATIAL, 10);
+
+  mySwarm.setGeospatialInfoRate(1); // Send a $GN message every second
+  mySwarm.setMessageNotifications(true); // Enable $RD messages
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void loop()
+{
+  mySwarm.checkUnsolicitedMsg();
+
+  static unsigned long lastPrint = 0;
+  if (millis() - lastPrint > 60000) // Print the number of messages dropped once per minute
+  {
+    lastPrint = millis();
+    Serial.print(F("Messages dropped by the subscriptions: "));
+    Serial.println(mySwarm.getFilteredCount());
+  }
+}
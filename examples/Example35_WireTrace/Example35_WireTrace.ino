@@ -0,0 +1,143 @@
+/*!
+ * @file Example35_WireTrace.ino
+ * 
+ * @mainpage SparkFun Swarm Satellite Arduino Library
+ * 
+ * @section intro_sec Examples
+ * 
+ * This example shows how to:
+ *   Record a wire trace of everything sent to and received from the modem into a RAM ring buffer
+ *   Dump the trace when a command fails, or when you send 'd' from the Serial Monitor
+ *   Play the trace back on a computer with extras/host/swarm_replay
+ * 
+ * Want to support open source hardware? Buy a board from SparkFun!
+ * SparkX Swarm Serial Breakout : https://www.sparkfun.com/products/19236
+ * 
+ * @section author Author
+ * 
+ * This library was written by:
+ * Paul Clark
+ * SparkFun Electronics
+ * October 2026
+ * 
+ * @section license License
+ * 
+ * MIT: please see LICENSE.md for the full license information
+ * 
+ */
+
+#include <SparkFun_Swarm_Satellite_Arduino_Library.h> //Click here to get the library:  http://librarymanager/All#SparkFun_Swarm_Satellite
+
+SWARM_M138 mySwarm;
+#define swarmSerial Serial1 // Use Serial1 to communicate with the modem. Change this if required.
+
+// If you are using the Swarm Satellite Transceiver MicroMod Function Board:
+//
+// The Function Board has an onboard power switch which controls the power to the modem.
+// The power is disabled by default.
+// To enable the power, you need to pull the correct PWR_EN pin high.
+//
+// Uncomment and adapt a line to match your Main Board and Processor configuration:
+//#define swarmPowerEnablePin A1 // MicroMod Main Board Single (DEV-18575) : with a Processor Board that supports A1 as an output
+//#define swarmPowerEnablePin 39 // MicroMod Main Board Single (DEV-18575) : with e.g. the Teensy Processor Board using pin 39 (SDIO_DATA2) to control the power
+//#define swarmPowerEnablePin 4  // MicroMod Main Board Single (DEV-18575) : with e.g. the Artemis Processor Board using pin 4 (SDIO_DATA2) to control the power
+//#define swarmPowerEnablePin G5 // MicroMod Main Board Double (DEV-18576) : Slot 0 with the ALT_PWR_EN0 set to G5<->PWR_EN0
+//#define swarmPowerEnablePin G6 // MicroMod Main Board Double (DEV-18576) : Slot 1 with the ALT_PWR_EN1 set to G6<->PWR_EN1
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+// The trace is binary. HexPrint prints it as hex, 32 bytes per line, so it can be copied from the Serial Monitor.
+// Paste the hex lines into trace.hex, then: xxd -r -p trace.hex trace.bin ; swarm_replay trace.bin
+class HexPrint : public Print
+{
+public:
+  size_t write(uint8_t c)
+  {
+    if (c < 0x10)
+      Serial.print(F("0"));
+    Serial.print(c, HEX);
+    if (++_count % 32 == 0)
+      Serial.println();
+    return (1);
+  }
+
+private:
+  unsigned long _count = 0;
+};
+
+void dumpTheTrace()
+{
+  HexPrint hex;
+  Serial.println(F("-----BEGIN TRACE-----"));
+  mySwarm.dumpTrace(hex);
+  Serial.println();
+  Serial.println(F("-----END TRACE-----"));
+  Serial.print(F("Records discarded to make room: "));
+  Serial.println(mySwarm.getTraceDropCount());
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void setup()
+{
+  // Swarm Satellite Transceiver MicroMod Function Board PWR_EN
+  #ifdef swarmPowerEnablePin
+  pinMode(swarmPowerEnablePin, OUTPUT); // Enable modem power 
+  digitalWrite(swarmPowerEnablePin, HIGH);
+  #endif
+
+  delay(1000);
+  
+  Serial.begin(115200);
+  while (!Serial)
+    ; // Wait for the user to open the Serial console
+  Serial.println(F("Swarm Satellite example"));
+  Serial.println();
+
+  //mySwarm.enableDebugging(); // Uncomment this line to enable debug messages on Serial
+
+  // Start recording before begin, so the trace includes everything. Keep the last 4096 bytes
+  if (!mySwarm.enableTrace(4096))
+    Serial.println(F("Not enough memory for the trace!"));
+
+  bool modemBegun = mySwarm.begin(swarmSerial); // Begin communication with the modem
+  
+  while (!modemBegun) // If the begin failed, keep trying to begin communication with the modem
+  {
+    Serial.println(F("Could not communicate with the modem. It may still be booting..."));
+    delay(2000);
+    modemBegun = mySwarm.begin(swarmSerial);
+  }
+
+  mySwarm.setGeospatialInfoRate(1); // Send a $GN message every second
+
+  Serial.println(F("Send d to dump the trace"));
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void loop()
+{
+  mySwarm.checkUnsolicitedMsg();
+
+  static unsigned long lastCommand = 0;
+  if (millis() - lastCommand > 10000) // Get the date and time every 10 seconds
+  {
+    lastCommand = millis();
+    Swarm_M138_DateTimeData_t dateTime;
+    Swarm_M138_Error_e err = mySwarm.getDateTime(&dateTime);
+    if (err != SWARM_M138_SUCCESS)
+    {
+      Serial.print(F("getDateTime failed: "));
+      Serial.println(mySwarm.modemErrorString(err));
+      dumpTheTrace(); // Keep the evidence
+    }
+  }
+
+  if (Serial.available())
+  {
+    if (Serial.read() == 'd')
+      dumpTheTrace();
+  }
+}
@@ -0,0 +1,148 @@
+/*!
+ * @file Example36_Statistics.ino
+ * 
+ * @mainpage SparkFun Swarm Satellite Arduino Library
+ * 
+ * @section intro_sec Examples
+ * 
+ * This example shows how to:
+ *   Collect a response time histogram and error counters for each command
+ *   Print them once a minute, e.g. to send as telemetry or to choose the command timeouts
+ * 
+ * The statistics are compiled out by default. To enable them, uncomment the
+ * #define SWARM_M138_STATS line in SparkFun_Swarm_Satellite_Arduino_Library.h
+ * 
+ * Want to support open source hardware? Buy a board from SparkFun!
+ * SparkX Swarm Serial Breakout : https://www.sparkfun.com/products/19236
+ * 
+ * @section author Author
+ * 
+ * This library was written by:
+ * Paul Clark
+ * SparkFun Electronics
+ * October 2026
+ * 
+ * @section license License
+ * 
+ * MIT: please see LICENSE.md for the full license information
+ * 
+ */
+
+#include <SparkFun_Swarm_Satellite_Arduino_Library.h> //Click here to get the library:  http://librarymanager/All#SparkFun_Swarm_Satellite
+
+SWARM_M138 mySwarm;
+#define swarmSerial Serial1 // Use Serial1 to communicate with the modem. Change this if required.
+
+// If you are using the Swarm Satellite Transceiver MicroMod Function Board:
+//
+// The Function Board has an onboard power switch which controls the power to the modem.
+// The power is disabled by default.
+// To enable the power, you need to pull the correct PWR_EN pin high.
+//
+// Uncomment and adapt a line to match your Main Board and Processor configuration:
+//#define swarmPowerEnablePin A1 // MicroMod Main Board Single (DEV-18575) : with a Processor Board that supports A1 as an output
+//#define swarmPowerEnablePin 39 // MicroMod Main Board Single (DEV-18575) : with e.g. the Teensy Processor Board using pin 39 (SDIO_DATA2) to control the power
+//#define swarmPowerEnablePin 4  // MicroMod Main Board Single (DEV-18575) : with e.g. the Artemis Processor Board using pin 4 (SDIO_DATA2) to control the power
+//#define swarmPowerEnablePin G5 // MicroMod Main Board Double (DEV-18576) : Slot 0 with the ALT_PWR_EN0 set to G5<->PWR_EN0
+//#define swarmPowerEnablePin G6 // MicroMod Main Board Double (DEV-18576) : Slot 1 with the ALT_PWR_EN1 set to G6<->PWR_EN1
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void setup()
+{
+  // Swarm Satellite Transceiver MicroMod Function Board PWR_EN
+  #ifdef swarmPowerEnablePin
+  pinMode(swarmPowerEnablePin, OUTPUT); // Enable modem power 
+  digitalWrite(swarmPowerEnablePin, HIGH);
+  #endif
+
+  delay(1000);
+  
+  Serial.begin(115200);
+  while (!Serial)
+    ; // Wait for the user to open the Serial console
+  Serial.println(F("Swarm Satellite example"));
+  Serial.println();
+
+#ifndef SWARM_M138_STATS
+  Serial.println(F("Please uncomment the #define SWARM_M138_STATS line in SparkFun_Swarm_Satellite_Arduino_Library.h"));
+  while (1)
+    ; // Do nothing more
+#endif
+
+  //mySwarm.enableDebugging(); // Uncomment this line to enable debug messages on Serial
+
+  bool modemBegun = mySwarm.begin(swarmSerial); // Begin communication with the modem
+  
+  while (!modemBegun) // If the begin failed, keep trying to begin communication with the modem
+  {
+    Serial.println(F("Could not communicate with the modem. It may still be booting..."));
+    delay(2000);
+    modemBegun = mySwarm.begin(swarmSerial);
+  }
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void loop()
+{
+  mySwarm.checkUnsolicitedMsg();
+
+  // Send a few commands every 5 seconds
+  static unsigned long lastCommand = 0;
+  if (millis() - lastCommand > 5000)
+  {
+    lastCommand = millis();
+    Swarm_M138_DateTimeData_t dateTime;
+    mySwarm.getDateTime(&dateTime);
+    Swarm_M138_GeospatialData_t info;
+    mySwarm.getGeospatialInfo(&info);
+    uint16_t count;
+    mySwarm.getUnsentMessageCount(&count);
+  }
+
+#ifdef SWARM_M138_STATS
+  // Print the statistics once a minute
+  static unsigned long lastPrint = 0;
+  if (millis() - lastPrint > 60000)
+  {
+    lastPrint = millis();
+
+    Swarm_M138_Stats_t stats;
+    mySwarm.getStats(&stats);
+
+    Serial.println(F("Tag  Count  Timeouts  ERR  Checksum  Response times: 0ms 1ms 2ms 4ms 8ms ... 1024ms 2048ms+"));
+    for (uint8_t i = 0; i < SWARM_M138_STATS_TAGS; i++)
+    {
+      if (stats.commands[i].count == 0)
+        continue;
+      Serial.print(mySwarm.statsTag(i));
+      Serial.print(F("  "));
+      Serial.print(stats.commands[i].count);
+      Serial.print(F("  "));
+      Serial.print(stats.commands[i].timeouts);
+      Serial.print(F("  "));
+      Serial.print(stats.commands[i].errors);
+      Serial.print(F("  "));
+      Serial.print(stats.commands[i].checksumFailures);
+      Serial.print(F("  "));
+      for (uint8_t bucket = 0; bucket < SWARM_M138_STATS_BUCKETS; bucket++)
+      {
+        Serial.print(stats.commands[i].histogram[bucket]);
+        Serial.print(F(" "));
+      }
+      Serial.println();
+    }
+    Serial.print(F("Backlog overflows: "));
+    Serial.print(stats.backlogOverflows);
+    Serial.print(F("  Response overflows: "));
+    Serial.print(stats.responseOverflows);
+    Serial.print(F("  Unsolicited checksum failures: "));
+    Serial.println(stats.eventChecksumFailures);
+    Serial.println();
+
+    //mySwarm.resetStats(); // Uncomment this line to start again after each report
+  }
+#endif
+}
@@ -0,0 +1,180 @@
+/*!
+ * @file Arduino.cpp
+ *
+ * The Linux implementation of the minimal Arduino shim
+ *
+ * Please see LICENSE.md for the license information
+ *
+ */
+
+#include "Arduino.h"
+#include "Wire.h"
+
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+HardwareSerial Serial;
+TwoWire Wire;
+
+// Both clocks count from the first call, like a board which has just been reset
+static struct timespec hostStartTime;
+static bool hostStartTimeValid = false;
+
+// The simulated clock
+static bool hostSimulatedClock = false;
+static uint64_t hostSimulatedMicros = 0;
+#define HOST_SIMULATED_TICK 100 // Microseconds added by each call, so busy-wait loops still time out
+
+void hostUseSimulatedClock(bool enable)
+{
+  hostSimulatedClock = enable;
+  hostSimulatedMicros = 0;
+}
+
+static uint64_t hostMicros(void)
+{
+  if (hostSimulatedClock)
+  {
+    hostSimulatedMicros += HOST_SIMULATED_TICK;
+    return (hostSimulatedMicros);
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (!hostStartTimeValid)
+  {
+    hostStartTime = now;
+    hostStartTimeValid = true;
+  }
+  int64_t us = ((int64_t)(now.tv_sec - hostStartTime.tv_sec) * 1000000LL) + ((int64_t)(now.tv_nsec - hostStartTime.tv_nsec) / 1000LL);
+  return ((uint64_t)us);
+}
+
+unsigned long millis(void)
+{
+  return ((unsigned long)(hostMicros() / 1000ULL));
+}
+
+unsigned long micros(void)
+{
+  return ((unsigned long)hostMicros());
+}
+
+void delay(unsigned long ms)
+{
+  if (hostSimulatedClock)
+  {
+    hostSimulatedMicros += (uint64_t)ms * 1000ULL;
+    return;
+  }
+
+  struct timespec req;
+  req.tv_sec = ms / 1000;
+  req.tv_nsec = (ms % 1000) * 1000000L;
+  while (nanosleep(&req, &req) != 0) // Restart if interrupted by a signal
+    ;
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  if (hostSimulatedClock)
+  {
+    hostSimulatedMicros += us;
+    return;
+  }
+  usleep(us);
+}
+
+void yield(void)
+{
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+}
+
+// Print
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+  size_t n = 0;
+  while (size--)
+  {
+    if (write(*buffer++))
+      n++;
+    else
+      break;
+  }
+  return (n);
+}
+
+size_t Print::print(long n, int base)
+{
+  if ((base == DEC) && (n < 0))
+  {
+    size_t t = print('-');
+    return (t + print((unsigned long)(-(n + 1)) + 1UL, DEC)); // Avoid overflow on LONG_MIN
+  }
+  return (print((unsigned long)n, base));
+}
+
+size_t Print::print(unsigned long n, int base)
+{
+  char buf[8 * sizeof(unsigned long) + 1]; // Enough for base 2
+  char *str = &buf[sizeof(buf) - 1];
+
+  if (base < 2)
+    base = 10;
+
+  *str = '\0';
+  do
+  {
+    char c = n % base;
+    n /= base;
+    *--str = c < 10 ? c + '0' : c + 'A' - 10;
+  } while (n);
+
+  return (write(str));
+}
+
+size_t Print::print(double n, int digits)
+{
+  char buf[48];
+  snprintf(buf, sizeof(buf), "%.*f", digits, n);
+  return (write(buf));
+}
+
+// HardwareSerial: the console
+
+int HardwareSerial::available(void)
+{
+  int count = 0;
+  if (ioctl(STDIN_FILENO, FIONREAD, &count) != 0)
+    return (0);
+  return (count);
+}
+
+int HardwareSerial::read(void)
+{
+  if (available() <= 0)
+    return (-1);
+  uint8_t c;
+  if (::read(STDIN_FILENO, &c, 1) != 1)
+    return (-1);
+  return ((int)c);
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+  return (fputc(c, stdout) == EOF ? 0 : 1);
+}
+
+void HardwareSerial::flush(void)
+{
+  fflush(stdout);
+}
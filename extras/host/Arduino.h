@@ -0,0 +1,102 @@
+/*!
+ * @file Arduino.h
+ *
+ * A minimal Arduino shim for building the SparkFun Swarm Satellite Arduino Library on a Linux host.
+ *
+ * It provides just enough of the Arduino core for the library: millis, micros, delay, Print, Stream
+ * and a HardwareSerial type. Serial is the console (stdout / stdin).
+ * Talk to the modem through one of the SWARM_M138_Transport classes in SWARM_M138_Host_Transport.h.
+ *
+ * Please see LICENSE.md for the license information
+ *
+ */
+
+#ifndef SWARM_M138_HOST_ARDUINO_H
+#define SWARM_M138_HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define F(x) (x)
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const unsigned char *)(addr))
+
+#define DEC 10
+#define HEX 16
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield(void);
+void pinMode(uint8_t pin, uint8_t mode);    // No-op on the host
+void digitalWrite(uint8_t pin, uint8_t val); // No-op on the host
+
+// Host only: replace the real clock with a simulated one. delay() then returns at once and advances it,
+// and every millis() / micros() call advances it by a little, so timeouts cost no real time. Used by the fuzzers
+void hostUseSimulatedClock(bool enable);
+
+class Print
+{
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  size_t write(const char *str) { return (str == NULL ? 0 : write((const uint8_t *)str, strlen(str))); }
+  size_t write(const char *buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+  virtual void flush(void) {}
+
+  size_t print(const char *str) { return write(str); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(unsigned char n, int base = DEC) { return print((unsigned long)n, base); }
+  size_t print(int n, int base = DEC) { return print((long)n, base); }
+  size_t print(unsigned int n, int base = DEC) { return print((unsigned long)n, base); }
+  size_t print(long n, int base = DEC);
+  size_t print(unsigned long n, int base = DEC);
+  size_t print(double n, int digits = 2);
+
+  size_t println(void) { return write("\r\n"); }
+  template <typename T>
+  size_t println(T val) { size_t n = print(val); return n + println(); }
+  template <typename T>
+  size_t println(T val, int format) { size_t n = print(val, format); return n + println(); }
+};
+
+class Stream : public Print
+{
+public:
+  virtual int available(void) = 0;
+  virtual int read(void) = 0;
+  virtual int peek(void) { return -1; }
+};
+
+// The host has no UARTs. HardwareSerial is only here so the library's begin(HardwareSerial &) compiles
+// and so Serial can be used as the console and debug port
+class HardwareSerial : public Stream
+{
+public:
+  virtual void begin(unsigned long baud) {}
+  virtual void end(void) {}
+  int available(void);
+  int read(void);
+  size_t write(uint8_t c);
+  using Print::write;
+  void flush(void);
+  operator bool() { return true; }
+};
+
+extern HardwareSerial Serial; // The console
+
+#endif
@@ -0,0 +1,155 @@
+/*!
+ * @file SWARM_M138_Host_Storage.cpp
+ *
+ * Linux storage for the SparkFun Swarm Satellite Arduino Library
+ *
+ * Please see LICENSE.md for the license information
+ *
+ */
+
+#include "SWARM_M138_Host_Storage.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Write all len bytes, retrying after a signal or a short write
+static bool writeAll(int fd, const uint8_t *data, size_t len)
+{
+  while (len > 0)
+  {
+    ssize_t written = ::write(fd, data, len);
+    if (written < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      return (false);
+    }
+    data += written;
+    len -= written;
+  }
+  return (true);
+}
+
+// SWARM_M138_File_Storage
+
+SWARM_M138_File_Storage::SWARM_M138_File_Storage(void)
+{
+  _fd = -1;
+  _sync = true;
+}
+
+SWARM_M138_File_Storage::~SWARM_M138_File_Storage()
+{
+  close();
+}
+
+bool SWARM_M138_File_Storage::open(const char *path, bool sync)
+{
+  close();
+  _fd = ::open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (_fd < 0)
+    return (false);
+  _path = path;
+  _sync = sync;
+  return (true);
+}
+
+void SWARM_M138_File_Storage::close(void)
+{
+  if (_fd >= 0)
+    ::close(_fd);
+  _fd = -1;
+}
+
+uint32_t SWARM_M138_File_Storage::size(void)
+{
+  struct stat st;
+  if ((_fd < 0) || (fstat(_fd, &st) != 0))
+    return (0);
+  return ((uint32_t)st.st_size);
+}
+
+bool SWARM_M138_File_Storage::read(uint32_t offset, uint8_t *data, uint16_t len)
+{
+  if (_fd < 0)
+    return (false);
+  size_t done = 0;
+  while (done < len)
+  {
+    ssize_t got = pread(_fd, data + done, len - done, (off_t)offset + done);
+    if (got < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      return (false);
+    }
+    if (got == 0) // Past the end of the log
+      return (false);
+    done += got;
+  }
+  return (true);
+}
+
+bool SWARM_M138_File_Storage::append(const uint8_t *data, uint16_t len)
+{
+  if (_fd < 0)
+    return (false);
+  uint32_t oldSize = size();
+  if (!writeAll(_fd, data, len) || (_sync && (fsync(_fd) != 0)))
+  {
+    if (ftruncate(_fd, oldSize) == 0) // Do not leave part of a record behind
+      fsync(_fd);
+    return (false);
+  }
+  return (true);
+}
+
+bool SWARM_M138_File_Storage::clear(void)
+{
+  if (_fd < 0)
+    return (false);
+  if (ftruncate(_fd, 0) != 0)
+    return (false);
+  return ((!_sync) || (fsync(_fd) == 0));
+}
+
+bool SWARM_M138_File_Storage::discard(uint32_t len)
+{
+  uint32_t logSize = size();
+  if ((_fd < 0) || (len > logSize))
+    return (false);
+
+  std::string tmpPath = _path + ".tmp";
+  int tmpFd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (tmpFd < 0)
+    return (false);
+
+  // Copy the rest of the log into the new file
+  uint8_t buffer[512];
+  bool ok = true;
+  for (uint32_t offset = len; ok && (offset < logSize);)
+  {
+    uint16_t chunk = ((logSize - offset) > sizeof(buffer)) ? sizeof(buffer) : (uint16_t)(logSize - offset);
+    ok = read(offset, buffer, chunk) && writeAll(tmpFd, buffer, chunk);
+    offset += chunk;
+  }
+  if (ok && _sync)
+    ok = (fsync(tmpFd) == 0);
+  ::close(tmpFd);
+
+  // Replace the log. rename is atomic: after a crash, the log is either the old one or the new one
+  if (ok)
+    ok = (rename(tmpPath.c_str(), _path.c_str()) == 0);
+  if (!ok)
+  {
+    unlink(tmpPath.c_str());
+    return (false);
+  }
+
+  ::close(_fd);
+  _fd = ::open(_path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  return (_fd >= 0);
+}
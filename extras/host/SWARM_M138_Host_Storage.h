@@ -0,0 +1,43 @@
+/*!
+ * @file SWARM_M138_Host_Storage.h
+ *
+ * Linux storage for the SparkFun Swarm Satellite Arduino Library
+ *
+ * SWARM_M138_File_Storage keeps the outbox log (beginOutbox) in a plain file, so the outbox survives a restart
+ *
+ * Please see LICENSE.md for the license information
+ *
+ */
+
+#ifndef SWARM_M138_HOST_STORAGE_H
+#define SWARM_M138_HOST_STORAGE_H
+
+#include "SparkFun_Swarm_Satellite_Arduino_Library.h"
+
+#include <string>
+
+/** The outbox log in a plain file. Each append is written and fsync'd before it returns */
+// discard copies the rest of the log into <path>.tmp, then renames it over the log, so a crash leaves either the old or the new log
+class SWARM_M138_File_Storage : public SWARM_M138_Storage
+{
+public:
+  SWARM_M138_File_Storage(void);
+  ~SWARM_M138_File_Storage();
+
+  bool open(const char *path, bool sync = true); // Open or create the log. Set sync to false to skip the fsync after each write (faster, for tests)
+  void close(void);
+  bool isOpen(void) { return (_fd >= 0); }
+
+  uint32_t size(void);
+  bool read(uint32_t offset, uint8_t *data, uint16_t len);
+  bool append(const uint8_t *data, uint16_t len);
+  bool clear(void);
+  bool discard(uint32_t len);
+
+private:
+  int _fd;
+  bool _sync;
+  std::string _path;
+};
+
+#endif
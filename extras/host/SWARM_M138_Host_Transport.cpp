@@ -0,0 +1,514 @@
+/*!
+ * @file SWARM_M138_Host_Transport.cpp
+ *
+ * Linux transports for the SparkFun Swarm Satellite Arduino Library
+ *
+ * Please see LICENSE.md for the license information
+ *
+ */
+
+#include "SWARM_M138_Host_Transport.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+// SWARM_M138_Fd_Transport
+
+SWARM_M138_Fd_Transport::SWARM_M138_Fd_Transport(void)
+{
+  _readFd = -1;
+  _writeFd = -1;
+  _closeOnDestroy = false;
+}
+
+SWARM_M138_Fd_Transport::SWARM_M138_Fd_Transport(int readFd, int writeFd, bool closeOnDestroy)
+{
+  _readFd = -1;
+  _writeFd = -1;
+  _closeOnDestroy = false;
+  attach(readFd, writeFd, closeOnDestroy);
+}
+
+SWARM_M138_Fd_Transport::~SWARM_M138_Fd_Transport()
+{
+  close();
+}
+
+void SWARM_M138_Fd_Transport::attach(int readFd, int writeFd, bool closeOnDestroy)
+{
+  close();
+  _readFd = readFd;
+  _writeFd = writeFd;
+  _closeOnDestroy = closeOnDestroy;
+
+  if (_readFd >= 0) // The library polls available() and read(). It must never block
+  {
+    int flags = fcntl(_readFd, F_GETFL, 0);
+    if (flags >= 0)
+      fcntl(_readFd, F_SETFL, flags | O_NONBLOCK);
+  }
+}
+
+void SWARM_M138_Fd_Transport::close(void)
+{
+  if (_closeOnDestroy)
+  {
+    if (_readFd >= 0)
+      ::close(_readFd);
+    if ((_writeFd >= 0) && (_writeFd != _readFd))
+      ::close(_writeFd);
+  }
+  _readFd = -1;
+  _writeFd = -1;
+  _closeOnDestroy = false;
+}
+
+bool SWARM_M138_Fd_Transport::isOpen(void)
+{
+  return ((_readFd >= 0) && (_writeFd >= 0));
+}
+
+size_t SWARM_M138_Fd_Transport::write(const uint8_t *data, size_t len)
+{
+  if (_writeFd < 0)
+    return (0);
+
+  size_t written = 0;
+  while (written < len)
+  {
+    ssize_t n = ::write(_writeFd, data + written, len - written);
+    if (n > 0)
+    {
+      written += n;
+    }
+    else if ((n < 0) && (errno == EINTR))
+    {
+      continue;
+    }
+    else if ((n < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) // e.g. a tty shares the non-blocking descriptor
+    {
+      struct pollfd pfd;
+      pfd.fd = _writeFd;
+      pfd.events = POLLOUT;
+      if (poll(&pfd, 1, 1000) <= 0) // Give up if the far end stops reading
+        break;
+    }
+    else
+    {
+      break;
+    }
+  }
+  return (written);
+}
+
+int SWARM_M138_Fd_Transport::available(void)
+{
+  if (_readFd < 0)
+    return (-1);
+
+  int count = 0;
+  if (ioctl(_readFd, FIONREAD, &count) != 0)
+    return (-1);
+  return (count);
+}
+
+int SWARM_M138_Fd_Transport::read(uint8_t *data, size_t len)
+{
+  if (_readFd < 0)
+    return (-1);
+
+  ssize_t n;
+  do
+  {
+    n = ::read(_readFd, data, len);
+  } while ((n < 0) && (errno == EINTR));
+
+  if (n < 0)
+    return (((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? 0 : -1);
+  return ((int)n);
+}
+
+// SWARM_M138_Serial_Transport
+
+SWARM_M138_Serial_Transport::SWARM_M138_Serial_Transport(void)
+{
+  _ptyPeerFd = -1;
+}
+
+SWARM_M138_Serial_Transport::~SWARM_M138_Serial_Transport()
+{
+  close();
+}
+
+bool SWARM_M138_Serial_Transport::open(const char *device, unsigned long baud)
+{
+  close();
+
+  int fd = ::open(device, O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (fd < 0)
+    return (false);
+
+  if (!configure(fd, baud))
+  {
+    ::close(fd);
+    return (false);
+  }
+
+  attach(fd, fd, true);
+  return (true);
+}
+
+bool SWARM_M138_Serial_Transport::openPty(char *deviceName, size_t len)
+{
+  close();
+
+  int fd = posix_openpt(O_RDWR | O_NOCTTY);
+  if (fd < 0)
+    return (false);
+
+  if ((grantpt(fd) != 0) || (unlockpt(fd) != 0) || (ptsname_r(fd, deviceName, len) != 0))
+  {
+    ::close(fd);
+    return (false);
+  }
+
+  // The line discipline lives on the far end. Make it raw, otherwise the kernel echoes the commands back
+  // and translates LF to CR LF
+  _ptyPeerFd = ::open(deviceName, O_RDWR | O_NOCTTY);
+  if ((_ptyPeerFd < 0) || !configure(_ptyPeerFd, SWARM_M138_SERIAL_BAUD_RATE))
+  {
+    if (_ptyPeerFd >= 0)
+      ::close(_ptyPeerFd);
+    _ptyPeerFd = -1;
+    ::close(fd);
+    return (false);
+  }
+
+  attach(fd, fd, true);
+  return (true);
+}
+
+void SWARM_M138_Serial_Transport::close(void)
+{
+  SWARM_M138_Fd_Transport::close();
+  if (_ptyPeerFd >= 0)
+    ::close(_ptyPeerFd);
+  _ptyPeerFd = -1;
+}
+
+void SWARM_M138_Serial_Transport::begin(unsigned long baud)
+{
+  if ((_readFd >= 0) && (_ptyPeerFd < 0))
+    configure(_readFd, baud);
+}
+
+bool SWARM_M138_Serial_Transport::configure(int fd, unsigned long baud)
+{
+  speed_t speed;
+  switch (baud)
+  {
+  case 9600:
+    speed = B9600;
+    break;
+  case 19200:
+    speed = B19200;
+    break;
+  case 38400:
+    speed = B38400;
+    break;
+  case 57600:
+    speed = B57600;
+    break;
+  case 115200:
+    speed = B115200;
+    break;
+  case 230400:
+    speed = B230400;
+    break;
+  default:
+    return (false);
+  }
+
+  struct termios tio;
+  if (tcgetattr(fd, &tio) != 0)
+    return (false);
+
+  cfmakeraw(&tio); // 8N1, no echo, no CR/LF translation
+  tio.c_cflag |= (CLOCAL | CREAD);
+  tio.c_cflag &= ~CRTSCTS;
+  tio.c_cc[VMIN] = 0;
+  tio.c_cc[VTIME] = 0;
+  cfsetispeed(&tio, speed);
+  cfsetospeed(&tio, speed);
+
+  return (tcsetattr(fd, TCSANOW, &tio) == 0);
+}
+
+// SWARM_M138_Loopback_Transport
+
+std::mutex SWARM_M138_Loopback_Transport::_connectMutex;
+
+SWARM_M138_Loopback_Transport::SWARM_M138_Loopback_Transport(void)
+{
+  _peer = NULL;
+}
+
+SWARM_M138_Loopback_Transport::~SWARM_M138_Loopback_Transport()
+{
+  disconnect();
+}
+
+void SWARM_M138_Loopback_Transport::connect(SWARM_M138_Loopback_Transport &peer)
+{
+  disconnect();
+  peer.disconnect();
+  std::lock_guard<std::mutex> lock(_connectMutex);
+  _peer = &peer;
+  peer._peer = this;
+}
+
+void SWARM_M138_Loopback_Transport::disconnect(void)
+{
+  std::lock_guard<std::mutex> lock(_connectMutex);
+  if (_peer != NULL)
+    _peer->_peer = NULL;
+  _peer = NULL;
+}
+
+size_t SWARM_M138_Loopback_Transport::write(const uint8_t *data, size_t len)
+{
+  std::lock_guard<std::mutex> lock(_connectMutex); // Stops the peer disappearing mid-write
+  if (_peer == NULL)
+    return (len); // Like a disconnected UART: the bytes go nowhere
+  _peer->push(data, len);
+  return (len);
+}
+
+int SWARM_M138_Loopback_Transport::available(void)
+{
+  std::lock_guard<std::mutex> lock(_rxMutex);
+  return ((int)_rx.size());
+}
+
+int SWARM_M138_Loopback_Transport::read(uint8_t *data, size_t len)
+{
+  std::lock_guard<std::mutex> lock(_rxMutex);
+  size_t n = 0;
+  while ((n < len) && !_rx.empty())
+  {
+    data[n++] = _rx.front();
+    _rx.pop_front();
+  }
+  return ((int)n);
+}
+
+void SWARM_M138_Loopback_Transport::push(const uint8_t *data, size_t len)
+{
+  std::lock_guard<std::mutex> lock(_rxMutex);
+  _rx.insert(_rx.end(), data, data + len);
+}
+
+// SWARM_M138_Trace_Transport
+
+SWARM_M138_Trace_Transport::SWARM_M138_Trace_Transport(void)
+{
+  _records = 0;
+  _duration = 0;
+  _speed = 1.0f;
+  _started = false;
+  _start = 0;
+  _elapsed = 0;
+  _next = 0;
+  _rxPos = 0;
+  _txPos = 0;
+  _mismatch = SIZE_MAX;
+}
+
+bool SWARM_M138_Trace_Transport::open(const char *path)
+{
+  FILE *f = fopen(path, "rb");
+  if (f == NULL)
+    return (false);
+  std::vector<uint8_t> trace;
+  uint8_t chunk[4096];
+  size_t got;
+  while ((got = fread(chunk, 1, sizeof(chunk), f)) > 0)
+    trace.insert(trace.end(), chunk, chunk + got);
+  fclose(f);
+  return (load(trace.data(), trace.size()));
+}
+
+bool SWARM_M138_Trace_Transport::load(const uint8_t *trace, size_t len)
+{
+  if ((trace == NULL) || (len < 4) || (memcmp(trace, SWARM_M138_TRACE_MAGIC, 4) != 0))
+    return (false);
+
+  _rx.clear();
+  _rxDue.clear();
+  _rxEnd.clear();
+  _tx.clear();
+  _records = 0;
+  _duration = 0;
+  _started = false;
+  _elapsed = 0;
+  _next = 0;
+  _rxPos = 0;
+  _txPos = 0;
+  _mismatch = SIZE_MAX;
+
+  uint32_t previous = 0;
+  size_t pos = 4;
+  while (pos + SWARM_M138_TRACE_RECORD_HEADER <= len) // A truncated last record is ignored
+  {
+    uint8_t direction = trace[pos];
+    uint32_t stamp = (uint32_t)trace[pos + 1] | ((uint32_t)trace[pos + 2] << 8) | ((uint32_t)trace[pos + 3] << 16) | ((uint32_t)trace[pos + 4] << 24);
+    size_t recordLen = trace[pos + 5];
+    pos += SWARM_M138_TRACE_RECORD_HEADER;
+    if (pos + recordLen > len)
+      break;
+
+    if (_records == 0)
+      previous = stamp;
+    _duration += (uint32_t)(stamp - previous); // micros() wraps every 71 minutes. The gaps between records are shorter
+    previous = stamp;
+
+    if (direction == SWARM_M138_TRACE_RECEIVED)
+    {
+      _rx.insert(_rx.end(), trace + pos, trace + pos + recordLen);
+      _rxDue.push_back(_duration);
+      _rxEnd.push_back(_rx.size());
+    }
+    else if (direction == SWARM_M138_TRACE_SENT)
+      _tx.insert(_tx.end(), trace + pos, trace + pos + recordLen);
+    else
+      return (false); // Not a trace: stop before the rubbish is played back
+
+    _records++;
+    pos += recordLen;
+  }
+
+  return (true);
+}
+
+bool SWARM_M138_Trace_Transport::extractReceived(const uint8_t *trace, size_t len, std::vector<uint8_t> &rx)
+{
+  SWARM_M138_Trace_Transport player;
+  if (!player.load(trace, len))
+    return (false);
+  rx.insert(rx.end(), player._rx.begin(), player._rx.end());
+  return (true);
+}
+
+void SWARM_M138_Trace_Transport::setSpeed(float speed)
+{
+  _speed = (speed < 0.0f) ? 0.0f : speed;
+}
+
+bool SWARM_M138_Trace_Transport::done(void)
+{
+  return (_rxPos >= _rx.size());
+}
+
+size_t SWARM_M138_Trace_Transport::getRecordCount(void)
+{
+  return (_records);
+}
+
+size_t SWARM_M138_Trace_Transport::getReceivedBytes(void)
+{
+  return (_rx.size());
+}
+
+size_t SWARM_M138_Trace_Transport::getSentBytes(void)
+{
+  return (_tx.size());
+}
+
+uint64_t SWARM_M138_Trace_Transport::getDuration(void)
+{
+  return (_duration);
+}
+
+size_t SWARM_M138_Trace_Transport::getMismatch(void)
+{
+  return (_mismatch);
+}
+
+size_t SWARM_M138_Trace_Transport::released(void)
+{
+  if (_speed == 0.0f)
+    return (_rx.size());
+
+  unsigned long now = micros();
+  if (!_started)
+  {
+    _started = true;
+    _start = now;
+  }
+  _elapsed += (uint64_t)((float)(now - _start) * _speed);
+  _start = now;
+
+  while ((_next < _rxDue.size()) && (_rxDue[_next] <= _elapsed))
+    _next++;
+  return ((_next == 0) ? 0 : _rxEnd[_next - 1]);
+}
+
+size_t SWARM_M138_Trace_Transport::write(const uint8_t *data, size_t len)
+{
+  for (size_t i = 0; (i < len) && (_mismatch == SIZE_MAX); i++)
+  {
+    if ((_txPos + i >= _tx.size()) || (_tx[_txPos + i] != data[i]))
+      _mismatch = _txPos + i;
+  }
+  _txPos += len;
+  return (len);
+}
+
+int SWARM_M138_Trace_Transport::available(void)
+{
+  return ((int)(released() - _rxPos));
+}
+
+int SWARM_M138_Trace_Transport::read(uint8_t *data, size_t len)
+{
+  size_t n = released() - _rxPos;
+  if (n > len)
+    n = len;
+  memcpy(data, _rx.data() + _rxPos, n);
+  _rxPos += n;
+  return ((int)n);
+}
+
+// SWARM_M138_File_Print
+
+bool SWARM_M138_File_Print::open(const char *path)
+{
+  close();
+  _file = fopen(path, "wb");
+  return (_file != NULL);
+}
+
+void SWARM_M138_File_Print::close(void)
+{
+  if (_file != NULL)
+    fclose(_file);
+  _file = NULL;
+}
+
+size_t SWARM_M138_File_Print::write(const uint8_t *buffer, size_t size)
+{
+  if (_file == NULL)
+    return (0);
+  return (fwrite(buffer, 1, size, _file));
+}
+
+void SWARM_M138_File_Print::flush(void)
+{
+  if (_file != NULL)
+    fflush(_file);
+}
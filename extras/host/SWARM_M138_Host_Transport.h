@@ -0,0 +1,154 @@
+/*!
+ * @file SWARM_M138_Host_Transport.h
+ *
+ * Linux transports for the SparkFun Swarm Satellite Arduino Library
+ *
+ * Pass one of these to SWARM_M138::begin(SWARM_M138_Transport &) to run the library off-target:
+ *   SWARM_M138_Fd_Transport       : a pair of file descriptors - e.g. two pipes, a socket, or stdin / stdout
+ *   SWARM_M138_Serial_Transport   : a serial port (/dev/ttyUSB0) or a pseudo-terminal, in raw mode
+ *   SWARM_M138_Loopback_Transport : an in-memory pair. Whatever one end writes, its peer reads
+ *   SWARM_M138_Trace_Transport    : plays back a wire trace recorded by enableTrace, with the original timing
+ *
+ * SWARM_M138_File_Print writes to a file. Pass it to enableTrace to record a trace
+ *
+ * Please see LICENSE.md for the license information
+ *
+ */
+
+#ifndef SWARM_M138_HOST_TRANSPORT_H
+#define SWARM_M138_HOST_TRANSPORT_H
+
+#include "SparkFun_Swarm_Satellite_Arduino_Library.h"
+
+#include <deque>
+#include <mutex>
+#include <stdio.h>
+#include <vector>
+
+/** A transport over a pair of file descriptors. Reads are non-blocking */
+class SWARM_M138_Fd_Transport : public SWARM_M138_Transport
+{
+public:
+  SWARM_M138_Fd_Transport(void);
+  SWARM_M138_Fd_Transport(int readFd, int writeFd, bool closeOnDestroy = false);
+  ~SWARM_M138_Fd_Transport();
+
+  void attach(int readFd, int writeFd, bool closeOnDestroy = false); // Use these descriptors. readFd is made non-blocking
+  void close(void);                                                  // Close the descriptors if we own them. Forget them
+  bool isOpen(void);                                                 // Return true if the descriptors are valid
+
+  size_t write(const uint8_t *data, size_t len);
+  int available(void);
+  int read(uint8_t *data, size_t len);
+
+protected:
+  int _readFd;
+  int _writeFd;
+  bool _closeOnDestroy;
+};
+
+/** A serial port or pseudo-terminal, opened in raw 8N1 mode */
+class SWARM_M138_Serial_Transport : public SWARM_M138_Fd_Transport
+{
+public:
+  SWARM_M138_Serial_Transport(void);
+  ~SWARM_M138_Serial_Transport();
+
+  bool open(const char *device, unsigned long baud = SWARM_M138_SERIAL_BAUD_RATE); // Open e.g. /dev/ttyUSB0. Return false on failure
+  bool openPty(char *deviceName, size_t len);                                      // Create a pseudo-terminal. Copy the name of the far end (e.g. /dev/pts/3) into deviceName
+  void close(void);
+
+  void begin(unsigned long baud); // Change the baud rate. Ignored by pseudo-terminals
+
+private:
+  bool configure(int fd, unsigned long baud);
+  int _ptyPeerFd; // Keep the far end of a pseudo-terminal open so the near end does not see EIO before a peer connects
+};
+
+/** An in-memory transport. Connect two of these back to back: one for the library, one for a simulated modem.
+ *  Thread-safe: each end may be used from a different thread */
+class SWARM_M138_Loopback_Transport : public SWARM_M138_Transport
+{
+public:
+  SWARM_M138_Loopback_Transport(void);
+  ~SWARM_M138_Loopback_Transport();
+
+  void connect(SWARM_M138_Loopback_Transport &peer); // Connect both ends
+  void disconnect(void);                             // Disconnect both ends. Writes are discarded
+
+  size_t write(const uint8_t *data, size_t len);
+  int available(void);
+  int read(uint8_t *data, size_t len);
+
+private:
+  void push(const uint8_t *data, size_t len);
+  SWARM_M138_Loopback_Transport *_peer;
+  std::deque<uint8_t> _rx;
+  std::mutex _rxMutex;
+  static std::mutex _connectMutex;
+};
+
+/** Plays a wire trace back as the modem output. Each received record is delivered when its time comes:
+ *  its timestamp, relative to the first record, has passed since the library first polled the transport.
+ *  What the library writes is compared with the sent records, so you can see where it behaves differently from the capture */
+class SWARM_M138_Trace_Transport : public SWARM_M138_Transport
+{
+public:
+  SWARM_M138_Trace_Transport(void);
+
+  bool open(const char *path);                 // Load a trace file. Return false if it cannot be read or is not a trace
+  bool load(const uint8_t *trace, size_t len); // Load a trace from memory. Return false if it is not a trace
+  void setSpeed(float speed);                  // 1.0 plays at the original speed (the default). 2.0 twice as fast. 0 delivers everything at once
+  bool done(void);                             // Return true when every received byte has been read
+
+  size_t getRecordCount(void);   // The number of records in the trace
+  size_t getReceivedBytes(void); // The number of bytes the modem sent
+  size_t getSentBytes(void);     // The number of bytes the library sent
+  uint64_t getDuration(void);    // Microseconds from the first record to the last
+  size_t getMismatch(void);      // The offset of the first byte the library wrote which differs from the trace. SIZE_MAX if none have
+
+  // Append the received bytes in a trace to rx. Return false if it is not a trace
+  static bool extractReceived(const uint8_t *trace, size_t len, std::vector<uint8_t> &rx);
+
+  size_t write(const uint8_t *data, size_t len);
+  int available(void);
+  int read(uint8_t *data, size_t len);
+
+private:
+  size_t released(void); // Return the number of received bytes whose time has come
+  std::vector<uint8_t> _rx;       // Everything the modem sent
+  std::vector<uint64_t> _rxDue;   // For each received record: microseconds after the first record
+  std::vector<size_t> _rxEnd;     // For each received record: the offset in _rx just after it
+  std::vector<uint8_t> _tx;       // Everything the library sent
+  size_t _records;
+  uint64_t _duration;
+  float _speed;
+  bool _started;
+  unsigned long _start;
+  uint64_t _elapsed; // Microseconds since the first poll, scaled by _speed
+  size_t _next;      // The next received record to release
+  size_t _rxPos;
+  size_t _txPos;
+  size_t _mismatch;
+};
+
+/** A Print which writes to a file. E.g. mySwarm.enableTrace(traceFile) */
+class SWARM_M138_File_Print : public Print
+{
+public:
+  SWARM_M138_File_Print(void) : _file(NULL) {}
+  ~SWARM_M138_File_Print() { close(); }
+
+  bool open(const char *path); // Create or truncate the file. Return false on failure
+  void close(void);
+  bool isOpen(void) { return (_file != NULL); }
+
+  size_t write(uint8_t c) { return (write(&c, 1)); }
+  size_t write(const uint8_t *buffer, size_t size);
+  void flush(void);
+
+private:
+  FILE *_file;
+};
+
+#endif
@@ -0,0 +1,120 @@
+/*!
+ * @file SWARM_M138_RX_Simulator.cpp
+ *
+ * Host simulation of an interrupt-driven receive path for the SparkFun Swarm Satellite Arduino Library
+ *
+ * Please see LICENSE.md for the license information
+ *
+ */
+
+#include "SWARM_M138_RX_Simulator.h"
+
+#include <chrono>
+
+/**************************************************************************/
+/*!
+    @brief  Constructor for the host receive path simulator
+    @param  swarm
+            The SWARM_M138 object. Call enableRxHook before start
+    @param  source
+            The Stream which provides the modem's serial data
+    @param  baud
+            The simulated baud rate
+*/
+/**************************************************************************/
+SWARM_M138_RX_Simulator::SWARM_M138_RX_Simulator(SWARM_M138 &swarm, Stream &source, unsigned long baud)
+{
+  _swarm = &swarm;
+  _source = &source;
+  _transport = NULL;
+  _baud = baud;
+  _run = false;
+  _thread = NULL;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Constructor for the host receive path simulator
+    @param  swarm
+            The SWARM_M138 object. Call enableRxHook before start
+    @param  source
+            The SWARM_M138_Transport which provides the modem's serial data,
+            e.g. SWARM_M138_Simulator::port. Pass the same transport to SWARM_M138::begin
+            so the commands reach the modem
+    @param  baud
+            The simulated baud rate
+*/
+/**************************************************************************/
+SWARM_M138_RX_Simulator::SWARM_M138_RX_Simulator(SWARM_M138 &swarm, SWARM_M138_Transport &source, unsigned long baud)
+{
+  _swarm = &swarm;
+  _source = NULL;
+  _transport = &source;
+  _baud = baud;
+  _run = false;
+  _thread = NULL;
+}
+
+SWARM_M138_RX_Simulator::~SWARM_M138_RX_Simulator()
+{
+  stop();
+}
+
+/**************************************************************************/
+/*!
+    @brief  Start delivering bytes from the source to feedRxBytes
+            Every millisecond, up to baud / 10000 bytes are delivered - as they
+            would be by a UART RX interrupt - regardless of what the main thread is doing.
+    @return True if the thread was started
+*/
+/**************************************************************************/
+bool SWARM_M138_RX_Simulator::start(void)
+{
+  if (_thread != NULL)
+    return (true);
+
+  _run = true;
+  _thread = new std::thread([this]()
+                            {
+                              size_t perMilli = (_baud / 10000) + 1; // 10 bits per byte
+                              uint8_t buf[64];
+                              if (perMilli > sizeof(buf))
+                                perMilli = sizeof(buf);
+                              while (_run.load())
+                              {
+                                size_t len = 0;
+                                if (_transport != NULL)
+                                {
+                                  int got = _transport->read(buf, perMilli);
+                                  if (got > 0)
+                                    len = (size_t)got;
+                                }
+                                else
+                                {
+                                  while ((len < perMilli) && (_source->available() > 0))
+                                    buf[len++] = (uint8_t)_source->read();
+                                }
+                                if (len > 0)
+                                  _swarm->feedRxBytes(buf, len); // The 'interrupt'
+                                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                              }
+                            });
+
+  return (_thread != NULL);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Stop delivering bytes
+*/
+/**************************************************************************/
+void SWARM_M138_RX_Simulator::stop(void)
+{
+  _run = false;
+  if (_thread != NULL)
+  {
+    _thread->join();
+    delete _thread;
+    _thread = NULL;
+  }
+}
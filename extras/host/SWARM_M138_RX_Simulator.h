@@ -0,0 +1,41 @@
+/*!
+ * @file SWARM_M138_RX_Simulator.h
+ *
+ * Host simulation of an interrupt-driven receive path for the SparkFun Swarm Satellite Arduino Library
+ *
+ * SWARM_M138_RX_Simulator plays the part of a UART RX interrupt: it passes the modem's bytes to feedRxBytes (enableRxHook)
+ *
+ * Please see LICENSE.md for the license information
+ *
+ */
+
+#ifndef SWARM_M138_RX_SIMULATOR_H
+#define SWARM_M138_RX_SIMULATOR_H
+
+#include "SparkFun_Swarm_Satellite_Arduino_Library.h"
+
+#include <atomic>
+#include <thread>
+
+/** A std::thread copies the bytes from a Stream or a SWARM_M138_Transport (e.g. a pseudo-terminal or SWARM_M138_Simulator::port)
+ *  into feedRxBytes at the rate they would arrive at the given baud rate, while the
+ *  main thread is busy elsewhere. Use getRxDroppedBytes to check the ring buffer size. */
+class SWARM_M138_RX_Simulator
+{
+public:
+  SWARM_M138_RX_Simulator(SWARM_M138 &swarm, Stream &source, unsigned long baud = SWARM_M138_SERIAL_BAUD_RATE);
+  SWARM_M138_RX_Simulator(SWARM_M138 &swarm, SWARM_M138_Transport &source, unsigned long baud = SWARM_M138_SERIAL_BAUD_RATE);
+  ~SWARM_M138_RX_Simulator();
+  bool start(void); // Start delivering bytes. Call enableRxHook first
+  void stop(void);  // Stop delivering bytes
+
+private:
+  SWARM_M138 *_swarm;
+  Stream *_source;                  // Only one of _source and _transport is used
+  SWARM_M138_Transport *_transport;
+  unsigned long _baud;
+  std::atomic<bool> _run;
+  std::thread *_thread;
+};
+
+#endif
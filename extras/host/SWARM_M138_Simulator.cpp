@@ -0,0 +1,1173 @@
+/*!
+ * @file SWARM_M138_Simulator.cpp
+ *
+ * A scriptable Swarm M138 modem simulator for the Linux host build
+ *
+ * Please see LICENSE.md for the license information
+ *
+ */
+
+#include "SWARM_M138_Simulator.h"
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <time.h>
+
+#define SWARM_M138_SIM_FIRST_MESSAGE_ID 5354900000000ULL // The modem uses large, 64-bit message IDs
+#define SWARM_M138_SIM_DEFAULT_EPOCH 1767225600UL         // 2026-01-01 00:00:00
+#define SWARM_M138_SIM_RATE_COUNT 6
+
+const char *const SWARM_M138_Simulator::_rateTags[SWARM_M138_SIM_RATE_COUNT] = {"DT", "GJ", "GN", "GS", "PW", "RT"};
+
+// printf into a std::string. The simulator sentences are all short
+static std::string simFormat(const char *fmt, ...)
+{
+  char buf[512];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(buf, sizeof(buf), fmt, args);
+  va_end(args);
+  return (std::string(buf));
+}
+
+static bool simIsNumber(const std::string &s)
+{
+  if (s.empty())
+    return (false);
+  for (size_t i = 0; i < s.size(); i++)
+    if (!isdigit((unsigned char)s[i]))
+      return (false);
+  return (true);
+}
+
+static std::string simToHex(const uint8_t *data, size_t len)
+{
+  static const char digits[] = "0123456789abcdef";
+  std::string hex;
+  for (size_t i = 0; i < len; i++)
+  {
+    hex += digits[data[i] >> 4];
+    hex += digits[data[i] & 0x0F];
+  }
+  return (hex);
+}
+
+// SWARM_M138_Simulator_Port
+
+size_t SWARM_M138_Simulator_Port::write(const uint8_t *data, size_t len)
+{
+  std::lock_guard<std::recursive_mutex> lock(_sim->_mutex);
+  for (size_t i = 0; i < len; i++)
+    _sim->receiveByte(data[i]);
+  return (len);
+}
+
+int SWARM_M138_Simulator_Port::available(void)
+{
+  _sim->service();
+  std::lock_guard<std::recursive_mutex> lock(_sim->_mutex);
+  return ((int)_sim->_portRx.size());
+}
+
+int SWARM_M138_Simulator_Port::read(uint8_t *data, size_t len)
+{
+  _sim->service();
+  std::lock_guard<std::recursive_mutex> lock(_sim->_mutex);
+  size_t n = 0;
+  while ((n < len) && !_sim->_portRx.empty())
+  {
+    data[n++] = _sim->_portRx.front();
+    _sim->_portRx.pop_front();
+  }
+  return ((int)n);
+}
+
+// SWARM_M138_Simulator
+
+SWARM_M138_Simulator::SWARM_M138_Simulator(void)
+{
+  _transport = NULL;
+  init();
+}
+
+SWARM_M138_Simulator::SWARM_M138_Simulator(SWARM_M138_Transport &modemEnd)
+{
+  _transport = &modemEnd;
+  init();
+}
+
+SWARM_M138_Simulator::~SWARM_M138_Simulator()
+{
+  stop();
+}
+
+void SWARM_M138_Simulator::init(void)
+{
+  _port._sim = this;
+  _discardLine = false;
+  _replyDelay = 0;
+  _burstPending = false;
+  _paceStart = 0;
+  _paceSent = 0;
+
+  _latencyMin = SWARM_M138_SIM_DEFAULT_LATENCY;
+  _latencyMax = SWARM_M138_SIM_DEFAULT_LATENCY;
+  _baud = SWARM_M138_SERIAL_BAUD_RATE;
+  _secondLength = 1000;
+
+  _state = SIM_RUNNING;
+  _wakeAt = 0;
+  _deviceID = 0x000abc;
+  _firmware = "2022-02-06T00:06:40,v2.0.1";
+  _epoch = SWARM_M138_SIM_DEFAULT_EPOCH;
+  _epochSetAt = millis();
+  _epochValid = true;
+  _lat = 40.0902;
+  _lon = -105.1851;
+  _alt = 1624;
+  _course = 0;
+  _speed = 0;
+  _hdop = 109;
+  _vdop = 214;
+  _sats = 9;
+  _fixType = "G3";
+  _spoofState = 1;
+  _jammingLevel = 0;
+  _cpuVolts = 3.3;
+  _temperature = 25.0;
+  _backgroundRssi = -104;
+  _gpio1Mode = SWARM_M138_GPIO1_ANALOG;
+  _gpio1High = false;
+
+  for (int i = 0; i < SWARM_M138_SIM_RATE_COUNT; i++)
+  {
+    _rates[i] = 0;
+    _rateDue[i] = 0;
+  }
+  _burst = 0;
+
+  _txQueueLimit = SWARM_M138_SIM_DEFAULT_TX_QUEUE_LIMIT;
+  _txSendDelay = 0;
+  _nextMessageID = SWARM_M138_SIM_FIRST_MESSAGE_ID;
+  _rxNotifications = false;
+
+  for (int i = 0; i < SWARM_M138_SIM_FAULT_COUNT; i++)
+  {
+    _faultCount[i] = 0;
+    _faultRate[i] = 0;
+  }
+  _seed = 0x1234567;
+
+  _commandCount = 0;
+  _checksumErrors = 0;
+
+  _run = false;
+  _thread = NULL;
+}
+
+SWARM_M138_Transport &SWARM_M138_Simulator::port(void)
+{
+  return (_port);
+}
+
+void SWARM_M138_Simulator::service(void)
+{
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+
+  if (_transport != NULL)
+  {
+    uint8_t buf[64];
+    int n;
+    while ((n = _transport->read(buf, sizeof(buf))) > 0)
+      for (int i = 0; i < n; i++)
+        receiveByte(buf[i]);
+  }
+
+  periodic();
+  deliver();
+}
+
+bool SWARM_M138_Simulator::start(void)
+{
+  if (_thread != NULL)
+    return (false);
+
+  _run = true;
+  _thread = new std::thread([this]()
+                            {
+                              while (_run)
+                              {
+                                service();
+                                delayMicroseconds(100);
+                              } });
+  return (_thread != NULL);
+}
+
+void SWARM_M138_Simulator::stop(void)
+{
+  if (_thread == NULL)
+    return;
+
+  _run = false;
+  _thread->join();
+  delete _thread;
+  _thread = NULL;
+}
+
+// Timing
+
+void SWARM_M138_Simulator::setLatency(unsigned long minMs, unsigned long maxMs)
+{
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  _latencyMin = minMs;
+  _latencyMax = (maxMs > minMs) ? maxMs : minMs;
+}
+
+void SWARM_M138_Simulator::setBaud(unsigned long baud)
+{
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  _baud = baud;
+  _paceStart = micros();
+  _paceSent = 0;
+}
+
+void SWARM_M138_Simulator::setSecondLength(unsigned long ms)
+{
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  _epoch = epochNow(); // Restart the clock at the new rate
+  _epochSetAt = millis();
+  _secondLength = (ms == 0) ? 1 : ms;
+}
+
+// Modem state
+
+void SWARM_M138_Simulator::setDeviceID(uint32_t id)
+{
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  _deviceID = id;
+}
+
+void SWARM_M138_Simulator::setFirmwareVersion(const char *version)
+{
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  _firmware = version;
+}
+
+void SWARM_M138_Simulator::setDateTime(uint32_t epoch, bool valid)
+{
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  _epoch = epoch;
+  _epochSetAt = millis();
+  _epochValid = valid;
+}
+
+void SWARM_M138_Simulator::setPosition(float lat, float lon, int alt, int course, int speed)
+{
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  _lat = lat;
+  _lon = lon;
+  _alt = alt;
+  _course = course;
+  _speed = speed;
+}
+
+void SWARM_M138_Simulator::setFixQuality(int hdop, int vdop, int sats, const char *fixType)
+{
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  _hdop = hdop;
+  _vdop = vdop;
+  _sats = sats;
+  _fixType = fixType;
+}
+
+void SWARM_M138_Simulator::setJamming(int spoofState, int jammingLevel)
+{
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  _spoofState = spoofState;
+  _jammingLevel = jammingLevel;
+}
+
+void SWARM_M138_Simulator::setPowerStatus(float cpuVolts, float temperature)
+{
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  _cpuVolts = cpuVolts;
+  _temperature = temperature;
+}
+
+void SWARM_M138_Simulator::setBackgroundRssi(int rssi)
+{
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  _backgroundRssi = rssi;
+}
+
+void SWARM_M138_Simulator::setGpio1Input(bool high)
+{
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  _gpio1High = high;
+}
+
+// Message queues
+
+void SWARM_M138_Simulator::setTxQueueLimit(uint16_t limit)
+{
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  _txQueueLimit = limit;
+}
+
+void SWARM_M138_Simulator::setTxSendDelay(unsigned long ms)
+{
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  _txSendDelay = ms;
+}
+
+uint16_t SWARM_M138_Simulator::sendQueuedMessages(uint16_t count, int rssi, int snr, int fdev)
+{
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  uint16_t sent = 0;
+  while ((sent < count) && !_txQueue.empty())
+  {
+    queue(simFormat("TD SENT RSSI=%d,SNR=%d,FDEV=%d,%llu", rssi, snr, fdev, (unsigned long long)_txQueue.front().id), 0, false);
+    _txQueue.erase(_txQueue.begin());
+    sent++;
+  }
+  return (sent);
+}
+
+uint16_t SWARM_M138_Simulator::getTxQueueCount(void)
+{
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  return ((uint16_t)_txQueue.size());
+}
+
+bool SWARM_M138_Simulator::receiveMessage(uint16_t appID, const uint8_t *data, size_t len, int rssi, int snr, int fdev)
+{
+  if ((data == NULL) || (len == 0) || (len > SWARM_M138_SIM_MAX_PAYLOAD))
+    return (false);
+
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  Sim_Message_t msg;
+  msg.id = _nextMessageID++;
+  msg.appID = appID;
+  msg.hex = simToHex(data, len);
+  msg.epoch = epochNow();
+  msg.sendAt = 0;
+  msg.read = false;
+  _rxStore.push_back(msg);
+
+  if (_rxNotifications && (_state == SIM_RUNNING))
+    queue(simFormat("RD AI=%u,RSSI=%d,SNR=%d,FDEV=%d,%s", appID, rssi, snr, fdev, msg.hex.c_str()), 0, false);
+  return (true);
+}
+
+uint16_t SWARM_M138_Simulator::getRxMessageCount(bool unreadOnly)
+{
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  uint16_t count = 0;
+  for (size_t i = 0; i < _rxStore.size(); i++)
+    if ((!unreadOnly) || (!_rxStore[i].read))
+      count++;
+  return (count);
+}
+
+// Unsolicited messages
+
+bool SWARM_M138_Simulator::setRate(const char *tag, uint32_t seconds)
+{
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  for (int i = 0; i < SWARM_M138_SIM_RATE_COUNT; i++)
+  {
+    if (strcmp(tag, _rateTags[i]) == 0)
+    {
+      _rates[i] = seconds;
+      _rateDue[i] = millis() + (seconds * _secondLength);
+      return (true);
+    }
+  }
+  return (false);
+}
+
+void SWARM_M138_Simulator::sendSentence(const char *body, unsigned long delayMs)
+{
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  queue(std::string(body), delayMs, false);
+}
+
+void SWARM_M138_Simulator::setBurst(uint8_t count)
+{
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  _burst = count;
+}
+
+void SWARM_M138_Simulator::boot(void)
+{
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  bootSequence(0);
+}
+
+void SWARM_M138_Simulator::powerOn(void)
+{
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  if (_state != SIM_OFF)
+    return;
+  _state = SIM_RUNNING;
+  bootSequence(0);
+}
+
+// Fault injection
+
+void SWARM_M138_Simulator::injectFault(Swarm_M138_Sim_Fault_e fault, uint16_t count)
+{
+  if ((fault <= SWARM_M138_SIM_FAULT_NONE) || (fault >= SWARM_M138_SIM_FAULT_COUNT))
+    return;
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  _faultCount[fault] = count;
+}
+
+void SWARM_M138_Simulator::setFaultRate(Swarm_M138_Sim_Fault_e fault, uint16_t perMille)
+{
+  if ((fault <= SWARM_M138_SIM_FAULT_NONE) || (fault >= SWARM_M138_SIM_FAULT_COUNT))
+    return;
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  _faultRate[fault] = perMille;
+}
+
+void SWARM_M138_Simulator::injectError(const char *tag, const char *error)
+{
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  if (*tag == '$') // Accept "$TD" or "TD"
+    tag++;
+  _errors[std::string(tag)].push_back(std::string(error));
+}
+
+void SWARM_M138_Simulator::setSeed(uint32_t seed)
+{
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  _seed = (seed == 0) ? 1 : seed; // xorshift must not be seeded with zero
+}
+
+// Observation
+
+uint32_t SWARM_M138_Simulator::getCommandCount(void)
+{
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  return (_commandCount);
+}
+
+uint32_t SWARM_M138_Simulator::getChecksumErrorCount(void)
+{
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  return (_checksumErrors);
+}
+
+bool SWARM_M138_Simulator::getLastCommand(char *dest, size_t len)
+{
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  if ((dest == NULL) || (len == 0) || _lastCommand.empty())
+    return (false);
+  strncpy(dest, _lastCommand.c_str(), len - 1);
+  dest[len - 1] = 0;
+  return (true);
+}
+
+bool SWARM_M138_Simulator::isAsleep(void)
+{
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  return (_state == SIM_SLEEPING);
+}
+
+bool SWARM_M138_Simulator::isPoweredOff(void)
+{
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  return (_state == SIM_OFF);
+}
+
+// Private: the receive side
+
+void SWARM_M138_Simulator::receiveByte(uint8_t c)
+{
+  if (_state == SIM_OFF)
+    return;
+
+  if (_state == SIM_SLEEPING) // Any serial activity wakes the modem. The command itself is lost
+  {
+    _state = SIM_RUNNING;
+    _discardLine = (c != '\n');
+    _line.clear();
+    queue("SL WAKE,SERIAL", _latencyMin, false);
+    return;
+  }
+
+  if (_discardLine)
+  {
+    if (c == '\n')
+      _discardLine = false;
+    return;
+  }
+
+  if (c == '\n')
+  {
+    handleCommand(_line);
+    _line.clear();
+  }
+  else if ((c != '\r') && (_line.size() < 1024))
+  {
+    _line += (char)c;
+  }
+}
+
+void SWARM_M138_Simulator::handleCommand(const std::string &line)
+{
+  size_t start = line.find('$');
+  size_t star = line.rfind('*');
+  if ((start == std::string::npos) || (star == std::string::npos) || (star < start))
+    return; // The modem ignores anything which is not a sentence
+
+  std::string body = line.substr(start + 1, star - start - 1);
+  size_t space = body.find(' ');
+  std::string tag = body.substr(0, space);
+  std::string args = (space == std::string::npos) ? std::string("") : body.substr(space + 1);
+
+  _commandCount++;
+  _lastCommand = body;
+  _replyDelay = _latencyMin;
+  if (_latencyMax > _latencyMin)
+    _replyDelay += random() % (_latencyMax - _latencyMin + 1);
+  _burstPending = true;
+
+  uint8_t checksum = 0;
+  for (size_t i = 0; i < body.size(); i++)
+    checksum ^= (uint8_t)body[i];
+  bool checksumOK = (line.size() >= (star + 3))
+                    && isxdigit((unsigned char)line[star + 1]) && isxdigit((unsigned char)line[star + 2])
+                    && (strtoul(line.substr(star + 1, 2).c_str(), NULL, 16) == checksum);
+  if (!checksumOK)
+  {
+    _checksumErrors++;
+    reply(tag + " ERR,BADCHECKSUM");
+    return;
+  }
+
+  std::map<std::string, std::deque<std::string>>::iterator injected = _errors.find(tag);
+  if ((injected != _errors.end()) && !injected->second.empty())
+  {
+    reply(tag + " ERR," + injected->second.front());
+    injected->second.pop_front();
+    return;
+  }
+
+  for (int i = 0; i < SWARM_M138_SIM_RATE_COUNT; i++)
+  {
+    if (tag == _rateTags[i])
+    {
+      rateCommand(i, args);
+      return;
+    }
+  }
+
+  if (tag == "CS")
+  {
+    reply(simFormat("CS DI=0x%06lx,DN=M138", (unsigned long)_deviceID));
+  }
+  else if (tag == "FV")
+  {
+    reply("FV " + _firmware);
+  }
+  else if (tag == "GP")
+  {
+    if (args == "?")
+      reply(simFormat("GP %d", _gpio1Mode));
+    else if (args == "@")
+    {
+      if (_gpio1Mode == SWARM_M138_GPIO1_ADC)
+        reply(_gpio1High ? "GP 3.300V" : "GP 0.000V");
+      else if ((_gpio1Mode >= SWARM_M138_GPIO1_INPUT) && (_gpio1Mode <= SWARM_M138_GPIO1_EXIT_SLEEP_HIGH_LOW))
+        reply(_gpio1High ? "GP H" : "GP L");
+      else
+        reply("GP Cannot read in mode");
+    }
+    else if (simIsNumber(args) && (atoi(args.c_str()) < SWARM_M138_GPIO1_INVALID))
+    {
+      _gpio1Mode = atoi(args.c_str());
+      reply("GP OK");
+    }
+    else
+      reply("GP ERR,BADPARAMVALUE");
+  }
+  else if (tag == "MM")
+  {
+    commandMM(args);
+  }
+  else if (tag == "MT")
+  {
+    commandMT(args);
+  }
+  else if (tag == "TD")
+  {
+    commandTD(args);
+  }
+  else if (tag == "SL")
+  {
+    commandSL(args);
+  }
+  else if (tag == "PO")
+  {
+    reply("PO OK");
+    _state = SIM_OFF; // The reply has already been queued. Ignore everything else until powerOn
+  }
+  else if (tag == "RS")
+  {
+    reply("RS OK");
+    bootSequence(_replyDelay + 100);
+  }
+  else
+  {
+    reply(tag + " ERR,NOCOMMAND");
+  }
+}
+
+void SWARM_M138_Simulator::rateCommand(int index, const std::string &args)
+{
+  std::string tag(_rateTags[index]);
+
+  if (args == "@")
+    reply(rateBody(index));
+  else if (args == "?")
+    reply(simFormat("%s %lu", tag.c_str(), (unsigned long)_rates[index]));
+  else if (simIsNumber(args))
+  {
+    setRate(tag.c_str(), (uint32_t)strtoul(args.c_str(), NULL, 10));
+    reply(tag + " OK");
+  }
+  else
+    reply(tag + " ERR,BADPARAM");
+}
+
+void SWARM_M138_Simulator::commandMM(const std::string &args)
+{
+  if ((args == "C=U") || (args == "C=*"))
+  {
+    reply(simFormat("MM %u", getRxMessageCount(args == "C=U")));
+  }
+  else if ((args == "D=R") || (args == "D=*"))
+  {
+    unsigned count = 0;
+    for (size_t i = 0; i < _rxStore.size();)
+    {
+      if ((args == "D=*") || _rxStore[i].read)
+      {
+        _rxStore.erase(_rxStore.begin() + i);
+        count++;
+      }
+      else
+        i++;
+    }
+    reply(simFormat("MM %u", count));
+  }
+  else if (args == "M=*")
+  {
+    for (size_t i = 0; i < _rxStore.size(); i++)
+      _rxStore[i].read = true;
+    reply(simFormat("MM %u", (unsigned)_rxStore.size()));
+  }
+  else if (args == "N=?")
+  {
+    reply(_rxNotifications ? "MM N=E" : "MM N=D");
+  }
+  else if ((args == "N=E") || (args == "N=D"))
+  {
+    _rxNotifications = (args == "N=E");
+    reply("MM OK");
+  }
+  else if ((args == "R=O") || (args == "R=N"))
+  {
+    int found = -1;
+    for (size_t i = 0; i < _rxStore.size(); i++)
+    {
+      if (!_rxStore[i].read)
+      {
+        found = (int)i;
+        if (args == "R=O") // Oldest: stop at the first
+          break;
+      }
+    }
+    if (found < 0)
+    {
+      reply("MM ERR,DBX_NOMORE");
+      return;
+    }
+    _rxStore[found].read = true;
+    reply(messageBody("MM", _rxStore[found]));
+  }
+  else if ((args.size() > 2) && (args[1] == '=') && simIsNumber(args.substr(2)))
+  {
+    uint64_t id = strtoull(args.c_str() + 2, NULL, 10);
+    for (size_t i = 0; i < _rxStore.size(); i++)
+    {
+      if (_rxStore[i].id != id)
+        continue;
+      switch (args[0])
+      {
+      case 'R':
+        _rxStore[i].read = true;
+        reply(messageBody("MM", _rxStore[i]));
+        return;
+      case 'L':
+        reply(messageBody("MM", _rxStore[i]));
+        return;
+      case 'D':
+        _rxStore.erase(_rxStore.begin() + i);
+        reply("MM DELETED");
+        return;
+      case 'M':
+        _rxStore[i].read = true;
+        reply("MM MARKED");
+        return;
+      default:
+        reply("MM ERR,BADPARAM");
+        return;
+      }
+    }
+    reply("MM ERR,DBX_INVMSGID");
+  }
+  else
+  {
+    reply("MM ERR,BADPARAM");
+  }
+}
+
+void SWARM_M138_Simulator::commandMT(const std::string &args)
+{
+  if (args == "C=U")
+  {
+    reply(simFormat("MT %u", (unsigned)_txQueue.size()));
+  }
+  else if (args == "D=U")
+  {
+    unsigned count = (unsigned)_txQueue.size();
+    _txQueue.clear();
+    reply(simFormat("MT %u", count));
+  }
+  else if (args == "L=U")
+  {
+    for (size_t i = 0; i < _txQueue.size(); i++)
+      reply(messageBody("MT", _txQueue[i]));
+    reply(simFormat("MT %u", (unsigned)_txQueue.size()));
+  }
+  else if ((args.size() > 2) && ((args[0] == 'L') || (args[0] == 'D')) && (args[1] == '=') && simIsNumber(args.substr(2)))
+  {
+    uint64_t id = strtoull(args.c_str() + 2, NULL, 10);
+    for (size_t i = 0; i < _txQueue.size(); i++)
+    {
+      if (_txQueue[i].id != id)
+        continue;
+      if (args[0] == 'L')
+      {
+        reply(messageBody("MT", _txQueue[i]));
+      }
+      else
+      {
+        _txQueue.erase(_txQueue.begin() + i);
+        reply("MT DELETED");
+      }
+      return;
+    }
+    reply("MT ERR,DBX_INVMSGID");
+  }
+  else
+  {
+    reply("MT ERR,BADPARAM");
+  }
+}
+
+void SWARM_M138_Simulator::commandTD(const std::string &args)
+{
+  Sim_Message_t msg;
+  msg.appID = 0;
+  msg.epoch = epochNow();
+  msg.sendAt = 0;
+  msg.read = false;
+
+  // Options: AI=, HD= and ET=, each followed by a comma
+  size_t pos = 0;
+  while ((args.size() > pos + 3) && (args[pos + 2] == '=') && (args[pos] != '"'))
+  {
+    size_t comma = args.find(',', pos);
+    if (comma == std::string::npos)
+      break;
+    std::string name = args.substr(pos, 2);
+    std::string value = args.substr(pos + 3, comma - pos - 3);
+    if (!simIsNumber(value))
+    {
+      reply("TD ERR,BADPARAMVALUE");
+      return;
+    }
+    unsigned long v = strtoul(value.c_str(), NULL, 10);
+    if (name == "AI")
+    {
+      if (v > 64999)
+      {
+        reply("TD ERR,BADAPPID");
+        return;
+      }
+      msg.appID = (uint16_t)v;
+    }
+    else if (name == "ET")
+    {
+      if (v <= epochNow())
+      {
+        reply("TD ERR,BADEXPIRETIME");
+        return;
+      }
+    }
+    else if (name != "HD")
+    {
+      reply("TD ERR,BADPARAM");
+      return;
+    }
+    pos = comma + 1;
+  }
+
+  std::string data = args.substr(pos);
+  if ((data.size() >= 2) && (data[0] == '"') && (data[data.size() - 1] == '"')) // ASCII
+  {
+    data = data.substr(1, data.size() - 2);
+    msg.hex = simToHex((const uint8_t *)data.c_str(), data.size());
+  }
+  else // ASCII Hex
+  {
+    for (size_t i = 0; i < data.size(); i++)
+    {
+      if (!isxdigit((unsigned char)data[i]))
+      {
+        reply("TD ERR,BADDATA");
+        return;
+      }
+    }
+    if ((data.size() & 1) != 0)
+    {
+      reply("TD ERR,BADDATA");
+      return;
+    }
+    msg.hex = data;
+  }
+
+  if (msg.hex.empty())
+  {
+    reply("TD ERR,BADDATA");
+    return;
+  }
+  if (msg.hex.size() > (SWARM_M138_SIM_MAX_PAYLOAD * 2))
+  {
+    reply("TD ERR,TOOLONG");
+    return;
+  }
+  if (_txQueue.size() >= _txQueueLimit)
+  {
+    reply("TD ERR,DBXTOHIVEFULL");
+    return;
+  }
+
+  msg.id = _nextMessageID++;
+  if (_txSendDelay > 0)
+  {
+    msg.sendAt = millis() + _txSendDelay;
+    if (msg.sendAt == 0)
+      msg.sendAt = 1;
+  }
+  _txQueue.push_back(msg);
+  reply(simFormat("TD OK,%llu", (unsigned long long)msg.id));
+}
+
+void SWARM_M138_Simulator::commandSL(const std::string &args)
+{
+  uint32_t seconds = 0;
+
+  if ((args.size() > 2) && (args.compare(0, 2, "S=") == 0) && simIsNumber(args.substr(2)))
+  {
+    seconds = (uint32_t)strtoul(args.c_str() + 2, NULL, 10);
+  }
+  else if ((args.size() > 2) && (args.compare(0, 2, "U=") == 0))
+  {
+    struct tm target;
+    uint32_t now = epochNow();
+    time_t nowT = (time_t)now;
+    gmtime_r(&nowT, &target);
+    int YYYY, MM, DD, hh, mm, ss;
+    if (sscanf(args.c_str() + 2, "%d-%d-%dT%d:%d:%d", &YYYY, &MM, &DD, &hh, &mm, &ss) == 6)
+    {
+      target.tm_year = YYYY - 1900;
+      target.tm_mon = MM - 1;
+      target.tm_mday = DD;
+    }
+    else if (sscanf(args.c_str() + 2, "%d:%d:%d", &hh, &mm, &ss) != 3)
+    {
+      reply("SL ERR,BADPARAM");
+      return;
+    }
+    target.tm_hour = hh;
+    target.tm_min = mm;
+    target.tm_sec = ss;
+    time_t wake = timegm(&target);
+    if ((strchr(args.c_str(), 'T') == NULL) && (wake <= nowT)) // Time only: that time tomorrow
+      wake += 86400;
+    if (wake <= nowT)
+    {
+      reply("SL ERR,BADPARAMVALUE");
+      return;
+    }
+    seconds = (uint32_t)(wake - nowT);
+  }
+
+  if (seconds == 0)
+  {
+    reply("SL ERR,BADPARAM");
+    return;
+  }
+
+  reply("SL OK");
+  sleepFor(seconds, _replyDelay);
+}
+
+// Private: the transmit side
+
+void SWARM_M138_Simulator::reply(const std::string &body)
+{
+  if (_burstPending) // Unsolicited messages which arrive while the command is being processed
+  {
+    _burstPending = false;
+    for (uint8_t i = 0; i < _burst; i++)
+      queue(rateBody(i % (SWARM_M138_SIM_RATE_COUNT - 1)), _replyDelay, false); // Skip $RT
+  }
+  queue(body, _replyDelay, true);
+}
+
+void SWARM_M138_Simulator::queue(const std::string &body, unsigned long delayMs, bool isResponse)
+{
+  std::string s = sentence(body, isResponse);
+  if (s.empty()) // Silenced
+    return;
+  _scheduled.insert(std::make_pair(micros() + (delayMs * 1000UL), s)); // Equal times are kept in order
+}
+
+std::string SWARM_M138_Simulator::sentence(const std::string &body, bool isResponse)
+{
+  uint8_t checksum = 0;
+  for (size_t i = 0; i < body.size(); i++)
+    checksum ^= (uint8_t)body[i];
+
+  int fault = SWARM_M138_SIM_FAULT_NONE;
+  if (isResponse)
+  {
+    for (int f = SWARM_M138_SIM_FAULT_NONE + 1; f < SWARM_M138_SIM_FAULT_COUNT; f++)
+    {
+      if (_faultCount[f] > 0)
+      {
+        _faultCount[f]--;
+        fault = f;
+        break;
+      }
+    }
+  }
+  if (fault == SWARM_M138_SIM_FAULT_NONE)
+  {
+    for (int f = SWARM_M138_SIM_FAULT_NONE + 1; f < SWARM_M138_SIM_FAULT_COUNT; f++)
+    {
+      if ((_faultRate[f] > 0) && ((random() % 1000) < _faultRate[f]))
+      {
+        fault = f;
+        break;
+      }
+    }
+  }
+
+  if (fault == SWARM_M138_SIM_FAULT_SILENCE)
+    return (std::string(""));
+  if (fault == SWARM_M138_SIM_FAULT_BAD_CHECKSUM)
+    checksum ^= 0x5A;
+
+  std::string s = simFormat("$%s*%02x\n", body.c_str(), checksum);
+
+  if (fault == SWARM_M138_SIM_FAULT_TRUNCATE)
+    s = s.substr(0, s.size() / 2);
+
+  return (s);
+}
+
+void SWARM_M138_Simulator::bootSequence(unsigned long delayMs)
+{
+  queue("M138 BOOT,RESTART", delayMs, false);
+  queue("M138 BOOT,POWERON,LPWR=y,WDOG=n,SFTY=n,SWRS=y", delayMs + 10, false);
+  queue("M138 BOOT,VERSION," + _firmware, delayMs + 20, false);
+  queue(simFormat("M138 BOOT,DEVICEID,DI=0x%06lx", (unsigned long)_deviceID), delayMs + 30, false);
+  queue("M138 BOOT,RUNNING", delayMs + 40, false);
+  if (_epochValid)
+  {
+    queue("M138 DATETIME", delayMs + 40 + (2 * _secondLength), false);
+    queue("M138 POSITION", delayMs + 40 + (3 * _secondLength), false);
+  }
+}
+
+void SWARM_M138_Simulator::deliver(void)
+{
+  unsigned long now = micros();
+
+  while (!_scheduled.empty() && ((long)(now - _scheduled.begin()->first) >= 0))
+  {
+    if (_out.empty()) // Start pacing from when the sentence became due
+    {
+      _paceStart = _scheduled.begin()->first;
+      _paceSent = 0;
+    }
+    const std::string &s = _scheduled.begin()->second;
+    _out.insert(_out.end(), s.begin(), s.end());
+    _scheduled.erase(_scheduled.begin());
+  }
+
+  size_t n = _out.size();
+  if ((_baud > 0) && (n > 0))
+  {
+    unsigned long allowed = (unsigned long)(((uint64_t)(now - _paceStart) * _baud) / 10000000ULL); // 10 bits per byte
+    n = (allowed > _paceSent) ? allowed - _paceSent : 0;
+    if (n > _out.size())
+      n = _out.size();
+  }
+  if (n == 0)
+    return;
+
+  _paceSent += n;
+  if (_transport != NULL)
+  {
+    uint8_t buf[64];
+    while (n > 0)
+    {
+      size_t chunk = (n < sizeof(buf)) ? n : sizeof(buf);
+      for (size_t i = 0; i < chunk; i++)
+      {
+        buf[i] = _out.front();
+        _out.pop_front();
+      }
+      _transport->write(buf, chunk);
+      n -= chunk;
+    }
+  }
+  else
+  {
+    _portRx.insert(_portRx.end(), _out.begin(), _out.begin() + n);
+    _out.erase(_out.begin(), _out.begin() + n);
+  }
+}
+
+void SWARM_M138_Simulator::periodic(void)
+{
+  unsigned long now = millis();
+
+  if ((_state == SIM_SLEEPING) && ((long)(now - _wakeAt) >= 0))
+  {
+    _state = SIM_RUNNING;
+    queue("SL WAKE,TIME", 0, false);
+  }
+
+  if (_state != SIM_RUNNING)
+    return;
+
+  for (int i = 0; i < SWARM_M138_SIM_RATE_COUNT; i++)
+  {
+    if ((_rates[i] > 0) && ((long)(now - _rateDue[i]) >= 0))
+    {
+      queue(rateBody(i), 0, false);
+      _rateDue[i] += _rates[i] * _secondLength;
+      if ((long)(now - _rateDue[i]) >= 0) // Do not try to catch up
+        _rateDue[i] = now + (_rates[i] * _secondLength);
+    }
+  }
+
+  for (size_t i = 0; i < _txQueue.size();)
+  {
+    if ((_txQueue[i].sendAt != 0) && ((long)(now - _txQueue[i].sendAt) >= 0))
+    {
+      queue(simFormat("TD SENT RSSI=-110,SNR=8,FDEV=-1000,%llu", (unsigned long long)_txQueue[i].id), 0, false);
+      _txQueue.erase(_txQueue.begin() + i);
+    }
+    else
+      i++;
+  }
+}
+
+void SWARM_M138_Simulator::sleepFor(uint32_t seconds, unsigned long afterMs)
+{
+  _state = SIM_SLEEPING;
+  _wakeAt = millis() + afterMs + (seconds * _secondLength);
+}
+
+uint32_t SWARM_M138_Simulator::epochNow(void)
+{
+  return (_epoch + (uint32_t)((millis() - _epochSetAt) / _secondLength));
+}
+
+// Private: the message bodies
+
+std::string SWARM_M138_Simulator::dateTimeBody(void)
+{
+  time_t now = (time_t)epochNow();
+  struct tm t;
+  gmtime_r(&now, &t);
+  return (simFormat("DT %04d%02d%02d%02d%02d%02d,%c", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday,
+                    t.tm_hour, t.tm_min, t.tm_sec, _epochValid ? 'V' : 'I'));
+}
+
+std::string SWARM_M138_Simulator::geospatialBody(void)
+{
+  return (simFormat("GN %.4f,%.4f,%d,%d,%d", _lat, _lon, _alt, _course, _speed));
+}
+
+std::string SWARM_M138_Simulator::fixQualityBody(void)
+{
+  return (simFormat("GS %d,%d,%d,0,%s", _hdop, _vdop, _sats, _fixType.c_str()));
+}
+
+std::string SWARM_M138_Simulator::jammingBody(void)
+{
+  return (simFormat("GJ %d,%d", _spoofState, _jammingLevel));
+}
+
+std::string SWARM_M138_Simulator::powerBody(void)
+{
+  return (simFormat("PW %.5f,0.00000,0.00000,0.00000,%.1f", _cpuVolts, _temperature));
+}
+
+std::string SWARM_M138_Simulator::rssiBody(void)
+{
+  return (simFormat("RT RSSI=%d", _backgroundRssi));
+}
+
+std::string SWARM_M138_Simulator::rateBody(int index)
+{
+  switch (index)
+  {
+  case 0:
+    return (dateTimeBody());
+  case 1:
+    return (jammingBody());
+  case 2:
+    return (geospatialBody());
+  case 3:
+    return (fixQualityBody());
+  case 4:
+    return (powerBody());
+  default:
+    return (rssiBody());
+  }
+}
+
+std::string SWARM_M138_Simulator::messageBody(const char *tag, const Sim_Message_t &msg)
+{
+  return (simFormat("%s AI=%u,%s,%llu,%lu", tag, msg.appID, msg.hex.c_str(), (unsigned long long)msg.id, (unsigned long)msg.epoch));
+}
+
+uint32_t SWARM_M138_Simulator::random(void)
+{
+  _seed ^= _seed << 13;
+  _seed ^= _seed >> 17;
+  _seed ^= _seed << 5;
+  return (_seed);
+}
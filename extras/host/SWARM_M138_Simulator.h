@@ -0,0 +1,229 @@
+/*!
+ * @file SWARM_M138_Simulator.h
+ *
+ * A scriptable Swarm M138 modem simulator for the Linux host build
+ *
+ * It implements the commands the library uses ($CS, $DT, $FV, $GJ, $GN, $GP, $GS, $MM, $MT, $PO, $PW,
+ * $RS, $RT, $SL and $TD), the $RD, $TD SENT, $SL WAKE and $M138 messages, and the periodic messages
+ * set by the rate commands. Responses can be delayed, paced at the serial baud rate, interleaved with
+ * bursts of unsolicited messages, and corrupted, truncated or dropped on demand.
+ *
+ * The simplest way to use it is through its built-in in-memory port:
+ *
+ *   SWARM_M138_Simulator sim;
+ *   mySwarm.begin(sim.port());
+ *
+ * Reading from the port runs the simulator, so everything happens on one thread, in a repeatable order.
+ * Alternatively, give it the modem end of a SWARM_M138_Transport (a loopback, a pipe or a pseudo-terminal)
+ * and call start() to run it on its own thread.
+ *
+ * Please see LICENSE.md for the license information
+ *
+ */
+
+#ifndef SWARM_M138_SIMULATOR_H
+#define SWARM_M138_SIMULATOR_H
+
+#include "SparkFun_Swarm_Satellite_Arduino_Library.h"
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** Faults which can be injected into the simulator output */
+typedef enum
+{
+  SWARM_M138_SIM_FAULT_NONE = 0,
+  SWARM_M138_SIM_FAULT_BAD_CHECKSUM, // Corrupt the checksum
+  SWARM_M138_SIM_FAULT_TRUNCATE,     // Send only the first half of the sentence, without the LF
+  SWARM_M138_SIM_FAULT_SILENCE,      // Do not send the sentence at all
+  SWARM_M138_SIM_FAULT_COUNT
+} Swarm_M138_Sim_Fault_e;
+
+#define SWARM_M138_SIM_DEFAULT_LATENCY 5         ///< The default delay (ms) between a command and the start of its response
+#define SWARM_M138_SIM_DEFAULT_TX_QUEUE_LIMIT 2048 ///< The default size of the simulated transmit queue
+#define SWARM_M138_SIM_MAX_PAYLOAD 192           ///< The largest message payload (bytes)
+
+class SWARM_M138_Simulator;
+
+/** The library end of the simulator's built-in in-memory port. Calling available() or read() runs the simulator */
+class SWARM_M138_Simulator_Port : public SWARM_M138_Transport
+{
+public:
+  size_t write(const uint8_t *data, size_t len);
+  int available(void);
+  int read(uint8_t *data, size_t len);
+
+private:
+  friend class SWARM_M138_Simulator;
+  SWARM_M138_Simulator *_sim;
+};
+
+/** A simulated Swarm M138 modem */
+class SWARM_M138_Simulator
+{
+public:
+  SWARM_M138_Simulator(void);                          // Use the built-in in-memory port. Pass port() to SWARM_M138::begin
+  SWARM_M138_Simulator(SWARM_M138_Transport &modemEnd); // Use an external transport. Call service() regularly, or start()
+  ~SWARM_M138_Simulator();
+
+  SWARM_M138_Transport &port(void); // The library end of the built-in port
+  void service(void);               // Process the received bytes. Deliver anything which is due
+  bool start(void);                 // Call service() continuously on a std::thread
+  void stop(void);                  // Stop the thread
+
+  /** Timing */
+  void setLatency(unsigned long minMs, unsigned long maxMs = 0); // Delay each response by minMs, or by a random time between minMs and maxMs
+  void setBaud(unsigned long baud);                              // Pace the output at baud (10 bits per byte). 0 delivers each sentence instantly
+  void setSecondLength(unsigned long ms);                        // The length of a simulated second. Reduce it to speed up the rates, sleeps and clock
+
+  /** Modem state */
+  void setDeviceID(uint32_t id);
+  void setFirmwareVersion(const char *version);
+  void setDateTime(uint32_t epoch, bool valid = true); // The clock then runs at one tick per simulated second
+  void setPosition(float lat, float lon, int alt = 0, int course = 0, int speed = 0);
+  void setFixQuality(int hdop, int vdop, int sats, const char *fixType = "G3");
+  void setJamming(int spoofState, int jammingLevel);
+  void setPowerStatus(float cpuVolts, float temperature);
+  void setBackgroundRssi(int rssi);
+  void setGpio1Input(bool high);
+
+  /** Message queues */
+  void setTxQueueLimit(uint16_t limit);     // $TD returns ERR,DBXTOHIVEFULL when the queue is full
+  void setTxSendDelay(unsigned long ms);    // Send each queued message ms after it was queued. 0 = only when sendQueuedMessages is called
+  uint16_t sendQueuedMessages(uint16_t count = 0xFFFF, int rssi = -110, int snr = 8, int fdev = -1000); // A satellite pass: send the oldest count messages. Return how many were sent
+  uint16_t getTxQueueCount(void);           // Return the number of unsent messages
+  bool receiveMessage(uint16_t appID, const uint8_t *data, size_t len, int rssi = -100, int snr = 10, int fdev = 0); // A message arrives from the satellite
+  uint16_t getRxMessageCount(bool unreadOnly = false);
+
+  /** Unsolicited messages */
+  bool setRate(const char *tag, uint32_t seconds);        // As if $DT, $GJ, $GN, $GS, $PW or $RT had been sent with a rate
+  void sendSentence(const char *body, unsigned long delayMs = 0); // Send any sentence, e.g. "M138 BOOT,RUNNING". The $, checksum and LF are added
+  void setBurst(uint8_t count);                           // Send count $DT / $GN / $GS / $GJ / $PW messages between every command and its response
+  void boot(void);                                        // Send the $M138 BOOT sequence
+  void powerOn(void);                                     // Wake up after $PO. Sends the boot sequence
+
+  /** Fault injection */
+  void injectFault(Swarm_M138_Sim_Fault_e fault, uint16_t count = 1); // Apply fault to the next count responses
+  void setFaultRate(Swarm_M138_Sim_Fault_e fault, uint16_t perMille); // Apply fault at random to any sentence
+  void injectError(const char *tag, const char *error);              // Reply to the next command with this tag with e.g. "$TD ERR,<error>"
+  void setSeed(uint32_t seed);                                       // Seed the latency and fault generator
+
+  /** Observation */
+  uint32_t getCommandCount(void);           // Return the number of commands received
+  uint32_t getChecksumErrorCount(void);     // Return the number of commands which had a bad checksum
+  bool getLastCommand(char *dest, size_t len); // Copy the most recent command (without the checksum). Return false if there was none
+  bool isAsleep(void);
+  bool isPoweredOff(void);
+
+private:
+  friend class SWARM_M138_Simulator_Port;
+
+  typedef enum
+  {
+    SIM_RUNNING = 0,
+    SIM_SLEEPING,
+    SIM_OFF
+  } Sim_State_e;
+
+  typedef struct
+  {
+    uint64_t id;
+    uint16_t appID;
+    std::string hex;
+    uint32_t epoch;
+    unsigned long sendAt; // millis. 0 = not scheduled
+    bool read;            // RX only
+  } Sim_Message_t;
+
+  void init(void);
+  void receiveByte(uint8_t c);
+  void handleCommand(const std::string &line);
+  void reply(const std::string &body);
+  void queue(const std::string &body, unsigned long delayMs, bool isResponse);
+  void bootSequence(unsigned long delayMs);
+  void deliver(void);
+  void periodic(void);
+  std::string sentence(const std::string &body, bool isResponse);
+  void sleepFor(uint32_t seconds, unsigned long afterMs);
+  uint32_t epochNow(void);
+  std::string dateTimeBody(void);
+  std::string geospatialBody(void);
+  std::string fixQualityBody(void);
+  std::string jammingBody(void);
+  std::string powerBody(void);
+  std::string rssiBody(void);
+  std::string messageBody(const char *tag, const Sim_Message_t &msg);
+  std::string rateBody(int index);
+  void rateCommand(int index, const std::string &args);
+  void commandMM(const std::string &args);
+  void commandMT(const std::string &args);
+  void commandTD(const std::string &args);
+  void commandSL(const std::string &args);
+  uint32_t random(void);
+
+  std::recursive_mutex _mutex;
+  SWARM_M138_Transport *_transport;     // NULL when using the built-in port
+  SWARM_M138_Simulator_Port _port;
+  std::deque<uint8_t> _portRx;          // Bytes delivered to the built-in port
+  std::string _line;                    // The command being received
+  unsigned long _replyDelay;            // The latency chosen for the current command
+  bool _burstPending;                   // Send the burst before the first reply to the current command
+  bool _discardLine;                    // The rest of the line woke the modem. Ignore it
+  std::multimap<unsigned long, std::string> _scheduled; // Sentences waiting for their latency (micros)
+  std::deque<uint8_t> _out;             // Sentences being paced out
+  unsigned long _paceStart;             // micros when the first byte in _out became due
+  unsigned long _paceSent;              // Bytes sent since _paceStart
+
+  unsigned long _latencyMin;
+  unsigned long _latencyMax;
+  unsigned long _baud;
+  unsigned long _secondLength;
+
+  Sim_State_e _state;
+  unsigned long _wakeAt; // millis
+  uint32_t _deviceID;
+  std::string _firmware;
+  uint32_t _epoch;
+  unsigned long _epochSetAt; // millis
+  bool _epochValid;
+  float _lat, _lon;
+  int _alt, _course, _speed;
+  int _hdop, _vdop, _sats;
+  std::string _fixType;
+  int _spoofState, _jammingLevel;
+  float _cpuVolts, _temperature;
+  int _backgroundRssi;
+  int _gpio1Mode;
+  bool _gpio1High;
+
+  static const char *const _rateTags[6];
+  uint32_t _rates[6];           // Seconds. 0 = disabled
+  unsigned long _rateDue[6];    // millis
+  uint8_t _burst;
+
+  std::vector<Sim_Message_t> _txQueue;
+  std::vector<Sim_Message_t> _rxStore;
+  uint16_t _txQueueLimit;
+  unsigned long _txSendDelay;
+  uint64_t _nextMessageID;
+  bool _rxNotifications;
+
+  uint16_t _faultCount[SWARM_M138_SIM_FAULT_COUNT];
+  uint16_t _faultRate[SWARM_M138_SIM_FAULT_COUNT];
+  std::map<std::string, std::deque<std::string>> _errors;
+  uint32_t _seed;
+
+  uint32_t _commandCount;
+  uint32_t _checksumErrors;
+  std::string _lastCommand;
+
+  std::atomic<bool> _run;
+  std::thread *_thread;
+};
+
+#endif
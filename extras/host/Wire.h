@@ -0,0 +1,31 @@
+/*!
+ * @file Wire.h
+ *
+ * A TwoWire stub for the Linux host build. There is no I2C bus: every transmission is NACK'd,
+ * so begin(deviceAddress, wirePort) will fail cleanly. Use a SWARM_M138_Transport instead.
+ *
+ * Please see LICENSE.md for the license information
+ *
+ */
+
+#ifndef SWARM_M138_HOST_WIRE_H
+#define SWARM_M138_HOST_WIRE_H
+
+#include "Arduino.h"
+
+class TwoWire : public Stream
+{
+public:
+  void begin(void) {}
+  void beginTransmission(uint8_t address) {}
+  uint8_t endTransmission(bool sendStop = true) { return 2; } // Address NACK
+  uint8_t requestFrom(uint8_t address, uint8_t quantity, uint8_t sendStop = true) { return 0; }
+  size_t write(uint8_t c) { return 0; }
+  using Print::write;
+  int available(void) { return 0; }
+  int read(void) { return -1; }
+};
+
+extern TwoWire Wire;
+
+#endif
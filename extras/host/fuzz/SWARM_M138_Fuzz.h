@@ -0,0 +1,104 @@
+/*!
+ * @file SWARM_M138_Fuzz.h
+ *
+ * Shared code for the fuzz targets: a transport which plays the fuzz input as the modem output,
+ * and callbacks for every unsolicited message so each parser runs
+ *
+ * Please see LICENSE.md for the license information
+ *
+ */
+
+#ifndef SWARM_M138_FUZZ_H
+#define SWARM_M138_FUZZ_H
+
+#include "SparkFun_Swarm_Satellite_Arduino_Library.h"
+
+/** Plays data as the modem output, a UART FIFO's worth at a time. Whatever the library writes is discarded */
+class SWARM_M138_Fuzz_Transport : public SWARM_M138_Transport
+{
+public:
+  SWARM_M138_Fuzz_Transport(void) : _data(NULL), _len(0), _pos(0) {}
+
+  void play(const uint8_t *data, size_t len)
+  {
+    _data = data;
+    _len = len;
+    _pos = 0;
+  }
+  bool done(void) { return (_pos >= _len); }
+
+  size_t write(const uint8_t *data, size_t len) { return (len); }
+  int available(void)
+  {
+    size_t n = _len - _pos;
+    return ((int)(n > 64 ? 64 : n));
+  }
+  int read(uint8_t *data, size_t len)
+  {
+    size_t n = _len - _pos;
+    if (n > len)
+      n = len;
+    memcpy(data, _data + _pos, n);
+    _pos += n;
+    return ((int)n);
+  }
+
+private:
+  const uint8_t *_data;
+  size_t _len;
+  size_t _pos;
+};
+
+// The callbacks read every field, so MemorySanitizer builds see anything left uninitialized
+
+static volatile uint32_t swarmFuzzSink;
+static volatile float swarmFuzzFloatSink;
+
+inline void swarmFuzzDateTime(const Swarm_M138_DateTimeData_t *d) { swarmFuzzSink += d->YYYY + d->MM + d->DD + d->hh + d->mm + d->ss + d->valid; }
+inline void swarmFuzzJamming(const Swarm_M138_GPS_Jamming_Indication_t *j) { swarmFuzzSink += j->spoof_state + j->jamming_level; }
+inline void swarmFuzzGeospatial(const Swarm_M138_GeospatialData_t *g) { swarmFuzzFloatSink += g->lat + g->lon + g->alt + g->course + g->speed; }
+inline void swarmFuzzFixQuality(const Swarm_M138_GPS_Fix_Quality_t *f) { swarmFuzzSink += f->hdop + f->vdop + f->gnss_sats + f->unused + f->fix_type; }
+inline void swarmFuzzPower(const Swarm_M138_Power_Status_t *p) { swarmFuzzFloatSink += p->cpu_volts + p->unused1 + p->unused2 + p->unused3 + p->temp; }
+inline void swarmFuzzReceiveTest(const Swarm_M138_Receive_Test_t *r)
+{
+  if (r->background)
+    swarmFuzzSink += r->rssi_background;
+  else
+    swarmFuzzSink += r->rssi_sat + r->snr + r->fdev + r->time.YYYY + r->sat_id;
+}
+inline void swarmFuzzSleepWake(Swarm_M138_Wake_Cause_e cause) { swarmFuzzSink += cause; }
+inline void swarmFuzzTransmit(const int16_t *rssi, const int16_t *snr, const int16_t *fdev, const uint64_t *id) { swarmFuzzSink += *rssi + *snr + *fdev + (uint32_t)*id; }
+inline void swarmFuzzModemStatus(Swarm_M138_Modem_Status_e status, const char *data)
+{
+  swarmFuzzSink += status;
+  if (data != NULL)
+    swarmFuzzSink += strlen(data);
+}
+inline void swarmFuzzReceive(const uint16_t *appID, const int16_t *rssi, const int16_t *snr, const int16_t *fdev, const char *asciiHex)
+{
+  if (appID != NULL) // NULL if the message had no appID
+    swarmFuzzSink += *appID;
+  swarmFuzzSink += *rssi + *snr + *fdev + strlen(asciiHex);
+}
+inline void swarmFuzzRawLine(const Swarm_M138_Line_View_t *line)
+{
+  for (size_t i = 0; i < line->length; i++) // Every byte of the view must be inside the receive buffer
+    swarmFuzzSink += (uint8_t)line->data[i];
+}
+
+inline void swarmFuzzSetCallbacks(SWARM_M138 &swarm)
+{
+  swarm.setDateTimeCallback(&swarmFuzzDateTime);
+  swarm.setGpsJammingCallback(&swarmFuzzJamming);
+  swarm.setGeospatialInfoCallback(&swarmFuzzGeospatial);
+  swarm.setGpsFixQualityCallback(&swarmFuzzFixQuality);
+  swarm.setPowerStatusCallback(&swarmFuzzPower);
+  swarm.setReceiveMessageCallback(&swarmFuzzReceive);
+  swarm.setReceiveTestCallback(&swarmFuzzReceiveTest);
+  swarm.setSleepWakeCallback(&swarmFuzzSleepWake);
+  swarm.setModemStatusCallback(&swarmFuzzModemStatus);
+  swarm.setTransmitDataCallback(&swarmFuzzTransmit);
+  swarm.setRawLineCallback(&swarmFuzzRawLine);
+}
+
+#endif
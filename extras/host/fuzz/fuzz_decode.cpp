@@ -0,0 +1,82 @@
+/*!
+ * @file fuzz_decode.cpp
+ *
+ * Fuzz target: the binary payload decoders - unpackRecords, decompressPayload and the fragment reassembler
+ *
+ * The first input byte selects the decoder. The rest is the received payload.
+ * For the reassembler, the payload is a series of fragments, each preceded by its appID (two bytes) and length (one byte).
+ *
+ * Please see LICENSE.md for the license information
+ *
+ */
+
+#include "SWARM_M138_Fuzz.h"
+
+static void recordCallback(uint8_t type, const uint8_t *data, uint8_t len)
+{
+  for (uint8_t i = 0; i < len; i++)
+    swarmFuzzSink += data[i];
+  swarmFuzzSink += type;
+}
+
+static void reassembledCallback(const uint8_t *data, size_t len, uint8_t key, uint16_t channel)
+{
+  for (size_t i = 0; i < len; i++)
+    swarmFuzzSink += data[i];
+  swarmFuzzSink += key + channel;
+}
+
+extern "C" int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+  hostUseSimulatedClock(true);
+  return (0);
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  if (size < 1)
+    return (0);
+
+  SWARM_M138 swarm;
+  const uint8_t *payload = data + 1;
+  size_t len = size - 1;
+
+  switch (data[0] % 3)
+  {
+  case 0:
+    swarm.unpackRecords(payload, len, &recordCallback);
+    break;
+  case 1:
+  {
+    size_t outLen = 1024;
+    uint8_t *out = new uint8_t[outLen];
+    swarm.decompressPayload(payload, len, out, &outLen);
+    delete[] out;
+  }
+  break;
+  default:
+    if (swarm.enableReassembly(2048))
+    {
+      swarm.setReassembledCallback(&reassembledCallback);
+      while (len >= 3)
+      {
+        uint16_t appID = ((uint16_t)payload[0] << 8) | payload[1];
+        size_t fragmentLen = payload[2];
+        payload += 3;
+        len -= 3;
+        if (fragmentLen > len)
+          fragmentLen = len;
+        uint8_t *fragment = new uint8_t[fragmentLen + 1]; // Exactly sized (new uint8_t[0] is not NULL, but has no room)
+        memcpy(fragment, payload, fragmentLen);
+        swarm.feedFragment(appID, fragment, fragmentLen);
+        delete[] fragment;
+        payload += fragmentLen;
+        len -= fragmentLen;
+      }
+      uint8_t missing[SWARM_M138_FRAGMENT_BITMAP_LENGTH];
+      swarm.getMissingFragments(missing);
+    }
+    break;
+  }
+  return (0);
+}
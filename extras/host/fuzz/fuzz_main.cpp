@@ -0,0 +1,94 @@
+/*!
+ * @file fuzz_main.cpp
+ *
+ * A main() for the fuzz targets when libFuzzer is not available: with g++, or for AFL++.
+ * Each argument is a file, or a directory of files, to run through LLVMFuzzerTestOneInput.
+ * With no arguments, stdin is run. So it replays the corpus or a crash, and works as an AFL target:
+ *
+ *   afl-fuzz -i fuzz/corpus/unsolicited -o findings -- build/fuzz/fuzz_unsolicited_replay @@
+ *
+ * Please see LICENSE.md for the license information
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+extern "C" int LLVMFuzzerInitialize(int *argc, char ***argv);
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static int runFile(FILE *f, const char *name)
+{
+  size_t size = 0, capacity = 4096;
+  uint8_t *data = (uint8_t *)malloc(capacity);
+  size_t got;
+  while ((got = fread(data + size, 1, capacity - size, f)) > 0)
+  {
+    size += got;
+    if (size == capacity)
+    {
+      capacity *= 2;
+      data = (uint8_t *)realloc(data, capacity);
+    }
+  }
+  // Copy to an exactly sized buffer, so a read past the end is caught
+  uint8_t *exact = (uint8_t *)malloc(size ? size : 1);
+  memcpy(exact, data, size);
+  free(data);
+  LLVMFuzzerTestOneInput(exact, size);
+  free(exact);
+  fprintf(stderr, "ran %s (%lu bytes)\n", name, (unsigned long)size);
+  return (1);
+}
+
+static int runPath(const char *path)
+{
+  struct stat st;
+  if (stat(path, &st) != 0)
+  {
+    perror(path);
+    return (0);
+  }
+  if (S_ISDIR(st.st_mode))
+  {
+    int count = 0;
+    DIR *dir = opendir(path);
+    struct dirent *entry;
+    while ((dir != NULL) && ((entry = readdir(dir)) != NULL))
+    {
+      if (entry->d_name[0] == '.')
+        continue;
+      char child[4096];
+      snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+      count += runPath(child);
+    }
+    if (dir != NULL)
+      closedir(dir);
+    return (count);
+  }
+  FILE *f = fopen(path, "rb");
+  if (f == NULL)
+  {
+    perror(path);
+    return (0);
+  }
+  int count = runFile(f, path);
+  fclose(f);
+  return (count);
+}
+
+int main(int argc, char **argv)
+{
+  LLVMFuzzerInitialize(&argc, &argv);
+  if (argc < 2)
+    return (runFile(stdin, "stdin") == 1 ? 0 : 1);
+  int count = 0;
+  for (int i = 1; i < argc; i++)
+    count += runPath(argv[i]);
+  fprintf(stderr, "%d inputs\n", count);
+  return (0);
+}
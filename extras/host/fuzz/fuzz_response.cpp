@@ -0,0 +1,169 @@
+/*!
+ * @file fuzz_response.cpp
+ *
+ * Fuzz target: waitForResponse, the command error parser and the response parsers, including the
+ * $MM / $MT message read decoders
+ *
+ * The first input byte selects a public method. The rest is the modem output which follows the command:
+ * the response, or unsolicited messages and then the response, or rubbish.
+ * The caller buffers are exactly the documented sizes, so an overrun is caught by AddressSanitizer.
+ *
+ * Please see LICENSE.md for the license information
+ *
+ */
+
+#include "SWARM_M138_Fuzz.h"
+
+static void drainCallback(const uint8_t *data, size_t len, const uint64_t *msg_id, const uint32_t *epoch, const uint16_t *appID)
+{
+  for (size_t i = 0; i < len; i++)
+    swarmFuzzSink += data[i];
+  swarmFuzzSink += (uint32_t)*msg_id + *epoch + *appID;
+}
+
+extern "C" int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+  hostUseSimulatedClock(true);
+  return (0);
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  if (size < 1)
+    return (0);
+
+  SWARM_M138 swarm;
+  SWARM_M138_Fuzz_Transport transport;
+  swarm.begin(transport); // $CS gets no reply. begin returns false, but the buffers are ready
+  swarmFuzzSetCallbacks(swarm);
+
+  transport.play(data + 1, size - 1);
+
+  uint32_t u32;
+  uint16_t u16;
+  uint64_t u64;
+  float f;
+  bool b;
+  Swarm_M138_GPIO1_Mode_e mode;
+  Swarm_M138_DateTimeData_t dateTime;
+  Swarm_M138_GPS_Jamming_Indication_t jamming;
+  Swarm_M138_GeospatialData_t info;
+  Swarm_M138_GPS_Fix_Quality_t fixQuality;
+  Swarm_M138_Power_Status_t powerStatus;
+  Swarm_M138_Receive_Test_t rxTest;
+  char *buffer = NULL;
+  const uint8_t payload[] = {0x48, 0x65, 0x6c, 0x6c, 0x6f};
+
+  switch (data[0] % 32)
+  {
+  case 0:
+    buffer = new char[SWARM_M138_MEM_ALLOC_CS];
+    swarm.getConfigurationSettings(buffer);
+    break;
+  case 1:
+    swarm.getDeviceID(&u32);
+    break;
+  case 2:
+    swarm.getDateTime(&dateTime);
+    break;
+  case 3:
+    swarm.getDateTimeRate(&u32);
+    break;
+  case 4:
+    swarm.setDateTimeRate(60);
+    break;
+  case 5:
+    buffer = new char[SWARM_M138_MEM_ALLOC_FV];
+    swarm.getFirmwareVersion(buffer);
+    break;
+  case 6:
+    swarm.getGpsJammingIndication(&jamming);
+    break;
+  case 7:
+    swarm.getGeospatialInfo(&info);
+    break;
+  case 8:
+    swarm.getGPIO1Mode(&mode);
+    break;
+  case 9:
+    swarm.readGPIO1voltage(&f);
+    break;
+  case 10:
+    swarm.getGpsFixQuality(&fixQuality);
+    break;
+  case 11:
+    swarm.getPowerStatus(&powerStatus);
+    break;
+  case 12:
+    swarm.getTemperature(&f);
+    break;
+  case 13:
+    swarm.getCPUvoltage(&f);
+    break;
+  case 14:
+    swarm.getReceiveTest(&rxTest);
+    break;
+  case 15:
+    swarm.getReceiveTestRate(&u32);
+    break;
+  case 16:
+    swarm.getRxMessageCount(&u16);
+    break;
+  case 17:
+    swarm.getMessageNotifications(&b);
+    break;
+  case 18:
+    buffer = new char[SWARM_M138_MAX_PACKET_LENGTH_HEX + 1];
+    swarm.listMessage(5354900000001ULL, buffer, SWARM_M138_MAX_PACKET_LENGTH_HEX + 1, &u32, &u16);
+    break;
+  case 19:
+    buffer = new char[SWARM_M138_MAX_PACKET_LENGTH_HEX + 1];
+    swarm.readMessage(5354900000001ULL, buffer, SWARM_M138_MAX_PACKET_LENGTH_HEX + 1, &u32, &u16);
+    break;
+  case 20:
+    buffer = new char[9]; // A short buffer
+    swarm.readOldestMessage(buffer, 9, &u64, &u32, &u16);
+    break;
+  case 21:
+    buffer = new char[SWARM_M138_MAX_PACKET_LENGTH_HEX + 1];
+    swarm.readNewestMessage(buffer, SWARM_M138_MAX_PACKET_LENGTH_HEX + 1, &u64);
+    break;
+  case 22:
+    swarm.drainRxMessages(&drainCallback, 4);
+    break;
+  case 23:
+    swarm.getUnsentMessageCount(&u16);
+    break;
+  case 24:
+    buffer = new char[SWARM_M138_MAX_PACKET_LENGTH_HEX + 1];
+    swarm.listTxMessage(5354900000001ULL, buffer, SWARM_M138_MAX_PACKET_LENGTH_HEX + 1, &u32, &u16);
+    break;
+  case 25:
+    swarm.deleteTxMessage(5354900000001ULL);
+    break;
+  case 26:
+    swarm.transmitText("Hello", &u64);
+    break;
+  case 27:
+    swarm.transmitBinary(payload, sizeof(payload), &u64, 1234);
+    break;
+  case 28:
+    swarm.sleepMode(60);
+    break;
+  case 29:
+    swarm.restartDevice();
+    break;
+  case 30:
+    swarm.getGeospatialInfoRate(&u32);
+    break;
+  default:
+    swarm.setMessageNotifications(true);
+    break;
+  }
+
+  if (buffer != NULL)
+    delete[] buffer;
+
+  swarm.checkUnsolicitedMsg(); // Process whatever the command left in the backlog
+  return (0);
+}
@@ -0,0 +1,33 @@
+/*!
+ * @file fuzz_unsolicited.cpp
+ *
+ * Fuzz target: the line framer, checkChecksum and every unsolicited message parser
+ *
+ * The input is the modem output. It is read through checkUnsolicitedMsg, in UART FIFO sized chunks,
+ * so sentences are split across reads and carried over in the backlog.
+ *
+ * Please see LICENSE.md for the license information
+ *
+ */
+
+#include "SWARM_M138_Fuzz.h"
+
+extern "C" int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+  hostUseSimulatedClock(true);
+  return (0);
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  SWARM_M138 swarm;
+  SWARM_M138_Fuzz_Transport transport;
+  swarm.begin(transport); // $CS gets no reply. begin returns false, but the buffers are ready
+  swarmFuzzSetCallbacks(swarm);
+
+  transport.play(data, size);
+  for (size_t calls = 0; (calls <= size) && !transport.done(); calls++) // Each call reads at least one byte
+    swarm.checkUnsolicitedMsg();
+  swarm.checkUnsolicitedMsg(); // Process anything carried over in the backlog
+  return (0);
+}
@@ -0,0 +1,567 @@
+/*!
+ * @file swarm_bench.cpp
+ *
+ * Benchmarks for the SparkFun Swarm Satellite Arduino Library, run on a Linux host
+ *
+ * Reports, as JSON on stdout:
+ *   urc        : checkUnsolicitedMsg throughput (lines per second) for each unsolicited message type
+ *   recorded   : the same for a recorded capture, if one is given with --traffic <file>.
+ *                The capture is either the raw modem output, or a wire trace (enableTrace): its received bytes are used
+ *   commands   : microseconds, heap allocations and peak heap bytes per call for the public command methods
+ *   backlog    : backlog occupancy and command time when unsolicited messages arrive during each command
+ *   drain      : messages per second read from the simulated modem by drainRxMessages, and by a readOldestMessage loop:
+ *                paced at the modem's 115200 baud, and unpaced
+ *
+ * The modem is a canned responder which replies instantly and does not allocate, so the times and
+ * the heap figures are the library's own. The drain figures use SWARM_M138_Simulator with no latency,
+ * so they include the simulator's own work. Keep the JSON from each release and diff them.
+ *
+ * Usage: swarm_bench [--traffic <file>] [--quick]
+ *
+ * Please see LICENSE.md for the license information
+ *
+ */
+
+#include "SWARM_M138_Host_Transport.h"
+#include "SWARM_M138_Simulator.h"
+
+#include <chrono>
+#include <new>
+
+#ifndef SWARM_M138_BENCH_VERSION
+#define SWARM_M138_BENCH_VERSION "unknown"
+#endif
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+// Heap accounting. Every new / delete in the process comes through here
+
+static size_t heapAllocations = 0;
+static size_t heapLive = 0;
+static size_t heapPeak = 0;
+
+#define BENCH_HEAP_HEADER 16 // Keeps the returned pointer 16-byte aligned
+
+static void *benchAlloc(size_t size)
+{
+  uint8_t *p = (uint8_t *)malloc(size + BENCH_HEAP_HEADER);
+  if (p == NULL)
+    throw std::bad_alloc();
+  *(size_t *)p = size;
+  heapAllocations++;
+  heapLive += size;
+  if (heapLive > heapPeak)
+    heapPeak = heapLive;
+  return (p + BENCH_HEAP_HEADER);
+}
+
+static void benchFree(void *ptr)
+{
+  if (ptr == NULL)
+    return;
+  uint8_t *p = (uint8_t *)ptr - BENCH_HEAP_HEADER;
+  heapLive -= *(size_t *)p;
+  free(p);
+}
+
+void *operator new(size_t size) { return (benchAlloc(size)); }
+void *operator new[](size_t size) { return (benchAlloc(size)); }
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+  try
+  {
+    return (benchAlloc(size));
+  }
+  catch (...)
+  {
+    return (NULL);
+  }
+}
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+  try
+  {
+    return (benchAlloc(size));
+  }
+  catch (...)
+  {
+    return (NULL);
+  }
+}
+void operator delete(void *ptr) noexcept { benchFree(ptr); }
+void operator delete[](void *ptr) noexcept { benchFree(ptr); }
+void operator delete(void *ptr, size_t) noexcept { benchFree(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { benchFree(ptr); }
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+static double nowSeconds(void)
+{
+  return (std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Add the $, checksum and LF to body
+static void makeSentence(char *dest, size_t len, const char *body)
+{
+  uint8_t checksum = 0;
+  for (const char *c = body; *c != 0; c++)
+    checksum ^= (uint8_t)*c;
+  snprintf(dest, len, "$%s*%02x\n", body, checksum);
+}
+
+// A canned modem. Each command gets an instant reply, optionally preceded by a burst of unsolicited sentences
+class BenchModem : public SWARM_M138_Transport
+{
+public:
+  BenchModem(void) : _cmdLen(0), _rxLen(0), _rxPos(0), _burst(0), _burstSentence(NULL), _replay(NULL), _replayLen(0), _replayPos(0) {}
+
+  size_t write(const uint8_t *data, size_t len)
+  {
+    for (size_t i = 0; i < len; i++)
+    {
+      if (data[i] == '\n')
+      {
+        _cmd[_cmdLen] = 0;
+        respond();
+        _cmdLen = 0;
+      }
+      else if (_cmdLen < sizeof(_cmd) - 1)
+        _cmd[_cmdLen++] = (char)data[i];
+    }
+    return (len);
+  }
+  int available(void)
+  {
+    if (_replay != NULL) // A UART FIFO's worth at a time
+    {
+      size_t n = _replayLen - _replayPos;
+      return ((int)(n > 64 ? 64 : n));
+    }
+    return ((int)(_rxLen - _rxPos));
+  }
+  int read(uint8_t *data, size_t len)
+  {
+    if (_replay != NULL)
+    {
+      size_t n = _replayLen - _replayPos;
+      if (n > len)
+        n = len;
+      memcpy(data, _replay + _replayPos, n);
+      _replayPos += n;
+      return ((int)n);
+    }
+    size_t n = _rxLen - _rxPos;
+    if (n > len)
+      n = len;
+    memcpy(data, &_rx[_rxPos], n);
+    _rxPos += n;
+    return ((int)n);
+  }
+
+  void setBurst(uint8_t count, const char *sentence)
+  {
+    _burst = count;
+    _burstSentence = sentence;
+  }
+
+  // Stop replying. Deliver data instead
+  void replay(const char *data, size_t len)
+  {
+    _replay = data;
+    _replayLen = len;
+    _replayPos = 0;
+  }
+  bool replayDone(void) { return (_replayPos >= _replayLen); }
+
+private:
+  struct Reply
+  {
+    const char *command; // Matched against the start of the command body
+    const char *body;
+    char sentence[448];
+  };
+  static Reply _replies[];
+
+  void push(const char *s)
+  {
+    if (_rxPos == _rxLen)
+      _rxPos = _rxLen = 0;
+    size_t len = strlen(s);
+    if (_rxLen + len <= sizeof(_rx))
+    {
+      memcpy(&_rx[_rxLen], s, len);
+      _rxLen += len;
+    }
+  }
+
+  void respond(void)
+  {
+    const char *body = strchr(_cmd, '$');
+    if (body == NULL)
+      return;
+    body++;
+    for (uint8_t i = 0; i < _burst; i++)
+      push(_burstSentence);
+    for (Reply *r = _replies; r->command != NULL; r++)
+    {
+      if (strncmp(body, r->command, strlen(r->command)) == 0)
+      {
+        if (r->sentence[0] == 0)
+          makeSentence(r->sentence, sizeof(r->sentence), r->body);
+        push(r->sentence);
+        return;
+      }
+    }
+  }
+
+  char _cmd[512];
+  size_t _cmdLen;
+  char _rx[8192];
+  size_t _rxLen;
+  size_t _rxPos;
+  uint8_t _burst;
+  const char *_burstSentence;
+  const char *_replay;
+  size_t _replayLen;
+  size_t _replayPos;
+};
+
+BenchModem::Reply BenchModem::_replies[] = {
+    {"CS", "CS DI=0x000abc,DN=M138", {0}},
+    {"DT @", "DT 20261018120000,V", {0}},
+    {"DT ?", "DT 0", {0}},
+    {"DT ", "DT OK", {0}},
+    {"FV", "FV 2022-02-06T00:06:40,v2.0.1", {0}},
+    {"GJ @", "GJ 1,0", {0}},
+    {"GN @", "GN 40.0902,-105.1851,1624,0,0", {0}},
+    {"GS @", "GS 109,214,9,0,G3", {0}},
+    {"PW @", "PW 3.30000,0.00000,0.00000,0.00000,25.0", {0}},
+    {"RT @", "RT RSSI=-104", {0}},
+    {"MM C=", "MM 3", {0}},
+    {"MM R=O", "MM AI=0,48656c6c6f20576f726c6421,5354900000001,1767225600", {0}},
+    {"MT C=", "MT 3", {0}},
+    {"MT L=", "MT AI=0,48656c6c6f20576f726c6421,5354900000001,1767225600", {0}},
+    {"MT D=", "MT DELETED", {0}},
+    {"TD ", "TD OK,5354900000001", {0}},
+    {NULL, NULL, {0}}};
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+// Count what reaches the callbacks, so a parse failure shows up as delivered < lines
+
+static uint32_t delivered = 0;
+
+void countDateTime(const Swarm_M138_DateTimeData_t *) { delivered++; }
+void countJamming(const Swarm_M138_GPS_Jamming_Indication_t *) { delivered++; }
+void countGeospatial(const Swarm_M138_GeospatialData_t *) { delivered++; }
+void countFixQuality(const Swarm_M138_GPS_Fix_Quality_t *) { delivered++; }
+void countPower(const Swarm_M138_Power_Status_t *) { delivered++; }
+void countReceive(const uint16_t *, const int16_t *, const int16_t *, const int16_t *, const char *) { delivered++; }
+void countReceiveTest(const Swarm_M138_Receive_Test_t *) { delivered++; }
+void countSleepWake(Swarm_M138_Wake_Cause_e) { delivered++; }
+void countModemStatus(Swarm_M138_Modem_Status_e, const char *) { delivered++; }
+void countTransmit(const int16_t *, const int16_t *, const int16_t *, const uint64_t *) { delivered++; }
+
+static void setCallbacks(SWARM_M138 &swarm)
+{
+  swarm.setDateTimeCallback(&countDateTime);
+  swarm.setGpsJammingCallback(&countJamming);
+  swarm.setGeospatialInfoCallback(&countGeospatial);
+  swarm.setGpsFixQualityCallback(&countFixQuality);
+  swarm.setPowerStatusCallback(&countPower);
+  swarm.setReceiveMessageCallback(&countReceive);
+  swarm.setReceiveTestCallback(&countReceiveTest);
+  swarm.setSleepWakeCallback(&countSleepWake);
+  swarm.setModemStatusCallback(&countModemStatus);
+  swarm.setTransmitDataCallback(&countTransmit);
+}
+
+// Run checkUnsolicitedMsg over data. Print one JSON object
+static void benchReplay(const char *name, const char *data, size_t len, uint32_t lines, bool last)
+{
+  SWARM_M138 swarm;
+  BenchModem modem;
+  swarm.begin(modem);
+  setCallbacks(swarm);
+  modem.replay(data, len);
+
+  delivered = 0;
+  size_t allocationsBefore = heapAllocations;
+  double start = nowSeconds();
+  while (!modem.replayDone())
+    swarm.checkUnsolicitedMsg();
+  swarm.checkUnsolicitedMsg();
+  double elapsed = nowSeconds() - start;
+
+  printf("    {\"type\": \"%s\", \"lines\": %lu, \"bytes\": %lu, \"delivered\": %lu, \"seconds\": %.6f, \"lines_per_second\": %.0f, \"allocations_per_line\": %.2f}%s\n",
+         name, (unsigned long)lines, (unsigned long)len, (unsigned long)delivered, elapsed,
+         (elapsed > 0) ? lines / elapsed : 0.0, (double)(heapAllocations - allocationsBefore) / (lines ? lines : 1), last ? "" : ",");
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+static SWARM_M138 mySwarm;
+static BenchModem myModem;
+
+static uint32_t drained = 0;
+
+void countDrained(const uint8_t *, size_t, const uint64_t *, const uint32_t *, const uint16_t *) { drained++; }
+
+// Drain messages from the simulated modem, by drainRxMessages (method 0, or 1 to delete them) or by a readOldestMessage loop (method 2)
+// baud 0 delivers each response instantly, so only the library and the simulator are measured
+static void benchDrain(const char *name, int method, unsigned long baud, uint32_t messages, bool last)
+{
+  SWARM_M138 drainSwarm;
+  SWARM_M138_Simulator sim;
+  sim.setLatency(0);
+  sim.setBaud(baud);
+  drainSwarm.begin(sim.port());
+
+  uint8_t payload[64];
+  for (size_t i = 0; i < sizeof(payload); i++)
+    payload[i] = (uint8_t)i;
+  for (uint32_t i = 0; i < messages; i++)
+    sim.receiveMessage(1000 + (i % 16), payload, sizeof(payload));
+  drainSwarm.checkUnsolicitedMsg(); // Nothing is subscribed, so the $RD messages are dropped
+
+  char asciiHex[(SWARM_M138_MAX_PACKET_LENGTH_BYTES * 2) + 1];
+  uint64_t id;
+  uint32_t commandsBefore = sim.getCommandCount();
+#ifdef SWARM_M138_ALLOC_HOOKS
+  Swarm_M138_Alloc_Stats_t before, after;
+  drainSwarm.getAllocStats(&before);
+#endif
+  drained = 0;
+  double start = nowSeconds();
+  if (method == 2)
+  {
+    while (drainSwarm.readOldestMessage(asciiHex, sizeof(asciiHex), &id) == SWARM_M138_SUCCESS)
+      drained++;
+  }
+  else
+    drainSwarm.drainRxMessages(&countDrained, 0xFFFF, NULL, method == 1);
+  double elapsed = nowSeconds() - start;
+  uint32_t commands = sim.getCommandCount() - commandsBefore;
+  uint32_t count = (drained > 0) ? drained : 1;
+
+  printf("    {\"method\": \"%s\", \"baud\": %lu, \"messages\": %lu, \"drained\": %lu, \"seconds\": %.6f, \"messages_per_second\": %.0f, \"commands_per_message\": %.2f, ",
+         name, baud, (unsigned long)messages, (unsigned long)drained, elapsed, (elapsed > 0) ? drained / elapsed : 0.0, (double)commands / count);
+#ifdef SWARM_M138_ALLOC_HOOKS
+  drainSwarm.getAllocStats(&after);
+  printf("\"allocations_per_message\": %.2f}%s\n", (double)(after.allocations - before.allocations) / count, last ? "" : ",");
+#else
+  printf("\"allocations_per_message\": null}%s\n", last ? "" : ",");
+#endif
+}
+
+// Time calls of method. Record the allocations per call and the peak heap above the starting level
+#define BENCH_COMMAND(NAME, CALL, LAST)                                                                                  \
+  do                                                                                                                     \
+  {                                                                                                                      \
+    size_t allocationsBefore = heapAllocations;                                                                          \
+    size_t peakAbove = 0;                                                                                                \
+    uint32_t failures = 0;                                                                                               \
+    double start = nowSeconds();                                                                                         \
+    for (uint32_t i = 0; i < calls; i++)                                                                                 \
+    {                                                                                                                    \
+      size_t liveBefore = heapLive;                                                                                      \
+      heapPeak = heapLive;                                                                                               \
+      if ((CALL) != SWARM_M138_SUCCESS)                                                                                  \
+        failures++;                                                                                                      \
+      if (heapPeak - liveBefore > peakAbove)                                                                             \
+        peakAbove = heapPeak - liveBefore;                                                                               \
+    }                                                                                                                    \
+    double elapsed = nowSeconds() - start;                                                                               \
+    printf("    {\"method\": \"%s\", \"calls\": %lu, \"failures\": %lu, \"us_per_call\": %.3f, \"allocations_per_call\": %.2f, \"peak_bytes\": %lu}%s\n", \
+           NAME, (unsigned long)calls, (unsigned long)failures, (elapsed * 1e6) / calls,                                 \
+           (double)(heapAllocations - allocationsBefore) / calls, (unsigned long)peakAbove, (LAST) ? "" : ",");          \
+  } while (0)
+
+int main(int argc, char **argv)
+{
+  const char *trafficFile = NULL;
+  bool quick = false;
+  for (int i = 1; i < argc; i++)
+  {
+    if ((strcmp(argv[i], "--traffic") == 0) && (i + 1 < argc))
+      trafficFile = argv[++i];
+    else if (strcmp(argv[i], "--quick") == 0)
+      quick = true;
+    else
+    {
+      fprintf(stderr, "Usage: %s [--traffic <file>] [--quick]\n", argv[0]);
+      return (1);
+    }
+  }
+
+  const uint32_t urcLines = quick ? 2000 : 20000;
+  const uint32_t calls = quick ? 200 : 2000;
+  const uint32_t backlogCalls = quick ? 20 : 200; // Each one waits for checkUnsolicitedMsg's receive window
+
+  printf("{\n");
+  printf("  \"schema\": 1,\n");
+  printf("  \"library_version\": \"%s\",\n", SWARM_M138_BENCH_VERSION);
+  printf("  \"compiler\": \"%s\",\n", __VERSION__);
+#ifdef SWARM_M138_THREADS_AVAILABLE
+  printf("  \"threads\": true,\n");
+#else
+  printf("  \"threads\": false,\n");
+#endif
+
+  // Unsolicited message throughput
+
+  char rdBody[448] = "RD AI=1234,RSSI=-100,SNR=10,FDEV=0,";
+  for (int i = 0; i < SWARM_M138_MAX_PACKET_LENGTH_BYTES; i++)
+    snprintf(&rdBody[strlen(rdBody)], 3, "%02x", i);
+
+  const char *urcs[][2] = {
+      {"$DT", "DT 20261018120000,V"},
+      {"$GJ", "GJ 1,0"},
+      {"$GN", "GN 40.0902,-105.1851,1624,0,0"},
+      {"$GS", "GS 109,214,9,0,G3"},
+      {"$PW", "PW 3.30000,0.00000,0.00000,0.00000,25.0"},
+      {"$RT background", "RT RSSI=-104"},
+      {"$RT packet", "RT RSSI=-110,SNR=-1,FDEV=135,TS=2026-10-18T12:00:00,DI=0x000e57"},
+      {"$M138", "M138 BOOT,RUNNING"},
+      {"$SL WAKE", "SL WAKE,TIME"},
+      {"$RD", rdBody},
+      {"$TD SENT", "TD SENT RSSI=-110,SNR=8,FDEV=-1000,5354900000001"}};
+  const size_t urcCount = sizeof(urcs) / sizeof(urcs[0]);
+
+  printf("  \"urc\": [\n");
+  for (size_t u = 0; u < urcCount; u++)
+  {
+    char sentence[512];
+    makeSentence(sentence, sizeof(sentence), urcs[u][1]);
+    size_t sentenceLen = strlen(sentence);
+    size_t len = sentenceLen * urcLines;
+    char *data = (char *)malloc(len);
+    for (uint32_t i = 0; i < urcLines; i++)
+      memcpy(data + (i * sentenceLen), sentence, sentenceLen);
+    benchReplay(urcs[u][0], data, len, urcLines, u == urcCount - 1);
+    free(data);
+  }
+  printf("  ],\n");
+
+  // Recorded traffic
+
+  if (trafficFile != NULL)
+  {
+    FILE *f = fopen(trafficFile, "rb");
+    if (f == NULL)
+    {
+      perror(trafficFile);
+      return (1);
+    }
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *data = (char *)malloc(len > 0 ? len : 1);
+    size_t got = fread(data, 1, len, f);
+    fclose(f);
+    std::vector<uint8_t> received;
+    if (SWARM_M138_Trace_Transport::extractReceived((const uint8_t *)data, got, received)) // A wire trace: use what the modem sent
+    {
+      free(data);
+      got = received.size();
+      data = (char *)malloc(got > 0 ? got : 1);
+      memcpy(data, received.data(), got);
+    }
+    uint32_t lines = 0;
+    for (size_t i = 0; i < got; i++)
+      if (data[i] == '\n')
+        lines++;
+    printf("  \"recorded\": [\n");
+    benchReplay(trafficFile, data, got, lines, true);
+    printf("  ],\n");
+    free(data);
+  }
+
+  // Commands
+
+  mySwarm.begin(myModem);
+  setCallbacks(mySwarm);
+
+  char text[SWARM_M138_MEM_ALLOC_FV + 64];
+  uint8_t binary[SWARM_M138_MAX_PACKET_LENGTH_BYTES];
+  for (size_t i = 0; i < sizeof(binary); i++)
+    binary[i] = (uint8_t)i;
+  uint64_t id;
+  uint16_t count;
+  uint32_t rate;
+  Swarm_M138_DateTimeData_t dateTime;
+  Swarm_M138_GPS_Jamming_Indication_t jamming;
+  Swarm_M138_GeospatialData_t info;
+  Swarm_M138_GPS_Fix_Quality_t fixQuality;
+  Swarm_M138_Power_Status_t powerStatus;
+  Swarm_M138_Receive_Test_t rxTest;
+  char asciiHex[(SWARM_M138_MAX_PACKET_LENGTH_BYTES * 2) + 1];
+
+  printf("  \"commands\": [\n");
+  BENCH_COMMAND("getConfigurationSettings", mySwarm.getConfigurationSettings(text), false);
+  BENCH_COMMAND("getDateTime", mySwarm.getDateTime(&dateTime), false);
+  BENCH_COMMAND("getDateTimeRate", mySwarm.getDateTimeRate(&rate), false);
+  BENCH_COMMAND("setDateTimeRate", mySwarm.setDateTimeRate(0), false);
+  BENCH_COMMAND("getFirmwareVersion", mySwarm.getFirmwareVersion(text), false);
+  BENCH_COMMAND("getGpsJammingIndication", mySwarm.getGpsJammingIndication(&jamming), false);
+  BENCH_COMMAND("getGeospatialInfo", mySwarm.getGeospatialInfo(&info), false);
+  BENCH_COMMAND("getGpsFixQuality", mySwarm.getGpsFixQuality(&fixQuality), false);
+  BENCH_COMMAND("getPowerStatus", mySwarm.getPowerStatus(&powerStatus), false);
+  BENCH_COMMAND("getReceiveTest", mySwarm.getReceiveTest(&rxTest), false);
+  BENCH_COMMAND("getRxMessageCount", mySwarm.getRxMessageCount(&count), false);
+  BENCH_COMMAND("readOldestMessage", mySwarm.readOldestMessage(asciiHex, sizeof(asciiHex), &id), false);
+  BENCH_COMMAND("getUnsentMessageCount", mySwarm.getUnsentMessageCount(&count), false);
+  BENCH_COMMAND("listTxMessage", mySwarm.listTxMessage(5354900000001ULL, asciiHex, sizeof(asciiHex)), false);
+  BENCH_COMMAND("deleteTxMessage", mySwarm.deleteTxMessage(5354900000001ULL), false);
+  BENCH_COMMAND("transmitText", mySwarm.transmitText("Hello World!", &id), false);
+  BENCH_COMMAND("transmitBinary (192 bytes)", mySwarm.transmitBinary(binary, sizeof(binary), &id), false);
+  BENCH_COMMAND("checkUnsolicitedMsg (idle)", (mySwarm.checkUnsolicitedMsg(), SWARM_M138_SUCCESS), true);
+  printf("  ],\n");
+
+  // Backlog occupancy: unsolicited messages arrive during every command
+
+  char burstSentence[128];
+  makeSentence(burstSentence, sizeof(burstSentence), "GN 40.0902,-105.1851,1624,0,0");
+  const uint8_t bursts[] = {0, 1, 2, 4, 8, 12};
+  const size_t burstCount = sizeof(bursts) / sizeof(bursts[0]);
+
+  printf("  \"backlog\": [\n");
+  for (size_t b = 0; b < burstCount; b++)
+  {
+    myModem.setBurst(bursts[b], burstSentence);
+    mySwarm.checkUnsolicitedMsg(); // Start from an empty backlog
+    mySwarm.resetBacklogStats();
+    delivered = 0;
+    uint32_t failures = 0;
+    double start = nowSeconds();
+    for (uint32_t i = 0; i < backlogCalls; i++)
+    {
+      if (mySwarm.getDateTime(&dateTime) != SWARM_M138_SUCCESS)
+        failures++;
+      mySwarm.checkUnsolicitedMsg();
+    }
+    double elapsed = nowSeconds() - start;
+    printf("    {\"burst\": %u, \"commands\": %lu, \"failures\": %lu, \"us_per_command\": %.3f, \"sent\": %lu, \"delivered\": %lu, \"high_water\": %u, \"overflows\": %lu}%s\n",
+           bursts[b], (unsigned long)backlogCalls, (unsigned long)failures, (elapsed * 1e6) / backlogCalls,
+           (unsigned long)(bursts[b] * backlogCalls), (unsigned long)delivered, mySwarm.getBacklogHighWater(),
+           (unsigned long)mySwarm.getBacklogOverflows(), (b == burstCount - 1) ? "" : ",");
+  }
+  myModem.setBurst(0, NULL);
+  printf("  ],\n");
+
+  // Draining the modem's received messages
+
+  const uint32_t drainMessages = quick ? 50 : 200; // At 115200 baud, each 64-byte message takes ~15ms on the wire
+
+  printf("  \"drain\": [\n");
+  benchDrain("drainRxMessages", 0, SWARM_M138_SERIAL_BAUD_RATE, drainMessages, false);
+  benchDrain("drainRxMessages (delete)", 1, SWARM_M138_SERIAL_BAUD_RATE, drainMessages, false);
+  benchDrain("readOldestMessage loop", 2, SWARM_M138_SERIAL_BAUD_RATE, drainMessages, false);
+  benchDrain("drainRxMessages", 0, 0, drainMessages * 10, false);
+  benchDrain("drainRxMessages (delete)", 1, 0, drainMessages * 10, false);
+  benchDrain("readOldestMessage loop", 2, 0, drainMessages * 10, true);
+  printf("  ]\n");
+
+  printf("}\n");
+  return (0);
+}
@@ -0,0 +1,154 @@
+/*!
+ * @file swarm_coro.cpp
+ *
+ * Drive the C++20 coroutine command API against SWARM_M138_Simulator:
+ *   the typed $DT, $MM, $MT and $TD awaitables, ERR replies, nextEvent, delayAsync,
+ *   several coroutines sharing the modem, and the fixed frame pool
+ *
+ * Built with -std=gnu++20 by "make coro". The exit code is the number of scenarios which did not behave as expected.
+ *
+ * Please see LICENSE.md for the license information
+ *
+ */
+
+#include "SWARM_M138_Simulator.h"
+
+#ifndef SWARM_M138_COROUTINES_AVAILABLE
+#error "swarm_coro needs C++20 coroutines: build it with make coro"
+#endif
+
+SWARM_M138 mySwarm;
+SWARM_M138_Simulator sim;
+
+static int failures = 0;
+
+static void expect(bool ok, const char *scenario)
+{
+  Serial.print(ok ? F("PASS  ") : F("FAIL  "));
+  Serial.println(scenario);
+  if (!ok)
+    failures++;
+}
+
+// Poll until done is true, or ms milliseconds have passed
+static void pollUntil(const bool *done, unsigned long ms)
+{
+  unsigned long start = millis();
+  while ((!*done) && (millis() - start < ms))
+  {
+    mySwarm.poll();
+    delay(1);
+  }
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+// Queue two messages, then count them
+static bool transmitDone = false;
+static Swarm_M138_Error_e textErr, binaryErr, unsentErr;
+static uint64_t textID = 0, binaryID = 0;
+static uint16_t unsentCount = 0xFFFF;
+
+SWARM_M138_Task transmitter()
+{
+  textErr = co_await mySwarm.transmitTextAsync("Hello World!", &textID);
+  const uint8_t payload[] = {0x01, 0x02, 0x03};
+  binaryErr = co_await mySwarm.transmitBinaryAsync(payload, sizeof(payload), &binaryID, 1234);
+  unsentErr = co_await mySwarm.getUnsentMessageCountAsync(&unsentCount);
+  transmitDone = true;
+}
+
+// Wait for a message to arrive, then count the unread messages
+static bool receiveDone = false;
+static Swarm_M138_Error_e unreadErr;
+static uint16_t unreadCount = 0xFFFF;
+
+SWARM_M138_Task receiver()
+{
+  co_await mySwarm.nextEvent(SWARM_M138_EVENT_RECEIVE_MESSAGE);
+  unreadErr = co_await mySwarm.getRxMessageCountAsync(&unreadCount, true);
+  receiveDone = true;
+}
+
+// Read the date and time while the transmitter is using the modem
+static bool dateTimeDone = false;
+static Swarm_M138_Error_e dateTimeErr;
+static Swarm_M138_DateTimeData_t dateTime;
+
+SWARM_M138_Task dateTimeReader()
+{
+  co_await mySwarm.delayAsync(5);
+  dateTimeErr = co_await mySwarm.getDateTimeAsync(&dateTime);
+  dateTimeDone = true;
+}
+
+// An ERR reply
+static bool errDone = false;
+static Swarm_M138_Error_e errErr;
+
+SWARM_M138_Task rejected()
+{
+  uint64_t id = 0;
+  errErr = co_await mySwarm.transmitTextAsync("Queue full", &id);
+  errDone = true;
+}
+
+// Never finishes: holds a frame
+SWARM_M138_Task waiter()
+{
+  co_await mySwarm.nextEvent(SWARM_M138_EVENT_SLEEP_WAKE);
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+int main(int argc, char **argv)
+{
+  sim.setSeed(42);
+  sim.setLatency(2, 20);
+
+  expect(mySwarm.begin(sim.port()), "begin");
+  expect(mySwarm.setMessageNotifications(true) == SWARM_M138_SUCCESS, "$MM N=E");
+  expect(mySwarm.deleteAllRxMessages(false) == SWARM_M138_SUCCESS, "$MM D=*");
+
+#ifdef SWARM_M138_ALLOC_HOOKS
+  Swarm_M138_Alloc_Stats_t before;
+  mySwarm.getAllocStats(&before);
+#endif
+
+  // Three coroutines share the modem. Their commands are sent one at a time
+  expect(transmitter().valid() && receiver().valid() && dateTimeReader().valid(), "three coroutines start");
+  expect(mySwarm.getCoroutineFramesInUse() == 3, "three frames in use");
+  pollUntil(&dateTimeDone, 2000);
+  pollUntil(&transmitDone, 2000);
+  expect((dateTimeErr == SWARM_M138_SUCCESS) && (dateTime.YYYY >= 2022), "getDateTimeAsync");
+  expect((textErr == SWARM_M138_SUCCESS) && (textID != 0), "transmitTextAsync: $TD OK");
+  expect((binaryErr == SWARM_M138_SUCCESS) && (binaryID != 0) && (binaryID != textID), "transmitBinaryAsync: $TD OK");
+  expect((unsentErr == SWARM_M138_SUCCESS) && (unsentCount == 2) && (sim.getTxQueueCount() == 2), "getUnsentMessageCountAsync: $MT C=U");
+
+  const uint8_t payload[] = {0x0A, 0x0B};
+  sim.receiveMessage(77, payload, sizeof(payload));
+  pollUntil(&receiveDone, 2000);
+  expect((unreadErr == SWARM_M138_SUCCESS) && (unreadCount == 1), "getRxMessageCountAsync: $MM C=U after $RD");
+
+  sim.injectError("TD", "DBXTOHIVEFULL");
+  expect(rejected().valid(), "ERR coroutine starts");
+  pollUntil(&errDone, 2000);
+  expect((errErr == SWARM_M138_ERROR_ERR) && (strcmp(mySwarm.commandError, "DBXTOHIVEFULL") == 0), "transmitTextAsync: $TD ERR");
+
+  expect(mySwarm.getCoroutineFramesInUse() == 0, "every frame is returned to the pool");
+
+#ifdef SWARM_M138_ALLOC_HOOKS
+  Swarm_M138_Alloc_Stats_t after;
+  mySwarm.getAllocStats(&after);
+  expect(after.outstanding == before.outstanding, "the $TD commands are freed");
+#endif
+
+  // Fill the pool. The next coroutine does not start
+  bool allStarted = true;
+  for (uint8_t i = 0; i < SWARM_M138_COROUTINE_POOL_SLOTS; i++)
+    allStarted &= waiter().valid();
+  expect(allStarted && !waiter().valid(), "a full pool is reported by valid()");
+
+  printf("\nCommands received by the simulator: %lu\n", (unsigned long)sim.getCommandCount());
+  return (failures);
+}
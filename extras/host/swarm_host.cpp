@@ -0,0 +1,180 @@
+/*!
+ * @file swarm_host.cpp
+ *
+ * Run the SparkFun Swarm Satellite Arduino Library on a Linux host
+ *
+ * Usage:
+ *   swarm_host /dev/ttyUSB0  : talk to a real modem through a USB-serial adapter
+ *   swarm_host --sim         : talk to the simulated modem through its built-in port, on one thread
+ *   swarm_host --loopback    : talk to the simulated modem through the in-memory loopback
+ *   swarm_host --pipe        : talk to the simulated modem through a pair of pipes
+ *   swarm_host --pty         : talk to the simulated modem through a pseudo-terminal
+ *   swarm_host --pty-only    : create a pseudo-terminal and wait for an external simulator to open it
+ *
+ * Add --trace <file> to record a wire trace of the session. swarm_replay plays it back
+ *
+ * Please see LICENSE.md for the license information
+ *
+ */
+
+#include "SWARM_M138_Host_Transport.h"
+#include "SWARM_M138_Simulator.h"
+
+#include <unistd.h>
+
+SWARM_M138 mySwarm;
+SWARM_M138_File_Print traceFile;
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+static int runExample(SWARM_M138_Transport &transport)
+{
+  //mySwarm.enableDebugging(); // Uncomment this line to enable debug messages on Serial
+
+  if (traceFile.isOpen())
+    mySwarm.enableTrace(traceFile); // Record everything, including begin
+
+  if (!mySwarm.begin(transport))
+  {
+    Serial.println(F("Could not communicate with the modem"));
+    return (1);
+  }
+
+  char *settings = new char[SWARM_M138_MEM_ALLOC_CS]; // Create storage for the configuration settings
+  if (mySwarm.getConfigurationSettings(settings) == SWARM_M138_SUCCESS)
+  {
+    Serial.print(F("Configuration settings: "));
+    Serial.println(settings);
+  }
+  delete[] settings;
+
+  Swarm_M138_DateTimeData_t dateTime;
+  Swarm_M138_Error_e err = mySwarm.getDateTime(&dateTime);
+  if (err == SWARM_M138_SUCCESS)
+  {
+    Serial.print(F("Date and time: "));
+    Serial.print(dateTime.YYYY);
+    Serial.print(F("/"));
+    Serial.print(dateTime.MM);
+    Serial.print(F("/"));
+    Serial.print(dateTime.DD);
+    Serial.print(F(" "));
+    Serial.print(dateTime.hh);
+    Serial.print(F(":"));
+    Serial.print(dateTime.mm);
+    Serial.print(F(":"));
+    Serial.print(dateTime.ss);
+    Serial.println(dateTime.valid ? F("  (valid)") : F("  (invalid)"));
+  }
+  else
+  {
+    Serial.print(F("Swarm communication error: "));
+    Serial.println(mySwarm.modemErrorString(err));
+  }
+
+  Swarm_M138_GeospatialData_t info;
+  err = mySwarm.getGeospatialInfo(&info);
+  if (err == SWARM_M138_SUCCESS)
+  {
+    Serial.print(F("Latitude: "));
+    Serial.print(info.lat, 4);
+    Serial.print(F("  Longitude: "));
+    Serial.print(info.lon, 4);
+    Serial.print(F("  Altitude: "));
+    Serial.println(info.alt);
+  }
+  else
+  {
+    Serial.print(F("Swarm communication error: "));
+    Serial.println(mySwarm.modemErrorString(err));
+  }
+
+  Serial.flush();
+  return (err == SWARM_M138_SUCCESS ? 0 : 1);
+}
+
+static int runWithSimulator(SWARM_M138_Transport &library, SWARM_M138_Transport &modem)
+{
+  SWARM_M138_Simulator sim(modem);
+  sim.start(); // Run the simulator on its own thread
+  int result = runExample(library);
+  sim.stop();
+  return (result);
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+int main(int argc, char **argv)
+{
+  const char *mode = (argc > 1) ? argv[1] : "--sim";
+
+  if ((argc > 3) && (strcmp(argv[2], "--trace") == 0))
+  {
+    if (!traceFile.open(argv[3]))
+    {
+      perror(argv[3]);
+      return (1);
+    }
+  }
+
+  if (strcmp(mode, "--sim") == 0)
+  {
+    SWARM_M138_Simulator sim;
+    return (runExample(sim.port()));
+  }
+  else if (strcmp(mode, "--loopback") == 0)
+  {
+    SWARM_M138_Loopback_Transport library, modem;
+    library.connect(modem);
+    return (runWithSimulator(library, modem));
+  }
+  else if (strcmp(mode, "--pipe") == 0)
+  {
+    int toModem[2], fromModem[2];
+    if ((pipe(toModem) != 0) || (pipe(fromModem) != 0))
+    {
+      perror("pipe");
+      return (1);
+    }
+    SWARM_M138_Fd_Transport library(fromModem[0], toModem[1], true);
+    SWARM_M138_Fd_Transport modem(toModem[0], fromModem[1], true);
+    return (runWithSimulator(library, modem));
+  }
+  else if ((strcmp(mode, "--pty") == 0) || (strcmp(mode, "--pty-only") == 0))
+  {
+    SWARM_M138_Serial_Transport library;
+    char name[64];
+    if (!library.openPty(name, sizeof(name)))
+    {
+      perror("openPty");
+      return (1);
+    }
+    Serial.print(F("Pseudo-terminal: "));
+    Serial.println(name);
+    Serial.flush();
+
+    if (strcmp(mode, "--pty-only") == 0)
+    {
+      Serial.println(F("Waiting 10 seconds for the simulator to open it..."));
+      Serial.flush();
+      delay(10000);
+      return (runExample(library));
+    }
+
+    SWARM_M138_Serial_Transport modem;
+    if (!modem.open(name))
+    {
+      perror("open");
+      return (1);
+    }
+    return (runWithSimulator(library, modem));
+  }
+
+  SWARM_M138_Serial_Transport port;
+  if (!port.open(mode))
+  {
+    perror(mode);
+    return (1);
+  }
+  return (runExample(port));
+}
@@ -0,0 +1,279 @@
+/*!
+ * @file swarm_replay.cpp
+ *
+ * Play a wire trace (recorded by enableTrace or dumpTrace) back into the library, to reproduce a parsing or backlog
+ * problem seen in the field
+ *
+ * Usage:
+ *   swarm_replay <trace> [--realtime] [--speed <factor>] [--debug] [--quiet]
+ *
+ *   --realtime : use the real clock. By default the simulated clock is used: the run takes no real time
+ *                and is the same every time
+ *   --speed    : play the trace <factor> times faster than it was recorded. 0 delivers everything at once
+ *   --debug    : enableDebugging
+ *   --quiet    : do not print each message, only the summary
+ *
+ * The library is begun on the trace, then checkUnsolicitedMsg is called until every received byte has been read.
+ * Each unsolicited message is printed as it is delivered. The summary shows the backlog statistics, and where the
+ * commands the library sent first differ from the ones in the trace.
+ *
+ * Please see LICENSE.md for the license information
+ *
+ */
+
+#include "SWARM_M138_Host_Transport.h"
+
+SWARM_M138 mySwarm;
+SWARM_M138_Trace_Transport trace;
+
+static bool quiet = false;
+static uint32_t delivered = 0;
+
+// Print the time in the trace, then the message
+static void stamp(const char *type)
+{
+  delivered++;
+  if (quiet)
+    return;
+  Serial.print(millis());
+  Serial.print(F(" ms  "));
+  Serial.print(type);
+  Serial.print(F("  "));
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+void dateTimeCallback(const Swarm_M138_DateTimeData_t *dateTime)
+{
+  stamp("$DT");
+  if (quiet)
+    return;
+  Serial.print(dateTime->YYYY);
+  Serial.print(F("/"));
+  Serial.print(dateTime->MM);
+  Serial.print(F("/"));
+  Serial.print(dateTime->DD);
+  Serial.print(F(" "));
+  Serial.print(dateTime->hh);
+  Serial.print(F(":"));
+  Serial.print(dateTime->mm);
+  Serial.print(F(":"));
+  Serial.print(dateTime->ss);
+  Serial.println(dateTime->valid ? F("  (valid)") : F("  (invalid)"));
+}
+
+void gpsJammingCallback(const Swarm_M138_GPS_Jamming_Indication_t *jamming)
+{
+  stamp("$GJ");
+  if (quiet)
+    return;
+  Serial.print(jamming->spoof_state);
+  Serial.print(F(","));
+  Serial.println(jamming->jamming_level);
+}
+
+void geospatialCallback(const Swarm_M138_GeospatialData_t *info)
+{
+  stamp("$GN");
+  if (quiet)
+    return;
+  Serial.print(info->lat, 4);
+  Serial.print(F(","));
+  Serial.print(info->lon, 4);
+  Serial.print(F(","));
+  Serial.print(info->alt);
+  Serial.print(F(","));
+  Serial.print(info->course);
+  Serial.print(F(","));
+  Serial.println(info->speed);
+}
+
+void gpsFixQualityCallback(const Swarm_M138_GPS_Fix_Quality_t *fixQuality)
+{
+  stamp("$GS");
+  if (quiet)
+    return;
+  Serial.print(fixQuality->hdop);
+  Serial.print(F(","));
+  Serial.print(fixQuality->vdop);
+  Serial.print(F(","));
+  Serial.print(fixQuality->gnss_sats);
+  Serial.print(F(","));
+  Serial.println(fixQuality->fix_type);
+}
+
+void powerStatusCallback(const Swarm_M138_Power_Status_t *status)
+{
+  stamp("$PW");
+  if (quiet)
+    return;
+  Serial.print(status->cpu_volts, 3);
+  Serial.print(F(" V,"));
+  Serial.print(status->temp, 1);
+  Serial.println(F(" C"));
+}
+
+void receiveMessageCallback(const uint16_t *appID, const int16_t *rssi, const int16_t *snr, const int16_t *fdev, const char *asciiHex)
+{
+  stamp("$RD");
+  if (quiet)
+    return;
+  if (appID != NULL)
+  {
+    Serial.print(F("AI="));
+    Serial.print(*appID);
+    Serial.print(F(","));
+  }
+  Serial.print(*rssi);
+  Serial.print(F(","));
+  Serial.print(*snr);
+  Serial.print(F(","));
+  Serial.print(*fdev);
+  Serial.print(F(","));
+  Serial.println(asciiHex);
+}
+
+void receiveTestCallback(const Swarm_M138_Receive_Test_t *rxTest)
+{
+  stamp("$RT");
+  if (quiet)
+    return;
+  if (rxTest->background)
+  {
+    Serial.print(F("RSSI="));
+    Serial.println(rxTest->rssi_background);
+  }
+  else
+  {
+    Serial.print(F("RSSI="));
+    Serial.print(rxTest->rssi_sat);
+    Serial.print(F(",SNR="));
+    Serial.print(rxTest->snr);
+    Serial.print(F(",FDEV="));
+    Serial.print(rxTest->fdev);
+    Serial.print(F(",SAT="));
+    Serial.println(rxTest->sat_id, HEX);
+  }
+}
+
+void sleepWakeCallback(Swarm_M138_Wake_Cause_e cause)
+{
+  stamp("$SL");
+  if (quiet)
+    return;
+  Serial.println(cause);
+}
+
+void modemStatusCallback(Swarm_M138_Modem_Status_e status, const char *data)
+{
+  stamp("$M138");
+  if (quiet)
+    return;
+  Serial.print(mySwarm.modemStatusString(status));
+  if (data != NULL)
+  {
+    Serial.print(F(" "));
+    Serial.print(data);
+  }
+  Serial.println();
+}
+
+void transmitDataCallback(const int16_t *rssi_sat, const int16_t *snr, const int16_t *fdev, const uint64_t *msg_id)
+{
+  stamp("$TD");
+  if (quiet)
+    return;
+  Serial.print(*rssi_sat);
+  Serial.print(F(","));
+  Serial.print(*snr);
+  Serial.print(F(","));
+  Serial.print(*fdev);
+  Serial.print(F(","));
+  Serial.println((unsigned long)(*msg_id & 0xFFFFFFFF)); // Print does not have uint64_t
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    fprintf(stderr, "Usage: %s <trace> [--realtime] [--speed <factor>] [--debug] [--quiet]\n", argv[0]);
+    return (1);
+  }
+
+  bool realtime = false;
+  for (int i = 2; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--realtime") == 0)
+      realtime = true;
+    else if ((strcmp(argv[i], "--speed") == 0) && (i + 1 < argc))
+      trace.setSpeed(atof(argv[++i]));
+    else if (strcmp(argv[i], "--debug") == 0)
+      mySwarm.enableDebugging();
+    else if (strcmp(argv[i], "--quiet") == 0)
+      quiet = true;
+    else
+    {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return (1);
+    }
+  }
+
+  if (!trace.open(argv[1]))
+  {
+    fprintf(stderr, "%s is not a wire trace\n", argv[1]);
+    return (1);
+  }
+
+  hostUseSimulatedClock(!realtime);
+
+  mySwarm.setDateTimeCallback(&dateTimeCallback);
+  mySwarm.setGpsJammingCallback(&gpsJammingCallback);
+  mySwarm.setGeospatialInfoCallback(&geospatialCallback);
+  mySwarm.setGpsFixQualityCallback(&gpsFixQualityCallback);
+  mySwarm.setPowerStatusCallback(&powerStatusCallback);
+  mySwarm.setReceiveMessageCallback(&receiveMessageCallback);
+  mySwarm.setReceiveTestCallback(&receiveTestCallback);
+  mySwarm.setSleepWakeCallback(&sleepWakeCallback);
+  mySwarm.setModemStatusCallback(&modemStatusCallback);
+  mySwarm.setTransmitDataCallback(&transmitDataCallback);
+
+  // begin sends $CS. If the trace was recorded from the start, its reply is in the trace
+  bool begun = mySwarm.begin(trace);
+
+  while (!trace.done())
+  {
+    mySwarm.checkUnsolicitedMsg();
+    delay(1);
+  }
+  mySwarm.checkUnsolicitedMsg(); // Process anything left in the backlog
+
+  Serial.println();
+  Serial.print(F("Records: "));
+  Serial.print((unsigned long)trace.getRecordCount());
+  Serial.print(F("  received bytes: "));
+  Serial.print((unsigned long)trace.getReceivedBytes());
+  Serial.print(F("  sent bytes: "));
+  Serial.print((unsigned long)trace.getSentBytes());
+  Serial.print(F("  duration: "));
+  Serial.print((unsigned long)(trace.getDuration() / 1000));
+  Serial.println(F(" ms"));
+  Serial.print(F("begin: "));
+  Serial.print(begun ? F("true") : F("false"));
+  Serial.print(F("  messages delivered: "));
+  Serial.print(delivered);
+  Serial.print(F("  backlog high water: "));
+  Serial.print(mySwarm.getBacklogHighWater());
+  Serial.print(F("  backlog overflows: "));
+  Serial.println(mySwarm.getBacklogOverflows());
+  if (trace.getMismatch() == SIZE_MAX)
+    Serial.println(F("The library sent the same commands as the trace"));
+  else
+  {
+    Serial.print(F("The library's commands differ from the trace at byte "));
+    Serial.println((unsigned long)trace.getMismatch());
+  }
+  Serial.flush();
+  return (0);
+}
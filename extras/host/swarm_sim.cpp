@@ -0,0 +1,704 @@
+/*!
+ * @file swarm_sim.cpp
+ *
+ * Drive the library through a series of scripted modem behaviours using SWARM_M138_Simulator:
+ *   $TD OK and $TD SENT, $RD, $M138 BOOT, ERR replies, unsolicited message bursts during a command,
+ *   bad checksums, truncated responses, silence, and a full transmit queue
+ *
+ * Everything runs on one thread through the simulator's built-in port, so the run is repeatable. The exceptions are
+ * the receive hook scenario, where SWARM_M138_RX_Simulator plays the UART interrupt, and threaded mode (build/threads).
+ * The exit code is the number of scenarios which did not behave as expected.
+ *
+ * Please see LICENSE.md for the license information
+ *
+ */
+
+#include "SWARM_M138_Host_Storage.h"
+#include "SWARM_M138_RX_Simulator.h"
+#include "SWARM_M138_Simulator.h"
+
+#include <unistd.h>
+
+SWARM_M138 mySwarm;
+SWARM_M138_Simulator sim;
+
+static int failures = 0;
+
+static void expect(bool ok, const char *scenario)
+{
+  Serial.print(ok ? F("PASS  ") : F("FAIL  "));
+  Serial.println(scenario);
+  if (!ok)
+    failures++;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+static uint64_t lastSentID = 0;
+static int receivedCount = 0;
+static int bootRunningCount = 0;
+static int unknownStatusCount = 0;
+static int dateTimeCount = 0;
+
+void transmitDataCallback(const int16_t *rssi_sat, const int16_t *snr, const int16_t *fdev, const uint64_t *msg_id)
+{
+  lastSentID = *msg_id;
+}
+
+void receiveMessageCallback(const uint16_t *appID, const int16_t *rssi, const int16_t *snr, const int16_t *fdev, const char *asciiHex)
+{
+  receivedCount++;
+}
+
+void modemStatusCallback(Swarm_M138_Modem_Status_e status, const char *data)
+{
+  if (status == SWARM_M138_MODEM_STATUS_BOOT_RUNNING)
+    bootRunningCount++;
+  if (status == SWARM_M138_MODEM_STATUS_UNKNOWN)
+    unknownStatusCount++;
+}
+
+void dateTimeCallback(const Swarm_M138_DateTimeData_t *dateTime)
+{
+  dateTimeCount++;
+}
+
+static int reassembledCount = 0;
+
+void reassembledCallback(const uint8_t *data, size_t len, uint8_t key, uint16_t channel)
+{
+  reassembledCount++;
+}
+
+static int drainCount = 0;
+static int drainDeleteErrors = 0;
+static uint16_t lastDrainAppID = 0;
+
+void drainCallback(const uint8_t *data, size_t len, const uint64_t *msg_id, const uint32_t *epoch, const uint16_t *appID)
+{
+  drainCount++;
+  lastDrainAppID = (appID != NULL) ? *appID : 0;
+}
+
+// Send a command from inside the drain
+void drainAndDelete(const uint8_t *data, size_t len, const uint64_t *msg_id, const uint32_t *epoch, const uint16_t *appID)
+{
+  drainCallback(data, len, msg_id, epoch, appID);
+  if (mySwarm.deleteRxMessage(*msg_id) != SWARM_M138_SUCCESS)
+    drainDeleteErrors++;
+}
+
+static int packedRecords = 0;
+static uint8_t lastRecordType = 0;
+
+void recordCallback(uint8_t type, const uint8_t *data, uint8_t len)
+{
+  packedRecords++;
+  lastRecordType = type;
+}
+
+static int rawBootViews = 0;
+
+// A handler for a message the library does not know. context counts the messages
+bool xyHandler(const Swarm_M138_Line_View_t *line, void *context)
+{
+  if ((line->length > 4) && (strncmp(line->data, "$XY ", 4) == 0))
+    (*(int *)context)++;
+  return (true);
+}
+
+// A handler which counts every message it is given
+bool countingHandler(const Swarm_M138_Line_View_t *line, void *context)
+{
+  (*(int *)context)++;
+  return (true);
+}
+
+void rawLineCallback(const Swarm_M138_Line_View_t *line)
+{
+  const char *boot = "$M138 BOOT,RUNNING*"; // Then the two checksum characters
+  if ((line->length == strlen(boot) + 2) && (strncmp(line->data, boot, strlen(boot)) == 0))
+    rawBootViews++;
+}
+
+#ifdef SWARM_M138_ALLOC_HOOKS
+// An allocator which fails once failAfter allocations have succeeded
+static int failAfter = -1; // -1 : never fail
+
+void *failingAllocate(size_t size, void *context)
+{
+  if (failAfter == 0)
+    return (NULL);
+  if (failAfter > 0)
+    failAfter--;
+  return (malloc(size));
+}
+
+void failingRelease(void *ptr, size_t size, void *context)
+{
+  free(ptr);
+}
+
+// Return the entry for a public function. NULL if it has not allocated anything
+const Swarm_M138_Alloc_Entry_Stats_t *findAllocEntry(const Swarm_M138_Alloc_Entry_Stats_t *entries, uint8_t count, const char *entry)
+{
+  for (uint8_t i = 0; i < count; i++)
+  {
+    if (strcmp(entries[i].entry, entry) == 0)
+      return (&entries[i]);
+  }
+  return (NULL);
+}
+#endif
+
+// Call checkUnsolicitedMsg for ms milliseconds
+static void pump(unsigned long ms)
+{
+  unsigned long start = millis();
+  while (millis() - start < ms)
+  {
+    mySwarm.checkUnsolicitedMsg();
+    delay(1);
+  }
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+
+int main(int argc, char **argv)
+{
+  sim.setSeed(42);
+  sim.setLatency(2, 20); // Realistic, jittery, but repeatable
+
+  //mySwarm.enableDebugging(); // Uncomment this line to enable debug messages on Serial
+
+  expect(mySwarm.begin(sim.port()), "begin");
+
+  mySwarm.setTransmitDataCallback(&transmitDataCallback);
+  mySwarm.setReceiveMessageCallback(&receiveMessageCallback);
+  mySwarm.setModemStatusCallback(&modemStatusCallback);
+  mySwarm.setDateTimeCallback(&dateTimeCallback);
+
+  // $TD OK, then $TD SENT during a simulated satellite pass
+  uint64_t id = 0;
+  expect(mySwarm.transmitText("Hello World!", &id) == SWARM_M138_SUCCESS, "$TD OK");
+  expect(sim.getTxQueueCount() == 1, "the message is in the modem queue");
+  sim.sendQueuedMessages();
+  pump(50);
+  expect(lastSentID == id, "$TD SENT");
+
+  // $RD with notifications enabled
+  expect(mySwarm.setMessageNotifications(true) == SWARM_M138_SUCCESS, "$MM N=E");
+  const uint8_t payload[] = {0x01, 0x02, 0x03};
+  sim.receiveMessage(1234, payload, sizeof(payload));
+  pump(50);
+  expect(receivedCount == 1, "$RD");
+
+  // RX batch: the queued deletes are sent one by one. Stale IDs must not take the unread messages with them
+  expect(mySwarm.deleteAllRxMessages(false) == SWARM_M138_SUCCESS, "$MM D=*");
+  sim.receiveMessage(1, payload, sizeof(payload));
+  sim.receiveMessage(2, payload, sizeof(payload));
+  pump(50);
+  expect(mySwarm.enableRxBatch(16, false), "enableRxBatch");
+  mySwarm.queueDeleteRxMessage(1111);
+  mySwarm.queueDeleteRxMessage(2222);
+  expect((mySwarm.getRxBatchCount() == 2) && (sim.getCommandCount() > 0), "RX batch: queued");
+  expect((mySwarm.flushRxBatch() == SWARM_M138_SUCCESS) && (mySwarm.getRxBatchCount() == 0) && (sim.getRxMessageCount(true) == 2), "RX batch: stale IDs do not delete unread messages");
+  char rxHex[SWARM_M138_MAX_PACKET_LENGTH_HEX + 1];
+  uint64_t rxID = 0;
+  expect(mySwarm.readOldestMessage(rxHex, sizeof(rxHex), &rxID) == SWARM_M138_SUCCESS, "$MM R=O");
+  mySwarm.queueMarkRxMessage(rxID);
+  mySwarm.queueDeleteRxMessage(rxID, true);
+  expect((mySwarm.flushRxBatch() == SWARM_M138_SUCCESS) && (sim.getRxMessageCount() == 1) && (sim.getRxMessageCount(true) == 1), "RX batch: delete");
+  expect(mySwarm.enableRxBatch(16, true), "enableRxBatch: automatic flush");
+  mySwarm.queueDeleteRxMessage(3333);
+  uint32_t commandsBefore = sim.getCommandCount();
+  pump(50);
+  expect((mySwarm.getRxBatchCount() == 1) && (sim.getCommandCount() == commandsBefore), "RX batch: the automatic flush is rate-limited");
+  mySwarm.disableRxBatch();
+
+  // Duplicate filter: a repeated $RD is suppressed. readMessage is not filtered: it always returns the message which was asked for
+  expect(mySwarm.enableRxDedup(8), "enableRxDedup");
+  const uint8_t repeated[] = {0x0D, 0x0E};
+  int receivedBeforeDedup = receivedCount;
+  sim.receiveMessage(4321, repeated, sizeof(repeated));
+  sim.receiveMessage(4321, repeated, sizeof(repeated));
+  pump(50);
+  expect((receivedCount == receivedBeforeDedup + 1) && (mySwarm.getRxDuplicateCount() == 1), "RX dedup: the repeated $RD is suppressed");
+  expect(mySwarm.readNewestMessage(rxHex, sizeof(rxHex), &rxID) == SWARM_M138_SUCCESS, "RX dedup: $MM R=N");
+  expect((mySwarm.readMessage(rxID, rxHex, sizeof(rxHex)) == SWARM_M138_SUCCESS) && (strcasecmp(rxHex, "0D0E") == 0), "RX dedup: readMessage of a seen message");
+  mySwarm.disableRxDedup();
+
+  // drainRxMessages: the next $MM R=O is sent before the callback runs. A callback which sends a command must not lose it
+  expect(mySwarm.deleteAllRxMessages(false) == SWARM_M138_SUCCESS, "$MM D=*");
+  for (uint8_t i = 0; i < 4; i++)
+    sim.receiveMessage(200 + i, payload, sizeof(payload));
+  pump(50);
+  uint16_t drained = 0;
+  drainCount = 0;
+  expect((mySwarm.drainRxMessages(&drainAndDelete, 0xFFFF, &drained) == SWARM_M138_SUCCESS) && (drained == 4) && (drainCount == 4)
+         && (drainDeleteErrors == 0) && (sim.getRxMessageCount() == 0), "drain: the callback deletes each message");
+  for (uint8_t i = 0; i < 3; i++)
+    sim.receiveMessage(210 + i, payload, sizeof(payload));
+  pump(50);
+  drainCount = 0;
+  expect((mySwarm.drainRxMessages(&drainCallback, 2, &drained) == SWARM_M138_SUCCESS) && (drained == 2) && (drainCount == 2)
+         && (lastDrainAppID == 211) && (sim.getRxMessageCount(true) == 1), "drain: maxCount");
+  expect((mySwarm.drainRxMessages(&drainCallback, 0xFFFF, &drained, true) == SWARM_M138_SUCCESS) && (drained == 1) && (lastDrainAppID == 212)
+         && (sim.getRxMessageCount() == 0), "drain: deleteWhenDone");
+
+  // ERR reply
+  sim.injectError("TD", "DBXTOHIVEFULL");
+  Swarm_M138_Error_e err = mySwarm.transmitText("Queue full", &id);
+  expect((err == SWARM_M138_ERROR_ERR) && (strstr(mySwarm.commandError, "DBXTOHIVEFULL") != NULL), "$TD ERR");
+
+  // A full transmit queue
+  sim.setTxQueueLimit(1);
+  expect(mySwarm.transmitText("One", &id) == SWARM_M138_SUCCESS, "queue one message");
+  expect(mySwarm.transmitText("Two", &id) == SWARM_M138_ERROR_ERR, "queue limit");
+  sim.setTxQueueLimit(SWARM_M138_SIM_DEFAULT_TX_QUEUE_LIMIT);
+
+  // Outbox: a steady trickle, with one message always pending. The sent records are trimmed from the front of the log
+  sim.sendQueuedMessages();
+  sim.setLatency(0);
+  pump(20);
+  SWARM_M138_RAM_Storage ramStorage(4000);
+  expect(mySwarm.beginOutbox(&ramStorage, 1), "beginOutbox");
+  uint8_t reading[64];
+  memset(reading, 0xA5, sizeof(reading));
+  bool trickleOk = (mySwarm.outboxBinary(reading, sizeof(reading)) == SWARM_M138_SUCCESS);
+  for (int i = 0; (i < 100) && trickleOk; i++) // 100 messages and their acknowledgements need more than twice the 4000 bytes
+  {
+    reading[0] = i;
+    trickleOk = (mySwarm.outboxBinary(reading, sizeof(reading)) == SWARM_M138_SUCCESS)
+                && (mySwarm.serviceOutbox() == SWARM_M138_SUCCESS) && (mySwarm.getOutboxCount() == 1);
+    sim.sendQueuedMessages();
+  }
+  expect(trickleOk && (ramStorage.size() < 4000), "outbox: a steady trickle does not fill the log");
+  expect(mySwarm.outboxBinary(reading, 65536 + 4) == SWARM_M138_ERROR_ERROR, "outbox: a message longer than 65535 bytes is rejected");
+  mySwarm.endOutbox();
+
+  // Outbox in a file: the pending messages survive a restart, and the sent record is trimmed when the log is reopened
+  char logPath[64];
+  snprintf(logPath, sizeof(logPath), "/tmp/swarm_sim_outbox_%d.log", (int)getpid());
+  {
+    SWARM_M138_File_Storage fileStorage;
+    expect(fileStorage.open(logPath, false) && fileStorage.clear() && mySwarm.beginOutbox(&fileStorage, 1), "outbox: file storage");
+    for (int i = 0; i < 3; i++)
+      mySwarm.outboxBinary(reading, sizeof(reading));
+    mySwarm.serviceOutbox();
+    sim.sendQueuedMessages();
+    mySwarm.endOutbox();
+  }
+  {
+    SWARM_M138_File_Storage fileStorage;
+    bool recovered = fileStorage.open(logPath, false) && mySwarm.beginOutbox(&fileStorage, 1) && (mySwarm.getOutboxCount() == 2);
+    expect(recovered && (fileStorage.size() == (3 * SWARM_M138_OUTBOX_RECORD_OVERHEAD) + (2 * sizeof(reading))), "outbox: file storage recovery");
+    for (int i = 0; (i < 4) && (mySwarm.getOutboxCount() > 0); i++)
+    {
+      mySwarm.serviceOutbox();
+      sim.sendQueuedMessages();
+    }
+    expect((mySwarm.getOutboxCount() == 0) && (fileStorage.size() == 0), "outbox: file storage drained");
+    mySwarm.endOutbox();
+  }
+  unlink(logPath);
+  sim.setLatency(2, 20);
+  pump(20);
+
+  // Reassembly: a repeat of the last complete message is ignored. Once the timeout has passed, the same key and channel
+  // start a new message: e.g. from a sender which has restarted
+  expect(mySwarm.enableReassembly(512, 200), "enableReassembly");
+  mySwarm.setReassembledCallback(&reassembledCallback);
+  const uint8_t fragment[] = {0, 0, 1, 'a', 'b', 'c', 'd'}; // key 0, index 0, count 1
+  mySwarm.feedFragment(SWARM_M138_FRAGMENT_APPID_BASE + 5, fragment, sizeof(fragment));
+  mySwarm.feedFragment(SWARM_M138_FRAGMENT_APPID_BASE + 5, fragment, sizeof(fragment));
+  expect(reassembledCount == 1, "reassembly: a repeated message is ignored");
+  delay(250);
+  mySwarm.feedFragment(SWARM_M138_FRAGMENT_APPID_BASE + 5, fragment, sizeof(fragment));
+  expect(reassembledCount == 2, "reassembly: the same key is accepted after the timeout");
+  mySwarm.disableReassembly();
+
+  // TX queue mirror: the depth follows $TD OK, deleteTxMessage and $TD SENT without asking the modem.
+  // A full mirror still counts the messages. syncTxQueueMirror finds the messages queued while it was disabled
+  expect(mySwarm.deleteAllTxMessages() == SWARM_M138_SUCCESS, "$MT D=U");
+  expect(mySwarm.enableTxQueueMirror(2), "TX mirror: enableTxQueueMirror");
+  uint64_t mirrorIDs[3] = {0, 0, 0};
+  bool mirrorQueued = true;
+  for (int i = 0; i < 3; i++)
+    mirrorQueued &= (mySwarm.transmitText("Mirror", &mirrorIDs[i]) == SWARM_M138_SUCCESS);
+  uint64_t trackedIDs[3] = {0, 0, 0};
+  uint16_t trackedCount = mySwarm.getTxQueueMirrorIDs(trackedIDs, 3);
+  expect(mirrorQueued && (mySwarm.getTxQueueDepth() == 3) && (sim.getTxQueueCount() == 3), "TX mirror: depth after $TD OK (one untracked)");
+  expect((trackedCount == 2) && (trackedIDs[0] == mirrorIDs[0]) && (trackedIDs[1] == mirrorIDs[1]), "TX mirror: the tracked IDs, oldest first");
+  expect((mySwarm.deleteTxMessage(mirrorIDs[0]) == SWARM_M138_SUCCESS) && (mySwarm.getTxQueueDepth() == 2) &&
+         !mySwarm.isTxMessagePending(mirrorIDs[0]) && mySwarm.isTxMessagePending(mirrorIDs[1]), "TX mirror: deleteTxMessage");
+  sim.sendQueuedMessages();
+  pump(50);
+  Swarm_M138_TX_Latency_t latency;
+  mySwarm.getTxQueueLatency(&latency);
+  expect((mySwarm.getTxQueueDepth() == 0) && (sim.getTxQueueCount() == 0) && (latency.sent == 1), "TX mirror: $TD SENT empties the mirror");
+  mySwarm.disableTxQueueMirror();
+  expect(mySwarm.transmitText("Untracked", &id) == SWARM_M138_SUCCESS, "TX mirror: $TD while disabled");
+  expect(mySwarm.enableTxQueueMirror(2) && (mySwarm.getTxQueueDepth() == 0), "TX mirror: re-enabled");
+  expect((mySwarm.syncTxQueueMirror() == SWARM_M138_SUCCESS) && (mySwarm.getTxQueueDepth() == 1), "TX mirror: syncTxQueueMirror");
+  sim.sendQueuedMessages();
+  pump(50);
+  expect(mySwarm.getTxQueueDepth() == 0, "TX mirror: $TD SENT of an untracked message");
+  mySwarm.disableTxQueueMirror();
+
+  // Record packer: a full packet is sent with $TD. If that fails, packRecord still reports the record as packed,
+  // and the packet is sent before the next record. No record is sent twice
+  expect(mySwarm.enableTxQueueMirror(8) && mySwarm.enablePacker(0), "enablePacker");
+  uint8_t record[30];
+  memset(record, 0x5A, sizeof(record));
+  bool allPacked = true;
+  for (uint8_t i = 0; i < 5; i++) // 5 records of 32 bytes
+    allPacked &= (mySwarm.packRecord(i, record, sizeof(record)) == SWARM_M138_SUCCESS);
+  sim.injectError("TD", "DBXTOHIVEFULL");
+  allPacked &= (mySwarm.packRecord(5, record, sizeof(record)) == SWARM_M138_SUCCESS); // The packet is full: 192 bytes
+  expect(allPacked && (mySwarm.getPackerFlushError() == SWARM_M138_ERROR_ERR) && (mySwarm.getPackerLength() == 192) && (sim.getTxQueueCount() == 0),
+         "packer: a failed send keeps the packed record");
+  expect((mySwarm.packRecord(6, record, sizeof(record)) == SWARM_M138_SUCCESS) && (mySwarm.getPackerFlushError() == SWARM_M138_SUCCESS) &&
+         (mySwarm.getPackerLength() == 32) && (sim.getTxQueueCount() == 1), "packer: the full packet is sent before the next record");
+  expect((mySwarm.flushPacker() == SWARM_M138_SUCCESS) && (mySwarm.getPackerLength() == 0) && (sim.getTxQueueCount() == 2), "packer: flushPacker");
+  uint64_t packetIDs[2] = {0, 0};
+  packedRecords = 0;
+  bool packetsListed = (mySwarm.getTxQueueMirrorIDs(packetIDs, 2) == 2);
+  for (int i = 0; packetsListed && (i < 2); i++)
+  {
+    uint8_t packet[SWARM_M138_MAX_PACKET_LENGTH_BYTES];
+    packetsListed = (mySwarm.listTxMessage(packetIDs[i], rxHex, sizeof(rxHex)) == SWARM_M138_SUCCESS);
+    size_t packetLen = 0;
+    for (; packetsListed && (rxHex[packetLen * 2] != 0) && (packetLen < sizeof(packet)); packetLen++)
+      packet[packetLen] = (uint8_t)strtoul(std::string(&rxHex[packetLen * 2], 2).c_str(), NULL, 16);
+    packetsListed &= (mySwarm.unpackRecords(packet, packetLen, &recordCallback) == SWARM_M138_SUCCESS);
+  }
+  expect(packetsListed && (packedRecords == 7) && (lastRecordType == 6), "packer: each record is sent once");
+  mySwarm.disablePacker();
+  expect(mySwarm.deleteAllTxMessages() == SWARM_M138_SUCCESS, "$MT D=U");
+  mySwarm.disableTxQueueMirror();
+
+  // Transmit scheduler with a modem window of two: telemetry evicts bulk, and an alarm goes to the front of the modem's queue
+  expect(mySwarm.enableTxScheduler(8, 2) && mySwarm.setTxPriorityPolicy(SWARM_M138_TX_PRIORITY_TELEMETRY, 3600, 0), "enableTxScheduler");
+  const uint8_t bulk[] = {0xB0}, telemetry[] = {0x70}, alarm[] = {0xA1};
+  char lastCommand[64];
+  bool scheduled = (mySwarm.scheduleBinary(bulk, sizeof(bulk), SWARM_M138_TX_PRIORITY_BULK) == SWARM_M138_SUCCESS);
+  scheduled &= (mySwarm.scheduleBinary(bulk, sizeof(bulk), SWARM_M138_TX_PRIORITY_BULK) == SWARM_M138_SUCCESS);
+  expect(scheduled && (sim.getTxQueueCount() == 2) && (mySwarm.getScheduledCount(SWARM_M138_TX_PRIORITY_BULK) == 2), "scheduler: bulk fills the window");
+  expect((mySwarm.scheduleBinary(telemetry, sizeof(telemetry), SWARM_M138_TX_PRIORITY_TELEMETRY) == SWARM_M138_SUCCESS) && (sim.getTxQueueCount() == 2)
+         && sim.getLastCommand(lastCommand, sizeof(lastCommand)) && (strstr(lastCommand, "TD HD=3600,") == lastCommand), "scheduler: telemetry evicts bulk, with its hold duration");
+  expect((mySwarm.scheduleBinary(alarm, sizeof(alarm), SWARM_M138_TX_PRIORITY_ALARM) == SWARM_M138_SUCCESS) && (sim.getTxQueueCount() == 2)
+         && (mySwarm.getScheduledCount(SWARM_M138_TX_PRIORITY_BULK) == 2), "scheduler: alarm");
+  sim.sendQueuedMessages(1); // The oldest message in the modem's queue
+  pump(50);
+  expect((mySwarm.serviceTxScheduler() == SWARM_M138_SUCCESS) && (mySwarm.getScheduledCount(SWARM_M138_TX_PRIORITY_ALARM) == 0)
+         && (mySwarm.getScheduledCount(SWARM_M138_TX_PRIORITY_TELEMETRY) == 1), "scheduler: the alarm is sent first");
+  for (int pass = 0; (pass < 4) && (mySwarm.getScheduledCount(SWARM_M138_TX_PRIORITY_BULK) > 0); pass++)
+  {
+    sim.sendQueuedMessages();
+    pump(50);
+    mySwarm.serviceTxScheduler();
+  }
+  expect((mySwarm.getScheduledCount(SWARM_M138_TX_PRIORITY_TELEMETRY) == 0) && (mySwarm.getScheduledCount(SWARM_M138_TX_PRIORITY_BULK) == 0)
+         && (sim.getTxQueueCount() == 0), "scheduler: every message is sent");
+  mySwarm.disableTxScheduler();
+  mySwarm.disableTxQueueMirror();
+
+  // An explicit subscription mask without $TD: the TX queue mirror still sees $TD SENT
+  expect(mySwarm.enableTxQueueMirror(), "enableTxQueueMirror");
+  mySwarm.setSubscriptions(SWARM_M138_SUBSCRIBE(SWARM_M138_EVENT_DATE_TIME));
+  expect((mySwarm.getSubscriptions() & SWARM_M138_SUBSCRIBE(SWARM_M138_EVENT_TRANSMIT_DATA)) != 0, "subscriptions: the mirror keeps $TD");
+  expect(mySwarm.transmitText("Mirror", &id) == SWARM_M138_SUCCESS, "subscriptions: $TD");
+  uint16_t depthBefore = mySwarm.getTxQueueDepth();
+  sim.sendQueuedMessages();
+  pump(50);
+  expect((depthBefore > 0) && (mySwarm.getTxQueueDepth() == 0), "subscriptions: $TD SENT reaches the mirror");
+  mySwarm.setSubscriptions(SWARM_M138_SUBSCRIBE_AUTO);
+  mySwarm.disableTxQueueMirror();
+
+  // A burst of unsolicited messages between a command and its response
+  sim.setBurst(5);
+  Swarm_M138_DateTimeData_t dateTime;
+  expect(mySwarm.getDateTime(&dateTime) == SWARM_M138_SUCCESS, "command during a burst");
+  pump(50);
+  expect(dateTimeCount >= 1, "the burst is delivered to the callbacks");
+  sim.setBurst(0);
+
+  // Typed events: each unsolicited message is queued in parsed form, including those which arrive during a command
+  expect(mySwarm.enableTypedEvents(4, SWARM_M138_OVERFLOW_DROP_OLDEST), "enableTypedEvents");
+  sim.receiveMessage(55, payload, sizeof(payload));
+  pump(50);
+  expect(mySwarm.transmitText("Typed", &id) == SWARM_M138_SUCCESS, "typed events: $TD");
+  sim.sendQueuedMessages();
+  sim.sendSentence("M138 DATETIME");
+  pump(50);
+  Swarm_M138_Typed_Event_t typedEvent;
+  expect((mySwarm.getTypedEventCount() == 3) && mySwarm.popTypedEvent(&typedEvent) && (typedEvent.type == SWARM_M138_EVENT_RECEIVE_MESSAGE)
+         && typedEvent.receiveData.appIDValid && (typedEvent.receiveData.appID == 55) && (typedEvent.receiveData.length == sizeof(payload))
+         && (memcmp(typedEvent.receiveData.data, payload, sizeof(payload)) == 0), "typed events: $RD");
+  expect(mySwarm.popTypedEvent(&typedEvent) && (typedEvent.type == SWARM_M138_EVENT_TRANSMIT_DATA) && (typedEvent.transmitData.msg_id == id), "typed events: $TD SENT");
+  expect(mySwarm.popTypedEvent(&typedEvent) && (typedEvent.type == SWARM_M138_EVENT_MODEM_STATUS)
+         && (typedEvent.modemStatus.status == SWARM_M138_MODEM_STATUS_DATETIME) && !mySwarm.popTypedEvent(&typedEvent), "typed events: $M138 DATETIME");
+  sim.setBurst(3); // $DT, $GJ and $GN. The command takes the first $DT, so its own response is queued as an event
+  expect((mySwarm.getDateTime(&dateTime) == SWARM_M138_SUCCESS) && (mySwarm.getTypedEventCount() == 0), "typed events: command during a burst");
+  sim.setBurst(0);
+  pump(50);
+  expect((mySwarm.getTypedEventCount() == 4) && (mySwarm.getTypedEventDrops() == 0), "typed events: the burst is queued");
+  for (int i = 0; i < 2; i++)
+    sim.sendSentence("M138 DATETIME");
+  pump(50);
+  expect((mySwarm.getTypedEventCount() == 4) && (mySwarm.getTypedEventDrops() == 2) && (mySwarm.getTypedEventHighWater() == 4)
+         && mySwarm.popTypedEvent(&typedEvent) && (typedEvent.type == SWARM_M138_EVENT_GEOSPATIAL), "typed events: a full queue drops the oldest");
+  mySwarm.disableTypedEvents();
+
+  // Faults
+  sim.injectFault(SWARM_M138_SIM_FAULT_BAD_CHECKSUM);
+  expect(mySwarm.getDateTime(&dateTime) == SWARM_M138_ERROR_INVALID_CHECKSUM, "bad checksum");
+
+  sim.injectFault(SWARM_M138_SIM_FAULT_SILENCE);
+  expect(mySwarm.getDateTime(&dateTime) == SWARM_M138_ERROR_TIMEOUT, "silence (timeout)");
+
+  sim.injectFault(SWARM_M138_SIM_FAULT_TRUNCATE);
+  err = mySwarm.getDateTime(&dateTime); // The truncated response runs into the next sentence
+  expect(err != SWARM_M138_SUCCESS, "truncated response");
+  expect(mySwarm.getDateTime(&dateTime) == SWARM_M138_SUCCESS, "recovery after the faults");
+
+#ifdef SWARM_M138_STATS
+  // The faults are in the statistics. $DT is stats.commands[1]. The silence and the truncated response both time out
+  Swarm_M138_Stats_t stats;
+  mySwarm.getStats(&stats);
+  expect((strcmp(mySwarm.statsTag(1), "$DT") == 0) && (stats.commands[1].timeouts == 2) && (stats.commands[1].checksumFailures == 1), "statistics: $DT timeouts and checksum failure");
+  expect(stats.commands[14].errors == 3, "statistics: $TD ERR replies");
+  uint32_t responses = 0;
+  for (int bucket = 0; bucket < SWARM_M138_STATS_BUCKETS; bucket++)
+    responses += stats.commands[1].histogram[bucket];
+  expect(responses + stats.commands[1].timeouts == stats.commands[1].count, "statistics: $DT histogram");
+#endif
+
+  // $M138 BOOT after a restart. The raw line callback sees the message before it is parsed
+  mySwarm.setRawLineCallback(&rawLineCallback);
+  expect(mySwarm.restartDevice() == SWARM_M138_SUCCESS, "$RS OK");
+  pump(200);
+  expect(bootRunningCount == 1, "$M138 BOOT,RUNNING");
+  expect(rawBootViews == 1, "raw line view");
+  mySwarm.setRawLineCallback(NULL);
+
+  // Registered URC handlers: a message the library does not know, including one which arrives during a command
+  int xyCount = 0;
+  expect(mySwarm.registerUrcHandler("$XY", &xyHandler, &xyCount), "registerUrcHandler");
+  sim.sendSentence("XY 1,2,3");
+  pump(50);
+  expect(xyCount == 1, "URC handler");
+  sim.setLatency(30);
+  sim.sendSentence("XY 4,5,6", 10);
+  expect(mySwarm.getDateTime(&dateTime) == SWARM_M138_SUCCESS, "URC handler: command");
+  pump(50);
+  expect(xyCount == 2, "URC handler: kept in the backlog");
+  sim.setLatency(2, 20);
+
+  // A prefix starts with a complete tag: "$XY" does not match "$XYZ". Prefixes which cannot be a tag are rejected
+  int xyCalls = 0;
+  expect(mySwarm.registerUrcHandler("$XY", &countingHandler, &xyCalls), "registerUrcHandler: replace");
+  sim.sendSentence("XYZ 1");
+  sim.sendSentence("XY,2");
+  pump(50);
+  expect(xyCalls == 1, "URC handler: whole tag");
+  expect(!mySwarm.registerUrcHandler("$xy", &countingHandler) && !mySwarm.registerUrcHandler("$XY*", &countingHandler), "registerUrcHandler: invalid tag");
+  expect(mySwarm.registerUrcHandler("$XY", &xyHandler, &xyCount), "registerUrcHandler: restore");
+
+  // A handler for a longer prefix replaces the built-in $M138 parser for those messages only
+  expect(mySwarm.registerUrcHandler("$M138 GNSS", &xyHandler, &xyCount), "registerUrcHandler: $M138 GNSS");
+  sim.sendSentence("M138 GNSS,OK");
+  sim.sendSentence("M138 OTHER,1");
+  pump(50);
+  expect((xyCount == 2) && (unknownStatusCount == 1), "URC handler: longest prefix");
+  expect(mySwarm.unregisterUrcHandler("$XY") && !mySwarm.unregisterUrcHandler("$XY"), "unregisterUrcHandler");
+  sim.sendSentence("XY 7,8,9");
+  pump(50);
+  expect(xyCount == 2, "URC handler: unregistered");
+  mySwarm.disableUrcHandlers();
+
+  // Output paced at 9600 baud: the response to $CS takes tens of milliseconds
+  sim.setBaud(9600);
+  sim.setLatency(0);
+  char *settings = new char[SWARM_M138_MEM_ALLOC_CS];
+  unsigned long start = millis();
+  err = mySwarm.getConfigurationSettings(settings);
+  unsigned long elapsed = millis() - start;
+  delete[] settings;
+  expect((err == SWARM_M138_SUCCESS) && (elapsed >= 25), "per-byte pacing");
+  sim.setBaud(0);
+  sim.setLatency(2, 20);
+
+  // Adaptive timeouts: once the response time has been learned, a silent modem is detected in a few hundred milliseconds
+  expect(mySwarm.enableAdaptiveTimeouts(SWARM_M138_ADAPTIVE_TIMEOUT_FLOOR, 1000), "enableAdaptiveTimeouts: ceiling");
+  expect((mySwarm.getAdaptiveTimeout(SWARM_M138_STANDARD_RESPONSE_TIMEOUT) == SWARM_M138_STANDARD_RESPONSE_TIMEOUT)
+         && (mySwarm.getAdaptiveTimeout(SWARM_M138_MESSAGE_DELETE_TIMEOUT) == SWARM_M138_MESSAGE_DELETE_TIMEOUT), "adaptive timeout: the fixed timeouts apply until learned, and a short ceiling does not shorten them");
+  expect(mySwarm.enableAdaptiveTimeouts(), "enableAdaptiveTimeouts");
+  for (int i = 0; i < 8; i++)
+    mySwarm.getDateTime(&dateTime);
+  expect(mySwarm.getAdaptiveTimeout(SWARM_M138_STANDARD_RESPONSE_TIMEOUT) == SWARM_M138_ADAPTIVE_TIMEOUT_FLOOR, "the response time is learned");
+  sim.injectFault(SWARM_M138_SIM_FAULT_SILENCE);
+  start = millis();
+  err = mySwarm.getDateTime(&dateTime);
+  elapsed = millis() - start;
+  expect((err == SWARM_M138_ERROR_TIMEOUT) && (elapsed < 500), "adaptive timeout: silence");
+  expect(mySwarm.getDateTime(&dateTime) == SWARM_M138_SUCCESS, "adaptive timeout: recovery");
+
+  // A slow response while other messages are arriving is not a false timeout
+  sim.setLatency(600);
+  sim.sendSentence("M138 DATETIME", 100);
+  expect(mySwarm.getDateTime(&dateTime) == SWARM_M138_SUCCESS, "adaptive timeout: slow response under load");
+  sim.setLatency(2, 20);
+  pump(50);
+  mySwarm.disableAdaptiveTimeouts();
+
+  // Receive window: in gap mode, a complete message is delivered without waiting out the fixed 12ms window
+  // (which counts millis ticks, so it can close after a little over 11ms)
+  sim.setLatency(0);
+  pump(20);
+  int boots = bootRunningCount;
+  sim.sendSentence("M138 BOOT,RUNNING");
+  start = micros();
+  mySwarm.checkUnsolicitedMsg();
+  unsigned long fixedMicros = micros() - start;
+  mySwarm.setRxWindowMode(SWARM_M138_RX_WINDOW_GAP);
+  sim.sendSentence("M138 BOOT,RUNNING");
+  start = micros();
+  mySwarm.checkUnsolicitedMsg();
+  unsigned long gapMicros = micros() - start;
+  expect((bootRunningCount == boots + 2) && (fixedMicros >= 10000) && (gapMicros < 1000), "gap receive window");
+
+  // A sentence which arrives a byte at a time is not split by the inter-byte gap
+  sim.setBaud(SWARM_M138_SERIAL_BAUD_RATE);
+  sim.sendSentence("M138 BOOT,RUNNING");
+  pump(20);
+  expect(bootRunningCount == boots + 3, "gap receive window: paced sentence");
+  expect(mySwarm.getDateTime(&dateTime) == SWARM_M138_SUCCESS, "gap receive window: command");
+  sim.setBaud(0);
+  sim.setLatency(2, 20);
+  mySwarm.setRxWindowMode(SWARM_M138_RX_WINDOW_FIXED);
+
+  // Receive hook: a second thread plays the UART RX interrupt and feeds the modem's bytes into the ring buffer,
+  // while the main thread is busy. Nothing is lost, and commands read their responses from the ring
+  expect(mySwarm.enableRxHook(1024), "enableRxHook");
+  {
+    SWARM_M138_RX_Simulator rxInterrupt(mySwarm, sim.port());
+    expect(rxInterrupt.start(), "RX hook: the interrupt thread starts");
+    int receivedBeforeHook = receivedCount;
+    for (uint8_t i = 0; i < 4; i++)
+      sim.receiveMessage(100 + i, payload, sizeof(payload));
+    delay(100); // Busy: the bytes wait in the ring buffer
+    expect(mySwarm.getRxHighWater() > 0, "RX hook: the bytes arrive while the main thread is busy");
+    pump(50);
+    expect((receivedCount == receivedBeforeHook + 4) && (mySwarm.getRxDroppedBytes() == 0), "RX hook: $RD");
+    expect(mySwarm.getDateTime(&dateTime) == SWARM_M138_SUCCESS, "RX hook: command");
+    rxInterrupt.stop();
+  }
+  mySwarm.disableRxHook();
+  expect(mySwarm.getDateTime(&dateTime) == SWARM_M138_SUCCESS, "disableRxHook: the port is read directly again");
+
+#ifdef SWARM_M138_ALLOC_HOOKS
+  // Out of memory: every allocation a command makes fails in turn. Nothing may leak
+  Swarm_M138_Alloc_Stats_t before, after;
+  mySwarm.setAllocator(&failingAllocate, &failingRelease);
+  mySwarm.getAllocStats(&before);
+  bool memAllocSeen = false;
+  bool allFailedCleanly = true;
+  for (int n = 0; n < 4; n++)
+  {
+    failAfter = n;
+    err = mySwarm.getDateTime(&dateTime);
+    if (err == SWARM_M138_ERROR_MEM_ALLOC)
+      memAllocSeen = true;
+    else if (err != SWARM_M138_SUCCESS)
+      allFailedCleanly = false;
+  }
+  failAfter = -1;
+  mySwarm.getAllocStats(&after);
+  expect(memAllocSeen && allFailedCleanly && (after.failures > before.failures), "out of memory");
+  expect((after.outstanding == before.outstanding) && (after.currentBytes == before.currentBytes), "no leaks after out of memory");
+  expect(mySwarm.getDateTime(&dateTime) == SWARM_M138_SUCCESS, "recovery after out of memory");
+
+  // Out of memory in checkUnsolicitedMsg: the receive buffer cannot be allocated. Once memory is available again, messages are delivered
+  int receivedBefore = receivedCount;
+  sim.receiveMessage(4321, payload, sizeof(payload));
+  failAfter = 0;
+  bool oomHandled = mySwarm.checkUnsolicitedMsg();
+  failAfter = -1;
+  pump(50);
+  expect((!oomHandled) && (receivedCount == receivedBefore + 1), "checkUnsolicitedMsg: recovery after out of memory");
+
+  // Out of memory while filtering $RD: the payload cannot be decoded for the duplicate filter. The message is dropped, not delivered unfiltered
+  expect(mySwarm.enableRxDedup(8), "enableRxDedup: out of memory");
+  sim.receiveMessage(4321, repeated, sizeof(repeated));
+  pump(50);
+  receivedBefore = receivedCount;
+#ifdef SWARM_M138_STATS
+  mySwarm.getStats(&stats);
+  uint32_t memoryFailuresBefore = stats.eventMemoryFailures;
+#endif
+  sim.receiveMessage(4321, repeated, sizeof(repeated));
+  delay(20);
+  failAfter = 1; // The receive buffer is allocated. The payload is not
+  mySwarm.checkUnsolicitedMsg();
+  failAfter = -1;
+  pump(50);
+  expect((receivedCount == receivedBefore) && (mySwarm.getRxDuplicateCount() == 0), "RX dedup: out of memory drops the $RD");
+#ifdef SWARM_M138_STATS
+  mySwarm.getStats(&stats);
+  expect(stats.eventMemoryFailures == memoryFailuresBefore + 1, "statistics: $RD dropped for lack of memory");
+#endif
+  mySwarm.disableRxDedup();
+  mySwarm.setAllocator(NULL, NULL);
+
+  // Heap use per public function. Each block counts against the function which allocated it, whoever frees it
+  mySwarm.resetAllocStats();
+  expect((mySwarm.getDateTime(&dateTime) == SWARM_M138_SUCCESS) && mySwarm.enableTxQueueMirror(4), "allocation entries: $DT and enableTxQueueMirror");
+  Swarm_M138_Alloc_Entry_Stats_t entries[SWARM_M138_ALLOC_ENTRIES];
+  uint8_t entryCount = mySwarm.getAllocEntryStats(entries, SWARM_M138_ALLOC_ENTRIES);
+  const Swarm_M138_Alloc_Entry_Stats_t *dateTimeEntry = findAllocEntry(entries, entryCount, "getDateTime");
+  const Swarm_M138_Alloc_Entry_Stats_t *mirrorEntry = findAllocEntry(entries, entryCount, "enableTxQueueMirror");
+  expect((dateTimeEntry != NULL) && (dateTimeEntry->allocations > 0) && (dateTimeEntry->outstanding == 0), "allocation entries: getDateTime frees what it allocates");
+  expect((mirrorEntry != NULL) && (mirrorEntry->outstanding == 1) && (mirrorEntry->currentBytes > 0), "allocation entries: enableTxQueueMirror keeps its mirror");
+  mySwarm.disableTxQueueMirror();
+  entryCount = mySwarm.getAllocEntryStats(entries, SWARM_M138_ALLOC_ENTRIES);
+  mirrorEntry = findAllocEntry(entries, entryCount, "enableTxQueueMirror");
+  expect((mirrorEntry != NULL) && (mirrorEntry->outstanding == 0) && (mirrorEntry->currentBytes == 0)
+         && (findAllocEntry(entries, entryCount, "disableTxQueueMirror") == NULL), "allocation entries: the free counts against enableTxQueueMirror");
+#endif
+
+#ifdef SWARM_M138_THREADS_AVAILABLE
+  // Threaded mode: the reader thread owns the port. Commands are posted to it, and $RD and $TD SENT arrive as events
+  expect(mySwarm.beginThreadedMode() && mySwarm.isThreadedMode(), "beginThreadedMode");
+  expect(mySwarm.getDateTime(&dateTime) == SWARM_M138_SUCCESS, "threaded mode: $DT");
+  int receivedBeforeThreads = receivedCount;
+  sim.receiveMessage(5678, payload, sizeof(payload));
+  pump(100);
+  expect(receivedCount == receivedBeforeThreads + 1, "threaded mode: $RD");
+  expect(mySwarm.transmitText("Threaded", &id) == SWARM_M138_SUCCESS, "threaded mode: $TD OK");
+  sim.sendQueuedMessages();
+  pump(100);
+  expect(lastSentID == id, "threaded mode: $TD SENT");
+  // The reader reads the URC handlers and the subscriptions. Changing them pauses it, so the change applies from the next message
+  int xyBeforeThreads = xyCount;
+  expect(mySwarm.registerUrcHandler("$XY", &xyHandler, &xyCount), "threaded mode: registerUrcHandler");
+  sim.sendSentence("XY 7,8,9");
+  pump(100);
+  expect(xyCount == xyBeforeThreads + 1, "threaded mode: URC handler");
+  expect(mySwarm.unregisterUrcHandler("$XY"), "threaded mode: unregisterUrcHandler");
+  mySwarm.setSubscriptions(SWARM_M138_SUBSCRIBE(SWARM_M138_EVENT_DATE_TIME));
+  receivedBeforeThreads = receivedCount;
+  sim.receiveMessage(5678, payload, sizeof(payload));
+  pump(100);
+  mySwarm.setSubscriptions(SWARM_M138_SUBSCRIBE_AUTO);
+  expect((receivedCount == receivedBeforeThreads) && (mySwarm.getDateTime(&dateTime) == SWARM_M138_SUCCESS), "threaded mode: setSubscriptions");
+  mySwarm.endThreadedMode();
+  expect((!mySwarm.isThreadedMode()) && (mySwarm.getDateTime(&dateTime) == SWARM_M138_SUCCESS), "endThreadedMode");
+#endif
+
+  Serial.print(F("Commands received by the simulator: "));
+  Serial.println(sim.getCommandCount());
+  Serial.flush();
+  return (failures);
+}
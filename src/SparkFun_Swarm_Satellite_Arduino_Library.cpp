@@ -25,12 +25,80 @@
 
 #include "SparkFun_Swarm_Satellite_Arduino_Library.h"
 
+#ifdef SWARM_M138_ALLOC_HOOKS
+// Set _allocEntry for the lifetime of a public function, unless an outer public function has already set it
+class SWARM_M138_Alloc_Scope
+{
+public:
+  SWARM_M138_Alloc_Scope(SWARM_M138 *swarm, const char *entry)
+  {
+    _swarm = swarm;
+    _outermost = (swarm->_allocEntry == NULL);
+    if (_outermost)
+      swarm->_allocEntry = entry;
+  }
+  ~SWARM_M138_Alloc_Scope()
+  {
+    if (_outermost)
+      _swarm->_allocEntry = NULL;
+  }
+
+private:
+  SWARM_M138 *_swarm;
+  bool _outermost;
+};
+// Place at the start of each public function which can allocate, so getAllocEntryStats can attribute its allocations
+#define SWARM_M138_ALLOC_ENTRY() SWARM_M138_Alloc_Scope allocScope(this, __func__)
+#else
+#define SWARM_M138_ALLOC_ENTRY()
+#endif
+
+#ifdef SWARM_M138_THREADS_AVAILABLE
+// Pause the reader task for the lifetime of a function which changes what the reader reads
+class SWARM_M138_Reader_Pause
+{
+public:
+  SWARM_M138_Reader_Pause(SWARM_M138 *swarm)
+  {
+    _swarm = swarm;
+    swarm->pauseReader();
+  }
+  ~SWARM_M138_Reader_Pause()
+  {
+    _swarm->resumeReader();
+  }
+
+private:
+  SWARM_M138 *_swarm;
+};
+// Place at the start of each function which changes the callbacks, the typed event queue, the subscriptions or the URC handlers
+#define SWARM_M138_PAUSE_READER() SWARM_M138_Reader_Pause readerPause(this)
+#else
+#define SWARM_M138_PAUSE_READER()
+#endif
+
+// The static dictionary for compressPayload / decompressPayload: common telemetry and JSON tokens
+// The LZSS encoder can match against this as if it preceded the data
+// It is part of the compressed format: changing it will prevent older payloads from being decompressed
+static const char swarm_m138_compressor_dictionary[] PROGMEM =
+  "{\"id\":\"ts\":\"time\":\"date\":\"lat\":\"lon\":\"alt\":\"speed\":\"heading\":\"temp\":\"hum\":"
+  "\"press\":\"bat\":\"volt\":\"rssi\":\"snr\":\"status\":\"ok\",\"error\":\"value\":\"data\":"
+  "true,false,null},{\"0000000.000,0.00,1,2,3,-";
+#define SWARM_M138_COMPRESS_DICTIONARY_LENGTH (sizeof(swarm_m138_compressor_dictionary) - 1) // Ignore the NULL
+
+#ifdef SWARM_M138_COROUTINES_AVAILABLE
+// The coroutine frames. A fixed pool: a long-running device must not fragment its heap
+alignas(16) static uint8_t swarm_m138_coroutine_pool[SWARM_M138_COROUTINE_POOL_SLOTS][SWARM_M138_COROUTINE_FRAME_SIZE];
+static bool swarm_m138_coroutine_used[SWARM_M138_COROUTINE_POOL_SLOTS];
+#endif
+
 SWARM_M138::SWARM_M138(void)
 {
 #ifdef SWARM_M138_SOFTWARE_SERIAL_ENABLED
   _softSerial = NULL;
 #endif
   _hardSerial = NULL;
+  _transport = NULL;
   _baud = SWARM_M138_SERIAL_BAUD_RATE;
   _i2cPort = NULL;
   _address = SFE_QWIIC_SWARM_DEFAULT_I2C_ADDRESS;
@@ -51,22 +119,135 @@ SWARM_M138::SWARM_M138(void)
   _swarmSleepWakeCallback = NULL;
   _swarmModemStatusCallback = NULL;
   _swarmTransmitDataCallback = NULL;
+  _swarmRawLineCallback = NULL;
+
+  _txMirror = NULL;
+  _rxBatch = NULL;
+  _rxDedup = NULL;
+  _outbox = NULL;
+  _packer = NULL;
+
+  _rxDecompress = false;
+  _drainResponse = NULL;
+  _drainResponseReady = false;
+  _drainResponseErr = SWARM_M138_ERROR_SUCCESS;
+  _rxDecompressAppID = 0;
+
+  _fragmentNextKey = 0;
+  _fragmentKeySeeded = false;
+  _reassembly = NULL;
+  _swarmReassembledCallback = NULL;
+  _swarmFragmentTimeoutCallback = NULL;
+
+  _txScheduler = NULL;
+  _typedEvents = NULL;
+
+  _subscriptionMask = SWARM_M138_SUBSCRIBE_AUTO;
+  _subscriptionAsync = 0;
+  _subscriptionSampling = NULL;
+  _subscriptionFiltered = 0;
+
+  _urcTable = NULL;
+
+  _backlogHighWater = 0;
+  _backlogOverflows = 0;
+
+  _rxWindowMode = SWARM_M138_RX_WINDOW_FIXED;
+  _rxFifoThreshold = SWARM_M138_RX_FIFO_THRESHOLD;
+
+  _adaptiveTimeouts = NULL;
+
+#ifdef SWARM_M138_STATS
+  resetStats();
+  _statsTag = SWARM_M138_STATS_TAGS - 1;
+  _statsSentAt = 0;
+#endif
+
+  _traceRing = NULL;
+  _tracePort = NULL;
+  _traceDropped = 0;
+
+#ifdef SWARM_M138_ALLOC_HOOKS
+  _allocate = NULL;
+  _release = NULL;
+  _allocContext = NULL;
+  _allocCount = 0;
+  _freeCount = 0;
+  _allocFailures = 0;
+  _allocBytes = 0;
+  _allocPeak = 0;
+  _allocLargest = 0;
+  _allocEntry = NULL;
+  _allocEntryCount = 0;
+#endif
+
+  _rxRing = NULL;
+
+#ifdef SWARM_M138_COROUTINES_AVAILABLE
+  _asyncPending = NULL;
+  _asyncCommand = NULL;
+#endif
 
+#ifdef SWARM_M138_THREADS_AVAILABLE
+  _eventQueue = NULL;
+  _commandQueue = NULL;
+  _dispatchEvent = NULL;
+  _readerLine = NULL;
+  _readerLineLength = 0;
+  _readerAwaitingResponse = false;
+  _readerSentAt = 0;
+  _readerRun = false;
+  _readerRunning = false;
+  _readerPaused = false;
+  _readerPauseDepth = 0;
+  _eventDrops = 0;
+  _readerLineChecked = false;
+  _readerLineDiscard = false;
+#ifdef SWARM_M138_THREADS_FREERTOS
+  _readerTask = NULL;
+#else
+  _readerThread = NULL;
+#endif
+#endif
 }
 
 SWARM_M138::~SWARM_M138(void)
 {
+#ifdef SWARM_M138_THREADS_AVAILABLE
+  endThreadedMode(); // Stop the reader task before freeing anything it uses
+#endif
+
+  disableRxHook();
+  disableTrace();
+  disableAdaptiveTimeouts();
+  disableUrcHandlers();
+  disableTypedEvents();
+
+  if (_subscriptionSampling != NULL)
+  {
+    swarm_m138_free(_subscriptionSampling);
+    _subscriptionSampling = NULL;
+  }
+
   if (_swarmBacklog != NULL)
   {
-    delete[] _swarmBacklog;
+    swarm_m138_free_char(_swarmBacklog);
     _swarmBacklog = NULL;
   }
 
   if (commandError != NULL)
   {
-    delete[] commandError;
+    swarm_m138_free_char(commandError);
     commandError = NULL;
   }
+
+  disableTxQueueMirror();
+  disableRxBatch();
+  disableRxDedup();
+  endOutbox();
+  disablePacker();
+  disableReassembly();
+  disableTxScheduler();
 }
 
 #ifdef SWARM_M138_SOFTWARE_SERIAL_ENABLED
@@ -80,6 +261,7 @@ SWARM_M138::~SWARM_M138(void)
 /**************************************************************************/
 bool SWARM_M138::begin(SoftwareSerial &softSerial)
 {
+  SWARM_M138_ALLOC_ENTRY();
   if (!initializeBuffers())
     return false;
     
@@ -105,6 +287,7 @@ bool SWARM_M138::begin(SoftwareSerial &softSerial)
 /**************************************************************************/
 bool SWARM_M138::begin(HardwareSerial &hardSerial)
 {
+  SWARM_M138_ALLOC_ENTRY();
   if (!initializeBuffers())
     return false;
     
@@ -119,6 +302,28 @@ bool SWARM_M138::begin(HardwareSerial &hardSerial)
   return (isConnected());
 }
 
+/**************************************************************************/
+/*!
+    @brief  Begin communication with the Swarm M138 modem
+    @param  transport
+            The transport to be used to communicate with the modem,
+            e.g. one of the Linux transports in extras/host
+    @return True if communication with the modem was successful, otherwise false
+*/
+/**************************************************************************/
+bool SWARM_M138::begin(SWARM_M138_Transport &transport)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  if (!initializeBuffers())
+    return false;
+
+  _transport = &transport;
+
+  beginSerial(_baud);
+
+  return (isConnected());
+}
+
 /**************************************************************************/
 /*!
     @brief  Begin communication with the Swarm M138 modem
@@ -133,6 +338,7 @@ bool SWARM_M138::begin(HardwareSerial &hardSerial)
 /**************************************************************************/
 bool SWARM_M138::begin(byte deviceAddress, TwoWire &wirePort)
 {
+  SWARM_M138_ALLOC_ENTRY();
   if (!initializeBuffers())
     return false;
 
@@ -152,6 +358,7 @@ bool SWARM_M138::begin(byte deviceAddress, TwoWire &wirePort)
 /**************************************************************************/
 bool SWARM_M138::isConnected(void)
 {
+  SWARM_M138_ALLOC_ENTRY();
   uint32_t dev_ID = 0;
   return (getDeviceID(&dev_ID) == SWARM_M138_ERROR_SUCCESS);
 }
@@ -160,7 +367,7 @@ bool SWARM_M138::isConnected(void)
 bool SWARM_M138::initializeBuffers()
 {
   if (_swarmBacklog == NULL)
-    _swarmBacklog = new char[_RxBuffSize];
+    _swarmBacklog = swarm_m138_alloc_char(_RxBuffSize);
   if (_swarmBacklog == NULL)
   {
     if (_printDebug == true)
@@ -170,7 +377,7 @@ bool SWARM_M138::initializeBuffers()
   memset(_swarmBacklog, 0, _RxBuffSize);
 
   if (commandError == NULL)
-    commandError = new char[SWARM_M138_MAX_CMD_ERROR_LEN];
+    commandError = swarm_m138_alloc_char(SWARM_M138_MAX_CMD_ERROR_LEN);
   if (commandError == NULL)
   {
     if (_printDebug == true)
@@ -217,126 +424,206 @@ void SWARM_M138::disableDebugging(void)
 /**************************************************************************/
 bool SWARM_M138::checkUnsolicitedMsg(void)
 {
+  SWARM_M138_ALLOC_ENTRY();
   if (_checkUnsolicitedMsgReentrant == true) // Check for reentry (i.e. checkUnsolicitedMsg has been called from inside a callback)
     return false;
 
   _checkUnsolicitedMsgReentrant = true;
 
+  collectDrainResponse(); // Called from a drainRxMessages callback? Don't let the next message be treated as unsolicited
+
   size_t avail = 0; // The number of available serial bytes
   bool handled = false; // Flag if any unsolicited messages were handled
   unsigned long timeIn = millis(); // Record the time so we can timeout
-  char *event; // Each unsolicited messages is an 'event'
+  char *event = NULL; // Each unsolicited messages is an 'event'. It points into _swarmRxBuffer
 
-  char *_swarmRxBuffer = swarm_m138_alloc_char(_RxBuffSize);
-  if (_swarmRxBuffer == NULL)
+#ifdef SWARM_M138_THREADS_AVAILABLE
+  if (_eventQueue != NULL) // Threaded mode: the reader task owns the serial port. Dispatch the events it has queued
   {
-    if (_printDebug == true)
-      _debugPort->println(F("checkUnsolicitedMsg: not enough memory for _swarmRxBuffer!"));
-    return false;
+    while (_eventQueue->pop(*_dispatchEvent))
+    {
+      avail += _dispatchEvent->length;
+      bool latestHandled = processUnsolicitedEvent(_dispatchEvent->sentence, _dispatchEvent->length);
+      if (latestHandled)
+        handled = true; // handled will be true if latestHandled has ever been true
+    }
   }
-  memset(_swarmRxBuffer, 0, _RxBuffSize); // Clear _swarmRxBuffer
-
-  // Does the backlog contain any data? If it does, copy it into _swarmRxBuffer and then clear the backlog
-  // All of the serial data from the modem is 'printable'. It should never contain a \0. So it is OK to use strlen.
-  size_t backlogLength = strlen((const char *)_swarmBacklog);
-  if (backlogLength > 0)
+  else
+#endif
   {
-    //The backlog also logs reads from other tasks like transmitting.
-    if (_printDebug == true)
+    char *_swarmRxBuffer = swarm_m138_alloc_char(_RxBuffSize);
+    if (_swarmRxBuffer == NULL)
     {
-      _debugPort->print(F("checkUnsolicitedMsg: backlog found! backlog length is "));
-      _debugPort->println(backlogLength);
+      if (_printDebug == true)
+        _debugPort->println(F("checkUnsolicitedMsg: not enough memory for _swarmRxBuffer!"));
+      _checkUnsolicitedMsgReentrant = false; // Otherwise every later call would return immediately
+      return false;
     }
-    memcpy(_swarmRxBuffer + avail, _swarmBacklog, backlogLength); // avail is zero
-    avail += backlogLength;
-    memset(_swarmBacklog, 0, _RxBuffSize); // Clear the backlog making sure it is NULL-terminated
-  }
+    memset(_swarmRxBuffer, 0, _RxBuffSize); // Clear _swarmRxBuffer
 
-  int hwAvail = hwAvailable();
-  if ((hwAvail > 0) || (backlogLength > 0)) // If either new data is available, or backlog had data.
-  {
-    // Wait for up to _rxWindowMillis for new serial data to arrive. 
-    while (((millis() - timeIn) < _rxWindowMillis) && ((avail + hwAvail) < _RxBuffSize))
+    // Does the backlog contain any data? If it does, copy it into _swarmRxBuffer and then clear the backlog
+    // All of the serial data from the modem is 'printable'. It should never contain a \0. So it is OK to use strlen.
+    size_t backlogLength = strlen((const char *)_swarmBacklog);
+    if (backlogLength > 0)
     {
-      if (hwAvail > 0) //hwAvailable can return -1 if the serial port is NULL
+      //The backlog also logs reads from other tasks like transmitting.
+      if (_printDebug == true)
       {
-        avail += hwReadChars((char *)&_swarmRxBuffer[avail], hwAvail);
-        timeIn = millis();
+        _debugPort->print(F("checkUnsolicitedMsg: backlog found! backlog length is "));
+        _debugPort->println(backlogLength);
       }
-      else
-        delay(1);
-      hwAvail = hwAvailable();
+      memcpy(_swarmRxBuffer + avail, _swarmBacklog, backlogLength); // avail is zero
+      avail += backlogLength;
+      memset(_swarmBacklog, 0, _RxBuffSize); // Clear the backlog making sure it is NULL-terminated
     }
 
-    // _swarmRxBuffer now contains the backlog (if any) and the new serial data (if any)
-
-    // A health warning about strtok:
-    //
-    // strtok will convert any delimiters it finds ("\n" in our case) into NULL characters.
-    //
-    // Also, be very careful that you do not use strtok within an strtok while loop.
-    // The next call of strtok(NULL, ...) in the outer loop will use the pointer saved from the inner loop!
-    // In our case, strtok is also used in pruneBacklog, which is called by waitForResponse or sendCommandWithResponse,
-    // which is called by the parse functions called by processUnsolicitedEvent...
-    // The solution is to use strtok_r - the reentrant version of strtok
-    //
-    // Also, if the string does not contain any delimiters, strtok will still return a pointer to the start of the string.
-    // The entire string is considered the first token.
-
-    char *preservedEvent;
-    event = strtok_r(_swarmRxBuffer, "\n", &preservedEvent); // Look for an 'event' (_swarmRxBuffer contains something ending in \n)
-
-    if (event != NULL)
-      if (_printDebug == true)
-        _debugPort->println(F("checkUnsolicitedMsg: event(s) found! ===>"));
-
-    while (event != NULL) // Keep going until all events have been processed
+    int hwAvail = hwAvailable();
+    if ((hwAvail > 0) || (backlogLength > 0)) // If either new data is available, or backlog had data.
     {
-      if (_printDebug == true)
+      // Keep reading until the receive window closes (see setRxWindowMode)
+      // Read only what fits: with the interrupt receive path, more than _RxBuffSize bytes can be waiting
+      unsigned long lastRx = (_rxWindowMode == SWARM_M138_RX_WINDOW_GAP) ? micros() : timeIn;
+      while (avail < (_RxBuffSize - 1))
       {
-        _debugPort->print(F("checkUnsolicitedMsg: start of event: "));
-        _debugPort->println(event);
+        if (hwAvail > 0) //hwAvailable can return -1 if the serial port is NULL
+        {
+          if ((avail + hwAvail) > (_RxBuffSize - 1))
+            hwAvail = _RxBuffSize - 1 - avail;
+          avail += hwReadChars((char *)&_swarmRxBuffer[avail], hwAvail);
+          lastRx = rxWindowNow();
+        }
+        else if (rxWindowClosed(_swarmRxBuffer, avail, lastRx))
+          break;
+        else
+          rxWindowWait();
+        hwAvail = hwAvailable();
       }
 
-      if (checkChecksum(event) == SWARM_M138_ERROR_SUCCESS) // Check the checksum
+      // If the buffer is full, the last sentence is probably incomplete. Carry it over to the next call in the backlog
+      char *partial = NULL;
+      if (avail >= (_RxBuffSize - 1))
       {
-        //Process the event
-        bool latestHandled = processUnsolicitedEvent((const char *)event);
-        if (latestHandled)
-          handled = true; // handled will be true if latestHandled has ever been true
+        char *lastLF = strrchr(_swarmRxBuffer, '\n');
+        if ((lastLF != NULL) && (*(lastLF + 1) != 0))
+        {
+          size_t partialLength = strlen(lastLF + 1);
+          partial = swarm_m138_alloc_char(partialLength + 1);
+          if (partial != NULL)
+          {
+            memcpy(partial, lastLF + 1, partialLength + 1);
+            memset(lastLF + 1, 0, partialLength);
+            avail -= partialLength;
+          }
+        }
       }
-      else
-      {
+
+      // _swarmRxBuffer now contains the backlog (if any) and the new serial data (if any)
+
+      // A health warning about strtok:
+      //
+      // strtok will convert any delimiters it finds ("\n" in our case) into NULL characters.
+      //
+      // Also, be very careful that you do not use strtok within an strtok while loop.
+      // The next call of strtok(NULL, ...) in the outer loop will use the pointer saved from the inner loop!
+      // In our case, strtok is also used in pruneBacklog, which is called by waitForResponse or sendCommandWithResponse,
+      // which is called by the parse functions called by processUnsolicitedEvent...
+      // The solution is to use strtok_r - the reentrant version of strtok
+      //
+      // Also, if the string does not contain any delimiters, strtok will still return a pointer to the start of the string.
+      // The entire string is considered the first token.
+
+      char *preservedEvent;
+      event = strtok_r(_swarmRxBuffer, "\n", &preservedEvent); // Look for an 'event' (_swarmRxBuffer contains something ending in \n)
+
+      if (event != NULL)
         if (_printDebug == true)
-          _debugPort->println(F("checkUnsolicitedMsg: event is invalid!"));
-      }
+          _debugPort->println(F("checkUnsolicitedMsg: event(s) found! ===>"));
 
-      backlogLength = strlen((const char *)_swarmBacklog);
-      if ((backlogLength > 0) && ((avail + backlogLength) < _RxBuffSize)) // Has any new data been added to the backlog?
+      while (event != NULL) // Keep going until all events have been processed
       {
         if (_printDebug == true)
         {
-          _debugPort->println(F("checkUnsolicitedMsg: new backlog added!"));
+          _debugPort->print(F("checkUnsolicitedMsg: start of event: "));
+          _debugPort->println(event);
         }
-        memcpy(_swarmRxBuffer + avail, _swarmBacklog, backlogLength);
-        avail += backlogLength;
-        memset(_swarmBacklog, 0, _RxBuffSize); //Clear out the backlog buffer again.
-      }
 
-      //Walk through any remaining events
-      event = strtok_r(NULL, "\n", &preservedEvent);
+        if (!acceptEvent((const char *)event)) // Drop unsubscribed messages before checking the checksum
+        {
+          if (_printDebug == true)
+            _debugPort->println(F("checkUnsolicitedMsg: event is not subscribed"));
+        }
+        else if (checkChecksum(event) == SWARM_M138_ERROR_SUCCESS) // Check the checksum
+        {
+          //Process the event
+          bool latestHandled = processUnsolicitedEvent(event, strlen(event));
+          if (latestHandled)
+            handled = true; // handled will be true if latestHandled has ever been true
+        }
+        else
+        {
+#ifdef SWARM_M138_STATS
+          _statsEventChecksumFailures = _statsEventChecksumFailures + 1;
+#endif
+          if (_printDebug == true)
+            _debugPort->println(F("checkUnsolicitedMsg: event is invalid!"));
+        }
 
-      if (_printDebug == true)
-        _debugPort->println(F("checkUnsolicitedMsg: end of event")); //Just to denote end of processing event.
+        backlogLength = strlen((const char *)_swarmBacklog);
+        if ((backlogLength > 0) && ((avail + backlogLength) < _RxBuffSize)) // Has any new data been added to the backlog?
+        {
+          if (_printDebug == true)
+          {
+            _debugPort->println(F("checkUnsolicitedMsg: new backlog added!"));
+          }
+          memcpy(_swarmRxBuffer + avail, _swarmBacklog, backlogLength);
+          avail += backlogLength;
+          memset(_swarmBacklog, 0, _RxBuffSize); //Clear out the backlog buffer again.
+        }
+
+        //Walk through any remaining events
+        event = strtok_r(NULL, "\n", &preservedEvent);
 
-      if (event == NULL)
         if (_printDebug == true)
-          _debugPort->println(F("checkUnsolicitedMsg: <=== end of event(s)!"));
+          _debugPort->println(F("checkUnsolicitedMsg: end of event")); //Just to denote end of processing event.
+
+        if (event == NULL)
+          if (_printDebug == true)
+            _debugPort->println(F("checkUnsolicitedMsg: <=== end of event(s)!"));
+      }
+
+      if (partial != NULL) // Carry the incomplete sentence over. The rest of it is still waiting to be read
+      {
+        size_t partialLength = strlen(partial);
+        backlogLength = strlen((const char *)_swarmBacklog);
+        if ((backlogLength + partialLength) < _RxBuffSize)
+        {
+          memcpy(&_swarmBacklog[backlogLength], partial, partialLength);
+          noteBacklogLength(backlogLength + partialLength);
+        }
+        else
+          _backlogOverflows = _backlogOverflows + 1;
+        swarm_m138_free_char(partial);
+      }
     }
+
+    swarm_m138_free_char(_swarmRxBuffer);
   }
 
-  swarm_m138_free_char(_swarmRxBuffer);
-  delete event;
+  // If no serial data arrived, the modem is idle. Flush any pending RX batch intents
+  // Rate-limited: each flush is a series of blocking $MM commands
+  if ((avail == 0) && (_rxBatch != NULL) && (_rxBatch->count > 0) && (_rxBatch->autoFlush == true)
+      && ((millis() - _rxBatch->lastFlush) >= SWARM_M138_RX_BATCH_AUTOFLUSH_INTERVAL))
+    flushRxBatch();
+
+  // If the oldest packed record has reached its maximum age, send the packet
+  if ((avail == 0) && (_packer != NULL) && (_packer->length > 0) && (_packer->maxAge > 0) && ((millis() - _packer->firstAt) >= _packer->maxAge))
+    flushPacker();
+
+  checkReassemblyTimeout(); // Discard any partial message which has timed out
+
+#ifdef SWARM_M138_COROUTINES_AVAILABLE
+  asyncService(); // Resume any coroutines whose results have arrived
+#endif
 
   _checkUnsolicitedMsgReentrant = false;
 
@@ -344,459 +631,495 @@ bool SWARM_M138::checkUnsolicitedMsg(void)
 } // /checkUnsolicitedMsg
 
 // Parse incoming unsolicited messages - pass the data to the user via the callbacks (if defined)
-bool SWARM_M138::processUnsolicitedEvent(const char *event)
+// event is a view of length bytes in the receive buffer. The parsers work in place: nothing is copied
+// Each result is parsed into a local struct. The callbacks get a pointer which is only valid during the call
+bool SWARM_M138::processUnsolicitedEvent(char *event, size_t length)
 {
+#ifdef SWARM_M138_COROUTINES_AVAILABLE
+  if (asyncOfferLine(event)) // Is this the response to an async command?
+    return (true);
+  asyncOfferEvent(event); // Complete any nextEvent awaiters. The callbacks are still called
+#endif
+
+  char *dollar = (char *)memchr(event, '$', length); // Skip anything before the $
+  if (dollar == NULL)
+    return (false);
+
+  Swarm_M138_Line_View_t line;
+  line.data = (const char *)dollar;
+  line.length = length - (size_t)(dollar - event);
+
+  if (_swarmRawLineCallback != NULL)
+  {
+    _swarmRawLineCallback((const Swarm_M138_Line_View_t *)&line); // Call the callback
+  }
+
+  // A registered handler sees the message before the built-in parser
+  Swarm_M138_URC_Handler_t *urcHandler = findUrcHandler(line.data, line.length, true);
+  if (urcHandler != NULL)
+  {
+    if (urcHandler->handler((const Swarm_M138_Line_View_t *)&line, urcHandler->context))
+      return (true); // The handler has dealt with it
+  }
+
+  // Only the parser for this tag needs to run
+  Swarm_M138_Event_Type_e type = eventType((const char *)dollar);
+
+  if (type == SWARM_M138_EVENT_DATE_TIME)
   { // $DT - Date/Time
-    Swarm_M138_DateTimeData_t *dateTime = new Swarm_M138_DateTimeData_t;
-    if (dateTime != NULL) // Check memory allocation was successful
-    {
-      char *eventStart;
-      char *eventEnd;
+    Swarm_M138_DateTimeData_t dateTime;
+    char *eventStart;
+    char *eventEnd;
 
-      eventStart = strstr(event, "$DT ");
-      if (eventStart != NULL)
+    eventStart = strstr(event, "$DT ");
+    if (eventStart != NULL)
+    {
+      eventEnd = strchr(eventStart, '*'); // Stop at the asterix
+      if (eventEnd != NULL)
       {
-        eventEnd = strchr(eventStart, '*'); // Stop at the asterix
-        if (eventEnd != NULL)
+        if (eventEnd >= (eventStart + 20)) // Check we have enough data
         {
-          if (eventEnd >= (eventStart + 20)) // Check we have enough data
-          {
-            // Extract the Date, Time and flag
-            int year, month, day, hour, minute, second;
-            char valid;
+          // Extract the Date, Time and flag
+          int year, month, day, hour, minute, second;
+          char valid;
 
-            int ret = sscanf(eventStart, "$DT %4d%2d%2d%2d%2d%2d,%c*", &year, &month, &day, &hour, &minute, &second, &valid);
+          int ret = sscanf(eventStart, "$DT %4d%2d%2d%2d%2d%2d,%c*", &year, &month, &day, &hour, &minute, &second, &valid);
 
-            if (ret == 7)
+          if (ret == 7)
+          {
+            dateTime.YYYY = (uint16_t)year;
+            dateTime.MM = (uint8_t)month;
+            dateTime.DD = (uint8_t)day;
+            dateTime.hh = (uint8_t)hour;
+            dateTime.mm = (uint8_t)minute;
+            dateTime.ss = (uint8_t)second;
+            dateTime.valid = valid == 'V' ? 1 : 0;
+
+            Swarm_M138_Typed_Event_t *typedEvent = typedEventPush(SWARM_M138_EVENT_DATE_TIME);
+            if (typedEvent != NULL)
+              typedEvent->dateTime = dateTime;
+
+            if (_swarmDateTimeCallback != NULL)
             {
-              dateTime->YYYY = (uint16_t)year;
-              dateTime->MM = (uint8_t)month;
-              dateTime->DD = (uint8_t)day;
-              dateTime->hh = (uint8_t)hour;
-              dateTime->mm = (uint8_t)minute;
-              dateTime->ss = (uint8_t)second;
-              dateTime->valid = valid == 'V' ? 1 : 0;
-
-              if (_swarmDateTimeCallback != NULL)
-              {
-                _swarmDateTimeCallback((const Swarm_M138_DateTimeData_t *)dateTime); // Call the callback
-              }
-
-              delete dateTime;
-              return (true);
+              _swarmDateTimeCallback((const Swarm_M138_DateTimeData_t *)&dateTime); // Call the callback
             }
+
+            return (true);
           }
         }
       }
-      delete dateTime;
     }
   }
+  if (type == SWARM_M138_EVENT_GPS_JAMMING)
   { // $GJ - jamming indication
-    Swarm_M138_GPS_Jamming_Indication_t *jamming = new Swarm_M138_GPS_Jamming_Indication_t;
-    if (jamming != NULL) // Check memory allocation was successful
-    {
-      char *eventStart;
-      char *eventEnd;
+    Swarm_M138_GPS_Jamming_Indication_t jamming;
+    char *eventStart;
+    char *eventEnd;
 
-      eventStart = strstr(event, "$GJ ");
-      if (eventStart != NULL)
+    eventStart = strstr(event, "$GJ ");
+    if (eventStart != NULL)
+    {
+      eventEnd = strchr(eventStart, '*'); // Stop at the asterix
+      if (eventEnd != NULL)
       {
-        eventEnd = strchr(eventStart, '*'); // Stop at the asterix
-        if (eventEnd != NULL)
+        if (eventEnd >= (eventStart + 3)) // Check we have enough data
         {
-          if (eventEnd >= (eventStart + 3)) // Check we have enough data
-          {
-            // Extract the spoof_state and jamming_level
-            int spoof_state, jamming_level;
+          // Extract the spoof_state and jamming_level
+          int spoof_state, jamming_level;
 
-            int ret = sscanf(eventStart, "$GJ %d,%d*", &spoof_state, &jamming_level);
+          int ret = sscanf(eventStart, "$GJ %d,%d*", &spoof_state, &jamming_level);
 
-            if (ret == 2)
-            {
-              jamming->spoof_state = (uint8_t)spoof_state;
-              jamming->jamming_level = (uint8_t)jamming_level;
+          if (ret == 2)
+          {
+            jamming.spoof_state = (uint8_t)spoof_state;
+            jamming.jamming_level = (uint8_t)jamming_level;
 
-              if (_swarmGpsJammingCallback != NULL)
-              {
-                _swarmGpsJammingCallback((const Swarm_M138_GPS_Jamming_Indication_t *)jamming); // Call the callback
-              }
+            Swarm_M138_Typed_Event_t *typedEvent = typedEventPush(SWARM_M138_EVENT_GPS_JAMMING);
+            if (typedEvent != NULL)
+              typedEvent->jamming = jamming;
 
-              delete jamming;
-              return (true);
+            if (_swarmGpsJammingCallback != NULL)
+            {
+              _swarmGpsJammingCallback((const Swarm_M138_GPS_Jamming_Indication_t *)&jamming); // Call the callback
             }
+
+            return (true);
           }
         }
       }
-      delete jamming;
     }
   }
+  if (type == SWARM_M138_EVENT_GEOSPATIAL)
   { // $GN - geospatial information
-    Swarm_M138_GeospatialData_t *info = new Swarm_M138_GeospatialData_t;
-    if (info != NULL) // Check memory allocation was successful
-    {
-      char *eventStart;
-      char *eventEnd;
+    Swarm_M138_GeospatialData_t info;
+    char *eventStart;
+    char *eventEnd;
 
-      eventStart = strstr(event, "$GN ");
-      if (eventStart != NULL)
+    eventStart = strstr(event, "$GN ");
+    if (eventStart != NULL)
+    {
+      eventEnd = strchr(eventStart, '*'); // Stop at the asterix
+      if (eventEnd != NULL)
       {
-        eventEnd = strchr(eventStart, '*'); // Stop at the asterix
-        if (eventEnd != NULL)
+        if (eventEnd >= (eventStart + 10)) // Check we have enough data
         {
-          if (eventEnd >= (eventStart + 10)) // Check we have enough data
+          // Extract the geospatial info
+          int latH, lonH, alt, course, speed;
+          char latL[8], lonL[8];
+
+          int ret = sscanf(eventStart, "$GN %d.%7[0-9],%d.%7[0-9],%d,%d,%d*",
+                           &latH, latL, &lonH, lonL, &alt, &course, &speed);
+
+          if (ret == 7)
           {
-            // Extract the geospatial info
-            int latH, lonH, alt, course, speed;
-            char latL[8], lonL[8];
+            if (!fieldIsNegative(eventStart, 0))
+              info.lat = (float)latH + ((float)atol(latL) / pow(10, strlen(latL)));
+            else
+              info.lat = (float)latH - ((float)atol(latL) / pow(10, strlen(latL)));
+            if (!fieldIsNegative(eventStart, 1))
+              info.lon = (float)lonH + ((float)atol(lonL) / pow(10, strlen(lonL)));
+            else
+              info.lon = (float)lonH - ((float)atol(lonL) / pow(10, strlen(lonL)));
+            info.alt = (float)alt;
+            info.course = (float)course;
+            info.speed = (float)speed;
 
-            int ret = sscanf(eventStart, "$GN %d.%[^,],%d.%[^,],%d,%d,%d*",
-                             &latH, latL, &lonH, lonL, &alt, &course, &speed);
+            Swarm_M138_Typed_Event_t *typedEvent = typedEventPush(SWARM_M138_EVENT_GEOSPATIAL);
+            if (typedEvent != NULL)
+              typedEvent->geospatial = info;
 
-            if (ret == 7)
+            if (_swarmGeospatialCallback != NULL)
             {
-              if (latH >= 0)
-                info->lat = (float)latH + ((float)atol(latL) / pow(10, strlen(latL)));
-              else
-                info->lat = (float)latH - ((float)atol(latL) / pow(10, strlen(latL)));
-              if (lonH >= 0)
-                info->lon = (float)lonH + ((float)atol(lonL) / pow(10, strlen(lonL)));
-              else
-                info->lon = (float)lonH - ((float)atol(lonL) / pow(10, strlen(lonL)));
-              info->alt = (float)alt;
-              info->course = (float)course;
-              info->speed = (float)speed;
-
-              if (_swarmGeospatialCallback != NULL)
-              {
-                _swarmGeospatialCallback((const Swarm_M138_GeospatialData_t *)info); // Call the callback
-              }
-
-              delete info;
-              return (true);
+              _swarmGeospatialCallback((const Swarm_M138_GeospatialData_t *)&info); // Call the callback
             }
+
+            return (true);
           }
         }
       }
-      delete info;
     }
   }
+  if (type == SWARM_M138_EVENT_GPS_FIX_QUALITY)
   { // $GS - GPS fix quality
-    Swarm_M138_GPS_Fix_Quality_t *fixQuality = new Swarm_M138_GPS_Fix_Quality_t;
-    if (fixQuality != NULL) // Check memory allocation was successful
-    {
-      char *eventStart;
-      char *eventEnd;
+    Swarm_M138_GPS_Fix_Quality_t fixQuality;
+    char *eventStart;
+    char *eventEnd;
 
-      eventStart = strstr(event, "$GS ");
-      if (eventStart != NULL)
+    eventStart = strstr(event, "$GS ");
+    if (eventStart != NULL)
+    {
+      eventEnd = strchr(eventStart, '*'); // Stop at the asterix
+      if (eventEnd != NULL)
       {
-        eventEnd = strchr(eventStart, '*'); // Stop at the asterix
-        if (eventEnd != NULL)
+        if (eventEnd >= (eventStart + 11)) // Check we have enough data
         {
-          if (eventEnd >= (eventStart + 11)) // Check we have enough data
+          // Extract the GPS fix quality
+          int hdop, vdop, gnss_sats, unused;
+          char fix_type[3];
+
+          int ret = sscanf(eventStart, "$GS %d,%d,%d,%d,%c%c*", &hdop, &vdop, &gnss_sats, &unused, &fix_type[0], &fix_type[1]);
+
+          if (ret == 6)
           {
-            // Extract the GPS fix quality
-            int hdop, vdop, gnss_sats, unused;
-            char fix_type[3];
+            fixQuality.hdop = (uint16_t)hdop;
+            fixQuality.vdop = (uint16_t)vdop;
+            fixQuality.gnss_sats = (uint8_t)gnss_sats;
+            fixQuality.unused = (uint8_t)unused;
+
+            fix_type[2] = 0; // Null-terminate the fix type
+            if (strstr(fix_type, "NF") != NULL)
+              fixQuality.fix_type = SWARM_M138_GPS_FIX_TYPE_NF;
+            else if (strstr(fix_type, "DR") != NULL)
+              fixQuality.fix_type = SWARM_M138_GPS_FIX_TYPE_DR;
+            else if (strstr(fix_type, "G2") != NULL)
+              fixQuality.fix_type = SWARM_M138_GPS_FIX_TYPE_G2;
+            else if (strstr(fix_type, "G3") != NULL)
+              fixQuality.fix_type = SWARM_M138_GPS_FIX_TYPE_G3;
+            else if (strstr(fix_type, "D2") != NULL)
+              fixQuality.fix_type = SWARM_M138_GPS_FIX_TYPE_D2;
+            else if (strstr(fix_type, "D3") != NULL)
+              fixQuality.fix_type = SWARM_M138_GPS_FIX_TYPE_D3;
+            else if (strstr(fix_type, "RK") != NULL)
+              fixQuality.fix_type = SWARM_M138_GPS_FIX_TYPE_RK;
+            else if (strstr(fix_type, "TT") != NULL)
+              fixQuality.fix_type = SWARM_M138_GPS_FIX_TYPE_TT;
+            else
+              fixQuality.fix_type = SWARM_M138_GPS_FIX_TYPE_INVALID;
 
-            int ret = sscanf(eventStart, "$GS %d,%d,%d,%d,%c%c*", &hdop, &vdop, &gnss_sats, &unused, &fix_type[0], &fix_type[1]);
+            Swarm_M138_Typed_Event_t *typedEvent = typedEventPush(SWARM_M138_EVENT_GPS_FIX_QUALITY);
+            if (typedEvent != NULL)
+              typedEvent->fixQuality = fixQuality;
 
-            if (ret == 6)
+            if (_swarmGpsFixQualityCallback != NULL)
             {
-              fixQuality->hdop = (uint16_t)hdop;
-              fixQuality->vdop = (uint16_t)vdop;
-              fixQuality->gnss_sats = (uint8_t)gnss_sats;
-              fixQuality->unused = (uint8_t)unused;
-
-              fix_type[2] = 0; // Null-terminate the fix type
-              if (strstr(fix_type, "NF") != NULL)
-                fixQuality->fix_type = SWARM_M138_GPS_FIX_TYPE_NF;
-              else if (strstr(fix_type, "DR") != NULL)
-                fixQuality->fix_type = SWARM_M138_GPS_FIX_TYPE_DR;
-              else if (strstr(fix_type, "G2") != NULL)
-                fixQuality->fix_type = SWARM_M138_GPS_FIX_TYPE_G2;
-              else if (strstr(fix_type, "G3") != NULL)
-                fixQuality->fix_type = SWARM_M138_GPS_FIX_TYPE_G3;
-              else if (strstr(fix_type, "D2") != NULL)
-                fixQuality->fix_type = SWARM_M138_GPS_FIX_TYPE_D2;
-              else if (strstr(fix_type, "D3") != NULL)
-                fixQuality->fix_type = SWARM_M138_GPS_FIX_TYPE_D3;
-              else if (strstr(fix_type, "RK") != NULL)
-                fixQuality->fix_type = SWARM_M138_GPS_FIX_TYPE_RK;
-              else if (strstr(fix_type, "TT") != NULL)
-                fixQuality->fix_type = SWARM_M138_GPS_FIX_TYPE_TT;
-              else
-                fixQuality->fix_type = SWARM_M138_GPS_FIX_TYPE_INVALID;
-
-              if (_swarmGpsFixQualityCallback != NULL)
-              {
-                _swarmGpsFixQualityCallback((const Swarm_M138_GPS_Fix_Quality_t *)fixQuality); // Call the callback
-              }
-
-              delete fixQuality;
-              return (true);
+              _swarmGpsFixQualityCallback((const Swarm_M138_GPS_Fix_Quality_t *)&fixQuality); // Call the callback
             }
+
+            return (true);
           }
         }
       }
-      delete fixQuality;
     }
   }
+  if (type == SWARM_M138_EVENT_POWER_STATUS)
   { // $PW - Power Status
-    Swarm_M138_Power_Status_t *powerStatus = new Swarm_M138_Power_Status_t;
-    if (powerStatus != NULL) // Check memory allocation was successful
-    {
-      char *eventStart;
-      char *eventEnd;
+    Swarm_M138_Power_Status_t powerStatus;
+    char *eventStart;
+    char *eventEnd;
 
-      eventStart = strstr(event, "$PW ");
-      if (eventStart != NULL)
+    eventStart = strstr(event, "$PW ");
+    if (eventStart != NULL)
+    {
+      eventEnd = strchr(eventStart, '*'); // Stop at the asterix
+      if (eventEnd != NULL)
       {
-        eventEnd = strchr(eventStart, '*'); // Stop at the asterix
-        if (eventEnd != NULL)
+        if (eventEnd >= (eventStart + 10)) // Check we have enough data
         {
-          if (eventEnd >= (eventStart + 10)) // Check we have enough data
+          // Extract the power status
+          int unused1H, unused2H, unused3H, cpu_voltsH, tempH;
+          char unused1L[8], unused2L[8], unused3L[8], cpu_voltsL[8], tempL[8];
+
+          int ret = sscanf(eventStart, "$PW %d.%7[0-9],%d.%7[0-9],%d.%7[0-9],%d.%7[0-9],%d.%7[0-9]*",
+                          &cpu_voltsH, cpu_voltsL, &unused1H, unused1L,
+                          &unused2H, unused2L, &unused3H, unused3L,
+                          &tempH, tempL);
+
+          if (ret == 10)
           {
-            // Extract the power status
-            int unused1H, unused2H, unused3H, cpu_voltsH, tempH;
-            char unused1L[8], unused2L[8], unused3L[8], cpu_voltsL[8], tempL[8];
+            if (!fieldIsNegative(eventStart, 0))
+              powerStatus.cpu_volts = (float)cpu_voltsH + ((float)atol(cpu_voltsL) / pow(10, strlen(cpu_voltsL)));
+            else
+              powerStatus.cpu_volts = (float)cpu_voltsH - ((float)atol(cpu_voltsL) / pow(10, strlen(cpu_voltsL)));
+            if (!fieldIsNegative(eventStart, 1))
+              powerStatus.unused1 = (float)unused1H + ((float)atol(unused1L) / pow(10, strlen(unused1L)));
+            else
+              powerStatus.unused1 = (float)unused1H - ((float)atol(unused1L) / pow(10, strlen(unused1L)));
+            if (!fieldIsNegative(eventStart, 2))
+              powerStatus.unused2 = (float)unused2H + ((float)atol(unused2L) / pow(10, strlen(unused2L)));
+            else
+              powerStatus.unused2 = (float)unused2H - ((float)atol(unused2L) / pow(10, strlen(unused2L)));
+            if (!fieldIsNegative(eventStart, 3))
+              powerStatus.unused3 = (float)unused3H + ((float)atol(unused3L) / pow(10, strlen(unused3L)));
+            else
+              powerStatus.unused3 = (float)unused3H - ((float)atol(unused3L) / pow(10, strlen(unused3L)));
+            if (!fieldIsNegative(eventStart, 4))
+              powerStatus.temp = (float)tempH + ((float)atol(tempL) / pow(10, strlen(tempL)));
+            else
+              powerStatus.temp = (float)tempH - ((float)atol(tempL) / pow(10, strlen(tempL)));
 
-            int ret = sscanf(eventStart, "$PW %d.%[^,],%d.%[^,],%d.%[^,],%d.%[^,],%d.%[^,]*",
-                            &cpu_voltsH, cpu_voltsL, &unused1H, unused1L,
-                            &unused2H, unused2L, &unused3H, unused3L,
-                            &tempH, tempL);
+            Swarm_M138_Typed_Event_t *typedEvent = typedEventPush(SWARM_M138_EVENT_POWER_STATUS);
+            if (typedEvent != NULL)
+              typedEvent->powerStatus = powerStatus;
 
-            if (ret == 10)
+            if (_swarmPowerStatusCallback != NULL)
             {
-              if (cpu_voltsH >= 0)
-                powerStatus->cpu_volts = (float)cpu_voltsH + ((float)atol(cpu_voltsL) / pow(10, strlen(cpu_voltsL)));
-              else
-                powerStatus->cpu_volts = (float)cpu_voltsH - ((float)atol(cpu_voltsL) / pow(10, strlen(cpu_voltsL)));
-              if (unused1H >= 0)
-                powerStatus->unused1 = (float)unused1H + ((float)atol(unused1L) / pow(10, strlen(unused1L)));
-              else
-                powerStatus->unused1 = (float)unused1H - ((float)atol(unused1L) / pow(10, strlen(unused1L)));
-              if (unused2H >= 0)
-                powerStatus->unused2 = (float)unused2H + ((float)atol(unused2L) / pow(10, strlen(unused2L)));
-              else
-                powerStatus->unused2 = (float)unused2H - ((float)atol(unused2L) / pow(10, strlen(unused2L)));
-              if (unused3H >= 0)
-                powerStatus->unused3 = (float)unused3H + ((float)atol(unused3L) / pow(10, strlen(unused3L)));
-              else
-                powerStatus->unused3 = (float)unused3H - ((float)atol(unused3L) / pow(10, strlen(unused3L)));
-              if (tempH >= 0)
-                powerStatus->temp = (float)tempH + ((float)atol(tempL) / pow(10, strlen(tempL)));
-              else
-                powerStatus->temp = (float)tempH - ((float)atol(tempL) / pow(10, strlen(tempL)));
-
-              if (_swarmPowerStatusCallback != NULL)
-              {
-                _swarmPowerStatusCallback((const Swarm_M138_Power_Status_t *)powerStatus); // Call the callback
-              }
-
-              delete powerStatus;
-              return (true);
+              _swarmPowerStatusCallback((const Swarm_M138_Power_Status_t *)&powerStatus); // Call the callback
             }
+
+            return (true);
           }
         }
       }
-      delete powerStatus;
     }
   }
+  if (type == SWARM_M138_EVENT_RECEIVE_TEST)
   { // $RT - Receive Test
-    Swarm_M138_Receive_Test_t *rxTest = new Swarm_M138_Receive_Test_t;
-    if (rxTest != NULL) // Check memory allocation was successful
-    {
-      char *eventStart;
-      char *eventEnd;
+    Swarm_M138_Receive_Test_t rxTest;
+    char *eventStart;
+    char *eventEnd;
 
-      eventStart = strstr(event, "$RT ");
-      if (eventStart != NULL)
+    eventStart = strstr(event, "$RT ");
+    if (eventStart != NULL)
+    {
+      eventEnd = strchr(eventStart, '*'); // Stop at the asterix
+      if (eventEnd != NULL)
       {
-        eventEnd = strchr(eventStart, '*'); // Stop at the asterix
-        if (eventEnd != NULL)
+        if (eventEnd >= (eventStart + 9)) // Check we have enough data
         {
-          if (eventEnd >= (eventStart + 9)) // Check we have enough data
-          {
-            // Extract the receive test info
-            int rssi_bg = 0, rssi_sat = 0, snr = 0, fdev = 0;
-            int YYYY = 0, MM = 0, DD = 0, hh = 0, mm = 0, ss = 0;
-            uint32_t sat_ID = 0;
+          // Extract the receive test info
+          int rssi_bg = 0, rssi_sat = 0, snr = 0, fdev = 0;
+          int YYYY = 0, MM = 0, DD = 0, hh = 0, mm = 0, ss = 0;
+          uint32_t sat_ID = 0;
 
-            int ret = sscanf(eventStart, "$RT RSSI=%d,SNR=%d,FDEV=%d,TS=%d-%d-%dT%d:%d:%d,DI=0x",
-                            &rssi_sat, &snr, &fdev, &YYYY, &MM, &DD, &hh, &mm, &ss);
+          int ret = sscanf(eventStart, "$RT RSSI=%d,SNR=%d,FDEV=%d,TS=%d-%d-%dT%d:%d:%d,DI=0x",
+                          &rssi_sat, &snr, &fdev, &YYYY, &MM, &DD, &hh, &mm, &ss);
 
-            if (ret == 9)
-            {
-              eventStart = strstr(eventStart, "DI=0x"); // Find the start of the satellite ID
+          char *satIDStart = NULL;
+          if (ret == 9)
+            satIDStart = strstr(eventStart, "DI=0x"); // Find the start of the satellite ID. sscanf does not check the final literal
 
-              // Extract the ID
-              eventStart += 5; // Point at the first digit
-              while (eventStart < eventEnd)
-              {
-                sat_ID <<= 4; // Shuffle the existing value along by 4 bits
-                char c = *eventStart; // Get the digit
-                if ((c >= '0') && (c <= '9'))
-                  sat_ID |= c - '0';
-                else if ((c >= 'a') && (c <= 'f'))
-                  sat_ID |= c + 10 - 'a';
-                else if ((c >= 'A') && (c <= 'F'))
-                  sat_ID |= c + 10 - 'A';
-                eventStart++;
-              }
-            }
-            else // Try to extract just rssi_background
+          if (satIDStart != NULL)
+          {
+            // Extract the ID
+            satIDStart += 5; // Point at the first digit
+            while (satIDStart < eventEnd)
             {
-              ret = sscanf(eventStart, "$RT RSSI=%d*", &rssi_bg);
+              sat_ID <<= 4; // Shuffle the existing value along by 4 bits
+              char c = *satIDStart; // Get the digit
+              if ((c >= '0') && (c <= '9'))
+                sat_ID |= c - '0';
+              else if ((c >= 'a') && (c <= 'f'))
+                sat_ID |= c + 10 - 'a';
+              else if ((c >= 'A') && (c <= 'F'))
+                sat_ID |= c + 10 - 'A';
+              satIDStart++;
             }
+          }
+          else if (ret == 9) // The satellite ID is missing
+            ret = 0;
+          else // Try to extract just rssi_background
+          {
+            ret = sscanf(eventStart, "$RT RSSI=%d*", &rssi_bg);
+          }
 
-            if ((ret == 9) || (ret == 1)) // Check if we got valid data
+          if ((ret == 9) || (ret == 1)) // Check if we got valid data
+          {
+            rxTest.background = ret == 1;
+            rxTest.rssi_background = (int16_t)rssi_bg;
+            rxTest.rssi_sat = (int16_t)rssi_sat;
+            rxTest.snr = (int16_t)snr;
+            rxTest.fdev = (int16_t)fdev;
+            rxTest.time.YYYY = YYYY;
+            rxTest.time.MM = MM;
+            rxTest.time.DD = DD;
+            rxTest.time.hh = hh;
+            rxTest.time.mm = mm;
+            rxTest.time.ss = ss;
+            rxTest.sat_id = sat_ID;
+
+            Swarm_M138_Typed_Event_t *typedEvent = typedEventPush(SWARM_M138_EVENT_RECEIVE_TEST);
+            if (typedEvent != NULL)
+              typedEvent->receiveTest = rxTest;
+
+            if (_swarmReceiveTestCallback != NULL)
             {
-              rxTest->background = ret == 1;
-              rxTest->rssi_background = (int16_t)rssi_bg;
-              rxTest->rssi_sat = (int16_t)rssi_sat;
-              rxTest->snr = (int16_t)snr;
-              rxTest->fdev = (int16_t)fdev;
-              rxTest->time.YYYY = YYYY;
-              rxTest->time.MM = MM;
-              rxTest->time.DD = DD;
-              rxTest->time.hh = hh;
-              rxTest->time.mm = mm;
-              rxTest->time.ss = ss;
-              rxTest->sat_id = sat_ID;
-
-              if (_swarmReceiveTestCallback != NULL)
-              {
-                _swarmReceiveTestCallback((const Swarm_M138_Receive_Test_t *)rxTest); // Call the callback
-              }
-
-              delete rxTest;
-              return (true);
+              _swarmReceiveTestCallback((const Swarm_M138_Receive_Test_t *)&rxTest); // Call the callback
             }
+
+            return (true);
           }
         }
       }
-      delete rxTest;
     }
   }
+  if (type == SWARM_M138_EVENT_MODEM_STATUS)
   { // $M138 - Modem Status
-    char *data = swarm_m138_alloc_char(SWARM_M138_MEM_ALLOC_MS);
-    if (data != NULL) // Check memory allocation was successful
-    {
-      Swarm_M138_Modem_Status_e status = SWARM_M138_MODEM_STATUS_INVALID;
-      char *eventStart;
-      char *eventEnd;
-
-      memset(data, 0, SWARM_M138_MEM_ALLOC_MS); // Clear the data
+    Swarm_M138_Modem_Status_e status = SWARM_M138_MODEM_STATUS_INVALID;
+    char *eventStart;
+    char *eventEnd;
 
-      eventStart = strstr(event, "$M138 ");
-      if (eventStart != NULL)
+    eventStart = strstr(event, "$M138 ");
+    if (eventStart != NULL)
+    {
+      eventEnd = strchr(eventStart, '*'); // Stop at the asterix
+      if (eventEnd != NULL)
       {
-        eventEnd = strchr(eventStart, '*'); // Stop at the asterix
-        if (eventEnd != NULL)
+        if (eventEnd >= (eventStart + 6)) // Check we have enough data
         {
-          if (eventEnd >= (eventStart + 6)) // Check we have enough data
-          {
-            // Extract the modem status
+          // Extract the modem status
 
-            eventStart += 6; // Point at the first character of the msg
+          eventStart += 6; // Point at the first character of the msg
 
-            if (strstr(eventStart, "BOOT,ABORT") != NULL)
-            {
-              status = SWARM_M138_MODEM_STATUS_BOOT_ABORT;
-              eventStart += strlen("BOOT,ABORT"); // Point at the comma (or asterix)
-            }
-            else if (strstr(eventStart, "BOOT,DEVICEID") != NULL)
-            {
-              status = SWARM_M138_MODEM_STATUS_BOOT_DEVICEID;
-              eventStart += strlen("BOOT,DEVICEID"); // Point at the comma (or asterix)
-            }
-            else if (strstr(eventStart, "BOOT,POWERON") != NULL)
-            {
-              status = SWARM_M138_MODEM_STATUS_BOOT_POWERON;
-              eventStart += strlen("BOOT,POWERON"); // Point at the comma (or asterix)
-            }
-            else if (strstr(eventStart, "BOOT,RUNNING") != NULL)
-            {
-              status = SWARM_M138_MODEM_STATUS_BOOT_RUNNING;
-              eventStart += strlen("BOOT,RUNNING"); // Point at the comma (or asterix)
-            }
-            else if (strstr(eventStart, "BOOT,UPDATED") != NULL)
-            {
-              status = SWARM_M138_MODEM_STATUS_BOOT_UPDATED;
-              eventStart += strlen("BOOT,UPDATED"); // Point at the comma (or asterix)
-            }
-            else if (strstr(eventStart, "BOOT,VERSION") != NULL)
-            {
-              status = SWARM_M138_MODEM_STATUS_BOOT_VERSION;
-              eventStart += strlen("BOOT,VERSION"); // Point at the comma (or asterix)
-            }
-            else if (strstr(eventStart, "BOOT,RESTART") != NULL)
-            {
-              status = SWARM_M138_MODEM_STATUS_BOOT_RESTART;
-              eventStart += strlen("BOOT,RESTART"); // Point at the comma (or asterix)
-            }
-            else if (strstr(eventStart, "BOOT,SHUTDOWN") != NULL)
-            {
-              status = SWARM_M138_MODEM_STATUS_BOOT_SHUTDOWN;
-              eventStart += strlen("BOOT,SHUTDOWN"); // Point at the comma (or asterix)
-            }
-            else if (strstr(eventStart, "DATETIME") != NULL)
-            {
-              status = SWARM_M138_MODEM_STATUS_DATETIME;
-              eventStart += strlen("DATETIME"); // Point at the asterix
-            }
-            else if (strstr(eventStart, "POSITION") != NULL)
-            {
-              status = SWARM_M138_MODEM_STATUS_POSITION;
-              eventStart += strlen("POSITION"); // Point at the asterix
-            }
-            else if (strstr(eventStart, "DEBUG") != NULL)
-            {
-              status = SWARM_M138_MODEM_STATUS_DEBUG;
-              eventStart += strlen("DEBUG"); // Point at the comma (or asterix)
-            }
-            else if (strstr(eventStart, "ERROR") != NULL)
-            {
-              status = SWARM_M138_MODEM_STATUS_ERROR;
-              eventStart += strlen("ERROR"); // Point at the comma (or asterix)
-            }
+          if (strstr(eventStart, "BOOT,ABORT") != NULL)
+          {
+            status = SWARM_M138_MODEM_STATUS_BOOT_ABORT;
+            eventStart += strlen("BOOT,ABORT"); // Point at the comma (or asterix)
+          }
+          else if (strstr(eventStart, "BOOT,DEVICEID") != NULL)
+          {
+            status = SWARM_M138_MODEM_STATUS_BOOT_DEVICEID;
+            eventStart += strlen("BOOT,DEVICEID"); // Point at the comma (or asterix)
+          }
+          else if (strstr(eventStart, "BOOT,POWERON") != NULL)
+          {
+            status = SWARM_M138_MODEM_STATUS_BOOT_POWERON;
+            eventStart += strlen("BOOT,POWERON"); // Point at the comma (or asterix)
+          }
+          else if (strstr(eventStart, "BOOT,RUNNING") != NULL)
+          {
+            status = SWARM_M138_MODEM_STATUS_BOOT_RUNNING;
+            eventStart += strlen("BOOT,RUNNING"); // Point at the comma (or asterix)
+          }
+          else if (strstr(eventStart, "BOOT,UPDATED") != NULL)
+          {
+            status = SWARM_M138_MODEM_STATUS_BOOT_UPDATED;
+            eventStart += strlen("BOOT,UPDATED"); // Point at the comma (or asterix)
+          }
+          else if (strstr(eventStart, "BOOT,VERSION") != NULL)
+          {
+            status = SWARM_M138_MODEM_STATUS_BOOT_VERSION;
+            eventStart += strlen("BOOT,VERSION"); // Point at the comma (or asterix)
+          }
+          else if (strstr(eventStart, "BOOT,RESTART") != NULL)
+          {
+            status = SWARM_M138_MODEM_STATUS_BOOT_RESTART;
+            eventStart += strlen("BOOT,RESTART"); // Point at the comma (or asterix)
+          }
+          else if (strstr(eventStart, "BOOT,SHUTDOWN") != NULL)
+          {
+            status = SWARM_M138_MODEM_STATUS_BOOT_SHUTDOWN;
+            eventStart += strlen("BOOT,SHUTDOWN"); // Point at the comma (or asterix)
+          }
+          else if (strstr(eventStart, "DATETIME") != NULL)
+          {
+            status = SWARM_M138_MODEM_STATUS_DATETIME;
+            eventStart += strlen("DATETIME"); // Point at the asterix
+          }
+          else if (strstr(eventStart, "POSITION") != NULL)
+          {
+            status = SWARM_M138_MODEM_STATUS_POSITION;
+            eventStart += strlen("POSITION"); // Point at the asterix
+          }
+          else if (strstr(eventStart, "DEBUG") != NULL)
+          {
+            status = SWARM_M138_MODEM_STATUS_DEBUG;
+            eventStart += strlen("DEBUG"); // Point at the comma (or asterix)
+          }
+          else if (strstr(eventStart, "ERROR") != NULL)
+          {
+            status = SWARM_M138_MODEM_STATUS_ERROR;
+            eventStart += strlen("ERROR"); // Point at the comma (or asterix)
+          }
 
-            if (*eventStart == ',') // Is eventStart pointing at a comma?
-              eventStart++; // Point at the next character
+          if (*eventStart == ',') // Is eventStart pointing at a comma?
+            eventStart++; // Point at the next character
 
-            if (eventStart < eventEnd) // Check if we have reached the asterix
-            {
-              if (status == SWARM_M138_MODEM_STATUS_INVALID) // If status is still INVALID, this must be an unknown / undocumented message
-                status = SWARM_M138_MODEM_STATUS_UNKNOWN;
+          if (eventStart > eventEnd) // The status was found after the asterix
+            eventStart = eventEnd;
 
-              // Keep going until we hit the asterix or the data buffer is full
-              // Leave a NULL on the end of data!
-              size_t dataLen = 0;
-              while ((eventStart < eventEnd) && (dataLen < (SWARM_M138_MEM_ALLOC_MS - 1)))
-              {
-                data[dataLen] = *eventStart; // Copy the message data into data
-                dataLen++;
-                eventStart++;
-              }
-            }
+          if ((eventStart < eventEnd) && (status == SWARM_M138_MODEM_STATUS_INVALID)) // If status is still INVALID, this must be an unknown / undocumented message
+            status = SWARM_M138_MODEM_STATUS_UNKNOWN;
 
-            if (status < SWARM_M138_MODEM_STATUS_INVALID) // Check if we got valid data
+          if (status < SWARM_M138_MODEM_STATUS_INVALID) // Check if we got valid data
+          {
+            // The data is passed in place: null-terminate it, limited to SWARM_M138_MEM_ALLOC_MS - 1 characters as before
+            size_t dataLen = (size_t)(eventEnd - eventStart);
+            if (dataLen > (SWARM_M138_MEM_ALLOC_MS - 1))
+              dataLen = SWARM_M138_MEM_ALLOC_MS - 1;
+            char *dataEnd = eventStart + dataLen;
+            char saved = *dataEnd;
+            *dataEnd = 0;
+
+            Swarm_M138_Typed_Event_t *typedEvent = typedEventPush(SWARM_M138_EVENT_MODEM_STATUS);
+            if (typedEvent != NULL)
             {
-              if (_swarmModemStatusCallback != NULL)
-              {
-                _swarmModemStatusCallback(status, data); // Call the callback
-              }
+              typedEvent->modemStatus.status = status;
+              memcpy(typedEvent->modemStatus.data, eventStart, dataLen + 1); // Include the null
+            }
 
-              swarm_m138_free_char(data);
-              return (true);
+            if (_swarmModemStatusCallback != NULL)
+            {
+              _swarmModemStatusCallback(status, (const char *)eventStart); // Call the callback
             }
+
+            *dataEnd = saved; // Be nice. Restore the line
+            return (true);
           }
         }
       }
-      swarm_m138_free_char(data);
     }
   }
+  if (type == SWARM_M138_EVENT_SLEEP_WAKE)
   { // $SL - Sleep Mode
     Swarm_M138_Wake_Cause_e cause = SWARM_M138_WAKE_CAUSE_INVALID;
     char *eventStart;
@@ -818,6 +1141,10 @@ bool SWARM_M138::processUnsolicitedEvent(const char *event)
 
         if (cause < SWARM_M138_WAKE_CAUSE_INVALID)
         {
+          Swarm_M138_Typed_Event_t *typedEvent = typedEventPush(SWARM_M138_EVENT_SLEEP_WAKE);
+          if (typedEvent != NULL)
+            typedEvent->wakeCause = cause;
+
           if (_swarmSleepWakeCallback != NULL)
           {
             _swarmSleepWakeCallback(cause); // Call the callback
@@ -828,6 +1155,7 @@ bool SWARM_M138::processUnsolicitedEvent(const char *event)
       }
     }
   }
+  if (type == SWARM_M138_EVENT_RECEIVE_MESSAGE)
   { // $RD - Receive Data Message
     char *eventStart;
     char *eventEnd;
@@ -878,7 +1206,60 @@ bool SWARM_M138::processUnsolicitedEvent(const char *event)
                 paramPtr++; // Point to the first ASCII Hex character
                 *eventEnd = 0; // Change the asterix into NULL
 
-                if (_swarmReceiveMessageCallback != NULL)
+                // The duplicate filter and the reassembler need the binary payload. Decode it once and share it
+                bool mayBeFragment = appIDseen && (_reassembly != NULL) && (appID >= SWARM_M138_FRAGMENT_APPID_BASE)
+                                     && (appID < (SWARM_M138_FRAGMENT_APPID_BASE + SWARM_M138_FRAGMENT_CHANNELS));
+                uint8_t *payload = NULL;
+                size_t payloadLen = 0;
+                if ((_rxDedup != NULL) || mayBeFragment)
+                {
+                  payload = (uint8_t *)swarm_m138_alloc_char(SWARM_M138_MAX_PACKET_LENGTH_BYTES); // Allocate memory for the binary payload
+                  if (payload == NULL)
+                  {
+                    // Without the payload, a duplicate or a fragment would reach the callback. Drop the message instead
+                    if (_printDebug == true)
+                      _debugPort->println(F("processUnsolicitedEvent: not enough memory to filter $RD! Message dropped"));
+#ifdef SWARM_M138_STATS
+                    _statsEventMemoryFailures = _statsEventMemoryFailures + 1;
+#endif
+                    *eventEnd = '*'; // Restore the asterix
+                    return (false); // Not handled
+                  }
+                  payloadLen = hexToBinary((const char *)paramPtr, payload, SWARM_M138_MAX_PACKET_LENGTH_BYTES);
+                }
+
+                bool isDuplicate = false;
+                if (_rxDedup != NULL)
+                  isDuplicate = checkRxDuplicate(appIDseen ? appID : 0, 0, (const uint8_t *)payload, payloadLen); // $RD does not include the epoch
+
+                bool isFragment = false;
+                if ((!isDuplicate) && mayBeFragment)
+                  isFragment = feedFragment(appID, (const uint8_t *)payload, payloadLen); // Pass it to the reassembler
+
+                if ((!isFragment) && (!isDuplicate))
+                {
+                  Swarm_M138_Typed_Event_t *typedEvent = typedEventPush(SWARM_M138_EVENT_RECEIVE_MESSAGE);
+                  if (typedEvent != NULL)
+                  {
+                    typedEvent->receiveData.appIDValid = appIDseen;
+                    typedEvent->receiveData.appID = appID;
+                    typedEvent->receiveData.rssi = rssi;
+                    typedEvent->receiveData.snr = snr;
+                    typedEvent->receiveData.fdev = fdev;
+                    if (payload != NULL) // Already decoded
+                    {
+                      memcpy(typedEvent->receiveData.data, payload, payloadLen);
+                      typedEvent->receiveData.length = (uint8_t)payloadLen;
+                    }
+                    else
+                      typedEvent->receiveData.length = (uint8_t)hexToBinary((const char *)paramPtr, typedEvent->receiveData.data, SWARM_M138_MAX_PACKET_LENGTH_BYTES);
+                  }
+                }
+
+                if (payload != NULL)
+                  swarm_m138_free_char((char *)payload);
+
+                if ((_swarmReceiveMessageCallback != NULL) && (!isFragment) && (!isDuplicate))
                 {
                   if (appIDseen)
                     _swarmReceiveMessageCallback((const uint16_t *)&appID, (const int16_t *)&rssi,
@@ -898,6 +1279,7 @@ bool SWARM_M138::processUnsolicitedEvent(const char *event)
       }
     }
   }
+  if (type == SWARM_M138_EVENT_TRANSMIT_DATA)
   { // $TD - Transmit Data Message
     char *eventStart;
     char *eventEnd;
@@ -941,6 +1323,17 @@ bool SWARM_M138::processUnsolicitedEvent(const char *event)
                   paramPtr++;
                 }
 
+                txMirrorRemove(msg_id, true); // Remove the message from the TX queue mirror (if enabled)
+
+                Swarm_M138_Typed_Event_t *typedEvent = typedEventPush(SWARM_M138_EVENT_TRANSMIT_DATA);
+                if (typedEvent != NULL)
+                {
+                  typedEvent->transmitData.rssi_sat = rssi;
+                  typedEvent->transmitData.snr = snr;
+                  typedEvent->transmitData.fdev = fdev;
+                  typedEvent->transmitData.msg_id = msg_id;
+                }
+
                 if (_swarmTransmitDataCallback != NULL)
                 {
                   _swarmTransmitDataCallback((const int16_t *)&rssi, (const int16_t *)&snr,
@@ -974,6 +1367,7 @@ bool SWARM_M138::processUnsolicitedEvent(const char *event)
 // but an unsolicited receive data message could arrive while we are waiting for the response...
 Swarm_M138_Error_e SWARM_M138::getConfigurationSettings(char *settings)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
   char *responseStart;
@@ -1038,6 +1432,7 @@ Swarm_M138_Error_e SWARM_M138::getConfigurationSettings(char *settings)
 // So we need to allocate the full _RxBuffSize for the response.
 Swarm_M138_Error_e SWARM_M138::getDeviceID(uint32_t *id)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
   char *responseStart;
@@ -1116,10 +1511,9 @@ Swarm_M138_Error_e SWARM_M138::getDeviceID(uint32_t *id)
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::getDateTime(Swarm_M138_DateTimeData_t *dateTime)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
-  char *responseStart;
-  char *responseEnd = NULL;
   Swarm_M138_Error_e err;
 
   // Allocate memory for the command, asterix, checksum bytes, \n and \0
@@ -1141,38 +1535,7 @@ Swarm_M138_Error_e SWARM_M138::getDateTime(Swarm_M138_DateTimeData_t *dateTime)
   err = sendCommandWithResponse(command, "$DT ", "$DT ERR", response, _RxBuffSize);
 
   if (err == SWARM_M138_ERROR_SUCCESS)
-  {
-    responseStart = strstr(response, "$DT ");
-    if (responseStart != NULL)
-      responseEnd = strchr(responseStart, '*'); // Stop at the asterix
-    if ((responseStart == NULL) || (responseEnd == NULL) || (responseEnd < (responseStart + 20))) // Check we have enough data
-    {
-      swarm_m138_free_char(command);
-      swarm_m138_free_char(response);
-      return (SWARM_M138_ERROR_ERROR);
-    }
-
-    // Extract the Date, Time and flag
-    int year, month, day, hour, minute, second;
-    char valid;
-
-    int ret = sscanf(responseStart, "$DT %4d%2d%2d%2d%2d%2d,%c*", &year, &month, &day, &hour, &minute, &second, &valid);
-
-    if (ret < 7)
-    {
-      swarm_m138_free_char(command);
-      swarm_m138_free_char(response);
-      return (SWARM_M138_ERROR_ERROR);
-    }
-
-    dateTime->YYYY = (uint16_t)year;
-    dateTime->MM = (uint8_t)month;
-    dateTime->DD = (uint8_t)day;
-    dateTime->hh = (uint8_t)hour;
-    dateTime->mm = (uint8_t)minute;
-    dateTime->ss = (uint8_t)second;
-    dateTime->valid = valid == 'V' ? 1 : 0;
-  }
+    err = parseDateTime(response, dateTime);
 
   swarm_m138_free_char(command);
   swarm_m138_free_char(response);
@@ -1191,6 +1554,7 @@ Swarm_M138_Error_e SWARM_M138::getDateTime(Swarm_M138_DateTimeData_t *dateTime)
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::getDateTimeRate(uint32_t *rate)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
   char *responseStart;
@@ -1271,6 +1635,7 @@ Swarm_M138_Error_e SWARM_M138::getDateTimeRate(uint32_t *rate)
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::setDateTimeRate(uint32_t rate)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
   Swarm_M138_Error_e err;
@@ -1287,7 +1652,7 @@ Swarm_M138_Error_e SWARM_M138::setDateTimeRate(uint32_t rate)
 #if defined(ARDUINO_ARCH_ESP32) || defined(ARDUINO_ARCH_ESP8266)
   sprintf(command, "%s %u*", SWARM_M138_COMMAND_DATE_TIME_STAT, rate); // Copy the command, add the asterix
 #else
-  sprintf(command, "%s %lu*", SWARM_M138_COMMAND_DATE_TIME_STAT, rate); // Copy the command, add the asterix
+  sprintf(command, "%s %lu*", SWARM_M138_COMMAND_DATE_TIME_STAT, (unsigned long)rate); // Copy the command, add the asterix
 #endif
   addChecksumLF(command); // Add the checksum bytes and line feed
 
@@ -1320,6 +1685,7 @@ Swarm_M138_Error_e SWARM_M138::setDateTimeRate(uint32_t rate)
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::getFirmwareVersion(char *version)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
   char *responseStart;
@@ -1381,6 +1747,7 @@ Swarm_M138_Error_e SWARM_M138::getFirmwareVersion(char *version)
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::getGpsJammingIndication(Swarm_M138_GPS_Jamming_Indication_t *jamming)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
   char *responseStart;
@@ -1450,6 +1817,7 @@ Swarm_M138_Error_e SWARM_M138::getGpsJammingIndication(Swarm_M138_GPS_Jamming_In
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::getGpsJammingIndicationRate(uint32_t *rate)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
   char *responseStart;
@@ -1530,6 +1898,7 @@ Swarm_M138_Error_e SWARM_M138::getGpsJammingIndicationRate(uint32_t *rate)
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::setGpsJammingIndicationRate(uint32_t rate)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
   Swarm_M138_Error_e err;
@@ -1546,7 +1915,7 @@ Swarm_M138_Error_e SWARM_M138::setGpsJammingIndicationRate(uint32_t rate)
 #if defined(ARDUINO_ARCH_ESP32) || defined(ARDUINO_ARCH_ESP8266)
   sprintf(command, "%s %u*", SWARM_M138_COMMAND_GPS_JAMMING, rate); // Copy the command, add the asterix
 #else
-  sprintf(command, "%s %lu*", SWARM_M138_COMMAND_GPS_JAMMING, rate); // Copy the command, add the asterix
+  sprintf(command, "%s %lu*", SWARM_M138_COMMAND_GPS_JAMMING, (unsigned long)rate); // Copy the command, add the asterix
 #endif
   addChecksumLF(command); // Add the checksum bytes and line feed
 
@@ -1577,10 +1946,9 @@ Swarm_M138_Error_e SWARM_M138::setGpsJammingIndicationRate(uint32_t rate)
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::getGeospatialInfo(Swarm_M138_GeospatialData_t *info)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
-  char *responseStart;
-  char *responseEnd = NULL;
   Swarm_M138_Error_e err;
 
   // Allocate memory for the command, asterix, checksum bytes, \n and \0
@@ -1602,43 +1970,7 @@ Swarm_M138_Error_e SWARM_M138::getGeospatialInfo(Swarm_M138_GeospatialData_t *in
   err = sendCommandWithResponse(command, "$GN ", "$GN ERR", response, _RxBuffSize);
 
   if (err == SWARM_M138_ERROR_SUCCESS)
-  {
-    responseStart = strstr(response, "$GN ");
-    if (responseStart != NULL)
-      responseEnd = strchr(responseStart, '*'); // Stop at the asterix
-    if ((responseStart == NULL) || (responseEnd == NULL) || (responseEnd < (responseStart + 10))) // Check we have enough data
-    {
-      swarm_m138_free_char(command);
-      swarm_m138_free_char(response);
-      return (SWARM_M138_ERROR_ERROR);
-    }
-
-    // Extract the geospatial info
-    int latH, lonH, alt, course, speed;
-    char latL[8], lonL[8];
-
-    int ret = sscanf(responseStart, "$GN %d.%[^,],%d.%[^,],%d,%d,%d*",
-                     &latH, latL, &lonH, lonL, &alt, &course, &speed);
-
-    if (ret < 7)
-    {
-      swarm_m138_free_char(command);
-      swarm_m138_free_char(response);
-      return (SWARM_M138_ERROR_ERROR);
-    }
-
-    if (latH >= 0)
-      info->lat = (float)latH + ((float)atol(latL) / pow(10, strlen(latL)));
-    else
-      info->lat = (float)latH - ((float)atol(latL) / pow(10, strlen(latL)));
-    if (lonH >= 0)
-      info->lon = (float)lonH + ((float)atol(lonL) / pow(10, strlen(lonL)));
-    else
-      info->lon = (float)lonH - ((float)atol(lonL) / pow(10, strlen(lonL)));
-    info->alt = (float)alt;
-    info->course = (float)course;
-    info->speed = (float)speed;
-  }
+    err = parseGeospatialInfo(response, info);
 
   swarm_m138_free_char(command);
   swarm_m138_free_char(response);
@@ -1657,6 +1989,7 @@ Swarm_M138_Error_e SWARM_M138::getGeospatialInfo(Swarm_M138_GeospatialData_t *in
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::getGeospatialInfoRate(uint32_t *rate)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
   char *responseStart;
@@ -1737,6 +2070,7 @@ Swarm_M138_Error_e SWARM_M138::getGeospatialInfoRate(uint32_t *rate)
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::setGeospatialInfoRate(uint32_t rate)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
   Swarm_M138_Error_e err;
@@ -1753,7 +2087,7 @@ Swarm_M138_Error_e SWARM_M138::setGeospatialInfoRate(uint32_t rate)
 #if defined(ARDUINO_ARCH_ESP32) || defined(ARDUINO_ARCH_ESP8266)
   sprintf(command, "%s %u*", SWARM_M138_COMMAND_GEOSPATIAL_INFO, rate); // Copy the command, add the asterix
 #else
-  sprintf(command, "%s %lu*", SWARM_M138_COMMAND_GEOSPATIAL_INFO, rate); // Copy the command, add the asterix
+  sprintf(command, "%s %lu*", SWARM_M138_COMMAND_GEOSPATIAL_INFO, (unsigned long)rate); // Copy the command, add the asterix
 #endif
   addChecksumLF(command); // Add the checksum bytes and line feed
 
@@ -1784,6 +2118,7 @@ Swarm_M138_Error_e SWARM_M138::setGeospatialInfoRate(uint32_t rate)
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::getGPIO1Mode(Swarm_M138_GPIO1_Mode_e *mode)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
   char *responseStart;
@@ -1852,6 +2187,7 @@ Swarm_M138_Error_e SWARM_M138::getGPIO1Mode(Swarm_M138_GPIO1_Mode_e *mode)
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::setGPIO1Mode(Swarm_M138_GPIO1_Mode_e mode)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
   Swarm_M138_Error_e err;
@@ -1898,6 +2234,7 @@ Swarm_M138_Error_e SWARM_M138::setGPIO1Mode(Swarm_M138_GPIO1_Mode_e mode)
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::readGPIO1voltage(float *voltage)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
   char *responseStart;
@@ -1956,7 +2293,7 @@ Swarm_M138_Error_e SWARM_M138::readGPIO1voltage(float *voltage)
         int volt;
         char mVolt[5];
 
-        int ret = sscanf(responseStart, "$GP %d.%[^,]V*", &volt, mVolt);
+        int ret = sscanf(responseStart, "$GP %d.%4[0-9]V*", &volt, mVolt);
 
         if (ret == 2)
         {
@@ -1989,6 +2326,7 @@ Swarm_M138_Error_e SWARM_M138::readGPIO1voltage(float *voltage)
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::getGpsFixQuality(Swarm_M138_GPS_Fix_Quality_t *fixQuality)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
   char *responseStart;
@@ -2081,6 +2419,7 @@ Swarm_M138_Error_e SWARM_M138::getGpsFixQuality(Swarm_M138_GPS_Fix_Quality_t *fi
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::getGpsFixQualityRate(uint32_t *rate)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
   char *responseStart;
@@ -2161,6 +2500,7 @@ Swarm_M138_Error_e SWARM_M138::getGpsFixQualityRate(uint32_t *rate)
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::setGpsFixQualityRate(uint32_t rate)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
   Swarm_M138_Error_e err;
@@ -2177,7 +2517,7 @@ Swarm_M138_Error_e SWARM_M138::setGpsFixQualityRate(uint32_t rate)
 #if defined(ARDUINO_ARCH_ESP32) || defined(ARDUINO_ARCH_ESP8266)
   sprintf(command, "%s %u*", SWARM_M138_COMMAND_GPS_FIX_QUAL, rate); // Copy the command, add the asterix
 #else
-  sprintf(command, "%s %lu*", SWARM_M138_COMMAND_GPS_FIX_QUAL, rate); // Copy the command, add the asterix
+  sprintf(command, "%s %lu*", SWARM_M138_COMMAND_GPS_FIX_QUAL, (unsigned long)rate); // Copy the command, add the asterix
 #endif
   addChecksumLF(command); // Add the checksum bytes and line feed
 
@@ -2207,6 +2547,7 @@ Swarm_M138_Error_e SWARM_M138::setGpsFixQualityRate(uint32_t rate)
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::powerOff(void)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
   Swarm_M138_Error_e err;
@@ -2246,6 +2587,7 @@ Swarm_M138_Error_e SWARM_M138::powerOff(void)
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::getPowerStatus(Swarm_M138_Power_Status_t *powerStatus)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
   char *responseStart;
@@ -2286,7 +2628,7 @@ Swarm_M138_Error_e SWARM_M138::getPowerStatus(Swarm_M138_Power_Status_t *powerSt
     int unused1H, unused2H, unused3H, cpu_voltsH, tempH;
     char unused1L[8], unused2L[8], unused3L[8], cpu_voltsL[8], tempL[8];
 
-    int ret = sscanf(responseStart, "$PW %d.%[^,],%d.%[^,],%d.%[^,],%d.%[^,],%d.%[^,]*",
+    int ret = sscanf(responseStart, "$PW %d.%7[0-9],%d.%7[0-9],%d.%7[0-9],%d.%7[0-9],%d.%7[0-9]*",
                      &cpu_voltsH, cpu_voltsL, &unused1H, unused1L,
                      &unused2H, unused2L, &unused3H, unused3L,
                      &tempH, tempL);
@@ -2298,23 +2640,23 @@ Swarm_M138_Error_e SWARM_M138::getPowerStatus(Swarm_M138_Power_Status_t *powerSt
       return (SWARM_M138_ERROR_ERROR);
     }
 
-    if (cpu_voltsH >= 0)
+    if (!fieldIsNegative(responseStart, 0))
       powerStatus->cpu_volts = (float)cpu_voltsH + ((float)atol(cpu_voltsL) / pow(10, strlen(cpu_voltsL)));
     else
       powerStatus->cpu_volts = (float)cpu_voltsH - ((float)atol(cpu_voltsL) / pow(10, strlen(cpu_voltsL)));
-    if (unused1H >= 0)
+    if (!fieldIsNegative(responseStart, 1))
       powerStatus->unused1 = (float)unused1H + ((float)atol(unused1L) / pow(10, strlen(unused1L)));
     else
       powerStatus->unused1 = (float)unused1H - ((float)atol(unused1L) / pow(10, strlen(unused1L)));
-    if (unused2H >= 0)
+    if (!fieldIsNegative(responseStart, 2))
       powerStatus->unused2 = (float)unused2H + ((float)atol(unused2L) / pow(10, strlen(unused2L)));
     else
       powerStatus->unused2 = (float)unused2H - ((float)atol(unused2L) / pow(10, strlen(unused2L)));
-    if (unused3H >= 0)
+    if (!fieldIsNegative(responseStart, 3))
       powerStatus->unused3 = (float)unused3H + ((float)atol(unused3L) / pow(10, strlen(unused3L)));
     else
       powerStatus->unused3 = (float)unused3H - ((float)atol(unused3L) / pow(10, strlen(unused3L)));
-    if (tempH >= 0)
+    if (!fieldIsNegative(responseStart, 4))
       powerStatus->temp = (float)tempH + ((float)atol(tempL) / pow(10, strlen(tempL)));
     else
       powerStatus->temp = (float)tempH - ((float)atol(tempL) / pow(10, strlen(tempL)));
@@ -2337,6 +2679,7 @@ Swarm_M138_Error_e SWARM_M138::getPowerStatus(Swarm_M138_Power_Status_t *powerSt
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::getPowerStatusRate(uint32_t *rate)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
   char *responseStart;
@@ -2417,6 +2760,7 @@ Swarm_M138_Error_e SWARM_M138::getPowerStatusRate(uint32_t *rate)
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::setPowerStatusRate(uint32_t rate)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
   Swarm_M138_Error_e err;
@@ -2433,7 +2777,7 @@ Swarm_M138_Error_e SWARM_M138::setPowerStatusRate(uint32_t rate)
 #if defined(ARDUINO_ARCH_ESP32) || defined(ARDUINO_ARCH_ESP8266)
   sprintf(command, "%s %u*", SWARM_M138_COMMAND_POWER_STAT, rate); // Copy the command, add the asterix
 #else
-  sprintf(command, "%s %lu*", SWARM_M138_COMMAND_POWER_STAT, rate); // Copy the command, add the asterix
+  sprintf(command, "%s %lu*", SWARM_M138_COMMAND_POWER_STAT, (unsigned long)rate); // Copy the command, add the asterix
 #endif
   addChecksumLF(command); // Add the checksum bytes and line feed
 
@@ -2464,11 +2808,12 @@ Swarm_M138_Error_e SWARM_M138::setPowerStatusRate(uint32_t rate)
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::getTemperature(float *temperature)
 {
-  Swarm_M138_Power_Status_t *powerStatus = new Swarm_M138_Power_Status_t;
+  SWARM_M138_ALLOC_ENTRY();
+  Swarm_M138_Power_Status_t *powerStatus = (Swarm_M138_Power_Status_t *)swarm_m138_alloc(sizeof(Swarm_M138_Power_Status_t));
   Swarm_M138_Error_e err = getPowerStatus(powerStatus);
   if (err == SWARM_M138_ERROR_SUCCESS)
     *temperature = powerStatus->temp;
-  delete powerStatus;
+  swarm_m138_free(powerStatus);
   return (err);
 }
 
@@ -2484,11 +2829,12 @@ Swarm_M138_Error_e SWARM_M138::getTemperature(float *temperature)
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::getCPUvoltage(float *voltage)
 {
-  Swarm_M138_Power_Status_t *powerStatus = new Swarm_M138_Power_Status_t;
+  SWARM_M138_ALLOC_ENTRY();
+  Swarm_M138_Power_Status_t *powerStatus = (Swarm_M138_Power_Status_t *)swarm_m138_alloc(sizeof(Swarm_M138_Power_Status_t));
   Swarm_M138_Error_e err = getPowerStatus(powerStatus);
   if (err == SWARM_M138_ERROR_SUCCESS)
     *voltage = powerStatus->cpu_volts;
-  delete powerStatus;
+  swarm_m138_free(powerStatus);
   return (err);
 }
 
@@ -2505,6 +2851,7 @@ Swarm_M138_Error_e SWARM_M138::getCPUvoltage(float *voltage)
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::restartDevice(bool deletedb)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
   Swarm_M138_Error_e err;
@@ -2549,6 +2896,7 @@ Swarm_M138_Error_e SWARM_M138::restartDevice(bool deletedb)
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::getReceiveTest(Swarm_M138_Receive_Test_t *rxTest)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
   char *responseStart;
@@ -2593,25 +2941,29 @@ Swarm_M138_Error_e SWARM_M138::getReceiveTest(Swarm_M138_Receive_Test_t *rxTest)
     int ret = sscanf(responseStart, "$RT RSSI=%d,SNR=%d,FDEV=%d,TS=%d-%d-%dT%d:%d:%d,DI=0x",
                      &rssi_sat, &snr, &fdev, &YYYY, &MM, &DD, &hh, &mm, &ss);
 
+    const char *satIDStart = NULL;
     if (ret == 9)
-    {
-      responseStart = strstr(response, "DI=0x"); // Find the start of the satellite ID
+      satIDStart = strstr(responseStart, "DI=0x"); // Find the start of the satellite ID. sscanf does not check the final literal
 
+    if (satIDStart != NULL)
+    {
       // Extract the ID
-      responseStart += 5; // Point at the first digit
-      while (responseStart < responseEnd)
+      satIDStart += 5; // Point at the first digit
+      while (satIDStart < responseEnd)
       {
         sat_ID <<= 4; // Shuffle the existing value along by 4 bits
-        char c = *responseStart; // Get the digit
+        char c = *satIDStart; // Get the digit
         if ((c >= '0') && (c <= '9'))
           sat_ID |= c - '0';
         else if ((c >= 'a') && (c <= 'f'))
           sat_ID |= c + 10 - 'a';
         else if ((c >= 'A') && (c <= 'F'))
           sat_ID |= c + 10 - 'A';
-        responseStart++;
+        satIDStart++;
       }
     }
+    else if (ret == 9) // The satellite ID is missing
+      ret = 0;
     else // Try to extract just rssi_background
     {
       ret = sscanf(responseStart, "$RT RSSI=%d*", &rssi_bg);
@@ -2653,6 +3005,7 @@ Swarm_M138_Error_e SWARM_M138::getReceiveTest(Swarm_M138_Receive_Test_t *rxTest)
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::getReceiveTestRate(uint32_t *rate)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
   char *responseStart;
@@ -2733,6 +3086,7 @@ Swarm_M138_Error_e SWARM_M138::getReceiveTestRate(uint32_t *rate)
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::setReceiveTestRate(uint32_t rate)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
   Swarm_M138_Error_e err;
@@ -2749,7 +3103,7 @@ Swarm_M138_Error_e SWARM_M138::setReceiveTestRate(uint32_t rate)
 #if defined(ARDUINO_ARCH_ESP32) || defined(ARDUINO_ARCH_ESP8266)
   sprintf(command, "%s %u*", SWARM_M138_COMMAND_RX_TEST, rate); // Copy the command, add the asterix
 #else
-  sprintf(command, "%s %lu*", SWARM_M138_COMMAND_RX_TEST, rate); // Copy the command, add the asterix
+  sprintf(command, "%s %lu*", SWARM_M138_COMMAND_RX_TEST, (unsigned long)rate); // Copy the command, add the asterix
 #endif
   addChecksumLF(command); // Add the checksum bytes and line feed
 
@@ -2781,6 +3135,7 @@ Swarm_M138_Error_e SWARM_M138::setReceiveTestRate(uint32_t rate)
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::sleepMode(uint32_t seconds)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
   Swarm_M138_Error_e err;
@@ -2793,7 +3148,7 @@ Swarm_M138_Error_e SWARM_M138::sleepMode(uint32_t seconds)
 #if defined(ARDUINO_ARCH_ESP32) || defined(ARDUINO_ARCH_ESP8266)
   sprintf(command, "%s S=%d*", SWARM_M138_COMMAND_SLEEP, seconds); // Copy the command, add the asterix
 #else
-  sprintf(command, "%s S=%ld*", SWARM_M138_COMMAND_SLEEP, seconds); // Copy the command, add the asterix
+  sprintf(command, "%s S=%lu*", SWARM_M138_COMMAND_SLEEP, (unsigned long)seconds); // Copy the command, add the asterix
 #endif
   addChecksumLF(command); // Add the checksum bytes and line feed
 
@@ -2828,6 +3183,7 @@ Swarm_M138_Error_e SWARM_M138::sleepMode(uint32_t seconds)
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::sleepMode(Swarm_M138_DateTimeData_t sleepUntil, bool dateAndTime)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
   char *scratchpad;
@@ -2914,10 +3270,9 @@ Swarm_M138_Error_e SWARM_M138::sleepMode(Swarm_M138_DateTimeData_t sleepUntil, b
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::getRxMessageCount(uint16_t *count, bool unread)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
-  char *responseStart;
-  char *responseEnd = NULL;
   Swarm_M138_Error_e err;
 
   // Allocate memory for the command, asterix, checksum bytes, \n and \0
@@ -2942,44 +3297,7 @@ Swarm_M138_Error_e SWARM_M138::getRxMessageCount(uint16_t *count, bool unread)
   err = sendCommandWithResponse(command, "$MM ", "$MM ERR", response, _RxBuffSize, SWARM_M138_MESSAGE_READ_TIMEOUT);
 
   if (err == SWARM_M138_ERROR_SUCCESS)
-  {
-    responseStart = strstr(response, "$MM ");
-    if (responseStart != NULL)
-      responseEnd = strchr(responseStart, '*'); // Stop at the asterix
-    if ((responseStart == NULL) || (responseEnd == NULL))
-    {
-      swarm_m138_free_char(command);
-      swarm_m138_free_char(response);
-      return (SWARM_M138_ERROR_ERROR);
-    }
-
-    // Extract the count
-    char c;
-    uint16_t theCount = 0;
-    responseStart += 4; // Point at the first digit of the count
-
-    c = *responseStart; // Get the first digit of the count
-    while ((c != '*') && (c != ',')) // Keep going until we hit the asterix or a comma
-    {
-      if ((c >= '0') && (c <= '9')) // Extract the count one digit at a time
-      {
-        theCount = theCount * 10;
-        theCount += (uint16_t)(c - '0');
-      }
-      responseStart++;
-      c = *responseStart; // Get the next digit of the count
-    }
-
-    if (c == ',') // If we hit a comma, this must be a different $MM message
-    {
-      *count = 0; // Set count to zero in case the user is not checking err
-      err = SWARM_M138_ERROR_INVALID_FORMAT;
-    }
-    else
-    {
-      *count = theCount;
-    }
-  }
+    err = parseMessageCount(response, "$MM ", count);
 
   swarm_m138_free_char(command);
   swarm_m138_free_char(response);
@@ -2999,6 +3317,7 @@ Swarm_M138_Error_e SWARM_M138::getRxMessageCount(uint16_t *count, bool unread)
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::deleteRxMessage(uint64_t msg_id)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
   char *fwd;
@@ -3090,6 +3409,7 @@ Swarm_M138_Error_e SWARM_M138::deleteRxMessage(uint64_t msg_id)
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::deleteAllRxMessages(bool read)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
   char *scratchpad;
@@ -3169,6 +3489,7 @@ Swarm_M138_Error_e SWARM_M138::deleteAllRxMessages(bool read)
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::markRxMessage(uint64_t msg_id)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
   char *fwd;
@@ -3257,6 +3578,7 @@ Swarm_M138_Error_e SWARM_M138::markRxMessage(uint64_t msg_id)
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::markAllRxMessages(void)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
   char *scratchpad;
@@ -3315,6 +3637,7 @@ Swarm_M138_Error_e SWARM_M138::markAllRxMessages(void)
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::getMessageNotifications(bool *enabled)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
   Swarm_M138_Error_e err;
@@ -3363,6 +3686,7 @@ Swarm_M138_Error_e SWARM_M138::getMessageNotifications(bool *enabled)
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::setMessageNotifications(bool enable)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
   Swarm_M138_Error_e err;
@@ -3414,6 +3738,7 @@ Swarm_M138_Error_e SWARM_M138::setMessageNotifications(bool enable)
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::listMessage(uint64_t msg_id, char *asciiHex, size_t len, uint32_t *epoch, uint16_t *appID)
 {
+  SWARM_M138_ALLOC_ENTRY();
   return (readMessageInternal('L', msg_id, asciiHex, len, NULL, epoch, appID));
 }
 /**************************************************************************/
@@ -3437,6 +3762,7 @@ Swarm_M138_Error_e SWARM_M138::listMessage(uint64_t msg_id, char *asciiHex, size
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::readMessage(uint64_t msg_id, char *asciiHex, size_t len, uint32_t *epoch, uint16_t *appID)
 {
+  SWARM_M138_ALLOC_ENTRY();
   return (readMessageInternal('R', msg_id, asciiHex, len, NULL, epoch, appID));
 }
 /**************************************************************************/
@@ -3460,6 +3786,7 @@ Swarm_M138_Error_e SWARM_M138::readMessage(uint64_t msg_id, char *asciiHex, size
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::readOldestMessage(char *asciiHex, size_t len, uint64_t *msg_id, uint32_t *epoch, uint16_t *appID)
 {
+  SWARM_M138_ALLOC_ENTRY();
   return (readMessageInternal('O', 0, asciiHex, len, msg_id, epoch, appID));
 }
 /**************************************************************************/
@@ -3483,440 +3810,549 @@ Swarm_M138_Error_e SWARM_M138::readOldestMessage(char *asciiHex, size_t len, uin
 /**************************************************************************/
 Swarm_M138_Error_e SWARM_M138::readNewestMessage(char *asciiHex, size_t len, uint64_t *msg_id, uint32_t *epoch, uint16_t *appID)
 {
+  SWARM_M138_ALLOC_ENTRY();
   return (readMessageInternal('N', 0, asciiHex, len, msg_id, epoch, appID));
 }
 
-Swarm_M138_Error_e SWARM_M138::readMessageInternal(const char mode, uint64_t msg_id_in, char *asciiHex, size_t len, uint64_t *msg_id_out, uint32_t *epoch, uint16_t *appID)
+/**************************************************************************/
+/*!
+    @brief  Read all of the unread messages, oldest first, and pass each one
+            to the callback as binary data.
+            The unread count is read once ($MM C=U). The messages are then read
+            using $MM R=O, which marks each one as read. On platforms with a
+            large serial receive buffer, the next $MM R=O is sent before the
+            callback is called, so the modem is reading the next message while
+            the callback processes the current one.
+            The callback may call other library commands (e.g. deleteRxMessage).
+            The next message is then read before the command is sent, so nothing
+            is lost, but the command waits for it.
+            Keep the callback short on AVR platforms: the next message is not
+            requested until the callback returns.
+    @param  swarmDrainCallback
+            The address of the function to be called for each message.
+            data points to the decoded binary message (len bytes). It is only valid
+            until the callback returns.
+            appID is NULL if the message does not have one.
+            If setRxDecompression has been called, messages with the matching appID
+            are decompressed first
+            If reassembly is enabled, fragments are passed to the reassembler instead
+    @param  maxCount
+            Stop after reading this many messages
+    @param  drained
+            Optional: a pointer to a uint16_t which will hold the number of messages read
+    @param  deleteWhenDone
+            If true: all read messages are deleted ($MM D=R) once the unread messages
+            have been read. Note: this includes any messages read previously
+    @return SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_ERROR if unsuccessful
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::drainRxMessages(void (*swarmDrainCallback)(const uint8_t *data, size_t len, const uint64_t *msg_id, const uint32_t *epoch, const uint16_t *appID),
+                                               uint16_t maxCount, uint16_t *drained, bool deleteWhenDone)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
-  char *fwd;
-  char *rev;
-  char *responseStart;
-  char *responseEnd = NULL;
+  uint8_t *data;
+  uint8_t *expanded = NULL;
   Swarm_M138_Error_e err;
+  uint16_t unreadTotal = 0;
+  uint16_t count = 0;
 
-  memset(asciiHex, 0, len); // Clear the char array
+  if (drained != NULL)
+    *drained = 0;
 
-  // Allocate memory for the command, asterix, checksum bytes, \n and \0
-  command = swarm_m138_alloc_char(strlen(SWARM_M138_COMMAND_MSG_RX_MGMT) + 3 + 20 + 5);
-  if (command == NULL)
-    return (SWARM_M138_ERROR_MEM_ALLOC);
-  memset(command, 0, strlen(SWARM_M138_COMMAND_MSG_RX_MGMT) + 3 + 20 + 5); // Clear it
+  err = getRxMessageCount(&unreadTotal, true); // Get the unread message count so we know how many messages to expect
+  if (err != SWARM_M138_ERROR_SUCCESS)
+    return (err);
 
-  if (mode == 'L')
-    sprintf(command, "%s L=", SWARM_M138_COMMAND_MSG_RX_MGMT); // Copy the command
-  else
-    sprintf(command, "%s R=", SWARM_M138_COMMAND_MSG_RX_MGMT); // Copy the command
+  if (unreadTotal > maxCount)
+    unreadTotal = maxCount;
 
-  if ((mode == 'L') || (mode == 'R')) // L=msgID or R=msgID
+  if (_printDebug == true)
   {
-    // Allocate memory for the scratchpads
-    fwd = swarm_m138_alloc_char(21); // Up to 20 digits plus null
-    if (fwd == NULL)
+    _debugPort->print(F("drainRxMessages: unreadTotal is "));
+    _debugPort->println(unreadTotal);
+  }
+
+  if (unreadTotal > 0)
+  {
+    // Allocate memory for the command, asterix, checksum bytes, \n and \0
+    command = swarm_m138_alloc_char(strlen(SWARM_M138_COMMAND_MSG_RX_MGMT) + 9);
+    if (command == NULL)
+      return (SWARM_M138_ERROR_MEM_ALLOC);
+    memset(command, 0, strlen(SWARM_M138_COMMAND_MSG_RX_MGMT) + 9); // Clear it
+    sprintf(command, "%s R=O*", SWARM_M138_COMMAND_MSG_RX_MGMT); // Copy the command, add the asterix
+    addChecksumLF(command); // Add the checksum bytes and line feed
+
+    response = swarm_m138_alloc_char(_RxBuffSize); // Allocate memory for the response
+    if (response == NULL)
     {
       swarm_m138_free_char(command);
       return (SWARM_M138_ERROR_MEM_ALLOC);
     }
-    memset(fwd, 0, 21); // Clear it
-    rev = swarm_m138_alloc_char(21); // Up to 20 digits plus null
-    if (rev == NULL)
+
+    data = (uint8_t *)swarm_m138_alloc_char(SWARM_M138_MAX_PACKET_LENGTH_BYTES); // Allocate memory for the decoded message
+    if (data == NULL)
     {
       swarm_m138_free_char(command);
-      swarm_m138_free_char(fwd);
+      swarm_m138_free_char(response);
       return (SWARM_M138_ERROR_MEM_ALLOC);
     }
-    memset(rev, 0, 21); // Clear it
 
-    // Add the 64-bit message ID
-    // Based on printLLNumber by robtillaart
-    // https://forum.arduino.cc/index.php?topic=143584.msg1519824#msg1519824
-    unsigned int i = 0;
-    if (msg_id_in == 0ULL) // if msg_id is zero, set fwd to "0"
+    if (_rxDecompress)
     {
-      fwd[0] = '0';
+      expanded = (uint8_t *)swarm_m138_alloc_char(SWARM_M138_MAX_DECOMPRESSED_LENGTH); // Allocate memory for the decompressed message
+      if (expanded == NULL)
+      {
+        swarm_m138_free_char(command);
+        swarm_m138_free_char(response);
+        swarm_m138_free_char((char *)data);
+        return (SWARM_M138_ERROR_MEM_ALLOC);
+      }
     }
-    else
+
+#ifdef ARDUINO_ARCH_AVR
+    const bool pipeline = false; // The AVR serial receive buffer is only 64 bytes. Don't let the response arrive while the callback is running
+#else
+    const bool pipeline = true;
+#endif
+
+    sendCommand(command); // Request the first message
+
+    while ((count < unreadTotal) && (err == SWARM_M138_ERROR_SUCCESS))
     {
-      while (msg_id_in > 0)
+      if (_drainResponseReady) // A command in the callback has already read the response
       {
-        rev[i++] = (msg_id_in % 10) + '0'; // divide by 10, convert the remainder to char
-        msg_id_in /= 10; // divide by 10
+        _drainResponseReady = false;
+        err = _drainResponseErr;
+        if (err == SWARM_M138_ERROR_ERR)
+          extractCommandError(strstr(response, "$MM ERR")); // The command in the callback has overwritten commandError
       }
-      unsigned int j = 0;
-      while (i > 0)
+      else
       {
-        fwd[j++] = rev[--i]; // reverse the order
+        memset(response, 0, _RxBuffSize); // Clear it
+
+        err = waitForResponse("$MM AI=", "$MM ERR", response, _RxBuffSize, SWARM_M138_MESSAGE_READ_TIMEOUT);
       }
-    }
-    strcat(command, fwd);
 
-    swarm_m138_free_char(fwd);
-    swarm_m138_free_char(rev);
-  }
-  else if (mode == 'O') // R=O (Oldest)
-    strcat(command, "O");
-  else // if (mode == 'N') // R=N (Newest)
-    strcat(command, "N");
+      if (err == SWARM_M138_ERROR_SUCCESS)
+      {
+        size_t len = SWARM_M138_MAX_PACKET_LENGTH_BYTES;
+        uint64_t msg_id = 0;
+        uint32_t epoch = 0;
+        uint16_t appID = 0;
 
-  strcat(command, "*"); // Append the asterix
+        err = decodeRxMessage(response, data, &len, &msg_id, &epoch, &appID);
 
-  addChecksumLF(command); // Add the checksum bytes and line feed
+        if (err == SWARM_M138_ERROR_SUCCESS)
+        {
+          count++;
 
-  response = swarm_m138_alloc_char(_RxBuffSize); // Allocate memory for the response
-  if (response == NULL)
-  {
-    swarm_m138_free_char(command);
-    return(SWARM_M138_ERROR_MEM_ALLOC);
-  }
-  memset(response, 0, _RxBuffSize); // Clear it
+          if ((count < unreadTotal) && pipeline)
+          {
+            sendCommand(command); // Request the next message now, before calling the callback
+            _drainResponse = response; // The response is read into here if the callback sends a command
+          }
 
-  err = sendCommandWithResponse(command, "$MM AI=", "$MM ERR", response, _RxBuffSize, SWARM_M138_MESSAGE_READ_TIMEOUT);
+          bool isDuplicate = checkRxDuplicate(appID, epoch, (const uint8_t *)data, len); // Check the raw payload against the duplicate filter
 
-  if (err == SWARM_M138_ERROR_SUCCESS)
-  {
-    responseStart = strstr(response, "$MM AI="); // Find the start of the response
-    if (responseStart != NULL)
-    {
-      responseEnd = strchr(responseStart, '*'); // Find the asterix
-      if (responseEnd != NULL)
-      {
-        // Extract the appID if required
-        if (appID != NULL)
-        {
-          int appID_i = 0;
-          int ret = sscanf(responseStart, "$MM AI=%d,", &appID_i);
-          if (ret == 1)
+          const uint8_t *callbackData = (const uint8_t *)data;
+          if ((!isDuplicate) && (expanded != NULL) && (appID == _rxDecompressAppID)) // Decompress the message if required
           {
-            *appID = (uint16_t)appID_i;
+            size_t expandedLen = SWARM_M138_MAX_DECOMPRESSED_LENGTH;
+            if (decompressPayload(data, len, expanded, &expandedLen) == SWARM_M138_ERROR_SUCCESS)
+            {
+              callbackData = (const uint8_t *)expanded;
+              len = expandedLen;
+            }
           }
+
+          bool isFragment = false;
+          if ((!isDuplicate) && (_reassembly != NULL) && (appID >= SWARM_M138_FRAGMENT_APPID_BASE)
+              && (appID < (SWARM_M138_FRAGMENT_APPID_BASE + SWARM_M138_FRAGMENT_CHANNELS)))
+            isFragment = feedFragment(appID, callbackData, len); // Pass it to the reassembler
+
+          if ((swarmDrainCallback != NULL) && (!isFragment) && (!isDuplicate))
+            swarmDrainCallback(callbackData, len, (const uint64_t *)&msg_id, (const uint32_t *)&epoch, (const uint16_t *)&appID); // Call the callback
+
+          _drainResponse = NULL; // If the callback did not send a command, the response is still on its way
+          if ((count < unreadTotal) && !pipeline)
+            sendCommand(command); // Request the next message
         }
+      }
+      else if ((err == SWARM_M138_ERROR_ERR) && (strstr(commandError, "DBX_NOMORE") != NULL))
+      {
+        err = SWARM_M138_ERROR_SUCCESS; // No more messages. The count must have changed
+        break;
+      }
+    }
 
-        responseStart = strchr(responseStart, ','); // Find the first comma (we know it is there)
-        
-        if (responseStart != NULL)
-        {
-          responseStart++; // Point to the first digit of the ASCII Hex
-          size_t charsRead = 0;
-          char c = *responseStart;
-          while ((c != ',') && (responseStart < responseEnd) && (charsRead < len)) // Stop at the next comma
-          {
-            asciiHex[charsRead] = c; // Copy the char into asciiHex
-            responseStart++; // Increment the pointer
-            charsRead++; // Increment the counter
-            c = *responseStart; // Get the next char
-          }
-
-          if (msg_id_out != NULL) // Are we reading the oldest or newest message?
-          {
-            responseStart++; // Point to the first digit of the msg_id
-            uint64_t theID = 0;
-            char c = *responseStart;
-            while ((c != ',') && (responseStart < responseEnd))
-            {
-              // if (_printDebug == true)
-              //   _debugPort->write(c);
-              theID *= 10;
-              theID += (uint64_t)(c - '0');
-              responseStart++;
-              c = *responseStart;
-            }
-            *msg_id_out = theID; // Store the extracted ID
-          }
-          else
-          {
-            responseStart++; // Point to the first digit of the msg_id
-            responseStart = strchr(responseStart, ','); // Find the next comma
-          }
+    swarm_m138_free_char(command);
+    swarm_m138_free_char(response);
+    swarm_m138_free_char((char *)data);
+    if (expanded != NULL)
+      swarm_m138_free_char((char *)expanded);
+  }
 
-          if (epoch != NULL) // Check if epoch is NULL
-          {
-            if (responseStart != NULL)
-            {
-              responseStart++; // Point to the first digit of the epoch
-              uint32_t theEpoch = 0;
-              char c = *responseStart;
-              while ((c != '*') && (responseStart < responseEnd)) // Stop at the asterix
-              {
-                theEpoch *= 10;
-                theEpoch += (uint32_t)(c - '0');
-                responseStart++;
-                c = *responseStart;
-              }
+  if (drained != NULL)
+    *drained = count;
 
-              *epoch = theEpoch;
-            }
-          }
-        }
-        else
-          err = SWARM_M138_ERROR_ERROR;
-      }
-      else
-        err = SWARM_M138_ERROR_ERROR;
-    }
-    else
-      err = SWARM_M138_ERROR_ERROR;
-  }
+  if ((err == SWARM_M138_ERROR_SUCCESS) && deleteWhenDone && (count > 0))
+    err = deleteAllRxMessages(true); // Delete the read messages in one go
 
-  swarm_m138_free_char(command);
-  swarm_m138_free_char(response);
   return (err);
 }
 
 /**************************************************************************/
 /*!
-    @brief  Return the count of all unsent messages
-    @param  count
-            A pointer to a uint16_t which will hold the message count
-    @return SWARM_M138_ERROR_SUCCESS if successful
-            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
-            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
-            SWARM_M138_ERROR_ERROR if unsuccessful
+    @brief  Enable the RX batch: a deferred list of mark / delete intents
+            queueMarkRxMessage and queueDeleteRxMessage add intents to the batch.
+            flushRxBatch sends them to the modem: the individual commands are
+            sent back-to-back.
+    @param  maxEntries
+            The maximum number of intents the batch can hold. The batch is flushed
+            automatically when it is full.
+            Each entry uses sizeof(Swarm_M138_RX_Batch_Entry_t) bytes of RAM.
+    @param  autoFlush
+            If true: checkUnsolicitedMsg flushes the batch when no serial data
+            has arrived from the modem, at most once every
+            SWARM_M138_RX_BATCH_AUTOFLUSH_INTERVAL milliseconds
+    @return True if the storage was allocated successfully, otherwise false
 */
 /**************************************************************************/
-Swarm_M138_Error_e SWARM_M138::getUnsentMessageCount(uint16_t *count)
+bool SWARM_M138::enableRxBatch(uint16_t maxEntries, bool autoFlush)
 {
-  char *command;
-  char *response;
-  char *responseStart;
-  char *responseEnd = NULL;
-  Swarm_M138_Error_e err;
+  SWARM_M138_ALLOC_ENTRY();
+  if (maxEntries == 0)
+    return (false);
 
-  // Allocate memory for the command, asterix, checksum bytes, \n and \0
-  command = swarm_m138_alloc_char(strlen(SWARM_M138_COMMAND_MSG_TX_MGMT) + 9);
-  if (command == NULL)
-    return (SWARM_M138_ERROR_MEM_ALLOC);
-  memset(command, 0, strlen(SWARM_M138_COMMAND_MSG_TX_MGMT) + 9); // Clear it
-  sprintf(command, "%s C=U*", SWARM_M138_COMMAND_MSG_TX_MGMT); // Copy the command, add the asterix
-  addChecksumLF(command); // Add the checksum bytes and line feed
+  disableRxBatch(); // Free any existing batch
 
-  response = swarm_m138_alloc_char(_RxBuffSize); // Allocate memory for the response
-  if (response == NULL)
+  Swarm_M138_RX_Batch_t *batch = (Swarm_M138_RX_Batch_t *)swarm_m138_alloc(sizeof(Swarm_M138_RX_Batch_t) + (sizeof(Swarm_M138_RX_Batch_Entry_t) * maxEntries));
+  if (batch == NULL)
   {
-    swarm_m138_free_char(command);
-    return(SWARM_M138_ERROR_MEM_ALLOC);
+    if (_printDebug == true)
+      _debugPort->println(F("enableRxBatch: not enough memory for _rxBatch!"));
+    return (false);
   }
-  memset(response, 0, _RxBuffSize); // Clear it
-
-  err = sendCommandWithResponse(command, "$MT ", "$MT ERR", response, _RxBuffSize, SWARM_M138_MESSAGE_READ_TIMEOUT);
-
-  if (err == SWARM_M138_ERROR_SUCCESS)
-  {
-    responseStart = strstr(response, "$MT ");
-    if (responseStart != NULL)
-      responseEnd = strchr(responseStart, '*'); // Stop at the asterix
-    if ((responseStart == NULL) || (responseEnd == NULL))
-    {
-      swarm_m138_free_char(command);
-      swarm_m138_free_char(response);
-      return (SWARM_M138_ERROR_ERROR);
-    }
 
-    // Extract the count
-    char c;
-    uint16_t theCount = 0;
-    responseStart += 4; // Point at the first digit of the count
+  batch->entries = (Swarm_M138_RX_Batch_Entry_t *)(batch + 1);
+  batch->size = maxEntries;
+  batch->count = 0;
+  batch->autoFlush = autoFlush;
+  batch->lastFlush = millis(); // The first automatic flush is one interval away
+  _rxBatch = batch;
 
-    c = *responseStart; // Get the first digit of the count
-    while ((c != '*') && (c != ',')) // Keep going until we hit the asterix
-    {
-      if ((c >= '0') && (c <= '9')) // Extract the count one digit at a time
-      {
-        theCount = theCount * 10;
-        theCount += (uint16_t)(c - '0');
-      }
-      responseStart++;
-      c = *responseStart; // Get the next digit of the count
-    }
+  return (true);
+}
 
-    if (c == ',') // If we hit a comma, this must be a different $MT message
-    {
-      *count = 0; // Set count to zero in case the user is not checking err
-      err = SWARM_M138_ERROR_INVALID_FORMAT;
-    }
-    else
-    {
-      *count = theCount;
-    }
+/**************************************************************************/
+/*!
+    @brief  Disable the RX batch and free its storage
+            Any pending intents are discarded. Call flushRxBatch first if required.
+*/
+/**************************************************************************/
+void SWARM_M138::disableRxBatch(void)
+{
+  if (_rxBatch != NULL)
+  {
+    swarm_m138_free(_rxBatch);
+    _rxBatch = NULL;
   }
-
-  swarm_m138_free_char(command);
-  swarm_m138_free_char(response);
-  return (err);
 }
 
 /**************************************************************************/
 /*!
-    @brief  Delete the TX message with the specified ID
+    @brief  Add a mark-as-read intent to the RX batch
+            If the batch is disabled, the message is marked immediately
     @param  msg_id
-            The ID of the message to be deleted
+            The ID of the message to be marked as read
     @return SWARM_M138_ERROR_SUCCESS if successful
             SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
             SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
             SWARM_M138_ERROR_ERROR if unsuccessful
 */
 /**************************************************************************/
-Swarm_M138_Error_e SWARM_M138::deleteTxMessage(uint64_t msg_id)
+Swarm_M138_Error_e SWARM_M138::queueMarkRxMessage(uint64_t msg_id)
 {
-  char *command;
-  char *response;
-  char *fwd;
-  char *rev;
-  Swarm_M138_Error_e err;
-
-  // Allocate memory for the command, asterix, checksum bytes, \n and \0
-  command = swarm_m138_alloc_char(strlen(SWARM_M138_COMMAND_MSG_TX_MGMT) + 3 + 20 + 5);
-  if (command == NULL)
-    return (SWARM_M138_ERROR_MEM_ALLOC);
-  memset(command, 0, strlen(SWARM_M138_COMMAND_MSG_TX_MGMT) + 3 + 20 + 5); // Clear it
-
-  // Allocate memory for the scratchpads
-  fwd = swarm_m138_alloc_char(21); // Up to 20 digits plus null
-  if (fwd == NULL)
-  {
-    swarm_m138_free_char(command);
-    return (SWARM_M138_ERROR_MEM_ALLOC);
-  }
-  memset(fwd, 0, 21); // Clear it
-  rev = swarm_m138_alloc_char(21); // Up to 20 digits plus null
-  if (rev == NULL)
-  {
-    swarm_m138_free_char(command);
-    swarm_m138_free_char(fwd);
-    return (SWARM_M138_ERROR_MEM_ALLOC);
-  }
-  memset(rev, 0, 21); // Clear it
-
-  sprintf(command, "%s D=", SWARM_M138_COMMAND_MSG_TX_MGMT); // Copy the command
-
-  // Add the 64-bit message ID
-  // Based on printLLNumber by robtillaart
-  // https://forum.arduino.cc/index.php?topic=143584.msg1519824#msg1519824
-  unsigned int i = 0;
-  if (msg_id == 0ULL) // if msg_id is zero, set fwd to "0"
-  {
-    fwd[0] = '0';
-  }
-  else
-  {
-    while (msg_id > 0)
-    {
-      rev[i++] = (msg_id % 10) + '0'; // divide by 10, convert the remainder to char
-      msg_id /= 10; // divide by 10
-    }
-    unsigned int j = 0;
-    while (i > 0)
-    {
-      fwd[j++] = rev[--i]; // reverse the order
-    }
-  }
-  strcat(command, fwd);
-
-  strcat(command, "*"); // Append the asterix
-
-  addChecksumLF(command); // Add the checksum bytes and line feed
+  SWARM_M138_ALLOC_ENTRY();
+  if (_rxBatch == NULL)
+    return (markRxMessage(msg_id));
 
-  response = swarm_m138_alloc_char(_RxBuffSize); // Allocate memory for the response
-  if (response == NULL)
-  {
-    swarm_m138_free_char(command);
-    swarm_m138_free_char(fwd);
-    swarm_m138_free_char(rev);
-    return(SWARM_M138_ERROR_MEM_ALLOC);
-  }
-  memset(response, 0, _RxBuffSize); // Clear it
+  return (rxBatchQueue(msg_id, SWARM_M138_RX_BATCH_MARK));
+}
 
-  err = sendCommandWithResponse(command, "$MT DELETED", "$MT ERR", response, _RxBuffSize, SWARM_M138_MESSAGE_DELETE_TIMEOUT);
+/**************************************************************************/
+/*!
+    @brief  Add a delete intent to the RX batch
+            If the batch is disabled, the message is deleted immediately
+    @param  msg_id
+            The ID of the message to be deleted
+    @param  read
+            Set this to true if the message has already been read (e.g. by
+            readMessage or drainRxMessages). Recorded with the intent. Deletes are
+            never collapsed into $MM D=R, so this does not change what is sent
+    @return SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_ERROR if unsuccessful
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::queueDeleteRxMessage(uint64_t msg_id, bool read)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  if (_rxBatch == NULL)
+    return (deleteRxMessage(msg_id));
 
-  swarm_m138_free_char(command);
-  swarm_m138_free_char(fwd);
-  swarm_m138_free_char(rev);
-  swarm_m138_free_char(response);
-  return (err);
+  return (rxBatchQueue(msg_id, read ? (SWARM_M138_RX_BATCH_DELETE | SWARM_M138_RX_BATCH_READ) : SWARM_M138_RX_BATCH_DELETE));
 }
 
 /**************************************************************************/
 /*!
-    @brief  Delete all unsent messages
-    @return SWARM_M138_ERROR_SUCCESS if successful
+    @brief  Send the pending RX batch intents to the modem
+            The individual $MM D= / $MM M= commands are sent back-to-back.
+            They are not collapsed into $MM D=* / D=R / M=*: the modem cannot list
+            its message IDs, so a stale ID, or a message which arrived after the
+            intents were queued, would be deleted or marked too.
+            A mark intent for a message which is also being deleted is skipped.
+            Messages which no longer exist (DBX_INVMSGID) are treated as done.
+    @return SWARM_M138_ERROR_SUCCESS if successful. The batch is then empty
             SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
             SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
             SWARM_M138_ERROR_ERROR if unsuccessful
+            The intents which were not completed remain in the batch
 */
 /**************************************************************************/
-Swarm_M138_Error_e SWARM_M138::deleteAllTxMessages(void)
+Swarm_M138_Error_e SWARM_M138::flushRxBatch(void)
 {
+  SWARM_M138_ALLOC_ENTRY();
   char *command;
   char *response;
-  char *scratchpad;
-  Swarm_M138_Error_e err;
-  uint16_t msgTotal = 0;
+  Swarm_M138_Error_e err = SWARM_M138_ERROR_SUCCESS;
 
-  err = getUnsentMessageCount(&msgTotal); // Get the message count so we know how many messages to expect
-  if (err != SWARM_M138_ERROR_SUCCESS)
-    return (err);
+  if ((_rxBatch == NULL) || (_rxBatch->count == 0))
+    return (SWARM_M138_ERROR_SUCCESS);
 
-  if (_printDebug == true)
-  {
-    _debugPort->print(F("deleteAllTxMessages: msgTotal is "));
-    _debugPort->println(msgTotal);
-  }
+  _rxBatch->lastFlush = millis();
 
-  // Allocate memory for the command, asterix, checksum bytes, \n and \0
-  command = swarm_m138_alloc_char(strlen(SWARM_M138_COMMAND_MSG_TX_MGMT) + 9);
+  // Send the individual commands back-to-back. They are never collapsed into $MM D=* / D=R / M=*:
+  // the modem cannot list its message IDs, so there is no way to know that the intents cover every message.
+  // A stale ID, or a $RD which arrived after the intents were queued, would be deleted or marked too
+  // Allocate memory for the command, " D=", up to 20 digits, asterix, checksum bytes, \n and \0
+  command = swarm_m138_alloc_char(strlen(SWARM_M138_COMMAND_MSG_RX_MGMT) + 3 + 20 + 5);
   if (command == NULL)
     return (SWARM_M138_ERROR_MEM_ALLOC);
-  memset(command, 0, strlen(SWARM_M138_COMMAND_MSG_TX_MGMT) + 9); // Clear it
-  sprintf(command, "%s D=U*", SWARM_M138_COMMAND_MSG_TX_MGMT); // Copy the command, add the asterix
-  addChecksumLF(command); // Add the checksum bytes and line feed
 
   response = swarm_m138_alloc_char(_RxBuffSize); // Allocate memory for the response
   if (response == NULL)
   {
     swarm_m138_free_char(command);
-    return(SWARM_M138_ERROR_MEM_ALLOC);
+    return (SWARM_M138_ERROR_MEM_ALLOC);
   }
-  memset(response, 0, _RxBuffSize); // Clear it
 
-  scratchpad = swarm_m138_alloc_char(16); // Create a scratchpad to hold the expectedResponse
-  if (scratchpad == NULL)
+  uint16_t done = 0;
+  while ((done < _rxBatch->count) && (err == SWARM_M138_ERROR_SUCCESS))
   {
-    swarm_m138_free_char(command);
-    swarm_m138_free_char(response);
-    return (SWARM_M138_ERROR_MEM_ALLOC);
+    bool del = (_rxBatch->entries[done].flags & SWARM_M138_RX_BATCH_DELETE) != 0;
+    err = rxBatchSendOne(_rxBatch->entries[done].msg_id, del, command, response);
+    if ((err == SWARM_M138_ERROR_ERR) && (strstr(commandError, "DBX_INVMSGID") != NULL))
+      err = SWARM_M138_ERROR_SUCCESS; // The message no longer exists. Nothing more to do
+    if (err == SWARM_M138_ERROR_SUCCESS)
+      done++;
   }
-  memset(scratchpad, 0, 16); // Clear it
-
-  sprintf(scratchpad, "$MT %d*", msgTotal); // Create the expected response
 
-  err = sendCommandWithResponse(command, scratchpad, "$MT ERR", response, _RxBuffSize, SWARM_M138_MESSAGE_DELETE_TIMEOUT);
+  // Remove the completed intents from the batch
+  for (uint16_t i = done; i < _rxBatch->count; i++)
+    _rxBatch->entries[i - done] = _rxBatch->entries[i];
+  _rxBatch->count -= done;
 
   swarm_m138_free_char(command);
   swarm_m138_free_char(response);
-  swarm_m138_free_char(scratchpad);
   return (err);
 }
 
 /**************************************************************************/
 /*!
-    @brief  List the unsent message with the specified ID
-    @param  msg_id
-            The ID of the message to be listed
-    @param  asciiHex
-            A pointer to a char array to hold the message
-    @param  len
-            The maximum message length which asciiHex can hold
-    @param  epoch
-            Optional: a pointer to a uint32_t to hold the epoch at which the modem received the message
+    @brief  Return the number of pending intents in the RX batch
+    @return The number of pending intents. Zero if the batch is disabled.
+*/
+/**************************************************************************/
+uint16_t SWARM_M138::getRxBatchCount(void)
+{
+  if (_rxBatch == NULL)
+    return (0);
+  return (_rxBatch->count);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Enable the duplicate filter for received messages
+            Each message is fingerprinted by appID, epoch and a hash of its payload.
+            A message whose fingerprint is already in the filter is suppressed:
+              $RD messages are not passed to the receive message callback
+              drainRxMessages does not pass the message to its callback
+            readMessage, readOldestMessage and readNewestMessage are not filtered: they
+            always return the message which was asked for.
+            The filter is a ring: the oldest fingerprint is overwritten when it is full.
+            $RD messages do not include the epoch. They are fingerprinted with epoch 0,
+            which only matches another $RD: an unknown epoch is not a wildcard. So a message
+            delivered as $RD and later read by drainRxMessages is passed to both callbacks.
+            Include a sequence number in messages which may legitimately repeat.
+            Each fingerprint uses sizeof(Swarm_M138_RX_Dedup_Entry_t) bytes of RAM.
+    @param  maxEntries
+            The number of fingerprints to remember
+    @param  storage
+            Optional: the fingerprints are appended to storage and reloaded by enableRxDedup,
+            so messages replayed after a reset (e.g. restartDevice(false)) are suppressed too.
+            The storage is rewritten when it holds SWARM_M138_RX_DEDUP_COMPACT_FACTOR * maxEntries fingerprints
+    @return True if the memory was allocated successfully, otherwise false
+*/
+/**************************************************************************/
+bool SWARM_M138::enableRxDedup(uint16_t maxEntries, SWARM_M138_Storage *storage)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  SWARM_M138_PAUSE_READER();
+  if (maxEntries == 0)
+    return (false);
+
+  disableRxDedup(); // Free any existing filter
+
+  Swarm_M138_RX_Dedup_t *dedup = (Swarm_M138_RX_Dedup_t *)swarm_m138_alloc(sizeof(Swarm_M138_RX_Dedup_t) + (sizeof(Swarm_M138_RX_Dedup_Entry_t) * maxEntries));
+  if (dedup == NULL)
+  {
+    if (_printDebug == true)
+      _debugPort->println(F("enableRxDedup: not enough memory for _rxDedup!"));
+    return (false);
+  }
+
+  dedup->entries = (Swarm_M138_RX_Dedup_Entry_t *)(dedup + 1);
+  dedup->size = maxEntries;
+  dedup->count = 0;
+  dedup->head = 0;
+  dedup->duplicates = 0;
+  dedup->storage = storage;
+  _rxDedup = dedup;
+
+  if (storage != NULL) // Reload the most recent fingerprints
+  {
+    uint32_t records = storage->size() / SWARM_M138_RX_DEDUP_RECORD_LEN;
+    uint32_t record = (records > maxEntries) ? records - maxEntries : 0;
+    uint8_t buf[SWARM_M138_RX_DEDUP_RECORD_LEN];
+
+    for (; record < records; record++)
+    {
+      if (!storage->read(record * SWARM_M138_RX_DEDUP_RECORD_LEN, buf, SWARM_M138_RX_DEDUP_RECORD_LEN))
+        break;
+
+      uint32_t hash = ((uint32_t)buf[0]) | (((uint32_t)buf[1]) << 8) | (((uint32_t)buf[2]) << 16) | (((uint32_t)buf[3]) << 24);
+      uint32_t epoch = ((uint32_t)buf[4]) | (((uint32_t)buf[5]) << 8) | (((uint32_t)buf[6]) << 16) | (((uint32_t)buf[7]) << 24);
+      rxDedupInsert(hash, epoch, false);
+    }
+
+    if (_printDebug == true)
+    {
+      _debugPort->print(F("enableRxDedup: reloaded "));
+      _debugPort->print(_rxDedup->count);
+      _debugPort->println(F(" fingerprints"));
+    }
+  }
+
+  return (true);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Disable the duplicate filter and free its memory. The storage is not cleared
+*/
+/**************************************************************************/
+void SWARM_M138::disableRxDedup(void)
+{
+  SWARM_M138_PAUSE_READER();
+  if (_rxDedup != NULL)
+  {
+    swarm_m138_free(_rxDedup);
+    _rxDedup = NULL;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief  Forget all fingerprints. The storage (if any) is cleared too
+    @return True if successful, false if the storage could not be cleared
+*/
+/**************************************************************************/
+bool SWARM_M138::clearRxDedup(void)
+{
+  if (_rxDedup == NULL)
+    return (true);
+
+  _rxDedup->count = 0;
+  _rxDedup->head = 0;
+
+  if (_rxDedup->storage != NULL)
+    return (_rxDedup->storage->clear());
+
+  return (true);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Check a received message against the duplicate filter
+            If the message has not been seen before, its fingerprint is added to the filter
     @param  appID
-            Optional: a pointer to a uint16_t to hold the message appID if there is one
-    @return SWARM_M138_ERROR_SUCCESS if successful
-            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
-            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
-            SWARM_M138_ERROR_ERROR if unsuccessful
+            The message appID. 0 if there is none
+    @param  epoch
+            The epoch at which the modem received the message. 0 if unknown
+    @param  data
+            A pointer to the binary payload
+    @param  len
+            The length of the payload
+    @return True if the message has been seen before. False if it is new (or the filter is disabled)
 */
 /**************************************************************************/
-Swarm_M138_Error_e SWARM_M138::listTxMessage(uint64_t msg_id, char *asciiHex, size_t len, uint32_t *epoch, uint16_t *appID)
+bool SWARM_M138::checkRxDuplicate(uint16_t appID, uint32_t epoch, const uint8_t *data, size_t len)
+{
+  if (_rxDedup == NULL)
+    return (false);
+
+  uint32_t hash = rxDedupHash(appID, data, len);
+
+  for (uint16_t i = 0; i < _rxDedup->count; i++)
+  {
+    Swarm_M138_RX_Dedup_Entry_t *entry = &_rxDedup->entries[i];
+    if ((entry->hash == hash) && (entry->epoch == epoch)) // 0 (unknown) only matches 0
+    {
+      _rxDedup->duplicates++;
+
+      if (_printDebug == true)
+        _debugPort->println(F("checkRxDuplicate: duplicate message suppressed"));
+
+      return (true);
+    }
+  }
+
+  rxDedupInsert(hash, epoch, true);
+
+  return (false);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Return the number of duplicate messages suppressed since enableRxDedup
+    @return The number of duplicates. Zero if the filter is disabled
+*/
+/**************************************************************************/
+uint32_t SWARM_M138::getRxDuplicateCount(void)
+{
+  if (_rxDedup == NULL)
+    return (0);
+  return (_rxDedup->duplicates);
+}
+
+Swarm_M138_Error_e SWARM_M138::readMessageInternal(const char mode, uint64_t msg_id_in, char *asciiHex, size_t len, uint64_t *msg_id_out, uint32_t *epoch, uint16_t *appID)
 {
   char *command;
   char *response;
@@ -3929,52 +4365,65 @@ Swarm_M138_Error_e SWARM_M138::listTxMessage(uint64_t msg_id, char *asciiHex, si
   memset(asciiHex, 0, len); // Clear the char array
 
   // Allocate memory for the command, asterix, checksum bytes, \n and \0
-  command = swarm_m138_alloc_char(strlen(SWARM_M138_COMMAND_MSG_TX_MGMT) + 3 + 20 + 5);
+  command = swarm_m138_alloc_char(strlen(SWARM_M138_COMMAND_MSG_RX_MGMT) + 3 + 20 + 5);
   if (command == NULL)
     return (SWARM_M138_ERROR_MEM_ALLOC);
-  memset(command, 0, strlen(SWARM_M138_COMMAND_MSG_TX_MGMT) + 3 + 20 + 5); // Clear it
-
-  // Allocate memory for the scratchpads
-  fwd = swarm_m138_alloc_char(21); // Up to 20 digits plus null
-  if (fwd == NULL)
-  {
-    swarm_m138_free_char(command);
-    return (SWARM_M138_ERROR_MEM_ALLOC);
-  }
-  memset(fwd, 0, 21); // Clear it
-  rev = swarm_m138_alloc_char(21); // Up to 20 digits plus null
-  if (rev == NULL)
-  {
-    swarm_m138_free_char(command);
-    swarm_m138_free_char(fwd);
-    return (SWARM_M138_ERROR_MEM_ALLOC);
-  }
-  memset(rev, 0, 21); // Clear it
-
-  sprintf(command, "%s L=", SWARM_M138_COMMAND_MSG_TX_MGMT); // Copy the command
+  memset(command, 0, strlen(SWARM_M138_COMMAND_MSG_RX_MGMT) + 3 + 20 + 5); // Clear it
 
-  // Add the 64-bit message ID
-  // Based on printLLNumber by robtillaart
-  // https://forum.arduino.cc/index.php?topic=143584.msg1519824#msg1519824
-  unsigned int i = 0;
-  if (msg_id == 0ULL) // if msg_id is zero, set fwd to "0"
-  {
-    fwd[0] = '0';
-  }
+  if (mode == 'L')
+    sprintf(command, "%s L=", SWARM_M138_COMMAND_MSG_RX_MGMT); // Copy the command
   else
+    sprintf(command, "%s R=", SWARM_M138_COMMAND_MSG_RX_MGMT); // Copy the command
+
+  if ((mode == 'L') || (mode == 'R')) // L=msgID or R=msgID
   {
-    while (msg_id > 0)
+    // Allocate memory for the scratchpads
+    fwd = swarm_m138_alloc_char(21); // Up to 20 digits plus null
+    if (fwd == NULL)
     {
-      rev[i++] = (msg_id % 10) + '0'; // divide by 10, convert the remainder to char
-      msg_id /= 10; // divide by 10
+      swarm_m138_free_char(command);
+      return (SWARM_M138_ERROR_MEM_ALLOC);
     }
-    unsigned int j = 0;
-    while (i > 0)
+    memset(fwd, 0, 21); // Clear it
+    rev = swarm_m138_alloc_char(21); // Up to 20 digits plus null
+    if (rev == NULL)
     {
-      fwd[j++] = rev[--i]; // reverse the order
+      swarm_m138_free_char(command);
+      swarm_m138_free_char(fwd);
+      return (SWARM_M138_ERROR_MEM_ALLOC);
+    }
+    memset(rev, 0, 21); // Clear it
+
+    // Add the 64-bit message ID
+    // Based on printLLNumber by robtillaart
+    // https://forum.arduino.cc/index.php?topic=143584.msg1519824#msg1519824
+    unsigned int i = 0;
+    if (msg_id_in == 0ULL) // if msg_id is zero, set fwd to "0"
+    {
+      fwd[0] = '0';
+    }
+    else
+    {
+      while (msg_id_in > 0)
+      {
+        rev[i++] = (msg_id_in % 10) + '0'; // divide by 10, convert the remainder to char
+        msg_id_in /= 10; // divide by 10
+      }
+      unsigned int j = 0;
+      while (i > 0)
+      {
+        fwd[j++] = rev[--i]; // reverse the order
+      }
     }
+    strcat(command, fwd);
+
+    swarm_m138_free_char(fwd);
+    swarm_m138_free_char(rev);
   }
-  strcat(command, fwd);
+  else if (mode == 'O') // R=O (Oldest)
+    strcat(command, "O");
+  else // if (mode == 'N') // R=N (Newest)
+    strcat(command, "N");
 
   strcat(command, "*"); // Append the asterix
 
@@ -3984,47 +4433,36 @@ Swarm_M138_Error_e SWARM_M138::listTxMessage(uint64_t msg_id, char *asciiHex, si
   if (response == NULL)
   {
     swarm_m138_free_char(command);
-    swarm_m138_free_char(fwd);
-    swarm_m138_free_char(rev);
     return(SWARM_M138_ERROR_MEM_ALLOC);
   }
   memset(response, 0, _RxBuffSize); // Clear it
 
-  err = sendCommandWithResponse(command, "$MT ", "$MT ERR", response, _RxBuffSize, SWARM_M138_MESSAGE_READ_TIMEOUT);
+  err = sendCommandWithResponse(command, "$MM AI=", "$MM ERR", response, _RxBuffSize, SWARM_M138_MESSAGE_READ_TIMEOUT);
 
   if (err == SWARM_M138_ERROR_SUCCESS)
   {
-    responseStart = strstr(response, "$MT "); // Find the start of the response
+    responseStart = strstr(response, "$MM AI="); // Find the start of the response
     if (responseStart != NULL)
     {
       responseEnd = strchr(responseStart, '*'); // Find the asterix
       if (responseEnd != NULL)
       {
-        responseStart = strstr(responseStart, " AI="); // Check if the message has AI= at the start
-        if (responseStart != NULL)
+        // Extract the appID if required
+        if (appID != NULL)
         {
-          // Extract the appID if required
-          if (appID != NULL)
+          int appID_i = 0;
+          int ret = sscanf(responseStart, "$MM AI=%d,", &appID_i);
+          if (ret == 1)
           {
-            int appID_i = 0;
-            int ret = sscanf(responseStart, " AI=%d,", &appID_i);
-            if (ret == 1)
-            {
-              *appID = (uint16_t)appID_i;
-            }
+            *appID = (uint16_t)appID_i;
           }
-
-          responseStart = strchr(responseStart, ','); // Find the first comma (we know it is there)
-          responseStart++; // Point to the first digit of the ASCII Hex
-        }
-        else // Message does not have AI= (Should be impossible with firmware >= v2)
-        {
-          responseStart = strstr(response, "$MT "); // Find the $MT again (we know it is there)
-          responseStart += 4; // Point to the first digit of the ASCII Hex
         }
+
+        responseStart = strchr(responseStart, ','); // Find the first comma (we know it is there)
         
         if (responseStart != NULL)
         {
+          responseStart++; // Point to the first digit of the ASCII Hex
           size_t charsRead = 0;
           char c = *responseStart;
           while ((c != ',') && (responseStart < responseEnd) && (charsRead < len)) // Stop at the next comma
@@ -4035,10 +4473,30 @@ Swarm_M138_Error_e SWARM_M138::listTxMessage(uint64_t msg_id, char *asciiHex, si
             c = *responseStart; // Get the next char
           }
 
-          if (epoch != NULL) // Check if epoch is NULL
+          if (msg_id_out != NULL) // Are we reading the oldest or newest message?
           {
-            responseStart++;
+            responseStart++; // Point to the first digit of the msg_id
+            uint64_t theID = 0;
+            char c = *responseStart;
+            while ((c != ',') && (responseStart < responseEnd))
+            {
+              // if (_printDebug == true)
+              //   _debugPort->write(c);
+              theID *= 10;
+              theID += (uint64_t)(c - '0');
+              responseStart++;
+              c = *responseStart;
+            }
+            *msg_id_out = theID; // Store the extracted ID
+          }
+          else
+          {
+            responseStart++; // Point to the first digit of the msg_id
             responseStart = strchr(responseStart, ','); // Find the next comma
+          }
+
+          if (epoch != NULL) // Check if epoch is NULL
+          {
             if (responseStart != NULL)
             {
               responseStart++; // Point to the first digit of the epoch
@@ -4057,7 +4515,7 @@ Swarm_M138_Error_e SWARM_M138::listTxMessage(uint64_t msg_id, char *asciiHex, si
           }
         }
         else
-          err = SWARM_M138_ERROR_INVALID_FORMAT;
+          err = SWARM_M138_ERROR_ERROR;
       }
       else
         err = SWARM_M138_ERROR_ERROR;
@@ -4067,1614 +4525,7255 @@ Swarm_M138_Error_e SWARM_M138::listTxMessage(uint64_t msg_id, char *asciiHex, si
   }
 
   swarm_m138_free_char(command);
-  swarm_m138_free_char(fwd);
-  swarm_m138_free_char(rev);
   swarm_m138_free_char(response);
   return (err);
 }
 
-// ** listTxMessagesIDs is not supported with modem firmware >= v2.0.0 **
-// 
-// /**************************************************************************/
-// /*!
-//     @brief  List the IDs of all the unsent messages
-//     @param  ids
-//             A pointer to an array of uint64_t to hold the message IDs.
-//             Call getUnsentMessageCount first so you know how many IDs to expect and allocate storage for them.
-//             Listing all the messages through the backlog could blow up the memory,
-//             so this function reads the returned text one byte at a time and extracts the IDs from that.
-//     @param  maxCount
-//             Stop after listing the IDs for this many messages
-//             Set this to the size of your uint64_t array
-//     @return SWARM_M138_ERROR_SUCCESS if successful
-//             SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
-//             SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
-//             SWARM_M138_ERROR_ERROR if unsuccessful
-// */
-// /**************************************************************************/
-// Swarm_M138_Error_e SWARM_M138::listTxMessagesIDs(uint64_t *ids, uint16_t maxCount)
-// {
-//   char *command;
-//   char *response;
-//   char *rxBuff;
-//   char *idStart;
-//   char *idEnd;
+/**************************************************************************/
+/*!
+    @brief  Return the count of all unsent messages
+    @param  count
+            A pointer to a uint16_t which will hold the message count
+    @return SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_ERROR if unsuccessful
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::getUnsentMessageCount(uint16_t *count)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  char *command;
+  char *response;
+  Swarm_M138_Error_e err;
+
+  // Allocate memory for the command, asterix, checksum bytes, \n and \0
+  command = swarm_m138_alloc_char(strlen(SWARM_M138_COMMAND_MSG_TX_MGMT) + 9);
+  if (command == NULL)
+    return (SWARM_M138_ERROR_MEM_ALLOC);
+  memset(command, 0, strlen(SWARM_M138_COMMAND_MSG_TX_MGMT) + 9); // Clear it
+  sprintf(command, "%s C=U*", SWARM_M138_COMMAND_MSG_TX_MGMT); // Copy the command, add the asterix
+  addChecksumLF(command); // Add the checksum bytes and line feed
+
+  response = swarm_m138_alloc_char(_RxBuffSize); // Allocate memory for the response
+  if (response == NULL)
+  {
+    swarm_m138_free_char(command);
+    return(SWARM_M138_ERROR_MEM_ALLOC);
+  }
+  memset(response, 0, _RxBuffSize); // Clear it
+
+  err = sendCommandWithResponse(command, "$MT ", "$MT ERR", response, _RxBuffSize, SWARM_M138_MESSAGE_READ_TIMEOUT);
+
+  if (err == SWARM_M138_ERROR_SUCCESS)
+    err = parseMessageCount(response, "$MT ", count);
+
+  swarm_m138_free_char(command);
+  swarm_m138_free_char(response);
+  return (err);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Delete the TX message with the specified ID
+    @param  msg_id
+            The ID of the message to be deleted
+    @return SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_ERROR if unsuccessful
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::deleteTxMessage(uint64_t msg_id)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  char *command;
+  char *response;
+  char *fwd;
+  char *rev;
+  Swarm_M138_Error_e err;
+
+  // Allocate memory for the command, asterix, checksum bytes, \n and \0
+  command = swarm_m138_alloc_char(strlen(SWARM_M138_COMMAND_MSG_TX_MGMT) + 3 + 20 + 5);
+  if (command == NULL)
+    return (SWARM_M138_ERROR_MEM_ALLOC);
+  memset(command, 0, strlen(SWARM_M138_COMMAND_MSG_TX_MGMT) + 3 + 20 + 5); // Clear it
+
+  // Allocate memory for the scratchpads
+  fwd = swarm_m138_alloc_char(21); // Up to 20 digits plus null
+  if (fwd == NULL)
+  {
+    swarm_m138_free_char(command);
+    return (SWARM_M138_ERROR_MEM_ALLOC);
+  }
+  memset(fwd, 0, 21); // Clear it
+  rev = swarm_m138_alloc_char(21); // Up to 20 digits plus null
+  if (rev == NULL)
+  {
+    swarm_m138_free_char(command);
+    swarm_m138_free_char(fwd);
+    return (SWARM_M138_ERROR_MEM_ALLOC);
+  }
+  memset(rev, 0, 21); // Clear it
+
+  sprintf(command, "%s D=", SWARM_M138_COMMAND_MSG_TX_MGMT); // Copy the command
+
+  uint64_t mirrorID = msg_id; // Keep a copy of the ID for the TX queue mirror. msg_id is consumed below
+
+  // Add the 64-bit message ID
+  // Based on printLLNumber by robtillaart
+  // https://forum.arduino.cc/index.php?topic=143584.msg1519824#msg1519824
+  unsigned int i = 0;
+  if (msg_id == 0ULL) // if msg_id is zero, set fwd to "0"
+  {
+    fwd[0] = '0';
+  }
+  else
+  {
+    while (msg_id > 0)
+    {
+      rev[i++] = (msg_id % 10) + '0'; // divide by 10, convert the remainder to char
+      msg_id /= 10; // divide by 10
+    }
+    unsigned int j = 0;
+    while (i > 0)
+    {
+      fwd[j++] = rev[--i]; // reverse the order
+    }
+  }
+  strcat(command, fwd);
+
+  strcat(command, "*"); // Append the asterix
+
+  addChecksumLF(command); // Add the checksum bytes and line feed
+
+  response = swarm_m138_alloc_char(_RxBuffSize); // Allocate memory for the response
+  if (response == NULL)
+  {
+    swarm_m138_free_char(command);
+    swarm_m138_free_char(fwd);
+    swarm_m138_free_char(rev);
+    return(SWARM_M138_ERROR_MEM_ALLOC);
+  }
+  memset(response, 0, _RxBuffSize); // Clear it
+
+  err = sendCommandWithResponse(command, "$MT DELETED", "$MT ERR", response, _RxBuffSize, SWARM_M138_MESSAGE_DELETE_TIMEOUT);
+
+  if (err == SWARM_M138_ERROR_SUCCESS)
+    txMirrorRemove(mirrorID, false); // Remove the message from the TX queue mirror (if enabled)
+
+  swarm_m138_free_char(command);
+  swarm_m138_free_char(fwd);
+  swarm_m138_free_char(rev);
+  swarm_m138_free_char(response);
+  return (err);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Delete all unsent messages
+    @return SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_ERROR if unsuccessful
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::deleteAllTxMessages(void)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  char *command;
+  char *response;
+  char *scratchpad;
+  Swarm_M138_Error_e err;
+  uint16_t msgTotal = 0;
+
+  err = getUnsentMessageCount(&msgTotal); // Get the message count so we know how many messages to expect
+  if (err != SWARM_M138_ERROR_SUCCESS)
+    return (err);
+
+  if (_printDebug == true)
+  {
+    _debugPort->print(F("deleteAllTxMessages: msgTotal is "));
+    _debugPort->println(msgTotal);
+  }
+
+  // Allocate memory for the command, asterix, checksum bytes, \n and \0
+  command = swarm_m138_alloc_char(strlen(SWARM_M138_COMMAND_MSG_TX_MGMT) + 9);
+  if (command == NULL)
+    return (SWARM_M138_ERROR_MEM_ALLOC);
+  memset(command, 0, strlen(SWARM_M138_COMMAND_MSG_TX_MGMT) + 9); // Clear it
+  sprintf(command, "%s D=U*", SWARM_M138_COMMAND_MSG_TX_MGMT); // Copy the command, add the asterix
+  addChecksumLF(command); // Add the checksum bytes and line feed
+
+  response = swarm_m138_alloc_char(_RxBuffSize); // Allocate memory for the response
+  if (response == NULL)
+  {
+    swarm_m138_free_char(command);
+    return(SWARM_M138_ERROR_MEM_ALLOC);
+  }
+  memset(response, 0, _RxBuffSize); // Clear it
+
+  scratchpad = swarm_m138_alloc_char(16); // Create a scratchpad to hold the expectedResponse
+  if (scratchpad == NULL)
+  {
+    swarm_m138_free_char(command);
+    swarm_m138_free_char(response);
+    return (SWARM_M138_ERROR_MEM_ALLOC);
+  }
+  memset(scratchpad, 0, 16); // Clear it
+
+  sprintf(scratchpad, "$MT %d*", msgTotal); // Create the expected response
+
+  err = sendCommandWithResponse(command, scratchpad, "$MT ERR", response, _RxBuffSize, SWARM_M138_MESSAGE_DELETE_TIMEOUT);
+
+  if ((err == SWARM_M138_ERROR_SUCCESS) && (_txMirror != NULL)) // The modem TX queue is now empty
+  {
+    _txMirror->count = 0;
+    _txMirror->untracked = 0;
+  }
+
+  swarm_m138_free_char(command);
+  swarm_m138_free_char(response);
+  swarm_m138_free_char(scratchpad);
+  return (err);
+}
+
+/**************************************************************************/
+/*!
+    @brief  List the unsent message with the specified ID
+    @param  msg_id
+            The ID of the message to be listed
+    @param  asciiHex
+            A pointer to a char array to hold the message
+    @param  len
+            The maximum message length which asciiHex can hold
+    @param  epoch
+            Optional: a pointer to a uint32_t to hold the epoch at which the modem received the message
+    @param  appID
+            Optional: a pointer to a uint16_t to hold the message appID if there is one
+    @return SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_ERROR if unsuccessful
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::listTxMessage(uint64_t msg_id, char *asciiHex, size_t len, uint32_t *epoch, uint16_t *appID)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  char *command;
+  char *response;
+  char *fwd;
+  char *rev;
+  char *responseStart;
+  char *responseEnd = NULL;
+  Swarm_M138_Error_e err;
+
+  memset(asciiHex, 0, len); // Clear the char array
+
+  // Allocate memory for the command, asterix, checksum bytes, \n and \0
+  command = swarm_m138_alloc_char(strlen(SWARM_M138_COMMAND_MSG_TX_MGMT) + 3 + 20 + 5);
+  if (command == NULL)
+    return (SWARM_M138_ERROR_MEM_ALLOC);
+  memset(command, 0, strlen(SWARM_M138_COMMAND_MSG_TX_MGMT) + 3 + 20 + 5); // Clear it
+
+  // Allocate memory for the scratchpads
+  fwd = swarm_m138_alloc_char(21); // Up to 20 digits plus null
+  if (fwd == NULL)
+  {
+    swarm_m138_free_char(command);
+    return (SWARM_M138_ERROR_MEM_ALLOC);
+  }
+  memset(fwd, 0, 21); // Clear it
+  rev = swarm_m138_alloc_char(21); // Up to 20 digits plus null
+  if (rev == NULL)
+  {
+    swarm_m138_free_char(command);
+    swarm_m138_free_char(fwd);
+    return (SWARM_M138_ERROR_MEM_ALLOC);
+  }
+  memset(rev, 0, 21); // Clear it
+
+  sprintf(command, "%s L=", SWARM_M138_COMMAND_MSG_TX_MGMT); // Copy the command
+
+  // Add the 64-bit message ID
+  // Based on printLLNumber by robtillaart
+  // https://forum.arduino.cc/index.php?topic=143584.msg1519824#msg1519824
+  unsigned int i = 0;
+  if (msg_id == 0ULL) // if msg_id is zero, set fwd to "0"
+  {
+    fwd[0] = '0';
+  }
+  else
+  {
+    while (msg_id > 0)
+    {
+      rev[i++] = (msg_id % 10) + '0'; // divide by 10, convert the remainder to char
+      msg_id /= 10; // divide by 10
+    }
+    unsigned int j = 0;
+    while (i > 0)
+    {
+      fwd[j++] = rev[--i]; // reverse the order
+    }
+  }
+  strcat(command, fwd);
+
+  strcat(command, "*"); // Append the asterix
+
+  addChecksumLF(command); // Add the checksum bytes and line feed
+
+  response = swarm_m138_alloc_char(_RxBuffSize); // Allocate memory for the response
+  if (response == NULL)
+  {
+    swarm_m138_free_char(command);
+    swarm_m138_free_char(fwd);
+    swarm_m138_free_char(rev);
+    return(SWARM_M138_ERROR_MEM_ALLOC);
+  }
+  memset(response, 0, _RxBuffSize); // Clear it
+
+  err = sendCommandWithResponse(command, "$MT ", "$MT ERR", response, _RxBuffSize, SWARM_M138_MESSAGE_READ_TIMEOUT);
+
+  if (err == SWARM_M138_ERROR_SUCCESS)
+  {
+    responseStart = strstr(response, "$MT "); // Find the start of the response
+    if (responseStart != NULL)
+    {
+      responseEnd = strchr(responseStart, '*'); // Find the asterix
+      if (responseEnd != NULL)
+      {
+        responseStart = strstr(responseStart, " AI="); // Check if the message has AI= at the start
+        if (responseStart != NULL)
+        {
+          // Extract the appID if required
+          if (appID != NULL)
+          {
+            int appID_i = 0;
+            int ret = sscanf(responseStart, " AI=%d,", &appID_i);
+            if (ret == 1)
+            {
+              *appID = (uint16_t)appID_i;
+            }
+          }
+
+          responseStart = strchr(responseStart, ','); // Find the first comma (we know it is there)
+          responseStart++; // Point to the first digit of the ASCII Hex
+        }
+        else // Message does not have AI= (Should be impossible with firmware >= v2)
+        {
+          responseStart = strstr(response, "$MT "); // Find the $MT again (we know it is there)
+          responseStart += 4; // Point to the first digit of the ASCII Hex
+        }
+        
+        if (responseStart != NULL)
+        {
+          size_t charsRead = 0;
+          char c = *responseStart;
+          while ((c != ',') && (responseStart < responseEnd) && (charsRead < len)) // Stop at the next comma
+          {
+            asciiHex[charsRead] = c; // Copy the char into asciiHex
+            responseStart++; // Increment the pointer
+            charsRead++; // Increment the counter
+            c = *responseStart; // Get the next char
+          }
+
+          if (epoch != NULL) // Check if epoch is NULL
+          {
+            responseStart++;
+            responseStart = strchr(responseStart, ','); // Find the next comma
+            if (responseStart != NULL)
+            {
+              responseStart++; // Point to the first digit of the epoch
+              uint32_t theEpoch = 0;
+              char c = *responseStart;
+              while ((c != '*') && (responseStart < responseEnd)) // Stop at the asterix
+              {
+                theEpoch *= 10;
+                theEpoch += (uint32_t)(c - '0');
+                responseStart++;
+                c = *responseStart;
+              }
+
+              *epoch = theEpoch;
+            }
+          }
+        }
+        else
+          err = SWARM_M138_ERROR_INVALID_FORMAT;
+      }
+      else
+        err = SWARM_M138_ERROR_ERROR;
+    }
+    else
+      err = SWARM_M138_ERROR_ERROR;
+  }
+
+  swarm_m138_free_char(command);
+  swarm_m138_free_char(fwd);
+  swarm_m138_free_char(rev);
+  swarm_m138_free_char(response);
+  return (err);
+}
+
+// ** listTxMessagesIDs is not supported with modem firmware >= v2.0.0 **
+// 
+// /**************************************************************************/
+// /*!
+//     @brief  List the IDs of all the unsent messages
+//     @param  ids
+//             A pointer to an array of uint64_t to hold the message IDs.
+//             Call getUnsentMessageCount first so you know how many IDs to expect and allocate storage for them.
+//             Listing all the messages through the backlog could blow up the memory,
+//             so this function reads the returned text one byte at a time and extracts the IDs from that.
+//     @param  maxCount
+//             Stop after listing the IDs for this many messages
+//             Set this to the size of your uint64_t array
+//     @return SWARM_M138_ERROR_SUCCESS if successful
+//             SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
+//             SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+//             SWARM_M138_ERROR_ERROR if unsuccessful
+// */
+// /**************************************************************************/
+// Swarm_M138_Error_e SWARM_M138::listTxMessagesIDs(uint64_t *ids, uint16_t maxCount)
+// {
+//   char *command;
+//   char *response;
+//   char *rxBuff;
+//   char *idStart;
+//   char *idEnd;
 //   Swarm_M138_Error_e err;
 //   uint16_t msgTotal = 0, msgCount = 0;
 
-//   if (maxCount == 0) // Quit if maxCount is zero. It must be at least one.
-//     return (SWARM_M138_ERROR_ERROR);
+//   if (maxCount == 0) // Quit if maxCount is zero. It must be at least one.
+//     return (SWARM_M138_ERROR_ERROR);
+
+//   // Calculate the "size of" each element in the array of uint64_t
+//   // Note: sizeof(uint64_t) doesn't seem to give the correct result?
+//   uint64_t test[2];
+//   size_t sizeOfUint64Array = &test[1] - &test[0];
+
+//   if (_printDebug == true)
+//   {
+//     _debugPort->print(F("listTxMessagesIDs: sizeOfUint64Array is "));
+//     _debugPort->println(sizeOfUint64Array);
+//   }
+
+//   err = getUnsentMessageCount(&msgTotal); // Get the message count so we know how many messages to expect
+//   if (err != SWARM_M138_ERROR_SUCCESS)
+//     return (err);
+
+//   if (_printDebug == true)
+//   {
+//     _debugPort->print(F("listTxMessagesIDs: msgTotal is "));
+//     _debugPort->println(msgTotal);
+//   }
+
+//   if (msgTotal == 0) // Quit if there are no messages in the buffer
+//     return (SWARM_M138_ERROR_ERROR);
+
+//   // Allocate memory for the response
+//   response = swarm_m138_alloc_char(_RxBuffSize);
+//   if (response == NULL)
+//   {
+//     return(SWARM_M138_ERROR_MEM_ALLOC);
+//   }
+//   memset(response, 0, _RxBuffSize); // Clear it
+
+//   // Allocate memory for the command, asterix, checksum bytes, \n and \0
+//   command = swarm_m138_alloc_char(strlen(SWARM_M138_COMMAND_MSG_TX_MGMT) + 9);
+//   if (command == NULL)
+//   {
+//     swarm_m138_free_char(response);
+//     return (SWARM_M138_ERROR_MEM_ALLOC);
+//   }
+//   memset(command, 0, strlen(SWARM_M138_COMMAND_MSG_TX_MGMT) + 9); // Clear it
+//   sprintf(command, "%s L=U*", SWARM_M138_COMMAND_MSG_TX_MGMT); // Copy the command, add the asterix
+//   addChecksumLF(command); // Add the checksum bytes and line feed
+
+//   // if (_printDebug == true)
+//   // {
+//   //   _debugPort->println(F("listTxMessagesIDs: ====>"));
+//   //   _debugPort->flush();
+//   // }
+
+//   sendCommand(command); // Send the command
+
+//   swarm_m138_free_char(command); // Free command now - we are done with it
+
+//   unsigned long startTime = millis();
+//   bool keepGoing = true;
+
+//   // Keep checking incoming chars for up to SWARM_M138_MESSAGE_ID_TIMEOUT secs total
+//   while ((millis() < (startTime + SWARM_M138_MESSAGE_ID_TIMEOUT)) && keepGoing)
+//   {
+//     int hwAvail = hwAvailable();
+
+//     if (hwAvail > 0) //hwAvailable can return -1 if the serial port is NULL
+//     {
+//       rxBuff = swarm_m138_alloc_char((size_t)(hwAvail + 1)); // Allocate memory to hold the data
+//       if (rxBuff != NULL)
+//       {
+//         memset(rxBuff, 0, (size_t)(hwAvail + 1)); // Clear it
+//         int charsRead = hwReadChars(rxBuff, hwAvail); // Read the characters
+
+//         // if (_printDebug == true)
+//         //   _debugPort->print(rxBuff);
+
+//         for (int i = 0; i < charsRead; i++) // Go through a character at a time
+//         {
+//           char cc[2];
+//           cc[0] = rxBuff[i];
+//           cc[1] = 0;
+//           if (strlen(response) < _RxBuffSize) // Check if response is full
+//           {
+//             strcat(response, cc); // Copy a single character into response
+//             if (cc[0] == '\n') // Check if this is a newline
+//             {
+//               idStart = strstr(response, "$MT "); // Check for $MT
+//               if (idStart != NULL)
+//               {
+//                 idStart = strstr(idStart, " AI="); // Check if the message has AI= at the start
+//                 if (idStart != NULL)
+//                 {
+//                   idStart = strchr(idStart, ','); // Find the first comma
+//                   if (idStart != NULL)
+//                   {
+//                     idStart++;
+//                     idStart = strchr(idStart, ','); // Find the second comma
+//                   }
+//                 }
+//                 else // Message does not have AI=
+//                 {
+//                   idStart = strstr(response, "$MT "); // Find the $MT again
+//                   if (idStart != NULL)
+//                   {
+//                     idStart = strchr(idStart, ','); // Find the first comma
+//                   }
+//                 }
+                
+//                 if (idStart != NULL)
+//                 {
+//                   idStart++; // Point to the first digit of the message ID
+//                   idEnd = strchr(idStart, ','); // Find the second/third comma
+//                   if (idEnd != NULL)
+//                   {
+//                     // We have (hopefully) a valid ID to extract
+//                     uint64_t theID = 0;
+//                     char c = *idStart;
+//                     while ((c != ',') && (idStart < idEnd))
+//                     {
+//                       // if (_printDebug == true)
+//                       //   _debugPort->write(c);
+//                       theID *= 10;
+//                       theID += (uint64_t)(c - '0');
+//                       idStart++;
+//                       c = *idStart;
+//                     }
+//                     *(ids + (sizeOfUint64Array * (size_t)msgCount)) = theID; // Store the extracted ID
+//                     msgCount++; // Increment the count
+//                     if (_printDebug == true)
+//                     {
+//                       _debugPort->println();
+//                       _debugPort->print(F("listTxMessagesIDs: msgCount is "));
+//                       _debugPort->println(msgCount);
+//                     }
+//                     if ((msgCount == msgTotal) || (msgCount == maxCount))
+//                       keepGoing = false; // Stop if we have reached msgTotal or maxCount
+//                   }
+//                 }
+//               }
+//               else
+//               {
+//                 // We got a \n but failed to find $MT.
+//                 // So, let's be nice and copy whatever this message is into the backlog if possible
+//                 size_t backlogLength = strlen((const char *)_swarmBacklog);
+//                 size_t msgLen = strlen((const char *)response);
+//                 if ((backlogLength + msgLen) < _RxBuffSize)
+//                 {
+//                   memcpy(&_swarmBacklog[backlogLength], response, msgLen);
+//                 }
+//               }
+//               memset(response, 0, _RxBuffSize); // Clear the response
+//             }
+//           }
+//           else // Response is full... We are stuck... And we are still in the for loop...
+//           {
+//             swarm_m138_free_char(rxBuff);
+//             swarm_m138_free_char(response);
+//             return (SWARM_M138_ERROR_ERROR);
+//           }
+//         }
+//         swarm_m138_free_char(rxBuff); // Free the buffer
+//       }
+//       else // The memory allocation failed
+//       {
+//         err = SWARM_M138_ERROR_MEM_ALLOC;
+//         keepGoing = false;
+//       }
+//     }
+//     else
+//       delay(1);
+//   }
+
+//   swarm_m138_free_char(response);
+
+//   // if (_printDebug == true)
+//   // {
+//   //   _debugPort->println(F("listTxMessagesIDs: <===="));
+//   //   _debugPort->flush();
+//   // }
+
+//   return (err);
+// }
+
+/**************************************************************************/
+/*!
+    @brief  Enable the TX queue mirror: a local shadow of the modem's transmit queue
+            Messages are added when the modem accepts them ($TD OK) and removed when
+            they are sent ($TD SENT) or deleted (deleteTxMessage / deleteAllTxMessages).
+            $TD SENT messages are processed by checkUnsolicitedMsg, so call it regularly.
+            Any unsent messages already in the modem are counted (but not tracked) by
+            calling syncTxQueueMirror.
+    @param  maxEntries
+            The maximum number of message IDs the mirror can hold.
+            Each entry uses sizeof(Swarm_M138_TX_Mirror_Entry_t) bytes of RAM.
+    @return True if the storage was allocated successfully, otherwise false
+*/
+/**************************************************************************/
+bool SWARM_M138::enableTxQueueMirror(uint16_t maxEntries)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  SWARM_M138_PAUSE_READER();
+  if (maxEntries == 0)
+    return (false);
+
+  disableTxQueueMirror(); // Free any existing mirror
+
+  Swarm_M138_TX_Mirror_t *mirror = (Swarm_M138_TX_Mirror_t *)swarm_m138_alloc(sizeof(Swarm_M138_TX_Mirror_t) + (sizeof(Swarm_M138_TX_Mirror_Entry_t) * maxEntries));
+  if (mirror == NULL)
+  {
+    if (_printDebug == true)
+      _debugPort->println(F("enableTxQueueMirror: not enough memory for _txMirror!"));
+    return (false);
+  }
+
+  memset(mirror, 0, sizeof(Swarm_M138_TX_Mirror_t));
+  mirror->entries = (Swarm_M138_TX_Mirror_Entry_t *)(mirror + 1);
+  mirror->size = maxEntries;
+  _txMirror = mirror;
+
+  return (true);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Disable the TX queue mirror and free its storage
+*/
+/**************************************************************************/
+void SWARM_M138::disableTxQueueMirror(void)
+{
+  SWARM_M138_PAUSE_READER();
+  if (_txMirror != NULL)
+  {
+    swarm_m138_free(_txMirror);
+    _txMirror = NULL;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief  Return the number of unsent messages in the modem's transmit queue
+            using the TX queue mirror. Does not communicate with the modem.
+    @return The number of tracked messages plus any untracked messages
+            seen by syncTxQueueMirror. Zero if the mirror is disabled.
+*/
+/**************************************************************************/
+uint16_t SWARM_M138::getTxQueueDepth(void)
+{
+  if (_txMirror == NULL)
+    return (0);
+  return (_txMirror->count + _txMirror->untracked);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Copy the IDs of the messages in the TX queue mirror into an array
+    @param  ids
+            A pointer to an array of uint64_t to hold the message IDs.
+            The IDs are copied oldest first.
+    @param  maxCount
+            The size of the ids array
+    @return The number of IDs copied into ids
+*/
+/**************************************************************************/
+uint16_t SWARM_M138::getTxQueueMirrorIDs(uint64_t *ids, uint16_t maxCount)
+{
+  uint16_t i = 0;
+
+  if ((_txMirror == NULL) || (ids == NULL))
+    return (0);
+
+  for (; (i < _txMirror->count) && (i < maxCount); i++)
+    ids[i] = _txMirror->entries[i].msg_id;
+
+  return (i);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Check if a message is in the TX queue mirror
+    @param  msg_id
+            The message ID
+    @return True if the message has been queued but not yet sent or deleted
+*/
+/**************************************************************************/
+bool SWARM_M138::isTxMessagePending(uint64_t msg_id)
+{
+  if (_txMirror == NULL)
+    return (false);
+
+  for (uint16_t i = 0; i < _txMirror->count; i++)
+  {
+    if (_txMirror->entries[i].msg_id == msg_id)
+      return (true);
+  }
+
+  return (false);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Resynchronise the TX queue mirror with the modem.
+            The unsent message count is read using $MT C=U. If it matches the mirror,
+            nothing more needs to be done. Otherwise each tracked message is listed
+            ($MT L=msg_id) and any which the modem no longer holds are removed.
+            Any remaining difference is recorded as untracked messages.
+    @return SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_ERROR if unsuccessful (or the mirror is disabled)
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::syncTxQueueMirror(void)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  Swarm_M138_Error_e err;
+  uint16_t msgTotal = 0;
+
+  if (_txMirror == NULL)
+    return (SWARM_M138_ERROR_ERROR);
+
+  err = getUnsentMessageCount(&msgTotal);
+  if (err != SWARM_M138_ERROR_SUCCESS)
+    return (err);
+
+  if (msgTotal == 0) // Quick exit if the modem queue is empty
+  {
+    _txMirror->count = 0;
+    _txMirror->untracked = 0;
+    return (err);
+  }
+
+  if (msgTotal != getTxQueueDepth()) // Check each tracked message is still in the modem
+  {
+    char *asciiHex = swarm_m138_alloc_char(SWARM_M138_MAX_PACKET_LENGTH_HEX + 1); // Scratchpad for listTxMessage
+    if (asciiHex == NULL)
+      return (SWARM_M138_ERROR_MEM_ALLOC);
+
+    uint16_t i = 0;
+    while ((i < _txMirror->count) && (err == SWARM_M138_ERROR_SUCCESS))
+    {
+      Swarm_M138_Error_e listErr = listTxMessage(_txMirror->entries[i].msg_id, asciiHex, SWARM_M138_MAX_PACKET_LENGTH_HEX + 1);
+      if ((listErr == SWARM_M138_ERROR_ERR) && (strstr(commandError, "DBX_INVMSGID") != NULL))
+        txMirrorRemove(_txMirror->entries[i].msg_id, false); // The message has gone. Don't increment i
+      else if (listErr == SWARM_M138_ERROR_SUCCESS)
+        i++;
+      else
+        err = listErr;
+    }
+
+    swarm_m138_free_char(asciiHex);
+
+    if (err != SWARM_M138_ERROR_SUCCESS)
+      return (err);
+  }
+
+  _txMirror->untracked = (msgTotal > _txMirror->count) ? msgTotal - _txMirror->count : 0;
+
+  if (_printDebug == true)
+  {
+    _debugPort->print(F("syncTxQueueMirror: tracked "));
+    _debugPort->print(_txMirror->count);
+    _debugPort->print(F(" untracked "));
+    _debugPort->println(_txMirror->untracked);
+  }
+
+  return (err);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Get the enqueue-to-sent latency of the messages tracked by the TX queue mirror
+    @param  latency
+            A pointer to a Swarm_M138_TX_Latency_t struct which will hold the result.
+            All zero if the mirror is disabled
+*/
+/**************************************************************************/
+void SWARM_M138::getTxQueueLatency(Swarm_M138_TX_Latency_t *latency)
+{
+  if (_txMirror == NULL)
+  {
+    memset(latency, 0, sizeof(Swarm_M138_TX_Latency_t));
+    return;
+  }
+  latency->sent = _txMirror->latencySent;
+  latency->last = _txMirror->latencyLast;
+  latency->minimum = _txMirror->latencyMin;
+  latency->maximum = _txMirror->latencyMax;
+  latency->mean = (_txMirror->latencySent > 0) ? (unsigned long)(_txMirror->latencyTotal / _txMirror->latencySent) : 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Queue a printable text message for transmission
+    @param  data
+            The message as printable ASCII characters (0x20 to 0x7E, space to ~)
+    @param  msg_id
+            A pointer to a uint64_t which will hold the assigned message ID
+    @return SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_ERROR if unsuccessful
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::transmitText(const char *data, uint64_t *msg_id)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  return (transmitText(data, msg_id, false, 0, false, 0, false, 0));
+}
+
+/**************************************************************************/
+/*!
+    @brief  Queue a printable text message for transmission with an appID
+    @param  data
+            The message as printable ASCII characters (0x20 to 0x7E, space to ~)
+    @param  msg_id
+            A pointer to a uint64_t which will hold the assigned message ID
+    @param  appID
+            The application ID: 0 to 64999
+    @return SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_ERROR if unsuccessful
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::transmitText(const char *data, uint64_t *msg_id, uint16_t appID)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  return (transmitText(data, msg_id, true, appID, false, 0, false, 0));
+}
+
+/**************************************************************************/
+/*!
+    @brief  Queue a printable text message for transmission with a hold duration
+    @param  data
+            The message as printable ASCII characters (0x20 to 0x7E, space to ~)
+    @param  msg_id
+            A pointer to a uint64_t which will hold the assigned message ID
+    @param  hold
+            The hold duration in seconds: 60 to 34819200 (13 months)
+            The message expires if it has not been transmitted within the hold duration
+            The default hold duration is 172800 seconds (48 hours)
+    @return SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_ERROR if unsuccessful
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::transmitTextHold(const char *data, uint64_t *msg_id, uint32_t hold)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  return (transmitText(data, msg_id, false, 0, true, hold, false, 0));
+}
+
+/**************************************************************************/
+/*!
+    @brief  Queue a printable text message for transmission with a hold duration and an appID
+    @param  data
+            The message as printable ASCII characters (0x20 to 0x7E, space to ~)
+    @param  msg_id
+            A pointer to a uint64_t which will hold the assigned message ID
+    @param  hold
+            The hold duration in seconds: 60 to 34819200 (13 months)
+            The message expires if it has not been transmitted within the hold duration
+            The default hold duration is 172800 seconds (48 hours)
+    @param  appID
+            The application ID: 0 to 64999
+    @return SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_ERROR if unsuccessful
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::transmitTextHold(const char *data, uint64_t *msg_id, uint32_t hold, uint16_t appID)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  return (transmitText(data, msg_id, true, appID, true, hold, false, 0));
+}
+
+/**************************************************************************/
+/*!
+    @brief  Queue a printable text message for transmission with an expiry time (epoch)
+    @param  data
+            The message as printable ASCII characters (0x20 to 0x7E, space to ~)
+    @param  msg_id
+            A pointer to a uint64_t which will hold the assigned message ID
+    @param  epoch
+            The second date after which the message will be expired if it has not been sent.
+            1577836800 to 2147483647
+            (2020-01-01 00:00:00 to 2038-01-19 03:14:07)
+    @return SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_ERROR if unsuccessful
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::transmitTextExpire(const char *data, uint64_t *msg_id, uint32_t epoch)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  return (transmitText(data, msg_id, false, 0, false, 0, true, epoch));
+}
+
+/**************************************************************************/
+/*!
+    @brief  Queue a printable text message for transmission with an expiry time (epoch) and an appID
+    @param  data
+            The message as printable ASCII characters (0x20 to 0x7E, space to ~)
+    @param  msg_id
+            A pointer to a uint64_t which will hold the assigned message ID
+    @param  epoch
+            The second date after which the message will be expired if it has not been sent.
+            1577836800 to 2147483647
+            (2020-01-01 00:00:00 to 2038-01-19 03:14:07)
+    @param  appID
+            The application ID: 0 to 64999
+    @return SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_ERROR if unsuccessful
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::transmitTextExpire(const char *data, uint64_t *msg_id, uint32_t epoch, uint16_t appID)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  return (transmitText(data, msg_id, true, appID, false, 0, true, epoch));
+}
+
+// Queue a text message for transmission
+// Return the allocated message ID in msg_id
+Swarm_M138_Error_e SWARM_M138::transmitText(const char *data, uint64_t *msg_id, bool useAppID, uint16_t appID,
+                                            bool useHold, uint32_t hold, bool useEpoch, uint32_t epoch)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  char *command;
+  char *response;
+  char *scratchpad;
+  Swarm_M138_Error_e err;
+
+  // Calculate the possible message length
+  size_t msgLen = strlen(SWARM_M138_COMMAND_TX_DATA); // $TD
+  msgLen += 1; // Space
+  if (useAppID) msgLen += 3 + 5 + 1; // AI=65535,
+  if (useHold) msgLen += 3 + 8 + 1; // HD=34819200,
+  if (useEpoch) msgLen += 3 + 10 + 1; // ET=2147483647,
+  msgLen += 2 + strlen(data); // Quotes plus the message itself
+  msgLen += 5; // asterix, checksum chars, line feed, null
+
+  // Allocate memory for the command, message, asterix, checksum bytes, \n and \0
+  command = swarm_m138_alloc_char(msgLen);
+  if (command == NULL)
+    return (SWARM_M138_ERROR_MEM_ALLOC);
+  memset(command, 0, msgLen); // Clear it
+
+  // Allocate memory for the scratchpad
+  scratchpad = swarm_m138_alloc_char(16);
+  if (scratchpad == NULL)
+  {
+    swarm_m138_free_char(command);
+    return (SWARM_M138_ERROR_MEM_ALLOC);
+  }
+  memset(scratchpad, 0, 16); // Clear it
+
+  sprintf(command, "%s ", SWARM_M138_COMMAND_TX_DATA); // Copy the command. Append the space
+  if (useAppID)
+  {
+    strcat(command, "AI=");
+    sprintf(scratchpad, "%d", appID);
+    strcat(command, scratchpad);
+    strcat(command, ",");
+  }
+  if (useHold)
+  {
+    strcat(command, "HD=");
+#if defined(ARDUINO_ARCH_ESP32) || defined(ARDUINO_ARCH_ESP8266)
+    sprintf(scratchpad, "%d", hold);
+#else
+    sprintf(scratchpad, "%lu", (unsigned long)hold);
+#endif
+    strcat(command, scratchpad);
+    strcat(command, ",");
+  }
+  if (useEpoch)
+  {
+    strcat(command, "ET=");
+#if defined(ARDUINO_ARCH_ESP32) || defined(ARDUINO_ARCH_ESP8266)
+    sprintf(scratchpad, "%d", epoch);
+#else
+    sprintf(scratchpad, "%lu", (unsigned long)epoch);
+#endif
+    strcat(command, scratchpad);
+    strcat(command, ",");
+  }
+  strcat(command, "\""); // Append the quote  
+  strcat(command, data); // Append the message
+  strcat(command, "\"*"); // Append the quote and asterix
+  addChecksumLF(command); // Add the checksum bytes and line feed
+
+  response = swarm_m138_alloc_char(_RxBuffSize); // Allocate memory for the response
+  if (response == NULL)
+  {
+    swarm_m138_free_char(command);
+    swarm_m138_free_char(scratchpad);
+    return(SWARM_M138_ERROR_MEM_ALLOC);
+  }
+  memset(response, 0, _RxBuffSize); // Clear it
+
+  err = sendCommandWithResponse(command, "$TD OK,", "$TD ERR", response, _RxBuffSize, SWARM_M138_MESSAGE_TRANSMIT_TIMEOUT);
+
+  if (err == SWARM_M138_ERROR_SUCCESS) // Check if we got $TD OK
+    err = parseTransmitResponse(response, msg_id);
+
+  swarm_m138_free_char(command);
+  swarm_m138_free_char(scratchpad);
+  swarm_m138_free_char(response);
+  return (err);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Queue a binary message for transmission
+    @param  data
+            The binary message
+    @param  len
+            The length of the binary message in bytes
+    @param  msg_id
+            A pointer to a uint64_t which will hold the assigned message ID
+    @return SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_ERROR if unsuccessful
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::transmitBinary(const uint8_t *data, size_t len, uint64_t *msg_id)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  return (transmitBinary(data, len, msg_id, false, 0, false, 0, false, 0));
+}
+
+/**************************************************************************/
+/*!
+    @brief  Queue a binary message for transmission with an appID
+    @param  data
+            The binary message
+    @param  len
+            The length of the binary message in bytes
+    @param  msg_id
+            A pointer to a uint64_t which will hold the assigned message ID
+    @param  appID
+            The application ID: 0 to 64999
+    @return SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_ERROR if unsuccessful
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::transmitBinary(const uint8_t *data, size_t len, uint64_t *msg_id, uint16_t appID)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  return (transmitBinary(data, len, msg_id, true, appID, false, 0, false, 0));
+}
+
+/**************************************************************************/
+/*!
+    @brief  Queue a binary message for transmission with a hold duration
+    @param  data
+            The binary message
+    @param  len
+            The length of the binary message in bytes
+    @param  msg_id
+            A pointer to a uint64_t which will hold the assigned message ID
+    @param  hold
+            The hold duration in seconds: 60 to 34819200 (13 months)
+            The message expires if it has not been transmitted within the hold duration
+            The default hold duration is 172800 seconds (48 hours)
+    @return SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_ERROR if unsuccessful
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::transmitBinaryHold(const uint8_t *data, size_t len, uint64_t *msg_id, uint32_t hold)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  return (transmitBinary(data, len, msg_id, false, 0, true, hold, false, 0));
+}
+
+/**************************************************************************/
+/*!
+    @brief  Queue a binary message for transmission with a hold duration and an appID
+    @param  data
+            The binary message
+    @param  len
+            The length of the binary message in bytes
+    @param  msg_id
+            A pointer to a uint64_t which will hold the assigned message ID
+    @param  hold
+            The hold duration in seconds: 60 to 34819200 (13 months)
+            The message expires if it has not been transmitted within the hold duration
+            The default hold duration is 172800 seconds (48 hours)
+    @param  appID
+            The application ID: 0 to 64999
+    @return SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_ERROR if unsuccessful
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::transmitBinaryHold(const uint8_t *data, size_t len, uint64_t *msg_id, uint32_t hold, uint16_t appID)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  return (transmitBinary(data, len, msg_id, true, appID, true, hold, false, 0));
+}
+
+/**************************************************************************/
+/*!
+    @brief  Queue a binary message for transmission with an expiry time (epoch)
+    @param  data
+            The binary message
+    @param  len
+            The length of the binary message in bytes
+    @param  msg_id
+            A pointer to a uint64_t which will hold the assigned message ID
+    @param  epoch
+            The second date after which the message will be expired if it has not been sent.
+            1577836800 to 2147483647
+            (2020-01-01 00:00:00 to 2038-01-19 03:14:07)
+    @return SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_ERROR if unsuccessful
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::transmitBinaryExpire(const uint8_t *data, size_t len, uint64_t *msg_id, uint32_t epoch)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  return (transmitBinary(data, len, msg_id, false, 0, false, 0, true, epoch));
+}
+
+/**************************************************************************/
+/*!
+    @brief  Queue a binary message for transmission with an expiry time (epoch) and an appID
+    @param  data
+            The binary message
+    @param  len
+            The length of the binary message in bytes
+    @param  msg_id
+            A pointer to a uint64_t which will hold the assigned message ID
+    @param  epoch
+            The second date after which the message will be expired if it has not been sent.
+            1577836800 to 2147483647
+            (2020-01-01 00:00:00 to 2038-01-19 03:14:07)
+    @param  appID
+            The application ID: 0 to 64999
+    @return SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_ERROR if unsuccessful
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::transmitBinaryExpire(const uint8_t *data, size_t len, uint64_t *msg_id, uint32_t epoch, uint16_t appID)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  return (transmitBinary(data, len, msg_id, true, appID, false, 0, true, epoch));
+}
+
+// Queue a binary message for transmission
+// Return the allocated message ID in msg_id
+Swarm_M138_Error_e SWARM_M138::transmitBinary(const uint8_t *data, size_t len, uint64_t *msg_id, bool useAppID, uint16_t appID,
+                                            bool useHold, uint32_t hold, bool useEpoch, uint32_t epoch)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  char *command;
+  char *response;
+  char *scratchpad;
+  Swarm_M138_Error_e err;
+
+  // Calculate the possible message length
+  size_t msgLen = strlen(SWARM_M138_COMMAND_TX_DATA); // $TD
+  msgLen += 1; // Space
+  if (useAppID) msgLen += 3 + 5 + 1; // AI=65535,
+  if (useHold) msgLen += 3 + 8 + 1; // HD=34819200,
+  if (useEpoch) msgLen += 3 + 10 + 1; // ET=2147483647,
+  msgLen += 2 * len; // The message length in ASCII Hex
+  msgLen += 5; // asterix, checksum chars, line feed, null
+
+  // Allocate memory for the command, message, asterix, checksum bytes, \n and \0
+  command = swarm_m138_alloc_char(msgLen);
+  if (command == NULL)
+    return (SWARM_M138_ERROR_MEM_ALLOC);
+  memset(command, 0, msgLen); // Clear it
+
+  // Allocate memory for the scratchpad
+  scratchpad = swarm_m138_alloc_char(16);
+  if (scratchpad == NULL)
+  {
+    swarm_m138_free_char(command);
+    return (SWARM_M138_ERROR_MEM_ALLOC);
+  }
+  memset(scratchpad, 0, 16); // Clear it
+
+  sprintf(command, "%s ", SWARM_M138_COMMAND_TX_DATA); // Copy the command. Append the space
+  if (useAppID)
+  {
+    strcat(command, "AI=");
+    sprintf(scratchpad, "%d", appID);
+    strcat(command, scratchpad);
+    strcat(command, ",");
+  }
+  if (useHold)
+  {
+    strcat(command, "HD=");
+#if defined(ARDUINO_ARCH_ESP32) || defined(ARDUINO_ARCH_ESP8266)
+    sprintf(scratchpad, "%d", hold);
+#else
+    sprintf(scratchpad, "%lu", (unsigned long)hold);
+#endif
+    strcat(command, scratchpad);
+    strcat(command, ",");
+  }
+  if (useEpoch)
+  {
+    strcat(command, "ET=");
+#if defined(ARDUINO_ARCH_ESP32) || defined(ARDUINO_ARCH_ESP8266)
+    sprintf(scratchpad, "%d", epoch);
+#else
+    sprintf(scratchpad, "%lu", (unsigned long)epoch);
+#endif
+    strcat(command, scratchpad);
+    strcat(command, ",");
+  }
+  for (size_t i = 0; i < len; i++)
+  {
+    char c1 = (data[i] >> 4) + '0'; // Convert the MS nibble to ASCII
+    if (c1 >= ':') c1 = c1 + 'A' - ':';
+    char c2 = (data[i] & 0x0F) + '0'; // Convert the LS nibble to ASCII
+    if (c2 >= ':') c2 = c2 + 'A' - ':';
+    sprintf(scratchpad, "%c%c", c1, c2);
+    strcat(command, scratchpad); // Append each data byte as an ASCII Hex char pair
+  }
+  strcat(command, "*"); // Append the asterix
+  addChecksumLF(command); // Add the checksum bytes and line feed
+
+  response = swarm_m138_alloc_char(_RxBuffSize); // Allocate memory for the response
+  if (response == NULL)
+  {
+    swarm_m138_free_char(command);
+    swarm_m138_free_char(scratchpad);
+    return(SWARM_M138_ERROR_MEM_ALLOC);
+  }
+  memset(response, 0, _RxBuffSize); // Clear it
+
+  err = sendCommandWithResponse(command, "$TD OK,", "$TD ERR", response, _RxBuffSize, SWARM_M138_MESSAGE_TRANSMIT_TIMEOUT);
+
+  if (err == SWARM_M138_ERROR_SUCCESS) // Check if we got $TD OK
+    err = parseTransmitResponse(response, msg_id);
+
+  swarm_m138_free_char(command);
+  swarm_m138_free_char(scratchpad);
+  swarm_m138_free_char(response);
+  return (err);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Begin using the outbox: a host-persistent extension of the modem's transmit queue
+            Messages added with outboxBinary are appended to a log in storage.
+            serviceOutbox moves them into the modem, keeping at most highWater unsent
+            messages in the modem's queue. Each record is protected by a CRC-16.
+            When the modem accepts a message, an acknowledgement record is appended.
+            The log is cleared once every message has been accepted. If the storage
+            supports discard, the accepted records are also removed from the front of
+            the log while other messages are still pending: by serviceOutbox once they
+            use SWARM_M138_OUTBOX_COMPACT_THRESHOLD bytes, or when the storage is full.
+            The log is scanned here, so messages which were pending before a reset are recovered.
+            Note: if a reset occurs after the modem accepts a message, but before the
+            acknowledgement is written, that message will be sent twice.
+    @param  storage
+            A pointer to the storage. It must remain valid until endOutbox is called
+    @param  highWater
+            The maximum number of unsent messages serviceOutbox will keep in the modem's queue.
+            Keep it high enough to fill a pass, but below the modem's queue limit.
+    @return True if the log was read successfully, otherwise false
+*/
+/**************************************************************************/
+bool SWARM_M138::beginOutbox(SWARM_M138_Storage *storage, uint16_t highWater)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  SWARM_M138_PAUSE_READER();
+  if ((storage == NULL) || (highWater == 0))
+    return (false);
+
+  endOutbox(); // Free any existing state
+
+  _outbox = (Swarm_M138_Outbox_t *)swarm_m138_alloc(sizeof(Swarm_M138_Outbox_t));
+  if (_outbox == NULL)
+    return (false);
+
+  _outbox->storage = storage;
+  _outbox->highWater = highWater;
+  _outbox->pending = 0;
+  _outbox->readOffset = storage->size();
+  _outbox->nextSeq = 1;
+  _outbox->ackedSeq = 0;
+
+  uint8_t *data = (uint8_t *)swarm_m138_alloc_char(SWARM_M138_MAX_PACKET_LENGTH_BYTES); // Allocate memory for the payload
+  if (data == NULL)
+  {
+    endOutbox();
+    return (false);
+  }
+
+  // First pass: find the last acknowledged record and the last sequence number
+  // The acknowledgements are always written in order
+  uint32_t offset = 0;
+  uint8_t flags;
+  uint16_t len, appID;
+  uint32_t seq;
+  while (outboxReadRecord(&offset, &flags, data, &len, &appID, &seq))
+  {
+    if (flags & SWARM_M138_OUTBOX_RECORD_ACK)
+    {
+      if (seq > _outbox->ackedSeq)
+        _outbox->ackedSeq = seq;
+    }
+    else if (seq >= _outbox->nextSeq)
+      _outbox->nextSeq = seq + 1;
+    offset += SWARM_M138_OUTBOX_RECORD_OVERHEAD + len; // Move on to the next record
+  }
+
+  // Second pass: count the pending records and find the oldest
+  offset = 0;
+  while (outboxReadRecord(&offset, &flags, data, &len, &appID, &seq))
+  {
+    if (((flags & SWARM_M138_OUTBOX_RECORD_ACK) == 0) && (seq > _outbox->ackedSeq))
+    {
+      if (_outbox->pending == 0)
+        _outbox->readOffset = offset;
+      _outbox->pending++;
+    }
+    offset += SWARM_M138_OUTBOX_RECORD_OVERHEAD + len; // Move on to the next record
+  }
+
+  swarm_m138_free_char((char *)data);
+
+  if (_printDebug == true)
+  {
+    _debugPort->print(F("beginOutbox: pending messages: "));
+    _debugPort->println(_outbox->pending);
+  }
+
+  outboxCompact(); // Remove the records which have already been sent
+
+  return (true);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Stop using the outbox. Any pending messages remain in the log
+*/
+/**************************************************************************/
+void SWARM_M138::endOutbox(void)
+{
+  SWARM_M138_PAUSE_READER();
+  if (_outbox != NULL)
+  {
+    swarm_m138_free(_outbox);
+    _outbox = NULL;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief  Add a binary message to the outbox
+    @param  data
+            A pointer to a uint8_t array of binary data
+    @param  len
+            The length of the binary data: up to SWARM_M138_MAX_PACKET_LENGTH_BYTES
+    @return SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_ERROR if the outbox is not in use, or the storage is full
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::outboxBinary(const uint8_t *data, size_t len)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  if (len > SWARM_M138_MAX_PACKET_LENGTH_BYTES) // Check before the length is narrowed to uint16_t
+    return (SWARM_M138_ERROR_ERROR);
+  if (_outbox == NULL)
+    return (SWARM_M138_ERROR_ERROR);
+  return (outboxAppend(0, data, (uint16_t)len, 0, _outbox->nextSeq));
+}
+
+/**************************************************************************/
+/*!
+    @brief  Add a binary message to the outbox
+    @param  data
+            A pointer to a uint8_t array of binary data
+    @param  len
+            The length of the binary data: up to SWARM_M138_MAX_PACKET_LENGTH_BYTES
+    @param  appID
+            The application ID
+    @return SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_ERROR if the outbox is not in use, or the storage is full
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::outboxBinary(const uint8_t *data, size_t len, uint16_t appID)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  if (len > SWARM_M138_MAX_PACKET_LENGTH_BYTES) // Check before the length is narrowed to uint16_t
+    return (SWARM_M138_ERROR_ERROR);
+  if (_outbox == NULL)
+    return (SWARM_M138_ERROR_ERROR);
+  return (outboxAppend(SWARM_M138_OUTBOX_RECORD_APPID, data, (uint16_t)len, appID, _outbox->nextSeq));
+}
+
+/**************************************************************************/
+/*!
+    @brief  Move messages from the outbox into the modem's transmit queue
+            The number of unsent messages is read from the TX queue mirror (if enabled)
+            or with getUnsentMessageCount. Messages are then transmitted until the modem
+            holds highWater unsent messages or the outbox is empty.
+            Call this regularly: e.g. every few seconds, or from the $TD SENT callback.
+    @return SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_ERROR if unsuccessful, or if an acknowledgement could not be written
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::serviceOutbox(void)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  Swarm_M138_Error_e err = SWARM_M138_ERROR_SUCCESS;
+  uint16_t unsent = 0;
+
+  if ((_outbox == NULL) || (_outbox->pending == 0))
+    return (SWARM_M138_ERROR_SUCCESS);
+
+  if (_txMirror != NULL)
+    unsent = getTxQueueDepth(); // Use the mirror. No need to talk to the modem
+  else
+  {
+    err = getUnsentMessageCount(&unsent);
+    if (err != SWARM_M138_ERROR_SUCCESS)
+      return (err);
+  }
+
+  if (unsent >= _outbox->highWater) // Is the modem's queue full enough?
+    return (SWARM_M138_ERROR_SUCCESS);
+
+  uint8_t *data = (uint8_t *)swarm_m138_alloc_char(SWARM_M138_MAX_PACKET_LENGTH_BYTES); // Allocate memory for the payload
+  if (data == NULL)
+    return (SWARM_M138_ERROR_MEM_ALLOC);
+
+  while ((_outbox->pending > 0) && (unsent < _outbox->highWater) && (err == SWARM_M138_ERROR_SUCCESS))
+  {
+    uint32_t offset = _outbox->readOffset;
+    uint8_t flags;
+    uint16_t len, appID;
+    uint32_t seq;
+
+    // Find the oldest pending record. Skip any acknowledgements
+    bool found = false;
+    while (!found && outboxReadRecord(&offset, &flags, data, &len, &appID, &seq))
+    {
+      if (((flags & SWARM_M138_OUTBOX_RECORD_ACK) == 0) && (seq > _outbox->ackedSeq))
+        found = true;
+      else
+        offset += SWARM_M138_OUTBOX_RECORD_OVERHEAD + len;
+    }
+
+    if (!found) // The log does not hold as many records as we thought. It may have been corrupted
+    {
+      _outbox->pending = 0;
+      break;
+    }
+
+    uint64_t msg_id;
+    if (flags & SWARM_M138_OUTBOX_RECORD_APPID)
+      err = transmitBinary(data, len, &msg_id, appID);
+    else
+      err = transmitBinary(data, len, &msg_id);
+
+    if (err == SWARM_M138_ERROR_SUCCESS)
+    {
+      unsent++;
+      _outbox->ackedSeq = seq;
+      _outbox->pending--;
+      _outbox->readOffset = offset + SWARM_M138_OUTBOX_RECORD_OVERHEAD + len;
+      // Record that the modem has accepted the message. If this fails, the message will be sent again after a reset
+      if (outboxAppend(SWARM_M138_OUTBOX_RECORD_ACK, NULL, 0, 0, seq) != SWARM_M138_ERROR_SUCCESS)
+      {
+        if (_printDebug == true)
+        {
+          _debugPort->print(F("serviceOutbox: could not record the acknowledgement for seq "));
+          _debugPort->println(seq);
+        }
+        err = SWARM_M138_ERROR_ERROR; // Stop here. The storage is failing
+      }
+    }
+  }
+
+  swarm_m138_free_char((char *)data);
+
+  if ((_outbox->pending == 0) || (_outbox->readOffset >= SWARM_M138_OUTBOX_COMPACT_THRESHOLD))
+    outboxCompact(); // Remove the sent records
+
+  if ((err == SWARM_M138_ERROR_ERR) && (strstr(commandError, "DBXTOHIVEFULL") != NULL))
+    err = SWARM_M138_ERROR_SUCCESS; // The modem's queue is full. Try again later
+
+  return (err);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Return the number of messages waiting in the outbox
+    @return The number of messages which have not yet been accepted by the modem
+*/
+/**************************************************************************/
+uint32_t SWARM_M138::getOutboxCount(void)
+{
+  if (_outbox == NULL)
+    return (0);
+  return (_outbox->pending);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Enable the record packer: many small records are aggregated into one
+            packet of up to SWARM_M138_MAX_PACKET_LENGTH_BYTES
+            Each record is packed as: type (1 byte), length (1 byte), data.
+            The packet is sent when the next record will not fit, when the oldest
+            record reaches maxAge (checked by checkUnsolicitedMsg and packRecord),
+            or when flushPacker is called.
+            If the outbox is in use, the packet is added to the outbox. Otherwise
+            it is sent with transmitBinary.
+    @param  maxAge
+            The maximum age of the oldest record in milliseconds. 0 disables the age check
+    @return True if the buffer was allocated successfully, otherwise false
+*/
+/**************************************************************************/
+bool SWARM_M138::enablePacker(unsigned long maxAge)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  disablePacker(); // Free any existing buffer
+
+  _packer = (Swarm_M138_Packer_t *)swarm_m138_alloc(sizeof(Swarm_M138_Packer_t));
+  if (_packer == NULL)
+  {
+    if (_printDebug == true)
+      _debugPort->println(F("enablePacker: not enough memory for _packer!"));
+    return (false);
+  }
+
+  _packer->length = 0;
+  _packer->maxAge = maxAge;
+  _packer->useAppID = false;
+  _packer->appID = 0;
+  _packer->flushError = SWARM_M138_ERROR_SUCCESS;
+
+  return (true);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Enable the record packer. Packets are sent with the application ID
+    @param  maxAge
+            The maximum age of the oldest record in milliseconds. 0 disables the age check
+    @param  appID
+            The application ID used when the packet is sent
+    @return True if the buffer was allocated successfully, otherwise false
+*/
+/**************************************************************************/
+bool SWARM_M138::enablePacker(unsigned long maxAge, uint16_t appID)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  if (!enablePacker(maxAge))
+    return (false);
+
+  _packer->useAppID = true;
+  _packer->appID = appID;
+
+  return (true);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Disable the record packer and free its buffer
+            Any packed records are discarded. Call flushPacker first if required.
+*/
+/**************************************************************************/
+void SWARM_M138::disablePacker(void)
+{
+  if (_packer != NULL)
+  {
+    swarm_m138_free(_packer);
+    _packer = NULL;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief  Add a record to the packet
+            If the record will not fit, the packet is sent first.
+            If the packet is then full, it is sent straight away. The record has
+            been packed by then, so a failure to send is not returned here: the full
+            packet is kept and sent by the next packRecord or flushPacker.
+            Use getPackerFlushError to check it.
+    @param  type
+            The record type. This is passed to the unpacker callback
+    @param  data
+            A pointer to a uint8_t array of binary data
+    @param  len
+            The length of the record: up to SWARM_M138_MAX_PACKET_LENGTH_BYTES - SWARM_M138_PACKER_RECORD_OVERHEAD
+    @return SWARM_M138_ERROR_SUCCESS if the record was packed
+            Any other result means the record was not packed, so it is safe to retry:
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_ERROR if the packer is disabled, the record is too long, or the previous packet could not be sent
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::packRecord(uint8_t type, const uint8_t *data, uint8_t len)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  Swarm_M138_Error_e err = SWARM_M138_ERROR_SUCCESS;
+
+  if ((_packer == NULL) || ((len > 0) && (data == NULL)))
+    return (SWARM_M138_ERROR_ERROR);
+
+  if ((len + SWARM_M138_PACKER_RECORD_OVERHEAD) > SWARM_M138_MAX_PACKET_LENGTH_BYTES)
+    return (SWARM_M138_ERROR_ERROR);
+
+  // Send the packet first if the record will not fit, or the oldest record has reached its maximum age
+  if (((_packer->length + len + SWARM_M138_PACKER_RECORD_OVERHEAD) > SWARM_M138_MAX_PACKET_LENGTH_BYTES)
+      || ((_packer->length > 0) && (_packer->maxAge > 0) && ((millis() - _packer->firstAt) >= _packer->maxAge)))
+  {
+    err = flushPacker();
+    if (err != SWARM_M138_ERROR_SUCCESS)
+      return (err);
+  }
+
+  if (_packer->length == 0)
+    _packer->firstAt = millis();
+
+  _packer->data[_packer->length++] = type;
+  _packer->data[_packer->length++] = len;
+  if (len > 0)
+    memcpy(&_packer->data[_packer->length], data, len);
+  _packer->length += len;
+
+  if (_packer->length > (SWARM_M138_MAX_PACKET_LENGTH_BYTES - SWARM_M138_PACKER_RECORD_OVERHEAD)) // Is there room for another record?
+    flushPacker(); // If this fails, the packet is kept. The record is in it, so it must not be packed again
+
+  return (SWARM_M138_ERROR_SUCCESS);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Send the packet now
+            If the outbox is in use, the packet is added to the outbox.
+            Otherwise it is sent with transmitBinary.
+            If the packet could not be sent, the records are kept.
+    @return SWARM_M138_ERROR_SUCCESS if successful (or if the packet is empty)
+            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_ERROR if unsuccessful
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::flushPacker(void)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  Swarm_M138_Error_e err;
+
+  if ((_packer == NULL) || (_packer->length == 0))
+    return (SWARM_M138_ERROR_SUCCESS);
+
+  if (_printDebug == true)
+  {
+    _debugPort->print(F("flushPacker: sending "));
+    _debugPort->print(_packer->length);
+    _debugPort->println(F(" bytes"));
+  }
+
+  if (_outbox != NULL)
+  {
+    if (_packer->useAppID)
+      err = outboxBinary(_packer->data, _packer->length, _packer->appID);
+    else
+      err = outboxBinary(_packer->data, _packer->length);
+  }
+  else
+  {
+    uint64_t msg_id;
+    if (_packer->useAppID)
+      err = transmitBinary(_packer->data, _packer->length, &msg_id, _packer->appID);
+    else
+      err = transmitBinary(_packer->data, _packer->length, &msg_id);
+  }
+
+  if (err == SWARM_M138_ERROR_SUCCESS)
+    _packer->length = 0;
+
+  _packer->flushError = err;
+  return (err);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Return the number of bytes in the packet
+    @return The number of bytes packed so far. Zero if the packer is disabled
+*/
+/**************************************************************************/
+size_t SWARM_M138::getPackerLength(void)
+{
+  if (_packer == NULL)
+    return (0);
+  return (_packer->length);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Return the result of the most recent attempt to send the packet:
+            by flushPacker, or by packRecord or checkUnsolicitedMsg when the packet
+            was full or old enough
+    @return SWARM_M138_ERROR_SUCCESS if the packet was sent (or there has been no attempt yet)
+            Otherwise the error from transmitBinary or outboxBinary. The packet has been kept
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::getPackerFlushError(void)
+{
+  if (_packer == NULL)
+    return (SWARM_M138_ERROR_SUCCESS);
+  return (_packer->flushError);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Split a packet created by the record packer into its records
+            Does not communicate with the modem.
+    @param  packet
+            A pointer to the binary packet
+    @param  len
+            The length of the packet
+    @param  swarmRecordCallback
+            The address of the function to be called for each record
+    @return SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_INVALID_FORMAT if the packet ends with an incomplete record.
+            The callback is still called for the complete records which precede it
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::unpackRecords(const uint8_t *packet, size_t len,
+                                             void (*swarmRecordCallback)(uint8_t type, const uint8_t *data, uint8_t len))
+{
+  size_t offset = 0;
+
+  while (offset < len)
+  {
+    if ((offset + SWARM_M138_PACKER_RECORD_OVERHEAD) > len) // Check the type and length are present
+      return (SWARM_M138_ERROR_INVALID_FORMAT);
+
+    uint8_t recordType = packet[offset];
+    uint8_t recordLen = packet[offset + 1];
+    offset += SWARM_M138_PACKER_RECORD_OVERHEAD;
+
+    if ((offset + recordLen) > len) // Check the data is all present
+      return (SWARM_M138_ERROR_INVALID_FORMAT);
+
+    if (swarmRecordCallback != NULL)
+      swarmRecordCallback(recordType, &packet[offset], recordLen); // Call the callback
+
+    offset += recordLen;
+  }
+
+  return (SWARM_M138_ERROR_SUCCESS);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Compress binary data or text using LZSS
+            The encoder can also match against a small static dictionary of common
+            telemetry / JSON tokens, so short payloads compress too.
+            If compression does not make the payload smaller, it is stored raw.
+            The first byte of out is the mode: SWARM_M138_COMPRESS_MODE_RAW or _LZSS.
+            No memory is allocated.
+    @param  in
+            A pointer to the data to be compressed
+    @param  inLen
+            The length of the data
+    @param  out
+            A pointer to the buffer for the compressed data
+    @param  outLen
+            On entry: the size of out (e.g. SWARM_M138_MAX_PACKET_LENGTH_BYTES).
+            On exit: the length of the compressed data
+    @return SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_ERROR if the compressed data will not fit in out
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::compressPayload(const uint8_t *in, size_t inLen, uint8_t *out, size_t *outLen)
+{
+  const uint16_t dictLen = SWARM_M138_COMPRESS_DICTIONARY_LENGTH;
+  size_t outMax = *outLen;
+  size_t outPos = 1;
+  size_t flagPos = 0;
+  uint8_t flagBit = 8; // Start a new flag byte straight away
+  size_t inPos = 0;
+  bool fits = (outMax > 1);
+
+  if (fits)
+    out[0] = SWARM_M138_COMPRESS_MODE_LZSS;
+
+  // Each group of eight items is preceded by a flag byte. Bit set: a two-byte match. Bit clear: a literal byte
+  // The window is the static dictionary followed by the data already encoded
+  while (fits && (inPos < inLen))
+  {
+    if (flagBit == 8) // Start a new flag byte
+    {
+      if (outPos >= outMax)
+      {
+        fits = false;
+        break;
+      }
+      flagPos = outPos++;
+      out[flagPos] = 0;
+      flagBit = 0;
+    }
+
+    // Find the longest match
+    size_t bestLen = 0;
+    size_t bestDist = 0;
+    size_t maxLen = inLen - inPos;
+    if (maxLen > SWARM_M138_COMPRESS_MAX_MATCH)
+      maxLen = SWARM_M138_COMPRESS_MAX_MATCH;
+    size_t here = dictLen + inPos; // Our position in the window
+    size_t start = (here > SWARM_M138_COMPRESS_WINDOW) ? here - SWARM_M138_COMPRESS_WINDOW : 0;
+
+    if (maxLen >= SWARM_M138_COMPRESS_MIN_MATCH)
+    {
+      for (size_t candidate = start; candidate < here; candidate++)
+      {
+        size_t matchLen = 0;
+        while (matchLen < maxLen)
+        {
+          size_t windowPos = candidate + matchLen;
+          uint8_t windowByte = (windowPos < dictLen) ? compressorDictionaryByte(windowPos) : in[windowPos - dictLen];
+          if (windowByte != in[inPos + matchLen])
+            break;
+          matchLen++;
+        }
+        if (matchLen > bestLen)
+        {
+          bestLen = matchLen;
+          bestDist = here - candidate;
+          if (bestLen == maxLen)
+            break;
+        }
+      }
+    }
+
+    if (bestLen >= SWARM_M138_COMPRESS_MIN_MATCH)
+    {
+      if ((outPos + 2) > outMax)
+      {
+        fits = false;
+        break;
+      }
+      out[flagPos] |= 1 << flagBit;
+      out[outPos++] = (uint8_t)((bestDist - 1) >> 4);
+      out[outPos++] = (uint8_t)((((bestDist - 1) & 0x0F) << 4) | (bestLen - SWARM_M138_COMPRESS_MIN_MATCH));
+      inPos += bestLen;
+    }
+    else
+    {
+      if (outPos >= outMax)
+      {
+        fits = false;
+        break;
+      }
+      out[outPos++] = in[inPos++];
+    }
+    flagBit++;
+  }
+
+  if (fits && (outPos < (inLen + 1))) // Did compression help?
+  {
+    *outLen = outPos;
+    return (SWARM_M138_ERROR_SUCCESS);
+  }
+
+  // Store the data raw
+  if ((inLen + 1) > outMax)
+    return (SWARM_M138_ERROR_ERROR);
+
+  out[0] = SWARM_M138_COMPRESS_MODE_RAW;
+  memcpy(&out[1], in, inLen);
+  *outLen = inLen + 1;
+  return (SWARM_M138_ERROR_SUCCESS);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Compress a series of slowly-varying numbers (e.g. sensor readings)
+            The first value and then the differences between values are stored as
+            zigzag-encoded varints: small changes take one byte.
+            The first byte of out is SWARM_M138_COMPRESS_MODE_SERIES.
+            No memory is allocated.
+    @param  values
+            A pointer to the values
+    @param  count
+            The number of values
+    @param  out
+            A pointer to the buffer for the compressed data
+    @param  outLen
+            On entry: the size of out (e.g. SWARM_M138_MAX_PACKET_LENGTH_BYTES).
+            On exit: the length of the compressed data
+    @return SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_ERROR if the compressed data will not fit in out
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::compressSeries(const int32_t *values, uint16_t count, uint8_t *out, size_t *outLen)
+{
+  size_t outMax = *outLen;
+  size_t outPos = 0;
+  uint32_t previous = 0;
+
+  if (outMax < 1)
+    return (SWARM_M138_ERROR_ERROR);
+
+  out[outPos++] = SWARM_M138_COMPRESS_MODE_SERIES;
+
+  for (uint16_t i = 0; i < count; i++)
+  {
+    uint32_t delta = (uint32_t)values[i] - previous; // Wraps modulo 2^32. The decoder wraps too
+    previous = (uint32_t)values[i];
+    uint32_t zigzag = (delta << 1) ^ (uint32_t)(-(int32_t)(delta >> 31)); // Small negative deltas become small positive numbers
+
+    do
+    {
+      if (outPos >= outMax)
+        return (SWARM_M138_ERROR_ERROR);
+      uint8_t b = zigzag & 0x7F;
+      zigzag >>= 7;
+      if (zigzag != 0)
+        b |= 0x80; // More bytes follow
+      out[outPos++] = b;
+    } while (zigzag != 0);
+  }
+
+  *outLen = outPos;
+  return (SWARM_M138_ERROR_SUCCESS);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Decompress a payload created by compressPayload or compressSeries
+            A series is returned as an array of little-endian int32_t.
+            No memory is allocated.
+    @param  in
+            A pointer to the compressed data
+    @param  inLen
+            The length of the compressed data
+    @param  out
+            A pointer to the buffer for the decompressed data
+    @param  outLen
+            On entry: the size of out. On exit: the length of the decompressed data
+    @return SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_INVALID_FORMAT if the compressed data is invalid
+            SWARM_M138_ERROR_ERROR if the decompressed data will not fit in out
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::decompressPayload(const uint8_t *in, size_t inLen, uint8_t *out, size_t *outLen)
+{
+  const uint16_t dictLen = SWARM_M138_COMPRESS_DICTIONARY_LENGTH;
+  size_t outMax = *outLen;
+  size_t outPos = 0;
+  size_t inPos = 1;
+
+  if (inLen < 1)
+    return (SWARM_M138_ERROR_INVALID_FORMAT);
+
+  if (in[0] == SWARM_M138_COMPRESS_MODE_RAW)
+  {
+    if ((inLen - 1) > outMax)
+      return (SWARM_M138_ERROR_ERROR);
+    memcpy(out, &in[1], inLen - 1);
+    *outLen = inLen - 1;
+    return (SWARM_M138_ERROR_SUCCESS);
+  }
+
+  else if (in[0] == SWARM_M138_COMPRESS_MODE_LZSS)
+  {
+    while (inPos < inLen)
+    {
+      uint8_t flags = in[inPos++];
+      for (uint8_t flagBit = 0; (flagBit < 8) && (inPos < inLen); flagBit++)
+      {
+        if (flags & (1 << flagBit)) // Match
+        {
+          if ((inPos + 2) > inLen)
+            return (SWARM_M138_ERROR_INVALID_FORMAT);
+          size_t dist = (((size_t)in[inPos]) << 4) + (in[inPos + 1] >> 4) + 1;
+          size_t matchLen = (in[inPos + 1] & 0x0F) + SWARM_M138_COMPRESS_MIN_MATCH;
+          inPos += 2;
+          if (dist > (dictLen + outPos))
+            return (SWARM_M138_ERROR_INVALID_FORMAT);
+          if ((outPos + matchLen) > outMax)
+            return (SWARM_M138_ERROR_ERROR);
+          size_t windowPos = dictLen + outPos - dist;
+          for (size_t i = 0; i < matchLen; i++, windowPos++) // Copy byte by byte. The match can overlap the output
+            out[outPos++] = (windowPos < dictLen) ? compressorDictionaryByte(windowPos) : out[windowPos - dictLen];
+        }
+        else // Literal
+        {
+          if (outPos >= outMax)
+            return (SWARM_M138_ERROR_ERROR);
+          out[outPos++] = in[inPos++];
+        }
+      }
+    }
+  }
+
+  else if (in[0] == SWARM_M138_COMPRESS_MODE_SERIES)
+  {
+    uint32_t previous = 0;
+    while (inPos < inLen)
+    {
+      uint32_t zigzag = 0;
+      uint8_t shift = 0;
+      uint8_t b;
+      do
+      {
+        if ((inPos >= inLen) || (shift > 28))
+          return (SWARM_M138_ERROR_INVALID_FORMAT);
+        b = in[inPos++];
+        zigzag |= ((uint32_t)(b & 0x7F)) << shift;
+        shift += 7;
+      } while (b & 0x80);
+
+      uint32_t delta = (zigzag >> 1) ^ (uint32_t)(-(int32_t)(zigzag & 1));
+      previous += delta;
+
+      if ((outPos + 4) > outMax)
+        return (SWARM_M138_ERROR_ERROR);
+      out[outPos++] = previous & 0xFF;
+      out[outPos++] = (previous >> 8) & 0xFF;
+      out[outPos++] = (previous >> 16) & 0xFF;
+      out[outPos++] = previous >> 24;
+    }
+  }
+
+  else
+    return (SWARM_M138_ERROR_INVALID_FORMAT);
+
+  *outLen = outPos;
+  return (SWARM_M138_ERROR_SUCCESS);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Compress binary data and queue it for transmission
+            The data can be longer than SWARM_M138_MAX_PACKET_LENGTH_BYTES
+            provided it compresses to fit.
+    @param  data
+            A pointer to a uint8_t array of binary data
+    @param  len
+            The length of the binary data
+    @param  msg_id
+            A pointer to a uint64_t which will hold the assigned message ID
+    @return SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_ERROR if unsuccessful (e.g. the data does not compress enough)
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::transmitCompressed(const uint8_t *data, size_t len, uint64_t *msg_id)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  uint8_t *compressed = (uint8_t *)swarm_m138_alloc_char(SWARM_M138_MAX_PACKET_LENGTH_BYTES); // Allocate memory for the compressed data
+  if (compressed == NULL)
+    return (SWARM_M138_ERROR_MEM_ALLOC);
+
+  size_t compressedLen = SWARM_M138_MAX_PACKET_LENGTH_BYTES;
+  Swarm_M138_Error_e err = compressPayload(data, len, compressed, &compressedLen);
+
+  if (err == SWARM_M138_ERROR_SUCCESS)
+    err = transmitBinary(compressed, compressedLen, msg_id);
+
+  swarm_m138_free_char((char *)compressed);
+  return (err);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Compress binary data and queue it for transmission
+    @param  data
+            A pointer to a uint8_t array of binary data
+    @param  len
+            The length of the binary data
+    @param  msg_id
+            A pointer to a uint64_t which will hold the assigned message ID
+    @param  appID
+            The application ID
+    @return SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_ERROR if unsuccessful (e.g. the data does not compress enough)
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::transmitCompressed(const uint8_t *data, size_t len, uint64_t *msg_id, uint16_t appID)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  uint8_t *compressed = (uint8_t *)swarm_m138_alloc_char(SWARM_M138_MAX_PACKET_LENGTH_BYTES); // Allocate memory for the compressed data
+  if (compressed == NULL)
+    return (SWARM_M138_ERROR_MEM_ALLOC);
+
+  size_t compressedLen = SWARM_M138_MAX_PACKET_LENGTH_BYTES;
+  Swarm_M138_Error_e err = compressPayload(data, len, compressed, &compressedLen);
+
+  if (err == SWARM_M138_ERROR_SUCCESS)
+    err = transmitBinary(compressed, compressedLen, msg_id, appID);
+
+  swarm_m138_free_char((char *)compressed);
+  return (err);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Enable / disable decompression of received messages in drainRxMessages
+            This only applies to drainRxMessages, which passes binary to its callback.
+            The $RD callback, readMessage, readOldestMessage and readNewestMessage
+            return the payload as received, in ASCII Hex: a decompressed payload can
+            be larger than SWARM_M138_MAX_PACKET_LENGTH_BYTES, so it may not fit their
+            buffers. Convert their payload to binary and call decompressPayload instead
+    @param  enable
+            If true: messages with the matching appID are decompressed before
+            the callback is called. Messages which fail to decompress are passed unchanged
+    @param  appID
+            The application ID of the compressed messages
+*/
+/**************************************************************************/
+void SWARM_M138::setRxDecompression(bool enable, uint16_t appID)
+{
+  _rxDecompress = enable;
+  _rxDecompressAppID = appID;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Split a payload larger than one packet into fragments and queue them
+            Each fragment carries a three byte header: key, index, count. It is sent
+            with appID SWARM_M138_FRAGMENT_APPID_BASE + channel.
+            If the outbox is in use, the fragments are added to the outbox.
+            Otherwise they are sent with transmitBinary. The modem's queue is finite,
+            so the outbox is recommended for large payloads.
+    @param  data
+            A pointer to a uint8_t array of binary data
+    @param  len
+            The length of the data: up to SWARM_M138_FRAGMENT_MAX_COUNT * SWARM_M138_FRAGMENT_PAYLOAD bytes
+    @param  key
+            A pointer to a uint8_t which will hold the message key. Keep it to retransmit missing fragments.
+            The keys count up from a value seeded from micros() on the first call
+    @param  channel
+            Fragments are sent with appID SWARM_M138_FRAGMENT_APPID_BASE + channel. 0 to 999
+    @return SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_ERROR if unsuccessful. Some fragments may already have been queued
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::transmitFragmented(const uint8_t *data, size_t len, uint8_t *key, uint16_t channel)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  if (!_fragmentKeySeeded) // Start from a different key after each reset, so a receiver does not mistake the first message for a repeat
+  {
+    unsigned long now = micros();
+    _fragmentNextKey = (uint8_t)(now ^ (now >> 8) ^ (now >> 16));
+    _fragmentKeySeeded = true;
+  }
+
+  uint8_t theKey = _fragmentNextKey++;
+
+  if (key != NULL)
+    *key = theKey;
+
+  return (transmitFragmentsInternal(data, len, theKey, NULL, channel));
+}
+
+/**************************************************************************/
+/*!
+    @brief  Queue the fragments of a message which the receiver reported missing
+    @param  data
+            A pointer to the original data
+    @param  len
+            The length of the original data
+    @param  key
+            The message key returned by transmitFragmented
+    @param  missing
+            A SWARM_M138_FRAGMENT_BITMAP_LENGTH byte bitmap. Bit set = fragment missing
+    @param  channel
+            The channel used by transmitFragmented
+    @return SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_ERROR if unsuccessful
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::retransmitFragments(const uint8_t *data, size_t len, uint8_t key, const uint8_t *missing, uint16_t channel)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  if (missing == NULL)
+    return (SWARM_M138_ERROR_ERROR);
+
+  return (transmitFragmentsInternal(data, len, key, missing, channel));
+}
+
+/**************************************************************************/
+/*!
+    @brief  Enable reassembly of received fragments
+            Fragments arriving as $RD messages (processed by checkUnsolicitedMsg)
+            or read by drainRxMessages are reassembled. When a message is complete,
+            the reassembled callback is called. If no fragment arrives within the
+            timeout, the partial message is discarded and the timeout callback is called
+            with the missing-fragment bitmap.
+            One message is reassembled at a time. A fragment with a new key or channel
+            replaces the partial message (the timeout callback is called for it).
+            Repeated fragments of the last complete message are ignored until the
+            timeout has passed. After that, the same key and channel start a new message.
+    @param  maxLength
+            The size of the reassembly buffer. Messages longer than this are ignored
+    @param  timeout
+            The reassembly timeout in milliseconds
+    @return True if the buffer was allocated successfully, otherwise false
+*/
+/**************************************************************************/
+bool SWARM_M138::enableReassembly(size_t maxLength, unsigned long timeout)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  SWARM_M138_PAUSE_READER();
+  if (maxLength == 0)
+    return (false);
+
+  disableReassembly(); // Free any existing buffer
+
+  _reassembly = (Swarm_M138_Reassembly_t *)swarm_m138_alloc(sizeof(Swarm_M138_Reassembly_t) + maxLength);
+  if (_reassembly == NULL)
+  {
+    if (_printDebug == true)
+      _debugPort->println(F("enableReassembly: not enough memory for _reassembly!"));
+    return (false);
+  }
+
+  memset(_reassembly, 0, sizeof(Swarm_M138_Reassembly_t));
+  _reassembly->data = (uint8_t *)(_reassembly + 1);
+  _reassembly->maxLength = maxLength;
+  _reassembly->timeout = timeout;
+
+  return (true);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Disable reassembly. Any partial message is discarded
+*/
+/**************************************************************************/
+void SWARM_M138::disableReassembly(void)
+{
+  SWARM_M138_PAUSE_READER();
+  if (_reassembly != NULL)
+  {
+    swarm_m138_free(_reassembly);
+    _reassembly = NULL;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief  Pass a received message to the reassembler
+            checkUnsolicitedMsg and drainRxMessages call this automatically.
+            Call it yourself for messages read with readMessage (etc.) after
+            converting them to binary.
+    @param  appID
+            The message appID
+    @param  data
+            A pointer to the binary message
+    @param  len
+            The length of the message
+    @return True if the message was a fragment (and has been consumed), otherwise false
+*/
+/**************************************************************************/
+bool SWARM_M138::feedFragment(uint16_t appID, const uint8_t *data, size_t len)
+{
+  if ((_reassembly == NULL) || (appID < SWARM_M138_FRAGMENT_APPID_BASE) || (appID >= (SWARM_M138_FRAGMENT_APPID_BASE + SWARM_M138_FRAGMENT_CHANNELS)))
+    return (false);
+
+  if (len < SWARM_M138_FRAGMENT_HEADER_LEN)
+    return (false);
+
+  uint16_t channel = appID - SWARM_M138_FRAGMENT_APPID_BASE;
+  uint8_t key = data[0];
+  uint8_t index = data[1];
+  uint8_t count = data[2];
+  size_t fragmentLen = len - SWARM_M138_FRAGMENT_HEADER_LEN;
+
+  if ((count == 0) || (index >= count) || (fragmentLen > SWARM_M138_FRAGMENT_PAYLOAD)
+      || ((index < (count - 1)) && (fragmentLen != SWARM_M138_FRAGMENT_PAYLOAD))) // Check the header is valid
+    return (true); // It is in the fragment appID range, so consume it anyway
+
+  if (_reassembly->doneValid && ((millis() - _reassembly->doneAt) >= _reassembly->timeout)) // Forget the last complete message once it has timed out
+    _reassembly->doneValid = false;
+
+  if (_reassembly->doneValid && (key == _reassembly->doneKey) && (channel == _reassembly->doneChannel)) // Ignore repeats of the last complete message
+    return (true);
+
+  if ((((size_t)index) * SWARM_M138_FRAGMENT_PAYLOAD + fragmentLen) > _reassembly->maxLength) // Will it fit?
+  {
+    if (_printDebug == true)
+      _debugPort->println(F("feedFragment: message is too long for the reassembly buffer!"));
+    return (true);
+  }
+
+  if (_reassembly->active && ((key != _reassembly->key) || (channel != _reassembly->channel) || (count != _reassembly->count))) // Is this a new message?
+  {
+    _reassembly->lastAt = millis() - _reassembly->timeout; // Time out the partial message
+    checkReassemblyTimeout();
+  }
+
+  if (!_reassembly->active) // Start a new message
+  {
+    _reassembly->active = true;
+    _reassembly->key = key;
+    _reassembly->channel = channel;
+    _reassembly->count = count;
+    _reassembly->received = 0;
+    _reassembly->lastLen = 0;
+    memset(_reassembly->bitmap, 0, SWARM_M138_FRAGMENT_BITMAP_LENGTH);
+  }
+
+  _reassembly->lastAt = millis();
+
+  if ((_reassembly->bitmap[index >> 3] & (1 << (index & 7))) != 0) // Have we already got this fragment?
+    return (true);
+
+  memcpy(&_reassembly->data[((size_t)index) * SWARM_M138_FRAGMENT_PAYLOAD], &data[SWARM_M138_FRAGMENT_HEADER_LEN], fragmentLen);
+  _reassembly->bitmap[index >> 3] |= 1 << (index & 7);
+  _reassembly->received++;
+  if (index == (count - 1))
+    _reassembly->lastLen = fragmentLen;
+
+  if (_reassembly->received == _reassembly->count) // Is the message complete?
+  {
+    _reassembly->active = false;
+    _reassembly->doneValid = true;
+    _reassembly->doneKey = key;
+    _reassembly->doneChannel = channel;
+    _reassembly->doneAt = millis();
+
+    if (_swarmReassembledCallback != NULL)
+      _swarmReassembledCallback((const uint8_t *)_reassembly->data, ((size_t)(count - 1)) * SWARM_M138_FRAGMENT_PAYLOAD + _reassembly->lastLen, key, channel); // Call the callback
+  }
+
+  return (true);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Get the missing-fragment bitmap for the partial message
+    @param  missing
+            A pointer to a SWARM_M138_FRAGMENT_BITMAP_LENGTH byte array.
+            Bit set = fragment missing. Can be NULL
+    @return The number of missing fragments. Zero if no partial message is held
+*/
+/**************************************************************************/
+uint8_t SWARM_M138::getMissingFragments(uint8_t *missing)
+{
+  if (missing != NULL)
+    memset(missing, 0, SWARM_M138_FRAGMENT_BITMAP_LENGTH);
+
+  if ((_reassembly == NULL) || (!_reassembly->active))
+    return (0);
+
+  if (missing != NULL)
+  {
+    for (uint16_t index = 0; index < _reassembly->count; index++)
+    {
+      if ((_reassembly->bitmap[index >> 3] & (1 << (index & 7))) == 0)
+        missing[index >> 3] |= 1 << (index & 7);
+    }
+  }
+
+  return (_reassembly->count - _reassembly->received);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Set up the callback for reassembled messages
+    @param  swarmReassembledCallback
+            The address of the function to be called when all of the fragments of a message have arrived.
+            data is only valid until the callback returns
+*/
+/**************************************************************************/
+void SWARM_M138::setReassembledCallback(void (*swarmReassembledCallback)(const uint8_t *data, size_t len, uint8_t key, uint16_t channel))
+{
+  SWARM_M138_PAUSE_READER();
+  _swarmReassembledCallback = swarmReassembledCallback;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Set up the callback for reassembly timeouts
+    @param  swarmFragmentTimeoutCallback
+            The address of the function to be called when a partial message is discarded.
+            missing is a SWARM_M138_FRAGMENT_BITMAP_LENGTH byte bitmap. Bit set = fragment missing
+*/
+/**************************************************************************/
+void SWARM_M138::setFragmentTimeoutCallback(void (*swarmFragmentTimeoutCallback)(uint8_t key, uint16_t channel, uint8_t count, const uint8_t *missing))
+{
+  SWARM_M138_PAUSE_READER();
+  _swarmFragmentTimeoutCallback = swarmFragmentTimeoutCallback;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Enable the priority transmit scheduler
+            Messages are scheduled with a priority: alarm, telemetry or bulk.
+            serviceTxScheduler moves them into the modem, highest priority first,
+            keeping at most modemWindow unsent messages in the modem's queue.
+            The TX queue mirror is enabled (if required) so the scheduler knows
+            when messages have been sent.
+            Each entry uses sizeof(Swarm_M138_TX_Scheduler_Entry_t) bytes of RAM.
+    @param  maxEntries
+            The maximum number of unsent messages the scheduler can hold (waiting plus in the modem)
+    @param  modemWindow
+            The maximum number of unsent messages to keep in the modem's queue
+    @return True if the memory was allocated successfully, otherwise false
+*/
+/**************************************************************************/
+bool SWARM_M138::enableTxScheduler(uint8_t maxEntries, uint8_t modemWindow)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  SWARM_M138_PAUSE_READER();
+  if ((maxEntries == 0) || (modemWindow == 0))
+    return (false);
+
+  disableTxScheduler(); // Free any existing scheduler
+
+  if (_txMirror == NULL) // The scheduler needs the mirror
+  {
+    if (!enableTxQueueMirror(SWARM_M138_TX_MIRROR_DEFAULT_SIZE > maxEntries ? SWARM_M138_TX_MIRROR_DEFAULT_SIZE : maxEntries))
+      return (false);
+  }
+
+  _txScheduler = (Swarm_M138_TX_Scheduler_t *)swarm_m138_alloc(sizeof(Swarm_M138_TX_Scheduler_t) + (sizeof(Swarm_M138_TX_Scheduler_Entry_t) * maxEntries));
+  if (_txScheduler == NULL)
+  {
+    if (_printDebug == true)
+      _debugPort->println(F("enableTxScheduler: not enough memory for _txScheduler!"));
+    return (false);
+  }
+
+  _txScheduler->entries = (Swarm_M138_TX_Scheduler_Entry_t *)(_txScheduler + 1);
+  for (uint8_t i = 0; i < maxEntries; i++)
+    _txScheduler->entries[i].inUse = false;
+
+  _txScheduler->size = maxEntries;
+  _txScheduler->window = modemWindow;
+  _txScheduler->policy[SWARM_M138_TX_PRIORITY_BULK].hold = 604800; // 7 days
+  _txScheduler->policy[SWARM_M138_TX_PRIORITY_BULK].maxAge = 0;
+  _txScheduler->policy[SWARM_M138_TX_PRIORITY_TELEMETRY].hold = 0; // Modem default: 48 hours
+  _txScheduler->policy[SWARM_M138_TX_PRIORITY_TELEMETRY].maxAge = 0;
+  _txScheduler->policy[SWARM_M138_TX_PRIORITY_ALARM].hold = 86400; // 24 hours
+  _txScheduler->policy[SWARM_M138_TX_PRIORITY_ALARM].maxAge = 0;
+
+  return (true);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Disable the priority transmit scheduler and free its memory
+            Waiting messages are discarded. Messages already in the modem are not deleted.
+*/
+/**************************************************************************/
+void SWARM_M138::disableTxScheduler(void)
+{
+  SWARM_M138_PAUSE_READER();
+  if (_txScheduler != NULL)
+  {
+    swarm_m138_free(_txScheduler);
+    _txScheduler = NULL;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief  Set the policy for a priority class
+    @param  priority
+            The priority class
+    @param  hold
+            The hold duration in seconds (60 to 34819200) used when the message is
+            sent to the modem. The modem discards the message if it has not been
+            transmitted within the hold duration. 0 = use the modem default (48 hours)
+    @param  maxAge
+            Discard the message if it has waited this long (ms) in the scheduler
+            before reaching the modem. 0 = never
+    @return True if successful, false if priority or hold is invalid or the scheduler is disabled
+*/
+/**************************************************************************/
+bool SWARM_M138::setTxPriorityPolicy(Swarm_M138_TX_Priority_e priority, uint32_t hold, unsigned long maxAge)
+{
+  if ((_txScheduler == NULL) || (priority >= SWARM_M138_TX_PRIORITY_INVALID))
+    return (false);
+
+  if ((hold != 0) && ((hold < 60) || (hold > 34819200)))
+    return (false);
+
+  _txScheduler->policy[priority].hold = hold;
+  _txScheduler->policy[priority].maxAge = maxAge;
+
+  return (true);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Schedule binary data for transmission
+            If the scheduler is full, the oldest waiting message with a lower
+            priority is discarded to make room.
+            serviceTxScheduler is called so the message reaches the modem as soon as possible.
+    @param  data
+            A pointer to a uint8_t array of binary data
+    @param  len
+            The length of the binary data: up to SWARM_M138_MAX_PACKET_LENGTH_BYTES
+    @param  priority
+            The priority class
+    @return SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_ERROR if unsuccessful (e.g. the scheduler is full)
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::scheduleBinary(const uint8_t *data, size_t len, Swarm_M138_TX_Priority_e priority)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  return (scheduleBinary(data, len, priority, 0xFFFF)); // 0xFFFF: no appID
+}
+
+/**************************************************************************/
+/*!
+    @brief  Schedule binary data for transmission with an appID
+    @param  data
+            A pointer to a uint8_t array of binary data
+    @param  len
+            The length of the binary data: up to SWARM_M138_MAX_PACKET_LENGTH_BYTES
+    @param  priority
+            The priority class
+    @param  appID
+            The application ID: 0 to 64999
+    @return SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_ERROR if unsuccessful (e.g. the scheduler is full)
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::scheduleBinary(const uint8_t *data, size_t len, Swarm_M138_TX_Priority_e priority, uint16_t appID)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  if ((_txScheduler == NULL) || (data == NULL) || (len == 0) || (len > SWARM_M138_MAX_PACKET_LENGTH_BYTES) || (priority >= SWARM_M138_TX_PRIORITY_INVALID))
+    return (SWARM_M138_ERROR_ERROR);
+
+  int slot = -1;
+  for (uint8_t i = 0; (i < _txScheduler->size) && (slot < 0); i++)
+  {
+    if (!_txScheduler->entries[i].inUse)
+      slot = i;
+  }
+
+  if (slot < 0) // The scheduler is full. Discard the oldest waiting message with the lowest priority below ours
+  {
+    for (uint8_t i = 0; i < _txScheduler->size; i++)
+    {
+      if ((!_txScheduler->entries[i].inModem) && (_txScheduler->entries[i].priority < priority))
+      {
+        if ((slot < 0) || (_txScheduler->entries[i].priority < _txScheduler->entries[slot].priority)
+            || ((_txScheduler->entries[i].priority == _txScheduler->entries[slot].priority) && ((long)(_txScheduler->entries[i].queuedAt - _txScheduler->entries[slot].queuedAt) < 0)))
+          slot = i;
+      }
+    }
+
+    if (slot < 0)
+      return (SWARM_M138_ERROR_ERROR);
+
+    if (_printDebug == true)
+      _debugPort->println(F("scheduleBinary: scheduler is full. Discarding a lower priority message"));
+  }
+
+  memcpy(_txScheduler->entries[slot].data, data, len);
+  _txScheduler->entries[slot].len = (uint8_t)len;
+  _txScheduler->entries[slot].priority = (uint8_t)priority;
+  _txScheduler->entries[slot].inUse = true;
+  _txScheduler->entries[slot].inModem = false;
+  _txScheduler->entries[slot].useAppID = (appID != 0xFFFF);
+  _txScheduler->entries[slot].appID = appID;
+  _txScheduler->entries[slot].queuedAt = millis();
+  _txScheduler->entries[slot].msg_id = 0;
+
+  return (serviceTxScheduler());
+}
+
+/**************************************************************************/
+/*!
+    @brief  Move scheduled messages into the modem
+            Messages which have been sent (according to the TX queue mirror) are released.
+            Waiting messages older than their class maxAge are discarded.
+            Then, highest priority first:
+              Alarms: every lower priority message in the modem is deleted and rescheduled,
+              so the alarm is at the front of the modem's queue.
+              Others: if the modem window is full, lower priority messages are deleted and
+              rescheduled to make room.
+              The message is queued with the hold duration for its class.
+            Call this regularly, e.g. after checkUnsolicitedMsg.
+    @return SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_ERROR if unsuccessful
+*/
+/**************************************************************************/
+Swarm_M138_Error_e SWARM_M138::serviceTxScheduler(void)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  Swarm_M138_Error_e err = SWARM_M138_ERROR_SUCCESS;
+
+  if (_txScheduler == NULL)
+    return (SWARM_M138_ERROR_ERROR);
+
+  for (uint8_t i = 0; i < _txScheduler->size; i++)
+  {
+    if (!_txScheduler->entries[i].inUse)
+      continue;
+
+    if (_txScheduler->entries[i].inModem)
+    {
+      if (!isTxMessagePending(_txScheduler->entries[i].msg_id)) // Has the message been sent (or deleted)?
+        _txScheduler->entries[i].inUse = false;
+    }
+    else
+    {
+      unsigned long maxAge = _txScheduler->policy[_txScheduler->entries[i].priority].maxAge;
+      if ((maxAge > 0) && ((millis() - _txScheduler->entries[i].queuedAt) >= maxAge)) // Has the message waited too long?
+      {
+        if (_printDebug == true)
+          _debugPort->println(F("serviceTxScheduler: discarding an expired message"));
+        _txScheduler->entries[i].inUse = false;
+      }
+    }
+  }
+
+  int next = txSchedulerNext();
+  while ((next >= 0) && (err == SWARM_M138_ERROR_SUCCESS))
+  {
+    uint8_t priority = _txScheduler->entries[next].priority;
+
+    if (priority == SWARM_M138_TX_PRIORITY_ALARM)
+      err = txSchedulerEvict(priority, true); // Move the alarm to the front
+    else if (getTxQueueDepth() >= _txScheduler->window)
+      err = txSchedulerEvict(priority, false); // Make room if we can
+
+    if ((err != SWARM_M138_ERROR_SUCCESS) || (getTxQueueDepth() >= _txScheduler->window))
+      break; // The modem window is full of messages with the same or higher priority
+
+    uint64_t msg_id = 0;
+    uint32_t hold = _txScheduler->policy[priority].hold;
+    if (_txScheduler->entries[next].useAppID)
+    {
+      if (hold > 0)
+        err = transmitBinaryHold(_txScheduler->entries[next].data, _txScheduler->entries[next].len, &msg_id, hold, _txScheduler->entries[next].appID);
+      else
+        err = transmitBinary(_txScheduler->entries[next].data, _txScheduler->entries[next].len, &msg_id, _txScheduler->entries[next].appID);
+    }
+    else
+    {
+      if (hold > 0)
+        err = transmitBinaryHold(_txScheduler->entries[next].data, _txScheduler->entries[next].len, &msg_id, hold);
+      else
+        err = transmitBinary(_txScheduler->entries[next].data, _txScheduler->entries[next].len, &msg_id);
+    }
+
+    if (err == SWARM_M138_ERROR_SUCCESS)
+    {
+      _txScheduler->entries[next].inModem = true;
+      _txScheduler->entries[next].msg_id = msg_id;
+    }
+
+    next = txSchedulerNext();
+  }
+
+  if ((err == SWARM_M138_ERROR_ERR) && (strstr(commandError, "DBXTOHIVEFULL") != NULL))
+    err = SWARM_M138_ERROR_SUCCESS; // The modem's queue is full. Try again later
+
+  return (err);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Return the number of unsent messages of a priority class
+    @param  priority
+            The priority class
+    @return The number of messages waiting in the scheduler or in the modem's queue
+*/
+/**************************************************************************/
+uint8_t SWARM_M138::getScheduledCount(Swarm_M138_TX_Priority_e priority)
+{
+  uint8_t count = 0;
+
+  if (_txScheduler == NULL)
+    return (0);
+
+  for (uint8_t i = 0; i < _txScheduler->size; i++)
+  {
+    if (_txScheduler->entries[i].inUse && (_txScheduler->entries[i].priority == (uint8_t)priority))
+      count++;
+  }
+
+  return (count);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Enable the interrupt / DMA receive path
+            The library reads the modem's serial data from a ring buffer instead of
+            the serial port. Your UART RX interrupt, DMA interrupt or UART event
+            task passes each received byte (or block of bytes) to feedRxByte(s).
+            This prevents the Arduino core receive buffer from overflowing while
+            your code is busy. Commands are still sent through the serial port.
+    @param  bufferSize
+            The size of the ring buffer in bytes (2 to 65535). One byte is kept free
+    @return True if the memory was allocated successfully, otherwise false
+*/
+/**************************************************************************/
+bool SWARM_M138::enableRxHook(uint16_t bufferSize)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  if (bufferSize < 2)
+    return (false);
+
+  disableRxHook(); // Free any existing ring
+
+  Swarm_M138_RX_Ring_t *ring = (Swarm_M138_RX_Ring_t *)swarm_m138_alloc(sizeof(Swarm_M138_RX_Ring_t) + bufferSize);
+  if (ring == NULL)
+  {
+    if (_printDebug == true)
+      _debugPort->println(F("enableRxHook: not enough memory for the ring buffer!"));
+    return (false);
+  }
+
+  ring->data = (uint8_t *)(ring + 1);
+  ring->head = 0;
+  ring->tail = 0;
+  ring->dropped = 0;
+  ring->highWater = 0;
+  ring->size = bufferSize;
+  _rxRing = ring; // Set this last: feedRxByte(s) does nothing until _rxRing is valid
+
+  return (true);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Disable the interrupt / DMA receive path and free the ring buffer
+            Stop calling feedRxByte(s) before calling this.
+            Any bytes which have not been read are discarded.
+*/
+/**************************************************************************/
+void SWARM_M138::disableRxHook(void)
+{
+  Swarm_M138_RX_Ring_t *ring = _rxRing;
+  _rxRing = NULL;
+  if (ring != NULL)
+    swarm_m138_free(ring);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Add one received byte to the ring buffer
+            Safe to call from an interrupt. If the ring buffer is full, the byte is
+            discarded and counted by getRxDroppedBytes.
+    @param  c
+            The received byte
+*/
+/**************************************************************************/
+SWARM_M138_ISR_ATTR void SWARM_M138::feedRxByte(uint8_t c)
+{
+  feedRxBytes(&c, 1);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Add received bytes to the ring buffer
+            Safe to call from an interrupt (e.g. a DMA half / complete transfer
+            interrupt). If the ring buffer fills, the remaining bytes are discarded
+            and counted by getRxDroppedBytes.
+    @param  data
+            A pointer to the received bytes
+    @param  len
+            The number of bytes
+*/
+/**************************************************************************/
+SWARM_M138_ISR_ATTR void SWARM_M138::feedRxBytes(const uint8_t *data, size_t len)
+{
+  if ((_rxRing == NULL) || (data == NULL))
+    return;
+
+  uint16_t head = _rxRing->head;
+  uint16_t tail = _rxRing->tail;
+
+  for (size_t i = 0; i < len; i++)
+  {
+    uint16_t next = head + 1;
+    if (next == _rxRing->size)
+      next = 0;
+    if (next == tail) // Full?
+    {
+      _rxRing->dropped = _rxRing->dropped + (uint32_t)(len - i);
+      break;
+    }
+    _rxRing->data[head] = data[i];
+    head = next;
+  }
+
+  _rxRing->head = head; // Publish the new bytes
+
+  uint16_t waiting = (head >= tail) ? (head - tail) : (head + _rxRing->size - tail);
+  if (waiting > _rxRing->highWater)
+    _rxRing->highWater = waiting;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Return the number of bytes discarded because the ring buffer was full
+    @return The number of discarded bytes. Zero if the ring buffer is disabled
+*/
+/**************************************************************************/
+uint32_t SWARM_M138::getRxDroppedBytes(void)
+{
+  if (_rxRing == NULL)
+    return (0);
+#ifdef ARDUINO_ARCH_AVR
+  noInterrupts(); // A 32-bit read is not atomic on AVR
+  uint32_t dropped = _rxRing->dropped;
+  interrupts();
+#else
+  uint32_t dropped = _rxRing->dropped;
+#endif
+  return (dropped);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Return the highest number of bytes which have been waiting in the ring buffer
+            Use this to choose the ring buffer size
+    @return The high water mark in bytes. Zero if the ring buffer is disabled
+*/
+/**************************************************************************/
+uint16_t SWARM_M138::getRxHighWater(void)
+{
+  if (_rxRing == NULL)
+    return (0);
+#ifdef ARDUINO_ARCH_AVR
+  noInterrupts(); // A 16-bit read is not atomic on AVR
+  uint16_t highWater = _rxRing->highWater;
+  interrupts();
+#else
+  uint16_t highWater = _rxRing->highWater;
+#endif
+  return (highWater);
+}
+
+#ifdef SWARM_M138_THREADS_AVAILABLE
+/**************************************************************************/
+/*!
+    @brief  Start threaded mode
+            A reader task takes ownership of the serial port. It frames the
+            unsolicited messages into events and pushes them into a lock-free
+            single-producer / single-consumer queue. Commands are posted to the
+            reader task through a second queue: the command functions still block,
+            but unsolicited messages keep being collected while they wait.
+            checkUnsolicitedMsg pops the events and calls the callbacks, so the
+            callbacks run in the caller's task - never inside the reader.
+            Call the command functions and checkUnsolicitedMsg from one task only.
+            ESP32: the reader is a FreeRTOS task. Host builds: the reader is a std::thread.
+    @param  stackSize
+            ESP32 only: the reader task stack size in bytes
+    @param  priority
+            ESP32 only: the reader task priority
+    @return True if the reader task was started, otherwise false
+*/
+/**************************************************************************/
+bool SWARM_M138::beginThreadedMode(uint32_t stackSize, uint8_t priority)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  if (_eventQueue != NULL) // Already running?
+    return (true);
+
+  if (_swarmBacklog == NULL) // begin has not been called
+    return (false);
+
+  _eventQueue = new SWARM_M138_SPSC_Queue<Swarm_M138_Event_t, SWARM_M138_EVENT_QUEUE_DEPTH>;
+  _commandQueue = new SWARM_M138_SPSC_Queue<Swarm_M138_Command_Request_t *, SWARM_M138_COMMAND_QUEUE_DEPTH>;
+  _dispatchEvent = new Swarm_M138_Event_t;
+  _readerLine = swarm_m138_alloc_char(SWARM_M138_EVENT_MAX_LENGTH);
+
+  if ((_eventQueue == NULL) || (_commandQueue == NULL) || (_dispatchEvent == NULL) || (_readerLine == NULL))
+  {
+    if (_printDebug == true)
+      _debugPort->println(F("beginThreadedMode: not enough memory for the queues!"));
+    endThreadedMode();
+    return (false);
+  }
+
+  _readerLineLength = 0;
+  _readerAwaitingResponse = false;
+  _eventDrops = 0;
+  _readerRun = true;
+  _readerRunning = true;
+
+#ifdef SWARM_M138_THREADS_FREERTOS
+  if (xTaskCreate(readerTaskEntry, "swarmReader", stackSize, (void *)this, priority, &_readerTask) != pdPASS)
+  {
+    _readerTask = NULL;
+    _readerRunning = false;
+  }
+#else
+  (void)stackSize;
+  (void)priority;
+  _readerThread = new std::thread([this]()
+                                  {
+                                    while (_readerRun.load())
+                                    {
+                                      if (!readerService())
+                                        readerYield();
+                                    }
+                                    _readerRunning = false;
+                                  });
+  if (_readerThread == NULL)
+    _readerRunning = false;
+#endif
+
+  if (!_readerRunning)
+  {
+    if (_printDebug == true)
+      _debugPort->println(F("beginThreadedMode: could not start the reader task!"));
+    endThreadedMode();
+    return (false);
+  }
+
+  return (true);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Stop threaded mode. The reader task is stopped and the queues are freed
+            Any events which have not been dispatched are discarded.
+*/
+/**************************************************************************/
+void SWARM_M138::endThreadedMode(void)
+{
+  _readerRun = false;
+
+#ifdef SWARM_M138_THREADS_FREERTOS
+  if (_readerTask != NULL)
+  {
+    while (_readerRunning.load()) // Wait for the reader to finish its current pass
+      delay(1);
+    _readerTask = NULL; // The task deletes itself
+  }
+#else
+  if (_readerThread != NULL)
+  {
+    _readerThread->join();
+    delete _readerThread;
+    _readerThread = NULL;
+  }
+#endif
+  _readerRunning = false;
+
+  if ((_readerLine != NULL) && (_readerLineLength > 0) && (_swarmBacklog != NULL)) // Hand any partial sentence back to the backlog
+  {
+    size_t backlogLength = strlen((const char *)_swarmBacklog);
+    if ((backlogLength + _readerLineLength) < _RxBuffSize)
+      memcpy(&_swarmBacklog[backlogLength], _readerLine, _readerLineLength);
+  }
+
+  if (_eventQueue != NULL)
+  {
+    delete _eventQueue;
+    _eventQueue = NULL;
+  }
+  if (_commandQueue != NULL)
+  {
+    delete _commandQueue;
+    _commandQueue = NULL;
+  }
+  if (_dispatchEvent != NULL)
+  {
+    delete _dispatchEvent;
+    _dispatchEvent = NULL;
+  }
+  if (_readerLine != NULL)
+  {
+    swarm_m138_free_char(_readerLine);
+    _readerLine = NULL;
+  }
+  _readerLineLength = 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Check if threaded mode is active
+    @return True if the reader task is running
+*/
+/**************************************************************************/
+bool SWARM_M138::isThreadedMode(void)
+{
+  return ((_eventQueue != NULL) && _readerRunning.load());
+}
+
+/**************************************************************************/
+/*!
+    @brief  Pop the next event from the threaded mode event queue
+            The callbacks are not called. Use this instead of checkUnsolicitedMsg
+            if you want to process the raw sentences yourself.
+    @param  event
+            A pointer to a Swarm_M138_Event_t to hold the event
+    @return True if an event was popped, false if there are none (or threaded mode is not active)
+*/
+/**************************************************************************/
+bool SWARM_M138::popEvent(Swarm_M138_Event_t *event)
+{
+  if ((_eventQueue == NULL) || (event == NULL))
+    return (false);
+
+  return (_eventQueue->pop(*event));
+}
+
+/**************************************************************************/
+/*!
+    @brief  Return the number of events discarded because the event queue was full
+    @return The number of discarded events
+*/
+/**************************************************************************/
+uint32_t SWARM_M138::getEventDropCount(void)
+{
+  return (_eventDrops.load());
+}
+#endif
+
+/**************************************************************************/
+/*!
+    @brief  Enable the typed event queue: an alternative to the callbacks.
+            checkUnsolicitedMsg parses each unsolicited message into the queue.
+            Pop the events with popTypedEvent, at your own pace, outside checkUnsolicitedMsg.
+            You can call library commands and do slow work while handling them.
+            The callbacks are still called if they are set
+    @param  depth
+            The number of events the queue can hold. Each event uses sizeof(Swarm_M138_Typed_Event_t) bytes
+    @param  policy
+            What to do when the queue is full:
+            SWARM_M138_OVERFLOW_DROP_OLDEST: overwrite the oldest event
+            SWARM_M138_OVERFLOW_DROP_NEWEST: discard the new event
+    @return True if the queue was allocated successfully, otherwise false
+*/
+/**************************************************************************/
+bool SWARM_M138::enableTypedEvents(uint8_t depth, Swarm_M138_Queue_Overflow_e policy)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  SWARM_M138_PAUSE_READER();
+  if ((depth == 0) || (policy > SWARM_M138_OVERFLOW_DROP_OLDEST))
+    return (false);
+
+  disableTypedEvents(); // Free any existing queue
+
+  _typedEvents = (Swarm_M138_Typed_Events_t *)swarm_m138_alloc(sizeof(Swarm_M138_Typed_Events_t) + (sizeof(Swarm_M138_Typed_Event_t) * depth));
+  if (_typedEvents == NULL)
+  {
+    if (_printDebug == true)
+      _debugPort->println(F("enableTypedEvents: not enough memory for the queue!"));
+    return (false);
+  }
+
+  _typedEvents->events = (Swarm_M138_Typed_Event_t *)(_typedEvents + 1);
+  _typedEvents->size = depth;
+  _typedEvents->policy = policy;
+  clearTypedEvents();
+  return (true);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Disable the typed event queue and free its memory. Any waiting events are discarded
+*/
+/**************************************************************************/
+void SWARM_M138::disableTypedEvents(void)
+{
+  SWARM_M138_PAUSE_READER();
+  if (_typedEvents != NULL)
+  {
+    swarm_m138_free(_typedEvents);
+    _typedEvents = NULL;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief  Pop the oldest event from the typed event queue
+    @param  event
+            A pointer to a Swarm_M138_Typed_Event_t which will hold the event.
+            Check event->type before reading the union
+    @return True if an event was popped, false if the queue is empty (or disabled)
+*/
+/**************************************************************************/
+bool SWARM_M138::popTypedEvent(Swarm_M138_Typed_Event_t *event)
+{
+  if ((_typedEvents == NULL) || (_typedEvents->count == 0) || (event == NULL))
+    return (false);
+
+  memcpy(event, &_typedEvents->events[_typedEvents->head], sizeof(Swarm_M138_Typed_Event_t));
+  _typedEvents->head = (uint8_t)((_typedEvents->head + 1) % _typedEvents->size);
+  _typedEvents->count--;
+  return (true);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Return the number of events waiting in the typed event queue
+    @return The number of events waiting
+*/
+/**************************************************************************/
+uint8_t SWARM_M138::getTypedEventCount(void)
+{
+  if (_typedEvents == NULL)
+    return (0);
+  return (_typedEvents->count);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Return the number of events discarded because the typed event queue was full
+    @return The number of events discarded (overwritten or rejected, depending on the policy)
+*/
+/**************************************************************************/
+uint32_t SWARM_M138::getTypedEventDrops(void)
+{
+  if (_typedEvents == NULL)
+    return (0);
+  return (_typedEvents->dropped);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Return the highest number of events which have been waiting in the typed event queue.
+            If it reaches the depth, the application is not popping the events quickly enough
+    @return The high water mark
+*/
+/**************************************************************************/
+uint8_t SWARM_M138::getTypedEventHighWater(void)
+{
+  if (_typedEvents == NULL)
+    return (0);
+  return (_typedEvents->highWater);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Discard any events waiting in the typed event queue. Reset the drop count and high water mark
+*/
+/**************************************************************************/
+void SWARM_M138::clearTypedEvents(void)
+{
+  if (_typedEvents == NULL)
+    return;
+  _typedEvents->head = 0;
+  _typedEvents->count = 0;
+  _typedEvents->highWater = 0;
+  _typedEvents->dropped = 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Subscribe to only these unsolicited message types.
+            The others are dropped as soon as their tag is known: before they are
+            buffered, checksummed or parsed. In threaded mode the reader task discards them byte by byte.
+            Command responses are not affected.
+            The types needed by the enabled library features are always kept, whatever the mask:
+            $TD for the TX queue mirror, the transmit scheduler and the outbox, and $RD for
+            reassembly and the duplicate filter. They are not sampled either
+    @param  mask
+            The types to keep: e.g. SWARM_M138_SUBSCRIBE(SWARM_M138_EVENT_DATE_TIME) | SWARM_M138_SUBSCRIBE(SWARM_M138_EVENT_RECEIVE_MESSAGE)
+            SWARM_M138_SUBSCRIBE_ALL keeps every type.
+            SWARM_M138_SUBSCRIBE_AUTO (the default) keeps the types which have a callback or are needed by a
+            library feature, and only filters the backlog
+*/
+/**************************************************************************/
+void SWARM_M138::setSubscriptions(uint16_t mask)
+{
+  SWARM_M138_PAUSE_READER();
+  if ((mask & SWARM_M138_SUBSCRIBE_AUTO) != 0)
+    _subscriptionMask = SWARM_M138_SUBSCRIBE_AUTO;
+  else
+    _subscriptionMask = mask & SWARM_M138_SUBSCRIBE_ALL;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Return the unsolicited message types which are being kept
+    @return The subscription mask. With SWARM_M138_SUBSCRIBE_AUTO, the types which have a callback
+            or are needed by a library feature. An explicit mask includes the types needed by the
+            enabled library features
+*/
+/**************************************************************************/
+uint16_t SWARM_M138::getSubscriptions(void)
+{
+  uint16_t mask = _subscriptionMask;
+  if ((mask & SWARM_M138_SUBSCRIBE_AUTO) != 0)
+    mask = subscriptionsNeeded();
+  else
+    mask |= subscriptionsRequired();
+  return (mask);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Keep only every Nth unsolicited message of this type: e.g. every 10th $GN.
+            The first message is kept, then the next N-1 are dropped
+    @param  type
+            The message type: e.g. SWARM_M138_EVENT_GEOSPATIAL
+    @param  everyNth
+            Keep one message in everyNth. 0 or 1 keeps them all.
+            The sampling state is allocated the first time everyNth is greater than 1
+    @return True if successful, false if type is invalid or the memory could not be allocated
+*/
+/**************************************************************************/
+bool SWARM_M138::setSubscriptionSampling(Swarm_M138_Event_Type_e type, uint16_t everyNth)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  SWARM_M138_PAUSE_READER();
+  if ((type == SWARM_M138_EVENT_UNKNOWN) || (type > SWARM_M138_EVENT_TRANSMIT_DATA))
+    return (false);
+
+  if (_subscriptionSampling == NULL)
+  {
+    if (everyNth <= 1)
+      return (true); // Nothing to do. Every message is kept
+
+    _subscriptionSampling = (Swarm_M138_Subscription_Sampling_t *)swarm_m138_alloc(sizeof(Swarm_M138_Subscription_Sampling_t));
+    if (_subscriptionSampling == NULL)
+    {
+      if (_printDebug == true)
+        _debugPort->println(F("setSubscriptionSampling: not enough memory for _subscriptionSampling!"));
+      return (false);
+    }
+
+    for (uint8_t i = 0; i <= SWARM_M138_EVENT_TRANSMIT_DATA; i++)
+    {
+      _subscriptionSampling->every[i] = 1;
+      _subscriptionSampling->count[i] = 0;
+    }
+  }
+
+  _subscriptionSampling->every[type] = (everyNth == 0) ? 1 : everyNth;
+  return (true);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Return the number of unsolicited messages dropped by the subscriptions (and sampling)
+    @return The number of messages dropped
+*/
+/**************************************************************************/
+uint32_t SWARM_M138::getFilteredCount(void)
+{
+  return (_subscriptionFiltered);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Return the number of bytes waiting in the backlog.
+            The backlog holds the sentences which arrive while a command is
+            waiting for its response, until checkUnsolicitedMsg processes them
+    @return The number of bytes
+*/
+/**************************************************************************/
+uint16_t SWARM_M138::getBacklogLength(void)
+{
+  if (_swarmBacklog == NULL)
+    return (0);
+  return ((uint16_t)strlen((const char *)_swarmBacklog));
+}
+
+/**************************************************************************/
+/*!
+    @brief  Return the highest number of bytes which have been waiting in the backlog.
+            If this approaches the buffer size (512 bytes), unsolicited messages are
+            being lost. Call checkUnsolicitedMsg more often, or reduce the message rates
+    @return The high water mark in bytes
+*/
+/**************************************************************************/
+uint16_t SWARM_M138::getBacklogHighWater(void)
+{
+  return (_backlogHighWater);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Return the number of times received bytes were not copied into the backlog
+            because it was full
+    @return The overflow count
+*/
+/**************************************************************************/
+uint32_t SWARM_M138::getBacklogOverflows(void)
+{
+  return (_backlogOverflows);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Reset the backlog high water mark and the overflow count
+*/
+/**************************************************************************/
+void SWARM_M138::resetBacklogStats(void)
+{
+  _backlogHighWater = 0;
+  _backlogOverflows = 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Select how long checkUnsolicitedMsg and sendCommand wait for the rest
+            of a burst of serial data.
+            SWARM_M138_RX_WINDOW_FIXED waits until no data has arrived for 12ms.
+            Every checkUnsolicitedMsg which finds data costs at least 12ms.
+            SWARM_M138_RX_WINDOW_GAP returns as soon as the data ends with \n and
+            nothing more is waiting - in well under 1ms for a short message.
+            If the data ends part way through a sentence, it waits until nothing has
+            arrived for the time taken to receive fifoThreshold + 2 bytes
+    @param  mode
+            SWARM_M138_RX_WINDOW_FIXED or SWARM_M138_RX_WINDOW_GAP
+    @param  fifoThreshold
+            The number of bytes the UART receives before available() changes.
+            ~120 on ESP32, 1 on most other platforms. With the interrupt receive
+            path: the largest number of bytes passed to feedRxBytes at once
+*/
+/**************************************************************************/
+void SWARM_M138::setRxWindowMode(Swarm_M138_RX_Window_e mode, uint16_t fifoThreshold)
+{
+  _rxWindowMode = mode;
+  _rxFifoThreshold = fifoThreshold;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Return the receive window mode
+    @return SWARM_M138_RX_WINDOW_FIXED or SWARM_M138_RX_WINDOW_GAP
+*/
+/**************************************************************************/
+Swarm_M138_RX_Window_e SWARM_M138::getRxWindowMode(void)
+{
+  return (_rxWindowMode);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Return the inter-byte gap used by SWARM_M138_RX_WINDOW_GAP:
+            the time to receive fifoThreshold + 2 bytes (10 bits each) at the baud rate
+    @return The gap in microseconds
+*/
+/**************************************************************************/
+unsigned long SWARM_M138::getRxGapMicros(void)
+{
+  unsigned long baud = (_baud > 0) ? _baud : SWARM_M138_SERIAL_BAUD_RATE;
+  return ((unsigned long)((((uint64_t)_rxFifoThreshold + 2) * 10000000ULL) / baud));
+}
+
+#ifdef SWARM_M138_ALLOC_HOOKS
+/**************************************************************************/
+/*!
+    @brief  Set the allocator used for all of the library's buffers
+            E.g. a fixed pool, or an allocator which fails on demand to test the
+            out-of-memory paths. Each block is returned to the allocator which
+            allocated it, so this can be called at any time.
+            Only available when SWARM_M138_ALLOC_HOOKS is defined.
+    @param  allocate
+            Return a pointer to size bytes, or NULL if there is no memory.
+            NULL restores new
+    @param  release
+            Free ptr. size is the size which was passed to allocate.
+            NULL restores delete
+    @param  context
+            Passed to allocate and release
+*/
+/**************************************************************************/
+void SWARM_M138::setAllocator(void *(*allocate)(size_t size, void *context), void (*release)(void *ptr, size_t size, void *context), void *context)
+{
+  if ((allocate == NULL) || (release == NULL))
+  {
+    allocate = NULL;
+    release = NULL;
+  }
+  _allocate = allocate;
+  _release = release;
+  _allocContext = context;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Copy the heap use counters.
+            To find what one call allocates (or leaks), compare the counters
+            before and after it: outstanding should return to where it was.
+            Only available when SWARM_M138_ALLOC_HOOKS is defined.
+    @param  stats
+            A pointer to a Swarm_M138_Alloc_Stats_t struct to hold the counters
+*/
+/**************************************************************************/
+void SWARM_M138::getAllocStats(Swarm_M138_Alloc_Stats_t *stats)
+{
+  if (stats == NULL)
+    return;
+  stats->allocations = _allocCount;
+  stats->frees = _freeCount;
+  stats->failures = _allocFailures;
+  stats->outstanding = stats->allocations - stats->frees;
+  stats->currentBytes = _allocBytes;
+  stats->peakBytes = _allocPeak;
+  stats->largest = _allocLargest;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Copy the heap use counters for each public function.
+            Each block is counted against the public function which was running
+            when it was allocated - the outermost one, if public functions call
+            each other - including its free, whenever that happens. So outstanding
+            shows which function's blocks have not been freed.
+            The first SWARM_M138_ALLOC_ENTRIES - 1 functions to allocate get their
+            own entry. An entry named "(other)" counts the rest, and any
+            allocation made outside a public function.
+            Only available when SWARM_M138_ALLOC_HOOKS is defined.
+    @param  stats
+            A pointer to an array of Swarm_M138_Alloc_Entry_Stats_t structs
+    @param  maxEntries
+            The number of structs in the array
+    @return The number of entries copied
+*/
+/**************************************************************************/
+uint8_t SWARM_M138::getAllocEntryStats(Swarm_M138_Alloc_Entry_Stats_t *stats, uint8_t maxEntries)
+{
+  if (stats == NULL)
+    return (0);
+  uint8_t count = 0;
+  for (uint8_t i = 0; (i < _allocEntryCount) && (count < maxEntries); i++)
+  {
+    if (_allocEntries[i].entry == NULL) // Freed by resetAllocStats
+      continue;
+    stats[count] = _allocEntries[i];
+    stats[count].outstanding = stats[count].allocations - stats[count].frees;
+    count++;
+  }
+  return (count);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Zero the allocation, free and failure counters, including those
+            for each public function. A function whose blocks have all been
+            freed loses its entry, making room for others.
+            The peak restarts from the bytes currently allocated.
+            currentBytes is not changed. outstanding restarts from zero.
+*/
+/**************************************************************************/
+void SWARM_M138::resetAllocStats(void)
+{
+  _allocCount = 0;
+  _freeCount = 0;
+  _allocFailures = 0;
+  _allocPeak = (uint32_t)_allocBytes;
+  _allocLargest = 0;
+  for (uint8_t i = 0; i < _allocEntryCount; i++)
+  {
+    _allocEntries[i].allocations = 0;
+    _allocEntries[i].frees = 0;
+    _allocEntries[i].failures = 0;
+    if ((_allocEntries[i].currentBytes == 0) && (_allocEntries[i].entry != NULL) && (strcmp(_allocEntries[i].entry, "(other)") != 0))
+      _allocEntries[i].entry = NULL; // None of its blocks are live. Let another function use the entry
+  }
+}
+#endif
+
+/**************************************************************************/
+/*!
+    @brief  Record the wire trace into a RAM ring buffer
+            Every byte sent to and received from the modem is recorded, with
+            its direction and a timestamp in microseconds. When the buffer is
+            full, the oldest records are discarded. Call dumpTrace to copy the
+            trace to a file or serial port
+    @param  bufferSize
+            The size of the ring buffer in bytes. At least SWARM_M138_TRACE_MIN_SIZE
+    @return True if the memory was allocated successfully, otherwise false
+*/
+/**************************************************************************/
+bool SWARM_M138::enableTrace(size_t bufferSize)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  if (bufferSize < SWARM_M138_TRACE_MIN_SIZE)
+    bufferSize = SWARM_M138_TRACE_MIN_SIZE;
+
+  if (_traceRing != NULL) // Free any existing ring
+  {
+    swarm_m138_free(_traceRing);
+    _traceRing = NULL;
+  }
+
+  Swarm_M138_Trace_Ring_t *ring = (Swarm_M138_Trace_Ring_t *)swarm_m138_alloc(sizeof(Swarm_M138_Trace_Ring_t) + bufferSize);
+  if (ring == NULL)
+  {
+    if (_printDebug == true)
+      _debugPort->println(F("enableTrace: not enough memory for the ring buffer!"));
+    return (false);
+  }
+
+  ring->data = (uint8_t *)(ring + 1);
+  ring->size = bufferSize;
+  ring->head = 0;
+  ring->tail = 0;
+  ring->used = 0;
+  _traceDropped = 0;
+  _traceRing = ring;
+
+  return (true);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Stream the wire trace to a Print (e.g. an SD card File, or a second serial port)
+            SWARM_M138_TRACE_MAGIC is written first, then each record as it happens.
+            The port must be fast enough to keep up with the modem
+    @param  tracePort
+            The Print to write the trace to
+*/
+/**************************************************************************/
+void SWARM_M138::enableTrace(Print &tracePort)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  _tracePort = &tracePort;
+  _tracePort->write((const uint8_t *)SWARM_M138_TRACE_MAGIC, 4);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Stop recording the wire trace. Free the ring buffer
+*/
+/**************************************************************************/
+void SWARM_M138::disableTrace(void)
+{
+  _tracePort = NULL;
+  if (_traceRing != NULL)
+  {
+    swarm_m138_free(_traceRing);
+    _traceRing = NULL;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief  Write the wire trace in the ring buffer to a Print, oldest record first
+            The trace is not cleared, so it can be dumped again later
+    @param  port
+            The Print to write the trace to (e.g. an SD card File)
+    @return The number of bytes written, including the magic. 0 if there is no ring buffer
+*/
+/**************************************************************************/
+size_t SWARM_M138::dumpTrace(Print &port)
+{
+  if (_traceRing == NULL)
+    return (0);
+
+  size_t written = port.write((const uint8_t *)SWARM_M138_TRACE_MAGIC, 4);
+  size_t firstPart = _traceRing->size - _traceRing->tail;
+  if (firstPart > _traceRing->used)
+    firstPart = _traceRing->used;
+  written += port.write(&_traceRing->data[_traceRing->tail], firstPart);
+  if (_traceRing->used > firstPart)
+    written += port.write(_traceRing->data, _traceRing->used - firstPart);
+  return (written);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Return the number of trace records which have been lost
+            Records are discarded from the ring buffer to make room for new ones,
+            and lost when the trace port does not accept all of the bytes
+    @return The number of lost records
+*/
+/**************************************************************************/
+uint32_t SWARM_M138::getTraceDropCount(void)
+{
+  return (_traceDropped);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Enable adaptive command timeouts
+            Each class of command (each fixed timeout, e.g.
+            SWARM_M138_STANDARD_RESPONSE_TIMEOUT) learns its response time. Once
+            SWARM_M138_ADAPTIVE_MIN_SAMPLES responses have been seen, a command
+            times out if the modem has sent nothing at all after the smoothed
+            response time plus four times its mean deviation. If the modem has
+            sent anything, the command waits until the ceiling as before. After
+            each timeout, the timeout of the class is doubled until a response
+            arrives. Until then, each class uses its fixed timeout.
+    @param  floorMillis
+            The shortest timeout (ms)
+    @param  ceilingMillis
+            The longest timeout (ms). It never shortens a class: each class uses the
+            longer of this and its fixed timeout. 0 uses the fixed timeout of each class
+    @return True if the memory was allocated successfully, otherwise false
+*/
+/**************************************************************************/
+bool SWARM_M138::enableAdaptiveTimeouts(unsigned long floorMillis, unsigned long ceilingMillis)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  if (_adaptiveTimeouts == NULL)
+  {
+    _adaptiveTimeouts = (Swarm_M138_Adaptive_Timeouts_t *)swarm_m138_alloc(sizeof(Swarm_M138_Adaptive_Timeouts_t));
+    if (_adaptiveTimeouts == NULL)
+    {
+      if (_printDebug == true)
+        _debugPort->println(F("enableAdaptiveTimeouts: not enough memory for the estimates!"));
+      return (false);
+    }
+    resetAdaptiveTimeouts();
+  }
+
+  _adaptiveTimeouts->floor = floorMillis;
+  _adaptiveTimeouts->ceiling = ceilingMillis;
+  return (true);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Go back to the fixed command timeouts. Free the estimates
+*/
+/**************************************************************************/
+void SWARM_M138::disableAdaptiveTimeouts(void)
+{
+  if (_adaptiveTimeouts != NULL)
+    swarm_m138_free(_adaptiveTimeouts);
+  _adaptiveTimeouts = NULL;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Forget the learned response times, e.g. after the modem restarts.
+            The fixed timeouts are used until the classes have learned again
+*/
+/**************************************************************************/
+void SWARM_M138::resetAdaptiveTimeouts(void)
+{
+  if (_adaptiveTimeouts == NULL)
+    return;
+  memset(_adaptiveTimeouts->classes, 0, sizeof(_adaptiveTimeouts->classes));
+}
+
+/**************************************************************************/
+/*!
+    @brief  Return the current adaptive timeout for a class of command
+    @param  fixedTimeout
+            The class: the fixed timeout its commands use, e.g. SWARM_M138_STANDARD_RESPONSE_TIMEOUT
+    @return How long a command in the class will wait if the modem sends nothing (ms).
+            fixedTimeout if the timeouts are not adaptive, or the class has not learned enough yet
+*/
+/**************************************************************************/
+unsigned long SWARM_M138::getAdaptiveTimeout(unsigned long fixedTimeout)
+{
+  return (adaptiveLimit(timeoutClass(fixedTimeout, false), fixedTimeout));
+}
+
+#ifdef SWARM_M138_STATS
+// The command tags, in the order of Swarm_M138_Stats_t.commands. The last entry is for any other command
+static const char swarm_m138_stats_tags[SWARM_M138_STATS_TAGS][4] = {
+    "$CS", "$DT", "$FV", "$GJ", "$GN", "$GP", "$GS", "$MM", "$MT", "$PO", "$PW", "$RS", "$RT", "$SL", "$TD", "$??"};
+
+/**************************************************************************/
+/*!
+    @brief  Copy the statistics: for each command tag, the number of commands,
+            timeouts, ERR replies, checksum failures and a histogram of the
+            response times. Plus the backlog and response buffer overflows and
+            the unsolicited messages discarded because of a bad checksum.
+            Only available when SWARM_M138_STATS is defined.
+    @param  stats
+            A pointer to a Swarm_M138_Stats_t struct to hold the statistics
+*/
+/**************************************************************************/
+void SWARM_M138::getStats(Swarm_M138_Stats_t *stats)
+{
+  if (stats == NULL)
+    return;
+
+  for (uint8_t tag = 0; tag < SWARM_M138_STATS_TAGS; tag++)
+  {
+    uint32_t count = _statsTimeouts[tag];
+    for (uint8_t bucket = 0; bucket < SWARM_M138_STATS_BUCKETS; bucket++)
+    {
+      stats->commands[tag].histogram[bucket] = _statsHistogram[tag][bucket];
+      count += stats->commands[tag].histogram[bucket];
+    }
+    stats->commands[tag].count = (count > 0xFFFF) ? 0xFFFF : (uint16_t)count;
+    stats->commands[tag].timeouts = _statsTimeouts[tag];
+    stats->commands[tag].errors = _statsErrors[tag];
+    stats->commands[tag].checksumFailures = _statsChecksumFailures[tag];
+  }
+
+  stats->backlogOverflows = (uint32_t)_backlogOverflows - _statsBacklogOverflowsAtReset;
+  stats->responseOverflows = _statsResponseOverflows;
+  stats->eventChecksumFailures = _statsEventChecksumFailures;
+  stats->eventMemoryFailures = _statsEventMemoryFailures;
+  stats->millisSinceReset = millis() - _statsResetAt;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Zero the statistics. The backlog statistics (getBacklogHighWater etc.)
+            are not changed
+*/
+/**************************************************************************/
+void SWARM_M138::resetStats(void)
+{
+  for (uint8_t tag = 0; tag < SWARM_M138_STATS_TAGS; tag++)
+  {
+    for (uint8_t bucket = 0; bucket < SWARM_M138_STATS_BUCKETS; bucket++)
+      _statsHistogram[tag][bucket] = 0;
+    _statsTimeouts[tag] = 0;
+    _statsErrors[tag] = 0;
+    _statsChecksumFailures[tag] = 0;
+  }
+  _statsResponseOverflows = 0;
+  _statsEventChecksumFailures = 0;
+  _statsEventMemoryFailures = 0;
+  _statsBacklogOverflowsAtReset = _backlogOverflows;
+  _statsResetAt = millis();
+}
+
+/**************************************************************************/
+/*!
+    @brief  Return the command tag for an entry in Swarm_M138_Stats_t.commands
+    @param  index
+            The index: 0 to SWARM_M138_STATS_TAGS - 1
+    @return The tag, e.g. "$DT". "$??" for the entry which counts any other command
+*/
+/**************************************************************************/
+const char *SWARM_M138::statsTag(uint8_t index)
+{
+  if (index >= SWARM_M138_STATS_TAGS)
+    index = SWARM_M138_STATS_TAGS - 1;
+  return (swarm_m138_stats_tags[index]);
+}
+#endif
+
+/**************************************************************************/
+/*!
+    @brief  Allocate the URC handler table. registerUrcHandler calls this
+            (with the default size) if required
+    @param  maxHandlers
+            The number of handlers which can be registered (1 to 254)
+    @return True if the memory was allocated successfully, otherwise false
+*/
+/**************************************************************************/
+bool SWARM_M138::enableUrcHandlers(uint8_t maxHandlers)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  SWARM_M138_PAUSE_READER();
+  if (_urcTable != NULL)
+    return (true);
+
+  if ((maxHandlers == 0) || (maxHandlers == 255)) // next holds the entry index + 1
+    return (false);
+
+  uint8_t buckets = 1; // A power of two, at least maxHandlers, so the chains are short
+  while ((buckets < maxHandlers) && (buckets < 128))
+    buckets <<= 1;
+
+  size_t length = sizeof(Swarm_M138_URC_Table_t) + (sizeof(Swarm_M138_URC_Handler_t) * maxHandlers) + buckets;
+  _urcTable = (Swarm_M138_URC_Table_t *)swarm_m138_alloc(length);
+  if (_urcTable == NULL)
+  {
+    if (_printDebug == true)
+      _debugPort->println(F("enableUrcHandlers: not enough memory for the table!"));
+    return (false);
+  }
+
+  memset(_urcTable, 0, length);
+  _urcTable->handlers = (Swarm_M138_URC_Handler_t *)(_urcTable + 1);
+  _urcTable->buckets = (uint8_t *)(_urcTable->handlers + maxHandlers);
+  _urcTable->size = maxHandlers;
+  _urcTable->bucketCount = buckets;
+  return (true);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Unregister all of the URC handlers and free the table
+*/
+/**************************************************************************/
+void SWARM_M138::disableUrcHandlers(void)
+{
+  SWARM_M138_PAUSE_READER();
+  if (_urcTable != NULL)
+  {
+    swarm_m138_free(_urcTable);
+    _urcTable = NULL;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief  Register a handler for unsolicited messages which start with prefix.
+            Use this to parse messages which the library does not know about -
+            from newer firmware, or undocumented - or to replace a built-in parser.
+            The handler is called by checkUnsolicitedMsg, before the built-in parser,
+            with a view of the message and context. If more than one prefix matches,
+            the longest wins. The handler returns true if it has dealt with the
+            message, or false to let the built-in parser (and its callback) see it too.
+            Messages whose tag has a handler are never dropped by the subscriptions
+            or pruned from the backlog.
+            The prefix must start with a complete tag: the handlers are looked up by tag.
+            "$XY" matches "$XY 1,2" and "$XY,1" but not "$XYZ 1". After the tag, any prefix
+            matches: "$M138 GN" matches "$M138 GNSS" and "$M138 GNSS2"
+    @param  prefix
+            The start of the message, including the $. E.g. "$XY" or "$M138 GNSS".
+            The tag is the $ followed by upper case letters and digits, up to the first
+            space or comma. Up to SWARM_M138_URC_PREFIX_MAX_LENGTH characters
+    @param  handler
+            The address of the function to be called
+    @param  context
+            Passed to the handler. E.g. a pointer to an object
+    @return True if the handler was registered. False if the prefix is invalid,
+            the table is full, or the memory allocation failed
+*/
+/**************************************************************************/
+bool SWARM_M138::registerUrcHandler(const char *prefix, bool (*handler)(const Swarm_M138_Line_View_t *line, void *context), void *context)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  SWARM_M138_PAUSE_READER();
+  if ((prefix == NULL) || (handler == NULL) || (prefix[0] != '$'))
+    return (false);
+
+  size_t prefixLength = strlen(prefix);
+  if ((prefixLength < 2) || (prefixLength > SWARM_M138_URC_PREFIX_MAX_LENGTH))
+    return (false);
+
+  size_t tagLength = urcTagLength(prefix, prefixLength);
+  if ((tagLength < 2) || (prefix[tagLength] == '*')) // The tag must be complete: the lookup only finds whole tags
+    return (false);
+  for (size_t i = 1; i < tagLength; i++)
+  {
+    if (!(((prefix[i] >= 'A') && (prefix[i] <= 'Z')) || ((prefix[i] >= '0') && (prefix[i] <= '9'))))
+      return (false);
+  }
+
+  if (!enableUrcHandlers())
+    return (false);
+
+  uint8_t bucket = urcBucket(prefix, tagLength);
+
+  // Replace the handler if the prefix is already registered
+  for (uint8_t next = _urcTable->buckets[bucket]; next != 0; next = _urcTable->handlers[next - 1].next)
+  {
+    Swarm_M138_URC_Handler_t *entry = &_urcTable->handlers[next - 1];
+    if (strcmp(entry->prefix, prefix) == 0)
+    {
+      entry->handler = handler;
+      entry->context = context;
+      return (true);
+    }
+  }
+
+  for (uint8_t i = 0; i < _urcTable->size; i++)
+  {
+    Swarm_M138_URC_Handler_t *entry = &_urcTable->handlers[i];
+    if (entry->prefix[0] == 0) // Is this entry unused?
+    {
+      memcpy(entry->prefix, prefix, prefixLength + 1);
+      entry->tagLength = (uint8_t)tagLength;
+      entry->handler = handler;
+      entry->context = context;
+      entry->next = _urcTable->buckets[bucket]; // Add it to the front of the chain
+      _urcTable->buckets[bucket] = i + 1;
+      return (true);
+    }
+  }
+
+  if (_printDebug == true)
+    _debugPort->println(F("registerUrcHandler: the table is full!"));
+  return (false);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Unregister the handler for prefix
+    @param  prefix
+            The prefix passed to registerUrcHandler
+    @return True if the handler was unregistered. False if the prefix was not registered
+*/
+/**************************************************************************/
+bool SWARM_M138::unregisterUrcHandler(const char *prefix)
+{
+  SWARM_M138_PAUSE_READER();
+  if ((prefix == NULL) || (_urcTable == NULL))
+    return (false);
+
+  uint8_t bucket = urcBucket(prefix, urcTagLength(prefix, strlen(prefix)));
+
+  uint8_t *link = &_urcTable->buckets[bucket];
+  while (*link != 0)
+  {
+    Swarm_M138_URC_Handler_t *entry = &_urcTable->handlers[*link - 1];
+    if (strcmp(entry->prefix, prefix) == 0)
+    {
+      *link = entry->next; // Remove it from the chain
+      memset(entry, 0, sizeof(Swarm_M138_URC_Handler_t));
+      return (true);
+    }
+    link = &entry->next;
+  }
+
+  return (false);
+}
+
+#ifdef SWARM_M138_COROUTINES_AVAILABLE
+/**************************************************************************/
+/*!
+    @brief  Send a command from a coroutine. co_await the result:
+            Swarm_M138_Error_e err = co_await mySwarm.commandAsync(command, "$MT ", "$MT ERR", response, sizeof(response));
+            The commands are sent one at a time, in the order they were awaited
+    @param  command
+            The command, including the asterix: e.g. "$MT C=U*"
+            The buffer needs room for four more bytes: the checksum is added in place, plus a line feed and null.
+            It must remain valid until the co_await completes
+    @param  expectedResponseStart
+            The start of the expected response: e.g. "$MT "
+    @param  expectedErrorStart
+            The start of the expected error: e.g. "$MT ERR". Can be NULL
+    @param  responseDest
+            A pointer to the buffer which will hold the response sentence (without the line feed). Can be NULL
+    @param  destSize
+            The size of responseDest
+    @param  timeout
+            The time to wait for the response (milliseconds)
+    @return An awaitable. co_await returns:
+            SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_TIMEOUT if the response did not arrive in time
+            SWARM_M138_ERROR_ERROR if unsuccessful (e.g. the response did not fit in responseDest)
+*/
+/**************************************************************************/
+SWARM_M138_Awaitable SWARM_M138::commandAsync(char *command, const char *expectedResponseStart, const char *expectedErrorStart,
+                                              char *responseDest, size_t destSize, unsigned long timeout)
+{
+  SWARM_M138_Awaitable awaitable(this, SWARM_M138_AWAIT_COMMAND);
+
+  if ((command == NULL) || (expectedResponseStart == NULL))
+  {
+    awaitable._result = SWARM_M138_ERROR_ERROR;
+    awaitable._ready = true; // Don't suspend
+    return (awaitable);
+  }
+
+  addChecksumLF(command); // Add the checksum bytes and line feed
+
+  awaitable._command = command;
+  awaitable._expectedResponseStart = expectedResponseStart;
+  awaitable._expectedErrorStart = expectedErrorStart;
+  awaitable._responseDest = responseDest;
+  awaitable._destSize = destSize;
+  awaitable._timeout = timeout;
+  return (awaitable);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Get the most recent $DT message from a coroutine. co_await the result
+    @param  dateTime
+            A pointer to a Swarm_M138_DateTimeData_t struct which will hold the result.
+            It must remain valid until the co_await completes
+    @return An awaitable. co_await returns:
+            SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_TIMEOUT if the response did not arrive in time
+            SWARM_M138_ERROR_ERROR if unsuccessful
+*/
+/**************************************************************************/
+SWARM_M138_Awaitable SWARM_M138::getDateTimeAsync(Swarm_M138_DateTimeData_t *dateTime)
+{
+  SWARM_M138_Awaitable awaitable(this, SWARM_M138_AWAIT_DATE_TIME);
+
+  sprintf(awaitable._commandBuffer, "%s @*", SWARM_M138_COMMAND_DATE_TIME_STAT); // Copy the command, add the asterix
+  addChecksumLF(awaitable._commandBuffer); // Add the checksum bytes and line feed
+
+  awaitable._expectedResponseStart = "$DT ";
+  awaitable._expectedErrorStart = "$DT ERR";
+  awaitable._out = (void *)dateTime;
+  return (awaitable);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Get the most recent $GN message from a coroutine. co_await the result
+    @param  info
+            A pointer to a Swarm_M138_GeospatialData_t struct which will hold the result.
+            It must remain valid until the co_await completes
+    @return An awaitable. co_await returns:
+            SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_TIMEOUT if the response did not arrive in time
+            SWARM_M138_ERROR_ERROR if unsuccessful
+*/
+/**************************************************************************/
+SWARM_M138_Awaitable SWARM_M138::getGeospatialInfoAsync(Swarm_M138_GeospatialData_t *info)
+{
+  SWARM_M138_Awaitable awaitable(this, SWARM_M138_AWAIT_GEOSPATIAL);
+
+  sprintf(awaitable._commandBuffer, "%s @*", SWARM_M138_COMMAND_GEOSPATIAL_INFO); // Copy the command, add the asterix
+  addChecksumLF(awaitable._commandBuffer); // Add the checksum bytes and line feed
+
+  awaitable._expectedResponseStart = "$GN ";
+  awaitable._expectedErrorStart = "$GN ERR";
+  awaitable._out = (void *)info;
+  return (awaitable);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Get the number of RX messages from a coroutine. co_await the result
+    @param  count
+            A pointer to a uint16_t which will hold the count.
+            It must remain valid until the co_await completes
+    @param  unread
+            If true, only count the unread messages. Otherwise count all messages
+    @return An awaitable. co_await returns:
+            SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_TIMEOUT if the response did not arrive in time
+            SWARM_M138_ERROR_INVALID_FORMAT if the response was not a count
+            SWARM_M138_ERROR_ERROR if unsuccessful
+*/
+/**************************************************************************/
+SWARM_M138_Awaitable SWARM_M138::getRxMessageCountAsync(uint16_t *count, bool unread)
+{
+  SWARM_M138_Awaitable awaitable(this, SWARM_M138_AWAIT_MESSAGE_COUNT);
+
+  if (unread)
+    sprintf(awaitable._commandBuffer, "%s C=U*", SWARM_M138_COMMAND_MSG_RX_MGMT); // Copy the command, add the asterix
+  else
+    sprintf(awaitable._commandBuffer, "%s C=**", SWARM_M138_COMMAND_MSG_RX_MGMT); // Copy the command, add the asterix
+  addChecksumLF(awaitable._commandBuffer); // Add the checksum bytes and line feed
+
+  awaitable._expectedResponseStart = "$MM ";
+  awaitable._expectedErrorStart = "$MM ERR";
+  awaitable._timeout = SWARM_M138_MESSAGE_READ_TIMEOUT;
+  awaitable._out = (void *)count;
+  return (awaitable);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Get the number of unsent TX messages from a coroutine. co_await the result
+    @param  count
+            A pointer to a uint16_t which will hold the count.
+            It must remain valid until the co_await completes
+    @return An awaitable. co_await returns:
+            SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_TIMEOUT if the response did not arrive in time
+            SWARM_M138_ERROR_INVALID_FORMAT if the response was not a count
+            SWARM_M138_ERROR_ERROR if unsuccessful
+*/
+/**************************************************************************/
+SWARM_M138_Awaitable SWARM_M138::getUnsentMessageCountAsync(uint16_t *count)
+{
+  SWARM_M138_Awaitable awaitable(this, SWARM_M138_AWAIT_MESSAGE_COUNT);
+
+  sprintf(awaitable._commandBuffer, "%s C=U*", SWARM_M138_COMMAND_MSG_TX_MGMT); // Copy the command, add the asterix
+  addChecksumLF(awaitable._commandBuffer); // Add the checksum bytes and line feed
+
+  awaitable._expectedResponseStart = "$MT ";
+  awaitable._expectedErrorStart = "$MT ERR";
+  awaitable._timeout = SWARM_M138_MESSAGE_READ_TIMEOUT;
+  awaitable._out = (void *)count;
+  return (awaitable);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Queue a text message for transmission from a coroutine. co_await the result
+    @param  data
+            The message. It is copied into the command, so it does not need to remain valid
+    @param  msg_id
+            A pointer to a uint64_t which will hold the assigned message ID.
+            It must remain valid until the co_await completes
+    @param  appID
+            Optional. The application ID
+    @return An awaitable. co_await returns:
+            SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_TIMEOUT if the response did not arrive in time
+            SWARM_M138_ERROR_ERROR if unsuccessful
+*/
+/**************************************************************************/
+SWARM_M138_Awaitable SWARM_M138::transmitTextAsync(const char *data, uint64_t *msg_id)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  return (transmitAsync(data, NULL, 0, msg_id, false, 0));
+}
+SWARM_M138_Awaitable SWARM_M138::transmitTextAsync(const char *data, uint64_t *msg_id, uint16_t appID)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  return (transmitAsync(data, NULL, 0, msg_id, true, appID));
+}
+
+/**************************************************************************/
+/*!
+    @brief  Queue a binary message for transmission from a coroutine. co_await the result
+    @param  data
+            The binary message. It is copied into the command, so it does not need to remain valid
+    @param  len
+            The length of the binary message in bytes
+    @param  msg_id
+            A pointer to a uint64_t which will hold the assigned message ID.
+            It must remain valid until the co_await completes
+    @param  appID
+            Optional. The application ID
+    @return An awaitable. co_await returns:
+            SWARM_M138_ERROR_SUCCESS if successful
+            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
+            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
+            SWARM_M138_ERROR_TIMEOUT if the response did not arrive in time
+            SWARM_M138_ERROR_ERROR if unsuccessful
+*/
+/**************************************************************************/
+SWARM_M138_Awaitable SWARM_M138::transmitBinaryAsync(const uint8_t *data, size_t len, uint64_t *msg_id)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  return (transmitAsync(NULL, data, len, msg_id, false, 0));
+}
+SWARM_M138_Awaitable SWARM_M138::transmitBinaryAsync(const uint8_t *data, size_t len, uint64_t *msg_id, uint16_t appID)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  return (transmitAsync(NULL, data, len, msg_id, true, appID));
+}
+
+// Build a $TD command for transmitTextAsync (text != NULL) or transmitBinaryAsync. The awaitable owns the command
+SWARM_M138_Awaitable SWARM_M138::transmitAsync(const char *text, const uint8_t *data, size_t len, uint64_t *msg_id, bool useAppID, uint16_t appID)
+{
+  SWARM_M138_Awaitable awaitable(this, SWARM_M138_AWAIT_TRANSMIT);
+
+  if (((text == NULL) && ((data == NULL) || (len == 0))) || (msg_id == NULL))
+  {
+    awaitable._result = SWARM_M138_ERROR_ERROR;
+    awaitable._ready = true; // Don't suspend
+    return (awaitable);
+  }
+
+  // Calculate the possible message length
+  size_t msgLen = strlen(SWARM_M138_COMMAND_TX_DATA); // $TD
+  msgLen += 1; // Space
+  if (useAppID) msgLen += 3 + 5 + 1; // AI=65535,
+  if (text != NULL)
+    msgLen += 2 + strlen(text); // Quotes plus the message itself
+  else
+    msgLen += 2 * len; // The message length in ASCII Hex
+  msgLen += 5; // asterix, checksum chars, line feed, null
+
+  // Allocate memory for the command, message, asterix, checksum bytes, \n and \0
+  char *command = swarm_m138_alloc_char(msgLen);
+  if (command == NULL)
+  {
+    awaitable._result = SWARM_M138_ERROR_MEM_ALLOC;
+    awaitable._ready = true; // Don't suspend
+    return (awaitable);
+  }
+  memset(command, 0, msgLen); // Clear it
+
+  if (useAppID)
+    sprintf(command, "%s AI=%d,", SWARM_M138_COMMAND_TX_DATA, appID); // Copy the command. Append the space and appID
+  else
+    sprintf(command, "%s ", SWARM_M138_COMMAND_TX_DATA); // Copy the command. Append the space
+  char *next = command + strlen(command);
+  if (text != NULL)
+  {
+    *next++ = '"'; // Append the quote
+    strcpy(next, text); // Append the message
+    next += strlen(text);
+    *next++ = '"'; // Append the quote
+  }
+  else
+  {
+    for (size_t i = 0; i < len; i++)
+    {
+      char c1 = (data[i] >> 4) + '0'; // Convert the MS nibble to ASCII
+      if (c1 >= ':') c1 = c1 + 'A' - ':';
+      char c2 = (data[i] & 0x0F) + '0'; // Convert the LS nibble to ASCII
+      if (c2 >= ':') c2 = c2 + 'A' - ':';
+      *next++ = c1; // Append each data byte as an ASCII Hex char pair
+      *next++ = c2;
+    }
+  }
+  *next = '*'; // Append the asterix
+  addChecksumLF(command); // Add the checksum bytes and line feed
+
+  awaitable._command = command;
+  awaitable._commandOwned = true; // Freed by the awaitable
+  awaitable._expectedResponseStart = "$TD OK,";
+  awaitable._expectedErrorStart = "$TD ERR";
+  awaitable._timeout = SWARM_M138_MESSAGE_TRANSMIT_TIMEOUT;
+  awaitable._out = (void *)msg_id;
+  return (awaitable);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Wait in a coroutine for the next unsolicited message of the chosen type. co_await the result.
+            The callback (if any) is still called
+    @param  type
+            The message type: e.g. SWARM_M138_EVENT_POWER_STATUS for $PW
+    @param  event
+            Optional. A pointer to a Swarm_M138_Event_t which will hold a copy of the message.
+            It must remain valid until the co_await completes
+    @return An awaitable. co_await returns SWARM_M138_ERROR_SUCCESS when the message arrives
+*/
+/**************************************************************************/
+SWARM_M138_Awaitable SWARM_M138::nextEvent(Swarm_M138_Event_Type_e type, Swarm_M138_Event_t *event)
+{
+  SWARM_M138_Awaitable awaitable(this, SWARM_M138_AWAIT_EVENT);
+
+  awaitable._eventType = type;
+  awaitable._out = (void *)event;
+  if (type == SWARM_M138_EVENT_UNKNOWN)
+  {
+    awaitable._result = SWARM_M138_ERROR_ERROR;
+    awaitable._ready = true; // Don't suspend. It would never be resumed
+  }
+  return (awaitable);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Wait in a coroutine without blocking the other coroutines. co_await the result.
+            The resolution is the rate at which checkUnsolicitedMsg / poll is called
+    @param  ms
+            The delay in milliseconds
+    @return An awaitable. co_await returns SWARM_M138_ERROR_SUCCESS when the delay has expired
+*/
+/**************************************************************************/
+SWARM_M138_Awaitable SWARM_M138::delayAsync(unsigned long ms)
+{
+  SWARM_M138_Awaitable awaitable(this, SWARM_M138_AWAIT_DELAY);
+
+  awaitable._timeout = ms;
+  if (ms == 0)
+  {
+    awaitable._result = SWARM_M138_ERROR_SUCCESS;
+    awaitable._ready = true; // Don't suspend
+  }
+  return (awaitable);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Process unsolicited messages and resume any coroutines whose results have arrived.
+            Call this from loop
+    @return True if at least one unsolicited message was processed, otherwise false
+*/
+/**************************************************************************/
+bool SWARM_M138::poll(void)
+{
+  SWARM_M138_ALLOC_ENTRY();
+  return (checkUnsolicitedMsg());
+}
+
+/**************************************************************************/
+/*!
+    @brief  Return the number of coroutine frames in use
+    @return The number of frames in use. The pool holds SWARM_M138_COROUTINE_POOL_SLOTS
+*/
+/**************************************************************************/
+uint8_t SWARM_M138::getCoroutineFramesInUse(void)
+{
+  uint8_t inUse = 0;
+  for (uint8_t i = 0; i < SWARM_M138_COROUTINE_POOL_SLOTS; i++)
+  {
+    if (swarm_m138_coroutine_used[i])
+      inUse++;
+  }
+  return (inUse);
+}
+#endif
+
+/**************************************************************************/
+/*!
+    @brief  Set up the callback for the $DT Date Time message
+    @param  swarmDateTimeCallback
+            The address of the function to be called when an unsolicited $DT message arrives
+*/
+/**************************************************************************/
+void SWARM_M138::setDateTimeCallback(void (*swarmDateTimeCallback)(const Swarm_M138_DateTimeData_t *dateTime))
+{
+  SWARM_M138_PAUSE_READER();
+  _swarmDateTimeCallback = swarmDateTimeCallback;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Set up the callback for the $GJ jamming indication message
+    @param  swarmGpsJammingCallback
+            The address of the function to be called when an unsolicited $GJ message arrives
+*/
+/**************************************************************************/
+void SWARM_M138::setGpsJammingCallback(void (*swarmGpsJammingCallback)(const Swarm_M138_GPS_Jamming_Indication_t *jamming))
+{
+  SWARM_M138_PAUSE_READER();
+  _swarmGpsJammingCallback = swarmGpsJammingCallback;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Set up the callback for the $GN geospatial information message
+    @param  swarmGeospatialCallback
+            The address of the function to be called when an unsolicited $GN message arrives
+*/
+/**************************************************************************/
+void SWARM_M138::setGeospatialInfoCallback(void (*swarmGeospatialCallback)(const Swarm_M138_GeospatialData_t *info))
+{
+  SWARM_M138_PAUSE_READER();
+  _swarmGeospatialCallback = swarmGeospatialCallback;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Set up the callback for the $GS GPS fix quality message
+    @param  swarmGpsFixQualityCallback
+            The address of the function to be called when an unsolicited $GS message arrives
+*/
+/**************************************************************************/
+void SWARM_M138::setGpsFixQualityCallback(void (*swarmGpsFixQualityCallback)(const Swarm_M138_GPS_Fix_Quality_t *fixQuality))
+{
+  SWARM_M138_PAUSE_READER();
+  _swarmGpsFixQualityCallback = swarmGpsFixQualityCallback;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Set up the callback for the $PW power status message
+    @param  swarmPowerStatusCallback
+            The address of the function to be called when an unsolicited $PW message arrives
+*/
+/**************************************************************************/
+void SWARM_M138::setPowerStatusCallback(void (*swarmPowerStatusCallback)(const Swarm_M138_Power_Status_t *power))
+{
+  SWARM_M138_PAUSE_READER();
+  _swarmPowerStatusCallback = swarmPowerStatusCallback;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Set up the callback for the $RT receive test message
+    @param  swarmReceiveTestCallback
+            The address of the function to be called when an unsolicited $RT message arrives
+*/
+/**************************************************************************/
+void SWARM_M138::setReceiveTestCallback(void (*swarmReceiveTestCallback)(const Swarm_M138_Receive_Test_t *rxTest))
+{
+  SWARM_M138_PAUSE_READER();
+  _swarmReceiveTestCallback = swarmReceiveTestCallback;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Set up the callback for the $M138 modem status messages
+    @param  swarmModemStatusCallback
+            The address of the function to be called when an unsolicited $M138 message arrives
+*/
+/**************************************************************************/
+void SWARM_M138::setModemStatusCallback(void (*swarmModemStatusCallback)(Swarm_M138_Modem_Status_e status, const char *debugOrError))
+{
+  SWARM_M138_PAUSE_READER();
+  _swarmModemStatusCallback = swarmModemStatusCallback;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Set up the callback for the $SL WAKE sleep mode messages
+    @param  swarmSleepWakeCallback
+            The address of the function to be called when an unsolicited $SL WAKE message arrives
+*/
+/**************************************************************************/
+void SWARM_M138::setSleepWakeCallback(void (*swarmSleepWakeCallback)(Swarm_M138_Wake_Cause_e cause))
+{
+  SWARM_M138_PAUSE_READER();
+  _swarmSleepWakeCallback = swarmSleepWakeCallback;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Set up the callback for the $RD receive data message
+    @param  swarmReceiveMessageCallback
+            The address of the function to be called when an unsolicited $RD message arrives
+*/
+/**************************************************************************/
+void SWARM_M138::setReceiveMessageCallback(void (*swarmReceiveMessageCallback)(const uint16_t *appID, const int16_t *rssi,
+                                           const int16_t *snr, const int16_t *fdev, const char *asciiHex))
+{
+  SWARM_M138_PAUSE_READER();
+  _swarmReceiveMessageCallback = swarmReceiveMessageCallback;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Set up the callback for $TD SENT messages
+    @param  swarmTransmitDataCallback
+            The address of the function to be called when an unsolicited $TD SENT message arrives
+*/
+/**************************************************************************/
+void SWARM_M138::setTransmitDataCallback(void (*swarmTransmitDataCallback)(const int16_t *rssi_sat, const int16_t *snr,
+                                         const int16_t *fdev, const uint64_t *id))
+{
+  SWARM_M138_PAUSE_READER();
+  _swarmTransmitDataCallback = swarmTransmitDataCallback;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Set up a callback for every unsolicited message, called before the message is parsed.
+            The callback is given a view of the message in the receive buffer: nothing is copied.
+            The view is only valid until the callback returns. Copy the data if you need to keep it
+    @param  swarmRawLineCallback
+            The address of the function to be called when any unsolicited message arrives
+*/
+/**************************************************************************/
+void SWARM_M138::setRawLineCallback(void (*swarmRawLineCallback)(const Swarm_M138_Line_View_t *line))
+{
+  SWARM_M138_PAUSE_READER();
+  _swarmRawLineCallback = swarmRawLineCallback;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Convert modem status enum into printable text
+    @param  status
+            The modem status (enumerated)
+    @return A pointer to the modem status in string (const char) format
+*/
+/**************************************************************************/
+const char *SWARM_M138::modemStatusString(Swarm_M138_Modem_Status_e status)
+{
+  switch (status)
+  {
+    case SWARM_M138_MODEM_STATUS_BOOT_ABORT:
+      return "BOOT ABORT (Restart after firmware crash)";
+      break;
+    case SWARM_M138_MODEM_STATUS_BOOT_DEVICEID:
+      return "BOOT DEVICEID (Device ID of the modem)";
+      break;
+    case SWARM_M138_MODEM_STATUS_BOOT_POWERON:
+      return "BOOT POWERON (Power has been applied)";
+      break;
+    case SWARM_M138_MODEM_STATUS_BOOT_RUNNING:
+      return "BOOT RUNNING (Boot has completed. Ready to accept commands)";
+      break;
+    case SWARM_M138_MODEM_STATUS_BOOT_UPDATED:
+      return "BOOT UPDATED (A firmware update was performed)";
+      break;
+    case SWARM_M138_MODEM_STATUS_BOOT_VERSION:
+      return "BOOT VERSION (Firmware version)";
+      break;
+    case SWARM_M138_MODEM_STATUS_BOOT_RESTART:
+      return "BOOT RESTART (Modem is restarting)";
+      break;
+    case SWARM_M138_MODEM_STATUS_BOOT_SHUTDOWN:
+      return "BOOT SHUTDOWN (Modem has shutdown. Disconnect power to restart)";
+      break;
+    case SWARM_M138_MODEM_STATUS_DATETIME:
+      return "DATETIME (GPS has acquired a valid date/time reference)";
+      break;
+    case SWARM_M138_MODEM_STATUS_POSITION:
+      return "POSITION (GPS has acquired a valid position 3D fix)";
+      break;
+    case SWARM_M138_MODEM_STATUS_DEBUG:
+      return "DEBUG (Debug message)";
+      break;
+    case SWARM_M138_MODEM_STATUS_ERROR:
+      return "ERROR (Error message)";
+      break;
+    case SWARM_M138_MODEM_STATUS_UNKNOWN:
+      return "UNKNOWN (undocumented)";
+      break;
+    default:
+      return "INVALID";
+      break;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief  Convert modem error enum into printable text
+    @param  error
+            The modem error (enumerated)
+    @return A pointer to the modem error in string (const char) format
+*/
+/**************************************************************************/
+const char *SWARM_M138::modemErrorString(Swarm_M138_Error_e error)
+{
+  switch (error)
+  {
+    case SWARM_M138_ERROR_ERROR:
+      return "Just a plain old communication error";
+      break;
+    case SWARM_M138_ERROR_SUCCESS:
+      return "Hey, it worked!";
+      break;
+    case SWARM_M138_ERROR_MEM_ALLOC:
+      return "Memory allocation error";
+      break;
+    case SWARM_M138_ERROR_TIMEOUT:
+      return "Communication timeout";
+      break;
+    case SWARM_M138_ERROR_INVALID_FORMAT:
+      return "Indicates the command response format was invalid: missing $ or *; non-ASCII checksum";
+      break;
+    case SWARM_M138_ERROR_INVALID_CHECKSUM:
+      return "Indicates the command response checksum was invalid";
+      break;
+    case SWARM_M138_ERROR_INVALID_RATE:
+      return "The requested message rate was invalid";
+      break;
+    case SWARM_M138_ERROR_INVALID_MODE:
+      return "The requested GPIO1 pin mode was invalid";
+      break;
+    case SWARM_M138_ERROR_ERR:
+      return "Command input error (ERR)";
+      break;
+  }
+
+  return "UNKNOWN";
+}
+
+/**************************************************************************/
+/*!
+    @brief  Convert command error into a printable description
+    @param  ERR
+            The command error as const char *
+    @return A pointer to the command error description in string (const char) format
+*/
+/**************************************************************************/
+const char *SWARM_M138::commandErrorString(const char *ERR)
+{
+  if (strstr(ERR, "BADPARAMLENGTH") != NULL)
+    return "A parameter has an incorrect length";
+  if (strstr(ERR, "BADPARAMVALUE") != NULL)
+    return "A parameter has a value that is out of range";
+  if (strstr(ERR, "BADPARAM") != NULL)
+    return "Unrecognizable parameter after command";
+  if (strstr(ERR, "INVALIDCHAR") != NULL)
+    return "A parameter has an invalid character";
+  if (strstr(ERR, "NOTIMPLEMENTED") != NULL)
+    return "The command is not recognized as valid";
+  if (strstr(ERR, "PARAMMISSING") != NULL)
+    return "A required parameter is missing";
+  if (strstr(ERR, "PARAMDUPLICATE") != NULL)
+    return "A parameter has been duplicated";
+  if (strstr(ERR, "DBX_INVMSGID") != NULL)
+    return "Messages Management : invalid message ID";
+  if (strstr(ERR, "DBX_NOMORE") != NULL)
+    return "Messages Management : no messages found";
+  if (strstr(ERR, "TIMENOTSET") != NULL)
+    return "Time not yet set from GPS";
+  if (strstr(ERR, "NOCOMMAND") != NULL)
+    return "Sleep Mode : No S or U partameter";
+  if (strstr(ERR, "NOTIME") != NULL)
+    return "Sleep Mode : attempt to sleep before time is set";
+  if (strstr(ERR, "BADAPPID") != NULL)
+    return "Transmit Data : invalid application ID";
+  if (strstr(ERR, "BADDATA") != NULL)
+    return "Transmit Data : Message has odd number or non-hex characters when sending data as hexadecimal";
+  if (strstr(ERR, "BADEXPIRETIME") != NULL)
+    return "Transmit Data : Invalid hold time";
+  if (strstr(ERR, "HOLDTIMEEXPIRED") != NULL)
+    return "Transmit Data : Unable to send within requested hold time";
+  if (strstr(ERR, "NODEVICEID") != NULL)
+    return "Transmit Data : The Swarm device ID has not yet been set - contact Swarm Support";
+  if (strstr(ERR, "NOSPACE") != NULL)
+    return "Transmit Data : No space for message";
+  if (strstr(ERR, "DBXTOHIVEFULL") != NULL)
+    return "Transmit Data : Queue for queued messages is full. Maximum of 2048 messages may be held in the queue";
+  if (strstr(ERR, "TOOLONG") != NULL)
+    return "Transmit Data : Message is too large to send";
+
+  return "UNKNOWN";
+}
+
+/////////////
+// Private //
+/////////////
+
+// Add the two NMEA checksum bytes and line feed to a command
+void SWARM_M138::addChecksumLF(char *command)
+{
+  char *dollar = strchr(command, '$'); // Find the $
+
+  if (dollar == NULL) // Return now if the $ was not found
+    return;
+
+  char *asterix = strchr(dollar, '*'); // Find the *
+
+  if (asterix == NULL) // Return now if the * was not found
+    return;
+
+  // Check for a second asterix ($MM C=**)
+  if (*(asterix + 1) == '*')
+    asterix++;
+
+  char checksum = 0;
+
+  dollar++; // Point to the char after the $
+
+  while (dollar < asterix) // Calculate the checksum
+  {
+    checksum ^= *dollar;
+    dollar++;
+  }
+
+  // Add the checksum bytes to the command
+  *(asterix + 1) = (checksum >> 4) + '0';
+  if (*(asterix + 1) >= ':') // Hex a-f
+    *(asterix + 1) = *(asterix + 1) + 'a' - ':';
+  *(asterix + 2) = (checksum & 0x0F) + '0';
+  if (*(asterix + 2) >= ':') // Hex a-f
+    *(asterix + 2) = *(asterix + 2) + 'a' - ':';
+
+  // Add the line feed
+  *(asterix + 3) = '\n';
+
+  // Add a \0 - just in case
+  *(asterix + 4) = 0;
+}
+
+// Check if the response / message checksum is valid
+Swarm_M138_Error_e SWARM_M138::checkChecksum(char *startPosition)
+{
+  char *dollar = strchr(startPosition, '$'); // Find the $
+
+  if (dollar == NULL) // Return now if the $ was not found
+  {
+    if (_printDebug == true)
+    {
+      _debugPort->println(F("checkChecksum: $ not found!"));
+    }
+    return (SWARM_M138_ERROR_INVALID_FORMAT);
+  }
+
+  char *asterix = strchr(dollar, '*'); // Find the *
+
+  if (asterix == NULL) // Return now if the * was not found
+  {
+    if (_printDebug == true)
+    {
+      _debugPort->println(F("checkChecksum: * not found!"));
+    }
+    return (SWARM_M138_ERROR_INVALID_FORMAT);
+  }
+
+  char checksum = 0;
+
+  dollar++; // Point to the char after the $
+
+  while (dollar < asterix) // Calculate the checksum
+  {
+    checksum ^= *dollar;
+    dollar++;
+  }
+
+  char expectedChecksum;
+
+  char checksumChar = *(asterix + 1); // Get the first checksum character
+
+  if ((checksumChar >= '0') && (checksumChar <= '9')) // Convert to binary
+    expectedChecksum = (checksumChar - '0') << 4;
+  else if ((checksumChar >= 'a') && (checksumChar <= 'f'))
+    expectedChecksum = (checksumChar + 10 - 'a') << 4;
+  else if ((checksumChar >= 'A') && (checksumChar <= 'F'))
+    expectedChecksum = (checksumChar + 10 - 'A') << 4;
+  else
+  {
+    if (_printDebug == true)
+    {
+      _debugPort->println(F("checkChecksum: invalid checksum char 1"));
+    }
+    return (SWARM_M138_ERROR_INVALID_FORMAT);
+  }
+
+  checksumChar = *(asterix + 2); // Get the second checksum character
+
+  if ((checksumChar >= '0') && (checksumChar <= '9')) // Convert to binary
+    expectedChecksum |= (checksumChar - '0');
+  else if ((checksumChar >= 'a') && (checksumChar <= 'f'))
+    expectedChecksum |= (checksumChar + 10 - 'a');
+  else if ((checksumChar >= 'A') && (checksumChar <= 'F'))
+    expectedChecksum |= (checksumChar + 10 - 'A');
+  else
+  {
+    if (_printDebug == true)
+    {
+      _debugPort->println(F("checkChecksum: invalid checksum char 2"));
+    }
+    return (SWARM_M138_ERROR_INVALID_FORMAT);
+  }
+
+  if (checksum != expectedChecksum)
+  {
+    if (_printDebug == true)
+    {
+      _debugPort->println(F("checkChecksum: invalid checksum"));
+    }
+    return (SWARM_M138_ERROR_INVALID_CHECKSUM);
+  }
+
+  return (SWARM_M138_ERROR_SUCCESS);
+}
+
+// Extract the command error
+Swarm_M138_Error_e SWARM_M138::extractCommandError(char *startPosition)
+{
+    memset(commandError, 0, SWARM_M138_MAX_CMD_ERROR_LEN); // Clear any existing error
+
+    char *errorAt = strstr(startPosition, "ERR,"); // Find the ERR,
+
+    if (errorAt == NULL)
+      return (SWARM_M138_ERROR_ERROR);
+
+    errorAt += 4; // Point to the start of the actual error message
+
+    char *asterix = strchr(errorAt, '*'); // Find the *
+
+    if (asterix == NULL)
+      return (SWARM_M138_ERROR_ERROR);
+
+    int errorLen = 0;
+    while ((errorAt < asterix) && (errorLen < (SWARM_M138_MAX_CMD_ERROR_LEN - 1))) // Leave a NULL on the end
+    {
+      commandError[errorLen] = *errorAt;
+      errorAt++;
+      errorLen++;
+    }
+
+    return (SWARM_M138_ERROR_SUCCESS);
+}
+
+// If drainRxMessages has a $MM R=O in flight, read its response into the drain's buffer now
+// Called before anything else reads the serial port, so a command sent from the drain callback cannot consume the response
+void SWARM_M138::collectDrainResponse(void)
+{
+  if (_drainResponse == NULL)
+    return;
+
+  char *response = _drainResponse;
+  _drainResponse = NULL; // waitForResponse does not come back here, but be sure
+  memset(response, 0, _RxBuffSize);
+  _drainResponseErr = waitForResponse("$MM AI=", "$MM ERR", response, _RxBuffSize, SWARM_M138_MESSAGE_READ_TIMEOUT);
+  _drainResponseReady = true;
+}
+
+// Send a command. Check for a response.
+// Return true if expectedResponseStart is seen in the data followed by a \n
+Swarm_M138_Error_e SWARM_M138::sendCommandWithResponse(
+    const char *command, const char *expectedResponseStart, const char *expectedErrorStart,
+    char *responseDest, size_t destSize, unsigned long commandTimeout)
+{
+#ifdef SWARM_M138_THREADS_AVAILABLE
+  Swarm_M138_Error_e result;
+  if (postToReader(SWARM_M138_REQUEST_SEND_WAIT, command, expectedResponseStart, expectedErrorStart, responseDest, destSize, commandTimeout, &result))
+    return (result); // The reader task has done the work
+#endif
+
+  if (_printDebug == true)
+    _debugPort->println(F("sendCommandWithResponse: ====>"));
+
+  sendCommand(command); //Sending command needs to dump data to backlog buffer as well.
+
+  Swarm_M138_Error_e err = waitForResponse(expectedResponseStart, expectedErrorStart, responseDest, destSize, commandTimeout);
+
+  if (_printDebug == true)
+    _debugPort->println(F("sendCommandWithResponse: <===="));
+
+  return (err);
+}
+
+void SWARM_M138::sendCommand(const char *command)
+{
+  collectDrainResponse(); // Called from a drainRxMessages callback? Read the pipelined response before this command can consume it
+
+#ifdef SWARM_M138_THREADS_AVAILABLE
+  if (postToReader(SWARM_M138_REQUEST_SEND, command, NULL, NULL, NULL, 0, 0, NULL))
+    return; // The reader task has sent the command
+#endif
+
+  //Copy any incoming serial data into the backlog until the receive window closes (see setRxWindowMode)
+  unsigned long lastRx = rxWindowNow();
+  int hwAvail = hwAvailable();
+  if (hwAvail > 0) //hwAvailable can return -1 if the serial port is NULL
+  {
+    size_t backlogLength = strlen((const char *)_swarmBacklog);
+    while ((backlogLength + hwAvail) < _RxBuffSize)
+    {
+      if (hwAvail > 0) //hwAvailable can return -1 if the serial port is NULL
+      {
+        backlogLength += hwReadChars((char *)&_swarmBacklog[backlogLength], hwAvail);
+        noteBacklogLength(backlogLength);
+        lastRx = rxWindowNow();
+      }
+      else if (rxWindowClosed(_swarmBacklog, backlogLength, lastRx))
+        break;
+      else
+        rxWindowWait();
+      hwAvail = hwAvailable();
+    }
+  }
+
+  if (_printDebug == true)
+  {
+    _debugPort->print(F("sendCommand: Command: "));
+    _debugPort->println(command);
+  }
+
+  //Now send the command
+  hwPrint(command);
+
+#ifdef SWARM_M138_STATS
+  _statsTag = statsTagIndex(command);
+  _statsSentAt = millis();
+#endif
+}
+
+Swarm_M138_Error_e SWARM_M138::waitForResponse(const char *expectedResponseStart, const char *expectedErrorStart,
+                                               char *responseDest, size_t destSize, unsigned long timeout)
+{
+#ifdef SWARM_M138_THREADS_AVAILABLE
+  Swarm_M138_Error_e result;
+  if (postToReader(SWARM_M138_REQUEST_WAIT, NULL, expectedResponseStart, expectedErrorStart, responseDest, destSize, timeout, &result))
+    return (result); // The reader task has read the response
+#endif
+
+  unsigned long timeIn;
+  bool found = false;
+  size_t destIndex = 0;
+  bool responseStartSeen = false, errorStartSeen = false;
+  int responseIndex = 0, errorIndex = 0;
+  size_t responseStartedAt = 0, errorStartedAt = 0;
+  Swarm_M138_Error_e err = SWARM_M138_ERROR_ERROR;
+
+  bool printedSomething = false;
+  bool responseOverflowed = false;
+
+  // With adaptive timeouts, a silent modem times out after silentTimeout. Once anything arrives, wait for the full timeout
+  Swarm_M138_Timeout_Class_t *adaptiveClass = timeoutClass(timeout, true);
+  unsigned long silentTimeout = adaptiveLimit(adaptiveClass, timeout);
+  timeout = adaptiveCeiling(timeout);
 
-//   // Calculate the "size of" each element in the array of uint64_t
-//   // Note: sizeof(uint64_t) doesn't seem to give the correct result?
-//   uint64_t test[2];
-//   size_t sizeOfUint64Array = &test[1] - &test[0];
+  timeIn = millis();
 
-//   if (_printDebug == true)
-//   {
-//     _debugPort->print(F("listTxMessagesIDs: sizeOfUint64Array is "));
-//     _debugPort->println(sizeOfUint64Array);
-//   }
+  while ((!found) && ((millis() - timeIn) < ((destIndex > 0) ? timeout : silentTimeout)))
+  {
+    size_t hwAvail = hwAvailable();
+    if (hwAvail > 0) //hwAvailable can return -1 if the serial port is NULL
+    {
+      if ((destIndex + hwAvail) < destSize) // Check there is room to store the response (with a null on the end!)
+      {
+        size_t bytesRead = hwReadChars((char *)&responseDest[destIndex], hwAvail);
 
-//   err = getUnsentMessageCount(&msgTotal); // Get the message count so we know how many messages to expect
-//   if (err != SWARM_M138_ERROR_SUCCESS)
-//     return (err);
+        if (_printDebug == true)
+        {
+          if (printedSomething == false)
+          {
+            _debugPort->print(F("waitForResponse: "));
+            printedSomething = true;
+          }
+          _debugPort->print((const char *)&responseDest[destIndex]);
+        }
+
+        // Check each character to see if it is the expected resonse or error
+        for (size_t chrPtr = destIndex; chrPtr < (destIndex + bytesRead); chrPtr++)
+        {
+          char c = responseDest[chrPtr]; // Check each character
+
+          if (c == expectedResponseStart[responseIndex])
+          {
+            if ((responseIndex == 0) && (responseStartSeen == false))
+              responseStartedAt = chrPtr; // Record where the (possible) response started
+            if (++responseIndex == (int)strlen(expectedResponseStart))
+            {
+              responseStartSeen = true;
+            }
+          }
+          else
+          {
+            responseIndex = 0;
+          }
+
+          if (expectedErrorStart != NULL)
+          {
+            if (c == expectedErrorStart[errorIndex])
+            {
+              if ((errorIndex == 0) && (errorStartSeen == false))
+                errorStartedAt = chrPtr; // Record where the (possible) error started
+              if (++errorIndex == (int)strlen(expectedErrorStart))
+              {
+                errorStartSeen = true;
+              }
+            }
+            else
+            {
+              errorIndex = 0;
+            }
+          }
+
+          // Set found to true if we have seen expectedResponseStart or expectedErrorStart _and_ have received a \n
+          if ((responseStartSeen || errorStartSeen) && (c == '\n'))
+            found = true;
+        }
+
+        // Now also copy the response into the backlog, if there is room
+        // _swarmBacklog is a global array that holds the backlog of any events
+        // that came in while waiting for response. To be processed later within checkUnsolicitedMsg().
+        // Note: the expectedResponse or expectedError will also be added to the backlog.
+        // Everything in the backlog is 'printable'. So it is OK to use strlen - so long as there is a
+        // \0 at the end of the buffer!
+        size_t backlogLength = strlen((const char *)_swarmBacklog);
+
+        if ((backlogLength + bytesRead) < _RxBuffSize) // Is there room to store the new data?
+        {
+          memcpy((char *)&_swarmBacklog[backlogLength], (char *)&responseDest[destIndex], bytesRead);
+          noteBacklogLength(backlogLength + bytesRead);
+        }
+        else
+        {
+          _backlogOverflows = _backlogOverflows + 1;
+          if (_printDebug == true)
+          {
+            if (printedSomething == true)
+            {
+              _debugPort->println();
+              printedSomething = false;
+            }
+            _debugPort->println(F("waitForResponse: Panic! _swarmBacklog is full!"));
+          }
+        }
+
+        destIndex += bytesRead; // Increment destIndex
+      }
+      else
+      {
+        responseOverflowed = true;
+        if (_printDebug == true)
+        {
+          if (printedSomething == true)
+          {
+            _debugPort->println();
+            printedSomething = false;
+          }
+          _debugPort->println(F("waitForResponse: Panic! responseDest is full!"));
+        }
+      }
+    }
+    else
+      delay(1);
+  }
+
+  if (_printDebug == true)
+    if (printedSomething)
+      _debugPort->println();
+
+  if (found == true)
+  {
+    if (errorStartSeen) // Error needs priority over response as response is often the beginning of error!
+    {
+      // if (_printDebug == true)
+      // {
+      //   _debugPort->print(F("waitForResponse: errorStart: "));
+      //   _debugPort->println((char *)&responseDest[errorStartedAt]);
+      // }
+      err = checkChecksum((char *)&responseDest[errorStartedAt]);
+      if (err == SWARM_M138_ERROR_SUCCESS)
+      {
+        extractCommandError((char *)&responseDest[errorStartedAt]);
+        err = SWARM_M138_ERROR_ERR;
+      }
+    }
+    else if (responseStartSeen)
+    {
+      // if (_printDebug == true)
+      // {
+      //   _debugPort->print(F("waitForResponse: responseStart: "));
+      //   _debugPort->println((char *)&responseDest[responseStartedAt]);
+      // }
+      err = checkChecksum((char *)&responseDest[responseStartedAt]);
+    }
+  }
+  else
+    err = SWARM_M138_ERROR_TIMEOUT;
+
+  if (adaptiveClass != NULL)
+  {
+    if (found)
+      learnResponseTime(adaptiveClass, millis() - timeIn);
+    else if (adaptiveClass->backoff < 8) // Karn: don't learn from a timeout, back off
+      adaptiveClass->backoff++;
+  }
+
+#ifdef SWARM_M138_STATS
+  noteCommandStats(_statsTag, err, millis() - _statsSentAt);
+  if (responseOverflowed)
+    _statsResponseOverflows = _statsResponseOverflows + 1;
+#else
+  (void)responseOverflowed;
+#endif
+
+  pruneBacklog(); // Prune any incoming non-actionable URC's and responses/errors from the backlog
+
+  return (err);
+}
+
+size_t SWARM_M138::hwPrint(const char *s)
+{
+  if ((_traceRing != NULL) || (_tracePort != NULL))
+    traceBytes(SWARM_M138_TRACE_SENT, s, strlen(s));
+
+  if (_transport != NULL)
+  {
+    return _transport->write((const uint8_t *)s, strlen(s));
+  }
+  else if (_hardSerial != NULL)
+  {
+    return _hardSerial->print(s);
+  }
+#ifdef SARA_R5_SOFTWARE_SERIAL_ENABLED
+  else if (_softSerial != NULL)
+  {
+    return _softSerial->print(s);
+  }
+#endif
+  else if (_i2cPort != NULL)
+  {
+    return ((size_t)qwiicSwarmWriteChars(strlen(s), s));
+  }
+
+  return (size_t)0;
+}
+
+size_t SWARM_M138::hwWriteData(const char *buff, int len)
+{
+  if (((_traceRing != NULL) || (_tracePort != NULL)) && (len > 0))
+    traceBytes(SWARM_M138_TRACE_SENT, buff, len);
+
+  if (_transport != NULL)
+  {
+    return _transport->write((const uint8_t *)buff, len);
+  }
+  else if (_hardSerial != NULL)
+  {
+    return _hardSerial->write((const uint8_t *)buff, len);
+  }
+#ifdef SWARM_M138_SOFTWARE_SERIAL_ENABLED
+  else if (_softSerial != NULL)
+  {
+    return _softSerial->write((const uint8_t *)buff, len);
+  }
+#endif
+  else if (_i2cPort != NULL)
+  {
+    return ((size_t)qwiicSwarmWriteChars(len, buff));
+  }
+
+  return (size_t)0;
+}
+
+size_t SWARM_M138::hwWrite(const char c)
+{
+  if ((_traceRing != NULL) || (_tracePort != NULL))
+    traceBytes(SWARM_M138_TRACE_SENT, &c, 1);
+
+  if (_transport != NULL)
+  {
+    return _transport->write((const uint8_t *)&c, 1);
+  }
+  else if (_hardSerial != NULL)
+  {
+    return _hardSerial->write(c);
+  }
+#ifdef SWARM_M138_SOFTWARE_SERIAL_ENABLED
+  else if (_softSerial != NULL)
+  {
+    return _softSerial->write(c);
+  }
+#endif
+  else if (_i2cPort != NULL)
+  {
+    return ((size_t)qwiicSwarmWriteChars((int)1, &c));
+  }
+
+  return (size_t)0;
+}
+
+int SWARM_M138::hwAvailable(void)
+{
+  if (_rxRing != NULL) // Interrupt / DMA receive path
+  {
+    return (rxRingAvailable());
+  }
+  else if (_transport != NULL)
+  {
+    return (_transport->available());
+  }
+  else if (_hardSerial != NULL)
+  {
+    return ((int)_hardSerial->available());
+  }
+#ifdef SWARM_M138_SOFTWARE_SERIAL_ENABLED
+  else if (_softSerial != NULL)
+  {
+    return ((int)_softSerial->available());
+  }
+#endif
+  else if (_i2cPort != NULL)
+  {
+    return (qwiicSwarmAvailable());
+  }
+
+  return -1;
+}
+
+// Read len chars from the appropriate port. Store in buf
+int SWARM_M138::hwReadChars(char *buf, int len)
+{
+  if (len <= 0)
+    return (len);
+
+  if (buf == NULL)
+    return (-1);
 
-//   if (_printDebug == true)
-//   {
-//     _debugPort->print(F("listTxMessagesIDs: msgTotal is "));
-//     _debugPort->println(msgTotal);
-//   }
+  int bytesRead = -1;
 
-//   if (msgTotal == 0) // Quit if there are no messages in the buffer
-//     return (SWARM_M138_ERROR_ERROR);
+  if (_rxRing != NULL) // Interrupt / DMA receive path
+  {
+    bytesRead = rxRingRead(buf, len);
+  }
+  else if (_transport != NULL)
+  {
+    bytesRead = _transport->read((uint8_t *)buf, len);
+    if (bytesRead < 0)
+      bytesRead = 0; // The callers add the result to their buffer index
+  }
+  else if (_hardSerial != NULL)
+  {
+    for (int i = 0; i < len; i++)
+    {
+      buf[i] = _hardSerial->read();
+    }
+    bytesRead = len;
+  }
+#ifdef SWARM_M138_SOFTWARE_SERIAL_ENABLED
+  else if (_softSerial != NULL)
+  {
+    for (int i = 0; i < len; i++)
+    {
+      buf[i] = _softSerial->read();
+    }
+    bytesRead = len;
+  }
+#endif
+  else if (_i2cPort != NULL)
+  {
+    bytesRead = qwiicSwarmReadChars(len, buf);
+  }
 
-//   // Allocate memory for the response
-//   response = swarm_m138_alloc_char(_RxBuffSize);
-//   if (response == NULL)
-//   {
-//     return(SWARM_M138_ERROR_MEM_ALLOC);
-//   }
-//   memset(response, 0, _RxBuffSize); // Clear it
+  if ((bytesRead > 0) && ((_traceRing != NULL) || (_tracePort != NULL)))
+    traceBytes(SWARM_M138_TRACE_RECEIVED, buf, bytesRead);
 
-//   // Allocate memory for the command, asterix, checksum bytes, \n and \0
-//   command = swarm_m138_alloc_char(strlen(SWARM_M138_COMMAND_MSG_TX_MGMT) + 9);
-//   if (command == NULL)
-//   {
-//     swarm_m138_free_char(response);
-//     return (SWARM_M138_ERROR_MEM_ALLOC);
-//   }
-//   memset(command, 0, strlen(SWARM_M138_COMMAND_MSG_TX_MGMT) + 9); // Clear it
-//   sprintf(command, "%s L=U*", SWARM_M138_COMMAND_MSG_TX_MGMT); // Copy the command, add the asterix
-//   addChecksumLF(command); // Add the checksum bytes and line feed
+  return (bytesRead);
+}
 
-//   // if (_printDebug == true)
-//   // {
-//   //   _debugPort->println(F("listTxMessagesIDs: ====>"));
-//   //   _debugPort->flush();
-//   // }
+// Record data in the wire trace. Long data is split into records of up to 255 bytes, all with the same timestamp
+void SWARM_M138::traceBytes(char direction, const char *data, size_t len)
+{
+  uint32_t now = micros();
 
-//   sendCommand(command); // Send the command
+  while (len > 0)
+  {
+    uint8_t chunk = (len > 255) ? 255 : (uint8_t)len;
+    uint8_t header[SWARM_M138_TRACE_RECORD_HEADER];
+    header[0] = (uint8_t)direction;
+    header[1] = (uint8_t)(now & 0xFF);
+    header[2] = (uint8_t)((now >> 8) & 0xFF);
+    header[3] = (uint8_t)((now >> 16) & 0xFF);
+    header[4] = (uint8_t)((now >> 24) & 0xFF);
+    header[5] = chunk;
 
-//   swarm_m138_free_char(command); // Free command now - we are done with it
+    if (_tracePort != NULL)
+    {
+      size_t written = _tracePort->write(header, SWARM_M138_TRACE_RECORD_HEADER);
+      written += _tracePort->write((const uint8_t *)data, chunk);
+      if (written < (size_t)(SWARM_M138_TRACE_RECORD_HEADER + chunk))
+        _traceDropped++;
+    }
 
-//   unsigned long startTime = millis();
-//   bool keepGoing = true;
+    if (_traceRing != NULL)
+    {
+      // Discard the oldest records until the new one fits
+      while ((_traceRing->size - _traceRing->used) < (size_t)(SWARM_M138_TRACE_RECORD_HEADER + chunk))
+      {
+        size_t lengthAt = _traceRing->tail + SWARM_M138_TRACE_RECORD_HEADER - 1;
+        if (lengthAt >= _traceRing->size)
+          lengthAt -= _traceRing->size;
+        size_t oldest = SWARM_M138_TRACE_RECORD_HEADER + _traceRing->data[lengthAt];
+        _traceRing->tail += oldest;
+        if (_traceRing->tail >= _traceRing->size)
+          _traceRing->tail -= _traceRing->size;
+        _traceRing->used -= oldest;
+        _traceDropped++;
+      }
+      tracePut(header, SWARM_M138_TRACE_RECORD_HEADER);
+      tracePut((const uint8_t *)data, chunk);
+    }
 
-//   // Keep checking incoming chars for up to SWARM_M138_MESSAGE_ID_TIMEOUT secs total
-//   while ((millis() < (startTime + SWARM_M138_MESSAGE_ID_TIMEOUT)) && keepGoing)
-//   {
-//     int hwAvail = hwAvailable();
+    data += chunk;
+    len -= chunk;
+  }
+}
 
-//     if (hwAvail > 0) //hwAvailable can return -1 if the serial port is NULL
-//     {
-//       rxBuff = swarm_m138_alloc_char((size_t)(hwAvail + 1)); // Allocate memory to hold the data
-//       if (rxBuff != NULL)
-//       {
-//         memset(rxBuff, 0, (size_t)(hwAvail + 1)); // Clear it
-//         int charsRead = hwReadChars(rxBuff, hwAvail); // Read the characters
+// Copy len bytes into the trace ring buffer at the head
+void SWARM_M138::tracePut(const uint8_t *data, size_t len)
+{
+  size_t firstPart = _traceRing->size - _traceRing->head;
+  if (firstPart > len)
+    firstPart = len;
+  memcpy(&_traceRing->data[_traceRing->head], data, firstPart);
+  if (len > firstPart)
+    memcpy(_traceRing->data, data + firstPart, len - firstPart);
+  _traceRing->head += len;
+  if (_traceRing->head >= _traceRing->size)
+    _traceRing->head -= _traceRing->size;
+  _traceRing->used += len;
+}
 
-//         // if (_printDebug == true)
-//         //   _debugPort->print(rxBuff);
+// I2C functions for Qwiic Swarm
 
-//         for (int i = 0; i < charsRead; i++) // Go through a character at a time
-//         {
-//           char cc[2];
-//           cc[0] = rxBuff[i];
-//           cc[1] = 0;
-//           if (strlen(response) < _RxBuffSize) // Check if response is full
-//           {
-//             strcat(response, cc); // Copy a single character into response
-//             if (cc[0] == '\n') // Check if this is a newline
-//             {
-//               idStart = strstr(response, "$MT "); // Check for $MT
-//               if (idStart != NULL)
-//               {
-//                 idStart = strstr(idStart, " AI="); // Check if the message has AI= at the start
-//                 if (idStart != NULL)
-//                 {
-//                   idStart = strchr(idStart, ','); // Find the first comma
-//                   if (idStart != NULL)
-//                   {
-//                     idStart++;
-//                     idStart = strchr(idStart, ','); // Find the second comma
-//                   }
-//                 }
-//                 else // Message does not have AI=
-//                 {
-//                   idStart = strstr(response, "$MT "); // Find the $MT again
-//                   if (idStart != NULL)
-//                   {
-//                     idStart = strchr(idStart, ','); // Find the first comma
-//                   }
-//                 }
-                
-//                 if (idStart != NULL)
-//                 {
-//                   idStart++; // Point to the first digit of the message ID
-//                   idEnd = strchr(idStart, ','); // Find the second/third comma
-//                   if (idEnd != NULL)
-//                   {
-//                     // We have (hopefully) a valid ID to extract
-//                     uint64_t theID = 0;
-//                     char c = *idStart;
-//                     while ((c != ',') && (idStart < idEnd))
-//                     {
-//                       // if (_printDebug == true)
-//                       //   _debugPort->write(c);
-//                       theID *= 10;
-//                       theID += (uint64_t)(c - '0');
-//                       idStart++;
-//                       c = *idStart;
-//                     }
-//                     *(ids + (sizeOfUint64Array * (size_t)msgCount)) = theID; // Store the extracted ID
-//                     msgCount++; // Increment the count
-//                     if (_printDebug == true)
-//                     {
-//                       _debugPort->println();
-//                       _debugPort->print(F("listTxMessagesIDs: msgCount is "));
-//                       _debugPort->println(msgCount);
-//                     }
-//                     if ((msgCount == msgTotal) || (msgCount == maxCount))
-//                       keepGoing = false; // Stop if we have reached msgTotal or maxCount
-//                   }
-//                 }
-//               }
-//               else
-//               {
-//                 // We got a \n but failed to find $MT.
-//                 // So, let's be nice and copy whatever this message is into the backlog if possible
-//                 size_t backlogLength = strlen((const char *)_swarmBacklog);
-//                 size_t msgLen = strlen((const char *)response);
-//                 if ((backlogLength + msgLen) < _RxBuffSize)
-//                 {
-//                   memcpy(&_swarmBacklog[backlogLength], response, msgLen);
-//                 }
-//               }
-//               memset(response, 0, _RxBuffSize); // Clear the response
-//             }
-//           }
-//           else // Response is full... We are stuck... And we are still in the for loop...
-//           {
-//             swarm_m138_free_char(rxBuff);
-//             swarm_m138_free_char(response);
-//             return (SWARM_M138_ERROR_ERROR);
-//           }
-//         }
-//         swarm_m138_free_char(rxBuff); // Free the buffer
-//       }
-//       else // The memory allocation failed
-//       {
-//         err = SWARM_M138_ERROR_MEM_ALLOC;
-//         keepGoing = false;
-//       }
-//     }
-//     else
-//       delay(1);
-//   }
+// Check how many bytes Qwiic Swarm has available
+// Return -1 if it is less than QWIIC_SWARM_I2C_POLLING_WAIT_MS since the last check
+int SWARM_M138::qwiicSwarmAvailable(void)
+{
+  int bytesAvailable = -1;
 
-//   swarm_m138_free_char(response);
+  if (millis() - _lastI2cCheck >= QWIIC_SWARM_I2C_POLLING_WAIT_MS)
+  {
+    //Check how many serial bytes are waiting to be read
+    _i2cPort->beginTransmission((uint8_t)_address); // Talk to the I2C device
+    _i2cPort->write(QWIIC_SWARM_LEN_REG); // Point to the serial buffer length
+    _i2cPort->endTransmission(); // Send data and release the bus (the 841 (WireS) doesn't like it if the Controller holds the bus!)
+    if (_i2cPort->requestFrom((uint8_t)_address, (uint8_t)2) == 2) // Request two bytes
+    {
+      uint8_t msb = _i2cPort->read();
+      uint8_t lsb = _i2cPort->read();
+      bytesAvailable = (((uint16_t)msb) << 8) | lsb;
+    }
 
-//   // if (_printDebug == true)
-//   // {
-//   //   _debugPort->println(F("listTxMessagesIDs: <===="));
-//   //   _debugPort->flush();
-//   // }
+    //Put off checking to avoid excessive I2C bus traffic - but only if zero bytes are available
+    if (bytesAvailable == 0)
+      _lastI2cCheck = millis();
+  }
 
-//   return (err);
-// }
+  return (bytesAvailable);
+}
 
-/**************************************************************************/
-/*!
-    @brief  Queue a printable text message for transmission
-    @param  data
-            The message as printable ASCII characters (0x20 to 0x7E, space to ~)
-    @param  msg_id
-            A pointer to a uint64_t which will hold the assigned message ID
-    @return SWARM_M138_ERROR_SUCCESS if successful
-            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
-            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
-            SWARM_M138_ERROR_ERROR if unsuccessful
-*/
-/**************************************************************************/
-Swarm_M138_Error_e SWARM_M138::transmitText(const char *data, uint64_t *msg_id)
+// Read len bytes from Qwiic Swarm, store in dest
+int SWARM_M138::qwiicSwarmReadChars(int len, char *dest)
 {
-  return (transmitText(data, msg_id, false, 0, false, 0, false, 0));
-}
+  if (len <= 0)
+    return (len);
+
+  if (dest == NULL)
+    return (0);
+
+  int bytesRead = 0;
+
+  // Request the bytes
+  // Release the bus afterwards
+  _i2cPort->beginTransmission((uint8_t)_address); // Talk to the I2C device
+  _i2cPort->write(QWIIC_SWARM_DATA_REG); // Point to the serial buffer
+  _i2cPort->endTransmission(); // Send data and release the bus (the 841 (WireS) doesn't like it if the Master holds the bus!)
+  while (len > QWIIC_SWARM_SER_PACKET_SIZE) // If there are _more_ than SER_PACKET_SIZE bytes to be read
+  {
+    _i2cPort->requestFrom((uint8_t)_address, (uint8_t)QWIIC_SWARM_SER_PACKET_SIZE, (uint8_t)false); // Request SER_PACKET_SIZE bytes, don't release the bus
+    while (_i2cPort->available())
+    {
+      dest[bytesRead] = _i2cPort->read(); // Read and store each byte
+      bytesRead++;
+    }
+    len -= QWIIC_SWARM_SER_PACKET_SIZE; // Decrease the number of bytes available by SER_PACKET_SIZE
+  }
+  _i2cPort->requestFrom((uint8_t)_address, (uint8_t)len); // Request remaining bytes, release the bus
+  while (_i2cPort->available())
+  {
+    dest[bytesRead] = _i2cPort->read(); // Read and store each byte
+    bytesRead++;
+  }
 
-/**************************************************************************/
-/*!
-    @brief  Queue a printable text message for transmission with an appID
-    @param  data
-            The message as printable ASCII characters (0x20 to 0x7E, space to ~)
-    @param  msg_id
-            A pointer to a uint64_t which will hold the assigned message ID
-    @param  appID
-            The application ID: 0 to 64999
-    @return SWARM_M138_ERROR_SUCCESS if successful
-            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
-            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
-            SWARM_M138_ERROR_ERROR if unsuccessful
-*/
-/**************************************************************************/
-Swarm_M138_Error_e SWARM_M138::transmitText(const char *data, uint64_t *msg_id, uint16_t appID)
-{
-  return (transmitText(data, msg_id, true, appID, false, 0, false, 0));
+  return (bytesRead);
 }
 
-/**************************************************************************/
-/*!
-    @brief  Queue a printable text message for transmission with a hold duration
-    @param  data
-            The message as printable ASCII characters (0x20 to 0x7E, space to ~)
-    @param  msg_id
-            A pointer to a uint64_t which will hold the assigned message ID
-    @param  hold
-            The hold duration in seconds: 60 to 34819200 (13 months)
-            The message expires if it has not been transmitted within the hold duration
-            The default hold duration is 172800 seconds (48 hours)
-    @return SWARM_M138_ERROR_SUCCESS if successful
-            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
-            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
-            SWARM_M138_ERROR_ERROR if unsuccessful
-*/
-/**************************************************************************/
-Swarm_M138_Error_e SWARM_M138::transmitTextHold(const char *data, uint64_t *msg_id, uint32_t hold)
+// Write serial data to Qwiic Swarm
+int SWARM_M138::qwiicSwarmWriteChars(int len, const char *dest)
 {
-  return (transmitText(data, msg_id, false, 0, true, hold, false, 0));
+  if (len <= 0)
+    return (len);
+
+  if (dest == NULL)
+    return (0);
+
+  size_t i = 0;
+  size_t nexti;
+  uint16_t checksum = 0;
+
+  while (len > (QWIIC_SWARM_I2C_BUFFER_LENGTH - 3)) // If there are too many bytes to send all in one go
+  {
+    nexti = i + (QWIIC_SWARM_I2C_BUFFER_LENGTH - 3);
+    _i2cPort->beginTransmission((uint8_t)_address);
+    _i2cPort->write(QWIIC_SWARM_DATA_REG); // Point to the serial data 'register'
+    for (; i < nexti; i++)
+    {
+        _i2cPort->write(dest[i]); // Write each byte
+        checksum += (uint16_t)dest[i]; // Update the checksum
+    }
+    len -= (QWIIC_SWARM_I2C_BUFFER_LENGTH - 3); // Decrease the number of bytes still to send
+    _i2cPort->endTransmission(); // Send data and release the bus (the 841 (WireS) doesn't like it if the Master holds the bus!)
+  }
+
+  // There are now <= (TINY_I2C_BUFFER_LENGTH - 3) bytes left to send, so send them and then release the bus
+  _i2cPort->beginTransmission((uint8_t)_address);
+  _i2cPort->write(QWIIC_SWARM_DATA_REG); // Point to the 'serial register'
+  while (len > 0)
+  {
+    _i2cPort->write(dest[i]);
+    checksum += (uint16_t)dest[i];
+    len--;
+    i++;
+  }
+  _i2cPort->write((uint8_t)(checksum >> 8));
+  _i2cPort->write((uint8_t)(checksum & 0xFF));
+  if (_i2cPort->endTransmission() != 0) //Send data and release bus
+    if (_printDebug == true)
+      _debugPort->println(F("qwiicSwarmWriteChars: I2C write was not successful!"));
+
+  return ((int)i);
 }
 
-/**************************************************************************/
-/*!
-    @brief  Queue a printable text message for transmission with a hold duration and an appID
-    @param  data
-            The message as printable ASCII characters (0x20 to 0x7E, space to ~)
-    @param  msg_id
-            A pointer to a uint64_t which will hold the assigned message ID
-    @param  hold
-            The hold duration in seconds: 60 to 34819200 (13 months)
-            The message expires if it has not been transmitted within the hold duration
-            The default hold duration is 172800 seconds (48 hours)
-    @param  appID
-            The application ID: 0 to 64999
-    @return SWARM_M138_ERROR_SUCCESS if successful
-            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
-            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
-            SWARM_M138_ERROR_ERROR if unsuccessful
-*/
-/**************************************************************************/
-Swarm_M138_Error_e SWARM_M138::transmitTextHold(const char *data, uint64_t *msg_id, uint32_t hold, uint16_t appID)
+void SWARM_M138::beginSerial(unsigned long baud)
 {
-  return (transmitText(data, msg_id, true, appID, true, hold, false, 0));
+  if (_transport != NULL)
+  {
+    _transport->begin(baud);
+  }
+  else if (_hardSerial != NULL)
+  {
+    _hardSerial->begin(baud);
+  }
+#ifdef SWARM_M138_SOFTWARE_SERIAL_ENABLED
+  else if (_softSerial != NULL)
+  {
+    _softSerial->end();
+    _softSerial->begin(baud);
+  }
+#endif
+  delay(100);
 }
 
-/**************************************************************************/
-/*!
-    @brief  Queue a printable text message for transmission with an expiry time (epoch)
-    @param  data
-            The message as printable ASCII characters (0x20 to 0x7E, space to ~)
-    @param  msg_id
-            A pointer to a uint64_t which will hold the assigned message ID
-    @param  epoch
-            The second date after which the message will be expired if it has not been sent.
-            1577836800 to 2147483647
-            (2020-01-01 00:00:00 to 2038-01-19 03:14:07)
-    @return SWARM_M138_ERROR_SUCCESS if successful
-            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
-            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
-            SWARM_M138_ERROR_ERROR if unsuccessful
-*/
-/**************************************************************************/
-Swarm_M138_Error_e SWARM_M138::transmitTextExpire(const char *data, uint64_t *msg_id, uint32_t epoch)
+// Add an intent to the RX batch. Intents for the same message are merged
+// If the batch is full, it is flushed first
+Swarm_M138_Error_e SWARM_M138::rxBatchQueue(uint64_t msg_id, uint8_t flags)
 {
-  return (transmitText(data, msg_id, false, 0, false, 0, true, epoch));
+  for (uint16_t i = 0; i < _rxBatch->count; i++)
+  {
+    if (_rxBatch->entries[i].msg_id == msg_id)
+    {
+      _rxBatch->entries[i].flags |= flags;
+      return (SWARM_M138_ERROR_SUCCESS);
+    }
+  }
+
+  if (_rxBatch->count >= _rxBatch->size) // Is the batch full?
+  {
+    Swarm_M138_Error_e err = flushRxBatch();
+    if (err != SWARM_M138_ERROR_SUCCESS)
+      return (err);
+  }
+
+  _rxBatch->entries[_rxBatch->count].msg_id = msg_id;
+  _rxBatch->entries[_rxBatch->count].flags = flags;
+  _rxBatch->count++;
+
+  return (SWARM_M138_ERROR_SUCCESS);
 }
 
-/**************************************************************************/
-/*!
-    @brief  Queue a printable text message for transmission with an expiry time (epoch) and an appID
-    @param  data
-            The message as printable ASCII characters (0x20 to 0x7E, space to ~)
-    @param  msg_id
-            A pointer to a uint64_t which will hold the assigned message ID
-    @param  epoch
-            The second date after which the message will be expired if it has not been sent.
-            1577836800 to 2147483647
-            (2020-01-01 00:00:00 to 2038-01-19 03:14:07)
-    @param  appID
-            The application ID: 0 to 64999
-    @return SWARM_M138_ERROR_SUCCESS if successful
-            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
-            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
-            SWARM_M138_ERROR_ERROR if unsuccessful
-*/
-/**************************************************************************/
-Swarm_M138_Error_e SWARM_M138::transmitTextExpire(const char *data, uint64_t *msg_id, uint32_t epoch, uint16_t appID)
+// Send a single $MM D=<msg_id> (del is true) or $MM M=<msg_id> command
+// command and response are allocated by the caller so they can be reused
+Swarm_M138_Error_e SWARM_M138::rxBatchSendOne(uint64_t msg_id, bool del, char *command, char *response)
 {
-  return (transmitText(data, msg_id, true, appID, false, 0, true, epoch));
+  char fwd[21]; // Up to 20 digits plus null
+  char rev[21];
+
+  memset(fwd, 0, 21); // Clear it
+  sprintf(command, "%s %s", SWARM_M138_COMMAND_MSG_RX_MGMT, del ? "D=" : "M="); // Copy the command
+
+  // Add the 64-bit message ID
+  // Based on printLLNumber by robtillaart
+  // https://forum.arduino.cc/index.php?topic=143584.msg1519824#msg1519824
+  unsigned int i = 0;
+  if (msg_id == 0ULL) // if msg_id is zero, set fwd to "0"
+  {
+    fwd[0] = '0';
+  }
+  else
+  {
+    while (msg_id > 0)
+    {
+      rev[i++] = (msg_id % 10) + '0'; // divide by 10, convert the remainder to char
+      msg_id /= 10; // divide by 10
+    }
+    unsigned int j = 0;
+    while (i > 0)
+    {
+      fwd[j++] = rev[--i]; // reverse the order
+    }
+  }
+  strcat(command, fwd);
+
+  strcat(command, "*"); // Append the asterix
+
+  addChecksumLF(command); // Add the checksum bytes and line feed
+
+  memset(response, 0, _RxBuffSize); // Clear it
+
+  if (del)
+    return (sendCommandWithResponse(command, "$MM DELETED", "$MM ERR", response, _RxBuffSize, SWARM_M138_MESSAGE_DELETE_TIMEOUT));
+
+  return (sendCommandWithResponse(command, "$MM MARKED", "$MM ERR", response, _RxBuffSize, SWARM_M138_MESSAGE_READ_TIMEOUT));
 }
 
-// Queue a text message for transmission
-// Return the allocated message ID in msg_id
-Swarm_M138_Error_e SWARM_M138::transmitText(const char *data, uint64_t *msg_id, bool useAppID, uint16_t appID,
-                                            bool useHold, uint32_t hold, bool useEpoch, uint32_t epoch)
+// Decode a $MM AI=<appID>,<data>,<msg_id>,<epoch>* response into binary
+// On entry, len holds the size of data. On exit, it holds the number of bytes decoded
+Swarm_M138_Error_e SWARM_M138::decodeRxMessage(const char *response, uint8_t *data, size_t *len, uint64_t *msg_id, uint32_t *epoch, uint16_t *appID)
 {
-  char *command;
-  char *response;
-  char *scratchpad;
-  Swarm_M138_Error_e err;
-
-  // Calculate the possible message length
-  size_t msgLen = strlen(SWARM_M138_COMMAND_TX_DATA); // $TD
-  msgLen += 1; // Space
-  if (useAppID) msgLen += 3 + 5 + 1; // AI=65535,
-  if (useHold) msgLen += 3 + 8 + 1; // HD=34819200,
-  if (useEpoch) msgLen += 3 + 10 + 1; // ET=2147483647,
-  msgLen += 2 + strlen(data); // Quotes plus the message itself
-  msgLen += 5; // asterix, checksum chars, line feed, null
+  const char *responseStart = strstr(response, "$MM AI="); // Find the start of the response
+  if (responseStart == NULL)
+    return (SWARM_M138_ERROR_ERROR);
 
-  // Allocate memory for the command, message, asterix, checksum bytes, \n and \0
-  command = swarm_m138_alloc_char(msgLen);
-  if (command == NULL)
-    return (SWARM_M138_ERROR_MEM_ALLOC);
-  memset(command, 0, msgLen); // Clear it
+  const char *responseEnd = strchr(responseStart, '*'); // Find the asterix
+  if (responseEnd == NULL)
+    return (SWARM_M138_ERROR_ERROR);
 
-  // Allocate memory for the scratchpad
-  scratchpad = swarm_m138_alloc_char(16);
-  if (scratchpad == NULL)
+  // Extract the appID
+  responseStart += 7; // Point at the first digit of the appID
+  uint16_t theAppID = 0;
+  while ((*responseStart != ',') && (responseStart < responseEnd))
   {
-    swarm_m138_free_char(command);
-    return (SWARM_M138_ERROR_MEM_ALLOC);
+    theAppID = theAppID * 10;
+    theAppID += (uint16_t)(*responseStart - '0');
+    responseStart++;
   }
-  memset(scratchpad, 0, 16); // Clear it
+  if (responseStart >= responseEnd)
+    return (SWARM_M138_ERROR_INVALID_FORMAT);
+  responseStart++; // Point to the first ASCII Hex character
 
-  sprintf(command, "%s ", SWARM_M138_COMMAND_TX_DATA); // Copy the command. Append the space
-  if (useAppID)
+  // Convert the ASCII Hex into binary, two characters at a time
+  size_t bytesDecoded = 0;
+  while ((*responseStart != ',') && ((responseStart + 1) < responseEnd) && (bytesDecoded < *len))
   {
-    strcat(command, "AI=");
-    sprintf(scratchpad, "%d", appID);
-    strcat(command, scratchpad);
-    strcat(command, ",");
+    uint8_t theByte = 0;
+    for (int nibble = 0; nibble < 2; nibble++)
+    {
+      char c = *responseStart;
+      theByte <<= 4;
+      if ((c >= '0') && (c <= '9'))
+        theByte |= c - '0';
+      else if ((c >= 'a') && (c <= 'f'))
+        theByte |= c + 10 - 'a';
+      else if ((c >= 'A') && (c <= 'F'))
+        theByte |= c + 10 - 'A';
+      else
+        return (SWARM_M138_ERROR_INVALID_FORMAT);
+      responseStart++;
+    }
+    data[bytesDecoded++] = theByte;
   }
-  if (useHold)
-  {
-    strcat(command, "HD=");
-#if defined(ARDUINO_ARCH_ESP32) || defined(ARDUINO_ARCH_ESP8266)
-    sprintf(scratchpad, "%d", hold);
-#else
-    sprintf(scratchpad, "%ld", hold);
-#endif
-    strcat(command, scratchpad);
-    strcat(command, ",");
+  if (*responseStart != ',') // Check we reached the comma (and did not run out of room)
+    return (SWARM_M138_ERROR_INVALID_FORMAT);
+  responseStart++; // Point to the first digit of the msg_id
+
+  // Extract the msg_id
+  uint64_t theID = 0;
+  while ((*responseStart != ',') && (responseStart < responseEnd))
+  {
+    theID *= 10;
+    theID += (uint64_t)(*responseStart - '0');
+    responseStart++;
   }
-  if (useEpoch)
+  if (responseStart >= responseEnd)
+    return (SWARM_M138_ERROR_INVALID_FORMAT);
+  responseStart++; // Point to the first digit of the epoch
+
+  // Extract the epoch
+  uint32_t theEpoch = 0;
+  while (responseStart < responseEnd)
   {
-    strcat(command, "ET=");
-#if defined(ARDUINO_ARCH_ESP32) || defined(ARDUINO_ARCH_ESP8266)
-    sprintf(scratchpad, "%d", epoch);
-#else
-    sprintf(scratchpad, "%ld", epoch);
-#endif
-    strcat(command, scratchpad);
-    strcat(command, ",");
+    theEpoch *= 10;
+    theEpoch += (uint32_t)(*responseStart - '0');
+    responseStart++;
   }
-  strcat(command, "\""); // Append the quote  
-  strcat(command, data); // Append the message
-  strcat(command, "\"*"); // Append the quote and asterix
-  addChecksumLF(command); // Add the checksum bytes and line feed
 
-  response = swarm_m138_alloc_char(_RxBuffSize); // Allocate memory for the response
-  if (response == NULL)
+  *len = bytesDecoded;
+  *msg_id = theID;
+  *epoch = theEpoch;
+  *appID = theAppID;
+
+  return (SWARM_M138_ERROR_SUCCESS);
+}
+
+// Append a record to the outbox log
+// Data records use seq _outbox->nextSeq. Acknowledgement records use the seq of the record which was accepted
+Swarm_M138_Error_e SWARM_M138::outboxAppend(uint8_t flags, const uint8_t *data, uint16_t len, uint16_t appID, uint32_t seq)
+{
+  uint8_t header[SWARM_M138_OUTBOX_HEADER_LEN];
+
+  if (_outbox == NULL)
+    return (SWARM_M138_ERROR_ERROR);
+
+  if ((len > SWARM_M138_MAX_PACKET_LENGTH_BYTES) || ((len > 0) && (data == NULL)))
+    return (SWARM_M138_ERROR_ERROR);
+
+  header[0] = SWARM_M138_OUTBOX_RECORD_MAGIC;
+  header[1] = flags;
+  header[2] = len & 0xFF;
+  header[3] = len >> 8;
+  header[4] = appID & 0xFF;
+  header[5] = appID >> 8;
+  header[6] = seq & 0xFF;
+  header[7] = (seq >> 8) & 0xFF;
+  header[8] = (seq >> 16) & 0xFF;
+  header[9] = seq >> 24;
+
+  uint16_t theCRC = outboxCRC(header, SWARM_M138_OUTBOX_HEADER_LEN);
+  if (len > 0)
+    theCRC = outboxCRC(data, len, theCRC);
+
+  // Assemble the whole record, so it is appended in one go. A full log then never holds half a record
+  uint8_t *record = (uint8_t *)swarm_m138_alloc_char(SWARM_M138_OUTBOX_RECORD_OVERHEAD + len);
+  if (record == NULL)
+    return (SWARM_M138_ERROR_MEM_ALLOC);
+  memcpy(record, header, SWARM_M138_OUTBOX_HEADER_LEN);
+  if (len > 0)
+    memcpy(&record[SWARM_M138_OUTBOX_HEADER_LEN], data, len);
+  record[SWARM_M138_OUTBOX_HEADER_LEN + len] = theCRC & 0xFF;
+  record[SWARM_M138_OUTBOX_HEADER_LEN + len + 1] = theCRC >> 8;
+
+  bool appended = _outbox->storage->append(record, SWARM_M138_OUTBOX_RECORD_OVERHEAD + len);
+  if ((!appended) && outboxCompact()) // Is the storage full? Make room by removing the sent records, then try again
+    appended = _outbox->storage->append(record, SWARM_M138_OUTBOX_RECORD_OVERHEAD + len);
+
+  swarm_m138_free_char((char *)record);
+
+  if (!appended)
+    return (SWARM_M138_ERROR_ERROR);
+
+  if ((flags & SWARM_M138_OUTBOX_RECORD_ACK) == 0)
   {
-    swarm_m138_free_char(command);
-    swarm_m138_free_char(scratchpad);
-    return(SWARM_M138_ERROR_MEM_ALLOC);
+    if (_outbox->pending == 0)
+      _outbox->readOffset = _outbox->storage->size() - (SWARM_M138_OUTBOX_RECORD_OVERHEAD + len); // This is now the oldest pending record
+    _outbox->nextSeq++;
+    _outbox->pending++;
   }
-  memset(response, 0, _RxBuffSize); // Clear it
 
-  err = sendCommandWithResponse(command, "$TD OK,", "$TD ERR", response, _RxBuffSize, SWARM_M138_MESSAGE_TRANSMIT_TIMEOUT);
+  return (SWARM_M138_ERROR_SUCCESS);
+}
 
-  if (err == SWARM_M138_ERROR_SUCCESS) // Check if we got $TD OK
+// Read the next valid record from the outbox log, starting at offset
+// If the record at offset is damaged (e.g. a write was interrupted by a reset), step forward until a valid record is found
+// On success, offset is updated to point to the start of the record. data must be able to hold SWARM_M138_MAX_PACKET_LENGTH_BYTES
+bool SWARM_M138::outboxReadRecord(uint32_t *offset, uint8_t *flags, uint8_t *data, uint16_t *len, uint16_t *appID, uint32_t *seq)
+{
+  uint8_t header[SWARM_M138_OUTBOX_HEADER_LEN];
+  uint8_t crc[2];
+  uint32_t logSize = _outbox->storage->size();
+
+  while ((*offset + SWARM_M138_OUTBOX_RECORD_OVERHEAD) <= logSize)
   {
-    char *idStart = strstr(response, "$TD OK,");
-    if (idStart != NULL)
+    if (_outbox->storage->read(*offset, header, SWARM_M138_OUTBOX_HEADER_LEN) && (header[0] == SWARM_M138_OUTBOX_RECORD_MAGIC))
     {
-      char *idEnd = strchr(idStart, '*'); // Look for the asterix
-      if (idEnd != NULL)
+      uint16_t theLen = ((uint16_t)header[3] << 8) | header[2];
+      if ((theLen <= SWARM_M138_MAX_PACKET_LENGTH_BYTES) && ((*offset + SWARM_M138_OUTBOX_RECORD_OVERHEAD + theLen) <= logSize))
       {
-        uint64_t theID = 0;
-
-        idStart += 7; // Point at the first digit of the ID
-
-        while (idStart < idEnd)
+        if (((theLen == 0) || _outbox->storage->read(*offset + SWARM_M138_OUTBOX_HEADER_LEN, data, theLen))
+            && _outbox->storage->read(*offset + SWARM_M138_OUTBOX_HEADER_LEN + theLen, crc, 2))
         {
-          theID *= 10;
-          theID += (uint64_t)((*idStart) - '0'); // Add each digit to theID
-          idStart++;
+          uint16_t theCRC = outboxCRC(header, SWARM_M138_OUTBOX_HEADER_LEN);
+          if (theLen > 0)
+            theCRC = outboxCRC(data, theLen, theCRC);
+          if (theCRC == (((uint16_t)crc[1] << 8) | crc[0]))
+          {
+            *flags = header[1];
+            *len = theLen;
+            *appID = ((uint16_t)header[5] << 8) | header[4];
+            *seq = ((uint32_t)header[9] << 24) | ((uint32_t)header[8] << 16) | ((uint32_t)header[7] << 8) | header[6];
+            return (true);
+          }
         }
-
-        *msg_id = theID;
       }
     }
+
+    if (_printDebug == true)
+    {
+      _debugPort->print(F("outboxReadRecord: invalid record at offset "));
+      _debugPort->println(*offset);
+    }
+
+    (*offset)++; // Resynchronise: look for the next magic byte
   }
 
-  swarm_m138_free_char(command);
-  swarm_m138_free_char(scratchpad);
-  swarm_m138_free_char(response);
-  return (err);
+  return (false);
 }
 
-/**************************************************************************/
-/*!
-    @brief  Queue a binary message for transmission
-    @param  data
-            The binary message
-    @param  len
-            The length of the binary message in bytes
-    @param  msg_id
-            A pointer to a uint64_t which will hold the assigned message ID
-    @return SWARM_M138_ERROR_SUCCESS if successful
-            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
-            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
-            SWARM_M138_ERROR_ERROR if unsuccessful
-*/
-/**************************************************************************/
-Swarm_M138_Error_e SWARM_M138::transmitBinary(const uint8_t *data, size_t len, uint64_t *msg_id)
+// Remove the records which precede the oldest pending record: they have all been accepted by the modem
+// If nothing is pending, the log is cleared. Otherwise the storage must support discard
+// Return true if any bytes were removed
+bool SWARM_M138::outboxCompact(void)
 {
-  return (transmitBinary(data, len, msg_id, false, 0, false, 0, false, 0));
-}
+  if ((_outbox == NULL) || (_outbox->storage->size() == 0))
+    return (false);
 
-/**************************************************************************/
-/*!
-    @brief  Queue a binary message for transmission with an appID
-    @param  data
-            The binary message
-    @param  len
-            The length of the binary message in bytes
-    @param  msg_id
-            A pointer to a uint64_t which will hold the assigned message ID
-    @param  appID
-            The application ID: 0 to 64999
-    @return SWARM_M138_ERROR_SUCCESS if successful
-            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
-            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
-            SWARM_M138_ERROR_ERROR if unsuccessful
-*/
-/**************************************************************************/
-Swarm_M138_Error_e SWARM_M138::transmitBinary(const uint8_t *data, size_t len, uint64_t *msg_id, uint16_t appID)
-{
-  return (transmitBinary(data, len, msg_id, true, appID, false, 0, false, 0));
-}
+  if (_outbox->pending == 0)
+  {
+    if (!_outbox->storage->clear())
+      return (false);
+  }
+  else
+  {
+    if ((_outbox->readOffset == 0) || (!_outbox->storage->discard(_outbox->readOffset)))
+      return (false);
+  }
 
-/**************************************************************************/
-/*!
-    @brief  Queue a binary message for transmission with a hold duration
-    @param  data
-            The binary message
-    @param  len
-            The length of the binary message in bytes
-    @param  msg_id
-            A pointer to a uint64_t which will hold the assigned message ID
-    @param  hold
-            The hold duration in seconds: 60 to 34819200 (13 months)
-            The message expires if it has not been transmitted within the hold duration
-            The default hold duration is 172800 seconds (48 hours)
-    @return SWARM_M138_ERROR_SUCCESS if successful
-            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
-            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
-            SWARM_M138_ERROR_ERROR if unsuccessful
-*/
-/**************************************************************************/
-Swarm_M138_Error_e SWARM_M138::transmitBinaryHold(const uint8_t *data, size_t len, uint64_t *msg_id, uint32_t hold)
-{
-  return (transmitBinary(data, len, msg_id, false, 0, true, hold, false, 0));
-}
+  if (_printDebug == true)
+  {
+    _debugPort->print(F("outboxCompact: log size is now "));
+    _debugPort->println(_outbox->storage->size());
+  }
 
-/**************************************************************************/
-/*!
-    @brief  Queue a binary message for transmission with a hold duration and an appID
-    @param  data
-            The binary message
-    @param  len
-            The length of the binary message in bytes
-    @param  msg_id
-            A pointer to a uint64_t which will hold the assigned message ID
-    @param  hold
-            The hold duration in seconds: 60 to 34819200 (13 months)
-            The message expires if it has not been transmitted within the hold duration
-            The default hold duration is 172800 seconds (48 hours)
-    @param  appID
-            The application ID: 0 to 64999
-    @return SWARM_M138_ERROR_SUCCESS if successful
-            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
-            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
-            SWARM_M138_ERROR_ERROR if unsuccessful
-*/
-/**************************************************************************/
-Swarm_M138_Error_e SWARM_M138::transmitBinaryHold(const uint8_t *data, size_t len, uint64_t *msg_id, uint32_t hold, uint16_t appID)
-{
-  return (transmitBinary(data, len, msg_id, true, appID, true, hold, false, 0));
+  _outbox->readOffset = 0;
+  return (true);
 }
 
-/**************************************************************************/
-/*!
-    @brief  Queue a binary message for transmission with an expiry time (epoch)
-    @param  data
-            The binary message
-    @param  len
-            The length of the binary message in bytes
-    @param  msg_id
-            A pointer to a uint64_t which will hold the assigned message ID
-    @param  epoch
-            The second date after which the message will be expired if it has not been sent.
-            1577836800 to 2147483647
-            (2020-01-01 00:00:00 to 2038-01-19 03:14:07)
-    @return SWARM_M138_ERROR_SUCCESS if successful
-            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
-            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
-            SWARM_M138_ERROR_ERROR if unsuccessful
-*/
-/**************************************************************************/
-Swarm_M138_Error_e SWARM_M138::transmitBinaryExpire(const uint8_t *data, size_t len, uint64_t *msg_id, uint32_t epoch)
+// CRC-16/CCITT (polynomial 0x1021). Pass the previous crc to continue a calculation
+uint16_t SWARM_M138::outboxCRC(const uint8_t *data, uint16_t len, uint16_t crc)
 {
-  return (transmitBinary(data, len, msg_id, false, 0, false, 0, true, epoch));
+  for (uint16_t i = 0; i < len; i++)
+  {
+    crc ^= ((uint16_t)data[i]) << 8;
+    for (uint8_t bit = 0; bit < 8; bit++)
+    {
+      if (crc & 0x8000)
+        crc = (crc << 1) ^ 0x1021;
+      else
+        crc = crc << 1;
+    }
+  }
+  return (crc);
 }
 
-/**************************************************************************/
-/*!
-    @brief  Queue a binary message for transmission with an expiry time (epoch) and an appID
-    @param  data
-            The binary message
-    @param  len
-            The length of the binary message in bytes
-    @param  msg_id
-            A pointer to a uint64_t which will hold the assigned message ID
-    @param  epoch
-            The second date after which the message will be expired if it has not been sent.
-            1577836800 to 2147483647
-            (2020-01-01 00:00:00 to 2038-01-19 03:14:07)
-    @param  appID
-            The application ID: 0 to 64999
-    @return SWARM_M138_ERROR_SUCCESS if successful
-            SWARM_M138_ERROR_MEM_ALLOC if the memory allocation fails
-            SWARM_M138_ERROR_ERR if a command ERR is received - error is returned in commandError
-            SWARM_M138_ERROR_ERROR if unsuccessful
-*/
-/**************************************************************************/
-Swarm_M138_Error_e SWARM_M138::transmitBinaryExpire(const uint8_t *data, size_t len, uint64_t *msg_id, uint32_t epoch, uint16_t appID)
+// Read a byte from the static compression dictionary
+uint8_t SWARM_M138::compressorDictionaryByte(uint16_t index)
 {
-  return (transmitBinary(data, len, msg_id, true, appID, false, 0, true, epoch));
+  return (pgm_read_byte(&swarm_m138_compressor_dictionary[index]));
 }
 
-// Queue a binary message for transmission
-// Return the allocated message ID in msg_id
-Swarm_M138_Error_e SWARM_M138::transmitBinary(const uint8_t *data, size_t len, uint64_t *msg_id, bool useAppID, uint16_t appID,
-                                            bool useHold, uint32_t hold, bool useEpoch, uint32_t epoch)
+// Queue the fragments of a message. If missing is not NULL, only queue the fragments flagged in the bitmap
+Swarm_M138_Error_e SWARM_M138::transmitFragmentsInternal(const uint8_t *data, size_t len, uint8_t key, const uint8_t *missing, uint16_t channel)
 {
-  char *command;
-  char *response;
-  char *scratchpad;
-  Swarm_M138_Error_e err;
+  Swarm_M138_Error_e err = SWARM_M138_ERROR_SUCCESS;
 
-  // Calculate the possible message length
-  size_t msgLen = strlen(SWARM_M138_COMMAND_TX_DATA); // $TD
-  msgLen += 1; // Space
-  if (useAppID) msgLen += 3 + 5 + 1; // AI=65535,
-  if (useHold) msgLen += 3 + 8 + 1; // HD=34819200,
-  if (useEpoch) msgLen += 3 + 10 + 1; // ET=2147483647,
-  msgLen += 2 * len; // The message length in ASCII Hex
-  msgLen += 5; // asterix, checksum chars, line feed, null
+  if ((data == NULL) || (len == 0) || (channel >= SWARM_M138_FRAGMENT_CHANNELS))
+    return (SWARM_M138_ERROR_ERROR);
 
-  // Allocate memory for the command, message, asterix, checksum bytes, \n and \0
-  command = swarm_m138_alloc_char(msgLen);
-  if (command == NULL)
-    return (SWARM_M138_ERROR_MEM_ALLOC);
-  memset(command, 0, msgLen); // Clear it
+  size_t count = (len + SWARM_M138_FRAGMENT_PAYLOAD - 1) / SWARM_M138_FRAGMENT_PAYLOAD;
+  if (count > SWARM_M138_FRAGMENT_MAX_COUNT)
+    return (SWARM_M138_ERROR_ERROR);
 
-  // Allocate memory for the scratchpad
-  scratchpad = swarm_m138_alloc_char(16);
-  if (scratchpad == NULL)
-  {
-    swarm_m138_free_char(command);
+  uint8_t *fragment = (uint8_t *)swarm_m138_alloc_char(SWARM_M138_MAX_PACKET_LENGTH_BYTES); // Allocate memory for the fragment
+  if (fragment == NULL)
     return (SWARM_M138_ERROR_MEM_ALLOC);
-  }
-  memset(scratchpad, 0, 16); // Clear it
 
-  sprintf(command, "%s ", SWARM_M138_COMMAND_TX_DATA); // Copy the command. Append the space
-  if (useAppID)
-  {
-    strcat(command, "AI=");
-    sprintf(scratchpad, "%d", appID);
-    strcat(command, scratchpad);
-    strcat(command, ",");
-  }
-  if (useHold)
+  uint16_t appID = SWARM_M138_FRAGMENT_APPID_BASE + channel;
+
+  for (size_t index = 0; (index < count) && (err == SWARM_M138_ERROR_SUCCESS); index++)
   {
-    strcat(command, "HD=");
-#if defined(ARDUINO_ARCH_ESP32) || defined(ARDUINO_ARCH_ESP8266)
-    sprintf(scratchpad, "%d", hold);
-#else
-    sprintf(scratchpad, "%ld", hold);
-#endif
-    strcat(command, scratchpad);
-    strcat(command, ",");
+    if ((missing != NULL) && ((missing[index >> 3] & (1 << (index & 7))) == 0)) // Skip fragments which were received
+      continue;
+
+    size_t offset = index * SWARM_M138_FRAGMENT_PAYLOAD;
+    size_t fragmentLen = len - offset;
+    if (fragmentLen > SWARM_M138_FRAGMENT_PAYLOAD)
+      fragmentLen = SWARM_M138_FRAGMENT_PAYLOAD;
+
+    fragment[0] = key;
+    fragment[1] = (uint8_t)index;
+    fragment[2] = (uint8_t)count;
+    memcpy(&fragment[SWARM_M138_FRAGMENT_HEADER_LEN], &data[offset], fragmentLen);
+
+    if (_outbox != NULL)
+      err = outboxBinary(fragment, fragmentLen + SWARM_M138_FRAGMENT_HEADER_LEN, appID);
+    else
+    {
+      uint64_t msg_id;
+      err = transmitBinary(fragment, fragmentLen + SWARM_M138_FRAGMENT_HEADER_LEN, &msg_id, appID);
+    }
   }
-  if (useEpoch)
+
+  swarm_m138_free_char((char *)fragment);
+  return (err);
+}
+
+// Discard the partial message if no fragment has arrived within the timeout. Call the timeout callback
+void SWARM_M138::checkReassemblyTimeout(void)
+{
+  if ((_reassembly == NULL) || (!_reassembly->active) || ((millis() - _reassembly->lastAt) < _reassembly->timeout))
+    return;
+
+  if (_printDebug == true)
+    _debugPort->println(F("checkReassemblyTimeout: partial message discarded"));
+
+  if (_swarmFragmentTimeoutCallback != NULL)
   {
-    strcat(command, "ET=");
-#if defined(ARDUINO_ARCH_ESP32) || defined(ARDUINO_ARCH_ESP8266)
-    sprintf(scratchpad, "%d", epoch);
-#else
-    sprintf(scratchpad, "%ld", epoch);
-#endif
-    strcat(command, scratchpad);
-    strcat(command, ",");
+    uint8_t missing[SWARM_M138_FRAGMENT_BITMAP_LENGTH];
+    getMissingFragments(missing);
+    _swarmFragmentTimeoutCallback(_reassembly->key, _reassembly->channel, _reassembly->count, (const uint8_t *)missing); // Call the callback
   }
-  for (size_t i = 0; i < len; i++)
+
+  _reassembly->active = false;
+}
+
+// Convert ASCII Hex into binary, two characters at a time. Stop at the first non-hex character, or when maxLen bytes have been converted
+size_t SWARM_M138::hexToBinary(const char *asciiHex, uint8_t *data, size_t maxLen)
+{
+  size_t bytesConverted = 0;
+
+  while (bytesConverted < maxLen)
   {
-    char c1 = (data[i] >> 4) + '0'; // Convert the MS nibble to ASCII
-    if (c1 >= ':') c1 = c1 + 'A' - ':';
-    char c2 = (data[i] & 0x0F) + '0'; // Convert the LS nibble to ASCII
-    if (c2 >= ':') c2 = c2 + 'A' - ':';
-    sprintf(scratchpad, "%c%c", c1, c2);
-    strcat(command, scratchpad); // Append each data byte as an ASCII Hex char pair
+    uint8_t theByte = 0;
+    for (int nibble = 0; nibble < 2; nibble++)
+    {
+      char c = *asciiHex;
+      theByte <<= 4;
+      if ((c >= '0') && (c <= '9'))
+        theByte |= c - '0';
+      else if ((c >= 'a') && (c <= 'f'))
+        theByte |= c + 10 - 'a';
+      else if ((c >= 'A') && (c <= 'F'))
+        theByte |= c + 10 - 'A';
+      else
+        return (bytesConverted);
+      asciiHex++;
+    }
+    data[bytesConverted++] = theByte;
   }
-  strcat(command, "*"); // Append the asterix
-  addChecksumLF(command); // Add the checksum bytes and line feed
 
-  response = swarm_m138_alloc_char(_RxBuffSize); // Allocate memory for the response
-  if (response == NULL)
+  return (bytesConverted);
+}
+
+// Return the index of the waiting scheduler message with the highest priority. Oldest first within a class
+int SWARM_M138::txSchedulerNext(void)
+{
+  int best = -1;
+
+  for (uint8_t i = 0; i < _txScheduler->size; i++)
   {
-    swarm_m138_free_char(command);
-    swarm_m138_free_char(scratchpad);
-    return(SWARM_M138_ERROR_MEM_ALLOC);
+    if ((!_txScheduler->entries[i].inUse) || (_txScheduler->entries[i].inModem))
+      continue;
+
+    if ((best < 0) || (_txScheduler->entries[i].priority > _txScheduler->entries[best].priority)
+        || ((_txScheduler->entries[i].priority == _txScheduler->entries[best].priority) && ((long)(_txScheduler->entries[i].queuedAt - _txScheduler->entries[best].queuedAt) < 0)))
+      best = i;
   }
-  memset(response, 0, _RxBuffSize); // Clear it
 
-  err = sendCommandWithResponse(command, "$TD OK,", "$TD ERR", response, _RxBuffSize, SWARM_M138_MESSAGE_TRANSMIT_TIMEOUT);
+  return (best);
+}
 
-  if (err == SWARM_M138_ERROR_SUCCESS) // Check if we got $TD OK
+// Delete scheduler messages with a priority lower than priority from the modem. They wait in the scheduler again
+// If all is false, stop once the modem window has room for one more message. Lowest priority (then newest) are deleted first
+Swarm_M138_Error_e SWARM_M138::txSchedulerEvict(uint8_t priority, bool all)
+{
+  Swarm_M138_Error_e err = SWARM_M138_ERROR_SUCCESS;
+
+  while (all || (getTxQueueDepth() >= _txScheduler->window))
   {
-    char *idStart = strstr(response, "$TD OK,");
-    if (idStart != NULL)
+    int victim = -1;
+    for (uint8_t i = 0; i < _txScheduler->size; i++)
     {
-      char *idEnd = strchr(idStart, '*'); // Look for the asterix
-      if (idEnd != NULL)
-      {
-        uint64_t theID = 0;
+      if ((!_txScheduler->entries[i].inUse) || (!_txScheduler->entries[i].inModem) || (_txScheduler->entries[i].priority >= priority))
+        continue;
 
-        idStart += 7; // Point at the first digit of the ID
+      if ((victim < 0) || (_txScheduler->entries[i].priority < _txScheduler->entries[victim].priority)
+          || ((_txScheduler->entries[i].priority == _txScheduler->entries[victim].priority) && ((long)(_txScheduler->entries[i].queuedAt - _txScheduler->entries[victim].queuedAt) > 0)))
+        victim = i;
+    }
 
-        while (idStart < idEnd)
-        {
-          theID *= 10;
-          theID += (uint64_t)((*idStart) - '0'); // Add each digit to theID
-          idStart++;
-        }
+    if (victim < 0) // Nothing left to evict
+      break;
 
-        *msg_id = theID;
-      }
+    if (_printDebug == true)
+      _debugPort->println(F("txSchedulerEvict: deleting a lower priority message from the modem"));
+
+    err = deleteTxMessage(_txScheduler->entries[victim].msg_id);
+
+    if ((err == SWARM_M138_ERROR_ERR) && (strstr(commandError, "DBX_INVMSGID") != NULL)) // Has it already been sent?
+    {
+      txMirrorRemove(_txScheduler->entries[victim].msg_id, false);
+      _txScheduler->entries[victim].inUse = false;
+      err = SWARM_M138_ERROR_SUCCESS;
     }
+    else if (err == SWARM_M138_ERROR_SUCCESS)
+      _txScheduler->entries[victim].inModem = false; // Wait in the scheduler again. queuedAt is unchanged so it keeps its place
+    else
+      break;
   }
 
-  swarm_m138_free_char(command);
-  swarm_m138_free_char(scratchpad);
-  swarm_m138_free_char(response);
   return (err);
 }
 
-/**************************************************************************/
-/*!
-    @brief  Set up the callback for the $DT Date Time message
-    @param  swarmDateTimeCallback
-            The address of the function to be called when an unsolicited $DT message arrives
-*/
-/**************************************************************************/
-void SWARM_M138::setDateTimeCallback(void (*swarmDateTimeCallback)(const Swarm_M138_DateTimeData_t *dateTime))
+// Add a fingerprint to the duplicate filter ring, overwriting the oldest if the ring is full
+// If persist is true, append it to the storage too. Compact the storage if it has grown too large
+void SWARM_M138::rxDedupInsert(uint32_t hash, uint32_t epoch, bool persist)
 {
-  _swarmDateTimeCallback = swarmDateTimeCallback;
+  _rxDedup->entries[_rxDedup->head].hash = hash;
+  _rxDedup->entries[_rxDedup->head].epoch = epoch;
+  _rxDedup->head++;
+  if (_rxDedup->head == _rxDedup->size)
+    _rxDedup->head = 0;
+  if (_rxDedup->count < _rxDedup->size)
+    _rxDedup->count++;
+
+  if ((!persist) || (_rxDedup->storage == NULL))
+    return;
+
+  if (_rxDedup->storage->size() >= ((uint32_t)_rxDedup->size * SWARM_M138_RX_DEDUP_RECORD_LEN * SWARM_M138_RX_DEDUP_COMPACT_FACTOR))
+  {
+    rxDedupCompact(); // The ring already holds the new fingerprint
+    return;
+  }
+
+  uint8_t buf[SWARM_M138_RX_DEDUP_RECORD_LEN];
+  for (uint8_t i = 0; i < 4; i++)
+  {
+    buf[i] = (uint8_t)(hash >> (8 * i));
+    buf[i + 4] = (uint8_t)(epoch >> (8 * i));
+  }
+  if ((!_rxDedup->storage->append(buf, SWARM_M138_RX_DEDUP_RECORD_LEN)) && (_printDebug == true))
+    _debugPort->println(F("rxDedupInsert: storage append failed"));
 }
 
-/**************************************************************************/
-/*!
-    @brief  Set up the callback for the $GJ jamming indication message
-    @param  swarmGpsJammingCallback
-            The address of the function to be called when an unsolicited $GJ message arrives
-*/
-/**************************************************************************/
-void SWARM_M138::setGpsJammingCallback(void (*swarmGpsJammingCallback)(const Swarm_M138_GPS_Jamming_Indication_t *jamming))
+// Rewrite the duplicate filter storage with the contents of the ring, oldest first
+bool SWARM_M138::rxDedupCompact(void)
 {
-  _swarmGpsJammingCallback = swarmGpsJammingCallback;
+  if (!_rxDedup->storage->clear())
+    return (false);
+
+  uint16_t index = (_rxDedup->head + _rxDedup->size - _rxDedup->count) % _rxDedup->size; // The oldest fingerprint
+  uint8_t buf[SWARM_M138_RX_DEDUP_RECORD_LEN];
+
+  for (uint16_t n = 0; n < _rxDedup->count; n++)
+  {
+    for (uint8_t i = 0; i < 4; i++)
+    {
+      buf[i] = (uint8_t)(_rxDedup->entries[index].hash >> (8 * i));
+      buf[i + 4] = (uint8_t)(_rxDedup->entries[index].epoch >> (8 * i));
+    }
+    if (!_rxDedup->storage->append(buf, SWARM_M138_RX_DEDUP_RECORD_LEN))
+      return (false);
+    index++;
+    if (index == _rxDedup->size)
+      index = 0;
+  }
+
+  return (true);
 }
 
-/**************************************************************************/
-/*!
-    @brief  Set up the callback for the $GN geospatial information message
-    @param  swarmGeospatialCallback
-            The address of the function to be called when an unsolicited $GN message arrives
-*/
-/**************************************************************************/
-void SWARM_M138::setGeospatialInfoCallback(void (*swarmGeospatialCallback)(const Swarm_M138_GeospatialData_t *info))
+// 32-bit FNV-1a hash of the appID (little endian) followed by the payload
+uint32_t SWARM_M138::rxDedupHash(uint16_t appID, const uint8_t *data, size_t len)
 {
-  _swarmGeospatialCallback = swarmGeospatialCallback;
+  uint32_t hash = 2166136261UL; // FNV offset basis
+
+  hash = (hash ^ (uint8_t)(appID & 0xFF)) * 16777619UL; // FNV prime
+  hash = (hash ^ (uint8_t)(appID >> 8)) * 16777619UL;
+
+  for (size_t i = 0; i < len; i++)
+    hash = (hash ^ data[i]) * 16777619UL;
+
+  return (hash);
 }
 
-/**************************************************************************/
-/*!
-    @brief  Set up the callback for the $GS GPS fix quality message
-    @param  swarmGpsFixQualityCallback
-            The address of the function to be called when an unsolicited $GS message arrives
-*/
-/**************************************************************************/
-void SWARM_M138::setGpsFixQualityCallback(void (*swarmGpsFixQualityCallback)(const Swarm_M138_GPS_Fix_Quality_t *fixQuality))
+// Return the queue slot for a new event of this type. Apply the overflow policy if the queue is full
+// Return NULL if the queue is disabled or the event must be dropped. The caller fills in the union
+Swarm_M138_Typed_Event_t *SWARM_M138::typedEventPush(Swarm_M138_Event_Type_e type)
 {
-  _swarmGpsFixQualityCallback = swarmGpsFixQualityCallback;
+  if (_typedEvents == NULL)
+    return (NULL);
+
+  if (_typedEvents->count == _typedEvents->size) // Is the queue full?
+  {
+    _typedEvents->dropped++;
+    if (_typedEvents->policy == SWARM_M138_OVERFLOW_DROP_NEWEST)
+      return (NULL);
+    _typedEvents->head = (uint8_t)((_typedEvents->head + 1) % _typedEvents->size); // Discard the oldest event
+    _typedEvents->count--;
+  }
+
+  Swarm_M138_Typed_Event_t *event = &_typedEvents->events[(_typedEvents->head + _typedEvents->count) % _typedEvents->size];
+  _typedEvents->count++;
+  if (_typedEvents->count > _typedEvents->highWater)
+    _typedEvents->highWater = _typedEvents->count;
+
+  event->type = type;
+  event->timestamp = millis();
+  return (event);
 }
 
-/**************************************************************************/
-/*!
-    @brief  Set up the callback for the $PW power status message
-    @param  swarmPowerStatusCallback
-            The address of the function to be called when an unsolicited $PW message arrives
-*/
-/**************************************************************************/
-void SWARM_M138::setPowerStatusCallback(void (*swarmPowerStatusCallback)(const Swarm_M138_Power_Status_t *power))
+// Return the message types needed by the callbacks and library features. This is the automatic subscription
+uint16_t SWARM_M138::subscriptionsNeeded(void)
 {
-  _swarmPowerStatusCallback = swarmPowerStatusCallback;
+  uint16_t mask = 0;
+
+  if (_swarmDateTimeCallback != NULL)
+    mask |= SWARM_M138_SUBSCRIBE(SWARM_M138_EVENT_DATE_TIME);
+  if (_swarmGpsJammingCallback != NULL)
+    mask |= SWARM_M138_SUBSCRIBE(SWARM_M138_EVENT_GPS_JAMMING);
+  if (_swarmGeospatialCallback != NULL)
+    mask |= SWARM_M138_SUBSCRIBE(SWARM_M138_EVENT_GEOSPATIAL);
+  if (_swarmGpsFixQualityCallback != NULL)
+    mask |= SWARM_M138_SUBSCRIBE(SWARM_M138_EVENT_GPS_FIX_QUALITY);
+  if (_swarmPowerStatusCallback != NULL)
+    mask |= SWARM_M138_SUBSCRIBE(SWARM_M138_EVENT_POWER_STATUS);
+  if (_swarmReceiveMessageCallback != NULL)
+    mask |= SWARM_M138_SUBSCRIBE(SWARM_M138_EVENT_RECEIVE_MESSAGE);
+  if (_swarmReceiveTestCallback != NULL)
+    mask |= SWARM_M138_SUBSCRIBE(SWARM_M138_EVENT_RECEIVE_TEST);
+  if (_swarmSleepWakeCallback != NULL)
+    mask |= SWARM_M138_SUBSCRIBE(SWARM_M138_EVENT_SLEEP_WAKE);
+  if (_swarmModemStatusCallback != NULL)
+    mask |= SWARM_M138_SUBSCRIBE(SWARM_M138_EVENT_MODEM_STATUS);
+  if (_swarmTransmitDataCallback != NULL)
+    mask |= SWARM_M138_SUBSCRIBE(SWARM_M138_EVENT_TRANSMIT_DATA);
+  if (_typedEvents != NULL)
+    mask |= SWARM_M138_SUBSCRIBE_ALL;
+
+  return (mask | subscriptionsRequired());
 }
 
-/**************************************************************************/
-/*!
-    @brief  Set up the callback for the $RT receive test message
-    @param  swarmReceiveTestCallback
-            The address of the function to be called when an unsolicited $RT message arrives
-*/
-/**************************************************************************/
-void SWARM_M138::setReceiveTestCallback(void (*swarmReceiveTestCallback)(const Swarm_M138_Receive_Test_t *rxTest))
+// Return the message types the enabled library features cannot work without
+// They are kept whatever the subscription mask and sampling say
+uint16_t SWARM_M138::subscriptionsRequired(void)
 {
-  _swarmReceiveTestCallback = swarmReceiveTestCallback;
+  uint16_t mask = 0;
+
+  if ((_txMirror != NULL) || (_txScheduler != NULL) || (_outbox != NULL)) // They follow $TD SENT
+    mask |= SWARM_M138_SUBSCRIBE(SWARM_M138_EVENT_TRANSMIT_DATA);
+  if ((_reassembly != NULL) || (_rxDedup != NULL)) // They see every $RD
+    mask |= SWARM_M138_SUBSCRIBE(SWARM_M138_EVENT_RECEIVE_MESSAGE);
+
+  return (mask);
 }
 
-/**************************************************************************/
-/*!
-    @brief  Set up the callback for the $M138 modem status messages
-    @param  swarmModemStatusCallback
-            The address of the function to be called when an unsolicited $M138 message arrives
-*/
-/**************************************************************************/
-void SWARM_M138::setModemStatusCallback(void (*swarmModemStatusCallback)(Swarm_M138_Modem_Status_e status, const char *debugOrError))
+// Return true if the line is a subscribed unsolicited message. No sampling. Used by pruneBacklog
+bool SWARM_M138::subscribed(const char *line)
 {
-  _swarmModemStatusCallback = swarmModemStatusCallback;
+  const char *tag = strchr(line, '$');
+  if (tag == NULL)
+    return (false);
+
+  if (findUrcHandler(tag, strlen(tag), false) != NULL)
+    return (true); // A registered handler needs it
+
+  Swarm_M138_Event_Type_e type = eventType(tag);
+  if (type == SWARM_M138_EVENT_UNKNOWN)
+    return (false); // Command responses are not kept in the backlog
+
+  uint16_t mask = _subscriptionMask;
+  if ((mask & SWARM_M138_SUBSCRIBE_AUTO) != 0)
+    mask = subscriptionsNeeded();
+  else
+    mask |= subscriptionsRequired();
+
+  return (((mask | _subscriptionAsync) & SWARM_M138_SUBSCRIBE(type)) != 0);
 }
 
-/**************************************************************************/
-/*!
-    @brief  Set up the callback for the $SL WAKE sleep mode messages
-    @param  swarmSleepWakeCallback
-            The address of the function to be called when an unsolicited $SL WAKE message arrives
-*/
-/**************************************************************************/
-void SWARM_M138::setSleepWakeCallback(void (*swarmSleepWakeCallback)(Swarm_M138_Wake_Cause_e cause))
+// Apply the subscriptions and sampling to a line. Called once per line by the framers, as soon as the tag is known
+// Return false if the line should be dropped. Lines without a known tag (e.g. command responses) are always kept
+bool SWARM_M138::acceptEvent(const char *line)
 {
-  _swarmSleepWakeCallback = swarmSleepWakeCallback;
+  const char *tag = strchr(line, '$');
+  if (tag == NULL)
+    return (true); // Let checkChecksum reject it
+
+  if (findUrcHandler(tag, strlen(tag), false) != NULL)
+    return (true); // A registered handler needs it
+
+  Swarm_M138_Event_Type_e type = eventType(tag);
+  if (type == SWARM_M138_EVENT_UNKNOWN)
+    return (true);
+
+  uint16_t bit = SWARM_M138_SUBSCRIBE(type);
+  if (((_subscriptionAsync | subscriptionsRequired()) & bit) != 0)
+    return (true); // A coroutine is waiting for it, or a library feature needs it
+
+  uint16_t mask = _subscriptionMask;
+  if (((mask & SWARM_M138_SUBSCRIBE_AUTO) == 0) && ((mask & bit) == 0))
+  {
+    _subscriptionFiltered = _subscriptionFiltered + 1;
+    return (false);
+  }
+
+  if (_subscriptionSampling == NULL)
+    return (true);
+
+  uint16_t every = _subscriptionSampling->every[type];
+  if (every > 1) // Keep the first of every N
+  {
+    uint16_t count = _subscriptionSampling->count[type];
+    _subscriptionSampling->count[type] = (uint16_t)((count + 1) % every);
+    if (count != 0)
+    {
+      _subscriptionFiltered = _subscriptionFiltered + 1;
+      return (false);
+    }
+  }
+
+  return (true);
 }
 
-/**************************************************************************/
-/*!
-    @brief  Set up the callback for the $RD receive data message
-    @param  swarmReceiveMessageCallback
-            The address of the function to be called when an unsolicited $RD message arrives
-*/
-/**************************************************************************/
-void SWARM_M138::setReceiveMessageCallback(void (*swarmReceiveMessageCallback)(const uint16_t *appID, const int16_t *rssi,
-                                           const int16_t *snr, const int16_t *fdev, const char *asciiHex))
+// Record the backlog high water mark
+void SWARM_M138::noteBacklogLength(size_t length)
 {
-  _swarmReceiveMessageCallback = swarmReceiveMessageCallback;
+  if (length > _backlogHighWater)
+    _backlogHighWater = (uint16_t)length;
 }
 
-/**************************************************************************/
-/*!
-    @brief  Set up the callback for $TD SENT messages
-    @param  swarmTransmitDataCallback
-            The address of the function to be called when an unsolicited $TD SENT message arrives
-*/
-/**************************************************************************/
-void SWARM_M138::setTransmitDataCallback(void (*swarmTransmitDataCallback)(const int16_t *rssi_sat, const int16_t *snr,
-                                         const int16_t *fdev, const uint64_t *id))
+// The receive window timers use millis in the fixed mode and micros in the gap mode
+unsigned long SWARM_M138::rxWindowNow(void)
 {
-  _swarmTransmitDataCallback = swarmTransmitDataCallback;
+  if (_rxWindowMode == SWARM_M138_RX_WINDOW_GAP)
+    return (micros());
+  return (millis());
 }
 
-/**************************************************************************/
-/*!
-    @brief  Convert modem status enum into printable text
-    @param  status
-            The modem status (enumerated)
-    @return A pointer to the modem status in string (const char) format
-*/
-/**************************************************************************/
-const char *SWARM_M138::modemStatusString(Swarm_M138_Modem_Status_e status)
+// Return true when the receive loops should stop waiting for more serial data.
+// lastRx is rxWindowNow when data last arrived. data holds length bytes read so far
+bool SWARM_M138::rxWindowClosed(const char *data, size_t length, unsigned long lastRx)
 {
-  switch (status)
+  if (_rxWindowMode == SWARM_M138_RX_WINDOW_GAP)
   {
-    case SWARM_M138_MODEM_STATUS_BOOT_ABORT:
-      return "BOOT ABORT (Restart after firmware crash)";
-      break;
-    case SWARM_M138_MODEM_STATUS_BOOT_DEVICEID:
-      return "BOOT DEVICEID (Device ID of the modem)";
-      break;
-    case SWARM_M138_MODEM_STATUS_BOOT_POWERON:
-      return "BOOT POWERON (Power has been applied)";
-      break;
-    case SWARM_M138_MODEM_STATUS_BOOT_RUNNING:
-      return "BOOT RUNNING (Boot has completed. Ready to accept commands)";
-      break;
-    case SWARM_M138_MODEM_STATUS_BOOT_UPDATED:
-      return "BOOT UPDATED (A firmware update was performed)";
-      break;
-    case SWARM_M138_MODEM_STATUS_BOOT_VERSION:
-      return "BOOT VERSION (Firmware version)";
-      break;
-    case SWARM_M138_MODEM_STATUS_BOOT_RESTART:
-      return "BOOT RESTART (Modem is restarting)";
-      break;
-    case SWARM_M138_MODEM_STATUS_BOOT_SHUTDOWN:
-      return "BOOT SHUTDOWN (Modem has shutdown. Disconnect power to restart)";
-      break;
-    case SWARM_M138_MODEM_STATUS_DATETIME:
-      return "DATETIME (GPS has acquired a valid date/time reference)";
-      break;
-    case SWARM_M138_MODEM_STATUS_POSITION:
-      return "POSITION (GPS has acquired a valid position 3D fix)";
-      break;
-    case SWARM_M138_MODEM_STATUS_DEBUG:
-      return "DEBUG (Debug message)";
-      break;
-    case SWARM_M138_MODEM_STATUS_ERROR:
-      return "ERROR (Error message)";
-      break;
-    case SWARM_M138_MODEM_STATUS_UNKNOWN:
-      return "UNKNOWN (undocumented)";
-      break;
-    default:
-      return "INVALID";
-      break;
+    if ((length > 0) && (data[length - 1] == '\n'))
+      return (true); // The data ends on a line boundary. Anything which follows is read by the next call
+    return ((micros() - lastRx) >= getRxGapMicros());
   }
+  return ((millis() - lastRx) >= _rxWindowMillis);
+}
+
+// Wait a little for more serial data. The gap can be much shorter than a millisecond
+void SWARM_M138::rxWindowWait(void)
+{
+  if ((_rxWindowMode == SWARM_M138_RX_WINDOW_GAP) && (getRxGapMicros() < 1000))
+    delayMicroseconds(10);
+  else
+    delay(1);
 }
 
-/**************************************************************************/
-/*!
-    @brief  Convert modem error enum into printable text
-    @param  error
-            The modem error (enumerated)
-    @return A pointer to the modem error in string (const char) format
-*/
-/**************************************************************************/
-const char *SWARM_M138::modemErrorString(Swarm_M138_Error_e error)
+// Find the adaptive timeout class for fixedTimeout. If create is true, use a free entry for a new class
+// Return NULL if the timeouts are fixed, or there is no free entry
+Swarm_M138_Timeout_Class_t *SWARM_M138::timeoutClass(unsigned long fixedTimeout, bool create)
 {
-  switch (error)
+  if (_adaptiveTimeouts == NULL)
+    return (NULL);
+
+  for (uint8_t i = 0; i < SWARM_M138_ADAPTIVE_CLASSES; i++)
   {
-    case SWARM_M138_ERROR_ERROR:
-      return "Just a plain old communication error";
-      break;
-    case SWARM_M138_ERROR_SUCCESS:
-      return "Hey, it worked!";
-      break;
-    case SWARM_M138_ERROR_MEM_ALLOC:
-      return "Memory allocation error";
-      break;
-    case SWARM_M138_ERROR_TIMEOUT:
-      return "Communication timeout";
-      break;
-    case SWARM_M138_ERROR_INVALID_FORMAT:
-      return "Indicates the command response format was invalid: missing $ or *; non-ASCII checksum";
-      break;
-    case SWARM_M138_ERROR_INVALID_CHECKSUM:
-      return "Indicates the command response checksum was invalid";
-      break;
-    case SWARM_M138_ERROR_INVALID_RATE:
-      return "The requested message rate was invalid";
-      break;
-    case SWARM_M138_ERROR_INVALID_MODE:
-      return "The requested GPIO1 pin mode was invalid";
-      break;
-    case SWARM_M138_ERROR_ERR:
-      return "Command input error (ERR)";
-      break;
+    if (_adaptiveTimeouts->classes[i].fixedTimeout == fixedTimeout)
+      return (&_adaptiveTimeouts->classes[i]);
+    if ((_adaptiveTimeouts->classes[i].fixedTimeout == 0) && create)
+    {
+      _adaptiveTimeouts->classes[i].fixedTimeout = fixedTimeout;
+      return (&_adaptiveTimeouts->classes[i]);
+    }
   }
+  return (NULL);
+}
 
-  return "UNKNOWN";
+// Return the timeout for a silent modem: the estimate, doubled for each consecutive timeout, between the floor and the ceiling
+// Until the class has learned enough, the fixed timeout applies
+unsigned long SWARM_M138::adaptiveLimit(Swarm_M138_Timeout_Class_t *timeoutClass, unsigned long fixedTimeout)
+{
+  if ((timeoutClass == NULL) || (timeoutClass->samples < SWARM_M138_ADAPTIVE_MIN_SAMPLES))
+    return (fixedTimeout);
+
+  unsigned long ceiling = adaptiveCeiling(fixedTimeout);
+
+  unsigned long limit = (timeoutClass->srtt8 >> 3) + timeoutClass->rttvar4; // SRTT + 4 x RTTVAR
+  for (uint8_t i = 0; (i < timeoutClass->backoff) && (limit < ceiling); i++)
+    limit <<= 1;
+  if (limit < _adaptiveTimeouts->floor)
+    limit = _adaptiveTimeouts->floor;
+  if (limit > ceiling)
+    limit = ceiling;
+  return (limit);
 }
 
-/**************************************************************************/
-/*!
-    @brief  Convert command error into a printable description
-    @param  ERR
-            The command error as const char *
-    @return A pointer to the command error description in string (const char) format
-*/
-/**************************************************************************/
-const char *SWARM_M138::commandErrorString(const char *ERR)
+// Return the ceiling for the class which uses fixedTimeout: the longer of the two. The ceiling never shortens a class
+unsigned long SWARM_M138::adaptiveCeiling(unsigned long fixedTimeout)
 {
-  if (strstr(ERR, "BADPARAMLENGTH") != NULL)
-    return "A parameter has an incorrect length";
-  if (strstr(ERR, "BADPARAMVALUE") != NULL)
-    return "A parameter has a value that is out of range";
-  if (strstr(ERR, "BADPARAM") != NULL)
-    return "Unrecognizable parameter after command";
-  if (strstr(ERR, "INVALIDCHAR") != NULL)
-    return "A parameter has an invalid character";
-  if (strstr(ERR, "NOTIMPLEMENTED") != NULL)
-    return "The command is not recognized as valid";
-  if (strstr(ERR, "PARAMMISSING") != NULL)
-    return "A required parameter is missing";
-  if (strstr(ERR, "PARAMDUPLICATE") != NULL)
-    return "A parameter has been duplicated";
-  if (strstr(ERR, "DBX_INVMSGID") != NULL)
-    return "Messages Management : invalid message ID";
-  if (strstr(ERR, "DBX_NOMORE") != NULL)
-    return "Messages Management : no messages found";
-  if (strstr(ERR, "TIMENOTSET") != NULL)
-    return "Time not yet set from GPS";
-  if (strstr(ERR, "NOCOMMAND") != NULL)
-    return "Sleep Mode : No S or U partameter";
-  if (strstr(ERR, "NOTIME") != NULL)
-    return "Sleep Mode : attempt to sleep before time is set";
-  if (strstr(ERR, "BADAPPID") != NULL)
-    return "Transmit Data : invalid application ID";
-  if (strstr(ERR, "BADDATA") != NULL)
-    return "Transmit Data : Message has odd number or non-hex characters when sending data as hexadecimal";
-  if (strstr(ERR, "BADEXPIRETIME") != NULL)
-    return "Transmit Data : Invalid hold time";
-  if (strstr(ERR, "HOLDTIMEEXPIRED") != NULL)
-    return "Transmit Data : Unable to send within requested hold time";
-  if (strstr(ERR, "NODEVICEID") != NULL)
-    return "Transmit Data : The Swarm device ID has not yet been set - contact Swarm Support";
-  if (strstr(ERR, "NOSPACE") != NULL)
-    return "Transmit Data : No space for message";
-  if (strstr(ERR, "DBXTOHIVEFULL") != NULL)
-    return "Transmit Data : Queue for queued messages is full. Maximum of 2048 messages may be held in the queue";
-  if (strstr(ERR, "TOOLONG") != NULL)
-    return "Transmit Data : Message is too large to send";
+  if ((_adaptiveTimeouts != NULL) && (_adaptiveTimeouts->ceiling > fixedTimeout))
+    return (_adaptiveTimeouts->ceiling);
+  return (fixedTimeout);
+}
 
-  return "UNKNOWN";
+// Update the estimate with a new response time (Jacobson / Karels, as in RFC 6298: alpha = 1/8, beta = 1/4)
+void SWARM_M138::learnResponseTime(Swarm_M138_Timeout_Class_t *timeoutClass, unsigned long responseTime)
+{
+  if (timeoutClass->samples == 0)
+  {
+    timeoutClass->srtt8 = responseTime << 3;
+    timeoutClass->rttvar4 = responseTime << 1; // RTTVAR = R / 2
+  }
+  else
+  {
+    long delta = (long)responseTime - (long)(timeoutClass->srtt8 >> 3);
+    timeoutClass->srtt8 = (uint32_t)((long)timeoutClass->srtt8 + delta); // SRTT += (R - SRTT) / 8
+    if (delta < 0)
+      delta = -delta;
+    delta -= (long)(timeoutClass->rttvar4 >> 2);
+    timeoutClass->rttvar4 = (uint32_t)((long)timeoutClass->rttvar4 + delta); // RTTVAR += (|R - SRTT| - RTTVAR) / 4
+  }
+  if (timeoutClass->samples < 0xFFFF)
+    timeoutClass->samples++;
+  timeoutClass->backoff = 0;
 }
 
-/////////////
-// Private //
-/////////////
+#ifdef SWARM_M138_STATS
+// Return the index of the command's tag in swarm_m138_stats_tags. Any other command gets the last entry
+uint8_t SWARM_M138::statsTagIndex(const char *command)
+{
+  for (uint8_t tag = 0; tag < (SWARM_M138_STATS_TAGS - 1); tag++)
+  {
+    if (strncmp(command, swarm_m138_stats_tags[tag], 3) == 0)
+      return (tag);
+  }
+  return (SWARM_M138_STATS_TAGS - 1);
+}
 
-// Add the two NMEA checksum bytes and line feed to a command
-void SWARM_M138::addChecksumLF(char *command)
+// Count the result of a command. The response time goes in the histogram unless the command timed out
+void SWARM_M138::noteCommandStats(uint8_t tag, Swarm_M138_Error_e err, unsigned long responseTime)
 {
-  char *dollar = strchr(command, '$'); // Find the $
+  if (tag >= SWARM_M138_STATS_TAGS)
+    return;
 
-  if (dollar == NULL) // Return now if the $ was not found
+  if (err == SWARM_M138_ERROR_TIMEOUT)
+  {
+    statsIncrement(_statsTimeouts[tag]);
     return;
+  }
 
-  char *asterix = strchr(dollar, '*'); // Find the *
+  if (err == SWARM_M138_ERROR_ERR)
+    statsIncrement(_statsErrors[tag]);
+  else if (err == SWARM_M138_ERROR_INVALID_CHECKSUM)
+    statsIncrement(_statsChecksumFailures[tag]);
 
-  if (asterix == NULL) // Return now if the * was not found
-    return;
+  uint8_t bucket = 0;
+  while ((responseTime > 0) && (bucket < (SWARM_M138_STATS_BUCKETS - 1)))
+  {
+    responseTime >>= 1;
+    bucket++;
+  }
+  statsIncrement(_statsHistogram[tag][bucket]);
+}
 
-  // Check for a second asterix ($MM C=**)
-  if (*(asterix + 1) == '*')
-    asterix++;
+void SWARM_M138::statsIncrement(swarm_m138_shared_uint16_t &counter)
+{
+  if (counter < 0xFFFF)
+    counter = counter + 1;
+}
+#endif
 
-  char checksum = 0;
+// Return the length of the tag at the start of a message or prefix: up to the first space, comma or asterix
+size_t SWARM_M138::urcTagLength(const char *tag, size_t length)
+{
+  size_t tagLength = 0;
+  while ((tagLength < length) && (tag[tagLength] != 0) && (tag[tagLength] != ' ') && (tag[tagLength] != ',') && (tag[tagLength] != '*'))
+    tagLength++;
+  return (tagLength);
+}
 
-  dollar++; // Point to the char after the $
+// Hash the tag (FNV-1a) into a URC handler bucket
+uint8_t SWARM_M138::urcBucket(const char *tag, size_t tagLength)
+{
+  uint32_t hash = 2166136261UL;
+  for (size_t i = 0; i < tagLength; i++)
+  {
+    hash ^= (uint8_t)tag[i];
+    hash *= 16777619UL;
+  }
+  return ((uint8_t)(hash & (_urcTable->bucketCount - 1)));
+}
 
-  while (dollar < asterix) // Calculate the checksum
+// Find the URC handler for a message. Only the handlers for the message's whole tag are checked (registerUrcHandler insists on a complete tag)
+// With wholePrefix, return the handler with the longest prefix which matches the message.
+// Otherwise return any handler for the message's tag: the line may be incomplete (the framers only know the tag)
+Swarm_M138_URC_Handler_t *SWARM_M138::findUrcHandler(const char *line, size_t length, bool wholePrefix)
+{
+  if (_urcTable == NULL)
+    return (NULL);
+
+  size_t tagLength = urcTagLength(line, length);
+  Swarm_M138_URC_Handler_t *best = NULL;
+  size_t bestLength = 0;
+
+  for (uint8_t next = _urcTable->buckets[urcBucket(line, tagLength)]; next != 0; next = _urcTable->handlers[next - 1].next)
   {
-    checksum ^= *dollar;
-    dollar++;
+    Swarm_M138_URC_Handler_t *entry = &_urcTable->handlers[next - 1];
+    if ((entry->tagLength != tagLength) || (memcmp(entry->prefix, line, tagLength) != 0))
+      continue; // A different tag with the same hash
+
+    if (!wholePrefix)
+      return (entry);
+
+    size_t prefixLength = strlen(entry->prefix);
+    if ((prefixLength <= length) && (prefixLength > bestLength) && (memcmp(entry->prefix, line, prefixLength) == 0))
+    {
+      best = entry;
+      bestLength = prefixLength;
+    }
   }
 
-  // Add the checksum bytes to the command
-  *(asterix + 1) = (checksum >> 4) + '0';
-  if (*(asterix + 1) >= ':') // Hex a-f
-    *(asterix + 1) = *(asterix + 1) + 'a' - ':';
-  *(asterix + 2) = (checksum & 0x0F) + '0';
-  if (*(asterix + 2) >= ':') // Hex a-f
-    *(asterix + 2) = *(asterix + 2) + 'a' - ':';
+  return (best);
+}
 
-  // Add the line feed
-  *(asterix + 3) = '\n';
+// Return the event type from the sentence tag
+Swarm_M138_Event_Type_e SWARM_M138::eventType(const char *sentence)
+{
+  if (strncmp(sentence, "$DT ", 4) == 0)
+    return (SWARM_M138_EVENT_DATE_TIME);
+  if (strncmp(sentence, "$GJ ", 4) == 0)
+    return (SWARM_M138_EVENT_GPS_JAMMING);
+  if (strncmp(sentence, "$GN ", 4) == 0)
+    return (SWARM_M138_EVENT_GEOSPATIAL);
+  if (strncmp(sentence, "$GS ", 4) == 0)
+    return (SWARM_M138_EVENT_GPS_FIX_QUALITY);
+  if (strncmp(sentence, "$PW ", 4) == 0)
+    return (SWARM_M138_EVENT_POWER_STATUS);
+  if (strncmp(sentence, "$RD ", 4) == 0)
+    return (SWARM_M138_EVENT_RECEIVE_MESSAGE);
+  if (strncmp(sentence, "$RT ", 4) == 0)
+    return (SWARM_M138_EVENT_RECEIVE_TEST);
+  if (strncmp(sentence, "$SL ", 4) == 0)
+    return (SWARM_M138_EVENT_SLEEP_WAKE);
+  if (strncmp(sentence, "$M138 ", 6) == 0)
+    return (SWARM_M138_EVENT_MODEM_STATUS);
+  if (strncmp(sentence, "$TD ", 4) == 0)
+    return (SWARM_M138_EVENT_TRANSMIT_DATA);
+  return (SWARM_M138_EVENT_UNKNOWN);
+}
 
-  // Add a \0 - just in case
-  *(asterix + 4) = 0;
+#ifdef SWARM_M138_THREADS_AVAILABLE
+#ifdef SWARM_M138_THREADS_FREERTOS
+// The FreeRTOS reader task
+void SWARM_M138::readerTaskEntry(void *param)
+{
+  SWARM_M138 *swarm = (SWARM_M138 *)param;
+
+  while (swarm->_readerRun.load())
+  {
+    if (!swarm->readerService())
+      swarm->readerYield();
+  }
+
+  swarm->_readerRunning = false;
+  vTaskDelete(NULL);
 }
+#endif
 
-// Check if the response / message checksum is valid
-Swarm_M138_Error_e SWARM_M138::checkChecksum(char *startPosition)
+// Return true if called from the reader task
+bool SWARM_M138::inReaderTask(void)
 {
-  char *dollar = strchr(startPosition, '$'); // Find the $
+#ifdef SWARM_M138_THREADS_FREERTOS
+  return ((_readerTask != NULL) && (xTaskGetCurrentTaskHandle() == _readerTask));
+#else
+  return ((_readerThread != NULL) && (std::this_thread::get_id() == _readerThread->get_id()));
+#endif
+}
 
-  if (dollar == NULL) // Return now if the $ was not found
+// Sleep for one tick / 1ms
+void SWARM_M138::readerYield(void)
+{
+#ifdef SWARM_M138_THREADS_FREERTOS
+  vTaskDelay(1);
+#else
+  std::this_thread::sleep_for(std::chrono::milliseconds(1));
+#endif
+}
+
+// If threaded mode is active (and we are not the reader), post the request to the reader task and wait for it to complete
+// Return false if the caller should do the work itself
+bool SWARM_M138::postToReader(uint8_t type, const char *command, const char *expectedResponseStart, const char *expectedErrorStart,
+                              char *responseDest, size_t destSize, unsigned long timeout, Swarm_M138_Error_e *result)
+{
+  if ((_commandQueue == NULL) || (!_readerRunning.load()) || inReaderTask())
+    return (false);
+
+  Swarm_M138_Command_Request_t request;
+  request.type = type;
+  request.command = command;
+  request.expectedResponseStart = expectedResponseStart;
+  request.expectedErrorStart = expectedErrorStart;
+  request.responseDest = responseDest;
+  request.destSize = destSize;
+  request.timeout = timeout;
+  request.result = SWARM_M138_ERROR_ERROR;
+  request.done = false;
+
+  Swarm_M138_Command_Request_t *requestPtr = &request;
+  while (!_commandQueue->push(requestPtr))
+    readerYield();
+
+  while (!request.done.load(std::memory_order_acquire)) // The request is on our stack. Wait until the reader has finished with it
+    readerYield();
+
+  if (result != NULL)
+    *result = request.result;
+
+  return (true);
+}
+
+// Stop the reader task framing the serial data until resumeReader. It still executes the commands the caller posts
+// Does nothing if threaded mode is not active, or if called from the reader task
+void SWARM_M138::pauseReader(void)
+{
+  if (_readerPauseDepth++ > 0) // Already paused by an outer function
+    return;
+  _readerPaused.store(true, std::memory_order_release);
+  if (!postToReader(SWARM_M138_REQUEST_PAUSE, NULL, NULL, NULL, NULL, 0, 0, NULL))
+    _readerPaused.store(false, std::memory_order_release); // Nothing to pause
+}
+
+void SWARM_M138::resumeReader(void)
+{
+  if (--_readerPauseDepth == 0)
+    _readerPaused.store(false, std::memory_order_release);
+}
+
+// Check a complete sentence and push it into the event queue
+void SWARM_M138::readerPushLine(char *line, size_t len)
+{
+  while ((len > 0) && (line[len - 1] == '\r')) // Trim any CR
+    len--;
+  line[len] = 0;
+
+  if ((len == 0) || (checkChecksum(line) != SWARM_M138_ERROR_SUCCESS))
   {
-    if (_printDebug == true)
+#ifdef SWARM_M138_STATS
+    if (len > 0)
+      _statsEventChecksumFailures = _statsEventChecksumFailures + 1;
+#endif
+    if ((len > 0) && (_printDebug == true))
+      _debugPort->println(F("readerPushLine: event is invalid!"));
+    return;
+  }
+
+  Swarm_M138_Event_t event;
+  event.type = eventType(line);
+  event.length = (uint16_t)len;
+  memcpy(event.sentence, line, len + 1);
+
+  if (!_eventQueue->push(event))
+    _eventDrops++; // The caller is not keeping up
+}
+
+// Move the complete sentences captured in the backlog (during a command) into the event queue
+// Anything after the last \n is the start of a partial sentence. It becomes the reader line
+void SWARM_M138::readerExtractBacklog(void)
+{
+  char *start = _swarmBacklog;
+  char *end = strchr(start, '\n');
+
+  while (end != NULL)
+  {
+    size_t len = end - start;
+    if (len < SWARM_M138_EVENT_MAX_LENGTH)
     {
-      _debugPort->println(F("checkChecksum: $ not found!"));
+      memcpy(_readerLine, start, len);
+      _readerLine[len] = 0;
+      if (acceptEvent((const char *)_readerLine))
+        readerPushLine(_readerLine, len);
     }
-    return (SWARM_M138_ERROR_INVALID_FORMAT);
+    start = end + 1;
+    end = strchr(start, '\n');
   }
 
-  char *asterix = strchr(dollar, '*'); // Find the *
-
-  if (asterix == NULL) // Return now if the * was not found
+  size_t remaining = strlen(start);
+  _readerLineChecked = false;
+  _readerLineDiscard = false;
+  if (remaining < SWARM_M138_EVENT_MAX_LENGTH)
   {
-    if (_printDebug == true)
+    memcpy(_readerLine, start, remaining);
+    _readerLine[remaining] = 0;
+    _readerLineLength = remaining;
+    if (strchr(_readerLine, ' ') != NULL) // Is the tag complete?
     {
-      _debugPort->println(F("checkChecksum: * not found!"));
+      _readerLineChecked = true;
+      _readerLineDiscard = !acceptEvent((const char *)_readerLine);
     }
-    return (SWARM_M138_ERROR_INVALID_FORMAT);
   }
+  else
+    _readerLineLength = 0;
 
-  char checksum = 0;
+  memset(_swarmBacklog, 0, _RxBuffSize); // Clear the backlog
+}
 
-  dollar++; // Point to the char after the $
+// Run one pass of the reader task: execute one posted command, then frame any new serial data into events
+// Return true if there was anything to do
+bool SWARM_M138::readerService(void)
+{
+  bool busy = false;
+  Swarm_M138_Command_Request_t *request;
 
-  while (dollar < asterix) // Calculate the checksum
+  if (_commandQueue->pop(request))
   {
-    checksum ^= *dollar;
-    dollar++;
-  }
+    busy = true;
 
-  char expectedChecksum;
+    if (request->type == SWARM_M138_REQUEST_PAUSE) // _readerPaused is set. Let the caller continue
+    {
+      request->done.store(true, std::memory_order_release); // Don't touch request after this
+      return (busy);
+    }
 
-  char checksumChar = *(asterix + 1); // Get the first checksum character
+    if ((_readerLineLength > 0) && (!_readerLineDiscard)) // Hand the partial sentence to the backlog. The command will capture the rest of it
+    {
+      memcpy(_swarmBacklog, _readerLine, _readerLineLength); // The backlog is empty between commands
+      _swarmBacklog[_readerLineLength] = 0;
+    }
+    _readerLineLength = 0;
+    _readerLineChecked = false;
+    _readerLineDiscard = false;
 
-  if ((checksumChar >= '0') && (checksumChar <= '9')) // Convert to binary
-    expectedChecksum = (checksumChar - '0') << 4;
-  else if ((checksumChar >= 'a') && (checksumChar <= 'f'))
-    expectedChecksum = (checksumChar + 10 - 'a') << 4;
-  else if ((checksumChar >= 'A') && (checksumChar <= 'F'))
-    expectedChecksum = (checksumChar + 10 - 'A') << 4;
-  else
-  {
-    if (_printDebug == true)
+    if (request->type == SWARM_M138_REQUEST_SEND)
     {
-      _debugPort->println(F("checkChecksum: invalid checksum char 1"));
+      sendCommand(request->command);
+      _readerAwaitingResponse = true; // Don't read the port until the response has been collected
+      _readerSentAt = millis();
+      request->result = SWARM_M138_ERROR_SUCCESS;
     }
-    return (SWARM_M138_ERROR_INVALID_FORMAT);
+    else if (request->type == SWARM_M138_REQUEST_SEND_ASYNC)
+    {
+      sendCommand(request->command); // Keep reading: the response will be pushed into the event queue
+      request->result = SWARM_M138_ERROR_SUCCESS;
+    }
+    else if (request->type == SWARM_M138_REQUEST_WAIT)
+    {
+      request->result = waitForResponse(request->expectedResponseStart, request->expectedErrorStart,
+                                        request->responseDest, request->destSize, request->timeout);
+      _readerAwaitingResponse = false;
+    }
+    else
+    {
+      request->result = sendCommandWithResponse(request->command, request->expectedResponseStart, request->expectedErrorStart,
+                                                request->responseDest, request->destSize, request->timeout);
+      _readerAwaitingResponse = false;
+    }
+
+    request->done.store(true, std::memory_order_release); // The caller can continue. Don't touch request after this
   }
 
-  checksumChar = *(asterix + 2); // Get the second checksum character
+  // While paused, the caller is changing the callbacks, subscriptions or URC handlers which the framing reads.
+  // Only its commands are executed: the caller is blocked until each one is done
+  if (_readerPaused.load(std::memory_order_acquire))
+    return (busy);
 
-  if ((checksumChar >= '0') && (checksumChar <= '9')) // Convert to binary
-    expectedChecksum |= (checksumChar - '0');
-  else if ((checksumChar >= 'a') && (checksumChar <= 'f'))
-    expectedChecksum |= (checksumChar + 10 - 'a');
-  else if ((checksumChar >= 'A') && (checksumChar <= 'F'))
-    expectedChecksum |= (checksumChar + 10 - 'A');
-  else
+  if (_readerAwaitingResponse)
+  {
+    if ((millis() - _readerSentAt) < SWARM_M138_MESSAGE_ID_TIMEOUT) // Has the caller given up on the response?
+      return (busy);
+    _readerAwaitingResponse = false;
+  }
+
+  if (_swarmBacklog[0] != 0) // Were any sentences captured during the command?
+  {
+    readerExtractBacklog();
+    busy = true;
+  }
+
+  char chunk[64];
+  int hwAvail = hwAvailable();
+  while (hwAvail > 0) //hwAvailable can return -1 if the serial port is NULL
   {
-    if (_printDebug == true)
+    int bytesRead = hwReadChars(chunk, (hwAvail < (int)sizeof(chunk)) ? hwAvail : (int)sizeof(chunk));
+    for (int i = 0; i < bytesRead; i++)
     {
-      _debugPort->println(F("checkChecksum: invalid checksum char 2"));
+      if (chunk[i] == '\n')
+      {
+        if (!_readerLineDiscard)
+          readerPushLine(_readerLine, _readerLineLength);
+        _readerLineLength = 0;
+        _readerLineChecked = false;
+        _readerLineDiscard = false;
+      }
+      else if (_readerLineDiscard)
+        continue; // Not subscribed. Don't buffer it
+      else if (_readerLineLength < (SWARM_M138_EVENT_MAX_LENGTH - 1))
+      {
+        _readerLine[_readerLineLength++] = chunk[i];
+        if ((chunk[i] == ' ') && (!_readerLineChecked)) // The tag is complete. Check the subscriptions
+        {
+          _readerLine[_readerLineLength] = 0;
+          _readerLineChecked = true;
+          _readerLineDiscard = !acceptEvent((const char *)_readerLine);
+        }
+      }
+      else
+        _readerLineLength = 0; // Too long. Discard it
     }
-    return (SWARM_M138_ERROR_INVALID_FORMAT);
+    busy = true;
+    hwAvail = hwAvailable();
   }
 
-  if (checksum != expectedChecksum)
+  return (busy);
+}
+#endif
+
+// Return the number of bytes waiting in the receive ring buffer
+int SWARM_M138::rxRingAvailable(void)
+{
+#ifdef ARDUINO_ARCH_AVR
+  noInterrupts(); // A 16-bit read is not atomic on AVR
+  uint16_t head = _rxRing->head;
+  interrupts();
+#else
+  uint16_t head = _rxRing->head;
+#endif
+  uint16_t tail = _rxRing->tail;
+
+  return ((head >= tail) ? (int)(head - tail) : (int)(head + _rxRing->size - tail));
+}
+
+// Read up to len bytes from the receive ring buffer. Return the number of bytes read
+int SWARM_M138::rxRingRead(char *buf, int len)
+{
+  int available = rxRingAvailable();
+  if (len > available)
+    len = available;
+
+  uint16_t tail = _rxRing->tail;
+  for (int i = 0; i < len; i++)
   {
-    if (_printDebug == true)
-    {
-      _debugPort->println(F("checkChecksum: invalid checksum"));
-    }
-    return (SWARM_M138_ERROR_INVALID_CHECKSUM);
+    buf[i] = (char)_rxRing->data[tail];
+    tail++;
+    if (tail == _rxRing->size)
+      tail = 0;
   }
 
-  return (SWARM_M138_ERROR_SUCCESS);
+  _rxRing->tail = tail; // Release the space
+
+  return (len);
 }
 
-// Extract the command error
-Swarm_M138_Error_e SWARM_M138::extractCommandError(char *startPosition)
+// Parse a $DT response into dateTime
+Swarm_M138_Error_e SWARM_M138::parseDateTime(const char *response, Swarm_M138_DateTimeData_t *dateTime)
 {
-    memset(commandError, 0, SWARM_M138_MAX_CMD_ERROR_LEN); // Clear any existing error
+  const char *responseStart;
+  const char *responseEnd = NULL;
 
-    char *errorAt = strstr(startPosition, "ERR,"); // Find the ERR,
+  responseStart = strstr(response, "$DT ");
+  if (responseStart != NULL)
+    responseEnd = strchr(responseStart, '*'); // Stop at the asterix
+  if ((responseStart == NULL) || (responseEnd == NULL) || (responseEnd < (responseStart + 20))) // Check we have enough data
+    return (SWARM_M138_ERROR_ERROR);
 
-    if (errorAt == NULL)
-      return (SWARM_M138_ERROR_ERROR);
+  // Extract the Date, Time and flag
+  int year, month, day, hour, minute, second;
+  char valid;
 
-    errorAt += 4; // Point to the start of the actual error message
+  int ret = sscanf(responseStart, "$DT %4d%2d%2d%2d%2d%2d,%c*", &year, &month, &day, &hour, &minute, &second, &valid);
 
-    char *asterix = strchr(errorAt, '*'); // Find the *
+  if (ret < 7)
+    return (SWARM_M138_ERROR_ERROR);
 
-    if (asterix == NULL)
-      return (SWARM_M138_ERROR_ERROR);
+  dateTime->YYYY = (uint16_t)year;
+  dateTime->MM = (uint8_t)month;
+  dateTime->DD = (uint8_t)day;
+  dateTime->hh = (uint8_t)hour;
+  dateTime->mm = (uint8_t)minute;
+  dateTime->ss = (uint8_t)second;
+  dateTime->valid = valid == 'V' ? 1 : 0;
 
-    int errorLen = 0;
-    while ((errorAt < asterix) && (errorLen < (SWARM_M138_MAX_CMD_ERROR_LEN - 1))) // Leave a NULL on the end
-    {
-      commandError[errorLen] = *errorAt;
-      errorAt++;
-      errorLen++;
-    }
+  return (SWARM_M138_ERROR_SUCCESS);
+}
 
-    return (SWARM_M138_ERROR_SUCCESS);
+// Return true if the comma-separated field starts with a minus sign. field 0 follows the space after the tag
+bool SWARM_M138::fieldIsNegative(const char *sentence, uint8_t field)
+{
+  const char *fieldStart = strchr(sentence, ' ');
+  while ((fieldStart != NULL) && (field > 0))
+  {
+    fieldStart = strchr(fieldStart + 1, ',');
+    field--;
+  }
+  return ((fieldStart != NULL) && (*(fieldStart + 1) == '-'));
 }
 
-// Send a command. Check for a response.
-// Return true if expectedResponseStart is seen in the data followed by a \n
-Swarm_M138_Error_e SWARM_M138::sendCommandWithResponse(
-    const char *command, const char *expectedResponseStart, const char *expectedErrorStart,
-    char *responseDest, size_t destSize, unsigned long commandTimeout)
+// Parse a $GN response into info
+Swarm_M138_Error_e SWARM_M138::parseGeospatialInfo(const char *response, Swarm_M138_GeospatialData_t *info)
 {
-  if (_printDebug == true)
-    _debugPort->println(F("sendCommandWithResponse: ====>"));
+  const char *responseStart;
+  const char *responseEnd = NULL;
 
-  sendCommand(command); //Sending command needs to dump data to backlog buffer as well.
+  responseStart = strstr(response, "$GN ");
+  if (responseStart != NULL)
+    responseEnd = strchr(responseStart, '*'); // Stop at the asterix
+  if ((responseStart == NULL) || (responseEnd == NULL) || (responseEnd < (responseStart + 10))) // Check we have enough data
+    return (SWARM_M138_ERROR_ERROR);
 
-  Swarm_M138_Error_e err = waitForResponse(expectedResponseStart, expectedErrorStart, responseDest, destSize, commandTimeout);
+  // Extract the geospatial info
+  int latH, lonH, alt, course, speed;
+  char latL[8], lonL[8];
 
-  if (_printDebug == true)
-    _debugPort->println(F("sendCommandWithResponse: <===="));
+  int ret = sscanf(responseStart, "$GN %d.%7[0-9],%d.%7[0-9],%d,%d,%d*",
+                   &latH, latL, &lonH, lonL, &alt, &course, &speed);
 
-  return (err);
+  if (ret < 7)
+    return (SWARM_M138_ERROR_ERROR);
+
+  if (!fieldIsNegative(responseStart, 0))
+    info->lat = (float)latH + ((float)atol(latL) / pow(10, strlen(latL)));
+  else
+    info->lat = (float)latH - ((float)atol(latL) / pow(10, strlen(latL)));
+  if (!fieldIsNegative(responseStart, 1))
+    info->lon = (float)lonH + ((float)atol(lonL) / pow(10, strlen(lonL)));
+  else
+    info->lon = (float)lonH - ((float)atol(lonL) / pow(10, strlen(lonL)));
+  info->alt = (float)alt;
+  info->course = (float)course;
+  info->speed = (float)speed;
+
+  return (SWARM_M138_ERROR_SUCCESS);
 }
 
-void SWARM_M138::sendCommand(const char *command)
+// Parse a $MM C= or $MT C= response into count. tag is "$MM " or "$MT "
+Swarm_M138_Error_e SWARM_M138::parseMessageCount(const char *response, const char *tag, uint16_t *count)
 {
-  //Spend up to _rxWindowMillis milliseconds copying any incoming serial data into the backlog
-  unsigned long timeIn = millis();
-  int hwAvail = hwAvailable();
-  if (hwAvail > 0) //hwAvailable can return -1 if the serial port is NULL
+  const char *responseStart;
+  const char *responseEnd = NULL;
+
+  responseStart = strstr(response, tag);
+  if (responseStart != NULL)
+    responseEnd = strchr(responseStart, '*'); // Stop at the asterix
+  if ((responseStart == NULL) || (responseEnd == NULL))
+    return (SWARM_M138_ERROR_ERROR);
+
+  // Extract the count
+  char c;
+  uint16_t theCount = 0;
+  responseStart += 4; // Point at the first digit of the count
+
+  c = *responseStart; // Get the first digit of the count
+  while ((c != '*') && (c != ',')) // Keep going until we hit the asterix or a comma
   {
-    size_t backlogLength = strlen((const char *)_swarmBacklog);
-    while (((millis() - timeIn) < _rxWindowMillis) && ((backlogLength + hwAvail) < _RxBuffSize)) //May need to escape on newline?
+    if ((c >= '0') && (c <= '9')) // Extract the count one digit at a time
     {
-      if (hwAvail > 0) //hwAvailable can return -1 if the serial port is NULL
-      {
-        backlogLength += hwReadChars((char *)&_swarmBacklog[backlogLength], hwAvail);
-        timeIn = millis();
-      }
-      else
-        delay(1);
-      hwAvail = hwAvailable();
+      theCount = theCount * 10;
+      theCount += (uint16_t)(c - '0');
     }
+    responseStart++;
+    c = *responseStart; // Get the next digit of the count
   }
 
-  if (_printDebug == true)
+  if (c == ',') // If we hit a comma, this must be a different $MM / $MT message
   {
-    _debugPort->print(F("sendCommand: Command: "));
-    _debugPort->println(command);
+    *count = 0; // Set count to zero in case the user is not checking err
+    return (SWARM_M138_ERROR_INVALID_FORMAT);
   }
 
-  //Now send the command
-  hwPrint(command);
+  *count = theCount;
+  return (SWARM_M138_ERROR_SUCCESS);
 }
 
-Swarm_M138_Error_e SWARM_M138::waitForResponse(const char *expectedResponseStart, const char *expectedErrorStart,
-                                               char *responseDest, size_t destSize, unsigned long timeout)
+// Parse a $TD OK response into msg_id. Add the message to the TX queue mirror (if enabled)
+Swarm_M138_Error_e SWARM_M138::parseTransmitResponse(const char *response, uint64_t *msg_id)
 {
-  unsigned long timeIn;
-  bool found = false;
-  size_t destIndex = 0;
-  bool responseStartSeen = false, errorStartSeen = false;
-  int responseIndex = 0, errorIndex = 0;
-  size_t responseStartedAt = 0, errorStartedAt = 0;
-  Swarm_M138_Error_e err = SWARM_M138_ERROR_ERROR;
+  const char *idStart;
+  const char *idEnd = NULL;
 
-  bool printedSomething = false;
+  idStart = strstr(response, "$TD OK,");
+  if (idStart != NULL)
+    idEnd = strchr(idStart, '*'); // Look for the asterix
+  if ((idStart == NULL) || (idEnd == NULL))
+    return (SWARM_M138_ERROR_ERROR);
 
-  timeIn = millis();
+  uint64_t theID = 0;
 
-  while ((!found) && ((timeIn + timeout) > millis()))
-  {
-    size_t hwAvail = hwAvailable();
-    if (hwAvail > 0) //hwAvailable can return -1 if the serial port is NULL
-    {
-      if ((destIndex + hwAvail) < destSize) // Check there is room to store the response (with a null on the end!)
-      {
-        size_t bytesRead = hwReadChars((char *)&responseDest[destIndex], hwAvail);
+  idStart += 7; // Point at the first digit of the ID
 
-        if (_printDebug == true)
-        {
-          if (printedSomething == false)
-          {
-            _debugPort->print(F("waitForResponse: "));
-            printedSomething = true;
-          }
-          _debugPort->print((const char *)&responseDest[destIndex]);
-        }
+  while (idStart < idEnd)
+  {
+    theID *= 10;
+    theID += (uint64_t)((*idStart) - '0'); // Add each digit to theID
+    idStart++;
+  }
 
-        // Check each character to see if it is the expected resonse or error
-        for (size_t chrPtr = destIndex; chrPtr < (destIndex + bytesRead); chrPtr++)
-        {
-          char c = responseDest[chrPtr]; // Check each character
+  *msg_id = theID;
 
-          if (c == expectedResponseStart[responseIndex])
-          {
-            if ((responseIndex == 0) && (responseStartSeen == false))
-              responseStartedAt = chrPtr; // Record where the (possible) response started
-            if (++responseIndex == (int)strlen(expectedResponseStart))
-            {
-              responseStartSeen = true;
-            }
-          }
-          else
-          {
-            responseIndex = 0;
-          }
+  txMirrorAdd(theID); // Add the message to the TX queue mirror (if enabled)
 
-          if (expectedErrorStart != NULL)
-          {
-            if (c == expectedErrorStart[errorIndex])
-            {
-              if ((errorIndex == 0) && (errorStartSeen == false))
-                errorStartedAt = chrPtr; // Record where the (possible) error started
-              if (++errorIndex == (int)strlen(expectedErrorStart))
-              {
-                errorStartSeen = true;
-              }
-            }
-            else
-            {
-              errorIndex = 0;
-            }
-          }
+  return (SWARM_M138_ERROR_SUCCESS);
+}
 
-          // Set found to true if we have seen expectedResponseStart or expectedErrorStart _and_ have received a \n
-          if ((responseStartSeen || errorStartSeen) && (c == '\n'))
-            found = true;
-        }
+#ifdef SWARM_M138_COROUTINES_AVAILABLE
+// Take a frame from the pool. Called by SWARM_M138_Task::promise_type::operator new
+void *swarm_m138_coroutine_alloc(size_t size)
+{
+  if (size > SWARM_M138_COROUTINE_FRAME_SIZE)
+    return (NULL); // The coroutine is too big. Increase SWARM_M138_COROUTINE_FRAME_SIZE
 
-        // Now also copy the response into the backlog, if there is room
-        // _swarmBacklog is a global array that holds the backlog of any events
-        // that came in while waiting for response. To be processed later within checkUnsolicitedMsg().
-        // Note: the expectedResponse or expectedError will also be added to the backlog.
-        // Everything in the backlog is 'printable'. So it is OK to use strlen - so long as there is a
-        // \0 at the end of the buffer!
-        size_t backlogLength = strlen((const char *)_swarmBacklog);
+  for (uint8_t i = 0; i < SWARM_M138_COROUTINE_POOL_SLOTS; i++)
+  {
+    if (!swarm_m138_coroutine_used[i])
+    {
+      swarm_m138_coroutine_used[i] = true;
+      return ((void *)swarm_m138_coroutine_pool[i]);
+    }
+  }
 
-        if ((backlogLength + bytesRead) < _RxBuffSize) // Is there room to store the new data?
-        {
-          memcpy((char *)&_swarmBacklog[backlogLength], (char *)&responseDest[destIndex], bytesRead);
-        }
-        else
-        {
-          if (_printDebug == true)
-          {
-            if (printedSomething == true)
-            {
-              _debugPort->println();
-              printedSomething = false;
-            }
-            _debugPort->println(F("waitForResponse: Panic! _swarmBacklog is full!"));
-          }
-        }
+  return (NULL); // The pool is full
+}
 
-        destIndex += bytesRead; // Increment destIndex
-      }
-      else
-      {
-        if (_printDebug == true)
-        {
-          if (printedSomething == true)
-          {
-            _debugPort->println();
-            printedSomething = false;
-          }
-          _debugPort->println(F("waitForResponse: Panic! responseDest is full!"));
-        }
-      }
-    }
-    else
-      delay(1);
+// Return a frame to the pool
+void swarm_m138_coroutine_free(void *frame)
+{
+  for (uint8_t i = 0; i < SWARM_M138_COROUTINE_POOL_SLOTS; i++)
+  {
+    if (frame == (void *)swarm_m138_coroutine_pool[i])
+      swarm_m138_coroutine_used[i] = false;
   }
+}
 
-  if (_printDebug == true)
-    if (printedSomething)
-      _debugPort->println();
+SWARM_M138_Awaitable::SWARM_M138_Awaitable(SWARM_M138 *swarm, uint8_t kind)
+{
+  _swarm = swarm;
+  _next = NULL;
+  _kind = kind;
+  _ready = false;
+  _sent = false;
+  _result = SWARM_M138_ERROR_ERROR;
+  _start = millis();
+  _timeout = SWARM_M138_STANDARD_RESPONSE_TIMEOUT;
+  _command = NULL;
+  _commandOwned = false;
+  _expectedResponseStart = NULL;
+  _expectedErrorStart = NULL;
+  _responseDest = NULL;
+  _destSize = 0;
+  _out = NULL;
+  _eventType = SWARM_M138_EVENT_UNKNOWN;
+  memset(_commandBuffer, 0, sizeof(_commandBuffer));
+}
 
-  if (found == true)
+// Move the awaitable out of the function which built it. The command (if owned) moves with it
+SWARM_M138_Awaitable::SWARM_M138_Awaitable(SWARM_M138_Awaitable &&other)
+{
+  _swarm = other._swarm;
+  _next = other._next;
+  _handle = other._handle;
+  _kind = other._kind;
+  _ready = other._ready;
+  _sent = other._sent;
+  _result = other._result;
+  _start = other._start;
+  _timeout = other._timeout;
+  _command = other._command;
+  _commandOwned = other._commandOwned;
+  _expectedResponseStart = other._expectedResponseStart;
+  _expectedErrorStart = other._expectedErrorStart;
+  _responseDest = other._responseDest;
+  _destSize = other._destSize;
+  _out = other._out;
+  _eventType = other._eventType;
+  memcpy(_commandBuffer, other._commandBuffer, sizeof(_commandBuffer));
+  other._commandOwned = false;
+}
+
+SWARM_M138_Awaitable::~SWARM_M138_Awaitable()
+{
+  if (_commandOwned)
+    _swarm->swarm_m138_free_char((char *)_command);
+}
+
+// Called by co_await: the coroutine is suspended. Link the awaiter so checkUnsolicitedMsg can resume it
+void SWARM_M138_Awaitable::await_suspend(std::coroutine_handle<> handle)
+{
+  _handle = handle;
+  _swarm->asyncLink(this);
+}
+
+// Add a suspended awaiter to the end of the list. Send its command if the modem is idle
+void SWARM_M138::asyncLink(SWARM_M138_Awaitable *awaitable)
+{
+  awaitable->_next = NULL;
+
+  if (_asyncPending == NULL)
+    _asyncPending = awaitable;
+  else
   {
-    if (errorStartSeen) // Error needs priority over response as response is often the beginning of error!
-    {
-      // if (_printDebug == true)
-      // {
-      //   _debugPort->print(F("waitForResponse: errorStart: "));
-      //   _debugPort->println((char *)&responseDest[errorStartedAt]);
-      // }
-      err = checkChecksum((char *)&responseDest[errorStartedAt]);
-      if (err == SWARM_M138_ERROR_SUCCESS)
-      {
-        extractCommandError((char *)&responseDest[errorStartedAt]);
-        err = SWARM_M138_ERROR_ERR;
-      }
-    }
-    else if (responseStartSeen)
-    {
-      // if (_printDebug == true)
-      // {
-      //   _debugPort->print(F("waitForResponse: responseStart: "));
-      //   _debugPort->println((char *)&responseDest[responseStartedAt]);
-      // }
-      err = checkChecksum((char *)&responseDest[responseStartedAt]);
-    }
+    SWARM_M138_Awaitable *last = _asyncPending;
+    while (last->_next != NULL)
+      last = last->_next;
+    last->_next = awaitable;
   }
-  else
-    err = SWARM_M138_ERROR_TIMEOUT;
 
-  pruneBacklog(); // Prune any incoming non-actionable URC's and responses/errors from the backlog
+  if (awaitable->_kind == SWARM_M138_AWAIT_DELAY)
+    awaitable->_start = millis(); // The delay starts now
 
-  return (err);
+  asyncUpdateSubscriptions(); // Before the command is sent
+
+  if (_asyncCommand == NULL)
+    asyncSendNext();
 }
 
-size_t SWARM_M138::hwPrint(const char *s)
+// Remove an awaiter from the list
+void SWARM_M138::asyncUnlink(SWARM_M138_Awaitable *awaitable)
 {
-  if (_hardSerial != NULL)
-  {
-    return _hardSerial->print(s);
-  }
-#ifdef SARA_R5_SOFTWARE_SERIAL_ENABLED
-  else if (_softSerial != NULL)
-  {
-    return _softSerial->print(s);
-  }
-#endif
-  else if (_i2cPort != NULL)
+  SWARM_M138_Awaitable **link = &_asyncPending;
+  while (*link != NULL)
   {
-    return ((size_t)qwiicSwarmWriteChars(strlen(s), s));
+    if (*link == awaitable)
+    {
+      *link = awaitable->_next;
+      break;
+    }
+    link = &((*link)->_next);
   }
 
-  return (size_t)0;
+  if (_asyncCommand == awaitable)
+    _asyncCommand = NULL;
 }
 
-size_t SWARM_M138::hwWriteData(const char *buff, int len)
+// Send the oldest unsent command. Only one command is in flight at a time
+void SWARM_M138::asyncSendNext(void)
 {
-  if (_hardSerial != NULL)
-  {
-    return _hardSerial->write((const uint8_t *)buff, len);
-  }
-#ifdef SWARM_M138_SOFTWARE_SERIAL_ENABLED
-  else if (_softSerial != NULL)
+  for (SWARM_M138_Awaitable *awaitable = _asyncPending; awaitable != NULL; awaitable = awaitable->_next)
   {
-    return _softSerial->write((const uint8_t *)buff, len);
+    if ((awaitable->_kind <= SWARM_M138_AWAIT_LAST_COMMAND) && (!awaitable->_sent) && (!awaitable->_ready))
+    {
+      _asyncCommand = awaitable;
+      awaitable->_sent = true;
+      awaitable->_start = millis();
+      sendCommandAsync((awaitable->_command != NULL) ? awaitable->_command : (const char *)awaitable->_commandBuffer);
+      return;
+    }
   }
+}
+
+// Send a command without waiting for the response. checkUnsolicitedMsg passes the response to asyncOfferLine
+void SWARM_M138::sendCommandAsync(const char *command)
+{
+#ifdef SWARM_M138_THREADS_AVAILABLE
+  if (postToReader(SWARM_M138_REQUEST_SEND_ASYNC, command, NULL, NULL, NULL, 0, 0, NULL))
+    return; // The reader task has sent the command
 #endif
-  else if (_i2cPort != NULL)
-  {
-    return ((size_t)qwiicSwarmWriteChars(len, buff));
-  }
 
-  return (size_t)0;
+  sendCommand(command);
 }
 
-size_t SWARM_M138::hwWrite(const char c)
+// Check if line is the response (or error) for the command in flight. If it is, complete the awaiter and return true
+bool SWARM_M138::asyncOfferLine(const char *line)
 {
-  if (_hardSerial != NULL)
+  SWARM_M138_Awaitable *awaitable = _asyncCommand;
+  if (awaitable == NULL)
+    return (false);
+
+  const char *errorStart = NULL;
+  if (awaitable->_expectedErrorStart != NULL)
+    errorStart = strstr(line, awaitable->_expectedErrorStart);
+
+  if (errorStart != NULL) // Error needs priority over response as response is often the beginning of error!
   {
-    return _hardSerial->write(c);
+    char *error = swarm_m138_alloc_char(strlen(errorStart) + 1); // extractCommandError needs a writable copy
+    if (error != NULL)
+    {
+      strcpy(error, errorStart);
+      extractCommandError(error);
+      swarm_m138_free_char(error);
+    }
+    awaitable->_result = SWARM_M138_ERROR_ERR;
   }
-#ifdef SWARM_M138_SOFTWARE_SERIAL_ENABLED
-  else if (_softSerial != NULL)
+  else
   {
-    return _softSerial->write(c);
+    const char *responseStart = strstr(line, awaitable->_expectedResponseStart);
+    if (responseStart == NULL)
+      return (false);
+
+    if (awaitable->_kind == SWARM_M138_AWAIT_DATE_TIME)
+      awaitable->_result = parseDateTime(responseStart, (Swarm_M138_DateTimeData_t *)awaitable->_out);
+    else if (awaitable->_kind == SWARM_M138_AWAIT_GEOSPATIAL)
+      awaitable->_result = parseGeospatialInfo(responseStart, (Swarm_M138_GeospatialData_t *)awaitable->_out);
+    else if (awaitable->_kind == SWARM_M138_AWAIT_MESSAGE_COUNT)
+      awaitable->_result = parseMessageCount(responseStart, awaitable->_expectedResponseStart, (uint16_t *)awaitable->_out);
+    else if (awaitable->_kind == SWARM_M138_AWAIT_TRANSMIT)
+      awaitable->_result = parseTransmitResponse(responseStart, (uint64_t *)awaitable->_out);
+    else if (awaitable->_responseDest != NULL)
+    {
+      if (strlen(responseStart) < awaitable->_destSize) // Check there is room for the response (with a null on the end!)
+      {
+        strcpy(awaitable->_responseDest, responseStart);
+        awaitable->_result = SWARM_M138_ERROR_SUCCESS;
+      }
+      else
+        awaitable->_result = SWARM_M138_ERROR_ERROR;
+    }
+    else
+      awaitable->_result = SWARM_M138_ERROR_SUCCESS;
   }
+
+#ifdef SWARM_M138_STATS
+  noteCommandStats(statsTagIndex((awaitable->_command != NULL) ? awaitable->_command : (const char *)awaitable->_commandBuffer),
+                   awaitable->_result, millis() - awaitable->_start);
 #endif
-  else if (_i2cPort != NULL)
-  {
-    return ((size_t)qwiicSwarmWriteChars((int)1, &c));
-  }
 
-  return (size_t)0;
+  awaitable->_ready = true;
+  _asyncCommand = NULL; // The modem is idle. asyncService will send the next command
+  return (true);
 }
 
-int SWARM_M138::hwAvailable(void)
+// Complete any nextEvent awaiters which are waiting for this type of message
+void SWARM_M138::asyncOfferEvent(const char *line)
 {
-  if (_hardSerial != NULL)
+  Swarm_M138_Event_Type_e type = eventType(line);
+  if (type == SWARM_M138_EVENT_UNKNOWN)
+    return;
+
+  for (SWARM_M138_Awaitable *awaitable = _asyncPending; awaitable != NULL; awaitable = awaitable->_next)
   {
-    return ((int)_hardSerial->available());
+    if ((awaitable->_kind == SWARM_M138_AWAIT_EVENT) && (!awaitable->_ready) && (awaitable->_eventType == type))
+    {
+      if (awaitable->_out != NULL)
+      {
+        Swarm_M138_Event_t *event = (Swarm_M138_Event_t *)awaitable->_out;
+        size_t len = strlen(line);
+        if (len > (SWARM_M138_EVENT_MAX_LENGTH - 1))
+          len = SWARM_M138_EVENT_MAX_LENGTH - 1;
+        event->type = type;
+        event->length = (uint16_t)len;
+        memcpy(event->sentence, line, len);
+        event->sentence[len] = 0;
+      }
+      awaitable->_result = SWARM_M138_ERROR_SUCCESS;
+      awaitable->_ready = true;
+    }
   }
-#ifdef SWARM_M138_SOFTWARE_SERIAL_ENABLED
-  else if (_softSerial != NULL)
+}
+
+// Return true if pruneBacklog must keep this line: it is the response to the command in flight, or an awaited message
+bool SWARM_M138::asyncKeepLine(const char *line)
+{
+  if (_asyncCommand != NULL)
   {
-    return ((int)_softSerial->available());
+    if (strstr(line, _asyncCommand->_expectedResponseStart) != NULL)
+      return (true);
+    if ((_asyncCommand->_expectedErrorStart != NULL) && (strstr(line, _asyncCommand->_expectedErrorStart) != NULL))
+      return (true);
   }
-#endif
-  else if (_i2cPort != NULL)
+
+  Swarm_M138_Event_Type_e type = eventType(line);
+  for (SWARM_M138_Awaitable *awaitable = _asyncPending; awaitable != NULL; awaitable = awaitable->_next)
   {
-    return (qwiicSwarmAvailable());
+    if ((awaitable->_kind == SWARM_M138_AWAIT_EVENT) && (awaitable->_eventType == type) && (type != SWARM_M138_EVENT_UNKNOWN))
+      return (true);
   }
 
-  return -1;
+  return (false);
 }
 
-// Read len chars from the appropriate port. Store in buf
-int SWARM_M138::hwReadChars(char *buf, int len)
+// Time out the command in flight, complete any expired delays, then resume the ready coroutines (oldest first)
+void SWARM_M138::asyncService(void)
 {
-  if (len <= 0)
-    return (len);
-
-  if (buf == NULL)
-    return (-1);
+  if ((_asyncCommand != NULL) && ((millis() - _asyncCommand->_start) >= _asyncCommand->_timeout))
+  {
+    if (_printDebug == true)
+      _debugPort->println(F("asyncService: command timed out"));
+#ifdef SWARM_M138_STATS
+    noteCommandStats(statsTagIndex((_asyncCommand->_command != NULL) ? _asyncCommand->_command : (const char *)_asyncCommand->_commandBuffer),
+                     SWARM_M138_ERROR_TIMEOUT, 0);
+#endif
+    _asyncCommand->_result = SWARM_M138_ERROR_TIMEOUT;
+    _asyncCommand->_ready = true;
+    _asyncCommand = NULL;
+  }
 
-  if (_hardSerial != NULL)
+  for (SWARM_M138_Awaitable *awaitable = _asyncPending; awaitable != NULL; awaitable = awaitable->_next)
   {
-    for (int i = 0; i < len; i++)
+    if ((awaitable->_kind == SWARM_M138_AWAIT_DELAY) && (!awaitable->_ready) && ((millis() - awaitable->_start) >= awaitable->_timeout))
     {
-      buf[i] = _hardSerial->read();
+      awaitable->_result = SWARM_M138_ERROR_SUCCESS;
+      awaitable->_ready = true;
     }
-    return (len);
   }
-#ifdef SWARM_M138_SOFTWARE_SERIAL_ENABLED
-  else if (_softSerial != NULL)
+
+  // Resuming a coroutine can link new awaiters (or free the frame holding this one). Rescan the list after each resume
+  bool resumed = true;
+  while (resumed)
   {
-    for (int i = 0; i < len; i++)
+    resumed = false;
+    for (SWARM_M138_Awaitable *awaitable = _asyncPending; awaitable != NULL; awaitable = awaitable->_next)
     {
-      buf[i] = _softSerial->read();
+      if (awaitable->_ready)
+      {
+        asyncUnlink(awaitable);
+        awaitable->_handle.resume(); // Don't touch awaitable after this
+        resumed = true;
+        break;
+      }
     }
-    return (len);
-  }
-#endif
-  else if (_i2cPort != NULL)
-  {
-    return (qwiicSwarmReadChars(len, buf));
   }
 
-  return (-1);
+  if (_asyncCommand == NULL)
+    asyncSendNext();
 
+  asyncUpdateSubscriptions(); // Release the types which are no longer awaited
 }
 
-// I2C functions for Qwiic Swarm
-
-// Check how many bytes Qwiic Swarm has available
-// Return -1 if it is less than QWIIC_SWARM_I2C_POLLING_WAIT_MS since the last check
-int SWARM_M138::qwiicSwarmAvailable(void)
+// Calculate the message types the awaiters need. The framers always keep these, even if they are not subscribed
+void SWARM_M138::asyncUpdateSubscriptions(void)
 {
-  int bytesAvailable = -1;
+  uint16_t mask = 0;
 
-  if (millis() - _lastI2cCheck >= QWIIC_SWARM_I2C_POLLING_WAIT_MS)
+  for (SWARM_M138_Awaitable *awaitable = _asyncPending; awaitable != NULL; awaitable = awaitable->_next)
   {
-    //Check how many serial bytes are waiting to be read
-    _i2cPort->beginTransmission((uint8_t)_address); // Talk to the I2C device
-    _i2cPort->write(QWIIC_SWARM_LEN_REG); // Point to the serial buffer length
-    _i2cPort->endTransmission(); // Send data and release the bus (the 841 (WireS) doesn't like it if the Controller holds the bus!)
-    if (_i2cPort->requestFrom((uint8_t)_address, (uint8_t)2) == 2) // Request two bytes
-    {
-      uint8_t msb = _i2cPort->read();
-      uint8_t lsb = _i2cPort->read();
-      bytesAvailable = (((uint16_t)msb) << 8) | lsb;
-    }
-
-    //Put off checking to avoid excessive I2C bus traffic - but only if zero bytes are available
-    if (bytesAvailable == 0)
-      _lastI2cCheck = millis();
+    Swarm_M138_Event_Type_e type = SWARM_M138_EVENT_UNKNOWN;
+    if (awaitable->_kind == SWARM_M138_AWAIT_EVENT)
+      type = awaitable->_eventType;
+    else if (awaitable->_kind <= SWARM_M138_AWAIT_LAST_COMMAND) // The response has the same tag as the command
+      type = eventType((awaitable->_command != NULL) ? awaitable->_command : (const char *)awaitable->_commandBuffer);
+    if (type != SWARM_M138_EVENT_UNKNOWN)
+      mask |= SWARM_M138_SUBSCRIBE(type);
   }
 
-  return (bytesAvailable);
+  _subscriptionAsync = mask;
 }
+#endif
 
-// Read len bytes from Qwiic Swarm, store in dest
-int SWARM_M138::qwiicSwarmReadChars(int len, char *dest)
+// Add a newly queued message to the TX queue mirror
+void SWARM_M138::txMirrorAdd(uint64_t msg_id)
 {
-  if (len <= 0)
-    return (len);
-
-  if (dest == NULL)
-    return (0);
-
-  int bytesRead = 0;
+  if (_txMirror == NULL)
+    return;
 
-  // Request the bytes
-  // Release the bus afterwards
-  _i2cPort->beginTransmission((uint8_t)_address); // Talk to the I2C device
-  _i2cPort->write(QWIIC_SWARM_DATA_REG); // Point to the serial buffer
-  _i2cPort->endTransmission(); // Send data and release the bus (the 841 (WireS) doesn't like it if the Master holds the bus!)
-  while (len > QWIIC_SWARM_SER_PACKET_SIZE) // If there are _more_ than SER_PACKET_SIZE bytes to be read
+  if (_txMirror->count < _txMirror->size)
   {
-    _i2cPort->requestFrom((uint8_t)_address, (uint8_t)QWIIC_SWARM_SER_PACKET_SIZE, (uint8_t)false); // Request SER_PACKET_SIZE bytes, don't release the bus
-    while (_i2cPort->available())
-    {
-      dest[bytesRead] = _i2cPort->read(); // Read and store each byte
-      bytesRead++;
-    }
-    len -= QWIIC_SWARM_SER_PACKET_SIZE; // Decrease the number of bytes available by SER_PACKET_SIZE
+    _txMirror->entries[_txMirror->count].msg_id = msg_id;
+    _txMirror->entries[_txMirror->count].queuedAt = millis();
+    _txMirror->count++;
   }
-  _i2cPort->requestFrom((uint8_t)_address, (uint8_t)len); // Request remaining bytes, release the bus
-  while (_i2cPort->available())
+  else
   {
-    dest[bytesRead] = _i2cPort->read(); // Read and store each byte
-    bytesRead++;
+    _txMirror->untracked++; // The mirror is full. We can still count the message
+    if (_printDebug == true)
+      _debugPort->println(F("txMirrorAdd: mirror is full!"));
   }
-
-  return (bytesRead);
 }
 
-// Write serial data to Qwiic Swarm
-int SWARM_M138::qwiicSwarmWriteChars(int len, const char *dest)
+// Remove a message from the TX queue mirror. Update the latency if wasSent is true
+// Return true if the message was found in the mirror
+bool SWARM_M138::txMirrorRemove(uint64_t msg_id, bool wasSent)
 {
-  if (len <= 0)
-    return (len);
-
-  if (dest == NULL)
-    return (0);
-
-  size_t i = 0;
-  size_t nexti;
-  uint16_t checksum = 0;
+  if (_txMirror == NULL)
+    return (false);
 
-  while (len > (QWIIC_SWARM_I2C_BUFFER_LENGTH - 3)) // If there are too many bytes to send all in one go
+  for (uint16_t i = 0; i < _txMirror->count; i++)
   {
-    nexti = i + (QWIIC_SWARM_I2C_BUFFER_LENGTH - 3);
-    _i2cPort->beginTransmission((uint8_t)_address);
-    _i2cPort->write(QWIIC_SWARM_DATA_REG); // Point to the serial data 'register'
-    for (; i < nexti; i++)
+    if (_txMirror->entries[i].msg_id == msg_id)
     {
-        _i2cPort->write(dest[i]); // Write each byte
-        checksum += (uint16_t)dest[i]; // Update the checksum
+      if (wasSent)
+      {
+        unsigned long latency = millis() - _txMirror->entries[i].queuedAt;
+        if ((_txMirror->latencySent == 0) || (latency < _txMirror->latencyMin))
+          _txMirror->latencyMin = latency;
+        if (latency > _txMirror->latencyMax)
+          _txMirror->latencyMax = latency;
+        _txMirror->latencyLast = latency;
+        _txMirror->latencyTotal += latency;
+        _txMirror->latencySent++;
+      }
+
+      _txMirror->count--;
+      for (; i < _txMirror->count; i++) // Shuffle the remaining entries down to keep them in order
+        _txMirror->entries[i] = _txMirror->entries[i + 1];
+
+      return (true);
     }
-    len -= (QWIIC_SWARM_I2C_BUFFER_LENGTH - 3); // Decrease the number of bytes still to send
-    _i2cPort->endTransmission(); // Send data and release the bus (the 841 (WireS) doesn't like it if the Master holds the bus!)
   }
 
-  // There are now <= (TINY_I2C_BUFFER_LENGTH - 3) bytes left to send, so send them and then release the bus
-  _i2cPort->beginTransmission((uint8_t)_address);
-  _i2cPort->write(QWIIC_SWARM_DATA_REG); // Point to the 'serial register'
-  while (len > 0)
-  {
-    _i2cPort->write(dest[i]);
-    checksum += (uint16_t)dest[i];
-    len--;
-    i++;
-  }
-  _i2cPort->write((uint8_t)(checksum >> 8));
-  _i2cPort->write((uint8_t)(checksum & 0xFF));
-  if (_i2cPort->endTransmission() != 0) //Send data and release bus
-    if (_printDebug == true)
-      _debugPort->println(F("qwiicSwarmWriteChars: I2C write was not successful!"));
+  // The message was not tracked. If it was sent or deleted, it must have been one of the untracked messages
+  if (_txMirror->untracked > 0)
+    _txMirror->untracked--;
 
-  return ((int)i);
+  return (false);
 }
 
-void SWARM_M138::beginSerial(unsigned long baud)
+#ifdef SWARM_M138_ALLOC_HOOKS
+// The header in front of each allocation: its size, and the allocator which will free it
+typedef union
 {
-  if (_hardSerial != NULL)
-  {
-    _hardSerial->begin(baud);
-  }
-#ifdef SWARM_M138_SOFTWARE_SERIAL_ENABLED
-  else if (_softSerial != NULL)
-  {
-    _softSerial->end();
-    _softSerial->begin(baud);
-  }
+  struct
+  {
+    size_t size;
+    void (*release)(void *ptr, size_t size, void *context); // NULL = delete[]
+    void *context;
+    uint8_t entry; // The _allocEntries index which allocated it
+  } block;
+  uint64_t align; // Keep the caller's memory aligned for any type it holds
+} Swarm_M138_Alloc_Header_t;
 #endif
-  delay(100);
+
+#ifdef SWARM_M138_ALLOC_HOOKS
+// Return the _allocEntries index for the running public function. Reuse an entry freed by resetAllocStats if there is one
+// Once the table is full, new functions share "(other)"
+uint8_t SWARM_M138::allocEntryIndex(void)
+{
+  const char *entry = (_allocEntry != NULL) ? _allocEntry : "(other)";
+  int unused = -1;
+  int other = -1;
+  for (uint8_t i = 0; i < _allocEntryCount; i++)
+  {
+    if (_allocEntries[i].entry == NULL)
+    {
+      if (unused < 0)
+        unused = i;
+    }
+    else if (strcmp(_allocEntries[i].entry, entry) == 0)
+      return (i);
+    else if (strcmp(_allocEntries[i].entry, "(other)") == 0)
+      other = i;
+  }
+  if ((unused < 0) && (_allocEntryCount < (SWARM_M138_ALLOC_ENTRIES - 1))) // The last entry is kept for "(other)"
+    unused = _allocEntryCount++;
+  if (unused < 0) // The table is full
+  {
+    if (other >= 0)
+      return ((uint8_t)other);
+    entry = "(other)";
+    unused = _allocEntryCount++; // The last entry
+  }
+  memset(&_allocEntries[unused], 0, sizeof(Swarm_M138_Alloc_Entry_Stats_t));
+  _allocEntries[unused].entry = entry;
+  return ((uint8_t)unused);
 }
+#endif
 
 // Allocate memory
+void *SWARM_M138::swarm_m138_alloc(size_t num)
+{
+#ifdef SWARM_M138_ALLOC_HOOKS
+  size_t total = num + sizeof(Swarm_M138_Alloc_Header_t);
+  Swarm_M138_Alloc_Header_t *header;
+  if (_allocate != NULL)
+    header = (Swarm_M138_Alloc_Header_t *)_allocate(total, _allocContext);
+  else
+    header = (Swarm_M138_Alloc_Header_t *)new char[total];
+  uint8_t entry = allocEntryIndex();
+  if (header == NULL)
+  {
+    _allocFailures = _allocFailures + 1;
+    _allocEntries[entry].failures++;
+    return (NULL);
+  }
+  header->block.size = num;
+  header->block.release = (_allocate != NULL) ? _release : NULL;
+  header->block.context = _allocContext;
+  header->block.entry = entry;
+  _allocEntries[entry].allocations++;
+  _allocEntries[entry].currentBytes += num;
+
+  _allocCount = _allocCount + 1;
+  _allocBytes = _allocBytes + num;
+  if (_allocBytes > _allocPeak)
+    _allocPeak = (uint32_t)_allocBytes;
+  if (num > _allocLargest)
+    _allocLargest = num;
+  return ((void *)(header + 1));
+#else
+  return ((void *)new char[num]);
+#endif
+}
+void SWARM_M138::swarm_m138_free(void *freeMe)
+{
+#ifdef SWARM_M138_ALLOC_HOOKS
+  if (freeMe == NULL)
+    return;
+  Swarm_M138_Alloc_Header_t *header = ((Swarm_M138_Alloc_Header_t *)freeMe) - 1;
+  _freeCount = _freeCount + 1;
+  _allocBytes = _allocBytes - header->block.size;
+  _allocEntries[header->block.entry].frees++;
+  _allocEntries[header->block.entry].currentBytes -= header->block.size;
+  if (header->block.release != NULL)
+    header->block.release((void *)header, header->block.size + sizeof(Swarm_M138_Alloc_Header_t), header->block.context);
+  else
+    delete[] (char *)header;
+#else
+  delete[] (char *)freeMe;
+#endif
+}
 char *SWARM_M138::swarm_m138_alloc_char(size_t num)
 {
-  return ((char *)new char[num]);
+  return ((char *)swarm_m138_alloc(num));
 }
 void SWARM_M138::swarm_m138_free_char(char *freeMe)
 {
-  delete[] freeMe;
+  swarm_m138_free((void *)freeMe);
 }
 
 //This prunes the backlog of non-actionable events. If new actionable events are added, you must modify the if statement.
@@ -5692,27 +11791,29 @@ void SWARM_M138::pruneBacklog()
   }
   memset(_pruneBuffer, 0, _RxBuffSize); // Clear the _pruneBuffer
 
+  // A sentence at the very end of the backlog which has no \n yet is still arriving. Keep it without adding one,
+  // so it is joined correctly when the rest arrives. (Adding one could also overflow _pruneBuffer when the backlog is full)
+  // Keep it even if it is not subscribed: it may be too short to hold its tag yet
+  char *backlogEnd = _swarmBacklog + strlen((const char *)_swarmBacklog);
+
   char *preservedEvent;
   event = strtok_r(_swarmBacklog, "\n", &preservedEvent); // Look for an 'event' - something ending in \n
 
   while (event != NULL) //If event is actionable, add it to pruneBuffer.
   {
     // These are the events we want to keep so they can be processed by checkUnsolicitedMsg.
-    // See issue #22. We only keep events which have a callback, otherwise the backlog
-    // fills up causing other problems.
-    if (((strstr(event, "$DT ") != NULL) && (_swarmDateTimeCallback != NULL))
-        || ((strstr(event, "$GJ ") != NULL) && (_swarmGpsJammingCallback != NULL))
-        || ((strstr(event, "$GN ") != NULL) && (_swarmGeospatialCallback != NULL))
-        || ((strstr(event, "$GS ") != NULL) && (_swarmGpsFixQualityCallback != NULL))
-        || ((strstr(event, "$PW ") != NULL) && (_swarmPowerStatusCallback != NULL))
-        || ((strstr(event, "$RD ") != NULL) && (_swarmReceiveMessageCallback != NULL))
-        || ((strstr(event, "$RT ") != NULL) && (_swarmReceiveTestCallback != NULL))
-        || ((strstr(event, "$SL ") != NULL) && (_swarmSleepWakeCallback != NULL))
-        || ((strstr(event, "$M138 ") != NULL) && (_swarmModemStatusCallback != NULL))
-        || ((strstr(event, "$TD ") != NULL) && (_swarmTransmitDataCallback != NULL)))
+    // See issue #22. We only keep the subscribed events: by default, those which have a callback
+    // or are needed by a library feature. Otherwise the backlog fills up causing other problems.
+    bool arriving = ((event + strlen(event)) == backlogEnd);
+    if (arriving || subscribed((const char *)event)
+#ifdef SWARM_M138_COROUTINES_AVAILABLE
+        || asyncKeepLine(event)
+#endif
+        )
     {
       strcat(_pruneBuffer, event); // The URCs are all readable text so using strcat is OK
-      strcat(_pruneBuffer, "\n"); // strtok blows away delimiter, but we want that for later.
+      if (!arriving)
+        strcat(_pruneBuffer, "\n"); // strtok blows away delimiter, but we want that for later.
     }
 
     event = strtok_r(NULL, "\n", &preservedEvent); // Walk though any remaining events
@@ -5722,5 +11823,66 @@ void SWARM_M138::pruneBacklog()
   memcpy(_swarmBacklog, _pruneBuffer, strlen(_pruneBuffer)); //Copy the pruned buffer back into the backlog
 
   swarm_m138_free_char(_pruneBuffer);
-  delete event;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Constructor for the RAM outbox storage
+    @param  capacity
+            The size of the log in bytes. Each message uses its length
+            plus SWARM_M138_OUTBOX_RECORD_OVERHEAD bytes, plus
+            SWARM_M138_OUTBOX_RECORD_OVERHEAD for its acknowledgement
+*/
+/**************************************************************************/
+SWARM_M138_RAM_Storage::SWARM_M138_RAM_Storage(uint32_t capacity)
+{
+  _buffer = new uint8_t[capacity];
+  _capacity = (_buffer == NULL) ? 0 : capacity;
+  _size = 0;
+}
+
+SWARM_M138_RAM_Storage::~SWARM_M138_RAM_Storage()
+{
+  if (_buffer != NULL)
+  {
+    delete[] _buffer;
+    _buffer = NULL;
+  }
+}
+
+uint32_t SWARM_M138_RAM_Storage::size(void)
+{
+  return (_size);
+}
+
+bool SWARM_M138_RAM_Storage::read(uint32_t offset, uint8_t *data, uint16_t len)
+{
+  if ((offset + len) > _size)
+    return (false);
+  memcpy(data, &_buffer[offset], len);
+  return (true);
+}
+
+bool SWARM_M138_RAM_Storage::append(const uint8_t *data, uint16_t len)
+{
+  if ((_size + len) > _capacity)
+    return (false);
+  memcpy(&_buffer[_size], data, len);
+  _size += len;
+  return (true);
+}
+
+bool SWARM_M138_RAM_Storage::clear(void)
+{
+  _size = 0;
+  return (true);
+}
+
+bool SWARM_M138_RAM_Storage::discard(uint32_t len)
+{
+  if (len > _size)
+    return (false);
+  memmove(_buffer, &_buffer[len], _size - len);
+  _size -= len;
+  return (true);
 }
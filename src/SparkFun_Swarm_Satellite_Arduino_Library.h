@@ -73,6 +73,46 @@
 
 #include <Wire.h> // Needed for I2C communication with Qwiic Swarm
 
+// Threaded mode: a reader task owns the serial port and queues the unsolicited messages as events
+// ESP32 uses a FreeRTOS task. Host (non-Arduino) builds use std::thread. Define SWARM_M138_USE_STD_THREAD to force std::thread
+#if defined(ARDUINO_ARCH_ESP32)
+#define SWARM_M138_THREADS_FREERTOS // The reader is a FreeRTOS task
+#elif !defined(ARDUINO) || defined(SWARM_M138_USE_STD_THREAD)
+#define SWARM_M138_THREADS_STD // The reader is a std::thread
+#endif
+
+#if defined(SWARM_M138_THREADS_FREERTOS) || defined(SWARM_M138_THREADS_STD)
+#define SWARM_M138_THREADS_AVAILABLE
+#include <atomic>
+#endif
+
+#ifdef SWARM_M138_THREADS_STD
+#include <thread>
+#endif
+
+// Coroutine command API: needs C++20 (e.g. -std=c++20 on the host, or -std=gnu++2a on ESP32 with a recent toolchain)
+#if defined(__has_include) && (__cplusplus >= 202002L)
+#if __has_include(<coroutine>)
+#define SWARM_M138_COROUTINES_AVAILABLE
+#include <coroutine>
+#endif
+#endif
+
+// feedRxByte / feedRxBytes can be called from an interrupt. On ESP32 they must be in IRAM
+#ifdef ARDUINO_ARCH_ESP32
+#define SWARM_M138_ISR_ATTR IRAM_ATTR
+#else
+#define SWARM_M138_ISR_ATTR
+#endif
+
+// Allocation hooks: count the library's heap use and let the application supply the allocator (setAllocator / getAllocStats)
+// Each allocation then carries a small header. Uncomment the next line, or define SWARM_M138_ALLOC_HOOKS on the command line, to enable them
+//#define SWARM_M138_ALLOC_HOOKS
+
+// Statistics: a response time histogram and error counters for each command (getStats / resetStats)
+// They cost ~550 bytes of RAM and a few microseconds per command. Uncomment the next line, or define SWARM_M138_STATS on the command line, to enable them
+//#define SWARM_M138_STATS
+
 /** Timeouts for the serial commands */
 #define SWARM_M138_STANDARD_RESPONSE_TIMEOUT 1500 ///< Standard command timeout: allow 1.5 seconds for the modem to respond (See issue #22. 1000ms was too short.)
 #define SWARM_M138_MESSAGE_DELETE_TIMEOUT 5000    ///< Allow extra time when deleting a message
@@ -80,6 +120,11 @@
 #define SWARM_M138_MESSAGE_READ_TIMEOUT 3000      ///< Allow extra time when reading a message
 #define SWARM_M138_MESSAGE_TRANSMIT_TIMEOUT 3000  ///< Allow extra time when queueing a message for transmission
 
+/** Adaptive timeouts */
+#define SWARM_M138_ADAPTIVE_TIMEOUT_FLOOR 250 ///< The default shortest adaptive timeout (ms)
+#define SWARM_M138_ADAPTIVE_CLASSES 6         ///< The number of timeout classes which can be learned. Each fixed timeout is one class
+#define SWARM_M138_ADAPTIVE_MIN_SAMPLES 4     ///< The number of responses to learn from before the timeout of a class is shortened
+
 /** Modem Serial Baud Rate */
 #define SWARM_M138_SERIAL_BAUD_RATE 115200 ///< The modem serial baud rate is 115200 and cannot be changed
 
@@ -259,6 +304,652 @@ typedef enum
   SWARM_M138_MODEM_STATUS_INVALID
 } Swarm_M138_Modem_Status_e;
 
+/** Local mirror of the modem's transmit queue */
+#define SWARM_M138_TX_MIRROR_DEFAULT_SIZE 16 ///< The default number of message IDs held in the TX queue mirror
+
+/** A struct to hold one entry in the TX queue mirror */
+typedef struct
+{
+  uint64_t msg_id;        // The message ID returned by $TD OK
+  unsigned long queuedAt; // millis() when the modem accepted the message
+} Swarm_M138_TX_Mirror_Entry_t;
+
+/** The TX queue mirror state. Allocated by enableTxQueueMirror, followed by the entries */
+typedef struct
+{
+  Swarm_M138_TX_Mirror_Entry_t *entries; // Points just after the struct
+  uint16_t size;                         // The number of entries the mirror can hold
+  uint16_t count;                        // The number of entries in use
+  uint16_t untracked;                    // Unsent messages the modem holds which are not in the mirror (queued before it was enabled, or it was full)
+  uint32_t latencySent;
+  unsigned long latencyLast;
+  unsigned long latencyMin;
+  unsigned long latencyMax;
+  uint64_t latencyTotal;
+} Swarm_M138_TX_Mirror_t;
+
+/** A struct to hold the enqueue-to-sent latency of the messages tracked by the TX queue mirror */
+typedef struct
+{
+  uint32_t sent;         // The number of tracked messages which have been sent ($TD SENT)
+  unsigned long last;    // The latency of the most recent message (ms)
+  unsigned long minimum; // The shortest latency (ms)
+  unsigned long maximum; // The longest latency (ms)
+  unsigned long mean;    // The mean latency (ms)
+} Swarm_M138_TX_Latency_t;
+
+/** Deferred batch of RX message mark / delete intents */
+#define SWARM_M138_RX_BATCH_DEFAULT_SIZE 16 ///< The default number of intents held in the RX batch
+#define SWARM_M138_RX_BATCH_MARK 0x01       ///< The message is to be marked as read
+#define SWARM_M138_RX_BATCH_DELETE 0x02     ///< The message is to be deleted
+#define SWARM_M138_RX_BATCH_READ 0x04       ///< The message is known to have been read already
+#define SWARM_M138_RX_BATCH_AUTOFLUSH_INTERVAL 10000 ///< checkUnsolicitedMsg flushes the batch at most this often (ms)
+
+/** A struct to hold one intent in the RX batch */
+typedef struct
+{
+  uint64_t msg_id; // The message ID
+  uint8_t flags;   // SWARM_M138_RX_BATCH_MARK / _DELETE / _READ
+} Swarm_M138_RX_Batch_Entry_t;
+
+/** The RX batch state. Allocated by enableRxBatch, followed by the entries */
+typedef struct
+{
+  Swarm_M138_RX_Batch_Entry_t *entries; // Points just after the struct
+  uint16_t size;                        // The number of entries the batch can hold
+  uint16_t count;                       // The number of entries in use
+  bool autoFlush;                       // Flush from checkUnsolicitedMsg when the modem is idle
+  unsigned long lastFlush;              // millis when the batch was last flushed. Limits the automatic flushes
+} Swarm_M138_RX_Batch_t;
+
+/** Duplicate filter for received messages */
+#define SWARM_M138_RX_DEDUP_DEFAULT_SIZE 32   ///< The default number of fingerprints held in the duplicate filter
+#define SWARM_M138_RX_DEDUP_RECORD_LEN 8      ///< Each fingerprint is stored as: hash (4), epoch (4). Little endian
+#define SWARM_M138_RX_DEDUP_COMPACT_FACTOR 4  ///< The storage is rewritten when it holds this many times the filter size
+
+/** A struct to hold one fingerprint in the duplicate filter */
+typedef struct
+{
+  uint32_t hash;  // FNV-1a hash of the appID and the binary payload
+  uint32_t epoch; // The epoch at which the modem received the message. 0 if unknown ($RD does not include it)
+} Swarm_M138_RX_Dedup_Entry_t;
+
+/** Host-persistent outbox */
+#define SWARM_M138_OUTBOX_DEFAULT_HIGH_WATER 8 ///< The default maximum number of outbox messages kept in the modem's transmit queue
+#define SWARM_M138_OUTBOX_RECORD_MAGIC 0x5A    ///< The first byte of every outbox log record
+#define SWARM_M138_OUTBOX_RECORD_ACK 0x01      ///< Record flag: this is an acknowledgement (the modem accepted record seq)
+#define SWARM_M138_OUTBOX_RECORD_APPID 0x02    ///< Record flag: the message has an appID
+#define SWARM_M138_OUTBOX_HEADER_LEN 10        ///< Record header: magic, flags, len (2), appID (2), seq (4)
+#define SWARM_M138_OUTBOX_RECORD_OVERHEAD 12   ///< Header plus the CRC-16 which follows the payload
+#define SWARM_M138_OUTBOX_COMPACT_THRESHOLD 1024 ///< serviceOutbox discards the sent records once they use this many bytes (needs SWARM_M138_Storage::discard)
+
+/** Storage interface for the outbox log. Implement this for SD, LittleFS, EEPROM, a file, etc. */
+// The log is only ever appended to, read, cleared completely, or (optionally) trimmed from the front
+class SWARM_M138_Storage
+{
+public:
+  virtual ~SWARM_M138_Storage() {}
+  virtual uint32_t size(void) = 0;                                        // Return the number of bytes in the log
+  virtual bool read(uint32_t offset, uint8_t *data, uint16_t len) = 0;   // Read len bytes from offset. Return false on failure
+  virtual bool append(const uint8_t *data, uint16_t len) = 0;            // Append len bytes to the end of the log. Return false on failure
+  virtual bool clear(void) = 0;                                           // Erase the log. Return false on failure
+  virtual bool discard(uint32_t len) { return (false); }                  // Optional: remove the first len bytes, so offset len becomes offset 0. Return false if not supported
+};
+
+/** A simple RAM implementation of SWARM_M138_Storage. The contents do not survive a reset */
+class SWARM_M138_RAM_Storage : public SWARM_M138_Storage
+{
+public:
+  SWARM_M138_RAM_Storage(uint32_t capacity);
+  ~SWARM_M138_RAM_Storage();
+  uint32_t size(void);
+  bool read(uint32_t offset, uint8_t *data, uint16_t len);
+  bool append(const uint8_t *data, uint16_t len);
+  bool clear(void);
+  bool discard(uint32_t len);
+
+private:
+  uint8_t *_buffer;
+  uint32_t _capacity;
+  uint32_t _size;
+};
+
+/** The duplicate filter state. Allocated by enableRxDedup, followed by the entries */
+typedef struct
+{
+  Swarm_M138_RX_Dedup_Entry_t *entries; // Points just after the struct: size fingerprints
+  uint16_t size;                        // The number of fingerprints the filter can hold
+  uint16_t count;                       // The number of fingerprints in use
+  uint16_t head;                        // The index of the next fingerprint to be overwritten
+  uint32_t duplicates;                  // The number of duplicates suppressed
+  SWARM_M138_Storage *storage;          // Optional. NULL if the fingerprints are not persisted
+} Swarm_M138_RX_Dedup_t;
+
+/** The outbox state. Allocated by beginOutbox */
+typedef struct
+{
+  SWARM_M138_Storage *storage; // The log
+  uint16_t highWater;          // Keep at most this many unsent messages in the modem's queue
+  uint32_t pending;            // The number of messages in the log which have not been accepted by the modem
+  uint32_t readOffset;         // The offset of the oldest pending record
+  uint32_t nextSeq;            // The sequence number for the next record
+  uint32_t ackedSeq;           // The sequence number of the last record accepted by the modem
+} Swarm_M138_Outbox_t;
+
+/** Record packer */
+#define SWARM_M138_PACKER_RECORD_OVERHEAD 2         ///< Each packed record is prefixed by its type and length
+#define SWARM_M138_PACKER_DEFAULT_MAX_AGE 3600000UL ///< The default maximum age (ms) of the oldest record before the packet is flushed
+
+/** The record packer state. Allocated by enablePacker */
+typedef struct
+{
+  uint8_t data[SWARM_M138_MAX_PACKET_LENGTH_BYTES]; // The packet
+  size_t length;                 // The number of bytes in data
+  unsigned long maxAge;          // Flush when the oldest record is this old (ms)
+  unsigned long firstAt;         // millis() when the first record was packed
+  bool useAppID;
+  uint16_t appID;
+  Swarm_M138_Error_e flushError; // The result of the most recent flushPacker. packRecord does not return it once the record is packed
+} Swarm_M138_Packer_t;
+
+/** Payload compression */
+#define SWARM_M138_COMPRESS_MODE_RAW 0x00          ///< The payload is not compressed
+#define SWARM_M138_COMPRESS_MODE_LZSS 0x01         ///< The payload is LZSS compressed, using the static dictionary
+#define SWARM_M138_COMPRESS_MODE_SERIES 0x02       ///< The payload is a series of int32_t, delta encoded as zigzag varints
+#define SWARM_M138_COMPRESS_MIN_MATCH 3            ///< The shortest LZSS match
+#define SWARM_M138_COMPRESS_MAX_MATCH 18           ///< The longest LZSS match (4 bits)
+#define SWARM_M138_COMPRESS_WINDOW 4096            ///< The LZSS window (12 bits)
+#define SWARM_M138_MAX_DECOMPRESSED_LENGTH 512     ///< The largest payload the decompressor will produce in the receive path
+
+/** Fragmentation and reassembly */
+#define SWARM_M138_FRAGMENT_APPID_BASE 64000                                                               ///< Fragments are sent with appID 64000 + channel
+#define SWARM_M138_FRAGMENT_CHANNELS 1000                                                                  ///< appIDs 64000 - 64999 are reserved for fragments
+#define SWARM_M138_FRAGMENT_HEADER_LEN 3                                                                   ///< Each fragment starts with: key, index, count
+#define SWARM_M138_FRAGMENT_PAYLOAD (SWARM_M138_MAX_PACKET_LENGTH_BYTES - SWARM_M138_FRAGMENT_HEADER_LEN)  ///< The data carried by each fragment
+#define SWARM_M138_FRAGMENT_MAX_COUNT 255                                                                  ///< The maximum number of fragments per message
+#define SWARM_M138_FRAGMENT_BITMAP_LENGTH 32                                                               ///< The length of a missing-fragment bitmap: one bit per fragment
+#define SWARM_M138_REASSEMBLY_DEFAULT_TIMEOUT 21600000UL                                                   ///< The default reassembly timeout (ms): 6 hours
+
+/** The reassembly state. Allocated by enableReassembly, followed by the maxLength byte buffer */
+typedef struct
+{
+  uint8_t *data;                 // Points just after the struct: maxLength bytes
+  uint8_t bitmap[SWARM_M138_FRAGMENT_BITMAP_LENGTH]; // Bit set = fragment received
+  size_t maxLength;
+  unsigned long timeout;
+  unsigned long lastAt;          // millis() when the last fragment arrived
+  bool active;                   // True if a partial message is held
+  uint8_t key;
+  uint16_t channel;
+  uint8_t count;
+  uint8_t received;
+  size_t lastLen;                // The length of the final fragment (once it has arrived)
+  bool doneValid;                // Remember the last completed message so repeated fragments are ignored
+  uint8_t doneKey;
+  uint16_t doneChannel;
+  unsigned long doneAt;          // millis() when it completed. It is forgotten after the reassembly timeout
+} Swarm_M138_Reassembly_t;
+
+/** Priority transmit scheduler */
+#define SWARM_M138_TX_SCHEDULER_DEFAULT_SIZE 8   ///< The default number of messages the scheduler can hold
+#define SWARM_M138_TX_SCHEDULER_DEFAULT_WINDOW 4 ///< The default maximum number of unsent messages kept in the modem's queue
+
+typedef enum
+{
+  SWARM_M138_TX_PRIORITY_BULK = 0,  // Logs etc.. Evicted from the modem first
+  SWARM_M138_TX_PRIORITY_TELEMETRY, // Routine readings
+  SWARM_M138_TX_PRIORITY_ALARM,     // Always moved to the front of the modem's queue
+  SWARM_M138_TX_PRIORITY_INVALID
+} Swarm_M138_TX_Priority_e;
+
+/** A struct to hold the policy for one priority class */
+typedef struct
+{
+  uint32_t hold;        // The $TD HD= hold duration in seconds (60 to 34819200). 0 = use the modem default (48 hours)
+  unsigned long maxAge; // Discard the message if it has waited this long (ms) before reaching the modem. 0 = never
+} Swarm_M138_TX_Priority_Policy_t;
+
+/** A struct to hold one message in the scheduler */
+typedef struct
+{
+  uint8_t data[SWARM_M138_MAX_PACKET_LENGTH_BYTES];
+  uint8_t len;
+  uint8_t priority;        // Swarm_M138_TX_Priority_e
+  bool inUse;
+  bool inModem;            // True if the message is in the modem's queue. msg_id is valid
+  bool useAppID;
+  uint16_t appID;
+  unsigned long queuedAt;  // millis() when the message was scheduled
+  uint64_t msg_id;
+} Swarm_M138_TX_Scheduler_Entry_t;
+
+/** The scheduler state. Allocated by enableTxScheduler, followed by the entries */
+typedef struct
+{
+  Swarm_M138_TX_Scheduler_Entry_t *entries; // Points just after the struct
+  uint8_t size;
+  uint8_t window;          // The maximum number of unsent messages to keep in the modem's queue
+  Swarm_M138_TX_Priority_Policy_t policy[SWARM_M138_TX_PRIORITY_INVALID];
+} Swarm_M138_TX_Scheduler_t;
+
+/** Unsolicited message events */
+#define SWARM_M138_EVENT_MAX_LENGTH 448     ///< The longest event sentence: $RD with 384 ASCII Hex characters, plus the header, checksum and null
+#define SWARM_M138_EVENT_QUEUE_DEPTH 8      ///< The number of slots in the threaded mode event queue (one fewer events can be waiting)
+#define SWARM_M138_COMMAND_QUEUE_DEPTH 2    ///< The number of slots in the threaded mode command queue
+#define SWARM_M138_READER_STACK_SIZE 4096   ///< The default stack size (bytes) for the threaded mode reader task
+
+typedef enum
+{
+  SWARM_M138_EVENT_UNKNOWN = 0,
+  SWARM_M138_EVENT_DATE_TIME,       // $DT
+  SWARM_M138_EVENT_GPS_JAMMING,     // $GJ
+  SWARM_M138_EVENT_GEOSPATIAL,      // $GN
+  SWARM_M138_EVENT_GPS_FIX_QUALITY, // $GS
+  SWARM_M138_EVENT_POWER_STATUS,    // $PW
+  SWARM_M138_EVENT_RECEIVE_MESSAGE, // $RD
+  SWARM_M138_EVENT_RECEIVE_TEST,    // $RT
+  SWARM_M138_EVENT_SLEEP_WAKE,      // $SL
+  SWARM_M138_EVENT_MODEM_STATUS,    // $M138
+  SWARM_M138_EVENT_TRANSMIT_DATA    // $TD
+} Swarm_M138_Event_Type_e;
+
+/** A struct to hold one unsolicited message: a complete sentence with a valid checksum */
+typedef struct
+{
+  Swarm_M138_Event_Type_e type;
+  uint16_t length;                               // strlen(sentence)
+  char sentence[SWARM_M138_EVENT_MAX_LENGTH];    // $ to checksum. Null-terminated. No \n
+} Swarm_M138_Event_t;
+
+/** A view of one unsolicited message in the receive buffer. Nothing is copied: the view is only valid until the callback returns */
+typedef struct
+{
+  const char *data; // The $
+  size_t length;    // $ to checksum. No \n
+} Swarm_M138_Line_View_t;
+
+/** URC handler registry */
+#define SWARM_M138_URC_HANDLERS_DEFAULT_SIZE 8 ///< The default number of handlers which can be registered
+#define SWARM_M138_URC_PREFIX_MAX_LENGTH 15    ///< The longest prefix which can be registered, e.g. "$M138 NEWSTATUS"
+
+/** A struct to hold one registered handler. See registerUrcHandler */
+typedef struct
+{
+  char prefix[SWARM_M138_URC_PREFIX_MAX_LENGTH + 1]; // e.g. "$XY" or "$M138 GNSS". Null-terminated. Empty if the entry is unused
+  uint8_t tagLength;                                 // The length of the tag: the prefix up to the first space (or comma)
+  uint8_t next;                                      // The next entry in the same hash bucket + 1. 0 = none
+  bool (*handler)(const Swarm_M138_Line_View_t *line, void *context);
+  void *context;
+} Swarm_M138_URC_Handler_t;
+
+/** The URC handler table. Allocated by enableUrcHandlers, followed by the handlers and the buckets */
+typedef struct
+{
+  Swarm_M138_URC_Handler_t *handlers; // Points just after the struct
+  uint8_t *buckets;                   // The first entry in each bucket + 1. 0 = empty
+  uint8_t size;
+  uint8_t bucketCount;                // A power of two
+} Swarm_M138_URC_Table_t;
+
+/** Typed event queue */
+#define SWARM_M138_TYPED_EVENT_DEFAULT_DEPTH 8 ///< The default number of parsed events the typed event queue can hold
+
+typedef enum
+{
+  SWARM_M138_OVERFLOW_DROP_NEWEST = 0, // When the queue is full, discard the new event
+  SWARM_M138_OVERFLOW_DROP_OLDEST      // When the queue is full, overwrite the oldest event
+} Swarm_M138_Queue_Overflow_e;
+
+/** A parsed unsolicited message. type selects the union member */
+typedef struct
+{
+  Swarm_M138_Event_Type_e type;
+  unsigned long timestamp;                       // millis() when the message was parsed
+  union
+  {
+    Swarm_M138_DateTimeData_t dateTime;          // SWARM_M138_EVENT_DATE_TIME
+    Swarm_M138_GPS_Jamming_Indication_t jamming; // SWARM_M138_EVENT_GPS_JAMMING
+    Swarm_M138_GeospatialData_t geospatial;      // SWARM_M138_EVENT_GEOSPATIAL
+    Swarm_M138_GPS_Fix_Quality_t fixQuality;     // SWARM_M138_EVENT_GPS_FIX_QUALITY
+    Swarm_M138_Power_Status_t powerStatus;       // SWARM_M138_EVENT_POWER_STATUS
+    Swarm_M138_Receive_Test_t receiveTest;       // SWARM_M138_EVENT_RECEIVE_TEST
+    Swarm_M138_Wake_Cause_e wakeCause;           // SWARM_M138_EVENT_SLEEP_WAKE
+    struct
+    {
+      Swarm_M138_Modem_Status_e status;
+      char data[SWARM_M138_MEM_ALLOC_MS];        // Null-terminated. Empty for messages like BOOT_RUNNING
+    } modemStatus;                               // SWARM_M138_EVENT_MODEM_STATUS
+    struct
+    {
+      bool appIDValid;                           // The appID is only included by firmware v1.1.0+
+      uint16_t appID;
+      int16_t rssi;
+      int16_t snr;
+      int16_t fdev;
+      uint8_t length;                            // The number of bytes in data
+      uint8_t data[SWARM_M138_MAX_PACKET_LENGTH_BYTES]; // The payload, converted from ASCII Hex to binary
+    } receiveData;                               // SWARM_M138_EVENT_RECEIVE_MESSAGE
+    struct
+    {
+      int16_t rssi_sat;
+      int16_t snr;
+      int16_t fdev;
+      uint64_t msg_id;
+    } transmitData;                              // SWARM_M138_EVENT_TRANSMIT_DATA ($TD SENT)
+  };
+} Swarm_M138_Typed_Event_t;
+
+/** The typed event queue. Allocated by enableTypedEvents, followed by the events */
+typedef struct
+{
+  Swarm_M138_Typed_Event_t *events; // Points just after the struct
+  uint8_t size;                     // The number of events the queue can hold
+  uint8_t head;                     // The index of the oldest event
+  uint8_t count;                    // The number of events waiting
+  uint8_t highWater;
+  uint32_t dropped;
+  Swarm_M138_Queue_Overflow_e policy;
+} Swarm_M138_Typed_Events_t;
+
+/** Interrupt / DMA receive path */
+#define SWARM_M138_RX_HOOK_DEFAULT_SIZE 1024 ///< The default size of the receive ring buffer (bytes). Holds ~90ms of data at 115200 baud
+
+/** Receive window */
+// On ESP32, Serial.available only changes when the UART FIFO reaches its threshold (~120 bytes) or the line goes idle
+#ifdef ARDUINO_ARCH_ESP32
+#define SWARM_M138_RX_FIFO_THRESHOLD 120 ///< The number of bytes the UART receives before Serial.available is updated
+#else
+#define SWARM_M138_RX_FIFO_THRESHOLD 1 ///< The number of bytes the UART receives before Serial.available is updated
+#endif
+
+typedef enum
+{
+  SWARM_M138_RX_WINDOW_FIXED = 0, // Wait until no data has arrived for 12ms (default)
+  SWARM_M138_RX_WINDOW_GAP        // Return as soon as the data ends on a line boundary. Otherwise wait for an inter-byte gap
+} Swarm_M138_RX_Window_e;
+
+/** Wire trace */
+#define SWARM_M138_TRACE_MAGIC "SWT1"        ///< Every trace starts with these four bytes. Then the records
+#define SWARM_M138_TRACE_SENT 'T'            ///< Record direction: bytes sent to the modem
+#define SWARM_M138_TRACE_RECEIVED 'R'        ///< Record direction: bytes received from the modem
+#define SWARM_M138_TRACE_RECORD_HEADER 6     ///< Each record: direction (1), micros() (4, little-endian), length (1), then up to 255 bytes
+#define SWARM_M138_TRACE_DEFAULT_SIZE 4096   ///< The default size of the trace ring buffer (bytes)
+#define SWARM_M138_TRACE_MIN_SIZE (SWARM_M138_TRACE_RECORD_HEADER + 255) ///< The ring buffer must hold the longest record
+
+/** The trace ring buffer. Allocated by enableTrace, followed by the size byte buffer */
+typedef struct
+{
+  uint8_t *data;   // Points just after the struct
+  size_t size;
+  size_t head;     // The next byte to write
+  size_t tail;     // The oldest record
+  size_t used;
+} Swarm_M138_Trace_Ring_t;
+
+#ifdef SWARM_M138_THREADS_AVAILABLE
+typedef std::atomic<uint16_t> swarm_m138_rx_index_t; // The receive ring indices are shared between the interrupt (or another core) and the library
+typedef std::atomic<uint16_t> swarm_m138_shared_uint16_t; // The subscriptions are shared with the reader task
+typedef std::atomic<uint32_t> swarm_m138_shared_uint32_t;
+#else
+typedef volatile uint16_t swarm_m138_rx_index_t;
+typedef volatile uint16_t swarm_m138_shared_uint16_t;
+typedef volatile uint32_t swarm_m138_shared_uint32_t;
+#endif
+
+/** The interrupt / DMA receive ring buffer. Allocated by enableRxHook, followed by the size byte buffer */
+typedef struct
+{
+  uint8_t *data;                   // Points just after the struct
+  uint16_t size;
+  swarm_m138_rx_index_t head;      // Written by feedRxByte(s) only
+  swarm_m138_rx_index_t tail;      // Written by the library only
+  volatile uint32_t dropped;       // Written by feedRxByte(s) only
+  volatile uint16_t highWater;     // Written by feedRxByte(s) only
+} Swarm_M138_RX_Ring_t;
+
+#ifdef SWARM_M138_ALLOC_HOOKS
+/** A struct to hold the library's heap use. See getAllocStats */
+typedef struct
+{
+  uint32_t allocations;  // Successful allocations
+  uint32_t frees;
+  uint32_t failures;     // Allocations which returned NULL
+  uint32_t outstanding;  // Allocations which have not been freed
+  uint32_t currentBytes; // Bytes allocated and not freed (excluding the headers)
+  uint32_t peakBytes;    // The highest currentBytes since the last resetAllocStats
+  uint32_t largest;      // The largest single allocation (bytes)
+} Swarm_M138_Alloc_Stats_t;
+
+#define SWARM_M138_ALLOC_ENTRIES 16 ///< The number of entries getAllocEntryStats can return. One of them may be "(other)": everything else
+
+/** A struct to hold the heap use of one public function. See getAllocEntryStats */
+typedef struct
+{
+  const char *entry;     // The function name, e.g. "getDateTime". Overloads share an entry
+  uint32_t allocations;  // Successful allocations made while the function was running, including by the functions it called
+  uint32_t frees;        // Frees of the blocks it allocated, whenever they happened
+  uint32_t failures;
+  uint32_t outstanding;  // Its blocks which have not been freed: e.g. a leak, or a buffer kept until a disable function
+  uint32_t currentBytes;
+} Swarm_M138_Alloc_Entry_Stats_t;
+
+class SWARM_M138_Alloc_Scope; // Records which public function is running. See SWARM_M138_ALLOC_ENTRY in the .cpp
+#endif
+
+#ifdef SWARM_M138_STATS
+/** Statistics */
+#define SWARM_M138_STATS_BUCKETS 13 ///< Response time histogram buckets: 0 ms, then 1, 2-3, 4-7 ... 1024-2047 ms, then >= 2048 ms
+#define SWARM_M138_STATS_TAGS 16    ///< The command tags: $CS, $DT, $FV, $GJ, $GN, $GP, $GS, $MM, $MT, $PO, $PW, $RS, $RT, $SL, $TD, then any other
+
+/** A struct to hold the statistics for one command tag. The counters stop at 65535 */
+typedef struct
+{
+  uint16_t count;            // Commands sent, including the timeouts
+  uint16_t timeouts;         // Commands which did not get a response
+  uint16_t errors;           // ERR replies
+  uint16_t checksumFailures; // Responses with a bad checksum
+  uint16_t histogram[SWARM_M138_STATS_BUCKETS]; // The response times. Bucket 0 is 0 ms, bucket n is 2^(n-1) to 2^n - 1 ms. Timeouts are not included
+} Swarm_M138_Command_Stats_t;
+
+/** A struct to hold a snapshot of the statistics. See getStats */
+typedef struct
+{
+  Swarm_M138_Command_Stats_t commands[SWARM_M138_STATS_TAGS]; // statsTag(i) returns the tag of commands[i]
+  uint32_t backlogOverflows;        // Received data discarded because the backlog was full
+  uint32_t responseOverflows;       // Commands whose response did not fit in responseDest
+  uint32_t eventChecksumFailures;   // Unsolicited messages discarded because of a bad checksum
+  uint32_t eventMemoryFailures;     // Unsolicited messages discarded because there was not enough memory to process them
+  unsigned long millisSinceReset;   // How long the statistics have been collected
+} Swarm_M138_Stats_t;
+#endif
+
+/** A struct to hold the response time estimate for one timeout class. See enableAdaptiveTimeouts */
+typedef struct
+{
+  unsigned long fixedTimeout; // The class: the fixed timeout the commands use (e.g. SWARM_M138_STANDARD_RESPONSE_TIMEOUT). 0 if the entry is unused
+  uint32_t srtt8;             // The smoothed response time (ms) x 8
+  uint32_t rttvar4;           // The mean deviation of the response time (ms) x 4
+  uint16_t samples;           // The number of responses learned from
+  uint8_t backoff;            // The timeout is doubled this many times: once for each consecutive timeout
+} Swarm_M138_Timeout_Class_t;
+
+/** The adaptive timeout state. Allocated by enableAdaptiveTimeouts */
+typedef struct
+{
+  Swarm_M138_Timeout_Class_t classes[SWARM_M138_ADAPTIVE_CLASSES];
+  unsigned long floor;
+  unsigned long ceiling;
+} Swarm_M138_Adaptive_Timeouts_t;
+
+/** Subscriptions: which unsolicited messages are kept */
+#define SWARM_M138_SUBSCRIBE(type) ((uint16_t)(1 << (type))) ///< The subscription bit for a Swarm_M138_Event_Type_e: e.g. SWARM_M138_SUBSCRIBE(SWARM_M138_EVENT_GEOSPATIAL)
+#define SWARM_M138_SUBSCRIBE_ALL ((uint16_t)((1 << (SWARM_M138_EVENT_TRANSMIT_DATA + 1)) - 2)) ///< Every unsolicited message type
+#define SWARM_M138_SUBSCRIBE_AUTO 0x8000 ///< The default: keep the messages which have a callback or are needed by a library feature
+
+/** The subscription sampling state. Allocated by setSubscriptionSampling */
+typedef struct
+{
+  uint16_t every[SWARM_M138_EVENT_TRANSMIT_DATA + 1]; // Keep every Nth message of each type. 1 keeps them all
+  uint16_t count[SWARM_M138_EVENT_TRANSMIT_DATA + 1]; // Messages seen since the last one kept. Framer only
+} Swarm_M138_Subscription_Sampling_t;
+
+#ifdef SWARM_M138_THREADS_AVAILABLE
+
+/** A lock-free single-producer / single-consumer ring. Holds up to N - 1 items */
+template <typename T, uint16_t N>
+class SWARM_M138_SPSC_Queue
+{
+public:
+  SWARM_M138_SPSC_Queue(void) : _head(0), _tail(0) {}
+
+  // Producer only. Return false if the queue is full
+  bool push(const T &item)
+  {
+    uint16_t head = _head.load(std::memory_order_relaxed);
+    uint16_t next = (uint16_t)((head + 1) % N);
+    if (next == _tail.load(std::memory_order_acquire))
+      return (false);
+    _items[head] = item;
+    _head.store(next, std::memory_order_release); // Publish the item
+    return (true);
+  }
+
+  // Consumer only. Return false if the queue is empty
+  bool pop(T &item)
+  {
+    uint16_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail == _head.load(std::memory_order_acquire))
+      return (false);
+    item = _items[tail];
+    _tail.store((uint16_t)((tail + 1) % N), std::memory_order_release); // Release the slot
+    return (true);
+  }
+
+  bool isEmpty(void) { return (_tail.load(std::memory_order_acquire) == _head.load(std::memory_order_acquire)); }
+
+private:
+  T _items[N];
+  std::atomic<uint16_t> _head; // Written by the producer
+  std::atomic<uint16_t> _tail; // Written by the consumer
+};
+
+/** A command posted to the reader task. The caller waits for done */
+#define SWARM_M138_REQUEST_SEND 0      ///< sendCommand
+#define SWARM_M138_REQUEST_WAIT 1      ///< waitForResponse
+#define SWARM_M138_REQUEST_SEND_WAIT 2 ///< sendCommandWithResponse
+#define SWARM_M138_REQUEST_SEND_ASYNC 3 ///< sendCommand. The response arrives as an event (coroutine command API)
+#define SWARM_M138_REQUEST_PAUSE 4      ///< Stop framing until the caller resumes the reader. See SWARM_M138_PAUSE_READER in the .cpp
+
+typedef struct
+{
+  uint8_t type; // SWARM_M138_REQUEST_SEND / _WAIT / _SEND_WAIT / _SEND_ASYNC / _PAUSE
+  const char *command;
+  const char *expectedResponseStart;
+  const char *expectedErrorStart;
+  char *responseDest;
+  size_t destSize;
+  unsigned long timeout;
+  Swarm_M138_Error_e result;
+  std::atomic<bool> done; // Set by the reader task when the request is complete
+} Swarm_M138_Command_Request_t;
+
+#endif
+
+#ifdef SWARM_M138_COROUTINES_AVAILABLE
+class SWARM_M138;
+
+/** Coroutine command API */
+#define SWARM_M138_COROUTINE_POOL_SLOTS 4    ///< The number of coroutine frames which can exist at once
+#define SWARM_M138_COROUTINE_FRAME_SIZE 1024 ///< The size of each frame (bytes). Each co_await uses ~120 bytes. A coroutine with a larger frame will not start
+
+// The coroutine frames come from a fixed pool, not the heap. Return NULL if there is no free frame
+void *swarm_m138_coroutine_alloc(size_t size);
+void swarm_m138_coroutine_free(void *frame);
+
+/** The return type of a coroutine which awaits the modem.
+ *  The coroutine runs immediately, up to its first co_await. It is resumed by checkUnsolicitedMsg
+ *  (or poll) when the result is available. Its frame is returned to the pool when it finishes */
+class SWARM_M138_Task
+{
+public:
+  struct promise_type
+  {
+    SWARM_M138_Task get_return_object(void) { return (SWARM_M138_Task(true)); }
+    static SWARM_M138_Task get_return_object_on_allocation_failure(void) { return (SWARM_M138_Task(false)); }
+    std::suspend_never initial_suspend(void) noexcept { return {}; }
+    std::suspend_never final_suspend(void) noexcept { return {}; }
+    void return_void(void) {}
+    void unhandled_exception(void) {}
+    static void *operator new(size_t size) noexcept { return (swarm_m138_coroutine_alloc(size)); }
+    static void operator delete(void *frame) { swarm_m138_coroutine_free(frame); }
+  };
+
+  bool valid(void) { return (_valid); } // Return false if there was no free frame. The coroutine did not run
+
+private:
+  explicit SWARM_M138_Task(bool valid) : _valid(valid) {}
+  bool _valid;
+};
+
+#define SWARM_M138_AWAIT_COMMAND 0        ///< commandAsync
+#define SWARM_M138_AWAIT_DATE_TIME 1      ///< getDateTimeAsync
+#define SWARM_M138_AWAIT_GEOSPATIAL 2     ///< getGeospatialInfoAsync
+#define SWARM_M138_AWAIT_MESSAGE_COUNT 3  ///< getRxMessageCountAsync and getUnsentMessageCountAsync
+#define SWARM_M138_AWAIT_TRANSMIT 4       ///< transmitTextAsync and transmitBinaryAsync
+#define SWARM_M138_AWAIT_LAST_COMMAND 4   ///< The kinds up to this one send a command
+#define SWARM_M138_AWAIT_EVENT 5          ///< nextEvent
+#define SWARM_M138_AWAIT_DELAY 6          ///< delayAsync
+
+/** The result of commandAsync, getDateTimeAsync etc.. co_await it from a SWARM_M138_Task.
+ *  co_await returns a Swarm_M138_Error_e */
+class SWARM_M138_Awaitable
+{
+public:
+  bool await_ready(void) { return (_ready); } // True if the result is already known. The coroutine does not suspend
+  void await_suspend(std::coroutine_handle<> handle);
+  Swarm_M138_Error_e await_resume(void) { return (_result); }
+
+  SWARM_M138_Awaitable(SWARM_M138_Awaitable &&other); // The command (if owned) moves with the awaitable
+  SWARM_M138_Awaitable(const SWARM_M138_Awaitable &) = delete;
+  ~SWARM_M138_Awaitable();
+
+private:
+  friend class SWARM_M138;
+  SWARM_M138_Awaitable(SWARM_M138 *swarm, uint8_t kind);
+
+  SWARM_M138 *_swarm;
+  SWARM_M138_Awaitable *_next;       // The next suspended awaiter
+  std::coroutine_handle<> _handle;   // The suspended coroutine
+  uint8_t _kind;                     // SWARM_M138_AWAIT_COMMAND etc.
+  bool _ready;                       // The result is known. Resume the coroutine
+  bool _sent;                        // The command has been sent
+  Swarm_M138_Error_e _result;
+  unsigned long _start;              // millis() when the command was sent or the delay started
+  unsigned long _timeout;
+  const char *_command;              // NULL for _DATE_TIME, _GEOSPATIAL and _MESSAGE_COUNT: the command is in _commandBuffer
+  bool _commandOwned;                // _command was allocated for _TRANSMIT. Freed by the destructor
+  const char *_expectedResponseStart;
+  const char *_expectedErrorStart;
+  char *_responseDest;
+  size_t _destSize;
+  void *_out;                        // Swarm_M138_DateTimeData_t, Swarm_M138_GeospatialData_t, uint16_t (count), uint64_t (msg_id) or Swarm_M138_Event_t
+  Swarm_M138_Event_Type_e _eventType;
+  char _commandBuffer[12];           // e.g. "$DT @*" plus the checksum, LF and null
+};
+#endif
+
+/** Byte transport interface. Implement this to talk to the modem over something other than a HardwareSerial,
+ *  e.g. a Linux serial port, a pipe or an in-memory loopback. See extras/host for the host build */
+class SWARM_M138_Transport
+{
+public:
+  virtual ~SWARM_M138_Transport() {}
+  virtual size_t write(const uint8_t *data, size_t len) = 0; // Write len bytes. Return the number of bytes written
+  virtual int available(void) = 0;                           // Return the number of bytes which can be read without blocking. -1 on error
+  virtual int read(uint8_t *data, size_t len) = 0;           // Read up to len bytes without blocking. Return the number of bytes read. -1 on error
+  virtual void begin(unsigned long baud) {}                  // Optional: (re)open the port at baud
+};
+
 /** Communication interface for the Swarm M138 satellite modem. */
 class SWARM_M138
 {
@@ -275,6 +966,7 @@ public:
   bool begin(SoftwareSerial &softSerial);
 #endif
   bool begin(HardwareSerial &hardSerial);
+  bool begin(SWARM_M138_Transport &transport);
   bool begin(byte deviceAddress = SFE_QWIIC_SWARM_DEFAULT_I2C_ADDRESS, TwoWire &wirePort = Wire);
 
   /** Debug prints */
@@ -350,6 +1042,29 @@ public:
   Swarm_M138_Error_e readMessage(uint64_t msg_id, char *asciiHex, size_t len, uint32_t *epoch = NULL, uint16_t *appID = NULL);        // Read the message with ID. Message contents are copied to asciiHex as ASCII Hex
   Swarm_M138_Error_e readOldestMessage(char *asciiHex, size_t len, uint64_t *msg_id, uint32_t *epoch = NULL, uint16_t *appID = NULL); // Read the oldest message. Message contents are copied to asciiHex. ID is copied to id.
   Swarm_M138_Error_e readNewestMessage(char *asciiHex, size_t len, uint64_t *msg_id, uint32_t *epoch = NULL, uint16_t *appID = NULL); // Read the oldest message. Message contents are copied to asciiHex. ID is copied to id.
+  Swarm_M138_Error_e drainRxMessages(void (*swarmDrainCallback)(const uint8_t *data, size_t len, const uint64_t *msg_id, const uint32_t *epoch, const uint16_t *appID),
+                                     uint16_t maxCount = 0xFFFF, uint16_t *drained = NULL, bool deleteWhenDone = false);                  // Read all unread messages (oldest first). Each is passed to the callback as binary
+
+  /** RX Batch - collect mark / delete intents and send them together */
+  // The intents are sent back-to-back. They are never collapsed into markAllRxMessages / deleteAllRxMessages
+  // The batch is flushed by flushRxBatch, when it is full, or (if autoFlush is true) by checkUnsolicitedMsg when the modem is idle,
+  // at most once every SWARM_M138_RX_BATCH_AUTOFLUSH_INTERVAL ms
+  bool enableRxBatch(uint16_t maxEntries = SWARM_M138_RX_BATCH_DEFAULT_SIZE, bool autoFlush = true); // Allocate storage for the batch
+  void disableRxBatch(void);                                                                         // Discard any pending intents and free the storage
+  Swarm_M138_Error_e queueMarkRxMessage(uint64_t msg_id);                                            // Add a mark intent to the batch
+  Swarm_M138_Error_e queueDeleteRxMessage(uint64_t msg_id, bool read = false);                      // Add a delete intent to the batch. Set read to true if the message has been read
+  Swarm_M138_Error_e flushRxBatch(void);                                                             // Send the pending intents to the modem
+  uint16_t getRxBatchCount(void);                                                                    // Return the number of pending intents
+
+  /** RX Duplicate Filter - suppress messages which have been seen before */
+  // A ring of (appID, epoch, payload hash) fingerprints. Checked before the $RD callback and before the drainRxMessages callback only.
+  // readMessage / readOldestMessage / readNewestMessage are not filtered
+  // $RD messages do not include the epoch: they are fingerprinted with epoch 0, which only matches another $RD
+  bool enableRxDedup(uint16_t maxEntries = SWARM_M138_RX_DEDUP_DEFAULT_SIZE, SWARM_M138_Storage *storage = NULL); // Allocate the filter. Reload the fingerprints from storage if provided
+  void disableRxDedup(void);                                                                                     // Free the filter
+  bool clearRxDedup(void);                                                                                       // Forget all fingerprints (and clear the storage)
+  bool checkRxDuplicate(uint16_t appID, uint32_t epoch, const uint8_t *data, size_t len);                        // Return true if the message has been seen before. Otherwise remember it and return false
+  uint32_t getRxDuplicateCount(void);                                                                            // Return the number of duplicates suppressed
 
   /** Messages To Transmit Management */
   Swarm_M138_Error_e getUnsentMessageCount(uint16_t *count);                                                                     // Return count of all unsent messages
@@ -358,6 +1073,17 @@ public:
   Swarm_M138_Error_e listTxMessage(uint64_t msg_id, char *asciiHex, size_t len, uint32_t *epoch = NULL, uint16_t *appID = NULL); // List unsent message with ID
   //Swarm_M138_Error_e listTxMessagesIDs(uint64_t *ids, uint16_t maxCount); // List the IDs of all unsent messages. ** Not supported with modem firmware >= v2.0.0 **
 
+  /** TX Queue Mirror - a library-maintained shadow of the modem's transmit queue */
+  // Entries are added on $TD OK and removed on $TD SENT, deleteTxMessage and deleteAllTxMessages
+  // $TD SENT messages are processed by checkUnsolicitedMsg, so call it regularly
+  bool enableTxQueueMirror(uint16_t maxEntries = SWARM_M138_TX_MIRROR_DEFAULT_SIZE); // Allocate storage for the mirror and start tracking
+  void disableTxQueueMirror(void);                                                   // Stop tracking and free the storage
+  uint16_t getTxQueueDepth(void);                                                    // Return the number of unsent messages - without talking to the modem
+  uint16_t getTxQueueMirrorIDs(uint64_t *ids, uint16_t maxCount);                    // Copy the IDs of the tracked unsent messages into ids (oldest first). Returns the number copied
+  bool isTxMessagePending(uint64_t msg_id);                                          // Return true if the message is in the mirror
+  Swarm_M138_Error_e syncTxQueueMirror(void);                                        // Resynchronise the mirror with the modem
+  void getTxQueueLatency(Swarm_M138_TX_Latency_t *latency);                          // Get the enqueue-to-sent latency of the tracked messages
+
   /** Transmit Data */
   // The application ID is optional. Valid appID's are: 0 to 64999. Swarm reserves use of 65000 - 65535.
   Swarm_M138_Error_e transmitText(const char *data, uint64_t *msg_id);                                                        // Send ASCII string. Assigned message ID is returned in id.
@@ -373,6 +1099,201 @@ public:
   Swarm_M138_Error_e transmitBinaryExpire(const uint8_t *data, size_t len, uint64_t *msg_id, uint32_t epoch);                 // Send binary data. Assigned message ID is returned in id. Expire message at epoch
   Swarm_M138_Error_e transmitBinaryExpire(const uint8_t *data, size_t len, uint64_t *msg_id, uint32_t epoch, uint16_t appID); // Send binary data. Assigned message ID is returned in id. Expire message at epoch
 
+  /** Outbox - a host-persistent extension of the modem's transmit queue */
+  // Messages are appended to a CRC-protected log in storage, then trickled into the modem by serviceOutbox
+  bool beginOutbox(SWARM_M138_Storage *storage, uint16_t highWater = SWARM_M138_OUTBOX_DEFAULT_HIGH_WATER); // Attach the storage and recover any pending messages
+  void endOutbox(void);                                                                                    // Detach the storage. Pending messages remain in the log
+  Swarm_M138_Error_e outboxBinary(const uint8_t *data, size_t len);                                        // Add binary data to the outbox
+  Swarm_M138_Error_e outboxBinary(const uint8_t *data, size_t len, uint16_t appID);                        // Add binary data to the outbox
+  Swarm_M138_Error_e serviceOutbox(void);                                                                  // Move messages from the outbox into the modem. Call this regularly
+  uint32_t getOutboxCount(void);                                                                           // Return the number of messages waiting in the outbox
+
+  /** Record Packer - aggregate many small records into one packet */
+  // Each record is packed as: type (1 byte), length (1 byte), data (length bytes)
+  // The packet is transmitted (or added to the outbox, if in use) when it is full, when the oldest record reaches maxAge, or by flushPacker
+  bool enablePacker(unsigned long maxAge = SWARM_M138_PACKER_DEFAULT_MAX_AGE);                  // Allocate the packet buffer. maxAge is in milliseconds. 0 disables the age check
+  bool enablePacker(unsigned long maxAge, uint16_t appID);                                      // Allocate the packet buffer. Packets are sent with appID
+  void disablePacker(void);                                                                     // Discard any packed records and free the buffer
+  Swarm_M138_Error_e packRecord(uint8_t type, const uint8_t *data, uint8_t len);                // Add a record to the packet. Only SUCCESS means it was packed
+  Swarm_M138_Error_e flushPacker(void);                                                         // Send the packet now
+  size_t getPackerLength(void);                                                                 // Return the number of bytes in the packet
+  Swarm_M138_Error_e getPackerFlushError(void);                                                 // Return the result of the most recent attempt to send the packet
+  Swarm_M138_Error_e unpackRecords(const uint8_t *packet, size_t len,
+                                   void (*swarmRecordCallback)(uint8_t type, const uint8_t *data, uint8_t len)); // Split a packet into records. Call the callback for each
+
+  /** Payload Compression */
+  // The first byte of a compressed payload is the mode: SWARM_M138_COMPRESS_MODE_RAW / _LZSS / _SERIES
+  // compressPayload falls back to raw if compression does not help. outLen holds the size of out on entry, the compressed length on exit
+  // setRxDecompression only applies to drainRxMessages. The $RD callback and readMessage / readOldestMessage / readNewestMessage
+  // return the payload as received (ASCII Hex): a decompressed payload may not fit their buffers. Pass it to decompressPayload instead
+  Swarm_M138_Error_e compressPayload(const uint8_t *in, size_t inLen, uint8_t *out, size_t *outLen);                // LZSS compress binary data or text
+  Swarm_M138_Error_e compressSeries(const int32_t *values, uint16_t count, uint8_t *out, size_t *outLen);            // Delta / varint compress a numeric series
+  Swarm_M138_Error_e decompressPayload(const uint8_t *in, size_t inLen, uint8_t *out, size_t *outLen);              // Decompress any mode. A series is returned as little-endian int32_t
+  Swarm_M138_Error_e transmitCompressed(const uint8_t *data, size_t len, uint64_t *msg_id);                         // Compress and send binary data. Assigned message ID is returned in id.
+  Swarm_M138_Error_e transmitCompressed(const uint8_t *data, size_t len, uint64_t *msg_id, uint16_t appID);         // Compress and send binary data. Assigned message ID is returned in id.
+  void setRxDecompression(bool enable, uint16_t appID = 0);                                                         // drainRxMessages (only) will decompress messages with this appID before calling the callback
+
+  /** Fragmentation and Reassembly - for payloads larger than one packet */
+  // Each fragment is sent with appID SWARM_M138_FRAGMENT_APPID_BASE + channel and starts with: key, index, count
+  // Missing-fragment bitmaps are SWARM_M138_FRAGMENT_BITMAP_LENGTH bytes: bit (index % 8) of byte (index / 8) is set if fragment index is missing
+  Swarm_M138_Error_e transmitFragmented(const uint8_t *data, size_t len, uint8_t *key, uint16_t channel = 0);                      // Split data into fragments and queue them. The message key is returned in key
+  Swarm_M138_Error_e retransmitFragments(const uint8_t *data, size_t len, uint8_t key, const uint8_t *missing, uint16_t channel = 0); // Queue only the fragments flagged in the missing bitmap
+  bool enableReassembly(size_t maxLength, unsigned long timeout = SWARM_M138_REASSEMBLY_DEFAULT_TIMEOUT);                            // Allocate the reassembly buffer. $RD fragments are then reassembled
+  void disableReassembly(void);                                                                                                      // Discard any partial message and free the buffer
+  bool feedFragment(uint16_t appID, const uint8_t *data, size_t len);                                                                // Pass a received message to the reassembler. Returns true if it was a fragment
+  uint8_t getMissingFragments(uint8_t *missing);                                                                                      // Fill the bitmap for the partial message. Returns the number of missing fragments
+  void setReassembledCallback(void (*swarmReassembledCallback)(const uint8_t *data, size_t len, uint8_t key, uint16_t channel));      // Called when a message is complete
+  void setFragmentTimeoutCallback(void (*swarmFragmentTimeoutCallback)(uint8_t key, uint16_t channel, uint8_t count, const uint8_t *missing)); // Called when a partial message times out
+
+  /** Priority Transmit Scheduler - alarm / telemetry / bulk */
+  // Messages wait in the scheduler and are moved into the modem (highest priority first) by serviceTxScheduler
+  // At most modemWindow unsent messages are kept in the modem. Lower priority messages are deleted from the modem
+  // (deleteTxMessage) and rescheduled to make way for higher priority messages. Alarms always go to the front
+  // The scheduler uses the TX queue mirror to see which messages have been sent, so call checkUnsolicitedMsg regularly
+  bool enableTxScheduler(uint8_t maxEntries = SWARM_M138_TX_SCHEDULER_DEFAULT_SIZE, uint8_t modemWindow = SWARM_M138_TX_SCHEDULER_DEFAULT_WINDOW); // Allocate the scheduler. Enables the TX queue mirror if required
+  void disableTxScheduler(void);                                                                                 // Discard the waiting messages and free the scheduler. Messages already in the modem are not deleted
+  bool setTxPriorityPolicy(Swarm_M138_TX_Priority_e priority, uint32_t hold, unsigned long maxAge);             // Set the hold duration (seconds) and maximum waiting age (ms) for a priority class. Call after enableTxScheduler
+  Swarm_M138_Error_e scheduleBinary(const uint8_t *data, size_t len, Swarm_M138_TX_Priority_e priority);        // Schedule binary data for transmission
+  Swarm_M138_Error_e scheduleBinary(const uint8_t *data, size_t len, Swarm_M138_TX_Priority_e priority, uint16_t appID); // Schedule binary data for transmission
+  Swarm_M138_Error_e serviceTxScheduler(void);                                                                   // Move messages into the modem. Call this regularly
+  uint8_t getScheduledCount(Swarm_M138_TX_Priority_e priority);                                                  // Return the number of unsent messages of this priority (waiting or in the modem)
+
+#ifdef SWARM_M138_THREADS_AVAILABLE
+  /** Threaded Mode - ESP32 (FreeRTOS) and host (std::thread) only */
+  // A reader task owns the serial port. It frames the unsolicited messages into events and pushes them into a lock-free queue.
+  // Commands are posted to the reader task through a second queue; the caller blocks until the response arrives.
+  // checkUnsolicitedMsg pops the events and calls the callbacks in the caller's task, never in the I/O path.
+  // Commands and checkUnsolicitedMsg must all be called from one task (the queues are single-producer / single-consumer)
+  // The reader task reads the callbacks, the typed event queue, the subscriptions and the URC handlers. Changing them pauses the reader
+  bool beginThreadedMode(uint32_t stackSize = SWARM_M138_READER_STACK_SIZE, uint8_t priority = 1); // Start the reader task
+  void endThreadedMode(void);                                                                        // Stop the reader task. Any queued events are discarded
+  bool isThreadedMode(void);                                                                         // Return true if the reader task is running
+  bool popEvent(Swarm_M138_Event_t *event);                                                          // Pop the next event without calling the callbacks. Return false if there are none
+  uint32_t getEventDropCount(void);                                                                  // Return the number of events discarded because the queue was full
+#endif
+
+  /** Interrupt / DMA Receive Path */
+  // Your UART RX interrupt, DMA half/complete interrupt or UART event task passes the received bytes to feedRxByte(s).
+  // They go into a ring buffer which the library reads instead of the serial port. Commands are still sent through the serial port.
+  // See Example31_InterruptReceive for ESP32 (UART events) and SAMD (SERCOM) reference implementations. On the host, SWARM_M138_RX_Simulator
+  // in extras/host plays the part of the interrupt
+  bool enableRxHook(uint16_t bufferSize = SWARM_M138_RX_HOOK_DEFAULT_SIZE); // Allocate the ring buffer and read from it instead of the serial port
+  void disableRxHook(void);                                                  // Go back to reading the serial port. Any unread bytes are discarded
+  SWARM_M138_ISR_ATTR void feedRxByte(uint8_t c);                            // Interrupt-safe: add one received byte to the ring buffer
+  SWARM_M138_ISR_ATTR void feedRxBytes(const uint8_t *data, size_t len);     // Interrupt-safe: add received bytes to the ring buffer
+  uint32_t getRxDroppedBytes(void);                                          // Return the number of bytes discarded because the ring buffer was full
+  uint16_t getRxHighWater(void);                                             // Return the highest number of bytes which have been waiting in the ring buffer
+
+  /** Backlog - the sentences which arrive while a command is waiting for its response. checkUnsolicitedMsg processes them */
+  uint16_t getBacklogLength(void);    // Return the number of bytes waiting in the backlog
+  uint16_t getBacklogHighWater(void); // Return the highest number of bytes which have been waiting in the backlog
+  uint32_t getBacklogOverflows(void); // Return the number of times received bytes were not copied into the backlog because it was full
+  void resetBacklogStats(void);       // Reset the high water mark and the overflow count
+
+  /** Receive Window - how long checkUnsolicitedMsg and sendCommand wait for the rest of a burst of serial data */
+  // SWARM_M138_RX_WINDOW_GAP returns as soon as the data read so far ends with \n and nothing more is waiting.
+  // Otherwise it waits until nothing has arrived for the time taken to receive fifoThreshold + 2 bytes at the baud rate
+  void setRxWindowMode(Swarm_M138_RX_Window_e mode, uint16_t fifoThreshold = SWARM_M138_RX_FIFO_THRESHOLD); // Select the mode
+  Swarm_M138_RX_Window_e getRxWindowMode(void);                                                              // Return the mode
+  unsigned long getRxGapMicros(void);                                                                        // Return the inter-byte gap used by SWARM_M138_RX_WINDOW_GAP (microseconds)
+
+#ifdef SWARM_M138_ALLOC_HOOKS
+  /** Allocation Hooks - enable with SWARM_M138_ALLOC_HOOKS */
+  // Every buffer the library allocates comes from the allocator, except the threaded mode's queues and thread.
+  // Each block is freed by the allocator which allocated it, so the allocator can be changed at any time.
+  // In threaded mode, the allocator must be thread-safe.
+  // getAllocEntryStats splits the counters by the public function which allocated each block: the outermost one, so a command
+  // sent from a callback counts against e.g. checkUnsolicitedMsg. In threaded mode, the reader task's allocations count against the waiting function
+  void setAllocator(void *(*allocate)(size_t size, void *context), void (*release)(void *ptr, size_t size, void *context), void *context = NULL); // NULL, NULL restores new / delete
+  void getAllocStats(Swarm_M138_Alloc_Stats_t *stats); // Copy the counters
+  uint8_t getAllocEntryStats(Swarm_M138_Alloc_Entry_Stats_t *stats, uint8_t maxEntries); // Copy the counters for each public function which has allocated. Return the number copied
+  void resetAllocStats(void);                          // Zero the counters. The peak restarts from the current level. Functions with no live blocks lose their entries
+#endif
+
+  /** Wire Trace - record every byte sent to and received from the modem, with a timestamp in microseconds */
+  // The trace is binary: SWARM_M138_TRACE_MAGIC, then records of SWARM_M138_TRACE_RECORD_HEADER bytes followed by the data.
+  // Record into a RAM ring buffer and dump it when something goes wrong, or stream the records to a Print (e.g. an SD card File).
+  // extras/host/swarm_replay plays a trace back into the library with the original timing.
+  // In threaded mode, the reader task records the trace: call dumpTrace after endThreadedMode
+  bool enableTrace(size_t bufferSize = SWARM_M138_TRACE_DEFAULT_SIZE); // Allocate the ring buffer and start recording into it. The oldest records are discarded
+  void enableTrace(Print &tracePort);                                  // Write the magic, then each record to tracePort as it happens
+  void disableTrace(void);                                             // Stop recording. Free the ring buffer
+  size_t dumpTrace(Print &port);                                       // Write the magic and the records in the ring buffer, oldest first. Return the number of bytes written
+  uint32_t getTraceDropCount(void);                                    // Return the number of records discarded from the ring buffer, or not written in full to the trace port
+
+  /** Adaptive Timeouts */
+  // Each command class (each fixed timeout, e.g. SWARM_M138_STANDARD_RESPONSE_TIMEOUT) learns its response time like TCP:
+  // timeout = smoothed response time + 4 x mean deviation, between floor and ceiling, doubled after each timeout.
+  // The learned timeout only applies while the modem is silent. Once any data arrives, the command waits for the ceiling
+  // (or the fixed timeout), so a busy modem does not cause false timeouts but a dead one is detected quickly.
+  // In threaded mode, call these before beginThreadedMode
+  bool enableAdaptiveTimeouts(unsigned long floorMillis = SWARM_M138_ADAPTIVE_TIMEOUT_FLOOR, unsigned long ceilingMillis = 0); // Allocate the estimates. Each class's ceiling is the longer of ceilingMillis and its fixed timeout
+  void disableAdaptiveTimeouts(void);                              // Go back to the fixed timeouts. Free the estimates
+  void resetAdaptiveTimeouts(void);                                // Forget what has been learned. E.g. after the modem restarts
+  unsigned long getAdaptiveTimeout(unsigned long fixedTimeout);    // Return the timeout a silent modem would get now, for the class which uses fixedTimeout
+
+#ifdef SWARM_M138_STATS
+  /** Statistics - enable with SWARM_M138_STATS */
+  // A response time histogram and error counters for each command tag, e.g. to choose the command timeouts or to send as telemetry
+  void getStats(Swarm_M138_Stats_t *stats); // Copy the statistics
+  void resetStats(void);                    // Zero the statistics
+  const char *statsTag(uint8_t index);      // Return the command tag for stats->commands[index], e.g. "$DT". "$??" for the others
+#endif
+
+#ifdef SWARM_M138_COROUTINES_AVAILABLE
+  /** Coroutine Command API - C++20 only */
+  // co_await the modem from a coroutine which returns SWARM_M138_Task. checkUnsolicitedMsg (or poll) resumes each coroutine
+  // when its result arrives, so one loop can run several coroutines without blocking. The commands are sent one at a time, in order.
+  // Blocking commands can still be used, but not in threaded mode while an async command is in flight. See Example32_Coroutines
+  SWARM_M138_Awaitable commandAsync(char *command, const char *expectedResponseStart, const char *expectedErrorStart,
+                                    char *responseDest, size_t destSize,
+                                    unsigned long timeout = SWARM_M138_STANDARD_RESPONSE_TIMEOUT); // Send a command. Copy the response sentence into responseDest
+  SWARM_M138_Awaitable getDateTimeAsync(Swarm_M138_DateTimeData_t *dateTime);                       // Get the most recent $DT message
+  SWARM_M138_Awaitable getGeospatialInfoAsync(Swarm_M138_GeospatialData_t *info);                   // Get the most recent $GN message
+  SWARM_M138_Awaitable getRxMessageCountAsync(uint16_t *count, bool unread = false);                 // $MM C=: count all messages (default) or unread messages
+  SWARM_M138_Awaitable getUnsentMessageCountAsync(uint16_t *count);                                  // $MT C=U: count the unsent messages
+  SWARM_M138_Awaitable transmitTextAsync(const char *data, uint64_t *msg_id);                        // $TD: send ASCII string. Assigned message ID is returned in msg_id
+  SWARM_M138_Awaitable transmitTextAsync(const char *data, uint64_t *msg_id, uint16_t appID);        // $TD: send ASCII string. Assigned message ID is returned in msg_id
+  SWARM_M138_Awaitable transmitBinaryAsync(const uint8_t *data, size_t len, uint64_t *msg_id);       // $TD: send binary data. Assigned message ID is returned in msg_id
+  SWARM_M138_Awaitable transmitBinaryAsync(const uint8_t *data, size_t len, uint64_t *msg_id, uint16_t appID); // $TD: send binary data with an appID
+  SWARM_M138_Awaitable nextEvent(Swarm_M138_Event_Type_e type, Swarm_M138_Event_t *event = NULL);   // Wait for the next unsolicited message of this type
+  SWARM_M138_Awaitable delayAsync(unsigned long ms);                                                 // Wait for ms milliseconds
+  bool poll(void);                                                                                   // Process unsolicited messages and resume coroutines. Same as checkUnsolicitedMsg
+  uint8_t getCoroutineFramesInUse(void);                                                             // Return the number of pool frames in use
+#endif
+
+  /** Typed Event Queue */
+  // An alternative to the callbacks: checkUnsolicitedMsg parses each unsolicited message into a fixed-size queue of tagged unions.
+  // The application pops them at its own pace, outside checkUnsolicitedMsg, so it can call library commands and do slow work
+  // (e.g. SD card writes) without delaying the parser. The callbacks are still called if they are set
+  bool enableTypedEvents(uint8_t depth = SWARM_M138_TYPED_EVENT_DEFAULT_DEPTH,
+                         Swarm_M138_Queue_Overflow_e policy = SWARM_M138_OVERFLOW_DROP_OLDEST); // Allocate the queue
+  void disableTypedEvents(void);                                // Free the queue. Any waiting events are discarded
+  bool popTypedEvent(Swarm_M138_Typed_Event_t *event);          // Pop the oldest event. Return false if there are none
+  uint8_t getTypedEventCount(void);                             // Return the number of events waiting
+  uint32_t getTypedEventDrops(void);                            // Return the number of events discarded because the queue was full
+  uint8_t getTypedEventHighWater(void);                         // Return the highest number of events which have been waiting
+  void clearTypedEvents(void);                                  // Discard any waiting events. Reset the counters
+
+  /** Subscriptions */
+  // Unsolicited messages which are not subscribed are dropped as soon as their tag is known: before they are buffered, checksummed or parsed.
+  // In threaded mode the reader task discards them byte by byte. By default (SWARM_M138_SUBSCRIBE_AUTO) only the backlog is filtered.
+  // Whatever the mask, $TD is kept while the TX queue mirror, scheduler or outbox is in use, and $RD while reassembly or the duplicate filter is
+  void setSubscriptions(uint16_t mask);                                          // Keep only these message types: e.g. SWARM_M138_SUBSCRIBE(SWARM_M138_EVENT_DATE_TIME) | ...
+  uint16_t getSubscriptions(void);                                               // Return the types which are being kept (the automatic mask, or the explicit mask plus any the library needs)
+  bool setSubscriptionSampling(Swarm_M138_Event_Type_e type, uint16_t everyNth); // Keep only every Nth message of this type. 1 keeps them all
+  uint32_t getFilteredCount(void);                                               // Return the number of messages dropped by the subscriptions
+
+  /** URC Handler Registry - parse undocumented and future unsolicited messages without changing the library */
+  // Each handler is registered for a prefix, e.g. "$XY" or "$M138 GNSS", and is called (before the built-in parser) for each
+  // message which starts with it. The prefix must start with a complete tag: "$XY" does not match "$XYZ". The longest matching prefix wins. Return true from the handler if it has dealt with the message,
+  // false to let the built-in parser see it too. Messages whose tag has a handler are always kept: by the subscriptions and in the backlog.
+  // In threaded mode, the handlers can be changed at any time: the reader task is paused while the table is updated
+  bool enableUrcHandlers(uint8_t maxHandlers = SWARM_M138_URC_HANDLERS_DEFAULT_SIZE); // Allocate the table. registerUrcHandler calls this if required
+  void disableUrcHandlers(void);                                                      // Unregister all of the handlers and free the table
+  bool registerUrcHandler(const char *prefix, bool (*handler)(const Swarm_M138_Line_View_t *line, void *context), void *context = NULL); // Replaces any handler with the same prefix. Return false if the prefix is invalid or the table is full
+  bool unregisterUrcHandler(const char *prefix);                                      // Return false if the prefix was not registered
+
   /**  Process unsolicited messages from the modem. Call the callbacks if required */
   bool checkUnsolicitedMsg(void);
 
@@ -387,6 +1308,7 @@ public:
   void setSleepWakeCallback(void (*swarmSleepWakeCallback)(Swarm_M138_Wake_Cause_e cause));                                                                                       // Set callback for $SL WAKE
   void setModemStatusCallback(void (*swarmModemStatusCallback)(Swarm_M138_Modem_Status_e status, const char *data));                                                              // Set callback for $M138. data could be NULL for messages like BOOT_RUNNING
   void setTransmitDataCallback(void (*swarmTransmitDataCallback)(const int16_t *rssi_sat, const int16_t *snr, const int16_t *fdev, const uint64_t *msg_id));                      // Set callback for $TD SENT
+  void setRawLineCallback(void (*swarmRawLineCallback)(const Swarm_M138_Line_View_t *line));                                                                                      // Set callback for every unsolicited message, before it is parsed. Copy the data to keep it
 
   /** Convert modem status enum etc. into printable text */
   const char *modemStatusString(Swarm_M138_Modem_Status_e status);
@@ -402,6 +1324,7 @@ private:
 #ifdef SWARM_M138_SOFTWARE_SERIAL_ENABLED
   SoftwareSerial *_softSerial;
 #endif
+  SWARM_M138_Transport *_transport; // Used instead of a serial port when not NULL
 
   unsigned long _baud; // Baud rate for serial communication with the modem
 
@@ -429,6 +1352,208 @@ private:
   void (*_swarmSleepWakeCallback)(Swarm_M138_Wake_Cause_e cause);
   void (*_swarmModemStatusCallback)(Swarm_M138_Modem_Status_e status, const char *data);
   void (*_swarmTransmitDataCallback)(const int16_t *rssi_sat, const int16_t *snr, const int16_t *fdev, const uint64_t *id);
+  void (*_swarmRawLineCallback)(const Swarm_M138_Line_View_t *line);
+
+  // TX queue mirror
+  Swarm_M138_TX_Mirror_t *_txMirror; // Allocated by enableTxQueueMirror. NULL if the mirror is disabled
+  void txMirrorAdd(uint64_t msg_id);                   // Add a newly queued message to the mirror
+  bool txMirrorRemove(uint64_t msg_id, bool wasSent); // Remove a message from the mirror. Update the latency if wasSent is true
+
+  // RX batch
+  Swarm_M138_RX_Batch_t *_rxBatch; // Allocated by enableRxBatch. NULL if the batch is disabled
+  Swarm_M138_Error_e rxBatchQueue(uint64_t msg_id, uint8_t flags);                              // Add (or merge) an intent
+  Swarm_M138_Error_e rxBatchSendOne(uint64_t msg_id, bool del, char *command, char *response); // Send a single $MM M= or $MM D= command
+
+  // RX duplicate filter
+  Swarm_M138_RX_Dedup_t *_rxDedup; // Allocated by enableRxDedup. NULL if the filter is disabled
+  void rxDedupInsert(uint32_t hash, uint32_t epoch, bool persist); // Add a fingerprint to the ring (and storage)
+  bool rxDedupCompact(void);                                       // Rewrite the storage with the contents of the ring
+  uint32_t rxDedupHash(uint16_t appID, const uint8_t *data, size_t len); // FNV-1a hash of the appID and payload
+
+  // Outbox
+  Swarm_M138_Outbox_t *_outbox;   // Allocated by beginOutbox. NULL if the outbox is not in use
+  Swarm_M138_Error_e outboxAppend(uint8_t flags, const uint8_t *data, uint16_t len, uint16_t appID, uint32_t seq); // Append a record to the log
+  bool outboxReadRecord(uint32_t *offset, uint8_t *flags, uint8_t *data, uint16_t *len, uint16_t *appID, uint32_t *seq); // Read the next valid record at or after offset
+  bool outboxCompact(void);        // Remove the sent records from the front of the log
+  uint16_t outboxCRC(const uint8_t *data, uint16_t len, uint16_t crc = 0xFFFF); // CRC-16/CCITT
+
+  // Record packer
+  Swarm_M138_Packer_t *_packer;   // Allocated by enablePacker. NULL if the packer is disabled
+
+  // Payload compression
+  bool _rxDecompress;             // Set by setRxDecompression
+  uint16_t _rxDecompressAppID;
+
+  // drainRxMessages
+  char *_drainResponse;           // The drain's response buffer while a pipelined $MM R=O is in flight and the callback is running. Else NULL
+  bool _drainResponseReady;       // True if a command in the callback has read the response into it
+  Swarm_M138_Error_e _drainResponseErr;
+  void collectDrainResponse(void); // Read the in-flight response (if any) before a command is sent
+  uint8_t compressorDictionaryByte(uint16_t index); // Read a byte from the static dictionary (PROGMEM)
+
+  // Fragmentation and reassembly
+  uint8_t _fragmentNextKey;          // The key for the next fragmented message
+  bool _fragmentKeySeeded;           // False until the first key has been seeded from micros()
+  Swarm_M138_Reassembly_t *_reassembly; // Allocated by enableReassembly. NULL if reassembly is disabled
+  void (*_swarmReassembledCallback)(const uint8_t *data, size_t len, uint8_t key, uint16_t channel);
+  void (*_swarmFragmentTimeoutCallback)(uint8_t key, uint16_t channel, uint8_t count, const uint8_t *missing);
+  Swarm_M138_Error_e transmitFragmentsInternal(const uint8_t *data, size_t len, uint8_t key, const uint8_t *missing, uint16_t channel);
+  void checkReassemblyTimeout(void);                                    // Discard a partial message if it has timed out
+  size_t hexToBinary(const char *asciiHex, uint8_t *data, size_t maxLen); // Convert ASCII Hex to binary. Stops at the first non-hex character
+
+  // Priority transmit scheduler
+  Swarm_M138_TX_Scheduler_t *_txScheduler; // Allocated by enableTxScheduler. NULL if the scheduler is disabled
+  int txSchedulerNext(void);                                // Return the index of the highest priority (then oldest) waiting message. -1 if there are none
+  Swarm_M138_Error_e txSchedulerEvict(uint8_t priority, bool all); // Delete lower priority messages from the modem and reschedule them
+
+#ifdef SWARM_M138_THREADS_AVAILABLE
+  // Threaded mode
+  SWARM_M138_SPSC_Queue<Swarm_M138_Event_t, SWARM_M138_EVENT_QUEUE_DEPTH> *_eventQueue;                 // Reader -> caller. NULL if threaded mode is not active
+  SWARM_M138_SPSC_Queue<Swarm_M138_Command_Request_t *, SWARM_M138_COMMAND_QUEUE_DEPTH> *_commandQueue; // Caller -> reader
+  Swarm_M138_Event_t *_dispatchEvent; // checkUnsolicitedMsg pops each event into here
+  char *_readerLine;                  // The partial sentence being assembled by the reader task
+  size_t _readerLineLength;
+  bool _readerAwaitingResponse;       // A command has been sent but its response has not been read yet. Leave the port alone
+  unsigned long _readerSentAt;
+  std::atomic<bool> _readerRun;       // Cleared by endThreadedMode to stop the reader
+  std::atomic<bool> _readerRunning;   // Cleared by the reader when it exits
+  std::atomic<bool> _readerPaused;    // The reader waits while this is set. See SWARM_M138_PAUSE_READER
+  uint8_t _readerPauseDepth;          // The number of nested SWARM_M138_PAUSE_READER scopes. Only the outermost one pauses the reader
+  std::atomic<uint32_t> _eventDrops;
+  bool _readerLineChecked;            // The tag of the reader line has been checked against the subscriptions
+  bool _readerLineDiscard;            // The reader line is not subscribed. Discard it up to the \n
+#ifdef SWARM_M138_THREADS_FREERTOS
+  TaskHandle_t _readerTask;
+  static void readerTaskEntry(void *param);
+#else
+  std::thread *_readerThread;
+#endif
+  bool inReaderTask(void);                        // Return true if called from the reader task
+  bool readerService(void);                       // Run one pass of the reader. Return true if there was anything to do
+  void readerYield(void);                         // Sleep for one tick / 1ms
+  void readerPushLine(char *line, size_t len);   // Check a complete sentence and push it into the event queue
+  void readerExtractBacklog(void);                // Move the sentences captured in the backlog during a command into the event queue
+  friend class SWARM_M138_Reader_Pause;
+  void pauseReader(void);                         // Stop the reader task framing, if threaded mode is active. Commands still run. Nests
+  void resumeReader(void);                        // Let it continue
+  bool postToReader(uint8_t type, const char *command, const char *expectedResponseStart, const char *expectedErrorStart,
+                    char *responseDest, size_t destSize, unsigned long timeout, Swarm_M138_Error_e *result); // Post a request if in threaded mode. Return false if not
+#endif
+  Swarm_M138_Event_Type_e eventType(const char *sentence); // Return the event type from the sentence tag
+
+  // Typed event queue
+  Swarm_M138_Typed_Events_t *_typedEvents; // Allocated by enableTypedEvents. NULL if the queue is disabled
+  Swarm_M138_Typed_Event_t *typedEventPush(Swarm_M138_Event_Type_e type); // Return the slot for a new event. NULL if the queue is disabled or the event was dropped
+
+  // Subscriptions
+  swarm_m138_shared_uint16_t _subscriptionMask;       // SWARM_M138_SUBSCRIBE_AUTO, or the explicit mask
+  swarm_m138_shared_uint16_t _subscriptionAsync;      // Types awaited by coroutines. Always kept
+  Swarm_M138_Subscription_Sampling_t *_subscriptionSampling; // Allocated by setSubscriptionSampling. NULL if every message is kept
+  swarm_m138_shared_uint32_t _subscriptionFiltered;
+
+  // URC handler registry: a bounded hash table. Each bucket is a chain of entries with the same tag hash
+  Swarm_M138_URC_Table_t *_urcTable; // Allocated by enableUrcHandlers. NULL if there are none
+  uint8_t urcBucket(const char *tag, size_t tagLength);                                   // Hash the tag
+  size_t urcTagLength(const char *tag, size_t length);                                    // Return the length of the tag: up to the first space, comma or asterix
+  Swarm_M138_URC_Handler_t *findUrcHandler(const char *line, size_t length, bool wholePrefix); // Return the handler for the line (longest prefix), or any handler for its tag. NULL if none
+
+  // Backlog occupancy
+  swarm_m138_shared_uint16_t _backlogHighWater;
+  swarm_m138_shared_uint32_t _backlogOverflows;
+  void noteBacklogLength(size_t length); // Update the high water mark
+
+  // Receive window
+  Swarm_M138_RX_Window_e _rxWindowMode;
+  uint16_t _rxFifoThreshold;
+  unsigned long rxWindowNow(void);                                         // millis (fixed window) or micros (gap mode)
+  bool rxWindowClosed(const char *data, size_t length, unsigned long lastRx); // Return true when the burst has ended
+  void rxWindowWait(void);                                                 // Wait a little for more data
+
+#ifdef SWARM_M138_ALLOC_HOOKS
+  // Allocation hooks
+  void *(*_allocate)(size_t size, void *context); // NULL = new
+  void (*_release)(void *ptr, size_t size, void *context);
+  void *_allocContext;
+  swarm_m138_shared_uint32_t _allocCount;
+  swarm_m138_shared_uint32_t _freeCount;
+  swarm_m138_shared_uint32_t _allocFailures;
+  swarm_m138_shared_uint32_t _allocBytes;
+  swarm_m138_shared_uint32_t _allocPeak;
+  swarm_m138_shared_uint32_t _allocLargest;
+  friend class SWARM_M138_Alloc_Scope;
+  const char *_allocEntry;                                          // The outermost public function being run. NULL if none
+  Swarm_M138_Alloc_Entry_Stats_t _allocEntries[SWARM_M138_ALLOC_ENTRIES]; // outstanding is not used: getAllocEntryStats calculates it
+  uint8_t _allocEntryCount;
+  uint8_t allocEntryIndex(void);                                    // Return the entry for _allocEntry. Add it if required
+#endif
+
+  // Wire trace
+  Swarm_M138_Trace_Ring_t *_traceRing; // Allocated by enableTrace. NULL if the trace is not recorded in RAM
+  Print *_tracePort;   // NULL if the trace is not streamed
+  uint32_t _traceDropped;
+  void traceBytes(char direction, const char *data, size_t len); // Record data. Long data is split into records of up to 255 bytes
+  void tracePut(const uint8_t *data, size_t len);                // Copy into the ring buffer. The caller makes room first
+
+  // Adaptive timeouts
+  Swarm_M138_Adaptive_Timeouts_t *_adaptiveTimeouts; // Allocated by enableAdaptiveTimeouts. NULL if the timeouts are fixed
+  Swarm_M138_Timeout_Class_t *timeoutClass(unsigned long fixedTimeout, bool create); // Find (or create) the class. NULL if there is none
+  unsigned long adaptiveLimit(Swarm_M138_Timeout_Class_t *timeoutClass, unsigned long fixedTimeout); // Return the clamped timeout for a silent modem
+  unsigned long adaptiveCeiling(unsigned long fixedTimeout);          // Return the longer of the ceiling and fixedTimeout
+  void learnResponseTime(Swarm_M138_Timeout_Class_t *timeoutClass, unsigned long responseTime);     // Update the estimate
+
+#ifdef SWARM_M138_STATS
+  // Statistics. Updated by the task which talks to the modem (the reader task in threaded mode)
+  swarm_m138_shared_uint16_t _statsHistogram[SWARM_M138_STATS_TAGS][SWARM_M138_STATS_BUCKETS];
+  swarm_m138_shared_uint16_t _statsTimeouts[SWARM_M138_STATS_TAGS];
+  swarm_m138_shared_uint16_t _statsErrors[SWARM_M138_STATS_TAGS];
+  swarm_m138_shared_uint16_t _statsChecksumFailures[SWARM_M138_STATS_TAGS];
+  swarm_m138_shared_uint32_t _statsResponseOverflows;
+  swarm_m138_shared_uint32_t _statsEventChecksumFailures;
+  swarm_m138_shared_uint32_t _statsEventMemoryFailures;
+  uint32_t _statsBacklogOverflowsAtReset; // getBacklogOverflows counts from resetBacklogStats. The stats count from resetStats
+  unsigned long _statsResetAt;
+  uint8_t _statsTag;           // The tag of the command in flight
+  unsigned long _statsSentAt;  // When it was sent
+  uint8_t statsTagIndex(const char *command); // Return the index of the command's tag
+  void noteCommandStats(uint8_t tag, Swarm_M138_Error_e err, unsigned long responseTime); // Count the result of a command
+  void statsIncrement(swarm_m138_shared_uint16_t &counter); // Add one. Stop at 65535
+#endif
+
+  uint16_t subscriptionsNeeded(void);                 // Return the types needed by the callbacks and library features
+  uint16_t subscriptionsRequired(void);               // Return the types the enabled library features cannot work without. Always kept
+  bool subscribed(const char *line);                  // Return true if the line's type is subscribed (no sampling). Used by pruneBacklog
+  bool acceptEvent(const char *line);                 // Called by the framers once the tag is known. Apply the subscriptions and sampling
+
+  // Interrupt / DMA receive path
+  Swarm_M138_RX_Ring_t *_rxRing; // Allocated by enableRxHook. NULL if the serial port is read directly
+  int rxRingAvailable(void);           // Return the number of bytes waiting in the ring buffer
+  int rxRingRead(char *buf, int len); // Read up to len bytes from the ring buffer
+
+#ifdef SWARM_M138_COROUTINES_AVAILABLE
+  // Coroutine command API
+  friend class SWARM_M138_Awaitable;
+  SWARM_M138_Awaitable *_asyncPending;  // The suspended awaiters, oldest first. NULL if there are none
+  SWARM_M138_Awaitable *_asyncCommand;  // The awaiter whose command has been sent. NULL if the modem is idle
+  void asyncLink(SWARM_M138_Awaitable *awaitable);     // Add a suspended awaiter to the end of the list. Send its command if the modem is idle
+  void asyncUnlink(SWARM_M138_Awaitable *awaitable);   // Remove an awaiter from the list
+  void asyncSendNext(void);                            // Send the oldest unsent command
+  bool asyncOfferLine(const char *line);               // Return true if line is the response to the command in flight
+  void asyncOfferEvent(const char *line);              // Complete any nextEvent awaiters which want this message
+  bool asyncKeepLine(const char *line);                // Return true if pruneBacklog must keep this line for an awaiter
+  void asyncService(void);                             // Check for timeouts and delays. Resume the ready coroutines
+  void sendCommandAsync(const char *command);          // Send a command. The response is collected by checkUnsolicitedMsg
+  void asyncUpdateSubscriptions(void);                 // Make sure the framers keep the messages the awaiters need
+  SWARM_M138_Awaitable transmitAsync(const char *text, const uint8_t *data, size_t len, uint64_t *msg_id, bool useAppID, uint16_t appID); // Build the $TD command
+#endif
+
+  // Parse the $DT, $GN, $MM / $MT count and $TD OK responses. Used by the blocking and async commands
+  Swarm_M138_Error_e parseDateTime(const char *response, Swarm_M138_DateTimeData_t *dateTime);
+  Swarm_M138_Error_e parseGeospatialInfo(const char *response, Swarm_M138_GeospatialData_t *info);
+  Swarm_M138_Error_e parseMessageCount(const char *response, const char *tag, uint16_t *count);
+  Swarm_M138_Error_e parseTransmitResponse(const char *response, uint64_t *msg_id); // Also adds the message to the TX queue mirror
+
+  // Check the sign of a fixed-point field. %d loses the sign of values like -0.5
+  bool fieldIsNegative(const char *sentence, uint8_t field); // field 0 is the first after the tag
 
   // Add the two NMEA checksum bytes and line feed to a command
   void addChecksumLF(char *command);
@@ -461,8 +1586,11 @@ private:
   // Common code for readMessage / readOldestMessage / readNewestMessage
   Swarm_M138_Error_e readMessageInternal(const char mode, uint64_t msg_id_in, char *asciiHex, size_t len, uint64_t *msg_id_out, uint32_t *epoch, uint16_t *appID);
 
+  // Decode a $MM AI= response into binary. Used by drainRxMessages
+  Swarm_M138_Error_e decodeRxMessage(const char *response, uint8_t *data, size_t *len, uint64_t *msg_id, uint32_t *epoch, uint16_t *appID);
+
   bool initializeBuffers(void);
-  bool processUnsolicitedEvent(const char *event);
+  bool processUnsolicitedEvent(char *event, size_t length); // Not const: the $RD payload and $M138 data are null-terminated in place (then restored)
   void pruneBacklog(void);
 
   // Support for Qwiic Swarm
@@ -482,8 +1610,10 @@ private:
 // Qwiic Iridium ATtiny841 I2C buffer length
 #define QWIIC_SWARM_I2C_BUFFER_LENGTH 32
 
-  // Memory allocation
+  // Memory allocation. Everything goes through swarm_m138_alloc, so the allocation hooks see it
 
+  void *swarm_m138_alloc(size_t num);
+  void swarm_m138_free(void *freeMe);
   char *swarm_m138_alloc_char(size_t num);
   void swarm_m138_free_char(char *freeMe);
 